@@ -9,7 +9,8 @@ LOCAL_SRC_FILES := \
 	bitbase.cpp      main.cpp      movepick.cpp  uci.cpp \
 	bitboard.cpp     pawns.cpp     ucioption.cpp \
 	book.cpp         material.cpp  position.cpp \
-	endgame.cpp      misc.cpp      timeman.cpp   thread.cpp
+	endgame.cpp      misc.cpp      timeman.cpp   thread.cpp \
+	analysis.cpp
 
 LOCAL_CFLAGS    := -I$(LOCAL_PATH)/../stlport/stlport \
 	 -mandroid \
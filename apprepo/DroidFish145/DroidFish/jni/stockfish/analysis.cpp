@@ -0,0 +1,421 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2012 Marco Costalba, Joona Kiiski, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#  include <fcntl.h>
+#  include <sys/file.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#include "analysis.h"
+#include "bitboard.h"
+
+AnalysisStore Analysis; // Our global analysis store
+
+namespace {
+
+  // The file starts with a StoreHeader of the size of a cache line, followed
+  // by a power of 2 number of AnalysisSlot. Integers are in native byte order.
+  struct StoreHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t slotSize;
+    uint64_t slots;
+    uint64_t count;
+    char padding[32];
+  };
+
+  const char StoreMagic[8] = { 'S', 'F', 'A', 'N', 'A', 'L', 'Y', 'S' };
+  const uint32_t StoreVersion = 1;
+
+  // Number of consecutive slots scanned by probe() and store()
+  const int MaxProbes = 8;
+
+  // A reader gives up after this number of tries on a slot being written, for
+  // instance by another process that crashed in the middle of an update.
+  const int MaxReadTries = 64;
+
+  inline StoreHeader* header(char* base) { return (StoreHeader*)base; }
+
+  void to_result(const AnalysisSlot& s, AnalysisResult& r) {
+
+    r.key = s.key;
+    r.depth = s.depth;
+    r.score = Value(s.score);
+    r.nodes = s.nodes;
+    r.pv.clear();
+
+    for (int i = 0; i < s.pvLength; i++)
+        r.pv.push_back(Move(s.pv[i]));
+  }
+}
+
+
+AnalysisStore::AnalysisStore() {
+
+  fd = -1;
+  base = NULL;
+  slots = NULL;
+  len = size = 0;
+  probes = hits = 0;
+}
+
+AnalysisStore::~AnalysisStore() {
+
+  close();
+}
+
+
+/// AnalysisStore::open() maps the given file, creating it with a size of
+/// mbSize megabytes if it does not exist. The size of an existing file is
+/// kept. Returns false if the file cannot be mapped or is not a valid store.
+
+bool AnalysisStore::open(const std::string& f, size_t mbSize) {
+
+  close();
+
+  return map(f, 1ULL << msb((mbSize << 20) / sizeof(AnalysisSlot)));
+}
+
+
+/// AnalysisStore::close() unmaps the file. Stored results are already in the
+/// page cache and will be written back by the operating system.
+
+void AnalysisStore::close() {
+
+#if !defined(_WIN32) && !defined(_WIN64)
+  if (base)
+      munmap(base, len);
+
+  if (fd != -1)
+      ::close(fd);
+#endif
+
+  fd = -1;
+  base = NULL;
+  slots = NULL;
+  len = size = 0;
+}
+
+
+/// AnalysisStore::map() does the actual work of open(). A new file gets
+/// 'slotCnt' empty slots. The file is kept open to lock it while writing.
+
+bool AnalysisStore::map(const std::string& f, size_t slotCnt) {
+
+#if !defined(_WIN32) && !defined(_WIN64)
+  struct stat st;
+  bool created = false;
+
+  fd = ::open(f.c_str(), O_RDWR | O_CREAT, 0644);
+
+  // Lock the file while checking its size, so that two processes creating
+  // the store at the same time do not both initialize it.
+  if (fd == -1 || flock(fd, LOCK_EX) || fstat(fd, &st))
+  {
+      std::cerr << "Unable to open file " << f << std::endl;
+      close();
+      return false;
+  }
+
+  if (st.st_size == 0)
+  {
+      st.st_size = sizeof(StoreHeader) + slotCnt * sizeof(AnalysisSlot);
+      created = true;
+
+      if (ftruncate(fd, st.st_size))
+      {
+          std::cerr << "Failed to allocate analysis store " << f << std::endl;
+          close();
+          return false;
+      }
+  }
+
+  void* p = (size_t)st.st_size >= sizeof(StoreHeader) ?
+            mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+
+  if (p == MAP_FAILED)
+  {
+      std::cerr << f << " is not a valid analysis store" << std::endl;
+      close();
+      return false;
+  }
+
+  base = (char*)p;
+  len = st.st_size;
+  StoreHeader* h = header(base);
+
+  if (created)
+  {
+      memcpy(h->magic, StoreMagic, sizeof(StoreMagic));
+      h->version = StoreVersion;
+      h->slotSize = sizeof(AnalysisSlot);
+      h->slots = slotCnt;
+      h->count = 0;
+  }
+  else if (   memcmp(h->magic, StoreMagic, sizeof(StoreMagic))
+           || h->version != StoreVersion
+           || h->slotSize != sizeof(AnalysisSlot)
+           || !h->slots
+           || (h->slots & (h->slots - 1))
+           || len != sizeof(StoreHeader) + h->slots * sizeof(AnalysisSlot))
+  {
+      std::cerr << f << " is not a valid analysis store" << std::endl;
+      close();
+      return false;
+  }
+
+  flock(fd, LOCK_UN);
+  fileName = f;
+  size = h->slots;
+  slots = (AnalysisSlot*)(base + sizeof(StoreHeader));
+  return true;
+#else
+  (void)slotCnt;
+  std::cerr << "Analysis store is not supported on this platform" << std::endl;
+  return false;
+#endif
+}
+
+
+/// AnalysisStore::read_slot() takes a consistent copy of a slot without
+/// locking, retrying while a writer is updating it. Returns false if no
+/// consistent copy could be read.
+
+bool AnalysisStore::read_slot(const AnalysisSlot* s, AnalysisSlot& copy) const {
+
+  for (int i = 0; i < MaxReadTries; i++)
+  {
+      uint32_t seq = s->sequence;
+
+      if (seq & 1)
+          continue;
+
+      memory_barrier();
+      memcpy((void*)&copy, (const void*)s, sizeof(AnalysisSlot));
+      memory_barrier();
+
+      if (s->sequence == seq)
+          return true;
+  }
+  return false;
+}
+
+
+/// AnalysisStore::write_slot() overwrites a slot. Caller must hold the lock.
+/// The sequence is made odd rather than incremented, in case a writer that
+/// crashed in the middle of an update left it odd.
+
+void AnalysisStore::write_slot(AnalysisSlot* s, const AnalysisSlot& copy) {
+
+  const size_t offset = sizeof(s->sequence);
+  uint32_t seq = s->sequence | 1;
+
+  s->sequence = seq;
+  memory_barrier();
+  memcpy((char*)s + offset, (const char*)&copy + offset, sizeof(AnalysisSlot) - offset);
+  memory_barrier();
+  s->sequence = seq + 1;
+}
+
+
+/// AnalysisStore::lock() and unlock() serialize the writers: threads of this
+/// process with the mutex, other processes with an exclusive lock on the file.
+
+void AnalysisStore::lock() {
+
+  mutex.lock();
+
+#if !defined(_WIN32) && !defined(_WIN64)
+  while (flock(fd, LOCK_EX) && errno == EINTR) {}
+#endif
+}
+
+void AnalysisStore::unlock() {
+
+#if !defined(_WIN32) && !defined(_WIN64)
+  flock(fd, LOCK_UN);
+#endif
+
+  mutex.unlock();
+}
+
+
+/// AnalysisStore::probe() looks up a position and returns true, filling 'r',
+/// if a result searched at least at the given depth is found.
+
+bool AnalysisStore::probe(Key key, int depth, AnalysisResult& r) {
+
+  AnalysisSlot copy;
+
+  probes++;
+
+  for (int i = 0; i < MaxProbes; i++)
+  {
+      if (!read_slot(&slots[(key + i) & (size - 1)], copy))
+          continue;
+
+      if (!copy.key)
+          return false;
+
+      if (copy.key != key)
+          continue;
+
+      if (copy.depth < depth)
+          return false;
+
+      to_result(copy, r);
+      hits++;
+      return true;
+  }
+  return false;
+}
+
+
+/// AnalysisStore::store() saves a search result. A result for the same
+/// position is replaced only if not deeper than the new one. When all the
+/// probed slots are in use the shallowest result is evicted.
+
+void AnalysisStore::store(const AnalysisResult& r) {
+
+  AnalysisSlot e;
+  memset(&e, 0, sizeof(AnalysisSlot));
+
+  e.key = r.key;
+  e.depth = (int16_t)r.depth;
+  e.nodes = r.nodes;
+  e.score = r.score;
+
+  while (   e.pvLength < AnalysisSlot::MaxPvLength
+         && e.pvLength < r.pv.size()
+         && r.pv[e.pvLength] != MOVE_NONE)
+      e.pv[e.pvLength] = (uint16_t)r.pv[e.pvLength], e.pvLength++;
+
+  lock();
+
+  AnalysisSlot* replace = NULL;
+
+  for (int i = 0; i < MaxProbes; i++)
+  {
+      AnalysisSlot* s = &slots[(e.key + i) & (size - 1)];
+
+      if (!s->key)
+      {
+          write_slot(s, e);
+          header(base)->count++;
+          unlock();
+          return;
+      }
+
+      if (s->key == e.key)
+      {
+          replace = (s->depth <= e.depth ? s : NULL);
+          break;
+      }
+
+      if (!replace || s->depth < replace->depth)
+          replace = s;
+  }
+
+  if (replace && replace->depth <= e.depth)
+      write_slot(replace, e);
+
+  unlock();
+}
+
+
+/// AnalysisStore::compact() rewrites the store dropping the results shallower
+/// than minDepth, and resizes it to twice the number of the remaining ones, so
+/// that probe sequences are short again. The new file replaces the old one by
+/// rename, so other processes keep using the old copy, and what they store is
+/// lost, until they reopen the store. Must not be called while searching.
+
+bool AnalysisStore::compact(int minDepth) {
+
+  if (!is_open())
+      return false;
+
+  AnalysisStore tmp;
+  AnalysisSlot copy;
+  AnalysisResult r;
+  size_t cnt = 0, newSize = 1024;
+  std::string tmpName = fileName + ".tmp";
+
+  lock();
+
+  for (size_t i = 0; i < size; i++)
+      if (slots[i].key && slots[i].depth >= minDepth)
+          cnt++;
+
+  while (newSize < 2 * cnt)
+      newSize *= 2;
+
+  remove(tmpName.c_str());
+
+  if (!tmp.map(tmpName, newSize))
+  {
+      unlock();
+      return false;
+  }
+
+  for (size_t i = 0; i < size; i++)
+      if (read_slot(&slots[i], copy) && copy.key && copy.depth >= minDepth)
+      {
+          to_result(copy, r);
+          tmp.store(r);
+      }
+
+  tmp.close();
+
+  std::string name = fileName;
+  bool ok = !rename(tmpName.c_str(), name.c_str());
+
+  close(); // Also releases the file lock
+  ok = map(name, 0) && ok;
+
+  mutex.unlock();
+  return ok;
+}
+
+
+/// AnalysisStore::stats() returns a description of the store occupancy and of
+/// the hit rate of the probes done by this process.
+
+const std::string AnalysisStore::stats() const {
+
+  std::stringstream s;
+
+  if (!is_open())
+      return "Analysis store not in use";
+
+  s << "Analysis store " << fileName
+    << ": " << header(base)->count << " results in " << size << " slots"
+    << ", probes " << probes << ", hits " << hits
+    << ", hit rate (%) " << (probes ? 100 * hits / probes : 0);
+
+  return s.str();
+}
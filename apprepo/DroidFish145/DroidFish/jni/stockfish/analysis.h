@@ -0,0 +1,103 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2012 Marco Costalba, Joona Kiiski, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if !defined(ANALYSIS_H_INCLUDED)
+#define ANALYSIS_H_INCLUDED
+
+#include <string>
+#include <vector>
+
+#include "thread.h"
+#include "types.h"
+
+/// AnalysisResult is the outcome of a completed search: the position key, the
+/// depth of the last completed iteration, the score, the number of searched
+/// nodes and the principal variation.
+
+struct AnalysisResult {
+  Key key;
+  int depth;
+  Value score;
+  int64_t nodes;
+  std::vector<Move> pv;
+};
+
+
+/// AnalysisSlot is the on-disk layout of a stored result, exactly one cache
+/// line. The 'sequence' field is a seqlock: it is odd while a writer updates
+/// the slot, so that readers never need to take a lock.
+
+struct AnalysisSlot {
+
+  static const int MaxPvLength = 18;
+
+  volatile uint32_t sequence;
+  int16_t depth;
+  uint16_t pvLength;
+  uint64_t key;
+  int64_t nodes;
+  int32_t score;
+  uint16_t pv[MaxPvLength];
+};
+
+
+/// The AnalysisStore class is a persistent, memory mapped hash table of search
+/// results, used to avoid searching again positions already analysed at the
+/// same or bigger depth, also by a previous run or by another process sharing
+/// the same file. Results are indexed by position key and looked up by minimum
+/// depth. Any number of readers can probe the store concurrently with a writer.
+/// Writers are serialized by a mutex within the process and by an exclusive
+/// lock on the file between processes.
+
+class AnalysisStore {
+
+  AnalysisStore(const AnalysisStore&);
+  AnalysisStore& operator=(const AnalysisStore&);
+
+public:
+  AnalysisStore();
+ ~AnalysisStore();
+  bool open(const std::string& fileName, size_t mbSize);
+  void close();
+  bool is_open() const { return slots != NULL; }
+  bool probe(Key key, int depth, AnalysisResult& r);
+  void store(const AnalysisResult& r);
+  bool compact(int minDepth);
+  const std::string stats() const;
+
+private:
+  bool map(const std::string& fileName, size_t slotCnt);
+  bool read_slot(const AnalysisSlot* s, AnalysisSlot& copy) const;
+  void write_slot(AnalysisSlot* s, const AnalysisSlot& copy);
+  void lock();
+  void unlock();
+
+  std::string fileName;
+  int fd;
+  char* base;
+  size_t len;
+  AnalysisSlot* slots;
+  size_t size;
+  Mutex mutex;
+  volatile uint64_t probes, hits;
+};
+
+extern AnalysisStore Analysis;
+
+#endif // !defined(ANALYSIS_H_INCLUDED)
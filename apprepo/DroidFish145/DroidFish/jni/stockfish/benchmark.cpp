@@ -109,7 +109,7 @@ void benchmark(const Position& current, istream& is) {
       file.close();
   }
 
-  int64_t nodes = 0;
+  int64_t nodes = 0, wakeups = 0, wakeupTime = 0;
   Search::StateStackPtr st;
   Time::point elapsed = Time::now();
 
@@ -130,6 +130,8 @@ void benchmark(const Position& current, istream& is) {
           Threads.start_searching(pos, limits, vector<Move>(), st);
           Threads.wait_for_search_finished();
           nodes += Search::RootPosition.nodes_searched();
+          wakeups += Threads.split_wakeups();
+          wakeupTime += Threads.split_wakeup_time();
       }
   }
 
@@ -138,5 +140,7 @@ void benchmark(const Position& current, istream& is) {
   cerr << "\n==========================="
        << "\nTotal time (ms) : " << elapsed
        << "\nNodes searched  : " << nodes
-       << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+       << "\nNodes/second    : " << 1000 * nodes / elapsed
+       << "\nSplit wakeups   : " << wakeups
+       << "\nWakeup (usec)   : " << (wakeups ? double(wakeupTime) / wakeups : 0.0) << endl;
 }
@@ -28,6 +28,10 @@
 #    include <sys/pstat.h>
 #endif
 
+#if defined(__linux__) && !defined(__ANDROID__)
+#    include <sched.h>
+#endif
+
 using namespace std;
 
 /// Version number. If Version is left empty, then Tag plus current
@@ -74,6 +78,10 @@ Time::point Time::now() {
   sys_time_t t; system_time(&t); return time_to_msec(t);
 }
 
+int64_t Time::now_usec() {
+  sys_time_t t; system_time(&t); return time_to_usec(t);
+}
+
 
 /// Debug functions used mainly to collect run-time statistics
 
@@ -199,6 +207,82 @@ int cpu_count() {
 }
 
 
+/// cpus_by_node() returns the list of the available CPUs ordered by NUMA node,
+/// so that consecutive entries share the same memory controller. When topology
+/// is unknown CPUs are simply numbered from 0 to cpu_count() - 1.
+
+std::vector<int> cpus_by_node() {
+
+  std::vector<int> cpus;
+
+#if defined(__linux__) && !defined(__ANDROID__)
+  for (int node = 0; true; node++)
+  {
+      stringstream name;
+      name << "/sys/devices/system/node/node" << node << "/cpulist";
+
+      ifstream f(name.str().c_str());
+      string range;
+
+      if (!f.is_open())
+          break;
+
+      // Format is a comma separated list of single CPUs or ranges, like "0-7,16"
+      while (getline(f, range, ','))
+      {
+          int first, last;
+          char dash;
+          stringstream ss(range);
+
+          if (!(ss >> first))
+              continue;
+
+          if (!(ss >> dash >> last))
+              last = first;
+
+          for (int cpu = first; cpu <= last; cpu++)
+              cpus.push_back(cpu);
+      }
+  }
+#endif
+
+  if (cpus.empty())
+      for (int cpu = 0; cpu < cpu_count(); cpu++)
+          cpus.push_back(cpu);
+
+  return cpus;
+}
+
+
+/// bind_to_cpu() restricts the calling thread to run on the given CPU, or on
+/// any CPU available to the process if cpu is negative. Not supported on all
+/// the platforms, in this case does nothing.
+
+void bind_to_cpu(int cpu) {
+
+#if defined(_WIN32) || defined(_WIN64)
+  DWORD_PTR processMask, systemMask;
+
+  if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+      SetThreadAffinityMask(GetCurrentThread(), cpu < 0 ? processMask : DWORD_PTR(1) << cpu);
+
+#elif defined(__linux__) && !defined(__ANDROID__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+
+  if (cpu < 0)
+      for (int i = 0; i < CPU_SETSIZE; i++)
+          CPU_SET(i, &set);
+  else
+      CPU_SET(cpu, &set);
+
+  sched_setaffinity(0, sizeof(cpu_set_t), &set);
+#else
+  (void)cpu;
+#endif
+}
+
+
 /// timed_wait() waits for msec milliseconds. It is mainly an helper to wrap
 /// conversion from milliseconds to struct timespec, as used by pthreads.
 
@@ -28,6 +28,8 @@
 
 extern const std::string engine_info(bool to_uci = false);
 extern int cpu_count();
+extern std::vector<int> cpus_by_node();
+extern void bind_to_cpu(int cpu);
 extern void timed_wait(WaitCondition&, Lock&, int);
 extern void prefetch(char* addr);
 extern void start_logger(bool b);
@@ -47,6 +49,7 @@ struct Log : public std::ofstream {
 namespace Time {
   typedef int64_t point;
   point now();
+  int64_t now_usec();
 }
 
 
@@ -55,6 +58,10 @@ struct HashTable {
   HashTable() : e(Size, Entry()) {}
   Entry* operator[](Key k) { return &e[(uint32_t)k & (Size - 1)]; }
 
+  // Reallocate the table from the calling thread, so that with a first touch
+  // NUMA policy memory is placed on the node the thread is running on.
+  void reset() { std::vector<Entry>(Size, Entry()).swap(e); }
+
 private:
   std::vector<Entry> e;
 };
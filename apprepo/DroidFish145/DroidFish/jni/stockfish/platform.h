@@ -49,6 +49,7 @@ typedef timeval sys_time_t;
 
 inline void system_time(sys_time_t* t) { gettimeofday(t, NULL); }
 inline int64_t time_to_msec(const sys_time_t& t) { return t.tv_sec * 1000LL + t.tv_usec / 1000; }
+inline int64_t time_to_usec(const sys_time_t& t) { return t.tv_sec * 1000000LL + t.tv_usec; }
 
 #  include <pthread.h>
 typedef pthread_mutex_t Lock;
@@ -67,6 +68,7 @@ typedef void*(*pt_start_fn)(void*);
 #  define cond_timedwait(x,y,z) pthread_cond_timedwait(&(x),&(y),z)
 #  define thread_create(x,f,t) !pthread_create(&(x),NULL,(pt_start_fn)f,t)
 #  define thread_join(x) pthread_join(x, NULL)
+#  define memory_barrier() __sync_synchronize()
 
 #else // Windows and MinGW
 
@@ -75,6 +77,7 @@ typedef _timeb sys_time_t;
 
 inline void system_time(sys_time_t* t) { _ftime(t); }
 inline int64_t time_to_msec(const sys_time_t& t) { return t.time * 1000LL + t.millitm; }
+inline int64_t time_to_usec(const sys_time_t& t) { return t.time * 1000000LL + t.millitm * 1000LL; }
 
 #if !defined(NOMINMAX)
 #  define NOMINMAX // disable macros min() and max()
@@ -103,7 +106,17 @@ typedef HANDLE NativeHandle;
 #  define cond_timedwait(x,y,z) { lock_release(y); WaitForSingleObject(x,z); lock_grab(y); }
 #  define thread_create(x,f,t) (x = CreateThread(NULL,0,(LPTHREAD_START_ROUTINE)f,t,0,NULL), x != NULL)
 #  define thread_join(x) { WaitForSingleObject(x, INFINITE); CloseHandle(x); }
+#  define memory_barrier() MemoryBarrier()
 
 #endif
 
+// Hint to the CPU that we are in a spin-wait loop
+#if defined(_MSC_VER)
+#  define cpu_relax() YieldProcessor()
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#  define cpu_relax() __builtin_ia32_pause()
+#else
+#  define cpu_relax()
+#endif
+
 #endif // !defined(PLATFORM_H_INCLUDED)
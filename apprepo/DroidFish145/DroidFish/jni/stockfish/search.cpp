@@ -24,6 +24,7 @@
 #include <iostream>
 #include <sstream>
 
+#include "analysis.h"
 #include "book.h"
 #include "evaluate.h"
 #include "history.h"
@@ -129,7 +130,10 @@ namespace {
   template <NodeType NT>
   Value qsearch(Position& pos, Stack* ss, Value alpha, Value beta, Depth depth);
 
-  void id_loop(Position& pos);
+  void id_loop(Position& pos, AnalysisResult& completed);
+  bool analysis_store_usable(const Position& pos);
+  bool probe_analysis(const Position& pos);
+  void save_analysis(const Position& pos, AnalysisResult& completed);
   bool check_is_dangerous(Position &pos, Move move, Value futilityBase, Value beta);
   bool connected_moves(const Position& pos, Move m1, Move m2);
   Value value_to_tt(Value v, int ply);
@@ -227,6 +231,7 @@ void Search::think() {
   static PolyglotBook book; // Defined static to initialize the PRNG only once
 
   Position& pos = RootPosition;
+  AnalysisResult completed;
   Chess960 = pos.is_chess960();
   Eval::RootColor = pos.side_to_move();
   TimeMgr.init(Limits, pos.startpos_ply_counter(), pos.side_to_move());
@@ -261,6 +266,14 @@ void Search::think() {
   SkillLevelEnabled = (SkillLevel < 20);
   MultiPV = (SkillLevelEnabled ? std::max(UCIMultiPV, (size_t)4) : UCIMultiPV);
 
+  // Fixed depth searches can be answered by a previous search of the same
+  // position at the same or bigger depth.
+  if (   Limits.depth
+      && !Limits.infinite
+      && analysis_store_usable(pos)
+      && probe_analysis(pos))
+      goto finalize;
+
   if (Options["Use Search Log"])
   {
       Log log(Options["Search Log Filename"]);
@@ -283,11 +296,14 @@ void Search::think() {
       Threads.set_timer(100);
 
   // We're ready to start searching. Call the iterative deepening loop function
-  id_loop(pos);
+  id_loop(pos, completed);
 
   Threads.set_timer(0); // Stop timer
   Threads.sleep();
 
+  if (completed.depth && analysis_store_usable(pos))
+      save_analysis(pos, completed);
+
   if (Options["Use Search Log"])
   {
       Time::point elapsed = Time::now() - SearchTime + 1;
@@ -321,9 +337,10 @@ namespace {
 
   // id_loop() is the main iterative deepening loop. It calls search() repeatedly
   // with increasing depth until the allocated thinking time has been consumed,
-  // user stops the search, or the maximum search depth is reached.
+  // user stops the search, or the maximum search depth is reached. The result
+  // of the last iteration that has not been interrupted is kept in 'completed'.
 
-  void id_loop(Position& pos) {
+  void id_loop(Position& pos, AnalysisResult& completed) {
 
     Stack ss[MAX_PLY_PLUS_2];
     int depth, prevBestMoveChanges;
@@ -335,6 +352,7 @@ namespace {
     depth = BestMoveChanges = 0;
     bestValue = delta = -VALUE_INFINITE;
     ss->currentMove = MOVE_NULL; // Hack to skip update gains
+    completed.depth = 0;
 
     // Iterative deepening loop until requested to stop or target depth reached
     while (!Signals.stop && ++depth <= MAX_PLY && (!Limits.depth || depth <= Limits.depth))
@@ -431,6 +449,16 @@ namespace {
             }
         }
 
+        // An interrupted iteration may have left a partially searched move
+        // at the front, so remember the result of the last complete one.
+        if (!Signals.stop)
+        {
+            completed.depth = depth;
+            completed.score = RootMoves[0].score;
+            completed.nodes = pos.nodes_searched();
+            completed.pv = RootMoves[0].pv;
+        }
+
         // Skills: Do we need to pick now the best move ?
         if (SkillLevelEnabled && depth == 1 + SkillLevel)
             skillBest = do_skill_level();
@@ -501,6 +529,62 @@ namespace {
   }
 
 
+  // analysis_store_usable() checks if the result of the current search can be
+  // looked up in, or saved to, the analysis store. This is true only for full
+  // strength single PV searches of all the legal root moves.
+
+  bool analysis_store_usable(const Position& pos) {
+
+    return   Analysis.is_open()
+          && MultiPV == 1
+          && !SkillLevelEnabled
+          && RootMoves.size() == MoveList<LEGAL>(pos).size();
+  }
+
+
+  // probe_analysis() looks up the root position in the analysis store and, in
+  // case of success, sets up the first root move as if it was just searched.
+
+  bool probe_analysis(const Position& pos) {
+
+    AnalysisResult r;
+
+    if (   !Analysis.probe(pos.key(), Limits.depth, r)
+        || r.pv.empty()
+        || !std::count(RootMoves.begin(), RootMoves.end(), r.pv[0]))
+        return false;
+
+    std::swap(RootMoves[0], *std::find(RootMoves.begin(), RootMoves.end(), r.pv[0]));
+    RootMoves[0].score = r.score;
+    RootMoves[0].pv = r.pv;
+    RootMoves[0].pv.push_back(MOVE_NONE);
+
+    std::stringstream s;
+
+    s << "info depth " << r.depth
+      << " score "     << score_to_uci(r.score)
+      << " nodes "     << r.nodes
+      << " time "      << Time::now() - SearchTime
+      << " pv";
+
+    for (size_t i = 0; i < r.pv.size(); i++)
+        s << " " << move_to_uci(r.pv[i], Chess960);
+
+    sync_cout << s.str() << sync_endl;
+    return true;
+  }
+
+
+  // save_analysis() saves the result of the last completed iteration of the
+  // search just finished in the analysis store.
+
+  void save_analysis(const Position& pos, AnalysisResult& completed) {
+
+    completed.key = pos.key();
+    Analysis.store(completed);
+  }
+
+
   // search<>() is the main search function for both PV and non-PV nodes and for
   // normal and SplitPoint nodes. When called just after a split point the search
   // is simpler because we have already probed the hash table, done a null move
@@ -1675,6 +1759,9 @@ void Thread::idle_loop() {
               return;
           }
 
+          if (!do_sleep && spin_for_work(sp_master))
+              continue;
+
           // Grab the lock to avoid races with Thread::wake_up()
           mutex.lock();
 
@@ -1707,6 +1794,11 @@ void Thread::idle_loop() {
 
           Threads.mutex.unlock();
 
+          int64_t wakeupTime = Time::now_usec() - sp->startTime;
+
+          if (!splitPointsCnt)
+              bind();
+
           Stack ss[MAX_PLY_PLUS_2];
           Position pos(*sp->pos, this);
 
@@ -1715,6 +1807,12 @@ void Thread::idle_loop() {
 
           sp->mutex.lock();
 
+          if (this != sp->master)
+          {
+              sp->wakeups++;
+              sp->wakeupTime += wakeupTime;
+          }
+
           if (sp->nodeType == Root)
               search<SplitPointRoot>(pos, ss+1, sp->alpha, sp->beta, sp->depth);
           else if (sp->nodeType == PV)
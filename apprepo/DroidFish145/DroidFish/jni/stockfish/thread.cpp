@@ -44,8 +44,9 @@ namespace { extern "C" {
 
 Thread::Thread(Fn fn) {
 
-  is_searching = do_exit = false;
+  is_searching = do_exit = is_spinning = false;
   maxPly = splitPointsCnt = 0;
+  boundCpu = -1;
   curSplitPoint = NULL;
   start_fn = fn;
   idx = Threads.size();
@@ -113,6 +114,7 @@ void Thread::main_loop() {
 
       is_searching = true;
 
+      bind();
       Search::think();
 
       assert(is_searching);
@@ -121,10 +123,18 @@ void Thread::main_loop() {
 
 
 // Thread::wake_up() wakes up the thread, normally at the beginning of the search
-// or, if "sleeping threads" is used at split time.
+// or, if "sleeping threads" is used at split time. A thread spinning in the idle
+// loop will notice the new state by itself, so the costly signal is skipped. The
+// barrier pairs with the one in spin_for_work(): either we see the thread still
+// spinning, or it sees the new state before going to sleep.
 
 void Thread::wake_up() {
 
+  memory_barrier();
+
+  if (is_spinning)
+      return;
+
   mutex.lock();
   sleepCondition.notify_one();
   mutex.unlock();
@@ -148,6 +158,54 @@ void Thread::wait_for_stop_or_ponderhit() {
 }
 
 
+// Thread::spin_for_work() is called by an idle thread before going to sleep. It
+// busy waits for at most "Spin Before Sleep" iterations for new work, or for
+// the slaves of its split point to finish, because often this happens within
+// few microseconds, well below the latency of a wait on a condition variable.
+// Returns true if the thread should not go to sleep.
+
+bool Thread::spin_for_work(const SplitPoint* sp_master) {
+
+  if (!Threads.spin_budget())
+      return false;
+
+  is_spinning = true;
+  memory_barrier();
+
+  for (int i = Threads.spin_budget(); i > 0; i--)
+  {
+      if (do_exit || do_sleep || is_searching || (sp_master && !sp_master->slavesMask))
+          break;
+
+      cpu_relax();
+  }
+
+  is_spinning = false;
+  memory_barrier();
+
+  return do_exit || (is_searching && !do_sleep);
+}
+
+
+// Thread::bind() pins the thread to the CPU assigned by the pool, or unpins it
+// if binding is disabled. When the CPU changes pawn and material tables are
+// reallocated by the thread itself, so to be local to its NUMA node. Must be
+// called only when the thread is not searching any split point.
+
+void Thread::bind() {
+
+  int cpu = Threads.cpu_for(idx);
+
+  if (cpu == boundCpu)
+      return;
+
+  bind_to_cpu(cpu);
+  boundCpu = cpu;
+  materialTable.entries.reset();
+  pawnTable.entries.reset();
+}
+
+
 // Thread::cutoff_occurred() checks whether a beta cutoff has occurred in the
 // current active split point, or in some ancestor of the split point.
 
@@ -190,6 +248,8 @@ bool Thread::is_available_to(Thread* master) const {
 
 void ThreadPool::init() {
 
+  cpus = cpus_by_node();
+  splitWakeups = splitWakeupTime = 0;
   timer = new Thread(&Thread::timer_loop);
   threads.push_back(new Thread(&Thread::main_loop));
   read_uci_options();
@@ -217,6 +277,8 @@ void ThreadPool::read_uci_options() {
   maxThreadsPerSplitPoint = Options["Max Threads per Split Point"];
   minimumSplitDepth       = Options["Min Split Depth"] * ONE_PLY;
   useSleepingThreads      = Options["Use Sleeping Threads"];
+  spinBudget              = Options["Spin Before Sleep"];
+  bindThreads             = Options["Bind Threads"];
   size_t requested        = Options["Threads"];
 
   assert(requested > 0);
@@ -318,6 +380,8 @@ Value ThreadPool::split(Position& pos, Stack* ss, Value alpha, Value beta,
   sp.pos = &pos;
   sp.nodes = 0;
   sp.ss = ss;
+  sp.wakeups = sp.wakeupTime = 0;
+  sp.startTime = Time::now_usec();
 
   assert(master->is_searching);
 
@@ -373,6 +437,8 @@ Value ThreadPool::split(Position& pos, Stack* ss, Value alpha, Value beta,
   master->curSplitPoint = sp.parent;
   pos.set_nodes_searched(pos.nodes_searched() + sp.nodes);
   *bestMove = sp.bestMove;
+  splitWakeups += sp.wakeups;
+  splitWakeupTime += sp.wakeupTime;
 
   mutex.unlock();
   sp.mutex.unlock();
@@ -424,6 +490,7 @@ void ThreadPool::start_searching(const Position& pos, const LimitsType& limits,
 
   RootPosition = pos;
   Limits = limits;
+  splitWakeups = splitWakeupTime = 0;
   SetupStates = states; // Ownership transfer here
   RootMoves.clear();
 
@@ -82,6 +82,11 @@ struct SplitPoint {
   volatile Move bestMove;
   volatile int moveCount;
   volatile bool cutoff;
+
+  // Wake up statistics, updated by the slaves
+  int64_t startTime;
+  int64_t wakeups;
+  int64_t wakeupTime;
 };
 
 
@@ -105,12 +110,15 @@ public:
   void main_loop();
   void timer_loop();
   void wait_for_stop_or_ponderhit();
+  bool spin_for_work(const SplitPoint* sp_master);
+  void bind();
 
   SplitPoint splitPoints[MAX_SPLITPOINTS_PER_THREAD];
   MaterialTable materialTable;
   PawnTable pawnTable;
   size_t idx;
   int maxPly;
+  int boundCpu;
   Mutex mutex;
   ConditionVariable sleepCondition;
   NativeHandle handle;
@@ -120,6 +128,7 @@ public:
   volatile bool is_searching;
   volatile bool do_sleep;
   volatile bool do_exit;
+  volatile bool is_spinning;
 };
 
 
@@ -136,6 +145,10 @@ public:
   Thread& operator[](size_t id) { return *threads[id]; }
   bool use_sleeping_threads() const { return useSleepingThreads; }
   int min_split_depth() const { return minimumSplitDepth; }
+  int spin_budget() const { return spinBudget; }
+  int cpu_for(size_t id) const { return bindThreads ? cpus[id % cpus.size()] : -1; }
+  int64_t split_wakeups() const { return splitWakeups; }
+  int64_t split_wakeup_time() const { return splitWakeupTime; }
   size_t size() const { return threads.size(); }
   Thread* main_thread() { return threads[0]; }
 
@@ -161,6 +174,10 @@ private:
   Depth minimumSplitDepth;
   int maxThreadsPerSplitPoint;
   bool useSleepingThreads;
+  int spinBudget;
+  bool bindThreads;
+  std::vector<int> cpus;
+  int64_t splitWakeups, splitWakeupTime;
 };
 
 extern ThreadPool Threads;
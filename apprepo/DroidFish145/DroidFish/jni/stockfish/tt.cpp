@@ -18,13 +18,110 @@
 */
 
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <vector>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
 
 #include "bitboard.h"
 #include "tt.h"
 
 TranspositionTable TT; // Our global transposition table
 
+namespace {
+
+  /// A snapshot file starts with a SnapshotHeader followed by 'count' records,
+  /// one for each non-empty entry of the table. Only the cluster index and the
+  /// 128 bits of the entry are stored, so the low bits of the position key must
+  /// be recovered from the index: a snapshot can be loaded in a table of the same
+  /// size or smaller, but not in a bigger one.
+
+  const char SnapshotMagic[8] = { 'S', 'F', 'T', 'T', 'S', 'N', 'A', 'P' };
+  const uint32_t SnapshotVersion = 1;
+
+  struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entrySize;
+    uint64_t clusters;
+    uint64_t count;
+    uint32_t generation;
+    uint32_t reserved;
+  };
+
+  struct SnapshotRecord {
+    uint32_t cluster;
+    TTEntry entry;
+  };
+
+
+  /// MappedFile gives read-only access to the whole content of a file. On Unix
+  /// the file is mapped in memory, so that the page cache is used directly and
+  /// a big snapshot is not copied in a temporary buffer before being loaded.
+
+  struct MappedFile {
+
+    MappedFile(const std::string& fileName) : data(NULL), len(0) {
+
+#if !defined(_WIN32) && !defined(_WIN64)
+      struct stat st;
+      int fd = open(fileName.c_str(), O_RDONLY);
+
+      if (fd == -1)
+          return;
+
+      if (!fstat(fd, &st) && st.st_size > 0)
+      {
+          void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+          if (p != MAP_FAILED)
+          {
+              data = (const char*)p;
+              len = st.st_size;
+              madvise(p, len, MADV_SEQUENTIAL);
+          }
+      }
+      close(fd);
+#else
+      std::ifstream f(fileName.c_str(), std::ios::in | std::ios::binary);
+
+      if (!f.is_open())
+          return;
+
+      f.seekg(0, std::ios::end);
+      buf.resize((size_t)f.tellg());
+      f.seekg(0, std::ios::beg);
+
+      if (!buf.empty() && f.read(&buf[0], buf.size()))
+      {
+          data = &buf[0];
+          len = buf.size();
+      }
+#endif
+    }
+
+   ~MappedFile() {
+#if !defined(_WIN32) && !defined(_WIN64)
+      if (data)
+          munmap((void*)data, len);
+#endif
+    }
+
+    const char* data;
+    size_t len;
+
+  private:
+    std::vector<char> buf;
+  };
+
+} // namespace
+
 TranspositionTable::TranspositionTable() {
 
   size = generation = 0;
@@ -139,3 +236,149 @@ TTEntry* TranspositionTable::probe(const Key posKey) const {
 void TranspositionTable::new_search() {
   generation++;
 }
+
+
+/// TranspositionTable::save() writes all the non-empty entries of the table to
+/// a snapshot file, so that the accumulated search knowledge can be restored
+/// later with load(), also by another process or on another machine. Returns
+/// false in case of I/O error.
+
+bool TranspositionTable::save(const std::string& fileName) const {
+
+  std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+  if (!file.is_open())
+  {
+      std::cerr << "Unable to open file " << fileName << std::endl;
+      return false;
+  }
+
+  SnapshotHeader h;
+  memset(&h, 0, sizeof(SnapshotHeader));
+  memcpy(h.magic, SnapshotMagic, sizeof(SnapshotMagic));
+  h.version = SnapshotVersion;
+  h.entrySize = sizeof(TTEntry);
+  h.clusters = size;
+  h.generation = generation;
+
+  // Header is written again at the end, when we know the number of records
+  file.write((const char*)&h, sizeof(SnapshotHeader));
+
+  SnapshotRecord r;
+
+  for (size_t idx = 0; idx < size; idx++)
+      for (int i = 0; i < ClusterSize; i++)
+          if (entries[idx].data[i].key())
+          {
+              r.cluster = (uint32_t)idx;
+              r.entry = entries[idx].data[i];
+              file.write((const char*)&r, sizeof(SnapshotRecord));
+              h.count++;
+          }
+
+  file.seekp(0);
+  file.write((const char*)&h, sizeof(SnapshotHeader));
+  file.close();
+
+  if (file.fail())
+  {
+      std::cerr << "Failed to write transposition table to " << fileName << std::endl;
+      return false;
+  }
+  return true;
+}
+
+
+/// TranspositionTable::load() reads a snapshot written by save(). If 'merge' is
+/// false the table is cleared and its content and generation are replaced by
+/// the snapshot ones. Otherwise the snapshot entries are folded into the live
+/// table as if they were from the previous search, so that the usual depth and
+/// generation rules decide which entries survive. Returns false, leaving the
+/// table untouched, if the file is missing or not a valid snapshot.
+
+bool TranspositionTable::load(const std::string& fileName, bool merge) {
+
+  MappedFile f(fileName);
+
+  if (!f.data)
+  {
+      std::cerr << "Unable to open file " << fileName << std::endl;
+      return false;
+  }
+
+  const SnapshotHeader* h = (const SnapshotHeader*)f.data;
+
+  if (   f.len < sizeof(SnapshotHeader)
+      || memcmp(h->magic, SnapshotMagic, sizeof(SnapshotMagic))
+      || h->version != SnapshotVersion
+      || h->entrySize != sizeof(TTEntry)
+      || (h->clusters & (h->clusters - 1))
+      || h->count > (f.len - sizeof(SnapshotHeader)) / sizeof(SnapshotRecord)
+      || f.len != sizeof(SnapshotHeader) + h->count * sizeof(SnapshotRecord))
+  {
+      std::cerr << fileName << " is not a valid transposition table file" << std::endl;
+      return false;
+  }
+
+  if (h->clusters < size)
+  {
+      std::cerr << "Transposition table in " << fileName << " is smaller than"
+                << " current one, set a lower hash size to load it" << std::endl;
+      return false;
+  }
+
+  if (!merge)
+  {
+      clear();
+      generation = (uint8_t)h->generation;
+  }
+
+  const SnapshotRecord* r = (const SnapshotRecord*)(f.data + sizeof(SnapshotHeader));
+  TTEntry e;
+
+  for (uint64_t n = 0; n < h->count; n++, r++)
+  {
+      e = r->entry;
+
+      if (merge)
+          e.set_generation(generation - 1);
+
+      merge_entry(r->cluster & (size - 1), e);
+  }
+  return true;
+}
+
+
+/// TranspositionTable::merge_entry() inserts an entry in the given cluster. It
+/// uses the same replace strategy of store(), but an already present entry is
+/// kept if deeper and an entry of the current search is never replaced by a
+/// shallower one.
+
+void TranspositionTable::merge_entry(size_t idx, const TTEntry& e) {
+
+  int c1, c2, c3;
+  TTEntry *tte, *replace;
+
+  tte = replace = entries[idx].data;
+
+  for (int i = 0; i < ClusterSize; i++, tte++)
+  {
+      if (!tte->key() || tte->key() == e.key())
+      {
+          if (!tte->key() || tte->depth() <= e.depth())
+              *tte = e;
+
+          return;
+      }
+
+      c1 = (replace->generation() == generation ?  2 : 0);
+      c2 = (tte->generation() == generation || tte->type() == BOUND_EXACT ? -2 : 0);
+      c3 = (tte->depth() < replace->depth() ?  1 : 0);
+
+      if (c1 + c2 + c3 > 0)
+          replace = tte;
+  }
+
+  if (replace->generation() != generation || replace->depth() < e.depth())
+      *replace = e;
+}
@@ -20,6 +20,8 @@
 #if !defined(TT_H_INCLUDED)
 #define TT_H_INCLUDED
 
+#include <string>
+
 #include "misc.h"
 #include "types.h"
 
@@ -105,8 +107,12 @@ public:
   void new_search();
   TTEntry* first_entry(const Key posKey) const;
   void refresh(const TTEntry* tte) const;
+  bool save(const std::string& fileName) const;
+  bool load(const std::string& fileName, bool merge);
 
 private:
+  void merge_entry(size_t idx, const TTEntry& e);
+
   size_t size;
   TTCluster* entries;
   uint8_t generation; // Size must be not bigger then TTEntry::generation8
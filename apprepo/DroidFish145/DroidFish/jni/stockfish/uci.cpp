@@ -21,6 +21,7 @@
 #include <sstream>
 #include <string>
 
+#include "analysis.h"
 #include "evaluate.h"
 #include "notation.h"
 #include "position.h"
@@ -121,6 +122,9 @@ void UCI::loop(const string& args) {
                     << "\nmaterial key: " << pos.material_key()
                     << "\npawn key: "     << pos.pawn_key() << sync_endl;
 
+      else if (token == "analysis")
+          sync_cout << Analysis.stats() << sync_endl;
+
       else if (token == "uci")
           sync_cout << "id name " << engine_info(true)
                     << "\n"       << Options
@@ -22,6 +22,7 @@
 #include <cstdlib>
 #include <sstream>
 
+#include "analysis.h"
 #include "evaluate.h"
 #include "misc.h"
 #include "thread.h"
@@ -40,6 +41,18 @@ void on_eval(const Option&) { Eval::init(); }
 void on_threads(const Option&) { Threads.read_uci_options(); }
 void on_hash_size(const Option& o) { TT.set_size(o); }
 void on_clear_hash(const Option&) { TT.clear(); }
+void on_save_hash(const Option&) { TT.save(Options["Hash File"]); }
+void on_load_hash(const Option&) { TT.load(Options["Hash File"], false); }
+void on_merge_hash(const Option&) { TT.load(Options["Hash File"], true); }
+void on_compact_analysis(const Option&) { Analysis.compact(0); }
+
+void on_analysis(const Option&) {
+
+  Analysis.close();
+
+  if (Options["Use Analysis Store"])
+      Analysis.open(Options["Analysis File"], Options["Analysis Store Size"]);
+}
 
 
 /// Our case insensitive less() function as required by UCI protocol
@@ -75,8 +88,18 @@ void init(OptionsMap& o) {
   o["Max Threads per Split Point"] = Option(5, 4, 8, on_threads);
   o["Threads"]                     = Option(cpus, 1, MAX_THREADS, on_threads);
   o["Use Sleeping Threads"]        = Option(true, on_threads);
+  o["Spin Before Sleep"]           = Option(0, 0, 1000000, on_threads);
+  o["Bind Threads"]                = Option(false, on_threads);
   o["Hash"]                        = Option(32, 4, 8192, on_hash_size);
   o["Clear Hash"]                  = Option(on_clear_hash);
+  o["Hash File"]                   = Option("hash.bin");
+  o["Save Hash to File"]           = Option(on_save_hash);
+  o["Load Hash from File"]         = Option(on_load_hash);
+  o["Merge Hash from File"]        = Option(on_merge_hash);
+  o["Use Analysis Store"]          = Option(false, on_analysis);
+  o["Analysis File"]               = Option("analysis.bin", on_analysis);
+  o["Analysis Store Size"]         = Option(16, 1, 4096, on_analysis);
+  o["Compact Analysis Store"]      = Option(on_compact_analysis);
   o["Ponder"]                      = Option(true);
   o["OwnBook"]                     = Option(false);
   o["MultiPV"]                     = Option(1, 1, 500);
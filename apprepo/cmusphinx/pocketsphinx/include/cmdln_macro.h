@@ -152,6 +152,10 @@
       ARG_INT32,                                                                                \
       "5000",                                                                                   \
       "Initial backpointer table size" },                                                       \
+{ "-commitwin",                                                                                 \
+      ARG_INT32,                                                                                \
+      "0",                                                                                      \
+      "Commit stable words and trim the backpointer table every N frames (continuous decoding, 0 to disable)" }, \
 { "-maxwpf",                                                                                    \
       ARG_INT32,                                                                                \
       "-1",                                                                                     \
@@ -171,7 +175,11 @@
 { "-fwdflatsfwin",                                                                              \
       ARG_INT32,                                                                                \
       "25",                                                                    	                \
-      "Window of frames in lattice to search for successor words in fwdflat search " }
+      "Window of frames in lattice to search for successor words in fwdflat search " },         \
+{ "-fwdflatlag",                                                                                \
+      ARG_INT32,                                                                                \
+      "0",                                                                                      \
+      "Run fwdflat search in another thread, this many frames behind fwdtree search (0 to run it after, should exceed typical word length plus -fwdflatsfwin; trigrams are not cached while both run, and MLLR adaptation restarts it)" }
 
 /** Command-line options for finite state grammars. */
 #define POCKETSPHINX_FSG_OPTIONS \
@@ -194,7 +202,11 @@
 { "-fsgusefiller",                                              \
         ARG_BOOLEAN,                                            \
         "yes",                                                  \
-        "Insert filler words at each state."}
+        "Insert filler words at each state."},                  \
+{ "-fsgcache",                                                  \
+        ARG_STRING,                                             \
+        NULL,                                                   \
+        "Directory of compiled grammars, read or written when grammars are activated" }
 
 /** Command-line options for statistical language models. */
 #define POCKETSPHINX_NGRAM_OPTIONS \
@@ -320,6 +332,10 @@
       ARG_FLOAT32,                                                              \
       "0.0001",                                                                 \
       "Mixture gaussian variance floor (applied to data from -var file)" },     \
+{ "-gquant",                                                                    \
+      ARG_INT32,                                                                \
+      "0",                                                                      \
+      "Bits per mean and precision in memory (8 or 16, continuous models)" },   \
 { "-mixw",                                                                      \
       ARG_STRING,                                                               \
       NULL,                                                                     \
@@ -340,14 +356,34 @@
       ARG_STRING,                                                               \
       NULL,                                                                     \
       "MLLR transformation to apply to means and variances" },                  \
+{ "-fmllr",                                                                     \
+      ARG_STRING,                                                               \
+      NULL,                                                                     \
+      "Feature space MLLR (CMLLR) transformation to apply to features" },       \
 { "-mmap",                                                                      \
       ARG_BOOLEAN,                                                              \
       "yes",                                                                    \
       "Use memory-mapped I/O (if possible) for model files" },                  \
+{ "-bundle",                                                                    \
+      ARG_STRING,                                                               \
+      NULL,                                                                     \
+      "Model bundle with precomputed parameters, used in place with -mmap" },   \
 { "-ds",                                                                        \
       ARG_INT32,                                                                \
       "1",                                                                      \
       "Frame GMM computation downsampling ratio" },                             \
+{ "-scoreblock",                                                                \
+      ARG_INT32,                                                                \
+      "1",                                                                      \
+      "Number of frames to score per pass over the GMMs, when available" },     \
+{ "-senthreads",                                                                \
+      ARG_INT32,                                                                \
+      "1",                                                                      \
+      "Number of threads to evaluate GMMs with (continuous and PTM models)" },  \
+{ "-pipeline",                                                                  \
+      ARG_BOOLEAN,                                                              \
+      "no",                                                                     \
+      "Score the next frames in the background during search" },                \
 { "-topn",                                                                      \
       ARG_INT32,                                                                \
       "4",                                                                      \
@@ -90,6 +90,30 @@ typedef struct ps_seg_s ps_seg_t;
 POCKETSPHINX_EXPORT
 ps_decoder_t *ps_init(cmd_ln_t *config);
 
+/**
+ * Initialize a decoder sharing the models of another one.
+ *
+ * The acoustic model, dictionary and language models of
+ * <code>other</code> are shared with the new decoder instead of being
+ * loaded again, so that several decoders can run in parallel, one per
+ * thread, for the memory cost of one.  Grammars are loaded again from
+ * the configuration.  Shared models are never modified while
+ * decoding, so language models do not cache N-Gram information
+ * anymore.
+ *
+ * @note Neither decoder may be reinitialized or have words added to
+ * its dictionary once they share models.  The new decoder can be
+ * adapted with ps_update_mllr(), which makes it use its own copy of
+ * the Gaussians, or with ps_update_fmllr(); <code>other</code> can
+ * only be adapted with ps_update_fmllr().
+ *
+ * @param other Decoder whose models are shared.  It can be freed
+ * before the new decoder.
+ * @return a new decoder, or NULL on failure.
+ */
+POCKETSPHINX_EXPORT
+ps_decoder_t *ps_init_shared(ps_decoder_t *other);
+
 /**
  * Reinitialize the decoder with updated configuration.
  *
@@ -192,17 +216,40 @@ feat_t *ps_get_feat(ps_decoder_t *ps);
 /**
  * Adapt current acoustic model using a linear transform.
  *
- * @param mllr The new transform to use, or NULL to update the existing
- *              transform.  The decoder retains ownership of this pointer,
- *              so you should not attempt to free it manually.  Use
- *              ps_mllr_retain() if you wish to reuse it
+ * The transform is applied to the unadapted means and variances,
+ * which are read again the first time only, so that switching between
+ * speakers is fast.
+ *
+ * @param mllr The new transform to use, or NULL to go back to the
+ *              unadapted model.  The decoder retains ownership of this
+ *              pointer, so you should not attempt to free it manually.
+ *              Use ps_mllr_retain() if you wish to reuse it
  *              elsewhere.
+ * @note With -fwdflatlag, this restarts the fwdflat search that
+ *       follows fwdtree, so it must not be called during an utterance.
  * @return The updated transform object for this decoder, or
- *         NULL on failure.
+ *         NULL on failure (or if there is none).
  */
 POCKETSPHINX_EXPORT
 ps_mllr_t *ps_update_mllr(ps_decoder_t *ps, ps_mllr_t *mllr);
 
+/**
+ * Adapt to a speaker using a feature space (constrained) linear
+ * transform.
+ *
+ * The transform is applied to feature vectors, from the next ones
+ * computed, rather than to the acoustic model, so it can be changed
+ * at no cost, including in decoders sharing their models.
+ *
+ * @param fmllr The new transform to use, or NULL for none.  Its
+ *              format is that of ps_mllr_read().  The decoder retains
+ *              ownership of this pointer, as with ps_update_mllr().
+ * @return The updated transform object for this decoder, or
+ *         NULL on failure (or if there is none).
+ */
+POCKETSPHINX_EXPORT
+ps_mllr_t *ps_update_fmllr(ps_decoder_t *ps, ps_mllr_t *fmllr);
+
 /**
  * Get the language model set object for this decoder.
  *
@@ -460,6 +507,20 @@ char const *ps_get_hyp(ps_decoder_t *ps, int32 *out_best_score,
 POCKETSPHINX_EXPORT
 char const *ps_get_hyp_final(ps_decoder_t *ps, int32 *out_is_final);
 
+/**
+ * Check whether the hypothesis has changed.
+ *
+ * This is cheap enough to call every few frames, so that applications
+ * displaying partial results only need to fetch them with
+ * ps_get_hyp() when something new is there.
+ *
+ * @param ps Decoder.
+ * @return TRUE if ps_get_hyp() would return a different string than
+ *         it did the last time it was called, FALSE otherwise.
+ */
+POCKETSPHINX_EXPORT
+int ps_hyp_changed(ps_decoder_t *ps);
+
 /**
  * Get posterior probability.
  *
@@ -504,6 +565,26 @@ ps_lattice_t *ps_get_lattice(ps_decoder_t *ps);
 POCKETSPHINX_EXPORT
 ps_seg_t *ps_seg_iter(ps_decoder_t *ps, int32 *out_best_score);
 
+/**
+ * Get an iterator over the words committed since the last call.
+ *
+ * When decoding continuously with <code>-commitwin</code>, words that
+ * all active hypotheses agree on are periodically committed and
+ * dropped from the search, so that memory use does not grow with the
+ * length of the utterance.  They are then no longer part of the
+ * results of ps_get_hyp() and ps_seg_iter(), which only cover the
+ * rest of the utterance.  Frame numbers are counted from the start
+ * of the utterance.  Call this regularly, as committed words are kept
+ * until they are fetched.
+ *
+ * @param ps Decoder.
+ * @return Iterator over the newly committed words, NULL if there are
+ *         none.  You must free it with ps_seg_free() if you do not
+ *         iterate to the end.
+ */
+POCKETSPHINX_EXPORT
+ps_seg_t *ps_seg_committed(ps_decoder_t *ps);
+
 /**
  * Get the next segment in a word segmentation.
  *
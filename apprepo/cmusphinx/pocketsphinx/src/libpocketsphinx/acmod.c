@@ -73,41 +73,61 @@ static const arg_t feat_defn[] = {
 #endif
 
 static int32 acmod_process_mfcbuf(acmod_t *acmod);
+static int32 acmod_bitvec2list(bitvec_t *vec, int32 total_dists, uint8 *list);
+static void acmod_pipeline_wait(acmod_t *acmod);
+static void acmod_init_buffers(acmod_t *acmod);
+static void acmod_fmllr_transform(acmod_t *acmod, mfcc_t ***feat, int32 nfr);
 
 static int
 acmod_init_am(acmod_t *acmod)
 {
-    char const *mdeffn, *tmatfn, *mllrfn, *hmmdir;
+    char const *mdeffn, *tmatfn, *mllrfn, *fmllrfn, *hmmdir, *bundlefn;
+
+    /* Use parameters from a model bundle in place if possible,
+     * otherwise (or for those it lacks) read the files. */
+    if ((bundlefn = cmd_ln_str_r(acmod->config, "-bundle"))
+        && cmd_ln_boolean_r(acmod->config, "-mmap"))
+        acmod->bundle = model_bundle_read(bundlefn, acmod->config,
+                                          acmod->lmath);
 
     /* Read model definition. */
-    if ((mdeffn = cmd_ln_str_r(acmod->config, "-mdef")) == NULL) {
-	if ((hmmdir = cmd_ln_str_r(acmod->config, "-hmm")) == NULL) {
-	    E_ERROR("Acoustic model definition is not specified neither with -mdef option nor with -hmm\n");
-	} else {
-	    E_ERROR("Folder '%s' does not contain acoustic model definition 'mdef'\n", hmmdir);
-	}
-        return -1;
-    }
+    if (acmod->bundle)
+        acmod->mdef = bin_mdef_read_bundle(acmod->bundle);
+    if (acmod->mdef == NULL) {
+        if ((mdeffn = cmd_ln_str_r(acmod->config, "-mdef")) == NULL) {
+            if ((hmmdir = cmd_ln_str_r(acmod->config, "-hmm")) == NULL) {
+                E_ERROR("Acoustic model definition is not specified neither with -mdef option nor with -hmm\n");
+            } else {
+                E_ERROR("Folder '%s' does not contain acoustic model definition 'mdef'\n", hmmdir);
+            }
+            return -1;
+        }
 
-    if ((acmod->mdef = bin_mdef_read(acmod->config, mdeffn)) == NULL) {
-        E_ERROR("Failed to read acoustic model definition from %s\n", mdeffn);
-        return -1;
+        if ((acmod->mdef = bin_mdef_read(acmod->config, mdeffn)) == NULL) {
+            E_ERROR("Failed to read acoustic model definition from %s\n", mdeffn);
+            return -1;
+        }
     }
 
     /* Read transition matrices. */
-    if ((tmatfn = cmd_ln_str_r(acmod->config, "-tmat")) == NULL) {
-        E_ERROR("No tmat file specified\n");
-        return -1;
+    if (acmod->bundle)
+        acmod->tmat = tmat_init_bundle(acmod->bundle, acmod->lmath);
+    if (acmod->tmat == NULL) {
+        if ((tmatfn = cmd_ln_str_r(acmod->config, "-tmat")) == NULL) {
+            E_ERROR("No tmat file specified\n");
+            return -1;
+        }
+        acmod->tmat = tmat_init(tmatfn, acmod->lmath,
+                                cmd_ln_float32_r(acmod->config, "-tmatfloor"),
+                                TRUE);
     }
-    acmod->tmat = tmat_init(tmatfn, acmod->lmath,
-                            cmd_ln_float32_r(acmod->config, "-tmatfloor"),
-                            TRUE);
 
     /* Read the acoustic models. */
-    if ((cmd_ln_str_r(acmod->config, "-mean") == NULL)
-        || (cmd_ln_str_r(acmod->config, "-var") == NULL)
-        || (cmd_ln_str_r(acmod->config, "-tmat") == NULL)) {
-        E_ERROR("No mean/var/tmat files specified\n");
+    if ((acmod->bundle == NULL
+         || model_bundle_get(acmod->bundle, "gauden", NULL) == NULL)
+        && ((cmd_ln_str_r(acmod->config, "-mean") == NULL)
+            || (cmd_ln_str_r(acmod->config, "-var") == NULL))) {
+        E_ERROR("No mean/var files specified\n");
         return -1;
     }
 
@@ -135,7 +155,21 @@ acmod_init_am(acmod_t *acmod)
         ps_mllr_t *mllr = ps_mllr_read(mllrfn);
         if (mllr == NULL)
             return -1;
-        acmod_update_mllr(acmod, mllr);
+        if (acmod_update_mllr(acmod, mllr) == NULL) {
+            ps_mllr_free(mllr);
+            return -1;
+        }
+    }
+
+    /* Likewise for a transform of the features. */
+    if ((fmllrfn = cmd_ln_str_r(acmod->config, "-fmllr"))) {
+        ps_mllr_t *fmllr = ps_mllr_read(fmllrfn);
+        if (fmllr == NULL)
+            return -1;
+        if (acmod_update_fmllr(acmod, fmllr) == NULL) {
+            ps_mllr_free(fmllr);
+            return -1;
+        }
     }
 
     return 0;
@@ -201,6 +235,43 @@ acmod_init_feat(acmod_t *acmod)
     return 0;
 }
 
+ps_mgau_t *
+ps_mgau_retain(ps_mgau_t *mgau)
+{
+    ++mgau->refcount;
+    return mgau;
+}
+
+int
+ps_mgau_free(ps_mgau_t *mgau)
+{
+    if (mgau == NULL)
+        return 0;
+    if (--mgau->refcount > 0)
+        return mgau->refcount;
+    (*mgau->vt->free)(mgau);
+    return 0;
+}
+
+ps_mgau_t *
+ps_mgau_copy(ps_mgau_t *mgau, acmod_t *acmod)
+{
+    if (mgau->vt->copy == NULL)
+        return NULL;
+    return (*mgau->vt->copy)(mgau, acmod);
+}
+
+int
+ps_mgau_write_bundle(ps_mgau_t *mgau, model_bundle_writer_t *w)
+{
+    if (mgau->vt->write_bundle == NULL) {
+        E_ERROR("Acoustic model type %s cannot be written to a model bundle\n",
+                mgau->vt->name);
+        return -1;
+    }
+    return (*mgau->vt->write_bundle)(mgau, w);
+}
+
 int
 acmod_fe_mismatch(acmod_t *acmod, fe_t *fe)
 {
@@ -278,6 +349,58 @@ acmod_init(cmd_ln_t *config, logmath_t *lmath, fe_t *fe, feat_t *fcb)
     if (acmod_init_am(acmod) < 0)
         goto error_out;
 
+    acmod_init_buffers(acmod);
+    return acmod;
+
+error_out:
+    acmod_free(acmod);
+    return NULL;
+}
+
+acmod_t *
+acmod_copy(acmod_t *other)
+{
+    acmod_t *acmod;
+
+    acmod = ckd_calloc(1, sizeof(*acmod));
+    acmod->config = cmd_ln_retain(other->config);
+    acmod->lmath = other->lmath;
+    acmod->state = ACMOD_IDLE;
+
+    /* Feature computation keeps state between frames, so it is
+     * created again (feat.params were already parsed by other). */
+    if ((acmod->fe = fe_init_auto_r(acmod->config)) == NULL)
+        goto error_out;
+    if (acmod_init_feat(acmod) < 0)
+        goto error_out;
+
+    /* Model parameters are shared. */
+    if (other->bundle)
+        acmod->bundle = model_bundle_retain(other->bundle);
+    acmod->mdef = bin_mdef_retain(other->mdef);
+    acmod->tmat = tmat_retain(other->tmat);
+    if ((acmod->mgau = ps_mgau_copy(other->mgau, acmod)) == NULL) {
+        E_ERROR("Acoustic model type %s cannot be shared\n",
+                other->mgau->vt->name);
+        goto error_out;
+    }
+    if (other->mllr)
+        acmod->mllr = ps_mllr_retain(other->mllr);
+    if (other->fmllr)
+        acmod_update_fmllr(acmod, ps_mllr_retain(other->fmllr));
+
+    acmod_init_buffers(acmod);
+    return acmod;
+
+error_out:
+    acmod_free(acmod);
+    return NULL;
+}
+
+static void
+acmod_init_buffers(acmod_t *acmod)
+{
+    cmd_ln_t *config = acmod->config;
 
     /* The MFCC buffer needs to be at least as large as the dynamic
      * feature window.  */
@@ -299,11 +422,34 @@ acmod_init(cmd_ln_t *config, logmath_t *lmath, fe_t *fe, feat_t *fcb)
                                                      sizeof(*acmod->senone_active));
     acmod->log_zero = logmath_get_zero(acmod->lmath);
     acmod->compallsen = cmd_ln_boolean_r(config, "-compallsen");
-    return acmod;
 
-error_out:
-    acmod_free(acmod);
-    return NULL;
+    /* Block scoring, if the model supports it. */
+    acmod->n_score_block = cmd_ln_int32_r(config, "-scoreblock");
+    if (acmod->n_score_block < 1)
+        acmod->n_score_block = 1;
+    if (acmod->mgau->vt->frame_eval_block == NULL)
+        acmod->n_score_block = 1;
+    if (cmd_ln_boolean_r(config, "-pipeline")) {
+        if (acmod->mgau->vt->frame_eval_block == NULL)
+            E_WARN("Model does not support scoring ahead, -pipeline ignored\n");
+        else if ((acmod->pipeline = thread_pool_init(config, 1)) != NULL)
+            E_INFO("Scoring frames in the background while searching\n");
+    }
+    if (acmod->n_score_block > 1 || acmod->pipeline) {
+        E_INFO("Scoring up to %d frames at once\n", acmod->n_score_block);
+        acmod->blk_scores = (int16 **)
+            ckd_calloc_2d(acmod->n_score_block, bin_mdef_n_sen(acmod->mdef),
+                          sizeof(**acmod->blk_scores));
+        acmod->blk_feat = ckd_calloc(acmod->n_score_block,
+                                     sizeof(*acmod->blk_feat));
+        acmod->blk_active_vec = bitvec_alloc(bin_mdef_n_sen(acmod->mdef));
+        acmod->blk_used_vec = bitvec_alloc(bin_mdef_n_sen(acmod->mdef));
+        acmod->blk_active = ckd_calloc(bin_mdef_n_sen(acmod->mdef),
+                                       sizeof(*acmod->blk_active));
+    }
+    acmod->n_blk_frame = 0;
+    acmod->perf.name = "score";
+    ptmr_init(&acmod->perf);
 }
 
 void
@@ -312,6 +458,10 @@ acmod_free(acmod_t *acmod)
     if (acmod == NULL)
         return;
 
+    /* Stop scoring before freeing anything it uses. */
+    if (acmod->pipeline)
+        thread_pool_free(acmod->pipeline);
+
     feat_free(acmod->fcb);
     fe_free(acmod->fe);
     cmd_ln_free_r(acmod->config);
@@ -332,6 +482,12 @@ acmod_free(acmod_t *acmod)
     ckd_free(acmod->senone_scores);
     ckd_free(acmod->senone_active_vec);
     ckd_free(acmod->senone_active);
+    if (acmod->blk_scores)
+        ckd_free_2d((void **)acmod->blk_scores);
+    ckd_free(acmod->blk_feat);
+    ckd_free(acmod->blk_active_vec);
+    ckd_free(acmod->blk_used_vec);
+    ckd_free(acmod->blk_active);
 
     if (acmod->mdef)
         bin_mdef_free(acmod->mdef);
@@ -341,6 +497,9 @@ acmod_free(acmod_t *acmod)
         ps_mgau_free(acmod->mgau);
     if (acmod->mllr)
         ps_mllr_free(acmod->mllr);
+    ps_mllr_free(acmod->fmllr);
+    ckd_free(acmod->fmllr_tmp);
+    model_bundle_free(acmod->bundle);
     
     ckd_free(acmod);
 }
@@ -348,14 +507,118 @@ acmod_free(acmod_t *acmod)
 ps_mllr_t *
 acmod_update_mllr(acmod_t *acmod, ps_mllr_t *mllr)
 {
+    /* The transform is applied to the parameters themselves, or to a
+     * copy of them in models sharing those of another one. */
+    if (acmod->mgau->refcount > 1) {
+        E_ERROR("Cannot adapt an acoustic model shared with other decoders\n");
+        return NULL;
+    }
+    if (mllr == NULL && acmod->mllr == NULL)
+        return NULL;
+    acmod_pipeline_wait(acmod);
+    if (ps_mgau_transform(acmod->mgau, mllr) < 0)
+        return NULL;
     if (acmod->mllr)
         ps_mllr_free(acmod->mllr);
     acmod->mllr = mllr;
-    ps_mgau_transform(acmod->mgau, mllr);
+    acmod->n_blk_frame = 0;
 
     return mllr;
 }
 
+ps_mllr_t *
+acmod_update_fmllr(acmod_t *acmod, ps_mllr_t *fmllr)
+{
+    int32 i, maxlen;
+
+    maxlen = 0;
+    if (fmllr) {
+        if (fmllr->n_feat != feat_dimension1(acmod->fcb)) {
+            E_ERROR("Feature transform has %d streams, features have %d\n",
+                    fmllr->n_feat, feat_dimension1(acmod->fcb));
+            return NULL;
+        }
+        for (i = 0; i < fmllr->n_feat; ++i) {
+            if (fmllr->veclen[i] != feat_dimension2(acmod->fcb, i)) {
+                E_ERROR("Feature transform stream %d has length %d, "
+                        "features have %d\n", i, fmllr->veclen[i],
+                        feat_dimension2(acmod->fcb, i));
+                return NULL;
+            }
+            if (fmllr->veclen[i] > maxlen)
+                maxlen = fmllr->veclen[i];
+        }
+        if (fmllr->n_class > 1)
+            E_WARN("Feature transform has %d classes, using the first one\n",
+                   fmllr->n_class);
+    }
+    ps_mllr_free(acmod->fmllr);
+    acmod->fmllr = fmllr;
+    ckd_free(acmod->fmllr_tmp);
+    acmod->fmllr_tmp = maxlen ? ckd_calloc(maxlen, sizeof(mfcc_t)) : NULL;
+
+    return fmllr;
+}
+
+/*
+ * Apply the feature space transform to newly computed features, as
+ * they enter the feature buffer.  As the Jacobian is the same for all
+ * senones, it does not change relative scores and is left out.
+ */
+static void
+acmod_fmllr_transform(acmod_t *acmod, mfcc_t ***feat, int32 nfr)
+{
+    ps_mllr_t *fmllr = acmod->fmllr;
+    int32 i, f, j, k;
+
+    if (fmllr == NULL)
+        return;
+    for (i = 0; i < nfr; ++i) {
+        for (f = 0; f < fmllr->n_feat; ++f) {
+            mfcc_t *x = feat[i][f];
+
+            for (j = 0; j < fmllr->veclen[f]; ++j) {
+                float32 const *a = fmllr->A[f][0][j];
+                float32 acc = fmllr->b[f][0][j];
+
+                for (k = 0; k < fmllr->veclen[f]; ++k)
+                    acc += a[k] * MFCC2FLOAT(x[k]);
+                acmod->fmllr_tmp[j] = FLOAT2MFCC(acc);
+            }
+            memcpy(x, acmod->fmllr_tmp, fmllr->veclen[f] * sizeof(*x));
+        }
+    }
+}
+
+int
+acmod_write_bundle(acmod_t *acmod, char const *file)
+{
+    model_bundle_writer_t *w;
+
+    if (acmod->mllr) {
+        E_ERROR("Adapted acoustic models cannot be written to a model bundle\n");
+        return -1;
+    }
+    if ((w = model_bundle_writer_init(file, acmod->config,
+                                      acmod->lmath)) == NULL)
+        return -1;
+    if (model_bundle_add_source(w, "-mdef") < 0
+        || model_bundle_add_source(w, "-tmat") < 0
+        || model_bundle_add_source(w, "-mean") < 0
+        || model_bundle_add_source(w, "-var") < 0
+        || model_bundle_add_source(w, "-mixw") < 0
+        || model_bundle_add_source(w, "-sendump") < 0
+        || model_bundle_add_source(w, "-senmgau") < 0
+        || bin_mdef_write_bundle(acmod->mdef, w) < 0
+        || tmat_write_bundle(acmod->tmat, w) < 0
+        || ps_mgau_write_bundle(acmod->mgau, w) < 0) {
+        E_ERROR("Failed to write model bundle %s\n", file);
+        model_bundle_writer_close(w, TRUE);
+        return -1;
+    }
+    return model_bundle_writer_close(w, FALSE);
+}
+
 int
 acmod_write_senfh_header(acmod_t *acmod, FILE *logfh)
 {
@@ -409,6 +672,7 @@ acmod_grow_feat_buf(acmod_t *acmod, int nfr)
         E_FATAL("Decoder can not process more than %d frames at once, requested %d\n", 
                 MAX_N_FRAMES, nfr);
 
+    acmod_pipeline_wait(acmod);
     acmod->feat_buf = feat_array_realloc(acmod->fcb, acmod->feat_buf, acmod->n_feat_alloc, nfr);
     acmod->framepos = ckd_realloc(acmod->framepos,
                                   nfr * sizeof(*acmod->framepos));
@@ -431,6 +695,7 @@ acmod_set_grow(acmod_t *acmod, int grow_feat)
 int
 acmod_start_utt(acmod_t *acmod)
 {
+    acmod_pipeline_wait(acmod);
     fe_start_utt(acmod->fe);
     acmod->state = ACMOD_STARTED;
     acmod->n_mfc_frame = 0;
@@ -441,6 +706,11 @@ acmod_start_utt(acmod_t *acmod)
     acmod->senscr_frame = -1;
     acmod->n_senone_active = 0;
     acmod->mgau->frame_idx = 0;
+    acmod->n_blk_frame = 0;
+    if (acmod->blk_used_vec)
+        bitvec_clear_all(acmod->blk_used_vec, bin_mdef_n_sen(acmod->mdef));
+    acmod->n_blk_hit = acmod->n_blk_miss = 0;
+    ptmr_reset(&acmod->perf);
     return 0;
 }
 
@@ -541,6 +811,7 @@ acmod_process_full_cep(acmod_t *acmod,
     /* Make dynamic features. */
     nfr = feat_s2mfc2feat_live(acmod->fcb, *inout_cep, inout_n_frames,
                                TRUE, TRUE, acmod->feat_buf);
+    acmod_fmllr_transform(acmod, acmod->feat_buf, nfr);
     acmod->n_feat_frame = nfr;
     assert(acmod->n_feat_frame <= acmod->n_feat_alloc);
     *inout_cep += *inout_n_frames;
@@ -755,6 +1026,7 @@ acmod_process_cep(acmod_t *acmod,
                                      acmod->feat_buf + inptr);
         if (nfeat < 0)
             return -1;
+        acmod_fmllr_transform(acmod, acmod->feat_buf + inptr, nfeat);
         /* Move the output feature pointer forward. */
         acmod->n_feat_frame += nfeat;
         assert(acmod->n_feat_frame <= acmod->n_feat_alloc);
@@ -773,6 +1045,7 @@ acmod_process_cep(acmod_t *acmod,
                                  acmod->feat_buf + inptr);
     if (nfeat < 0)
         return -1;
+    acmod_fmllr_transform(acmod, acmod->feat_buf + inptr, nfeat);
     acmod->n_feat_frame += nfeat;
     assert(acmod->n_feat_frame <= acmod->n_feat_alloc);
     /* Move the input feature pointers forward. */
@@ -808,6 +1081,7 @@ acmod_process_feat(acmod_t *acmod,
     for (i = 0; i < feat_dimension1(acmod->fcb); ++i)
         memcpy(acmod->feat_buf[inptr][i],
                feat[i], feat_dimension2(acmod->fcb, i) * sizeof(**feat));
+    acmod_fmllr_transform(acmod, acmod->feat_buf + inptr, 1);
     ++acmod->n_feat_frame;
     assert(acmod->n_feat_frame <= acmod->n_feat_alloc);
 
@@ -870,6 +1144,8 @@ acmod_rewind(acmod_t *acmod)
         return -1;
     }
 
+    acmod_pipeline_wait(acmod);
+
     /* Frames consumed + frames available */
     acmod->n_feat_frame = acmod->output_frame + acmod->n_feat_frame;
 
@@ -878,6 +1154,7 @@ acmod_rewind(acmod_t *acmod)
     acmod->output_frame = 0;
     acmod->senscr_frame = -1;
     acmod->mgau->frame_idx = 0;
+    acmod->n_blk_frame = 0;
 
     return 0;
 }
@@ -885,6 +1162,10 @@ acmod_rewind(acmod_t *acmod)
 int
 acmod_advance(acmod_t *acmod)
 {
+    /* The frame being scored in the background is computed relative
+     * to the output pointers. */
+    acmod_pipeline_wait(acmod);
+
     /* Advance the output pointers. */
     if (++acmod->feat_outidx == acmod->n_feat_alloc)
         acmod->feat_outidx = 0;
@@ -1084,6 +1365,166 @@ acmod_get_frame(acmod_t *acmod, int *inout_frame_idx)
     return acmod->feat_buf[feat_idx];
 }
 
+/*
+ * Set up a block of frames starting at frame_idx, to be scored with
+ * acmod_block_eval().  The block scores the union of the senones
+ * active in the current frame and of those requested while the
+ * previous block was in use, which is a good prediction of the
+ * senones that the search will ask for in the next few frames.
+ */
+static int
+acmod_block_setup(acmod_t *acmod, int frame_idx)
+{
+    int n_sen, n_frame, k, i;
+
+    n_sen = bin_mdef_n_sen(acmod->mdef);
+    /* Score as many frames as are available, up to the block size. */
+    n_frame = acmod->output_frame + acmod->n_feat_frame - frame_idx;
+    if (n_frame > acmod->n_score_block)
+        n_frame = acmod->n_score_block;
+    if (n_frame < 1)
+        n_frame = 1;
+    for (k = 0; k < n_frame; ++k) {
+        int feat_idx;
+        if ((feat_idx = calc_feat_idx(acmod, frame_idx + k)) < 0)
+            return -1;
+        acmod->blk_feat[k] = acmod->feat_buf[feat_idx];
+    }
+
+    if (acmod->compallsen) {
+        acmod->n_blk_active = n_sen;
+    }
+    else {
+        for (i = 0; i < bitvec_size(n_sen); ++i) {
+            acmod->blk_active_vec[i] = (acmod->senone_active_vec[i]
+                                        | acmod->blk_used_vec[i]);
+            acmod->blk_used_vec[i] = acmod->senone_active_vec[i];
+        }
+        acmod->n_blk_active = acmod_bitvec2list(acmod->blk_active_vec, n_sen,
+                                                acmod->blk_active);
+    }
+    acmod->blk_frame = frame_idx;
+    acmod->n_blk_frame = n_frame;
+
+    return 0;
+}
+
+/*
+ * Score the block set up by acmod_block_setup().
+ */
+static void
+acmod_block_eval(acmod_t *acmod)
+{
+    int n_frame;
+
+    n_frame = ps_mgau_frame_eval_block(acmod->mgau,
+                                       acmod->blk_scores,
+                                       acmod->blk_active,
+                                       acmod->n_blk_active,
+                                       acmod->blk_feat,
+                                       acmod->blk_frame,
+                                       acmod->n_blk_frame,
+                                       acmod->compallsen);
+    acmod->n_blk_frame = n_frame < 0 ? 0 : n_frame;
+    E_DEBUG(1,("Scored %d frames from %d with %d active states\n",
+               acmod->n_blk_frame, acmod->blk_frame, acmod->n_blk_active));
+}
+
+static void
+acmod_block_job(void *arg, int part, int n_part)
+{
+    acmod_block_eval((acmod_t *)arg);
+}
+
+/*
+ * Wait for the block being scored in the background, if any.
+ */
+static void
+acmod_pipeline_wait(acmod_t *acmod)
+{
+    if (acmod->pipeline)
+        thread_pool_wait(acmod->pipeline);
+}
+
+/*
+ * Check whether all the senones active in this frame were scored in
+ * the current block.
+ */
+static int
+acmod_block_covers(acmod_t *acmod)
+{
+    int i, n_words;
+
+    if (acmod->compallsen)
+        return TRUE;
+    n_words = bitvec_size(bin_mdef_n_sen(acmod->mdef));
+    for (i = 0; i < n_words; ++i)
+        if (acmod->senone_active_vec[i] & ~acmod->blk_active_vec[i])
+            return FALSE;
+    return TRUE;
+}
+
+/*
+ * Get scores for a frame from the current block of frames, or score a
+ * new block starting at this frame.  If the search asks for senones
+ * that are not in the block, the block is scored again from there.
+ * Frames before the block (the search may look back by -pl_window
+ * frames) are scored on their own, so as to keep the block.
+ *
+ * With -pipeline, once the last frame of a block is requested the
+ * next one is scored by another thread, while the search works on
+ * this frame.
+ */
+static int
+acmod_score_block(acmod_t *acmod, int frame_idx, int feat_idx)
+{
+    int n_sen, k, i;
+
+    n_sen = bin_mdef_n_sen(acmod->mdef);
+    acmod_pipeline_wait(acmod);
+    k = frame_idx - acmod->blk_frame;
+    if (k >= 0 && k < acmod->n_blk_frame && acmod_block_covers(acmod)) {
+        memcpy(acmod->senone_scores, acmod->blk_scores[k],
+               n_sen * sizeof(*acmod->senone_scores));
+        if (!acmod->compallsen) {
+            for (i = 0; i < bitvec_size(n_sen); ++i)
+                acmod->blk_used_vec[i] |= acmod->senone_active_vec[i];
+        }
+        ++acmod->n_blk_hit;
+    }
+    else if (k < 0 && acmod->n_blk_frame > 0) {
+        if (ps_mgau_frame_eval(acmod->mgau,
+                               acmod->senone_scores,
+                               acmod->senone_active,
+                               acmod->n_senone_active,
+                               acmod->feat_buf[feat_idx],
+                               frame_idx,
+                               acmod->compallsen) < 0)
+            return -1;
+        return 0;
+    }
+    else {
+        if (acmod_block_setup(acmod, frame_idx) < 0)
+            return -1;
+        acmod_block_eval(acmod);
+        if (acmod->n_blk_frame == 0)
+            return -1;
+        memcpy(acmod->senone_scores, acmod->blk_scores[0],
+               n_sen * sizeof(*acmod->senone_scores));
+        ++acmod->n_blk_miss;
+    }
+
+    if (acmod->pipeline
+        && frame_idx + 1 == acmod->blk_frame + acmod->n_blk_frame
+        && frame_idx + 1 < acmod->output_frame + acmod->n_feat_frame) {
+        if (acmod_block_setup(acmod, frame_idx + 1) < 0)
+            return -1;
+        thread_pool_start(acmod->pipeline, acmod_block_job, acmod);
+    }
+
+    return 0;
+}
+
 int16 const *
 acmod_score(acmod_t *acmod, int *inout_frame_idx)
 {
@@ -1111,11 +1552,24 @@ acmod_score(acmod_t *acmod, int *inout_frame_idx)
         if (acmod_read_scores_internal(acmod) < 0)
             return NULL;
     }
+    else if (acmod->n_score_block > 1 || acmod->pipeline) {
+        /* Build active senone list. */
+        acmod_flags2list(acmod);
+
+        /* Take scores from the current block, or score a new one. */
+        ptmr_start(&acmod->perf);
+        if (acmod_score_block(acmod, frame_idx, feat_idx) < 0) {
+            ptmr_stop(&acmod->perf);
+            return NULL;
+        }
+        ptmr_stop(&acmod->perf);
+    }
     else {
         /* Build active senone list. */
         acmod_flags2list(acmod);
 
         /* Generate scores for the next available frame */
+        ptmr_start(&acmod->perf);
         ps_mgau_frame_eval(acmod->mgau,
                            acmod->senone_scores,
                            acmod->senone_active,
@@ -1123,6 +1577,7 @@ acmod_score(acmod_t *acmod, int *inout_frame_idx)
                            acmod->feat_buf[feat_idx],
                            frame_idx,
                            acmod->compallsen);
+        ptmr_stop(&acmod->perf);
     }
 
     if (inout_frame_idx)
@@ -1228,21 +1683,19 @@ acmod_activate_hmm(acmod_t *acmod, hmm_t *hmm)
     }
 }
 
-int32
-acmod_flags2list(acmod_t *acmod)
+/*
+ * Convert a bit vector of active senones to an array of deltas.
+ */
+static int32
+acmod_bitvec2list(bitvec_t *vec, int32 total_dists, uint8 *list)
 {
-    int32 w, l, n, b, total_dists, total_words, extra_bits;
+    int32 w, l, n, b, total_words, extra_bits;
     bitvec_t *flagptr;
 
-    total_dists = bin_mdef_n_sen(acmod->mdef);
-    if (acmod->compallsen) {
-        acmod->n_senone_active = total_dists;
-        return total_dists;
-    }
     total_words = total_dists / BITVEC_BITS;
     extra_bits = total_dists % BITVEC_BITS;
     w = n = l = 0;
-    for (flagptr = acmod->senone_active_vec; w < total_words; ++w, ++flagptr) {
+    for (flagptr = vec; w < total_words; ++w, ++flagptr) {
         if (*flagptr == 0)
             continue;
         for (b = 0; b < BITVEC_BITS; ++b) {
@@ -1252,10 +1705,10 @@ acmod_flags2list(acmod_t *acmod)
                 /* Handle excessive deltas "lossily" by adding a few
                    extra senones to bridge the gap. */
                 while (delta > 255) {
-                    acmod->senone_active[n++] = 255;
+                    list[n++] = 255;
                     delta -= 255;
                 }
-                acmod->senone_active[n++] = delta;
+                list[n++] = delta;
                 l = sen;
             }
         }
@@ -1268,16 +1721,31 @@ acmod_flags2list(acmod_t *acmod)
             /* Handle excessive deltas "lossily" by adding a few
                extra senones to bridge the gap. */
             while (delta > 255) {
-                acmod->senone_active[n++] = 255;
+                list[n++] = 255;
                 delta -= 255;
             }
-            acmod->senone_active[n++] = delta;
+            list[n++] = delta;
             l = sen;
         }
     }
 
-    acmod->n_senone_active = n;
+    return n;
+}
+
+int32
+acmod_flags2list(acmod_t *acmod)
+{
+    int32 total_dists;
+
+    total_dists = bin_mdef_n_sen(acmod->mdef);
+    if (acmod->compallsen) {
+        acmod->n_senone_active = total_dists;
+        return total_dists;
+    }
+    acmod->n_senone_active = acmod_bitvec2list(acmod->senone_active_vec,
+                                               total_dists,
+                                               acmod->senone_active);
     E_DEBUG(1, ("acmod_flags2list: %d active in frame %d\n",
                 acmod->n_senone_active, acmod->output_frame));
-    return n;
+    return acmod->n_senone_active;
 }
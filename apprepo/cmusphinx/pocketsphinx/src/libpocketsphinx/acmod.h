@@ -54,12 +54,15 @@
 #include <sphinxbase/bitvec.h>
 #include <sphinxbase/err.h>
 #include <sphinxbase/prim_type.h>
+#include <sphinxbase/profile.h>
 
 /* Local headers. */
 #include "ps_mllr.h"
 #include "bin_mdef.h"
 #include "tmat.h"
 #include "hmm.h"
+#include "model_bundle.h"
+#include "thread_pool.h"
 
 /**
  * States in utterance processing.
@@ -94,6 +97,7 @@ struct ps_mllr_s {
  * Acoustic model parameter structure. 
  */
 typedef struct ps_mgau_s ps_mgau_t;
+struct acmod_s;
 
 typedef struct ps_mgaufuncs_s {
     char const *name;
@@ -105,24 +109,83 @@ typedef struct ps_mgaufuncs_s {
                       mfcc_t ** feat,
                       int32 frame,
                       int32 compallsen);
+    /**
+     * Score n_frame consecutive frames starting at frame, with the
+     * same active senones, passing over the model parameters once
+     * for all of them.  Optional (may be NULL).
+     *
+     * @return number of frames scored (possibly less than n_frame),
+     * or <0 for failure.
+     */
+    int (*frame_eval_block)(ps_mgau_t *mgau,
+                            int16 **senscr,
+                            uint8 *senone_active,
+                            int32 n_senone_active,
+                            mfcc_t *** feat,
+                            int32 frame,
+                            int32 n_frame,
+                            int32 compallsen);
     int (*transform)(ps_mgau_t *mgau,
                      ps_mllr_t *mllr);
+    /**
+     * Create a model sharing the parameters of mgau, with its own
+     * scratch space, so that both can be evaluated at the same time
+     * by different threads.  Optional (may be NULL).
+     */
+    ps_mgau_t *(*copy)(ps_mgau_t *mgau,
+                       struct acmod_s *acmod);
+    /**
+     * Add the precomputed parameters to a model bundle.  Optional
+     * (may be NULL).
+     */
+    int (*write_bundle)(ps_mgau_t *mgau,
+                        model_bundle_writer_t *w);
     void (*free)(ps_mgau_t *mgau);
 } ps_mgaufuncs_t;    
 
 struct ps_mgau_s {
     ps_mgaufuncs_t *vt;  /**< vtable of mgau functions. */
     int frame_idx;       /**< frame counter. */
+    int refcount;        /**< Reference count. */
+    ps_mgau_t *shared;   /**< Model whose parameters are used by this
+                              copy (or NULL). */
 };
 
 #define ps_mgau_base(mg) ((ps_mgau_t *)(mg))
 #define ps_mgau_frame_eval(mg,senscr,senone_active,n_senone_active,feat,frame,compallsen) \
     (*ps_mgau_base(mg)->vt->frame_eval)                                 \
     (mg, senscr, senone_active, n_senone_active, feat, frame, compallsen)
+#define ps_mgau_frame_eval_block(mg,senscr,senone_active,n_senone_active,feat,frame,n_frame,compallsen) \
+    (*ps_mgau_base(mg)->vt->frame_eval_block)                           \
+    (mg, senscr, senone_active, n_senone_active, feat, frame, n_frame, compallsen)
 #define ps_mgau_transform(mg, mllr)                                  \
     (*ps_mgau_base(mg)->vt->transform)(mg, mllr)
-#define ps_mgau_free(mg)                                  \
-    (*ps_mgau_base(mg)->vt->free)(mg)
+
+/**
+ * Retain a model, for instance for copies sharing its parameters.
+ */
+ps_mgau_t *ps_mgau_retain(ps_mgau_t *mgau);
+
+/**
+ * Release a model.
+ *
+ * @return new reference count (0 if freed).
+ */
+int ps_mgau_free(ps_mgau_t *mgau);
+
+/**
+ * Create a model sharing the parameters of another one.
+ *
+ * @return the new model, or NULL if mgau does not support it.
+ */
+ps_mgau_t *ps_mgau_copy(ps_mgau_t *mgau, struct acmod_s *acmod);
+
+/**
+ * Add the parameters of a model to a model bundle.
+ *
+ * @return 0 for success, <0 on error or if mgau does not support it.
+ */
+int ps_mgau_write_bundle(ps_mgau_t *mgau, model_bundle_writer_t *w);
 
 /**
  * Acoustic model structure.
@@ -160,6 +223,9 @@ struct acmod_s {
     tmat_t *tmat;              /**< Transition matrices. */
     ps_mgau_t *mgau;           /**< Model parameters. */
     ps_mllr_t *mllr;           /**< Speaker transformation. */
+    ps_mllr_t *fmllr;          /**< Speaker transformation of features. */
+    mfcc_t *fmllr_tmp;         /**< Scratch space for fmllr. */
+    model_bundle_t *bundle;    /**< Memory-mapped parameters (or NULL). */
 
     /* Senone scoring: */
     int16 *senone_scores;      /**< GMM scores for current frame. */
@@ -169,6 +235,22 @@ struct acmod_s {
     int n_senone_active;       /**< Number of active GMMs. */
     int log_zero;              /**< Zero log-probability value. */
 
+    /* Block scoring (several frames per pass over the model): */
+    int n_score_block;         /**< Maximum number of frames in a block. */
+    int16 **blk_scores;        /**< GMM scores for the frames in the block. */
+    mfcc_t ***blk_feat;        /**< Features for the frames in the block. */
+    bitvec_t *blk_active_vec;  /**< GMMs scored in the block. */
+    bitvec_t *blk_used_vec;    /**< GMMs requested since the block started. */
+    uint8 *blk_active;         /**< Array of deltas to blk_active_vec. */
+    int n_blk_active;          /**< Number of GMMs scored in the block. */
+    int blk_frame;             /**< Frame index of the first frame in the block. */
+    int n_blk_frame;           /**< Number of frames in the block. */
+    thread_pool_t *pipeline;   /**< Thread scoring the next block while the
+                                    current frame is searched (or NULL). */
+    int n_blk_hit;             /**< Frames taken from a block in this utterance. */
+    int n_blk_miss;            /**< Frames for which a block was scored. */
+    ptmr_t perf;               /**< Time spent in acoustic scoring. */
+
     /* Utterance processing: */
     mfcc_t **mfc_buf;   /**< Temporary buffer of acoustic features. */
     mfcc_t ***feat_buf; /**< Temporary buffer of dynamic features. */
@@ -184,7 +266,7 @@ struct acmod_s {
     uint8 grow_feat;    /**< Whether to grow feat_buf. */
     uint8 insen_swap;   /**< Whether to swap input senone score. */
 
-    frame_idx_t output_frame; /**< Index of next frame of dynamic features. */
+    int output_frame;         /**< Index of next frame of dynamic features. */
     frame_idx_t n_mfc_alloc;  /**< Number of frames allocated in mfc_buf */
     frame_idx_t n_mfc_frame;  /**< Number of frames active in mfc_buf */
     frame_idx_t mfc_outidx;   /**< Start of active frames in mfc_buf */
@@ -212,19 +294,46 @@ typedef struct acmod_s acmod_t;
  */
 acmod_t *acmod_init(cmd_ln_t *config, logmath_t *lmath, fe_t *fe, feat_t *fcb);
 
+/**
+ * Create an acoustic model sharing the parameters of another one.
+ *
+ * The model definition, transition matrices, Gaussians and mixture
+ * weights of <code>other</code> are shared, while feature
+ * computation, buffers and scratch space for scoring are private to
+ * the new object, so that both can be used at the same time by
+ * different threads.  The new one can be adapted with
+ * acmod_update_mllr(), which makes it use its own copy of the
+ * Gaussians, but <code>other</code> cannot while it is shared.
+ *
+ * @return a newly initialized acmod_t, or NULL on failure.
+ */
+acmod_t *acmod_copy(acmod_t *other);
+
 /**
  * Adapt acoustic model using a linear transform.
  *
- * @param mllr The new transform to use, or NULL to update the existing
- *              transform.  The decoder retains ownership of this pointer,
- *              so you should not attempt to free it manually.  Use
- *              ps_mllr_retain() if you wish to reuse it
+ * @param mllr The new transform to use, or NULL to go back to the
+ *              unadapted model.  The decoder retains ownership of this
+ *              pointer, so you should not attempt to free it manually.
+ *              Use ps_mllr_retain() if you wish to reuse it
  *              elsewhere.
  * @return The updated transform object for this decoder, or
- *         NULL on failure.
+ *         NULL on failure (or if there is none).
  */
 ps_mllr_t *acmod_update_mllr(acmod_t *acmod, ps_mllr_t *mllr);
 
+/**
+ * Adapt to a speaker using a linear transform of the features
+ * computed from now on, instead of the acoustic model.
+ *
+ * @param fmllr The new transform to use, or NULL for none.  The
+ *              decoder retains ownership of this pointer, as with
+ *              acmod_update_mllr().
+ * @return The updated transform object for this decoder, or
+ *         NULL on failure (or if there is none).
+ */
+ps_mllr_t *acmod_update_fmllr(acmod_t *acmod, ps_mllr_t *fmllr);
+
 /**
  * Start logging senone scores to a filehandle.
  *
@@ -257,6 +366,17 @@ int acmod_set_rawfh(acmod_t *acmod, FILE *logfh);
  */
 void acmod_free(acmod_t *acmod);
 
+/**
+ * Write the model definition, transition matrices and precomputed
+ * parameters to a model bundle, which is used instead of the files
+ * by acmod_init() with the same -logbase, -varfloor, -mixwfloor and
+ * -tmatfloor (see the -bundle option).
+ *
+ * @return 0 for success, <0 on error (including if the model is
+ * adapted or of a type which cannot be bundled).
+ */
+int acmod_write_bundle(acmod_t *acmod, char const *file);
+
 /**
  * Mark the start of an utterance.
  */
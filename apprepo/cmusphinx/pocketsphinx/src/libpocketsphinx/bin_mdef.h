@@ -58,6 +58,7 @@ extern "C" {
 #include <pocketsphinx_export.h>
 
 #include "mdef.h"
+#include "model_bundle.h"
 
 #define BIN_MDEF_FORMAT_VERSION 1
 /* Little-endian machines will write "BMDF" to disk, big-endian ones "FDMB". */
@@ -131,6 +132,7 @@ struct bin_mdef_s {
 	int16 sil;	    /**< CI phone ID for silence */
 
 	mmio_file_t *filemap;/**< File map for this file (if any) */
+	model_bundle_t *bundle;/**< Model bundle holding this (if any) */
 	char **ciname;       /**< CI phone names */
 	cd_tree_t *cd_tree;  /**< Tree mapping CD phones to phone IDs */
 	mdef_entry_t *phone; /**< All phone structures */
@@ -170,6 +172,11 @@ struct bin_mdef_s {
  */
 POCKETSPHINX_EXPORT
 bin_mdef_t *bin_mdef_read(cmd_ln_t *config, const char *filename);
+/**
+ * Get a binary mdef from a model bundle.
+ * @return NULL if the bundle has none.
+ */
+bin_mdef_t *bin_mdef_read_bundle(model_bundle_t *b);
 /**
  * Read a text mdef from a file (creating an in-memory binary mdef).
  */
@@ -180,6 +187,10 @@ bin_mdef_t *bin_mdef_read_text(cmd_ln_t *config, const char *filename);
  */
 POCKETSPHINX_EXPORT
 int bin_mdef_write(bin_mdef_t *m, const char *filename);
+/**
+ * Add a binary mdef to a model bundle.
+ */
+int bin_mdef_write_bundle(bin_mdef_t *m, model_bundle_writer_t *w);
 /**
  * Write a binary mdef to a text file.
  */
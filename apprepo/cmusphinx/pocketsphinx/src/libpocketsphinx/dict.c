@@ -41,6 +41,7 @@
 /* SphinxBase headers. */
 #include <sphinxbase/pio.h>
 #include <sphinxbase/strfuncs.h>
+#include <sphinxbase/case.h>
 
 /* Local headers. */
 #include "dict.h"
@@ -76,6 +77,231 @@ dict_ciphone_str(dict_t * d, s3wid_t wid, int32 pos)
 }
 
 
+/*
+ * Compiled dictionaries are model bundles (see model_bundle.h) with
+ * the contents of a dict_t: the word strings, pronunciations and
+ * alternate pronunciation links, and a minimal perfect hash function
+ * for dict_wordid().  They are mapped and used in place, so that only
+ * the array of dictword_t, pointing into the bundle, is built when
+ * reading one.  Words added afterwards go in the hash table.
+ *
+ * The perfect hash is built by "hash, displace and compress": words
+ * are put in buckets by a first hash, then, starting with the largest
+ * bucket, a seed is searched for each bucket such that a second hash,
+ * with this seed, sends all its words to free slots.  Words alone in
+ * their bucket are then put directly in the remaining slots, which is
+ * recorded as a negative displacement.  Slots hold the first hash
+ * too, so that looking up a missing word rarely compares strings.
+ */
+typedef struct bundle_dict_s {
+    int32 n_word;
+    int32 filler_start;
+    int32 filler_end;
+    int32 nocase;
+    int32 n_ciphone;    /**< CI phones of the model definition */
+    int32 ciphone_size; /**< Size of their names */
+    int32 str_size;     /**< Size of the string pool */
+    int32 n_phone;      /**< Size of the phone pool */
+    int32 n_bucket;     /**< Buckets of the perfect hash */
+} bundle_dict_t;
+
+typedef struct bundle_word_s {
+    int32 word;         /**< Offset in the string pool */
+    int32 ciphone;      /**< Offset in the phone pool */
+    int32 pronlen;
+    int32 alt;
+    int32 basewid;
+} bundle_word_t;
+
+typedef struct dict_mph_slot_s {
+    int32 wid;
+    int32 word;         /**< Offset in the string pool */
+    uint32 hash;        /**< First hash of the word */
+} dict_mph_slot_t;
+
+/** Perfect hash function, pointing into the bundle. */
+struct dict_mph_s {
+    int32 n_bucket;
+    int32 n_slot;
+    int32 const *disp;  /**< Seed or negative slot for each bucket */
+    dict_mph_slot_t const *slot;
+    char const *str;    /**< String pool */
+};
+
+typedef struct mph_bucket_s {
+    int32 size;
+    int32 bucket;
+} mph_bucket_t;
+
+/* Average number of words per bucket. */
+#define MPH_BUCKET_SIZE 4
+/* Give up if a bucket has no seed below this (it never happens). */
+#define MPH_MAX_SEED (1 << 24)
+
+/**
+ * Hash a word, giving two independent 32-bit hashes, the first for
+ * its bucket and the second (with a seed) for its slot.
+ */
+static void
+dict_mph_hash(dict_t *d, char const *word, uint32 *out_h1, uint32 *out_h2)
+{
+    unsigned char const *c = (unsigned char const *)word;
+    uint32 h1 = 0x811c9dc5, h2 = 0;
+
+    /* FNV-1a and a multiplicative hash. */
+    if (d->nocase) {
+        for (; *c; ++c) {
+            h1 = (h1 ^ UPPER_CASE(*c)) * 0x01000193;
+            h2 = (h2 + UPPER_CASE(*c)) * 0x5bd1e995;
+        }
+    }
+    else {
+        for (; *c; ++c) {
+            h1 = (h1 ^ *c) * 0x01000193;
+            h2 = (h2 + *c) * 0x5bd1e995;
+        }
+    }
+    *out_h1 = h1;
+    *out_h2 = h2;
+}
+
+/* Murmur3 finalizer, to mix in the seed. */
+static uint32
+mph_mix(uint32 h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+#define mph_bucket(h1, n) (mph_mix(h1) % (uint32)(n))
+#define mph_slot(h2, seed, n) (mph_mix((h2) ^ ((seed) * 0x9e3779b9)) % (uint32)(n))
+
+static s3wid_t
+dict_mph_lookup(dict_t *d, char const *word)
+{
+    dict_mph_t const *mph = d->mph;
+    dict_mph_slot_t const *slot;
+    uint32 h1, h2;
+    int32 disp;
+
+    dict_mph_hash(d, word, &h1, &h2);
+    disp = mph->disp[mph_bucket(h1, mph->n_bucket)];
+    if (disp < 0)
+        slot = mph->slot + (-disp - 1);
+    else
+        slot = mph->slot + mph_slot(h2, disp, mph->n_slot);
+    if (slot->hash != h1
+        || (d->nocase ? strcmp_nocase(mph->str + slot->word, word)
+            : strcmp(mph->str + slot->word, word)))
+        return BAD_S3WID;
+    return slot->wid;
+}
+
+static int
+mph_bucket_cmp(const void *a, const void *b)
+{
+    mph_bucket_t const *ba = a, *bb = b;
+
+    if (ba->size != bb->size)
+        return bb->size - ba->size;
+    return ba->bucket - bb->bucket;
+}
+
+/**
+ * Build the perfect hash function of all words in the dictionary.
+ *
+ * @param disp Output, displacement of each bucket
+ * @param slot Output, word id and hash in each slot (n_word)
+ */
+static int
+dict_mph_build(dict_t *d, int32 n_bucket, int32 *disp, dict_mph_slot_t *slot)
+{
+    int32 n = d->n_word;
+    mph_bucket_t *buckets;
+    uint32 *h1, *h2;
+    int32 *start, *members, *slots;
+    uint8 *used;
+    int32 i, j, k, free_slot, rv = -1;
+
+    /* Sort words by bucket. */
+    h1 = ckd_calloc(n, sizeof(*h1));
+    h2 = ckd_calloc(n, sizeof(*h2));
+    buckets = ckd_calloc(n_bucket, sizeof(*buckets));
+    start = ckd_calloc(n_bucket + 1, sizeof(*start));
+    members = ckd_calloc(n, sizeof(*members));
+    for (i = 0; i < n; ++i) {
+        dict_mph_hash(d, d->word[i].word, &h1[i], &h2[i]);
+        ++start[mph_bucket(h1[i], n_bucket) + 1];
+    }
+    for (i = 0; i < n_bucket; ++i)
+        start[i + 1] += start[i];
+    for (i = 0; i < n; ++i) {
+        int32 b = mph_bucket(h1[i], n_bucket);
+        members[start[b] + buckets[b].size++] = i;
+    }
+    for (i = 0; i < n_bucket; ++i)
+        buckets[i].bucket = i;
+    qsort(buckets, n_bucket, sizeof(*buckets), mph_bucket_cmp);
+
+    used = ckd_calloc(n, sizeof(*used));
+    slots = ckd_calloc(buckets[0].size, sizeof(*slots));
+    memset(disp, 0, n_bucket * sizeof(*disp));
+    for (i = 0; i < n_bucket && buckets[i].size > 1; ++i) {
+        int32 const *m = members + start[buckets[i].bucket];
+        uint32 seed;
+
+        for (seed = 1; seed < MPH_MAX_SEED; ++seed) {
+            for (j = 0; j < buckets[i].size; ++j) {
+                slots[j] = mph_slot(h2[m[j]], seed, n);
+                if (used[slots[j]])
+                    break;
+                for (k = 0; k < j; ++k)
+                    if (slots[k] == slots[j])
+                        break;
+                if (k < j)
+                    break;
+            }
+            if (j == buckets[i].size)
+                break;
+        }
+        if (seed == MPH_MAX_SEED) {
+            E_ERROR("Failed to find a perfect hash function\n");
+            goto error_out;
+        }
+        disp[buckets[i].bucket] = seed;
+        for (j = 0; j < buckets[i].size; ++j) {
+            used[slots[j]] = TRUE;
+            slot[slots[j]].wid = m[j];
+            slot[slots[j]].hash = h1[m[j]];
+        }
+    }
+    for (free_slot = 0; i < n_bucket && buckets[i].size == 1; ++i) {
+        int32 w = members[start[buckets[i].bucket]];
+
+        while (used[free_slot])
+            ++free_slot;
+        used[free_slot] = TRUE;
+        slot[free_slot].wid = w;
+        slot[free_slot].hash = h1[w];
+        disp[buckets[i].bucket] = -free_slot - 1;
+    }
+    rv = 0;
+
+error_out:
+    ckd_free(h1);
+    ckd_free(h2);
+    ckd_free(buckets);
+    ckd_free(start);
+    ckd_free(members);
+    ckd_free(used);
+    ckd_free(slots);
+    return rv;
+}
+
 s3wid_t
 dict_add_word(dict_t * d, char const *word, s3cipid_t const * p, int32 np)
 {
@@ -84,6 +310,10 @@ dict_add_word(dict_t * d, char const *word, s3cipid_t const * p, int32 np)
     s3wid_t newwid;
     char *wword;
 
+    /* Words of a compiled dictionary are not in the hash table. */
+    if (d->bundle && dict_mph_lookup(d, word) != BAD_S3WID)
+        return BAD_S3WID;
+
     if (d->n_word >= d->max_words) {
         E_INFO("Reallocating to %d KiB for word entries\n",
                (d->max_words + S3DICT_INC_SZ) * sizeof(dictword_t) / 1024);
@@ -123,7 +353,7 @@ dict_add_word(dict_t * d, char const *word, s3cipid_t const * p, int32 np)
 	int32 w;
 
         /* Truncated to a baseword string; find its ID */
-        if (hash_table_lookup_int32(d->ht, wword, &w) < 0) {
+        if ((w = dict_wordid(d, wword)) == BAD_S3WID) {
             E_ERROR("Missing base word for: %s\n", word);
             ckd_free(wword);
             ckd_free(wordp->word);
@@ -247,6 +477,263 @@ dict_write(dict_t *dict, char const *filename, char const *format)
 }
 
 
+int
+dict_write_bundle(dict_t *dict, char const *filename)
+{
+    model_bundle_writer_t *w;
+    bundle_dict_t hdr;
+    bundle_word_t *words;
+    char *ciphones, *strs;
+    s3cipid_t *phones;
+    int32 *disp;
+    dict_mph_slot_t *slot;
+    FILE *fh;
+    size_t pos;
+    int32 i;
+    int rv = -1;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.n_word = dict->n_word;
+    hdr.filler_start = dict->filler_start;
+    hdr.filler_end = dict->filler_end;
+    hdr.nocase = dict->nocase;
+    hdr.n_bucket = dict->n_word / MPH_BUCKET_SIZE + 1;
+    if (dict->mdef)
+        hdr.n_ciphone = bin_mdef_n_ciphone(dict->mdef);
+    for (i = 0; i < hdr.n_ciphone; ++i)
+        hdr.ciphone_size += strlen(bin_mdef_ciphone_str(dict->mdef, i)) + 1;
+    for (i = 0; i < dict->n_word; ++i) {
+        hdr.str_size += strlen(dict->word[i].word) + 1;
+        hdr.n_phone += dict->word[i].pronlen;
+    }
+
+    ciphones = ckd_calloc(hdr.ciphone_size + 1, 1);
+    for (pos = i = 0; i < hdr.n_ciphone; ++i) {
+        strcpy(ciphones + pos, bin_mdef_ciphone_str(dict->mdef, i));
+        pos += strlen(ciphones + pos) + 1;
+    }
+    words = ckd_calloc(dict->n_word, sizeof(*words));
+    strs = ckd_calloc(hdr.str_size, 1);
+    phones = ckd_calloc(hdr.n_phone + 1, sizeof(*phones));
+    for (pos = i = 0; i < dict->n_word; ++i) {
+        words[i].word = pos;
+        strcpy(strs + pos, dict->word[i].word);
+        pos += strlen(dict->word[i].word) + 1;
+        words[i].pronlen = dict->word[i].pronlen;
+        words[i].alt = dict->word[i].alt;
+        words[i].basewid = dict->word[i].basewid;
+    }
+    for (pos = i = 0; i < dict->n_word; ++i) {
+        words[i].ciphone = pos;
+        memcpy(phones + pos, dict->word[i].ciphone,
+               dict->word[i].pronlen * sizeof(*phones));
+        pos += dict->word[i].pronlen;
+    }
+    disp = ckd_calloc(hdr.n_bucket, sizeof(*disp));
+    slot = ckd_calloc(dict->n_word, sizeof(*slot));
+    if (dict_mph_build(dict, hdr.n_bucket, disp, slot) < 0)
+        goto error_out;
+    for (i = 0; i < dict->n_word; ++i)
+        slot[i].word = words[slot[i].wid].word;
+
+    if ((w = model_bundle_writer_init(filename, NULL, NULL)) == NULL)
+        goto error_out;
+    if ((fh = model_bundle_add(w, "dict")) == NULL
+        || model_bundle_write_aligned(fh, &hdr, sizeof(hdr)) < 0
+        || (fh = model_bundle_add(w, "dictciphone")) == NULL
+        || model_bundle_write_aligned(fh, ciphones, hdr.ciphone_size) < 0
+        || (fh = model_bundle_add(w, "dictword")) == NULL
+        || model_bundle_write_aligned(fh, words,
+                                      dict->n_word * sizeof(*words)) < 0
+        || (fh = model_bundle_add(w, "dictstr")) == NULL
+        || model_bundle_write_aligned(fh, strs, hdr.str_size) < 0
+        || (fh = model_bundle_add(w, "dictphone")) == NULL
+        || model_bundle_write_aligned(fh, phones,
+                                      hdr.n_phone * sizeof(*phones)) < 0
+        || (fh = model_bundle_add(w, "dictmphdisp")) == NULL
+        || model_bundle_write_aligned(fh, disp,
+                                      hdr.n_bucket * sizeof(*disp)) < 0
+        || (fh = model_bundle_add(w, "dictmphslot")) == NULL
+        || model_bundle_write_aligned(fh, slot,
+                                      dict->n_word * sizeof(*slot)) < 0) {
+        model_bundle_writer_close(w, TRUE);
+        goto error_out;
+    }
+    if ((rv = model_bundle_writer_close(w, FALSE)) == 0)
+        E_INFO("Wrote %d words to compiled dictionary %s\n",
+               dict->n_word, filename);
+
+error_out:
+    ckd_free(ciphones);
+    ckd_free(words);
+    ckd_free(strs);
+    ckd_free(phones);
+    ckd_free(disp);
+    ckd_free(slot);
+    return rv;
+}
+
+/**
+ * Get a section of a compiled dictionary holding (at least) n
+ * elements of the given size.
+ */
+static void const *
+dict_bundle_get(model_bundle_t *b, char const *name, size_t elsize, int32 n)
+{
+    void const *data;
+    size_t size;
+
+    if ((data = model_bundle_get(b, name, &size)) == NULL
+        || size / elsize < (size_t)n)
+        return NULL;
+    return data;
+}
+
+/**
+ * Check the contents of a compiled dictionary, so that a corrupt one
+ * cannot make the decoder read outside of it.
+ */
+static int
+dict_bundle_check(bundle_dict_t const *hdr, bundle_word_t const *words,
+                  char const *strs, s3cipid_t const *phones,
+                  int32 const *disp, dict_mph_slot_t const *slot)
+{
+    int32 i, j;
+
+    if (hdr->n_word <= 0 || hdr->n_word >= MAX_S3WID
+        || hdr->filler_start < 0 || hdr->filler_end >= hdr->n_word
+        || hdr->n_ciphone < 0 || hdr->ciphone_size < 0
+        || hdr->str_size <= 0 || hdr->n_phone < 0 || hdr->n_bucket <= 0
+        || strs[hdr->str_size - 1] != '\0')
+        return -1;
+    for (i = 0; i < hdr->n_word; ++i) {
+        bundle_word_t const *wd = words + i;
+
+        if (wd->word < 0 || wd->word >= hdr->str_size
+            || wd->pronlen < 0 || wd->ciphone < 0
+            || wd->ciphone > hdr->n_phone - wd->pronlen
+            || wd->basewid < 0 || wd->basewid >= hdr->n_word
+            || (wd->alt != BAD_S3WID
+                && (wd->alt < 0 || wd->alt >= hdr->n_word)))
+            return -1;
+        for (j = 0; j < wd->pronlen; ++j)
+            if (phones[wd->ciphone + j] < 0
+                || phones[wd->ciphone + j] >= hdr->n_ciphone)
+                return -1;
+        if (slot[i].wid < 0 || slot[i].wid >= hdr->n_word
+            || slot[i].word != words[slot[i].wid].word)
+            return -1;
+    }
+    for (i = 0; i < hdr->n_bucket; ++i)
+        if (disp[i] < -hdr->n_word)
+            return -1;
+    return 0;
+}
+
+static dict_t *
+dict_init_bundle(cmd_ln_t *config, bin_mdef_t *mdef, char const *dictfile)
+{
+    model_bundle_t *b;
+    bundle_dict_t const *hdr;
+    bundle_word_t const *words;
+    char const *ciphones, *strs;
+    s3cipid_t const *phones;
+    int32 const *disp;
+    dict_mph_slot_t const *slot;
+    dict_t *d;
+    int32 i;
+
+    if ((b = model_bundle_read(dictfile, NULL, NULL)) == NULL)
+        return NULL;
+    if ((hdr = dict_bundle_get(b, "dict", sizeof(*hdr), 1)) == NULL
+        || (ciphones = dict_bundle_get(b, "dictciphone", 1,
+                                       hdr->ciphone_size)) == NULL
+        || (words = dict_bundle_get(b, "dictword", sizeof(*words),
+                                    hdr->n_word)) == NULL
+        || (strs = dict_bundle_get(b, "dictstr", 1, hdr->str_size)) == NULL
+        || (phones = dict_bundle_get(b, "dictphone", sizeof(*phones),
+                                     hdr->n_phone)) == NULL
+        || (disp = dict_bundle_get(b, "dictmphdisp", sizeof(*disp),
+                                   hdr->n_bucket)) == NULL
+        || (slot = dict_bundle_get(b, "dictmphslot", sizeof(*slot),
+                                   hdr->n_word)) == NULL
+        || dict_bundle_check(hdr, words, strs, phones, disp, slot) < 0) {
+        E_ERROR("Compiled dictionary %s is truncated or corrupt\n", dictfile);
+        model_bundle_free(b);
+        return NULL;
+    }
+
+    /* Phone ids must mean the same thing as when it was compiled. */
+    if (mdef) {
+        char const *ph = ciphones;
+
+        for (i = 0; i < hdr->n_ciphone
+                 && i < bin_mdef_n_ciphone(mdef)
+                 && ph < ciphones + hdr->ciphone_size
+                 && 0 == strcmp(ph, bin_mdef_ciphone_str(mdef, i)); ++i)
+            ph += strlen(ph) + 1;
+        if (i != hdr->n_ciphone || i != bin_mdef_n_ciphone(mdef)) {
+            E_ERROR("Compiled dictionary %s was made for another phone set\n",
+                    dictfile);
+            model_bundle_free(b);
+            return NULL;
+        }
+    }
+    if (config && cmd_ln_exists_r(config, "-dictcase")
+        && cmd_ln_boolean_r(config, "-dictcase") != hdr->nocase) {
+        E_ERROR("Compiled dictionary %s was made with -dictcase %s\n",
+                dictfile, hdr->nocase ? "yes" : "no");
+        model_bundle_free(b);
+        return NULL;
+    }
+    if (config && cmd_ln_str_r(config, "-fdict"))
+        E_INFO("Filler words are in compiled dictionary %s, not reading %s\n",
+               dictfile, cmd_ln_str_r(config, "-fdict"));
+
+    d = (dict_t *) ckd_calloc(1, sizeof(dict_t));
+    d->refcnt = 1;
+    d->bundle = b;
+    d->nocase = hdr->nocase;
+    d->n_word = d->n_bundle_word = hdr->n_word;
+    d->max_words = (hdr->n_word < MAX_S3WID - S3DICT_INC_SZ)
+        ? hdr->n_word + S3DICT_INC_SZ : MAX_S3WID;
+    d->word = (dictword_t *) ckd_calloc(d->max_words, sizeof(dictword_t));
+    for (i = 0; i < hdr->n_word; ++i) {
+        d->word[i].word = (char *) strs + words[i].word;
+        d->word[i].ciphone = words[i].pronlen
+            ? (s3cipid_t *) phones + words[i].ciphone : NULL;
+        d->word[i].pronlen = words[i].pronlen;
+        d->word[i].alt = words[i].alt;
+        d->word[i].basewid = words[i].basewid;
+    }
+    d->mph = ckd_calloc(1, sizeof(*d->mph));
+    d->mph->n_bucket = hdr->n_bucket;
+    d->mph->n_slot = hdr->n_word;
+    d->mph->disp = disp;
+    d->mph->slot = slot;
+    d->mph->str = strs;
+    /* For words added later. */
+    d->ht = hash_table_new(S3DICT_INC_SZ, d->nocase);
+    if (mdef)
+        d->mdef = bin_mdef_retain(mdef);
+    d->filler_start = hdr->filler_start;
+    d->filler_end = hdr->filler_end;
+    d->startwid = dict_wordid(d, S3_START_WORD);
+    d->finishwid = dict_wordid(d, S3_FINISH_WORD);
+    d->silwid = dict_wordid(d, S3_SILENCE_WORD);
+    if (NOT_S3WID(d->startwid) || NOT_S3WID(d->finishwid)
+        || NOT_S3WID(d->silwid)) {
+        E_ERROR("Compiled dictionary %s has no %s, %s or %s\n", dictfile,
+                S3_START_WORD, S3_FINISH_WORD, S3_SILENCE_WORD);
+        dict_free(d);
+        return NULL;
+    }
+    E_INFO("%d words in compiled dictionary\n", d->n_word);
+
+    return d;
+}
+
+
 dict_t *
 dict_init(cmd_ln_t *config, bin_mdef_t * mdef)
 {
@@ -261,6 +748,8 @@ dict_init(cmd_ln_t *config, bin_mdef_t * mdef)
         dictfile = cmd_ln_str_r(config, "-dict");
         fillerfile = cmd_ln_str_r(config, "-fdict");
     }
+    if (dictfile && model_bundle_probe(dictfile))
+        return dict_init_bundle(config, mdef, dictfile);
 
     /*
      * First obtain #words in dictionary (for hash table allocation).
@@ -386,6 +875,11 @@ dict_wordid(dict_t *d, const char *word)
     assert(d);
     assert(word);
 
+    if (d->bundle) {
+        if ((w = dict_mph_lookup(d, word)) != BAD_S3WID
+            || d->n_word == d->n_bundle_word)
+            return w;
+    }
     if (hash_table_lookup_int32(d->ht, word, &w) < 0)
         return (BAD_S3WID);
     return w;
@@ -458,8 +952,9 @@ dict_free(dict_t * d)
     if (--d->refcnt > 0)
         return d->refcnt;
 
-    /* First Step, free all memory allocated for each word */
-    for (i = 0; i < d->n_word; i++) {
+    /* First Step, free all memory allocated for each word (not in
+     * the compiled dictionary) */
+    for (i = d->n_bundle_word; i < d->n_word; i++) {
         word = (dictword_t *) & (d->word[i]);
         if (word->word)
             ckd_free((void *) word->word);
@@ -473,6 +968,8 @@ dict_free(dict_t * d)
         hash_table_free(d->ht);
     if (d->mdef)
         bin_mdef_free(d->mdef);
+    ckd_free(d->mph);
+    model_bundle_free(d->bundle);
     ckd_free((void *) d);
 
     return 0;
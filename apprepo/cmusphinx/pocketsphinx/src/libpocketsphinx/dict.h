@@ -48,6 +48,7 @@
 /* Local headers. */
 #include "s3types.h"
 #include "bin_mdef.h"
+#include "model_bundle.h"
 #include "pocketsphinx_export.h"
 
 #define S3DICT_INC_SZ 4096
@@ -71,6 +72,9 @@ typedef struct {
     s3wid_t basewid;	/**< Base pronunciation id */
 } dictword_t;
 
+/** Perfect hash function of a compiled dictionary. */
+typedef struct dict_mph_s dict_mph_t;
+
 /** 
     \struct dict_t
     \brief a structure for a dictionary. 
@@ -89,6 +93,9 @@ typedef struct {
     s3wid_t finishwid;	/**< FOR INTERNAL-USE ONLY */
     s3wid_t silwid;	/**< FOR INTERNAL-USE ONLY */
     int nocase;
+    model_bundle_t *bundle; /**< Compiled dictionary, if read from one */
+    int32 n_bundle_word;   /**< #Entries pointing into the compiled dictionary */
+    dict_mph_t *mph;       /**< Perfect hash of the compiled dictionary words */
 } dict_t;
 
 
@@ -101,6 +108,10 @@ typedef struct {
  *
  * Otherwise an empty case-sensitive dictionary will be created.
  *
+ * If -dict is a compiled dictionary (see dict_write_bundle()), it is
+ * mapped and used in place, and -fdict is not read, since the filler
+ * words were compiled into it.
+ *
  * Return ptr to dict_t if successful, NULL otherwise.
  */
 dict_t *dict_init(cmd_ln_t *config, /**< Configuration (-dict, -fdict, -dictcase) or NULL */
@@ -112,6 +123,15 @@ dict_t *dict_init(cmd_ln_t *config, /**< Configuration (-dict, -fdict, -dictcase
  */
 int dict_write(dict_t *dict, char const *filename, char const *format);
 
+/**
+ * Write a compiled dictionary, holding all the words of a dictionary
+ * (including fillers) and a perfect hash function to look them up.
+ * It can only be used with the same CI phone set.
+ *
+ * @return 0 for success, -1 for failure.
+ */
+int dict_write_bundle(dict_t *dict, char const *filename);
+
 /** Return word id for given word string if present.  Otherwise return BAD_S3WID */
 POCKETSPHINX_EXPORT
 s3wid_t dict_wordid(dict_t *d, const char *word);
@@ -46,6 +46,8 @@
 /* SphinxBase headers. */
 #include <sphinxbase/ckd_alloc.h>
 #include <sphinxbase/err.h>
+#include <sphinxbase/bitvec.h>
+#include <sphinxbase/hash_table.h>
 
 /* Local headers. */
 #include "fsg_lextree.h"
@@ -288,7 +290,12 @@ fsg_lextree_free(fsg_lextree_t * lextree)
     if (lextree == NULL)
         return;
 
-    if (lextree->fsg)
+    if (lextree->pnode_block) {
+        for (s = 0; s < lextree->n_pnode; s++)
+            hmm_deinit(&lextree->pnode_block[s].hmm);
+        ckd_free(lextree->pnode_block);
+    }
+    else if (lextree->fsg)
         for (s = 0; s < fsg_model_n_state(lextree->fsg); s++)
             fsg_psubtree_free(lextree->alloc_head[s]);
 
@@ -299,6 +306,443 @@ fsg_lextree_free(fsg_lextree_t * lextree)
     ckd_free(lextree);
 }
 
+/*
+ * Layout of the "fsg" section of a bundle: this header, then the
+ * transitions (fsg_link_t, null ones with wid -1), the name and
+ * words of the FSG as NUL-terminated strings, and the silence and
+ * alternate word bit vectors if there are any, each one padded to
+ * MODEL_BUNDLE_ALIGN.
+ */
+typedef struct bundle_fsg_s {
+    int32 n_state;
+    int32 start_state;
+    int32 final_state;
+    int32 n_word;
+    int32 n_link;
+    int32 vocab_size;   /**< Size of the strings in bytes. */
+    int32 has_sil;
+    int32 has_alt;
+    float32 lw;
+} bundle_fsg_t;
+
+/*
+ * Layout of the "lextree" section: this header, then the left and
+ * right context lists (lc[0] and rc[0]), the root and alloc_head
+ * nodes of each state, and the nodes, each one padded to
+ * MODEL_BUNDLE_ALIGN.  Nodes are referred to by index, -1 for NULL.
+ */
+typedef struct bundle_lextree_s {
+    int32 n_state;
+    int32 n_ci;
+    int32 n_pnode;
+    int32 reserved;
+} bundle_lextree_t;
+
+typedef struct bundle_pnode_s {
+    int32 next;         /**< First child, or destination state of the
+                           FSG transition for leaves. */
+    int32 wid;          /**< FSG word ID for leaves, -1 otherwise. */
+    int32 sibling;
+    int32 alloc_next;
+    int32 logs2prob;
+    fsg_pnode_ctxt_t ctxt;
+    uint16 ci_ext;
+    uint8 ppos;
+    uint8 leaf;
+    int32 ssid;
+    int32 tmatid;
+} bundle_pnode_t;
+
+static int
+write_fsg(fsg_model_t *fsg, model_bundle_writer_t *w)
+{
+    bundle_fsg_t hdr;
+    fsg_link_t *links;
+    char *vocab, *ptr;
+    char const *name;
+    FILE *fh;
+    int32 s, i, n_link;
+    int rv;
+
+    n_link = 0;
+    for (s = 0; s < fsg_model_n_state(fsg); s++) {
+        fsg_arciter_t *itor;
+        for (itor = fsg_model_arcs(fsg, s); itor; itor = fsg_arciter_next(itor))
+            ++n_link;
+    }
+    links = ckd_calloc(n_link, sizeof(*links));
+    n_link = 0;
+    for (s = 0; s < fsg_model_n_state(fsg); s++) {
+        fsg_arciter_t *itor;
+        for (itor = fsg_model_arcs(fsg, s); itor; itor = fsg_arciter_next(itor))
+            links[n_link++] = *fsg_arciter_get(itor);
+    }
+
+    name = fsg_model_name(fsg) ? fsg_model_name(fsg) : "";
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.vocab_size = strlen(name) + 1;
+    for (i = 0; i < fsg_model_n_word(fsg); i++)
+        hdr.vocab_size += strlen(fsg_model_word_str(fsg, i)) + 1;
+    ptr = vocab = ckd_calloc(hdr.vocab_size, 1);
+    strcpy(ptr, name);
+    ptr += strlen(name) + 1;
+    for (i = 0; i < fsg_model_n_word(fsg); i++) {
+        strcpy(ptr, fsg_model_word_str(fsg, i));
+        ptr += strlen(ptr) + 1;
+    }
+
+    hdr.n_state = fsg_model_n_state(fsg);
+    hdr.start_state = fsg_model_start_state(fsg);
+    hdr.final_state = fsg_model_final_state(fsg);
+    hdr.n_word = fsg_model_n_word(fsg);
+    hdr.n_link = n_link;
+    hdr.has_sil = fsg_model_has_sil(fsg);
+    hdr.has_alt = fsg_model_has_alt(fsg);
+    hdr.lw = fsg_model_lw(fsg);
+
+    rv = -1;
+    if ((fh = model_bundle_add(w, "fsg")) == NULL
+        || model_bundle_write_aligned(fh, &hdr, sizeof(hdr)) < 0
+        || model_bundle_write_aligned(fh, links, n_link * sizeof(*links)) < 0
+        || model_bundle_write_aligned(fh, vocab, hdr.vocab_size) < 0)
+        goto error_out;
+    if (hdr.has_sil
+        && model_bundle_write_aligned(fh, fsg->silwords,
+                                      bitvec_size(hdr.n_word)
+                                      * sizeof(bitvec_t)) < 0)
+        goto error_out;
+    if (hdr.has_alt
+        && model_bundle_write_aligned(fh, fsg->altwords,
+                                      bitvec_size(hdr.n_word)
+                                      * sizeof(bitvec_t)) < 0)
+        goto error_out;
+    rv = 0;
+
+error_out:
+    ckd_free(links);
+    ckd_free(vocab);
+    return rv;
+}
+
+static int32
+pnode_index(hash_table_t *index, fsg_pnode_t *pnode)
+{
+    int32 i;
+
+    if (pnode == NULL)
+        return -1;
+    if (hash_table_lookup_bkey_int32(index, (char const *)&pnode,
+                                     sizeof(pnode), &i) < 0)
+        E_FATAL("Node %p is not in the lextree\n", pnode);
+    return i;
+}
+
+static int
+write_lextree(fsg_lextree_t *lextree, model_bundle_writer_t *w)
+{
+    bundle_lextree_t hdr;
+    bundle_pnode_t *pnodes;
+    fsg_pnode_t **nodes, *pn;
+    hash_table_t *index;
+    int32 *root, *alloc_head;
+    int32 s, i;
+    size_t ctx_size;
+    FILE *fh;
+    int rv;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.n_state = fsg_model_n_state(lextree->fsg);
+    hdr.n_ci = bin_mdef_n_ciphone(lextree->mdef);
+    hdr.n_pnode = lextree->n_pnode;
+
+    /* Number the nodes in allocation order. */
+    nodes = ckd_calloc(hdr.n_pnode, sizeof(*nodes));
+    index = hash_table_new(hdr.n_pnode, HASH_CASE_YES);
+    i = 0;
+    for (s = 0; s < hdr.n_state; s++) {
+        for (pn = lextree->alloc_head[s]; pn; pn = pn->alloc_next) {
+            nodes[i] = pn;
+            (void)hash_table_enter_bkey_int32(index, (char const *)&nodes[i],
+                                        sizeof(nodes[i]), i);
+            ++i;
+        }
+    }
+    assert(i == hdr.n_pnode);
+
+    root = ckd_calloc(hdr.n_state, sizeof(*root));
+    alloc_head = ckd_calloc(hdr.n_state, sizeof(*alloc_head));
+    for (s = 0; s < hdr.n_state; s++) {
+        root[s] = pnode_index(index, lextree->root[s]);
+        alloc_head[s] = pnode_index(index, lextree->alloc_head[s]);
+    }
+    pnodes = ckd_calloc(hdr.n_pnode, sizeof(*pnodes));
+    for (i = 0; i < hdr.n_pnode; i++) {
+        pn = nodes[i];
+        if (pn->leaf) {
+            pnodes[i].next = fsg_link_to_state(pn->next.fsglink);
+            pnodes[i].wid = fsg_link_wid(pn->next.fsglink);
+        }
+        else {
+            pnodes[i].next = pnode_index(index, pn->next.succ);
+            pnodes[i].wid = -1;
+        }
+        pnodes[i].sibling = pnode_index(index, pn->sibling);
+        pnodes[i].alloc_next = pnode_index(index, pn->alloc_next);
+        pnodes[i].logs2prob = pn->logs2prob;
+        pnodes[i].ctxt = pn->ctxt;
+        pnodes[i].ci_ext = pn->ci_ext;
+        pnodes[i].ppos = pn->ppos;
+        pnodes[i].leaf = pn->leaf;
+        pnodes[i].ssid = hmm_nonmpx_ssid(&pn->hmm);
+        pnodes[i].tmatid = hmm_tmatid(&pn->hmm);
+    }
+
+    /* Context lists were allocated with ckd_calloc_2d(), so they are
+     * contiguous. */
+    ctx_size = hdr.n_state * (hdr.n_ci + 1) * sizeof(**lextree->lc);
+    rv = -1;
+    if ((fh = model_bundle_add(w, "lextree")) == NULL
+        || model_bundle_write_aligned(fh, &hdr, sizeof(hdr)) < 0
+        || model_bundle_write_aligned(fh, lextree->lc[0], ctx_size) < 0
+        || model_bundle_write_aligned(fh, lextree->rc[0], ctx_size) < 0
+        || model_bundle_write_aligned(fh, root,
+                                      hdr.n_state * sizeof(*root)) < 0
+        || model_bundle_write_aligned(fh, alloc_head,
+                                      hdr.n_state * sizeof(*alloc_head)) < 0
+        || model_bundle_write_aligned(fh, pnodes,
+                                      hdr.n_pnode * sizeof(*pnodes)) < 0)
+        goto error_out;
+    rv = 0;
+
+error_out:
+    hash_table_free(index);
+    ckd_free(nodes);
+    ckd_free(root);
+    ckd_free(alloc_head);
+    ckd_free(pnodes);
+    return rv;
+}
+
+int
+fsg_lextree_write(fsg_lextree_t *lextree, model_bundle_writer_t *w)
+{
+    if (write_fsg(lextree->fsg, w) < 0
+        || write_lextree(lextree, w) < 0) {
+        E_ERROR("Failed to write FSG lextree\n");
+        return -1;
+    }
+    return 0;
+}
+
+fsg_model_t *
+fsg_lextree_read_fsg(model_bundle_t *b, logmath_t *lmath)
+{
+    bundle_fsg_t const *hdr;
+    fsg_link_t const *links;
+    char const *vocab, *ptr;
+    bitvec_t const *bv;
+    fsg_model_t *fsg;
+    size_t size, bv_size;
+    int32 i;
+
+    if ((hdr = model_bundle_get(b, "fsg", &size)) == NULL)
+        return NULL;
+    if (size < MODEL_BUNDLE_ALIGN
+        || hdr->n_state <= 0 || hdr->n_word < 0 || hdr->n_link < 0
+        || hdr->vocab_size <= 0
+        || hdr->start_state < 0 || hdr->start_state >= hdr->n_state
+        || hdr->final_state < 0 || hdr->final_state >= hdr->n_state)
+        goto corrupt;
+    if ((size_t)hdr->n_link > size / sizeof(*links)
+        || (size_t)hdr->n_word / BITVEC_BITS > size
+        || (size_t)hdr->vocab_size > size)
+        goto corrupt;
+    bv_size = model_bundle_aligned(bitvec_size(hdr->n_word) * sizeof(*bv));
+    if (MODEL_BUNDLE_ALIGN
+        + model_bundle_aligned(hdr->n_link * sizeof(*links))
+        + model_bundle_aligned(hdr->vocab_size)
+        + (hdr->has_sil ? bv_size : 0) + (hdr->has_alt ? bv_size : 0) > size)
+        goto corrupt;
+    links = (fsg_link_t const *)((char const *)hdr + MODEL_BUNDLE_ALIGN);
+    vocab = (char const *)links
+        + model_bundle_aligned(hdr->n_link * sizeof(*links));
+    bv = (bitvec_t const *)(vocab + model_bundle_aligned(hdr->vocab_size));
+
+    /* Check the strings before using them. */
+    if (vocab[hdr->vocab_size - 1] != '\0')
+        goto corrupt;
+    for (ptr = vocab, i = 0; ptr < vocab + hdr->vocab_size;
+         ptr += strlen(ptr) + 1)
+        ++i;
+    if (i != hdr->n_word + 1)
+        goto corrupt;
+    for (i = 0; i < hdr->n_link; i++) {
+        if (links[i].from_state < 0 || links[i].from_state >= hdr->n_state
+            || links[i].to_state < 0 || links[i].to_state >= hdr->n_state
+            || links[i].wid < -1 || links[i].wid >= hdr->n_word
+            || (links[i].wid == -1 && links[i].logs2prob > 0))
+            goto corrupt;
+    }
+
+    fsg = fsg_model_init(vocab, lmath, hdr->lw, hdr->n_state);
+    fsg->start_state = hdr->start_state;
+    fsg->final_state = hdr->final_state;
+    /* Words are known to be unique, so don't look them up. */
+    fsg->n_word = hdr->n_word;
+    fsg->n_word_alloc = hdr->n_word + 1;
+    fsg->vocab = ckd_calloc(fsg->n_word_alloc, sizeof(*fsg->vocab));
+    ptr = vocab + strlen(vocab) + 1;
+    for (i = 0; i < hdr->n_word; i++) {
+        fsg->vocab[i] = ckd_salloc(ptr);
+        ptr += strlen(ptr) + 1;
+    }
+    if (hdr->has_sil) {
+        fsg->silwords = bitvec_alloc(fsg->n_word_alloc);
+        memcpy(fsg->silwords, bv, bitvec_size(hdr->n_word) * sizeof(*bv));
+        bv += bv_size / sizeof(*bv);
+    }
+    if (hdr->has_alt) {
+        fsg->altwords = bitvec_alloc(fsg->n_word_alloc);
+        memcpy(fsg->altwords, bv, bitvec_size(hdr->n_word) * sizeof(*bv));
+    }
+    /* The closure of null transitions is already there. */
+    for (i = 0; i < hdr->n_link; i++) {
+        if (links[i].wid < 0)
+            fsg_model_null_trans_add(fsg, links[i].from_state,
+                                     links[i].to_state, links[i].logs2prob);
+        else
+            fsg_model_trans_add(fsg, links[i].from_state, links[i].to_state,
+                                links[i].logs2prob, links[i].wid);
+    }
+    E_INFO("Read FSG %s (%d states, %d words, %d transitions) from %s\n",
+           fsg_model_name(fsg), hdr->n_state, hdr->n_word, hdr->n_link,
+           model_bundle_name(b));
+    return fsg;
+
+corrupt:
+    E_ERROR("FSG in %s is truncated or corrupt\n", model_bundle_name(b));
+    return NULL;
+}
+
+fsg_lextree_t *
+fsg_lextree_read(model_bundle_t *b, fsg_model_t *fsg,
+                 dict_t *dict, dict2pid_t *d2p,
+                 bin_mdef_t *mdef, hmm_context_t *ctx,
+                 int32 wip, int32 pip)
+{
+    bundle_lextree_t const *hdr;
+    bundle_pnode_t const *pnodes;
+    int32 const *root, *alloc_head;
+    fsg_lextree_t *lextree;
+    size_t size, ctx_size, state_size;
+    int32 n_state, n_ci, s, i, n;
+
+    if ((hdr = model_bundle_get(b, "lextree", &size)) == NULL)
+        return NULL;
+    n_state = fsg_model_n_state(fsg);
+    n_ci = bin_mdef_n_ciphone(mdef);
+    if (size < MODEL_BUNDLE_ALIGN
+        || hdr->n_state != n_state || hdr->n_ci != n_ci
+        || hdr->n_pnode < 0) {
+        E_ERROR("Lextree in %s does not match the FSG\n",
+                model_bundle_name(b));
+        return NULL;
+    }
+    if ((size_t)hdr->n_pnode > size / sizeof(*pnodes))
+        goto corrupt;
+    ctx_size = model_bundle_aligned(n_state * (n_ci + 1) * sizeof(int16));
+    state_size = model_bundle_aligned(n_state * sizeof(int32));
+    if (MODEL_BUNDLE_ALIGN + 2 * (ctx_size + state_size)
+        + hdr->n_pnode * sizeof(*pnodes) > size)
+        goto corrupt;
+    root = (int32 const *)((char const *)hdr + MODEL_BUNDLE_ALIGN
+                           + 2 * ctx_size);
+    alloc_head = (int32 const *)((char const *)root + state_size);
+    pnodes = (bundle_pnode_t const *)((char const *)alloc_head + state_size);
+
+    lextree = ckd_calloc(1, sizeof(fsg_lextree_t));
+    lextree->fsg = fsg;
+    lextree->root = ckd_calloc(n_state, sizeof(fsg_pnode_t *));
+    lextree->alloc_head = ckd_calloc(n_state, sizeof(fsg_pnode_t *));
+    lextree->ctx = ctx;
+    lextree->dict = dict;
+    lextree->d2p = d2p;
+    lextree->mdef = mdef;
+    lextree->wip = wip;
+    lextree->pip = pip;
+    lextree->lc = ckd_calloc_2d(n_state, n_ci + 1, sizeof(**lextree->lc));
+    lextree->rc = ckd_calloc_2d(n_state, n_ci + 1, sizeof(**lextree->rc));
+    memcpy(lextree->lc[0], (char const *)hdr + MODEL_BUNDLE_ALIGN,
+           n_state * (n_ci + 1) * sizeof(**lextree->lc));
+    memcpy(lextree->rc[0], (char const *)hdr + MODEL_BUNDLE_ALIGN + ctx_size,
+           n_state * (n_ci + 1) * sizeof(**lextree->rc));
+
+    /* Nodes have to be writable for the search, so copy them. */
+    lextree->n_pnode = hdr->n_pnode;
+    lextree->pnode_block = ckd_calloc(hdr->n_pnode,
+                                      sizeof(*lextree->pnode_block));
+#define PNODE(i) ((i) < 0 ? NULL : lextree->pnode_block + (i))
+    for (s = 0; s < n_state; s++) {
+        if (root[s] >= hdr->n_pnode || alloc_head[s] >= hdr->n_pnode)
+            goto corrupt_free;
+        lextree->root[s] = PNODE(root[s]);
+        lextree->alloc_head[s] = PNODE(alloc_head[s]);
+    }
+    /* Follow the allocation lists to find the source state of leaves. */
+    n = 0;
+    for (s = 0; s < n_state; s++) {
+        for (i = alloc_head[s]; i >= 0; i = pnodes[i].alloc_next) {
+            bundle_pnode_t const *p = pnodes + i;
+            fsg_pnode_t *pn = lextree->pnode_block + i;
+
+            if (++n > hdr->n_pnode
+                || p->next >= hdr->n_pnode || p->sibling >= hdr->n_pnode
+                || p->alloc_next >= hdr->n_pnode
+                || p->ci_ext >= n_ci
+                || p->ssid < 0 || p->ssid >= bin_mdef_n_sseq(mdef)
+                || p->tmatid < 0 || p->tmatid >= bin_mdef_n_tmat(mdef))
+                goto corrupt_free;
+            if (p->leaf) {
+                gnode_t *gn;
+
+                if (p->next < 0 || p->next >= n_state)
+                    goto corrupt_free;
+                for (gn = fsg_model_trans(fsg, s, p->next); gn;
+                     gn = gnode_next(gn)) {
+                    if (fsg_link_wid((fsg_link_t *)gnode_ptr(gn)) == p->wid)
+                        break;
+                }
+                if (gn == NULL)
+                    goto corrupt_free;
+                pn->next.fsglink = (fsg_link_t *)gnode_ptr(gn);
+            }
+            else
+                pn->next.succ = PNODE(p->next);
+            pn->alloc_next = PNODE(p->alloc_next);
+            pn->sibling = PNODE(p->sibling);
+            pn->logs2prob = p->logs2prob;
+            pn->ctxt = p->ctxt;
+            pn->ci_ext = p->ci_ext;
+            pn->ppos = p->ppos;
+            pn->leaf = p->leaf;
+            pn->ctx = ctx;
+            hmm_init(ctx, &pn->hmm, FALSE, p->ssid, p->tmatid);
+        }
+    }
+#undef PNODE
+    if (n != hdr->n_pnode)
+        goto corrupt_free;
+    E_INFO("Read lextree with %d HMM nodes from %s\n",
+           lextree->n_pnode, model_bundle_name(b));
+    return lextree;
+
+corrupt_free:
+    fsg_lextree_free(lextree);
+corrupt:
+    E_ERROR("Lextree in %s is truncated or corrupt\n", model_bundle_name(b));
+    return NULL;
+}
+
 /******************************
  * psubtree stuff starts here *
  ******************************/
@@ -85,6 +85,7 @@
 #include "hmm.h"
 #include "dict.h"
 #include "dict2pid.h"
+#include "model_bundle.h"
 
 /*
  * **HACK-ALERT**!!  Compile-time constant determining the size of the
@@ -247,6 +248,8 @@ typedef struct fsg_lextree_s {
     fsg_pnode_t **alloc_head;	/* alloc_head[s] = head of linear list of all
 				   pnodes allocated for state s */
     int32 n_pnode;	/* #HMM nodes in search structure */
+    fsg_pnode_t *pnode_block;	/* All pnodes, if read from a bundle
+                                   (NULL if allocated one by one) */
     int32 wip;
     int32 pip;
 } fsg_lextree_t;
@@ -263,6 +266,40 @@ fsg_lextree_t *fsg_lextree_init(fsg_model_t *fsg, dict_t *dict,
 				bin_mdef_t *mdef, hmm_context_t *ctx,
 				int32 wip, int32 pip);
 
+/**
+ * Write an FSG and its lextree to "fsg" and "lextree" sections of a
+ * bundle.  Null transitions are written as they are, so the FSG
+ * should already contain their closure.
+ *
+ * @return 0 for success, -1 for failure.
+ */
+int fsg_lextree_write(fsg_lextree_t *lextree, model_bundle_writer_t *w);
+
+/**
+ * Read the FSG written by fsg_lextree_write() from a bundle.
+ *
+ * @return a new FSG, or NULL if there is no such section or it is corrupt.
+ */
+fsg_model_t *fsg_lextree_read_fsg(model_bundle_t *b, logmath_t *lmath);
+
+/**
+ * Read the lextree written by fsg_lextree_write() from a bundle.
+ *
+ * Only the HMMs are initialized, the left and right contexts and the
+ * tree structure are used as they were computed.  The caller must
+ * make sure that they were computed for the same FSG, dictionary,
+ * model and penalties.
+ *
+ * @param fsg The FSG read with fsg_lextree_read_fsg() or one with
+ * the same transitions.
+ * @return a new lextree, or NULL if there is no such section or it
+ * does not match the FSG.
+ */
+fsg_lextree_t *fsg_lextree_read(model_bundle_t *b, fsg_model_t *fsg,
+                                dict_t *dict, dict2pid_t *d2p,
+                                bin_mdef_t *mdef, hmm_context_t *ctx,
+                                int32 wip, int32 pip);
+
 /**
  * Free lextrees for an FSG.
  */
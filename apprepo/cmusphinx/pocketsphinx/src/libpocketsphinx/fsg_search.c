@@ -71,6 +71,7 @@
 #define __FSG_DBG_CHAN__	0
 
 static ps_seg_t *fsg_search_seg_iter(ps_search_t *search, int32 *out_score);
+static int fsg_search_check_dict(fsg_search_t *fsgs, fsg_model_t *fsg);
 static ps_lattice_t *fsg_search_lattice(ps_search_t *search);
 static int fsg_search_prob(ps_search_t *search);
 
@@ -87,6 +88,465 @@ static ps_searchfuncs_t fsg_funcs = {
     /* seg_iter: */ fsg_search_seg_iter,
 };
 
+/*
+ * Compiled grammars (-fsgcache) are model bundles holding an FSG
+ * with silences, alternate words and the closure of null transitions
+ * already added, and its lextree.  They are named after hashes of
+ * the grammar (including the files a JSGF grammar imports) and of the
+ * model definition, and also record the size of the grammar, a hash
+ * of the pronunciations of the grammar's words and the penalties, so
+ * that an out of date one is rebuilt.
+ */
+#define FSG_CACHE_SUFFIX ".fsgc"
+
+typedef struct fsg_cache_key_s {
+    uint32 grammar;     /**< Hash of the grammar files or FSG. */
+    uint32 size;        /**< Bytes in the grammar files, or transitions
+                           in the FSG. */
+    uint32 model;       /**< Hash of the model definition. */
+    uint32 dict;        /**< Hash of the pronunciations of the words. */
+    int32 wip;
+    int32 pip;
+    float32 lw;
+} fsg_cache_key_t;
+
+/* FNV-1a hash. */
+#define FSG_HASH_INIT 2166136261UL
+
+static uint32
+fsg_hash(uint32 hash, void const *data, size_t len)
+{
+    unsigned char const *ptr = data;
+
+    while (len--) {
+        hash ^= *ptr++;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+static uint32
+fsg_hash_str(uint32 hash, char const *str)
+{
+    return fsg_hash(hash, str, strlen(str) + 1);
+}
+
+static uint32
+fsg_hash_int32(uint32 hash, int32 val)
+{
+    return fsg_hash(hash, &val, sizeof(val));
+}
+
+static uint32
+fsg_search_model_hash(bin_mdef_t *mdef)
+{
+    uint32 hash;
+    int32 i;
+
+    hash = fsg_hash_int32(FSG_HASH_INIT, mdef->n_ciphone);
+    hash = fsg_hash_int32(hash, mdef->n_phone);
+    hash = fsg_hash_int32(hash, mdef->n_sen);
+    hash = fsg_hash_int32(hash, mdef->n_tmat);
+    hash = fsg_hash_int32(hash, mdef->n_sseq);
+    for (i = 0; i < mdef->n_ciphone; ++i)
+        hash = fsg_hash_str(hash, mdef->ciname[i]);
+    hash = fsg_hash(hash, mdef->phone, mdef->n_phone * sizeof(*mdef->phone));
+    for (i = 0; i < mdef->n_sseq; ++i)
+        hash = fsg_hash(hash, mdef->sseq[i],
+                        (mdef->n_emit_state ? mdef->n_emit_state
+                         : mdef->sseq_len[i]) * sizeof(**mdef->sseq));
+    return hash;
+}
+
+static uint32
+fsg_hash_word(uint32 hash, dict_t *dict, int32 wid)
+{
+    hash = fsg_hash_str(hash, dict_wordstr(dict, wid));
+    return fsg_hash(hash, dict->word[wid].ciphone,
+                    dict_pronlen(dict, wid) * sizeof(*dict->word[wid].ciphone));
+}
+
+/*
+ * Hash the pronunciations of the words in an FSG, and of those which
+ * could be added to it as alternates or fillers.
+ */
+static uint32
+fsg_search_dict_hash(fsg_search_t *fsgs, fsg_model_t *fsg)
+{
+    dict_t *dict;
+    uint32 hash;
+    int32 i, wid;
+
+    dict = ps_search_dict(fsgs);
+    hash = FSG_HASH_INIT;
+    for (i = 0; i < fsg_model_n_word(fsg); ++i) {
+        wid = dict_wordid(dict, fsg_model_word_str(fsg, i));
+        if (wid == BAD_S3WID) {
+            hash = fsg_hash_int32(hash, BAD_S3WID);
+            continue;
+        }
+        hash = fsg_hash_word(hash, dict, wid);
+        while ((wid = dict_nextalt(dict, wid)) != BAD_S3WID)
+            hash = fsg_hash_word(hash, dict, wid);
+    }
+    for (wid = dict_filler_start(dict); wid < dict_filler_end(dict); ++wid)
+        hash = fsg_hash_word(hash, dict, wid);
+    return hash;
+}
+
+/* Hash the contents of an FSG. */
+static uint32
+fsg_search_fsg_hash(fsg_model_t *fsg, uint32 *out_size)
+{
+    uint32 hash;
+    int32 i;
+
+    *out_size = 0;
+    hash = fsg_hash_str(FSG_HASH_INIT, "FSG");
+    hash = fsg_hash_int32(hash, fsg_model_n_state(fsg));
+    hash = fsg_hash_int32(hash, fsg_model_start_state(fsg));
+    hash = fsg_hash_int32(hash, fsg_model_final_state(fsg));
+    hash = fsg_hash(hash, &fsg->lw, sizeof(fsg->lw));
+    for (i = 0; i < fsg_model_n_word(fsg); ++i) {
+        hash = fsg_hash_str(hash, fsg_model_word_str(fsg, i));
+        hash = fsg_hash_int32(hash, fsg_model_is_filler(fsg, i)
+                              + 2 * fsg_model_is_alt(fsg, i));
+    }
+    for (i = 0; i < fsg_model_n_state(fsg); ++i) {
+        fsg_arciter_t *itor;
+        for (itor = fsg_model_arcs(fsg, i); itor;
+             itor = fsg_arciter_next(itor)) {
+            hash = fsg_hash(hash, fsg_arciter_get(itor), sizeof(fsg_link_t));
+            ++*out_size;
+        }
+    }
+    return hash;
+}
+
+/* Hash the contents of a file, adding its size to *inout_size. */
+static int
+fsg_hash_file(uint32 *inout_hash, uint32 *inout_size, char const *path)
+{
+    char buf[4096];
+    FILE *fh;
+    size_t n;
+
+    if ((fh = fopen(path, "rb")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open grammar file %s", path);
+        return -1;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), fh)) > 0) {
+        *inout_hash = fsg_hash(*inout_hash, buf, n);
+        *inout_size += n;
+    }
+    fclose(fh);
+    return 0;
+}
+
+/*
+ * Hash a grammar file and the files it imports (so a JSGF grammar
+ * must have been parsed already), along with the options used to
+ * build the FSG from it.
+ */
+static int
+fsg_search_file_hash(fsg_search_t *fsgs, char const *path,
+                     uint32 *out_hash, uint32 *out_size)
+{
+    cmd_ln_t *config = ps_search_config(fsgs);
+    uint32 hash;
+    float32 prob;
+
+    *out_size = 0;
+    hash = fsg_hash_str(FSG_HASH_INIT,
+                        cmd_ln_str_r(config, "-fsg") ? "-fsg" : "-jsgf");
+    if (fsg_hash_file(&hash, out_size, path) < 0)
+        return -1;
+    if (fsgs->jsgf) {
+        jsgf_import_iter_t *itor;
+        uint32 imports = 0;
+
+        /* They come in no particular order, so add up their hashes. */
+        for (itor = jsgf_import_iter(fsgs->jsgf); itor;
+             itor = jsgf_import_iter_next(itor)) {
+            char const *imp = jsgf_import_iter_path(itor);
+            uint32 imphash = fsg_hash_str(FSG_HASH_INIT, imp);
+
+            if (fsg_hash_file(&imphash, out_size, imp) < 0) {
+                jsgf_import_iter_free(itor);
+                return -1;
+            }
+            imports += imphash;
+        }
+        hash = fsg_hash_int32(hash, imports);
+    }
+    if (cmd_ln_str_r(config, "-toprule"))
+        hash = fsg_hash_str(hash, cmd_ln_str_r(config, "-toprule"));
+    hash = fsg_hash_int32(hash, cmd_ln_boolean_r(config, "-fsgusefiller"));
+    hash = fsg_hash_int32(hash, cmd_ln_boolean_r(config, "-fsgusealtpron"));
+    prob = cmd_ln_float32_r(config, "-silprob");
+    hash = fsg_hash(hash, &prob, sizeof(prob));
+    prob = cmd_ln_float32_r(config, "-fillprob");
+    hash = fsg_hash(hash, &prob, sizeof(prob));
+    *out_hash = hash;
+    return 0;
+}
+
+static void
+fsg_search_cache_key(fsg_search_t *fsgs, fsg_model_t *fsg, uint32 grammar,
+                     uint32 size, fsg_cache_key_t *key)
+{
+    memset(key, 0, sizeof(*key));
+    key->grammar = grammar;
+    key->size = size;
+    key->model = fsgs->model_hash;
+    key->dict = fsg_search_dict_hash(fsgs, fsg);
+    key->wip = fsgs->wip;
+    key->pip = fsgs->pip;
+    key->lw = fsgs->lw;
+}
+
+static char *
+fsg_search_cache_file(fsg_search_t *fsgs, uint32 grammar)
+{
+    char name[32];
+
+    sprintf(name, "%08lx%08lx" FSG_CACHE_SUFFIX,
+            (unsigned long)grammar, (unsigned long)fsgs->model_hash);
+    return string_join(cmd_ln_str_r(ps_search_config(fsgs), "-fsgcache"),
+                       "/", name, NULL);
+}
+
+/*
+ * Open a compiled grammar, if there is one, and check that it is up
+ * to date for an FSG (the one it contains if fsg is NULL).
+ */
+static model_bundle_t *
+fsg_search_cache_open(fsg_search_t *fsgs, char const *file, uint32 grammar,
+                      uint32 grammar_size, fsg_model_t **inout_fsg)
+{
+    fsg_cache_key_t key;
+    fsg_cache_key_t const *saved;
+    model_bundle_t *b;
+    fsg_model_t *fsg;
+    FILE *fh;
+    size_t size;
+
+    /* Not having been compiled yet is not an error. */
+    if ((fh = fopen(file, "rb")) == NULL)
+        return NULL;
+    fclose(fh);
+    if ((b = model_bundle_read(file, ps_search_config(fsgs),
+                               ps_search_acmod(fsgs)->lmath)) == NULL)
+        return NULL;
+    if ((saved = model_bundle_get(b, "fsgkey", &size)) == NULL) {
+        E_ERROR("%s is not a compiled grammar\n", file);
+        model_bundle_free(b);
+        return NULL;
+    }
+    if (size < sizeof(*saved)) {
+        E_INFO("Compiled grammar %s is out of date\n", file);
+        model_bundle_free(b);
+        return NULL;
+    }
+
+    if ((fsg = *inout_fsg) == NULL
+        && (fsg = fsg_lextree_read_fsg(b, ps_search_acmod(fsgs)->lmath)) == NULL) {
+        model_bundle_free(b);
+        return NULL;
+    }
+    fsg_search_cache_key(fsgs, fsg, grammar, grammar_size, &key);
+    if (memcmp(saved, &key, sizeof(key)) != 0) {
+        E_INFO("Compiled grammar %s is out of date\n", file);
+        if (fsg != *inout_fsg)
+            fsg_model_free(fsg);
+        model_bundle_free(b);
+        return NULL;
+    }
+    *inout_fsg = fsg;
+    return b;
+}
+
+static int
+fsg_search_cache_write(fsg_search_t *fsgs, fsg_lextree_t *lextree,
+                       char const *file, uint32 grammar, uint32 grammar_size)
+{
+    model_bundle_writer_t *w;
+    fsg_cache_key_t key;
+    FILE *fh;
+
+    if ((w = model_bundle_writer_init(file, ps_search_config(fsgs),
+                                      ps_search_acmod(fsgs)->lmath)) == NULL)
+        return -1;
+    fsg_search_cache_key(fsgs, lextree->fsg, grammar, grammar_size, &key);
+    if ((fh = model_bundle_add(w, "fsgkey")) == NULL
+        || model_bundle_write_aligned(fh, &key, sizeof(key)) < 0
+        || fsg_lextree_write(lextree, w) < 0) {
+        model_bundle_writer_close(w, TRUE);
+        return -1;
+    }
+    return model_bundle_writer_close(w, FALSE);
+}
+
+/*
+ * Get the lextree for an FSG, from the compiled grammars if possible,
+ * otherwise building it (and adding it to the compiled grammars).
+ */
+static fsg_lextree_t *
+fsg_search_lextree(fsg_search_t *fsgs, fsg_model_t *fsg)
+{
+    fsg_lextree_t *lextree;
+    model_bundle_t *b;
+    uint32 grammar, size;
+    char *file;
+
+    if (cmd_ln_str_r(ps_search_config(fsgs), "-fsgcache") == NULL)
+        return fsg_lextree_init(fsg, ps_search_dict(fsgs),
+                                ps_search_dict2pid(fsgs),
+                                ps_search_acmod(fsgs)->mdef,
+                                fsgs->hmmctx, fsgs->wip, fsgs->pip);
+
+    grammar = fsg_search_fsg_hash(fsg, &size);
+    file = fsg_search_cache_file(fsgs, grammar);
+    lextree = NULL;
+    if ((b = fsg_search_cache_open(fsgs, file, grammar, size, &fsg)) != NULL) {
+        lextree = fsg_lextree_read(b, fsg, ps_search_dict(fsgs),
+                                   ps_search_dict2pid(fsgs),
+                                   ps_search_acmod(fsgs)->mdef,
+                                   fsgs->hmmctx, fsgs->wip, fsgs->pip);
+        model_bundle_free(b);
+    }
+    if (lextree == NULL) {
+        lextree = fsg_lextree_init(fsg, ps_search_dict(fsgs),
+                                   ps_search_dict2pid(fsgs),
+                                   ps_search_acmod(fsgs)->mdef,
+                                   fsgs->hmmctx, fsgs->wip, fsgs->pip);
+        fsg_search_cache_write(fsgs, lextree, file, grammar, size);
+    }
+    ckd_free(file);
+    return lextree;
+}
+
+/*
+ * Build an FSG from the grammar file given in the configuration (a
+ * JSGF one has been parsed already).
+ */
+static fsg_model_t *
+fsg_search_read_grammar(fsg_search_t *fsgs, char const *path)
+{
+    cmd_ln_t *config = ps_search_config(fsgs);
+    logmath_t *lmath = ps_search_acmod(fsgs)->lmath;
+    jsgf_rule_t *rule;
+    char const *toprule;
+
+    if (cmd_ln_str_r(config, "-fsg"))
+        return fsg_model_readfile(path, lmath, fsgs->lw);
+
+    rule = NULL;
+    /* Take the -toprule if specified. */
+    if ((toprule = cmd_ln_str_r(config, "-toprule"))) {
+        char *anglerule;
+        anglerule = string_join("<", toprule, ">", NULL);
+        rule = jsgf_get_rule(fsgs->jsgf, anglerule);
+        ckd_free(anglerule);
+        if (rule == NULL) {
+            E_ERROR("Start rule %s not found\n", toprule);
+            return NULL;
+        }
+    }
+    /* Otherwise, take the first public rule. */
+    else {
+        jsgf_rule_iter_t *itor;
+
+        for (itor = jsgf_rule_iter(fsgs->jsgf); itor;
+             itor = jsgf_rule_iter_next(itor)) {
+            rule = jsgf_rule_iter_rule(itor);
+            if (jsgf_rule_public(rule)) {
+                jsgf_rule_iter_free(itor);
+                break;
+            }
+        }
+        if (rule == NULL) {
+            E_ERROR("No public rules found in %s\n", path);
+            return NULL;
+        }
+    }
+    return jsgf_build_fsg(fsgs->jsgf, rule, lmath, fsgs->lw);
+}
+
+/*
+ * Load the grammar given in the configuration and make it current,
+ * from the compiled grammars if possible.
+ */
+static int
+fsg_search_load_grammar(fsg_search_t *fsgs, char const *path)
+{
+    fsg_lextree_t *lextree;
+    fsg_model_t *fsg;
+    model_bundle_t *b;
+    uint32 grammar, size;
+    char *file;
+
+    /* The files a JSGF grammar imports are only known once parsed. */
+    if (cmd_ln_str_r(ps_search_config(fsgs), "-fsg") == NULL
+        && (fsgs->jsgf = jsgf_parse_file(path, NULL)) == NULL)
+        return -1;
+
+    fsg = NULL;
+    lextree = NULL;
+    file = NULL;
+    if (cmd_ln_str_r(ps_search_config(fsgs), "-fsgcache")
+        && fsg_search_file_hash(fsgs, path, &grammar, &size) == 0) {
+        file = fsg_search_cache_file(fsgs, grammar);
+        if ((b = fsg_search_cache_open(fsgs, file, grammar, size, &fsg)) != NULL) {
+            lextree = fsg_lextree_read(b, fsg, ps_search_dict(fsgs),
+                                       ps_search_dict2pid(fsgs),
+                                       ps_search_acmod(fsgs)->mdef,
+                                       fsgs->hmmctx, fsgs->wip, fsgs->pip);
+            model_bundle_free(b);
+            if (lextree == NULL) {
+                fsg_model_free(fsg);
+                fsg = NULL;
+            }
+        }
+    }
+
+    if (lextree) {
+        /* Silences and alternate words are already there. */
+        if (!fsg_search_check_dict(fsgs, fsg)
+            || hash_table_enter(fsgs->fsgs, fsg_model_name(fsg), fsg) != fsg)
+            goto error_out;
+    }
+    else {
+        if ((fsg = fsg_search_read_grammar(fsgs, path)) == NULL)
+            goto error_out;
+        if (fsg_set_add(fsgs, fsg_model_name(fsg), fsg) != fsg)
+            goto error_out;
+    }
+    if (fsg_set_select(fsgs, fsg_model_name(fsg)) == NULL) {
+        fsg = NULL; /* Owned by the FSG set now. */
+        goto error_out;
+    }
+
+    if (lextree == NULL) {
+        lextree = fsg_lextree_init(fsg, ps_search_dict(fsgs),
+                                   ps_search_dict2pid(fsgs),
+                                   ps_search_acmod(fsgs)->mdef,
+                                   fsgs->hmmctx, fsgs->wip, fsgs->pip);
+        if (file)
+            fsg_search_cache_write(fsgs, lextree, file, grammar, size);
+    }
+    fsgs->lextree = lextree;
+    fsg_history_set_fsg(fsgs->history, fsg, ps_search_dict(fsgs));
+    ckd_free(file);
+    return 0;
+
+error_out:
+    fsg_lextree_free(lextree);
+    fsg_model_free(fsg);
+    ckd_free(file);
+    return -1;
+}
+
 ps_search_t *
 fsg_search_init(cmd_ln_t *config,
                 acmod_t *acmod,
@@ -146,71 +606,13 @@ fsg_search_init(cmd_ln_t *config,
            fsgs->beam_orig, fsgs->pbeam_orig, fsgs->wbeam_orig,
            fsgs->wip, fsgs->pip);
 
-    /* Load an FSG if one was specified in config */
-    if ((path = cmd_ln_str_r(config, "-fsg"))) {
-        fsg_model_t *fsg;
+    if (cmd_ln_str_r(config, "-fsgcache"))
+        fsgs->model_hash = fsg_search_model_hash(acmod->mdef);
 
-        if ((fsg = fsg_model_readfile(path, acmod->lmath, fsgs->lw)) == NULL)
-            goto error_out;
-        if (fsg_set_add(fsgs, fsg_model_name(fsg), fsg) != fsg) {
-            fsg_model_free(fsg);
-            goto error_out;
-        }
-        if (fsg_set_select(fsgs, fsg_model_name(fsg)) == NULL)
-            goto error_out;
-        if (fsg_search_reinit(ps_search_base(fsgs),
-                              ps_search_dict(fsgs),
-                              ps_search_dict2pid(fsgs)) < 0)
-            goto error_out;
-    }
-    /* Or load a JSGF grammar */
-    else if ((path = cmd_ln_str_r(config, "-jsgf"))) {
-        fsg_model_t *fsg;
-        jsgf_rule_t *rule;
-        char const *toprule;
-
-        if ((fsgs->jsgf = jsgf_parse_file(path, NULL)) == NULL)
-            goto error_out;
-
-        rule = NULL;
-        /* Take the -toprule if specified. */
-        if ((toprule = cmd_ln_str_r(config, "-toprule"))) {
-            char *anglerule;
-            anglerule = string_join("<", toprule, ">", NULL);
-            rule = jsgf_get_rule(fsgs->jsgf, anglerule);
-            ckd_free(anglerule);
-            if (rule == NULL) {
-                E_ERROR("Start rule %s not found\n", toprule);
-                goto error_out;
-            }
-        }
-        /* Otherwise, take the first public rule. */
-        else {
-            jsgf_rule_iter_t *itor;
-
-            for (itor = jsgf_rule_iter(fsgs->jsgf); itor;
-                 itor = jsgf_rule_iter_next(itor)) {
-                rule = jsgf_rule_iter_rule(itor);
-                if (jsgf_rule_public(rule)) {
-            	    jsgf_rule_iter_free(itor);
-                    break;
-                }
-            }
-            if (rule == NULL) {
-                E_ERROR("No public rules found in %s\n", path);
-                goto error_out;
-            }
-        }
-        fsg = jsgf_build_fsg(fsgs->jsgf, rule, acmod->lmath, fsgs->lw);
-        if (fsg_set_add(fsgs, fsg_model_name(fsg), fsg) != fsg) {
-            fsg_model_free(fsg);
-            goto error_out;
-        }
-        if (fsg_set_select(fsgs, fsg_model_name(fsg)) == NULL)
-            goto error_out;
-        if (fsg_search_reinit(ps_search_base(fsgs),
-                              ps_search_dict(fsgs),
-                              ps_search_dict2pid(fsgs)) < 0)
+    /* Load an FSG or a JSGF grammar if one was specified in config */
+    if ((path = cmd_ln_str_r(config, "-fsg"))
+        || (path = cmd_ln_str_r(config, "-jsgf"))) {
+        if (fsg_search_load_grammar(fsgs, path) < 0)
             goto error_out;
     }
 
@@ -254,8 +656,8 @@ fsg_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
     fsg_search_t *fsgs = (fsg_search_t *)search;
 
     /* Free the old lextree */
-    if (fsgs->lextree)
-        fsg_lextree_free(fsgs->lextree);
+    fsg_lextree_free(fsgs->lextree);
+    fsgs->lextree = NULL;
 
     /* Free old dict2pid, dict */
     ps_search_base_reinit(search, dict, d2p);
@@ -268,9 +670,7 @@ fsg_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
     search->n_words = dict_size(dict);
 
     /* Allocate new lextree for the given FSG */
-    fsgs->lextree = fsg_lextree_init(fsgs->fsg, dict, d2p,
-                                     ps_search_acmod(fsgs)->mdef,
-                                     fsgs->hmmctx, fsgs->wip, fsgs->pip);
+    fsgs->lextree = fsg_search_lextree(fsgs, fsgs->fsg);
 
     /* Inform the history module of the new fsg */
     fsg_history_set_fsg(fsgs->history, fsgs->fsg, dict);
@@ -970,6 +1370,7 @@ fsg_search_start(ps_search_t *search)
 
     fsg_history_reset(fsgs->history);
     fsg_history_utt_start(fsgs->history);
+    ps_search_trace_reset(search);
     fsgs->final = FALSE;
 
     /* Dummy context structure that allows all right contexts to use this entry */
@@ -1138,20 +1539,37 @@ fsg_search_bestpath(ps_search_t *search, int32 *out_score, int backward)
     return search->last_link;
 }
 
+/* Predecessor function for the cached traceback. */
+static int32
+fsg_search_hist_pred(ps_search_t *search, int32 bp, char const **out_word)
+{
+    fsg_search_t *fsgs = (fsg_search_t *)search;
+    dict_t *dict = ps_search_dict(search);
+    fsg_hist_entry_t *hist_entry = fsg_history_entry_get(fsgs->history, bp);
+    int32 wid = fsg_link_wid(fsg_hist_entry_fsglink(hist_entry));
+
+    if (wid < 0 || fsg_model_is_filler(fsgs->fsg, wid))
+        *out_word = NULL;
+    else
+        *out_word = dict_basestr(dict,
+                                 dict_wordid(dict,
+                                             fsg_model_word_str(fsgs->fsg, wid)));
+    /* Entry 0 is the dummy start entry. */
+    bp = fsg_hist_entry_pred(hist_entry);
+    return (bp > 0) ? bp : -1;
+}
+
 char const *
 fsg_search_hyp(ps_search_t *search, int32 *out_score, int32 *out_is_final)
 {
     fsg_search_t *fsgs = (fsg_search_t *)search;
-    dict_t *dict = ps_search_dict(search);
-    char *c;
-    size_t len;
-    int bp, bpidx;
+    int bpidx;
 
     /* Get last backpointer table index. */
     bpidx = fsg_search_find_exit(fsgs, fsgs->frame, fsgs->final, out_score, out_is_final);
     /* No hypothesis (yet). */
     if (bpidx <= 0)
-        return NULL;
+        return ps_search_trace(search, -1, fsg_search_hist_pred);
 
     /* If bestpath is enabled and the utterance is complete, then run it. */
     if (fsgs->bestpath && fsgs->final) {
@@ -1169,56 +1587,7 @@ fsg_search_hyp(ps_search_t *search, int32 *out_score, int32 *out_is_final)
         return ps_lattice_hyp(dag, link);
     }
 
-    bp = bpidx;
-    len = 0;
-    while (bp > 0) {
-        fsg_hist_entry_t *hist_entry = fsg_history_entry_get(fsgs->history, bp);
-        fsg_link_t *fl = fsg_hist_entry_fsglink(hist_entry);
-        char const *baseword;
-        int32 wid;
-
-        bp = fsg_hist_entry_pred(hist_entry);
-        wid = fsg_link_wid(fl);
-        if (wid < 0 || fsg_model_is_filler(fsgs->fsg, wid))
-            continue;
-        baseword = dict_basestr(dict,
-                                dict_wordid(dict,
-                                            fsg_model_word_str(fsgs->fsg, wid)));
-        len += strlen(baseword) + 1;
-    }
-    
-    ckd_free(search->hyp_str);
-    if (len == 0) {
-	search->hyp_str = NULL;
-	return search->hyp_str;
-    }
-    search->hyp_str = ckd_calloc(1, len);
-
-    bp = bpidx;
-    c = search->hyp_str + len - 1;
-    while (bp > 0) {
-        fsg_hist_entry_t *hist_entry = fsg_history_entry_get(fsgs->history, bp);
-        fsg_link_t *fl = fsg_hist_entry_fsglink(hist_entry);
-        char const *baseword;
-        int32 wid;
-
-        bp = fsg_hist_entry_pred(hist_entry);
-        wid = fsg_link_wid(fl);
-        if (wid < 0 || fsg_model_is_filler(fsgs->fsg, wid))
-            continue;
-        baseword = dict_basestr(dict,
-                                dict_wordid(dict,
-                                            fsg_model_word_str(fsgs->fsg, wid)));
-        len = strlen(baseword);
-        c -= len;
-        memcpy(c, baseword, len);
-        if (c > search->hyp_str) {
-            --c;
-            *c = ' ';
-        }
-    }
-
-    return search->hyp_str;
+    return ps_search_trace(search, bpidx, fsg_search_hist_pred);
 }
 
 static void
@@ -1280,7 +1649,8 @@ fsg_search_seg_iter(ps_search_t *search, int32 *out_score)
 {
     fsg_search_t *fsgs = (fsg_search_t *)search;
     fsg_seg_t *itor;
-    int bp, bpidx, cur;
+    ps_trace_t *trace;
+    int bpidx, cur;
 
     bpidx = fsg_search_find_exit(fsgs, fsgs->frame, fsgs->final, out_score, NULL);
     /* No hypothesis (yet). */
@@ -1301,32 +1671,21 @@ fsg_search_seg_iter(ps_search_t *search, int32 *out_score)
 
     /* Calling this an "iterator" is a bit of a misnomer since we have
      * to get the entire backtrace in order to produce it.  On the
-     * other hand, all we actually need is the bptbl IDs, and we can
-     * allocate a fixed-size array of them. */
+     * other hand, all we actually need is the history IDs, which the
+     * cached traceback already has. */
+    ps_search_trace(search, bpidx, fsg_search_hist_pred);
+    trace = &search->trace;
+    if (trace->n_id == 0)
+        return NULL;
     itor = ckd_calloc(1, sizeof(*itor));
     itor->base.vt = &fsg_segfuncs;
     itor->base.search = search;
     itor->base.lwf = 1.0;
-    itor->n_hist = 0;
-    bp = bpidx;
-    while (bp > 0) {
-        fsg_hist_entry_t *hist_entry = fsg_history_entry_get(fsgs->history, bp);
-        bp = fsg_hist_entry_pred(hist_entry);
-        ++itor->n_hist;
-    }
-    if (itor->n_hist == 0) {
-        ckd_free(itor);
-        return NULL;
-    }
+    itor->n_hist = trace->n_id;
     itor->hist = ckd_calloc(itor->n_hist, sizeof(*itor->hist));
-    cur = itor->n_hist - 1;
-    bp = bpidx;
-    while (bp > 0) {
-        fsg_hist_entry_t *hist_entry = fsg_history_entry_get(fsgs->history, bp);
-        itor->hist[cur] = hist_entry;
-        bp = fsg_hist_entry_pred(hist_entry);
-        --cur;
-    }
+    for (cur = 0; cur < itor->n_hist; ++cur)
+        itor->hist[cur] = fsg_history_entry_get(fsgs->history,
+                                                trace->id[cur]);
 
     /* Fill in relevant fields for first element. */
     fsg_seg_bp2itor((ps_seg_t *)itor, itor->hist[0]);
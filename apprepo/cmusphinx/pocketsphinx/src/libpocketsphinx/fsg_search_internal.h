@@ -104,6 +104,9 @@ typedef struct fsg_search_s {
   
     int32 n_hmm_eval;		/**< Total HMMs evaluated this utt */
     int32 n_sen_eval;		/**< Total senones evaluated this utt */
+
+    uint32 model_hash;          /**< Hash of the model definition, for
+                                   compiled grammars (-fsgcache). */
 } fsg_search_t;
 
 /* Access macros */
@@ -0,0 +1,991 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2012 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * @file gmm_kernel.c Vectorized Gaussian density evaluation.
+ */
+
+/* System headers. */
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+/* SphinxBase headers. */
+#include <sphinxbase/ckd_alloc.h>
+#include <sphinxbase/err.h>
+
+/* Local headers. */
+#include "gmm_kernel.h"
+
+/*
+ * SIMD kernels are only built with compilers that let us enable
+ * instruction sets per function, so that the library as a whole still
+ * runs on any CPU.  Fixed-point kernels keep the low 32 bits of the
+ * shifted 64-bit products, like FIXMUL(), so the radix must be at
+ * most 32.
+ */
+#if (defined(__i386__) || defined(__x86_64__)) \
+    && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) \
+    && (!defined(FIXED_POINT) || DEFAULT_RADIX <= 32)
+#define GMM_KERNEL_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+#if (defined(__ARM_NEON__) || defined(__ARM_NEON)) \
+    && (!defined(FIXED_POINT) || DEFAULT_RADIX <= 32)
+#define GMM_KERNEL_NEON 1
+#include <arm_neon.h>
+#endif
+
+/** Alignment of the mean, variance and determinant arrays. */
+#define GMM_BLOCK_ALIGN 32
+
+typedef void (*gmm_eval_f)(gmm_block_t const *block,
+                           mfcc_t const *obs, mfcc_t *out);
+typedef void (*gmm_eval_list_f)(gmm_block_t const *block, mfcc_t const *obs,
+                                uint16 const *ids, int32 n_ids, mfcc_t *out);
+
+typedef struct gmm_kernel_s {
+    char const *name;
+    gmm_eval_f eval;
+    gmm_eval_f eval_quant;    /**< NULL to use the scalar code. */
+    gmm_eval_list_f eval_list; /**< NULL to use the scalar code. */
+    int (*supported)(void);   /**< NULL if always supported. */
+} gmm_kernel_t;
+
+static void kernel_init(void);
+
+gmm_block_t *
+gmm_block_init(mfcc_t **mean, mfcc_t **var, mfcc_t *det,
+               int32 n_density, int32 featlen)
+{
+    gmm_block_t *block;
+    mfcc_t *base;
+    size_t size;
+    int32 d, i;
+
+    kernel_init();
+    block = ckd_calloc(1, sizeof(*block));
+    block->n_density = n_density;
+    block->n_alloc = (n_density + GMM_BLOCK_WIDTH - 1)
+        / GMM_BLOCK_WIDTH * GMM_BLOCK_WIDTH;
+    block->featlen = featlen;
+
+    /* Padding densities have zero mean and variance and a very low
+     * determinant, so they never get a usable score. */
+    size = (2 * featlen + 1) * block->n_alloc * sizeof(mfcc_t);
+    block->buf = ckd_calloc(1, size + GMM_BLOCK_ALIGN);
+    base = (mfcc_t *)(((size_t)block->buf + GMM_BLOCK_ALIGN - 1)
+                      & ~(size_t)(GMM_BLOCK_ALIGN - 1));
+    block->mean = base;
+    block->var = base + featlen * block->n_alloc;
+    block->det = base + 2 * featlen * block->n_alloc;
+
+    for (d = 0; d < n_density; ++d) {
+        for (i = 0; i < featlen; ++i) {
+            block->mean[i * block->n_alloc + d] = mean[d][i];
+            block->var[i * block->n_alloc + d] = var[d][i];
+        }
+        block->det[d] = det[d];
+    }
+    for (; d < block->n_alloc; ++d)
+        block->det[d] = (mfcc_t)INT_MIN;
+
+    return block;
+}
+
+gmm_block_t *
+gmm_block_map(mfcc_t *base, int32 n_density, int32 featlen)
+{
+    gmm_block_t *block;
+
+    kernel_init();
+    block = ckd_calloc(1, sizeof(*block));
+    block->n_density = n_density;
+    block->n_alloc = (n_density + GMM_BLOCK_WIDTH - 1)
+        / GMM_BLOCK_WIDTH * GMM_BLOCK_WIDTH;
+    block->featlen = featlen;
+    block->mean = base;
+    block->var = base + featlen * block->n_alloc;
+    block->det = base + 2 * featlen * block->n_alloc;
+    return block;
+}
+
+static size_t
+align_size(size_t size)
+{
+    return (size + GMM_BLOCK_ALIGN - 1) & ~(size_t)(GMM_BLOCK_ALIGN - 1);
+}
+
+#ifdef FIXED_POINT
+/*
+ * Fractional bits of the observation in units of the quantized means,
+ * and of the square root of the precision scaled to these units.  The
+ * latter must stay below 2048 so that it fits in 32 bits.
+ */
+#define QUANT_X_RADIX 8
+#define QUANT_P_RADIX 20
+#endif
+
+/*
+ * Quantize the values of one dimension for all densities around the
+ * middle of their range.  Returns the scale, which is at least
+ * min_scale unless all values are the same.
+ */
+static float32
+quantize_dim(float32 const *val, int32 n_density, int bits,
+             float32 min_scale, void *out, float32 *out_off)
+{
+    int32 qmax = (1 << (bits - 1)) - 1;
+    float32 min, max, scale;
+    int32 d;
+
+    min = max = val[0];
+    for (d = 1; d < n_density; ++d) {
+        if (val[d] < min)
+            min = val[d];
+        if (val[d] > max)
+            max = val[d];
+    }
+    *out_off = (max + min) / 2;
+    scale = (max - min) / 2 / qmax;
+    if (scale > 0 && scale < min_scale)
+        scale = min_scale;
+    for (d = 0; d < n_density; ++d) {
+        int32 q = scale > 0
+            ? (int32)floor((val[d] - *out_off) / scale + 0.5) : 0;
+        if (q > qmax)
+            q = qmax;
+        if (q < -qmax)
+            q = -qmax;
+        if (bits == 8)
+            ((int8 *)out)[d] = q;
+        else
+            ((int16 *)out)[d] = q;
+    }
+    return scale;
+}
+
+gmm_block_t *
+gmm_block_init_quant(mfcc_t **mean, mfcc_t **var, mfcc_t *det,
+                     int32 n_density, int32 featlen, int bits)
+{
+    gmm_block_t *block;
+    float32 *val;
+    char *base;
+    size_t qsize, fsize;
+    int32 d, i;
+
+    if (bits != 8 && bits != 16) {
+        E_ERROR("Gaussians can only be quantized to 8 or 16 bits, not %d\n",
+                bits);
+        return NULL;
+    }
+
+    kernel_init();
+    block = ckd_calloc(1, sizeof(*block));
+    block->n_density = n_density;
+    block->n_alloc = (n_density + GMM_BLOCK_WIDTH - 1)
+        / GMM_BLOCK_WIDTH * GMM_BLOCK_WIDTH;
+    block->featlen = featlen;
+    block->bits = bits;
+
+    /* Determinants, then the per-dimension constants, then the
+     * quantized means and precisions, each one aligned.  Padding
+     * densities are all zeros with a very low determinant. */
+    qsize = align_size(featlen * block->n_alloc * bits / 8);
+    fsize = align_size(featlen * sizeof(mfcc_t));
+    block->buf = ckd_calloc(1, align_size(block->n_alloc * sizeof(mfcc_t))
+                            + 4 * fsize + 2 * qsize + GMM_BLOCK_ALIGN);
+    base = (char *)(((size_t)block->buf + GMM_BLOCK_ALIGN - 1)
+                    & ~(size_t)(GMM_BLOCK_ALIGN - 1));
+    block->det = (mfcc_t *)base;
+    base += align_size(block->n_alloc * sizeof(mfcc_t));
+    block->qoff = (mfcc_t *)base;
+    block->qinv = (mfcc_t *)(base + fsize);
+    block->qa = (mfcc_t *)(base + 2 * fsize);
+    block->qb = (mfcc_t *)(base + 3 * fsize);
+    base += 4 * fsize;
+    block->qmean = base;
+    block->qvar = base + qsize;
+
+    /* Precisions vary a lot more than means, so they are quantized
+     * as square roots, which halves their dynamic range. */
+    val = ckd_calloc(n_density, sizeof(*val));
+    for (i = 0; i < featlen; ++i) {
+        size_t row = (size_t)i * block->n_alloc * bits / 8;
+        float32 mscale, vscale, moff, voff;
+
+        for (d = 0; d < n_density; ++d)
+            val[d] = mean[d][i];
+#ifdef FIXED_POINT
+        /* The means are integers, so there is no point in a finer
+         * scale than 1. */
+        mscale = quantize_dim(val, n_density, bits, 1,
+                              (char *)block->qmean + row, &moff);
+#else
+        mscale = quantize_dim(val, n_density, bits, 0,
+                              (char *)block->qmean + row, &moff);
+#endif
+        for (d = 0; d < n_density; ++d)
+            val[d] = sqrt(var[d][i]);
+        vscale = quantize_dim(val, n_density, bits, 0,
+                              (char *)block->qvar + row, &voff);
+        /* A dimension with a single mean value is not scaled. */
+        if (mscale == 0)
+            mscale = 1;
+#ifdef FIXED_POINT
+        {
+            /* The square root of the precision, in log units per
+             * quantized mean unit, is qa + qb * qvar, where qb has
+             * bits - 1 more fractional bits than qa.  The means are
+             * scaled by (1 << DEFAULT_RADIX). */
+            double a = voff * mscale / (1 << DEFAULT_RADIX);
+            double b = vscale * mscale / (1 << DEFAULT_RADIX);
+            int32 qmax = (1 << (bits - 1)) - 1;
+
+            if (fabs(a) + fabs(b) * (qmax + 1) >= 1 << (31 - QUANT_P_RADIX)) {
+                E_ERROR("Precisions in dimension %d are too large "
+                        "for quantization\n", i);
+                ckd_free(val);
+                gmm_block_free(block);
+                return NULL;
+            }
+            block->qoff[i] = (mfcc_t)floor(moff + 0.5);
+            block->qinv[i] = (mfcc_t)floor((1 << (16 + QUANT_X_RADIX))
+                                           / mscale + 0.5);
+            block->qa[i] = (mfcc_t)floor(a * (1 << QUANT_P_RADIX) + 0.5);
+            block->qb[i] = (mfcc_t)floor(b * (1 << QUANT_P_RADIX)
+                                         * (qmax + 1) + 0.5);
+        }
+#else
+        block->qoff[i] = moff;
+        block->qinv[i] = 1 / mscale;
+        block->qa[i] = voff * mscale;
+        block->qb[i] = vscale * mscale;
+#endif
+    }
+    ckd_free(val);
+    for (d = 0; d < n_density; ++d)
+        block->det[d] = det[d];
+    for (; d < block->n_alloc; ++d)
+        block->det[d] = (mfcc_t)INT_MIN;
+
+    return block;
+}
+
+void
+gmm_block_free(gmm_block_t *block)
+{
+    if (block == NULL)
+        return;
+    ckd_free(block->buf);
+    ckd_free(block);
+}
+
+#ifdef FIXED_POINT
+/*
+ * Same as GMMSUB() but without relying on signed overflow: once the
+ * score wraps around it sticks at INT_MIN.
+ */
+static void
+eval_scalar(gmm_block_t const *block, mfcc_t const *obs, mfcc_t *out)
+{
+    int32 i, d;
+
+    memcpy(out, block->det, block->n_alloc * sizeof(*out));
+    for (i = 0; i < block->featlen; ++i) {
+        mfcc_t const *m = block->mean + i * block->n_alloc;
+        mfcc_t const *v = block->var + i * block->n_alloc;
+        mfcc_t x = obs[i];
+
+        for (d = 0; d < block->n_alloc; ++d) {
+            mfcc_t diff, compl, dval;
+
+            diff = x - m[d];
+            compl = MFCCMUL(MFCCMUL(diff, diff), v[d]);
+            dval = (mfcc_t)((uint32)out[d] - (uint32)compl);
+            out[d] = (dval > out[d]) ? INT_MIN : dval;
+        }
+    }
+}
+
+/*
+ * Observation in units of the quantized means of dimension i, with
+ * QUANT_X_RADIX fractional bits.  Observations further than a few
+ * times the range of the means are clamped, their densities
+ * underflow anyway.
+ */
+static int32
+quant_obs(gmm_block_t const *block, mfcc_t const *obs, int32 i)
+{
+    int64 x = (((int64)obs[i] - block->qoff[i]) * block->qinv[i]) >> 16;
+
+    if (x > (1 << 28))
+        return 1 << 28;
+    if (x < -(1 << 28))
+        return -(1 << 28);
+    return (int32)x;
+}
+
+/*
+ * Subtract the term of one dimension from a score, like
+ * eval_scalar().  The difference with the mean is multiplied by the
+ * square root of the precision before squaring it, as in floating
+ * point, with 64-bit intermediate results.
+ */
+static inline mfcc_t
+quant_sub(mfcc_t score, int32 x, int32 m, int32 v, int32 a, int32 b,
+          int32 bits)
+{
+    int64 p, diff;
+    mfcc_t compl, dval;
+
+    p = a + (((int64)b * v) >> (bits - 1));
+    diff = ((x - m * (1 << QUANT_X_RADIX)) * p)
+        >> (QUANT_X_RADIX + QUANT_P_RADIX - DEFAULT_RADIX);
+    /* Squares over 2^31 log units underflow. */
+    if (diff > ((int64)46340 << DEFAULT_RADIX)
+        || diff < -((int64)46340 << DEFAULT_RADIX))
+        return INT_MIN;
+    compl = (mfcc_t)((diff * diff) >> (2 * DEFAULT_RADIX));
+    dval = (mfcc_t)((uint32)score - (uint32)compl);
+    return (dval > score) ? INT_MIN : dval;
+}
+
+static void
+eval_quant_scalar(gmm_block_t const *block, mfcc_t const *obs, mfcc_t *out)
+{
+    int32 i, d, n_alloc = block->n_alloc;
+
+    memcpy(out, block->det, n_alloc * sizeof(*out));
+    for (i = 0; i < block->featlen; ++i) {
+        int32 x = quant_obs(block, obs, i);
+        int32 a = block->qa[i], b = block->qb[i];
+
+        if (block->bits == 8) {
+            int8 const *m = (int8 const *)block->qmean + i * n_alloc;
+            int8 const *v = (int8 const *)block->qvar + i * n_alloc;
+
+            for (d = 0; d < n_alloc; ++d)
+                out[d] = quant_sub(out[d], x, m[d], v[d], a, b, 8);
+        }
+        else {
+            int16 const *m = (int16 const *)block->qmean + i * n_alloc;
+            int16 const *v = (int16 const *)block->qvar + i * n_alloc;
+
+            for (d = 0; d < n_alloc; ++d)
+                out[d] = quant_sub(out[d], x, m[d], v[d], a, b, 16);
+        }
+    }
+}
+#else /* !FIXED_POINT */
+static void
+eval_scalar(gmm_block_t const *block, mfcc_t const *obs, mfcc_t *out)
+{
+    int32 i, d;
+
+    memcpy(out, block->det, block->n_alloc * sizeof(*out));
+    for (i = 0; i < block->featlen; ++i) {
+        mfcc_t const *m = block->mean + i * block->n_alloc;
+        mfcc_t const *v = block->var + i * block->n_alloc;
+        mfcc_t x = obs[i];
+
+        for (d = 0; d < block->n_alloc; ++d) {
+            mfcc_t diff = x - m[d];
+            out[d] -= diff * diff * v[d];
+        }
+    }
+}
+
+/*
+ * The observation is moved to the scale of the quantized means once
+ * per dimension, and the difference is multiplied by the square root
+ * of the precision before squaring it.
+ */
+static void
+eval_quant_scalar(gmm_block_t const *block, mfcc_t const *obs, mfcc_t *out)
+{
+    int32 i, d, n_alloc = block->n_alloc;
+
+    memcpy(out, block->det, n_alloc * sizeof(*out));
+    for (i = 0; i < block->featlen; ++i) {
+        float32 x = (obs[i] - block->qoff[i]) * block->qinv[i];
+        float32 a = block->qa[i], b = block->qb[i];
+
+        if (block->bits == 8) {
+            int8 const *m = (int8 const *)block->qmean + i * n_alloc;
+            int8 const *v = (int8 const *)block->qvar + i * n_alloc;
+
+            for (d = 0; d < n_alloc; ++d) {
+                float32 diff = (x - m[d]) * (a + b * v[d]);
+                out[d] -= diff * diff;
+            }
+        }
+        else {
+            int16 const *m = (int16 const *)block->qmean + i * n_alloc;
+            int16 const *v = (int16 const *)block->qvar + i * n_alloc;
+
+            for (d = 0; d < n_alloc; ++d) {
+                float32 diff = (x - m[d]) * (a + b * v[d]);
+                out[d] -= diff * diff;
+            }
+        }
+    }
+}
+#endif /* !FIXED_POINT */
+
+/*
+ * Shortlists are short and their densities are scattered through the
+ * block, so this goes one density at a time over the strided layout.
+ */
+static void
+eval_list_scalar(gmm_block_t const *block, mfcc_t const *obs,
+                 uint16 const *ids, int32 n_ids, mfcc_t *out)
+{
+    int32 i, k, n_alloc = block->n_alloc;
+
+    for (k = 0; k < n_ids; ++k) {
+        int32 d = ids[k];
+        mfcc_t dval = block->det[d];
+
+        if (block->bits) {
+            for (i = 0; i < block->featlen; ++i) {
+                int32 m, v;
+
+                if (block->bits == 8) {
+                    m = ((int8 const *)block->qmean)[i * n_alloc + d];
+                    v = ((int8 const *)block->qvar)[i * n_alloc + d];
+                }
+                else {
+                    m = ((int16 const *)block->qmean)[i * n_alloc + d];
+                    v = ((int16 const *)block->qvar)[i * n_alloc + d];
+                }
+#ifdef FIXED_POINT
+                dval = quant_sub(dval, quant_obs(block, obs, i), m, v,
+                                 block->qa[i], block->qb[i], block->bits);
+#else
+                {
+                    float32 x = (obs[i] - block->qoff[i]) * block->qinv[i];
+                    float32 diff = (x - m) * (block->qa[i] + block->qb[i] * v);
+                    dval -= diff * diff;
+                }
+#endif
+            }
+            out[k] = dval;
+            continue;
+        }
+        for (i = 0; i < block->featlen; ++i) {
+            mfcc_t diff = obs[i] - block->mean[i * n_alloc + d];
+#ifdef FIXED_POINT
+            mfcc_t compl = MFCCMUL(MFCCMUL(diff, diff),
+                                   block->var[i * n_alloc + d]);
+            mfcc_t pdval = dval;
+
+            dval = (mfcc_t)((uint32)dval - (uint32)compl);
+            if (dval > pdval) {
+                dval = INT_MIN;
+                break;
+            }
+#else
+            dval -= diff * diff * block->var[i * n_alloc + d];
+#endif
+        }
+        out[k] = dval;
+    }
+}
+
+#ifdef GMM_KERNEL_X86
+static int
+cpu_has_sse2(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return FALSE;
+    return (edx & (1 << 26)) != 0;
+}
+
+static int
+cpu_has_avx2(void)
+{
+    unsigned int eax, ebx, ecx, edx, xcr0;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return FALSE;
+    /* The OS has to save the YMM registers (OSXSAVE + AVX, then XCR0). */
+    if ((ecx & (1 << 27)) == 0 || (ecx & (1 << 28)) == 0)
+        return FALSE;
+    __asm__ ("xgetbv" : "=a" (xcr0), "=d" (edx) : "c" (0));
+    if ((xcr0 & 6) != 6)
+        return FALSE;
+    if (__get_cpuid_max(0, NULL) < 7)
+        return FALSE;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & (1 << 5)) != 0;
+}
+
+#ifdef FIXED_POINT
+/*
+ * MFCCMUL() of 4 pairs of values.  SSE2 only multiplies the even
+ * lanes, unsigned, into 64 bits, so the high halves of the products
+ * are corrected for the signs of the operands.  The low 32 bits of
+ * the shifted products are the same as with an arithmetic shift.
+ */
+__attribute__((target("sse2")))
+static inline __m128i
+fixmul_sse2(__m128i a, __m128i b)
+{
+    __m128i const lo = _mm_set_epi32(0, -1, 0, -1);
+    __m128i corr, even, odd;
+
+    corr = _mm_add_epi32(_mm_and_si128(_mm_srai_epi32(a, 31), b),
+                         _mm_and_si128(_mm_srai_epi32(b, 31), a));
+    even = _mm_sub_epi64(_mm_mul_epu32(a, b), _mm_slli_epi64(corr, 32));
+    odd = _mm_sub_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32),
+                                      _mm_srli_epi64(b, 32)),
+                        _mm_andnot_si128(lo, corr));
+    even = _mm_srli_epi64(even, DEFAULT_RADIX);
+    odd = _mm_srli_epi64(odd, DEFAULT_RADIX);
+    return _mm_or_si128(_mm_and_si128(even, lo), _mm_slli_epi64(odd, 32));
+}
+
+/* 4 densities at a time, underflowing to INT_MIN like eval_scalar(). */
+__attribute__((target("sse2")))
+static void
+eval_sse2(gmm_block_t const *block, mfcc_t const *obs, mfcc_t *out)
+{
+    int32 i, d, n_alloc = block->n_alloc;
+    __m128i const floor = _mm_set1_epi32(INT_MIN);
+
+    for (d = 0; d < n_alloc; d += 4) {
+        mfcc_t const *m = block->mean + d;
+        mfcc_t const *v = block->var + d;
+        __m128i acc = _mm_load_si128((__m128i const *)(block->det + d));
+
+        for (i = 0; i < block->featlen; ++i) {
+            __m128i diff = _mm_sub_epi32(_mm_set1_epi32(obs[i]),
+                                         _mm_load_si128((__m128i const *)m));
+            __m128i compl = fixmul_sse2(fixmul_sse2(diff, diff),
+                                        _mm_load_si128((__m128i const *)v));
+            __m128i dval = _mm_sub_epi32(acc, compl);
+            __m128i under = _mm_cmpgt_epi32(dval, acc);
+
+            acc = _mm_or_si128(_mm_andnot_si128(under, dval),
+                               _mm_and_si128(under, floor));
+            m += n_alloc;
+            v += n_alloc;
+        }
+        _mm_storeu_si128((__m128i *)(out + d), acc);
+    }
+}
+
+/* MFCCMUL() of 8 pairs of values, with the signed multiply of AVX2. */
+__attribute__((target("avx2")))
+static inline __m256i
+fixmul_avx2(__m256i a, __m256i b)
+{
+    __m256i even, odd;
+
+    even = _mm256_srli_epi64(_mm256_mul_epi32(a, b), DEFAULT_RADIX);
+    odd = _mm256_srli_epi64(_mm256_mul_epi32(_mm256_srli_epi64(a, 32),
+                                             _mm256_srli_epi64(b, 32)),
+                            DEFAULT_RADIX);
+    return _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xaa);
+}
+
+/* 8 densities at a time, like eval_sse2(). */
+__attribute__((target("avx2")))
+static void
+eval_avx2(gmm_block_t const *block, mfcc_t const *obs, mfcc_t *out)
+{
+    int32 i, d, n_alloc = block->n_alloc;
+    __m256i const floor = _mm256_set1_epi32(INT_MIN);
+
+    for (d = 0; d < n_alloc; d += 8) {
+        mfcc_t const *m = block->mean + d;
+        mfcc_t const *v = block->var + d;
+        __m256i acc = _mm256_load_si256((__m256i const *)(block->det + d));
+
+        for (i = 0; i < block->featlen; ++i) {
+            __m256i diff = _mm256_sub_epi32(_mm256_set1_epi32(obs[i]),
+                                            _mm256_load_si256((__m256i const *)m));
+            __m256i compl = fixmul_avx2(fixmul_avx2(diff, diff),
+                                        _mm256_load_si256((__m256i const *)v));
+            __m256i dval = _mm256_sub_epi32(acc, compl);
+
+            acc = _mm256_blendv_epi8(dval, floor, _mm256_cmpgt_epi32(dval, acc));
+            m += n_alloc;
+            v += n_alloc;
+        }
+        _mm256_storeu_si256((__m256i *)(out + d), acc);
+    }
+}
+#else /* !FIXED_POINT */
+/* 8 densities at a time, in two registers. */
+__attribute__((target("sse2")))
+static void
+eval_sse2(gmm_block_t const *block, mfcc_t const *obs, mfcc_t *out)
+{
+    int32 i, d, n_alloc = block->n_alloc;
+
+    for (d = 0; d < n_alloc; d += 8) {
+        mfcc_t const *m = block->mean + d;
+        mfcc_t const *v = block->var + d;
+        __m128 acc0 = _mm_load_ps(block->det + d);
+        __m128 acc1 = _mm_load_ps(block->det + d + 4);
+
+        for (i = 0; i < block->featlen; ++i) {
+            __m128 x = _mm_set1_ps(obs[i]);
+            __m128 diff0 = _mm_sub_ps(x, _mm_load_ps(m));
+            __m128 diff1 = _mm_sub_ps(x, _mm_load_ps(m + 4));
+            acc0 = _mm_sub_ps(acc0, _mm_mul_ps(_mm_mul_ps(diff0, diff0),
+                                               _mm_load_ps(v)));
+            acc1 = _mm_sub_ps(acc1, _mm_mul_ps(_mm_mul_ps(diff1, diff1),
+                                               _mm_load_ps(v + 4)));
+            m += n_alloc;
+            v += n_alloc;
+        }
+        _mm_storeu_ps(out + d, acc0);
+        _mm_storeu_ps(out + d + 4, acc1);
+    }
+}
+
+/*
+ * 16 densities at a time, in two registers, then the last 8 if any.
+ * No FMA, which would round differently from the scalar code.
+ */
+__attribute__((target("avx2")))
+static void
+eval_avx2(gmm_block_t const *block, mfcc_t const *obs, mfcc_t *out)
+{
+    int32 i, d, n_alloc = block->n_alloc;
+
+    for (d = 0; d + 16 <= n_alloc; d += 16) {
+        mfcc_t const *m = block->mean + d;
+        mfcc_t const *v = block->var + d;
+        __m256 acc0 = _mm256_load_ps(block->det + d);
+        __m256 acc1 = _mm256_load_ps(block->det + d + 8);
+
+        for (i = 0; i < block->featlen; ++i) {
+            __m256 x = _mm256_set1_ps(obs[i]);
+            __m256 diff0 = _mm256_sub_ps(x, _mm256_load_ps(m));
+            __m256 diff1 = _mm256_sub_ps(x, _mm256_load_ps(m + 8));
+            acc0 = _mm256_sub_ps(acc0,
+                                 _mm256_mul_ps(_mm256_mul_ps(diff0, diff0),
+                                               _mm256_load_ps(v)));
+            acc1 = _mm256_sub_ps(acc1,
+                                 _mm256_mul_ps(_mm256_mul_ps(diff1, diff1),
+                                               _mm256_load_ps(v + 8)));
+            m += n_alloc;
+            v += n_alloc;
+        }
+        _mm256_storeu_ps(out + d, acc0);
+        _mm256_storeu_ps(out + d + 8, acc1);
+    }
+    if (d < n_alloc) {
+        mfcc_t const *m = block->mean + d;
+        mfcc_t const *v = block->var + d;
+        __m256 acc = _mm256_load_ps(block->det + d);
+
+        for (i = 0; i < block->featlen; ++i) {
+            __m256 diff = _mm256_sub_ps(_mm256_set1_ps(obs[i]),
+                                        _mm256_load_ps(m));
+            acc = _mm256_sub_ps(acc, _mm256_mul_ps(_mm256_mul_ps(diff, diff),
+                                                   _mm256_load_ps(v)));
+            m += n_alloc;
+            v += n_alloc;
+        }
+        _mm256_storeu_ps(out + d, acc);
+    }
+}
+
+/* Load 8 quantized values as floats. */
+__attribute__((target("avx2")))
+static inline __m256
+load_quant_avx2(void const *q, int32 bits, int32 idx)
+{
+    __m256i qi;
+
+    if (bits == 8)
+        qi = _mm256_cvtepi8_epi32(_mm_loadl_epi64((__m128i const *)
+                                                  ((int8 const *)q + idx)));
+    else
+        qi = _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i const *)
+                                                   ((int16 const *)q + idx)));
+    return _mm256_cvtepi32_ps(qi);
+}
+
+/*
+ * Same loop order as eval_quant_scalar(), 8 densities at a time.  The
+ * partial sums stay in out, which is small enough to stay in cache.
+ */
+__attribute__((target("avx2")))
+static void
+eval_quant_avx2(gmm_block_t const *block, mfcc_t const *obs, mfcc_t *out)
+{
+    int32 i, d, n_alloc = block->n_alloc;
+
+    memcpy(out, block->det, n_alloc * sizeof(*out));
+    for (i = 0; i < block->featlen; ++i) {
+        __m256 x = _mm256_set1_ps((obs[i] - block->qoff[i]) * block->qinv[i]);
+        __m256 a = _mm256_set1_ps(block->qa[i]);
+        __m256 b = _mm256_set1_ps(block->qb[i]);
+
+        for (d = 0; d < n_alloc; d += 8) {
+            int32 idx = i * n_alloc + d;
+            __m256 m = load_quant_avx2(block->qmean, block->bits, idx);
+            __m256 v = load_quant_avx2(block->qvar, block->bits, idx);
+            __m256 diff = _mm256_mul_ps(_mm256_sub_ps(x, m),
+                                        _mm256_add_ps(a, _mm256_mul_ps(b, v)));
+
+            _mm256_storeu_ps(out + d,
+                             _mm256_sub_ps(_mm256_loadu_ps(out + d),
+                                           _mm256_mul_ps(diff, diff)));
+        }
+    }
+}
+
+/*
+ * Gather the parameters of 8 listed densities at a time.  The last
+ * group is padded with the first density of the list.
+ */
+__attribute__((target("avx2")))
+static void
+eval_list_avx2(gmm_block_t const *block, mfcc_t const *obs,
+               uint16 const *ids, int32 n_ids, mfcc_t *out)
+{
+    int32 i, k, n_alloc = block->n_alloc;
+
+    for (k = 0; k < n_ids; k += 8) {
+        int32 idx[8], j;
+        __m256i vidx;
+        __m256 acc;
+        float32 res[8];
+
+        for (j = 0; j < 8; ++j)
+            idx[j] = ids[k + j < n_ids ? k + j : 0];
+        vidx = _mm256_loadu_si256((__m256i const *)idx);
+        acc = _mm256_i32gather_ps(block->det, vidx, 4);
+        for (i = 0; i < block->featlen; ++i) {
+            __m256 m = _mm256_i32gather_ps(block->mean + i * n_alloc, vidx, 4);
+            __m256 v = _mm256_i32gather_ps(block->var + i * n_alloc, vidx, 4);
+            __m256 diff = _mm256_sub_ps(_mm256_set1_ps(obs[i]), m);
+            acc = _mm256_sub_ps(acc, _mm256_mul_ps(_mm256_mul_ps(diff, diff), v));
+        }
+        if (k + 8 <= n_ids)
+            _mm256_storeu_ps(out + k, acc);
+        else {
+            _mm256_storeu_ps(res, acc);
+            memcpy(out + k, res, (n_ids - k) * sizeof(*out));
+        }
+    }
+}
+#endif /* !FIXED_POINT */
+#endif /* GMM_KERNEL_X86 */
+
+#ifdef GMM_KERNEL_NEON
+#ifdef FIXED_POINT
+/* MFCCMUL() of 4 pairs of values, keeping the low 32 bits like FIXMUL(). */
+static inline int32x4_t
+fixmul_neon(int32x4_t a, int32x4_t b)
+{
+    int64x2_t lo = vmull_s32(vget_low_s32(a), vget_low_s32(b));
+    int64x2_t hi = vmull_s32(vget_high_s32(a), vget_high_s32(b));
+
+    return vcombine_s32(vshrn_n_s64(lo, DEFAULT_RADIX),
+                        vshrn_n_s64(hi, DEFAULT_RADIX));
+}
+
+/* 4 densities at a time, underflowing to INT_MIN like eval_scalar(). */
+static void
+eval_neon(gmm_block_t const *block, mfcc_t const *obs, mfcc_t *out)
+{
+    int32 i, d, n_alloc = block->n_alloc;
+    int32x4_t const floor = vdupq_n_s32(INT_MIN);
+
+    for (d = 0; d < n_alloc; d += 4) {
+        mfcc_t const *m = block->mean + d;
+        mfcc_t const *v = block->var + d;
+        int32x4_t acc = vld1q_s32(block->det + d);
+
+        for (i = 0; i < block->featlen; ++i) {
+            int32x4_t diff = vsubq_s32(vdupq_n_s32(obs[i]), vld1q_s32(m));
+            int32x4_t compl = fixmul_neon(fixmul_neon(diff, diff),
+                                          vld1q_s32(v));
+            int32x4_t dval = vsubq_s32(acc, compl);
+
+            acc = vbslq_s32(vcgtq_s32(dval, acc), floor, dval);
+            m += n_alloc;
+            v += n_alloc;
+        }
+        vst1q_s32(out + d, acc);
+    }
+}
+#else /* !FIXED_POINT */
+/* 8 densities at a time, in two registers. */
+static void
+eval_neon(gmm_block_t const *block, mfcc_t const *obs, mfcc_t *out)
+{
+    int32 i, d, n_alloc = block->n_alloc;
+
+    for (d = 0; d < n_alloc; d += 8) {
+        mfcc_t const *m = block->mean + d;
+        mfcc_t const *v = block->var + d;
+        float32x4_t acc0 = vld1q_f32(block->det + d);
+        float32x4_t acc1 = vld1q_f32(block->det + d + 4);
+
+        for (i = 0; i < block->featlen; ++i) {
+            float32x4_t x = vdupq_n_f32(obs[i]);
+            float32x4_t diff0 = vsubq_f32(x, vld1q_f32(m));
+            float32x4_t diff1 = vsubq_f32(x, vld1q_f32(m + 4));
+            acc0 = vsubq_f32(acc0, vmulq_f32(vmulq_f32(diff0, diff0),
+                                             vld1q_f32(v)));
+            acc1 = vsubq_f32(acc1, vmulq_f32(vmulq_f32(diff1, diff1),
+                                             vld1q_f32(v + 4)));
+            m += n_alloc;
+            v += n_alloc;
+        }
+        vst1q_f32(out + d, acc0);
+        vst1q_f32(out + d + 4, acc1);
+    }
+}
+#endif /* !FIXED_POINT */
+#endif /* GMM_KERNEL_NEON */
+
+/* Fastest first. */
+static const gmm_kernel_t kernels[] = {
+#ifdef GMM_KERNEL_X86
+#ifdef FIXED_POINT
+    { "avx2", eval_avx2, NULL, NULL, cpu_has_avx2 },
+#else
+    { "avx2", eval_avx2, eval_quant_avx2, eval_list_avx2, cpu_has_avx2 },
+#endif
+    { "sse2", eval_sse2, NULL, NULL, cpu_has_sse2 },
+#endif
+#ifdef GMM_KERNEL_NEON
+    { "neon", eval_neon, NULL, NULL, NULL },
+#endif
+    { "scalar", eval_scalar, NULL, NULL, NULL }
+};
+#define N_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+/*
+ * The kernel is selected when the first block is built, while the
+ * model is being loaded, so that the threads evaluating the blocks
+ * afterwards only ever read it.
+ */
+static gmm_kernel_t const *kernel;
+
+static int
+kernel_supported(gmm_kernel_t const *k)
+{
+    return k->supported == NULL || k->supported();
+}
+
+static void
+kernel_init(void)
+{
+    if (kernel == NULL)
+        gmm_kernel_select(NULL);
+}
+
+int
+gmm_kernel_select(char const *name)
+{
+    size_t i;
+
+    for (i = 0; i < N_KERNELS; ++i) {
+        if (name && strcmp(name, kernels[i].name) != 0)
+            continue;
+        if (!kernel_supported(&kernels[i])) {
+            if (name) {
+                E_ERROR("Gaussian kernel %s not supported by this CPU\n", name);
+                return -1;
+            }
+            continue;
+        }
+        kernel = &kernels[i];
+        E_INFO("Using %s Gaussian kernel\n", kernel->name);
+        return 0;
+    }
+    E_ERROR("Unknown Gaussian kernel %s\n", name);
+    return -1;
+}
+
+char const *
+gmm_kernel_name(void)
+{
+    kernel_init();
+    return kernel->name;
+}
+
+char const *
+gmm_kernel_supported(int n)
+{
+    size_t i;
+
+    for (i = 0; i < N_KERNELS; ++i) {
+        if (!kernel_supported(&kernels[i]))
+            continue;
+        if (n-- == 0)
+            return kernels[i].name;
+    }
+    return NULL;
+}
+
+void
+gmm_block_eval(gmm_block_t const *block, mfcc_t const *obs, mfcc_t *out)
+{
+    if (block->bits) {
+        if (kernel->eval_quant)
+            kernel->eval_quant(block, obs, out);
+        else
+            eval_quant_scalar(block, obs, out);
+        return;
+    }
+    kernel->eval(block, obs, out);
+}
+
+void
+gmm_block_eval_list(gmm_block_t const *block, mfcc_t const *obs,
+                    uint16 const *ids, int32 n_ids, mfcc_t *out)
+{
+    if (block->bits == 0 && kernel->eval_list)
+        kernel->eval_list(block, obs, ids, n_ids, out);
+    else
+        eval_list_scalar(block, obs, ids, n_ids, out);
+}
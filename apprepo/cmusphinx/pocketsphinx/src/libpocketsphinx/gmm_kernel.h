@@ -0,0 +1,194 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2012 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * @file gmm_kernel.h Vectorized Gaussian density evaluation.
+ *
+ * The Gaussian back-ends (ms_gauden, ptm_mgau, s2_semi_mgau) spend
+ * most of their time computing the log density of the same
+ * observation against every codeword of a codebook.  This module
+ * keeps a copy of each codebook in a dimension-major ("structure of
+ * arrays") layout, so that several densities can be computed at once
+ * with SIMD instructions, and selects the best implementation for
+ * the running CPU when the first block is built.
+ *
+ * All the kernels accumulate the per-dimension terms in the same
+ * order as the scalar code, so that in floating point their results
+ * are the same as those of the original loops (except on compilers
+ * that contract the multiply and subtract into a fused instruction).
+ * In fixed-point builds the SIMD kernels do the same 64-bit products
+ * and shifts as MFCCMUL(), and give exactly the same results.
+ *
+ * A block can also hold its means and precisions quantized to 8 or
+ * 16 bits, with a scale and an offset for each dimension, which
+ * divides the memory traffic of the density computation by four or
+ * two.  In floating point builds the quantized values are widened to
+ * floating point in registers.  In fixed-point builds the scale and
+ * offset are fixed-point numbers too, and the densities are computed
+ * with integer arithmetic only.
+ */
+
+#ifndef __GMM_KERNEL_H__
+#define __GMM_KERNEL_H__
+
+/* SphinxBase headers. */
+#include <sphinxbase/prim_type.h>
+#include <sphinxbase/fe.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+} /* Fool Emacs into not indenting things. */
+#endif
+
+/**
+ * Number of densities computed together.  The number of densities in
+ * a block is rounded up to a multiple of this.
+ */
+#define GMM_BLOCK_WIDTH 8
+
+/**
+ * A codebook (for one feature stream) in dimension-major layout.
+ */
+typedef struct gmm_block_s {
+    int32 n_density;  /**< Number of densities. */
+    int32 n_alloc;    /**< n_density rounded up to GMM_BLOCK_WIDTH. */
+    int32 featlen;    /**< Dimensionality of the feature stream. */
+    mfcc_t *mean;     /**< mean[i * n_alloc + d] = dimension i of density d */
+    mfcc_t *var;      /**< Precomputed 1/(2*var), same layout as mean. */
+    mfcc_t *det;      /**< Precomputed log determinants, n_alloc entries.
+                         Padding entries hold a very low score. */
+    int32 bits;       /**< 8 or 16 if quantized (mean and var are then
+                         NULL), 0 otherwise. */
+    void *qmean;      /**< Quantized means, int8 or int16, same layout
+                         as mean.  Mean is qoff[i] + qmean / qinv[i]. */
+    void *qvar;       /**< Quantized precisions, same layout.  The
+                         square root of the precision divided by
+                         qinv[i] is qa[i] + qb[i] * qvar. */
+    mfcc_t *qoff;     /**< Per-dimension mean offset. */
+    mfcc_t *qinv;     /**< Per-dimension inverse of the mean scale
+                         (fixed-point: with 16 fractional bits, and
+                         giving 8 fractional bits). */
+    mfcc_t *qa;       /**< Per-dimension precision offset (fixed-point:
+                         with 20 fractional bits). */
+    mfcc_t *qb;       /**< Per-dimension precision scale (fixed-point:
+                         with 19 + bits fractional bits). */
+    void *buf;        /**< Unaligned allocation for all of the above. */
+} gmm_block_t;
+
+/**
+ * Build a block from an array of mean and variance vectors, as stored
+ * in gauden_t, with the variances and determinants already
+ * precomputed.
+ */
+gmm_block_t *gmm_block_init(mfcc_t **mean, mfcc_t **var, mfcc_t *det,
+                            int32 n_density, int32 featlen);
+
+/**
+ * Use parameters already laid out as in a block built by
+ * gmm_block_init(), for instance in a model bundle: (2 * featlen + 1)
+ * * n_alloc values, aligned to GMM_BLOCK_ALIGN.  They are not copied
+ * or released.
+ */
+gmm_block_t *gmm_block_map(mfcc_t *base, int32 n_density, int32 featlen);
+
+/**
+ * Build a quantized block, like gmm_block_init().
+ *
+ * @param bits 8 or 16.
+ * @return NULL if bits is not supported, or in fixed-point builds if
+ * the precisions are too large for the fixed-point format.
+ */
+gmm_block_t *gmm_block_init_quant(mfcc_t **mean, mfcc_t **var, mfcc_t *det,
+                                  int32 n_density, int32 featlen, int bits);
+
+/**
+ * Release a block.
+ */
+void gmm_block_free(gmm_block_t *block);
+
+/**
+ * Compute the (unnormalized) log density of an observation for all
+ * densities in a block.
+ *
+ * In fixed-point builds, densities whose score underflows are set to
+ * INT_MIN, like with GMMSUB() in tied_mgau_common.h.
+ *
+ * @param out Output, must have room for block->n_alloc values.
+ */
+void gmm_block_eval(gmm_block_t const *block, mfcc_t const *obs, mfcc_t *out);
+
+/**
+ * Compute the log density of an observation for some of the
+ * densities in a block, as gmm_block_eval() does for all of them.
+ *
+ * @param ids Indices of the densities to compute.
+ * @param out Output, out[k] is the density of ids[k].
+ */
+void gmm_block_eval_list(gmm_block_t const *block, mfcc_t const *obs,
+                         uint16 const *ids, int32 n_ids, mfcc_t *out);
+
+/**
+ * Select a kernel by name, or the fastest one supported by this CPU
+ * if name is NULL.  Mostly useful for testing and benchmarking, and
+ * must not be called while other threads evaluate blocks.
+ *
+ * @return 0 for success, -1 if the kernel is unknown or not supported
+ * by this CPU or build.
+ */
+int gmm_kernel_select(char const *name);
+
+/**
+ * Get the name of the kernel in use.
+ */
+char const *gmm_kernel_name(void);
+
+/**
+ * Get the name of the n-th kernel supported by this CPU and build.
+ *
+ * @return the name, or NULL if n is out of range.
+ */
+char const *gmm_kernel_supported(int n);
+
+#if 0
+{ /* Stop indent from complaining */
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GMM_KERNEL_H__ */
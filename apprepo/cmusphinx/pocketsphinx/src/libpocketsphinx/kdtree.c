@@ -0,0 +1,471 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2013 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * @file kdtree.c kd-trees for Gaussian selection.
+ *
+ * File format: a bio header (version, chksum0), the number of trees,
+ * then for each tree n_density, n_comp and n_level, followed by its
+ * 2^n_level-1 nodes in order.  A node is split_comp (int32),
+ * split_plane (float32), n_bbi (int32) and n_bbi density indices
+ * (uint16).  All trees of a model are in the same file, codebook
+ * major, feature stream minor.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* SphinxBase headers. */
+#include <sphinxbase/ckd_alloc.h>
+#include <sphinxbase/err.h>
+#include <sphinxbase/bio.h>
+
+/* Local headers. */
+#include "kdtree.h"
+
+#define KD_TREE_VERSION "1.0"
+
+typedef struct kd_cand_s {
+    int32 id;
+    float64 dist;
+} kd_cand_t;
+
+typedef struct kd_build_s {
+    kd_tree_t *tree;
+    mfcc_t **mean;
+    mfcc_t **var;
+    float64 threshold;
+    float64 *lo, *hi;   /**< Box of the current node. */
+    float64 *vals;      /**< Scratch space for choosing a split. */
+} kd_build_t;
+
+static int
+cmp_cand(const void *a, const void *b)
+{
+    kd_cand_t const *ca = a, *cb = b;
+
+    if (ca->dist != cb->dist)
+        return ca->dist < cb->dist ? -1 : 1;
+    return ca->id - cb->id;
+}
+
+static int
+cmp_float64(const void *a, const void *b)
+{
+    float64 fa = *(float64 const *)a, fb = *(float64 const *)b;
+
+    return fa < fb ? -1 : (fa > fb ? 1 : 0);
+}
+
+/*
+ * Log density lost by a Gaussian at the point of the box closest to
+ * its mean (zero if the mean is inside).
+ */
+static float64
+box_dist(kd_build_t *b, int32 d)
+{
+    float64 dist = 0;
+    int32 i;
+
+    for (i = 0; i < b->tree->n_comp; ++i) {
+        float64 m = MFCC2FLOAT(b->mean[d][i]);
+        float64 diff = 0;
+
+        if (m < b->lo[i])
+            diff = b->lo[i] - m;
+        else if (m > b->hi[i])
+            diff = m - b->hi[i];
+        dist += diff * diff * (float64)b->var[d][i];
+    }
+    return dist;
+}
+
+/*
+ * Split on the dimension where the means inside the box are the most
+ * spread out relative to their variances, at their median.
+ */
+static int32
+choose_split(kd_build_t *b, kd_cand_t *cand, int32 n_inside, float64 *out_plane)
+{
+    int32 i, k, best = -1;
+    float64 best_spread = 0;
+
+    for (i = 0; i < b->tree->n_comp; ++i) {
+        float64 mu = 0, spread = 0;
+
+        for (k = 0; k < n_inside; ++k)
+            mu += MFCC2FLOAT(b->mean[cand[k].id][i]);
+        mu /= n_inside;
+        for (k = 0; k < n_inside; ++k) {
+            float64 diff = MFCC2FLOAT(b->mean[cand[k].id][i]) - mu;
+            spread += diff * diff * (float64)b->var[cand[k].id][i];
+        }
+        if (spread > best_spread) {
+            best_spread = spread;
+            best = i;
+        }
+    }
+    if (best < 0)
+        return -1;
+
+    for (k = 0; k < n_inside; ++k)
+        b->vals[k] = MFCC2FLOAT(b->mean[cand[k].id][best]);
+    qsort(b->vals, n_inside, sizeof(*b->vals), cmp_float64);
+    k = n_inside / 2;
+    if (b->vals[k] > b->vals[0])
+        *out_plane = b->vals[k];
+    else
+        *out_plane = (b->vals[0] + b->vals[n_inside - 1]) / 2;
+    return best;
+}
+
+static void
+build_node(kd_build_t *b, int32 i, int32 level, kd_cand_t const *parent,
+           int32 n_parent)
+{
+    kd_tree_node_t *node = &b->tree->nodes[i];
+    kd_cand_t *cand;
+    int32 k, n_cand, n_inside;
+    float64 plane, save;
+
+    /* Keep the densities of the parent which come close enough. */
+    cand = ckd_calloc(n_parent ? n_parent : 1, sizeof(*cand));
+    for (k = n_cand = 0; k < n_parent; ++k) {
+        float64 dist = box_dist(b, parent[k].id);
+        if (dist <= b->threshold) {
+            cand[n_cand].id = parent[k].id;
+            cand[n_cand].dist = dist;
+            ++n_cand;
+        }
+    }
+    qsort(cand, n_cand, sizeof(*cand), cmp_cand);
+    node->n_bbi = n_cand;
+    node->bbi = ckd_calloc(n_cand ? n_cand : 1, sizeof(*node->bbi));
+    for (k = 0; k < n_cand; ++k)
+        node->bbi[k] = cand[k].id;
+
+    for (n_inside = 0; n_inside < n_cand && cand[n_inside].dist == 0; ++n_inside)
+        ;
+    if (level + 1 < b->tree->n_level && n_inside > 1
+        && (node->split_comp = choose_split(b, cand, n_inside, &plane)) >= 0) {
+        node->split_plane = FLOAT2MFCC(plane);
+
+        save = b->hi[node->split_comp];
+        b->hi[node->split_comp] = plane;
+        build_node(b, 2 * i + 1, level + 1, cand, n_cand);
+        b->hi[node->split_comp] = save;
+
+        save = b->lo[node->split_comp];
+        b->lo[node->split_comp] = plane;
+        build_node(b, 2 * i + 2, level + 1, cand, n_cand);
+        b->lo[node->split_comp] = save;
+    }
+    ckd_free(cand);
+}
+
+/* Move the lists of all nodes to a single buffer. */
+static void
+pack_lists(kd_tree_t *tree, int32 n_nodes)
+{
+    int32 i, n;
+
+    for (i = n = 0; i < n_nodes; ++i)
+        n += tree->nodes[i].n_bbi;
+    tree->bbi = ckd_calloc(n ? n : 1, sizeof(*tree->bbi));
+    for (i = n = 0; i < n_nodes; ++i) {
+        kd_tree_node_t *node = &tree->nodes[i];
+
+        if (node->n_bbi)
+            memcpy(tree->bbi + n, node->bbi, node->n_bbi * sizeof(*node->bbi));
+        ckd_free(node->bbi);
+        node->bbi = tree->bbi + n;
+        n += node->n_bbi;
+    }
+}
+
+kd_tree_t *
+kd_tree_build(mfcc_t **mean, mfcc_t **var, int32 n_density, int32 n_comp,
+              int32 n_level, float64 threshold)
+{
+    kd_build_t b;
+    kd_cand_t *all;
+    int32 i, n_nodes;
+
+    if (n_density > 65536) {
+        E_ERROR("Too many densities for a kd-tree: %d\n", n_density);
+        return NULL;
+    }
+    if (n_level < 1 || n_level > 20) {
+        E_ERROR("Unsupported kd-tree depth: %d\n", n_level);
+        return NULL;
+    }
+    n_nodes = (1 << n_level) - 1;
+
+    b.tree = ckd_calloc(1, sizeof(*b.tree));
+    b.tree->n_density = n_density;
+    b.tree->n_comp = n_comp;
+    b.tree->n_level = n_level;
+    b.tree->nodes = ckd_calloc(n_nodes, sizeof(*b.tree->nodes));
+    for (i = 0; i < n_nodes; ++i)
+        b.tree->nodes[i].split_comp = -1;
+    b.mean = mean;
+    b.var = var;
+    b.threshold = threshold;
+    b.lo = ckd_calloc(n_comp, sizeof(*b.lo));
+    b.hi = ckd_calloc(n_comp, sizeof(*b.hi));
+    for (i = 0; i < n_comp; ++i) {
+        b.lo[i] = -HUGE_VAL;
+        b.hi[i] = HUGE_VAL;
+    }
+    b.vals = ckd_calloc(n_density, sizeof(*b.vals));
+
+    all = ckd_calloc(n_density, sizeof(*all));
+    for (i = 0; i < n_density; ++i)
+        all[i].id = i;
+    build_node(&b, 0, 0, all, n_density);
+    pack_lists(b.tree, n_nodes);
+
+    ckd_free(all);
+    ckd_free(b.lo);
+    ckd_free(b.hi);
+    ckd_free(b.vals);
+    return b.tree;
+}
+
+void
+kd_tree_free(kd_tree_t *tree)
+{
+    if (tree == NULL)
+        return;
+    ckd_free(tree->nodes);
+    ckd_free(tree->bbi);
+    ckd_free(tree);
+}
+
+void
+kd_trees_free(kd_tree_t **trees, int32 n_trees)
+{
+    int32 i;
+
+    if (trees == NULL)
+        return;
+    for (i = 0; i < n_trees; ++i)
+        kd_tree_free(trees[i]);
+    ckd_free(trees);
+}
+
+kd_tree_node_t const *
+kd_tree_find(kd_tree_t const *tree, mfcc_t const *obs)
+{
+    kd_tree_node_t const *node = tree->nodes;
+
+    while (node->split_comp >= 0) {
+        int32 i = node - tree->nodes;
+
+        if (obs[node->split_comp] < node->split_plane)
+            node = tree->nodes + 2 * i + 1;
+        else
+            node = tree->nodes + 2 * i + 2;
+    }
+    return node;
+}
+
+int32
+kd_trees_write(char const *file_name, kd_tree_t **trees, int32 n_trees)
+{
+    FILE *fp;
+    uint32 chksum = 0;
+    int32 i, j;
+
+    if ((fp = fopen(file_name, "wb")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open %s for writing", file_name);
+        return -1;
+    }
+    if (bio_writehdr(fp, "version", KD_TREE_VERSION,
+                     "chksum0", "yes", NULL) < 0
+        || bio_fwrite(&n_trees, sizeof(int32), 1, fp, 0, &chksum) != 1)
+        goto error_out;
+    for (i = 0; i < n_trees; ++i) {
+        kd_tree_t *tree = trees[i];
+
+        if (bio_fwrite(&tree->n_density, sizeof(int32), 1, fp, 0, &chksum) != 1
+            || bio_fwrite(&tree->n_comp, sizeof(int32), 1, fp, 0, &chksum) != 1
+            || bio_fwrite(&tree->n_level, sizeof(int32), 1, fp, 0, &chksum) != 1)
+            goto error_out;
+        for (j = 0; j < (1 << tree->n_level) - 1; ++j) {
+            kd_tree_node_t *node = &tree->nodes[j];
+            float32 plane = MFCC2FLOAT(node->split_plane);
+
+            if (bio_fwrite(&node->split_comp, sizeof(int32), 1, fp, 0, &chksum) != 1
+                || bio_fwrite(&plane, sizeof(float32), 1, fp, 0, &chksum) != 1
+                || bio_fwrite(&node->n_bbi, sizeof(int32), 1, fp, 0, &chksum) != 1
+                || bio_fwrite(node->bbi, sizeof(uint16), node->n_bbi,
+                              fp, 0, &chksum) != node->n_bbi)
+                goto error_out;
+        }
+    }
+    if (fwrite(&chksum, sizeof(chksum), 1, fp) != 1)
+        goto error_out;
+    fclose(fp);
+    return 0;
+
+error_out:
+    E_ERROR_SYSTEM("Failed to write %s", file_name);
+    fclose(fp);
+    return -1;
+}
+
+static kd_tree_t *
+read_tree(FILE *fp, int32 byteswap, uint32 *chksum,
+          int32 maxdepth, int32 maxbbi)
+{
+    kd_tree_t *tree;
+    uint16 *bbi;
+    int32 i, n_nodes, n_keep;
+
+    tree = ckd_calloc(1, sizeof(*tree));
+    if (bio_fread(&tree->n_density, sizeof(int32), 1, fp, byteswap, chksum) != 1
+        || bio_fread(&tree->n_comp, sizeof(int32), 1, fp, byteswap, chksum) != 1
+        || bio_fread(&tree->n_level, sizeof(int32), 1, fp, byteswap, chksum) != 1
+        || tree->n_level < 1 || tree->n_level > 20
+        || tree->n_density < 1 || tree->n_density > 65536) {
+        ckd_free(tree);
+        return NULL;
+    }
+    n_nodes = (1 << tree->n_level) - 1;
+    if (maxdepth > 0 && maxdepth < tree->n_level)
+        tree->n_level = maxdepth;
+    n_keep = (1 << tree->n_level) - 1;
+
+    tree->nodes = ckd_calloc(n_keep, sizeof(*tree->nodes));
+    bbi = ckd_calloc(tree->n_density, sizeof(*bbi));
+    for (i = 0; i < n_nodes; ++i) {
+        kd_tree_node_t *node = (i < n_keep) ? &tree->nodes[i] : NULL;
+        int32 split_comp, n_bbi;
+        float32 plane;
+
+        if (bio_fread(&split_comp, sizeof(int32), 1, fp, byteswap, chksum) != 1
+            || bio_fread(&plane, sizeof(float32), 1, fp, byteswap, chksum) != 1
+            || bio_fread(&n_bbi, sizeof(int32), 1, fp, byteswap, chksum) != 1
+            || n_bbi < 0 || n_bbi > tree->n_density
+            || split_comp >= tree->n_comp
+            || bio_fread(bbi, sizeof(uint16), n_bbi, fp, byteswap, chksum) != n_bbi)
+            goto error_out;
+        if (node == NULL)
+            continue;
+        /* Stop the search at the last level kept. */
+        node->split_comp = (2 * i + 1 < n_keep) ? split_comp : -1;
+        node->split_plane = FLOAT2MFCC(plane);
+        if (maxbbi >= 0 && n_bbi > maxbbi)
+            n_bbi = maxbbi;
+        node->n_bbi = n_bbi;
+        node->bbi = ckd_calloc(n_bbi ? n_bbi : 1, sizeof(*node->bbi));
+        memcpy(node->bbi, bbi, n_bbi * sizeof(*bbi));
+    }
+    ckd_free(bbi);
+    pack_lists(tree, n_keep);
+    return tree;
+
+error_out:
+    for (i = 0; i < n_keep; ++i)
+        ckd_free(tree->nodes[i].bbi);
+    ckd_free(bbi);
+    ckd_free(tree->nodes);
+    ckd_free(tree);
+    return NULL;
+}
+
+kd_tree_t **
+kd_trees_read(char const *file_name, int32 *out_n_trees,
+              int32 maxdepth, int32 maxbbi)
+{
+    FILE *fp;
+    kd_tree_t **trees;
+    char **argname, **argval;
+    int32 i, byteswap, chksum_present, n_trees;
+    uint32 chksum = 0;
+    char tmp;
+
+    E_INFO("Reading kd-trees: %s\n", file_name);
+    if ((fp = fopen(file_name, "rb")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open kd-tree file '%s' for reading", file_name);
+        return NULL;
+    }
+    if (bio_readhdr(fp, &argname, &argval, &byteswap) < 0) {
+        E_ERROR("Failed to read header from file '%s'\n", file_name);
+        fclose(fp);
+        return NULL;
+    }
+    chksum_present = 0;
+    for (i = 0; argname[i]; i++) {
+        if (strcmp(argname[i], "version") == 0) {
+            if (strcmp(argval[i], KD_TREE_VERSION) != 0)
+                E_WARN("Version mismatch(%s): %s, expecting %s\n",
+                       file_name, argval[i], KD_TREE_VERSION);
+        }
+        else if (strcmp(argname[i], "chksum0") == 0) {
+            chksum_present = 1;
+        }
+    }
+    bio_hdrarg_free(argname, argval);
+
+    if (bio_fread(&n_trees, sizeof(int32), 1, fp, byteswap, &chksum) != 1
+        || n_trees < 1) {
+        E_ERROR("Failed to read number of kd-trees from %s\n", file_name);
+        fclose(fp);
+        return NULL;
+    }
+    trees = ckd_calloc(n_trees, sizeof(*trees));
+    for (i = 0; i < n_trees; ++i) {
+        if ((trees[i] = read_tree(fp, byteswap, &chksum,
+                                  maxdepth, maxbbi)) == NULL) {
+            E_ERROR("Failed to read kd-tree %d from %s\n", i, file_name);
+            kd_trees_free(trees, n_trees);
+            fclose(fp);
+            return NULL;
+        }
+    }
+    if (chksum_present)
+        bio_verify_chksum(fp, byteswap, chksum);
+    if (fread(&tmp, 1, 1, fp) == 1)
+        E_WARN("More data than expected in %s\n", file_name);
+    fclose(fp);
+
+    *out_n_trees = n_trees;
+    return trees;
+}
@@ -0,0 +1,143 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2013 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * @file kdtree.h kd-trees for Gaussian selection.
+ *
+ * A kd-tree splits the feature space of a codebook into boxes, and
+ * keeps for each box the list of densities which can score well for
+ * an observation falling in it (the "bucket box intersection").  Only
+ * these densities are computed, instead of all of the codebook.
+ *
+ * A density is listed in a box if, at the point of the box closest to
+ * its mean, its log density is less than a threshold below its peak.
+ * Lists are sorted by this distance, so that they can be shortened
+ * when loading the trees.
+ */
+
+#ifndef __KDTREE_H__
+#define __KDTREE_H__
+
+/* SphinxBase headers. */
+#include <sphinxbase/prim_type.h>
+#include <sphinxbase/fe.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+} /* Fool Emacs into not indenting things. */
+#endif
+
+/**
+ * A node of a kd-tree.
+ */
+typedef struct kd_tree_node_s {
+    int32 split_comp;   /**< Dimension compared at this node, or -1
+                           if the search stops here. */
+    mfcc_t split_plane; /**< Observations below this value go to the
+                           left child. */
+    int32 n_bbi;        /**< Number of densities listed. */
+    uint16 *bbi;        /**< Densities for this box, best first. */
+} kd_tree_node_t;
+
+/**
+ * A kd-tree for one feature stream of one codebook.
+ */
+typedef struct kd_tree_s {
+    int32 n_density;    /**< Number of densities in the codebook. */
+    int32 n_comp;       /**< Dimensionality of the feature stream. */
+    int32 n_level;      /**< Depth of the tree. */
+    kd_tree_node_t *nodes; /**< The 2^n_level-1 nodes, children of node
+                              i are 2i+1 and 2i+2. */
+    uint16 *bbi;        /**< Storage for the lists of all nodes. */
+} kd_tree_t;
+
+/**
+ * Build a kd-tree for a codebook.
+ *
+ * @param mean Means, as in gauden_t.
+ * @param var Precomputed precisions, as in gauden_t.
+ * @param n_level Depth of the tree.
+ * @param threshold Maximum distance from the peak of a density, in
+ * the units of gauden_t::var, for it to be listed in a box.
+ * @return the tree, or NULL if there are too many densities.
+ */
+kd_tree_t *kd_tree_build(mfcc_t **mean, mfcc_t **var,
+                         int32 n_density, int32 n_comp,
+                         int32 n_level, float64 threshold);
+
+/**
+ * Release a kd-tree.
+ */
+void kd_tree_free(kd_tree_t *tree);
+
+/**
+ * Find the box of an observation.
+ */
+kd_tree_node_t const *kd_tree_find(kd_tree_t const *tree, mfcc_t const *obs);
+
+/**
+ * Write a set of kd-trees to a file.
+ * @return 0 if successful, -1 otherwise.
+ */
+int32 kd_trees_write(char const *file_name, kd_tree_t **trees, int32 n_trees);
+
+/**
+ * Read a set of kd-trees from a file.
+ *
+ * @param maxdepth Depth at which to stop the search, 0 for the whole
+ * tree.
+ * @param maxbbi Maximum number of densities to keep in each list, -1
+ * for all of them.
+ * @return the trees, or NULL on error.
+ */
+kd_tree_t **kd_trees_read(char const *file_name, int32 *out_n_trees,
+                          int32 maxdepth, int32 maxbbi);
+
+/**
+ * Release a set of kd-trees returned by kd_trees_read().
+ */
+void kd_trees_free(kd_tree_t **trees, int32 n_trees);
+
+#if 0
+{ /* Stop indent from complaining */
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __KDTREE_H__ */
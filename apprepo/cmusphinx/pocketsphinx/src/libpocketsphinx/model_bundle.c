@@ -0,0 +1,536 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2013 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * @file model_bundle.c Memory-mapped acoustic model bundles.
+ *
+ * File format: a fixed-size header (bundle_header_t below) in native
+ * byte order, which records the build and decoder parameters the
+ * contents were computed with, the size and modification time of the
+ * files they were read from, and the offset and size of each section,
+ * followed by the sections, each one starting on a MODEL_BUNDLE_ALIGN
+ * boundary.
+ */
+
+#include <string.h>
+
+/* SphinxBase headers. */
+#include <sphinxbase/ckd_alloc.h>
+#include <sphinxbase/err.h>
+#include <sphinxbase/mmio.h>
+#include <sphinxbase/pio.h>
+#include <sphinxbase/strfuncs.h>
+
+/* Local headers. */
+#include "model_bundle.h"
+#include "gmm_kernel.h"
+#include "hmm.h"
+
+#define MODEL_BUNDLE_MAGIC "PSBUNDLE"
+#define MODEL_BUNDLE_BYTEORDER 0x11223344
+#define MODEL_BUNDLE_MAX_SECTION 16
+#define MODEL_BUNDLE_MAX_SOURCE 8
+
+#ifdef FIXED_POINT
+#define MODEL_BUNDLE_FIXED 1
+#else
+#define MODEL_BUNDLE_FIXED 0
+#endif
+
+typedef struct bundle_section_s {
+    char name[16];
+    uint32 offset;
+    uint32 size;
+} bundle_section_t;
+
+typedef struct bundle_source_s {
+    char arg[16];       /**< Option naming the file, empty if unused. */
+    int32 mtime;        /**< As from stat_mtime(), -1 if no file. */
+    int32 reserved;
+    int64 size;         /**< Size in bytes, -1 if no file. */
+} bundle_source_t;
+
+typedef struct bundle_header_s {
+    char magic[8];
+    int32 byteorder;    /**< MODEL_BUNDLE_BYTEORDER as written. */
+    int32 version;
+    int32 fixed_point;  /**< Written by a FIXED_POINT build. */
+    int32 block_width;  /**< GMM_BLOCK_WIDTH. */
+    int32 senscr_shift; /**< SENSCR_SHIFT. */
+    int32 n_section;
+    float64 logbase;
+    float32 varfloor;
+    float32 mixwfloor;
+    float32 tmatfloor;
+    int32 reserved;
+    bundle_source_t source[MODEL_BUNDLE_MAX_SOURCE];
+    bundle_section_t section[MODEL_BUNDLE_MAX_SECTION];
+} bundle_header_t;
+
+struct model_bundle_s {
+    int refcount;
+    char *file;
+    mmio_file_t *filemap;
+    bundle_header_t const *hdr;
+};
+
+struct model_bundle_writer_s {
+    char *file;
+    char *tmpfile;
+    FILE *fh;
+    cmd_ln_t *config;
+    bundle_header_t hdr;
+};
+
+static void
+bundle_header_init(bundle_header_t *hdr, cmd_ln_t *config, logmath_t *lmath)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, MODEL_BUNDLE_MAGIC, sizeof(hdr->magic));
+    hdr->byteorder = MODEL_BUNDLE_BYTEORDER;
+    hdr->version = MODEL_BUNDLE_VERSION;
+    hdr->fixed_point = MODEL_BUNDLE_FIXED;
+    hdr->block_width = GMM_BLOCK_WIDTH;
+    hdr->senscr_shift = SENSCR_SHIFT;
+    if (lmath)
+        hdr->logbase = logmath_get_base(lmath);
+    if (config) {
+        hdr->varfloor = cmd_ln_float32_r(config, "-varfloor");
+        hdr->mixwfloor = cmd_ln_float32_r(config, "-mixwfloor");
+        hdr->tmatfloor = cmd_ln_float32_r(config, "-tmatfloor");
+    }
+}
+
+/*
+ * Describe the file named by an option.  Whether the option is set
+ * matters too, so that a bundle written without a file is not used
+ * instead of one given since.
+ */
+static void
+bundle_source_init(bundle_source_t *src, char const *arg, cmd_ln_t *config)
+{
+    char const *file = NULL;
+    FILE *fh;
+    long size;
+
+    memset(src, 0, sizeof(*src));
+    strncpy(src->arg, arg, sizeof(src->arg) - 1);
+    src->mtime = -1;
+    src->size = -1;
+    if (config && cmd_ln_exists_r(config, arg))
+        file = cmd_ln_str_r(config, arg);
+    if (file == NULL || (fh = fopen(file, "rb")) == NULL)
+        return;
+    if (fseek(fh, 0, SEEK_END) == 0 && (size = ftell(fh)) >= 0) {
+        src->size = size;
+        src->mtime = stat_mtime(file);
+    }
+    fclose(fh);
+}
+
+int
+model_bundle_probe(char const *file)
+{
+    FILE *fh;
+    char magic[8];
+    int rv;
+
+    if ((fh = fopen(file, "rb")) == NULL)
+        return FALSE;
+    rv = (fread(magic, sizeof(magic), 1, fh) == 1
+          && memcmp(magic, MODEL_BUNDLE_MAGIC, sizeof(magic)) == 0);
+    fclose(fh);
+    return rv;
+}
+
+model_bundle_t *
+model_bundle_read(char const *file, cmd_ln_t *config, logmath_t *lmath)
+{
+    model_bundle_t *b;
+    bundle_header_t hdr, want;
+    FILE *fh;
+    long size;
+    int32 i;
+
+    if ((fh = fopen(file, "rb")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open model bundle %s", file);
+        return NULL;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fh) != 1
+        || fseek(fh, 0, SEEK_END) < 0
+        || (size = ftell(fh)) < 0) {
+        E_ERROR("Failed to read model bundle header from %s\n", file);
+        fclose(fh);
+        return NULL;
+    }
+    fclose(fh);
+
+    bundle_header_init(&want, config, lmath);
+    if (memcmp(hdr.magic, want.magic, sizeof(hdr.magic)) != 0) {
+        E_WARN("%s is not a model bundle, ignoring it\n", file);
+        return NULL;
+    }
+    if (hdr.byteorder != want.byteorder) {
+        E_WARN("Model bundle %s has the wrong byte order, ignoring it\n", file);
+        return NULL;
+    }
+    if (hdr.version != want.version
+        || hdr.fixed_point != want.fixed_point
+        || hdr.block_width != want.block_width
+        || hdr.senscr_shift != want.senscr_shift) {
+        E_WARN("Model bundle %s was written by another version or build, "
+               "ignoring it\n", file);
+        return NULL;
+    }
+    if (hdr.logbase != want.logbase
+        || hdr.varfloor != want.varfloor
+        || hdr.mixwfloor != want.mixwfloor
+        || hdr.tmatfloor != want.tmatfloor) {
+        E_WARN("Model bundle %s was written with -logbase %g -varfloor %g "
+               "-mixwfloor %g -tmatfloor %g, ignoring it\n", file,
+               hdr.logbase, hdr.varfloor, hdr.mixwfloor, hdr.tmatfloor);
+        return NULL;
+    }
+    for (i = 0; i < MODEL_BUNDLE_MAX_SOURCE && hdr.source[i].arg[0]; ++i) {
+        bundle_source_t const *src = &hdr.source[i];
+        bundle_source_t cur;
+
+        if (memchr(src->arg, '\0', sizeof(src->arg)) == NULL)
+            goto corrupt;
+        bundle_source_init(&cur, src->arg, config);
+        if (cur.size != src->size || cur.mtime != src->mtime) {
+            E_WARN("Model bundle %s was not written from the current %s "
+                   "file, ignoring it\n", file, src->arg);
+            return NULL;
+        }
+    }
+    if (hdr.n_section < 0 || hdr.n_section > MODEL_BUNDLE_MAX_SECTION)
+        goto corrupt;
+    for (i = 0; i < hdr.n_section; ++i) {
+        bundle_section_t const *sec = &hdr.section[i];
+
+        if (memchr(sec->name, '\0', sizeof(sec->name)) == NULL
+            || sec->offset % MODEL_BUNDLE_ALIGN != 0
+            || sec->offset > (unsigned long)size
+            || sec->size > (unsigned long)size - sec->offset)
+            goto corrupt;
+    }
+
+    b = ckd_calloc(1, sizeof(*b));
+    b->refcount = 1;
+    b->file = ckd_salloc(file);
+    if ((b->filemap = mmio_file_read(file)) == NULL) {
+        E_ERROR("Failed to map model bundle %s\n", file);
+        model_bundle_free(b);
+        return NULL;
+    }
+    b->hdr = mmio_file_ptr(b->filemap);
+    /* It may have been replaced in the meantime. */
+    if (memcmp(b->hdr, &hdr, sizeof(hdr)) != 0) {
+        E_ERROR("Model bundle %s changed while reading it\n", file);
+        model_bundle_free(b);
+        return NULL;
+    }
+    E_INFO("Mapped model bundle %s (%ld bytes, %d sections)\n",
+           file, size, hdr.n_section);
+    return b;
+
+corrupt:
+    E_ERROR("Model bundle %s is truncated or corrupt\n", file);
+    return NULL;
+}
+
+model_bundle_t *
+model_bundle_retain(model_bundle_t *b)
+{
+    ++b->refcount;
+    return b;
+}
+
+int
+model_bundle_free(model_bundle_t *b)
+{
+    if (b == NULL)
+        return 0;
+    if (--b->refcount > 0)
+        return b->refcount;
+    if (b->filemap)
+        mmio_file_unmap(b->filemap);
+    ckd_free(b->file);
+    ckd_free(b);
+    return 0;
+}
+
+void *
+model_bundle_get(model_bundle_t *b, char const *name, size_t *out_size)
+{
+    int32 i;
+
+    for (i = 0; i < b->hdr->n_section; ++i) {
+        bundle_section_t const *sec = &b->hdr->section[i];
+
+        if (strcmp(sec->name, name) == 0) {
+            if (out_size)
+                *out_size = sec->size;
+            return (char *)b->hdr + sec->offset;
+        }
+    }
+    return NULL;
+}
+
+char const *
+model_bundle_name(model_bundle_t *b)
+{
+    return b->file;
+}
+
+static int
+pad_file(FILE *fh)
+{
+    static const char zeros[MODEL_BUNDLE_ALIGN];
+    long pos;
+
+    if ((pos = ftell(fh)) < 0)
+        return -1;
+    if (pos % MODEL_BUNDLE_ALIGN == 0)
+        return 0;
+    pos = MODEL_BUNDLE_ALIGN - pos % MODEL_BUNDLE_ALIGN;
+    return (fwrite(zeros, 1, pos, fh) == (size_t)pos) ? 0 : -1;
+}
+
+/* Set the size of the last section from the current position. */
+static int
+end_section(model_bundle_writer_t *w)
+{
+    bundle_section_t *sec;
+    long pos;
+
+    if (w->hdr.n_section == 0)
+        return 0;
+    sec = &w->hdr.section[w->hdr.n_section - 1];
+    if ((pos = ftell(w->fh)) < 0)
+        return -1;
+    /* Offsets are 32 bits. */
+    if ((unsigned long)pos - sec->offset > 0xffffffffUL - sec->offset) {
+        E_ERROR("Model bundle %s would be larger than 4GB\n", w->file);
+        return -1;
+    }
+    sec->size = pos - sec->offset;
+    return 0;
+}
+
+model_bundle_writer_t *
+model_bundle_writer_init(char const *file, cmd_ln_t *config, logmath_t *lmath)
+{
+    model_bundle_writer_t *w;
+
+    w = ckd_calloc(1, sizeof(*w));
+    w->file = ckd_salloc(file);
+    w->tmpfile = string_join(file, ".tmp", NULL);
+    w->config = config;
+    bundle_header_init(&w->hdr, config, lmath);
+    if ((w->fh = fopen(w->tmpfile, "wb")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open %s for writing", w->tmpfile);
+        ckd_free(w->file);
+        ckd_free(w->tmpfile);
+        ckd_free(w);
+        return NULL;
+    }
+    /* Written again with the sections at the end. */
+    if (fwrite(&w->hdr, sizeof(w->hdr), 1, w->fh) != 1) {
+        E_ERROR_SYSTEM("Failed to write to %s", w->tmpfile);
+        model_bundle_writer_close(w, TRUE);
+        return NULL;
+    }
+    return w;
+}
+
+FILE *
+model_bundle_add(model_bundle_writer_t *w, char const *name)
+{
+    bundle_section_t *sec;
+
+    if (w->hdr.n_section == MODEL_BUNDLE_MAX_SECTION
+        || strlen(name) >= sizeof(sec->name)) {
+        E_ERROR("Cannot add section %s to model bundle %s\n", name, w->file);
+        return NULL;
+    }
+    if (end_section(w) < 0 || pad_file(w->fh) < 0)
+        return NULL;
+    sec = &w->hdr.section[w->hdr.n_section++];
+    strcpy(sec->name, name);
+    sec->offset = ftell(w->fh);
+    return w->fh;
+}
+
+int
+model_bundle_add_source(model_bundle_writer_t *w, char const *arg)
+{
+    int32 i;
+
+    for (i = 0; i < MODEL_BUNDLE_MAX_SOURCE && w->hdr.source[i].arg[0]; ++i)
+        ;
+    if (i == MODEL_BUNDLE_MAX_SOURCE
+        || strlen(arg) >= sizeof(w->hdr.source[i].arg)) {
+        E_ERROR("Cannot record %s in model bundle %s\n", arg, w->file);
+        return -1;
+    }
+    bundle_source_init(&w->hdr.source[i], arg, w->config);
+    return 0;
+}
+
+int
+model_bundle_writer_close(model_bundle_writer_t *w, int abort)
+{
+    int rv = 0;
+
+    if (!abort) {
+        if (end_section(w) < 0
+            || fseek(w->fh, 0, SEEK_SET) < 0
+            || fwrite(&w->hdr, sizeof(w->hdr), 1, w->fh) != 1) {
+            E_ERROR_SYSTEM("Failed to write to %s", w->tmpfile);
+            rv = -1;
+        }
+    }
+    if (fclose(w->fh) != 0 && !abort) {
+        E_ERROR_SYSTEM("Failed to write to %s", w->tmpfile);
+        rv = -1;
+    }
+    if (abort || rv < 0) {
+        remove(w->tmpfile);
+        rv = -1;
+    }
+    else if (rename(w->tmpfile, w->file) < 0) {
+        /* Windows does not replace existing files. */
+        remove(w->file);
+        if (rename(w->tmpfile, w->file) < 0) {
+            E_ERROR_SYSTEM("Failed to rename %s to %s", w->tmpfile, w->file);
+            rv = -1;
+        }
+    }
+    if (rv == 0)
+        E_INFO("Wrote model bundle %s (%d sections)\n",
+               w->file, w->hdr.n_section);
+    ckd_free(w->file);
+    ckd_free(w->tmpfile);
+    ckd_free(w);
+    return rv;
+}
+
+int
+model_bundle_write_aligned(FILE *fh, void const *data, size_t size)
+{
+    if (fwrite(data, 1, size, fh) != size)
+        return -1;
+    return pad_file(fh);
+}
+
+/* Layout of the "sendump" section, followed by the rows. */
+typedef struct bundle_sendump_s {
+    int32 n_feat;
+    int32 n_density;
+    int32 n_sen;
+    int32 n_clust;
+    uint8 cb[16];
+} bundle_sendump_t;
+
+int
+model_bundle_write_sendump(model_bundle_writer_t *w, uint8 ***mixw,
+                           uint8 const *mixw_cb, int32 n_feat,
+                           int32 n_density, int32 n_sen)
+{
+    bundle_sendump_t hdr;
+    FILE *fh;
+    int32 f, d, step;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.n_feat = n_feat;
+    hdr.n_density = n_density;
+    hdr.n_sen = n_sen;
+    if (mixw_cb) {
+        hdr.n_clust = 16;
+        memcpy(hdr.cb, mixw_cb, sizeof(hdr.cb));
+    }
+    step = mixw_cb ? (n_sen + 1) / 2 : n_sen;
+
+    if ((fh = model_bundle_add(w, "sendump")) == NULL
+        || model_bundle_write_aligned(fh, &hdr, sizeof(hdr)) < 0)
+        return -1;
+    for (f = 0; f < n_feat; ++f)
+        for (d = 0; d < n_density; ++d)
+            if (fwrite(mixw[f][d], 1, step, fh) != (size_t)step)
+                return -1;
+    return 0;
+}
+
+uint8 ***
+model_bundle_get_sendump(model_bundle_t *b, int32 n_feat,
+                         int32 n_density, int32 n_sen,
+                         uint8 **out_mixw_cb)
+{
+    bundle_sendump_t const *hdr;
+    uint8 ***mixw;
+    uint8 *data;
+    size_t size, step;
+    int32 f, d;
+
+    if ((hdr = model_bundle_get(b, "sendump", &size)) == NULL)
+        return NULL;
+    if (size < MODEL_BUNDLE_ALIGN
+        || hdr->n_feat != n_feat
+        || hdr->n_density != n_density
+        || hdr->n_sen != n_sen
+        || (hdr->n_clust != 0 && hdr->n_clust != 16)) {
+        E_ERROR("Mixture weights in %s do not match the model\n", b->file);
+        return NULL;
+    }
+    step = hdr->n_clust ? (n_sen + 1) / 2 : n_sen;
+    if ((size - MODEL_BUNDLE_ALIGN) / step < (size_t)n_feat * n_density) {
+        E_ERROR("Model bundle %s is truncated or corrupt\n", b->file);
+        return NULL;
+    }
+
+    data = (uint8 *)hdr + MODEL_BUNDLE_ALIGN;
+    mixw = ckd_calloc_2d(n_feat, n_density, sizeof(**mixw));
+    for (f = 0; f < n_feat; ++f) {
+        for (d = 0; d < n_density; ++d) {
+            mixw[f][d] = data;
+            data += step;
+        }
+    }
+    *out_mixw_cb = hdr->n_clust ? (uint8 *)hdr->cb : NULL;
+    return mixw;
+}
@@ -0,0 +1,227 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2013 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * @file model_bundle.h Memory-mapped acoustic model bundles.
+ *
+ * A bundle holds the parameters of an acoustic model (model
+ * definition, transition matrices, Gaussians and mixture weights) in
+ * a single file, already converted to the representation used by the
+ * decoder: native byte order, log values in the decoder's log base,
+ * floors applied, and everything aligned.  It is memory-mapped and
+ * used in place, so that starting a decoder does not read, convert
+ * or copy the parameters, and processes decoding with the same model
+ * share its pages in the page cache.
+ *
+ * Since the contents depend on the build (fixed or floating point),
+ * on the decoder parameters used to precompute them (-logbase and the
+ * floors) and on the files they were read from, a bundle which does
+ * not match the configuration, or whose files have been modified
+ * since (according to their size and modification time), is ignored
+ * and the model is read from the usual files.
+ *
+ * A bundle is a header followed by named sections.  Each module
+ * reads and writes its own sections.
+ */
+
+#ifndef __MODEL_BUNDLE_H__
+#define __MODEL_BUNDLE_H__
+
+#include <stdio.h>
+
+/* SphinxBase headers. */
+#include <sphinxbase/prim_type.h>
+#include <sphinxbase/cmd_ln.h>
+#include <sphinxbase/logmath.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+} /* Fool Emacs into not indenting things. */
+#endif
+
+/** Format version. */
+#define MODEL_BUNDLE_VERSION 2
+/** Alignment of sections in the file (and thus in memory). */
+#define MODEL_BUNDLE_ALIGN 64
+
+/**
+ * Round a size up to the alignment of data written with
+ * model_bundle_write_aligned().
+ */
+#define model_bundle_aligned(size) \
+    (((size) + MODEL_BUNDLE_ALIGN - 1) & ~(size_t)(MODEL_BUNDLE_ALIGN - 1))
+
+/**
+ * A memory-mapped bundle.
+ */
+typedef struct model_bundle_s model_bundle_t;
+
+/**
+ * A bundle being written.
+ */
+typedef struct model_bundle_writer_s model_bundle_writer_t;
+
+/**
+ * Map a bundle, and check that it can be used with this build and
+ * configuration.
+ *
+ * @param config, lmath Configuration and log base the bundle must
+ * have been written with, or NULL for bundles whose contents do not
+ * depend on them (such as compiled dictionaries).
+ *
+ * @return the bundle, or NULL if it cannot be used (with a warning
+ * saying why).
+ */
+model_bundle_t *model_bundle_read(char const *file, cmd_ln_t *config,
+                                  logmath_t *lmath);
+
+/**
+ * Check whether a file is a bundle (without checking that it can be
+ * used, and without warnings if it is not).
+ */
+int model_bundle_probe(char const *file);
+
+/**
+ * Retain a bundle, for parameters pointing into it.
+ */
+model_bundle_t *model_bundle_retain(model_bundle_t *b);
+
+/**
+ * Release a bundle.
+ *
+ * @return new reference count (0 if freed).
+ */
+int model_bundle_free(model_bundle_t *b);
+
+/**
+ * Get the contents of a section.
+ *
+ * @param out_size Output, size of the section in bytes (may be NULL).
+ * @return pointer to the section, aligned to MODEL_BUNDLE_ALIGN, or
+ * NULL if there is no such section.
+ */
+void *model_bundle_get(model_bundle_t *b, char const *name, size_t *out_size);
+
+/**
+ * Get the name of the file a bundle was mapped from.
+ */
+char const *model_bundle_name(model_bundle_t *b);
+
+/**
+ * Start writing a bundle.  It is written to a temporary file, which
+ * replaces the output file in model_bundle_writer_close(), so that
+ * decoders which have the old one mapped are not disturbed.
+ *
+ * @param config Configuration used to precompute the parameters
+ * (NULL if they do not depend on it).
+ * @param lmath Log base used (NULL if they do not depend on it).
+ */
+model_bundle_writer_t *model_bundle_writer_init(char const *file,
+                                                cmd_ln_t *config,
+                                                logmath_t *lmath);
+
+/**
+ * Start a new section.  The previous one, if any, ends at the
+ * current position of the file.
+ *
+ * @return the file to write its contents to, or NULL on error (too
+ * many sections or name too long).
+ */
+FILE *model_bundle_add(model_bundle_writer_t *w, char const *name);
+
+/**
+ * Record the size and modification time of the file named by an
+ * option of the configuration given to model_bundle_writer_init().
+ * The bundle is then only used if the same option names a file with
+ * the same size and modification time, or no file if there was none.
+ *
+ * @return 0 for success, -1 if too many files are recorded.
+ */
+int model_bundle_add_source(model_bundle_writer_t *w, char const *arg);
+
+/**
+ * Finish writing a bundle.
+ *
+ * @param abort If TRUE, remove the temporary file instead.
+ * @return 0 for success, -1 for failure.
+ */
+int model_bundle_writer_close(model_bundle_writer_t *w, int abort);
+
+/**
+ * Write data to a section, padded to MODEL_BUNDLE_ALIGN so that the
+ * next array is aligned too.
+ *
+ * @return 0 for success, -1 for failure.
+ */
+int model_bundle_write_aligned(FILE *fh, void const *data, size_t size);
+
+/**
+ * Write 8-bit mixture weights in the layout of sendump files (as
+ * used by s2_semi_mgau and ptm_mgau) to a "sendump" section.
+ *
+ * @param mixw mixw[feat][density] is the row of weights of all
+ * senones for this density, n_sen bytes, or (n_sen+1)/2 bytes when
+ * they are 4-bit cluster indices.
+ * @param mixw_cb 16 cluster values, or NULL if not clustered.
+ * @return 0 for success, -1 for failure.
+ */
+int model_bundle_write_sendump(model_bundle_writer_t *w, uint8 ***mixw,
+                               uint8 const *mixw_cb, int32 n_feat,
+                               int32 n_density, int32 n_sen);
+
+/**
+ * Get the mixture weights of a "sendump" section.
+ *
+ * @param out_mixw_cb Output, cluster values (pointing into the
+ * bundle) or NULL if not clustered.
+ * @return rows of weights as for model_bundle_write_sendump(), to be
+ * freed with ckd_free_2d(), or NULL if there is no such section or it
+ * does not match the dimensions given.
+ */
+uint8 ***model_bundle_get_sendump(model_bundle_t *b, int32 n_feat,
+                                  int32 n_density, int32 n_sen,
+                                  uint8 **out_mixw_cb);
+
+#if 0
+{ /* Stop indent from complaining */
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MODEL_BUNDLE_H__ */
@@ -114,9 +114,11 @@
 
 /* System headers. */
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <float.h>
+#include <limits.h>
 
 /* SphinxBase headers. */
 #include <sphinxbase/bio.h>
@@ -153,6 +155,10 @@ gauden_dump_ind(const gauden_t * g, int senidx)
         E_INFO("Codebook %d, Feature %d (%dx%d):\n",
                senidx, f, g->n_density, g->featlen[f]);
 
+        if (g->mean == NULL) {
+            E_INFO("Quantized to %d bits\n", g->bits);
+            continue;
+        }
         for (d = 0; d < g->n_density; d++) {
             printf("m[%3d]", d);
             for (i = 0; i < g->featlen[f]; i++)
@@ -175,6 +181,79 @@ gauden_dump_ind(const gauden_t * g, int senidx)
     fflush(stderr);
 }
 
+/*
+ * Read quantized parameters: a scale and an offset for each
+ * dimension of each codebook and feature stream, then the values in
+ * the same order as unquantized files.
+ */
+static int32
+gauden_param_dequantize(float32 *buf, int32 n_mgau, int32 n_feat,
+                        int32 n_density, int32 const *veclen,
+                        int32 bits, int32 logmap,
+                        FILE *fp, int32 byteswap, uint32 *chksum)
+{
+    float32 *scale;
+    void *qbuf;
+    int32 i, j, k, l, m, n, blk;
+
+    for (i = 0, blk = 0; i < n_feat; i++)
+        blk += veclen[i];
+    n = n_mgau * n_density * blk;
+
+    scale = ckd_calloc(n_mgau * blk * 2, sizeof(*scale));
+    qbuf = ckd_calloc(n, bits / 8);
+    if (bio_fread(scale, sizeof(float32), n_mgau * blk * 2,
+                  fp, byteswap, chksum) != n_mgau * blk * 2
+        || bio_fread(qbuf, bits / 8, n, fp, byteswap, chksum) != n) {
+        ckd_free(scale);
+        ckd_free(qbuf);
+        return -1;
+    }
+
+    for (i = 0, l = 0; i < n_mgau; i++) {
+        float32 *sp = scale + i * blk * 2;
+
+        for (j = 0; j < n_feat; j++) {
+            for (k = 0; k < n_density; k++) {
+                for (m = 0; m < veclen[j]; m++, l++) {
+                    float32 q = (bits == 8)
+                        ? ((int8 *)qbuf)[l] : ((int16 *)qbuf)[l];
+
+                    buf[l] = sp[m * 2] + sp[m * 2 + 1] * q;
+                    if (logmap)
+                        buf[l] = exp(buf[l]);
+                }
+            }
+            sp += veclen[j] * 2;
+        }
+    }
+
+    ckd_free(scale);
+    ckd_free(qbuf);
+    return 0;
+}
+
+/* Build the [codebook][feature][codeword] pointers into a buffer. */
+static mfcc_t ****
+gauden_param_index(mfcc_t *buf, int32 n_mgau, int32 n_feat,
+                   int32 n_density, int32 const *veclen)
+{
+    mfcc_t ****out;
+    int32 i, j, k, l;
+
+    out = (mfcc_t ****) ckd_calloc_3d(n_mgau, n_feat, n_density,
+                                      sizeof(mfcc_t *));
+    for (i = 0, l = 0; i < n_mgau; i++) {
+        for (j = 0; j < n_feat; j++) {
+            for (k = 0; k < n_density; k++) {
+                out[i][j][k] = &buf[l];
+                l += veclen[j];
+            }
+        }
+    }
+    return out;
+}
+
 static int32
 gauden_param_read(float32 ***** out_param,      /* Alloc space iff *out_param == NULL */
                   int32 * out_n_mgau,
@@ -184,12 +263,12 @@ gauden_param_read(float32 ***** out_param,      /* Alloc space iff *out_param ==
 {
     char tmp;
     FILE *fp;
-    int32 i, j, k, l, n, blk;
+    int32 i, n, blk;
     int32 n_mgau;
     int32 n_feat;
     int32 n_density;
     int32 *veclen;
-    int32 byteswap, chksum_present;
+    int32 byteswap, chksum_present, bits, logmap;
     float32 ****out;
     float32 *buf;
     char **argname, **argval;
@@ -206,6 +285,7 @@ gauden_param_read(float32 ***** out_param,      /* Alloc space iff *out_param ==
 
     /* Parse argument-value list */
     chksum_present = 0;
+    bits = logmap = 0;
     for (i = 0; argname[i]; i++) {
         if (strcmp(argname[i], "version") == 0) {
             if (strcmp(argval[i], GAUDEN_PARAM_VERSION) != 0)
@@ -215,6 +295,15 @@ gauden_param_read(float32 ***** out_param,      /* Alloc space iff *out_param ==
         else if (strcmp(argname[i], "chksum0") == 0) {
             chksum_present = 1; /* Ignore the associated value */
         }
+        else if (strcmp(argname[i], "quant") == 0) {
+            bits = atoi(argval[i]);
+            if (bits != 8 && bits != 16)
+                E_FATAL("%s: unsupported quantization to %s bits\n",
+                        file_name, argval[i]);
+        }
+        else if (strcmp(argname[i], "quant_map") == 0) {
+            logmap = (strcmp(argval[i], "log") == 0);
+        }
     }
     bio_hdrarg_free(argname, argval);
     argname = argval = NULL;
@@ -258,17 +347,9 @@ gauden_param_read(float32 ***** out_param,      /* Alloc space iff *out_param ==
 
     /* Allocate memory for mixture gaussian densities if not already allocated */
     if (!(*out_param)) {
-        out = (float32 ****) ckd_calloc_3d(n_mgau, n_feat, n_density,
-                                         sizeof(float32 *));
         buf = (float32 *) ckd_calloc(n, sizeof(float32));
-        for (i = 0, l = 0; i < n_mgau; i++) {
-            for (j = 0; j < n_feat; j++) {
-                for (k = 0; k < n_density; k++) {
-                    out[i][j][k] = &buf[l];
-                    l += veclen[j];
-                }
-            }
-        }
+        out = (float32 ****) gauden_param_index((mfcc_t *)buf, n_mgau, n_feat,
+                                                n_density, veclen);
     }
     else {
         out = (float32 ****) *out_param;
@@ -276,7 +357,13 @@ gauden_param_read(float32 ***** out_param,      /* Alloc space iff *out_param ==
     }
 
     /* Read mixture gaussian densities data */
-    if (bio_fread(buf, sizeof(float32), n, fp, byteswap, &chksum) != n)
+    if (bits) {
+        E_INFO("Parameters are quantized to %d bits\n", bits);
+        if (gauden_param_dequantize(buf, n_mgau, n_feat, n_density, veclen,
+                                    bits, logmap, fp, byteswap, &chksum) < 0)
+            E_FATAL("fread(%s) (densitydata) failed\n", file_name);
+    }
+    else if (bio_fread(buf, sizeof(float32), n, fp, byteswap, &chksum) != n)
         E_FATAL("fread(%s) (densitydata) failed\n", file_name);
 
     if (chksum_present)
@@ -303,19 +390,266 @@ gauden_param_free(mfcc_t **** p)
     ckd_free_3d(p);
 }
 
+/* Release parameters, which may be in a model bundle. */
+static void
+gauden_param_release(gauden_t * g)
+{
+    if (g->bundle) {
+        if (g->mean)
+            ckd_free_3d(g->mean);
+        if (g->var)
+            ckd_free_3d(g->var);
+        if (g->det)
+            ckd_free_3d_ptr(g->det);
+    }
+    else {
+        if (g->mean)
+            gauden_param_free(g->mean);
+        if (g->var)
+            gauden_param_free(g->var);
+        if (g->det)
+            ckd_free_3d(g->det);
+    }
+    g->mean = g->var = NULL;
+    g->det = NULL;
+}
+
+int32
+gauden_param_quantize(char const *infile, char const *outfile,
+                      int bits, int logmap)
+{
+    FILE *fp;
+    float32 ****param, *scale;
+    void *qbuf;
+    int32 n_mgau, n_feat, n_density, *veclen;
+    int32 i, j, k, l, m, n, blk, qmax;
+    uint32 chksum;
+    char bitstr[8];
+
+    if (bits != 8 && bits != 16) {
+        E_ERROR("Gaussians can only be quantized to 8 or 16 bits, not %d\n",
+                bits);
+        return -1;
+    }
+    qmax = (1 << (bits - 1)) - 1;
+
+    param = NULL;
+    gauden_param_read(&param, &n_mgau, &n_feat, &n_density, &veclen, infile);
+    for (i = 0, blk = 0; i < n_feat; i++)
+        blk += veclen[i];
+    n = n_mgau * n_density * blk;
+
+    /* Quantize each dimension around the middle of its range. */
+    scale = ckd_calloc(n_mgau * blk * 2, sizeof(*scale));
+    qbuf = ckd_calloc(n, bits / 8);
+    for (i = 0; i < n_mgau; i++) {
+        float32 *sp = scale + i * blk * 2;
+
+        for (j = 0; j < n_feat; j++) {
+            for (m = 0; m < veclen[j]; m++) {
+                float32 min, max, x;
+
+                min = FLT_MAX;
+                max = -FLT_MAX;
+                for (k = 0; k < n_density; k++) {
+                    x = param[i][j][k][m];
+                    if (logmap)
+                        x = log(x > FLT_MIN ? x : FLT_MIN);
+                    if (x < min)
+                        min = x;
+                    if (x > max)
+                        max = x;
+                }
+                sp[m * 2] = (max + min) / 2;
+                sp[m * 2 + 1] = (max - min) / 2 / qmax;
+                for (k = 0; k < n_density; k++) {
+                    int32 q = 0;
+
+                    x = param[i][j][k][m];
+                    if (logmap)
+                        x = log(x > FLT_MIN ? x : FLT_MIN);
+                    if (sp[m * 2 + 1] > 0)
+                        q = (int32)floor((x - sp[m * 2])
+                                         / sp[m * 2 + 1] + 0.5);
+                    if (q > qmax)
+                        q = qmax;
+                    if (q < -qmax)
+                        q = -qmax;
+                    l = &param[i][j][k][m] - param[0][0][0];
+                    if (bits == 8)
+                        ((int8 *)qbuf)[l] = q;
+                    else
+                        ((int16 *)qbuf)[l] = q;
+                }
+            }
+            sp += veclen[j] * 2;
+        }
+    }
+
+    if ((fp = fopen(outfile, "wb")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open %s for writing", outfile);
+        goto error_out;
+    }
+    sprintf(bitstr, "%d", bits);
+    chksum = 0;
+    if (bio_writehdr(fp, "version", GAUDEN_PARAM_VERSION,
+                     "quant", bitstr,
+                     "quant_map", logmap ? "log" : "linear",
+                     "chksum0", "yes", NULL) < 0
+        || bio_fwrite(&n_mgau, sizeof(int32), 1, fp, 0, &chksum) != 1
+        || bio_fwrite(&n_feat, sizeof(int32), 1, fp, 0, &chksum) != 1
+        || bio_fwrite(&n_density, sizeof(int32), 1, fp, 0, &chksum) != 1
+        || bio_fwrite(veclen, sizeof(int32), n_feat, fp, 0, &chksum) != n_feat
+        || bio_fwrite(&n, sizeof(int32), 1, fp, 0, &chksum) != 1
+        || bio_fwrite(scale, sizeof(float32), n_mgau * blk * 2,
+                      fp, 0, &chksum) != n_mgau * blk * 2
+        || bio_fwrite(qbuf, bits / 8, n, fp, 0, &chksum) != n
+        || fwrite(&chksum, sizeof(chksum), 1, fp) != 1) {
+        E_ERROR_SYSTEM("Failed to write %s", outfile);
+        fclose(fp);
+        goto error_out;
+    }
+    fclose(fp);
+    E_INFO("Wrote %d codebooks quantized to %d bits to %s\n",
+           n_mgau, bits, outfile);
+
+    gauden_param_free((mfcc_t ****)param);
+    ckd_free(veclen);
+    ckd_free(scale);
+    ckd_free(qbuf);
+    return 0;
+
+error_out:
+    gauden_param_free((mfcc_t ****)param);
+    ckd_free(veclen);
+    ckd_free(scale);
+    ckd_free(qbuf);
+    return -1;
+}
+
+static void
+gauden_block_free(gauden_t * g)
+{
+    int32 m, f;
+
+    if (g->block == NULL)
+        return;
+    for (m = 0; m < g->n_mgau; m++)
+        for (f = 0; f < g->n_feat; f++)
+            gmm_block_free(g->block[m][f]);
+    ckd_free_2d(g->block);
+    ckd_free(g->dist);
+    g->block = NULL;
+    g->dist = NULL;
+}
+
+/*
+ * Copy the precomputed parameters into the layout used by the
+ * vectorized density computation.  Quantized blocks replace the
+ * parameters, which are then released.  Returns -1, with the
+ * parameters kept and no blocks, if they could not be quantized.
+ */
+static int32
+gauden_block_init(gauden_t * g)
+{
+    int32 m, f;
+
+    gauden_block_free(g);
+    g->block = (gmm_block_t ***)ckd_calloc_2d(g->n_mgau, g->n_feat,
+                                              sizeof(**g->block));
+    for (m = 0; m < g->n_mgau; m++) {
+        for (f = 0; f < g->n_feat; f++) {
+            if (g->bits)
+                g->block[m][f] = gmm_block_init_quant(g->mean[m][f],
+                                                      g->var[m][f],
+                                                      g->det[m][f],
+                                                      g->n_density,
+                                                      g->featlen[f],
+                                                      g->bits);
+            else
+                g->block[m][f] = gmm_block_init(g->mean[m][f], g->var[m][f],
+                                                g->det[m][f], g->n_density,
+                                                g->featlen[f]);
+            if (g->block[m][f] == NULL) {
+                gauden_block_free(g);
+                return -1;
+            }
+        }
+    }
+    g->dist = ckd_calloc(g->block[0][0]->n_alloc, sizeof(*g->dist));
+
+    if (g->bits) {
+        if (g->bundle) {
+            ckd_free_3d(g->mean);
+            ckd_free_3d(g->var);
+        }
+        else {
+            gauden_param_free(g->mean);
+            gauden_param_free(g->var);
+        }
+        g->mean = g->var = NULL;
+    }
+    return 0;
+}
+
+int32
+gauden_quantize(gauden_t * g, int bits)
+{
+    if (bits != 8 && bits != 16) {
+        E_ERROR("Gaussians can only be quantized to 8 or 16 bits, not %d\n",
+                bits);
+        return -1;
+    }
+    if (g->bits)
+        return (bits == g->bits) ? 0 : -1;
+    E_INFO("Quantizing means and precisions to %d bits\n", bits);
+    g->bits = bits;
+    if (gauden_block_init(g) < 0) {
+        g->bits = 0;
+        gauden_block_init(g);
+        return -1;
+    }
+    return 0;
+}
+
 /*
  * Some of the gaussian density computation can be carried out in advance:
  * 	log(determinant) calculation,
  * 	1/(2*var) in the exponent,
  * NOTE; The density computation is performed in log domain.
  */
+static int32
+gauden_precompute_density(logmath_t *lmath, float32 varfloor, int32 flen,
+                          mfcc_t *meanp, mfcc_t *varp, mfcc_t *detp)
+{
+    int32 i, floored;
+
+    floored = 0;
+    *detp = 0;
+    for (i = 0; i < flen; i++, varp++, meanp++) {
+        float32 *fvarp = (float32 *)varp;
+
+#ifdef FIXED_POINT
+        float32 *fmp = (float32 *)meanp;
+        *meanp = FLOAT2MFCC(*fmp);
+#endif
+        if (*fvarp < varfloor) {
+            *fvarp = varfloor;
+            ++floored;
+        }
+        *detp += (mfcc_t)logmath_log(lmath,
+                                     1.0 / sqrt(*fvarp * 2.0 * M_PI));
+        /* Precompute this part of the exponential */
+        *varp = (mfcc_t)logmath_ln_to_log(lmath,
+                                          (1.0 / (*fvarp * 2.0)));
+    }
+    return floored;
+}
+
 static int32
 gauden_dist_precompute(gauden_t * g, logmath_t *lmath, float32 varfloor)
 {
-    int32 i, m, f, d, flen;
-    mfcc_t *meanp;
-    mfcc_t *varp;
-    mfcc_t *detp;
+    int32 m, f, d;
     int32 floored;
 
     floored = 0;
@@ -324,36 +658,19 @@ gauden_dist_precompute(gauden_t * g, logmath_t *lmath, float32 varfloor)
 
     for (m = 0; m < g->n_mgau; m++) {
         for (f = 0; f < g->n_feat; f++) {
-            flen = g->featlen[f];
-
             /* Determinants for all variance vectors in g->[m][f] */
-            for (d = 0, detp = g->det[m][f]; d < g->n_density; d++, detp++) {
-                *detp = 0;
-                for (i = 0, varp = g->var[m][f][d], meanp = g->mean[m][f][d];
-                     i < flen; i++, varp++, meanp++) {
-                    float32 *fvarp = (float32 *)varp;
-
-#ifdef FIXED_POINT
-                    float32 *fmp = (float32 *)meanp;
-                    *meanp = FLOAT2MFCC(*fmp);
-#endif
-                    if (*fvarp < varfloor) {
-                        *fvarp = varfloor;
-                        ++floored;
-                    }
-                    *detp += (mfcc_t)logmath_log(lmath,
-                                                 1.0 / sqrt(*fvarp * 2.0 * M_PI));
-                    /* Precompute this part of the exponential */
-                    *varp = (mfcc_t)logmath_ln_to_log(lmath,
-                                                      (1.0 / (*fvarp * 2.0)));
-                }
-            }
+            for (d = 0; d < g->n_density; d++)
+                floored += gauden_precompute_density(lmath, varfloor,
+                                                     g->featlen[f],
+                                                     g->mean[m][f][d],
+                                                     g->var[m][f][d],
+                                                     &g->det[m][f][d]);
         }
     }
 
     E_INFO("%d variance values floored\n", floored);
 
-    return 0;
+    return gauden_block_init(g);
 }
 
 
@@ -395,59 +712,213 @@ gauden_init(char const *meanfile, char const *varfile, float32 varfloor, logmath
     return g;
 }
 
+/*
+ * Layout of the "gauden" section: n_mgau, n_feat, n_density, n_alloc
+ * and featlen[n_feat], then the precomputed means, precisions and
+ * determinants as in gauden_t, then the blocks for each codebook and
+ * feature, each of them aligned.
+ */
+gauden_t *
+gauden_init_bundle(model_bundle_t *b, logmath_t *lmath)
+{
+    int32 const *hdr;
+    char *p;
+    size_t size, need, n_param;
+    int32 i, m, f, blk;
+    gauden_t *g;
+
+    if ((hdr = model_bundle_get(b, "gauden", &size)) == NULL)
+        return NULL;
+    if (size < 4 * sizeof(*hdr)
+        || hdr[0] <= 0 || hdr[1] <= 0 || hdr[1] > 64 || hdr[2] <= 0
+        || hdr[3] != (hdr[2] + GMM_BLOCK_WIDTH - 1)
+        / GMM_BLOCK_WIDTH * GMM_BLOCK_WIDTH
+        || size < (4 + hdr[1]) * sizeof(*hdr))
+        goto invalid;
+    need = model_bundle_aligned((4 + hdr[1]) * sizeof(*hdr));
+    for (f = 0, blk = 0; f < hdr[1]; ++f) {
+        if (hdr[4 + f] <= 0)
+            goto invalid;
+        blk += hdr[4 + f];
+        need += hdr[0] * model_bundle_aligned((2 * hdr[4 + f] + 1)
+                                              * hdr[3] * sizeof(mfcc_t));
+    }
+    n_param = (size_t)hdr[0] * hdr[2] * blk;
+    need += 2 * model_bundle_aligned(n_param * sizeof(mfcc_t));
+    need += model_bundle_aligned((size_t)hdr[0] * hdr[1] * hdr[2]
+                                 * sizeof(mfcc_t));
+    if (size < need)
+        goto invalid;
+
+    g = (gauden_t *) ckd_calloc(1, sizeof(gauden_t));
+    g->lmath = lmath;
+    g->n_mgau = hdr[0];
+    g->n_feat = hdr[1];
+    g->n_density = hdr[2];
+    g->featlen = ckd_calloc(g->n_feat, sizeof(*g->featlen));
+    memcpy(g->featlen, hdr + 4, g->n_feat * sizeof(*g->featlen));
+    g->bundle = model_bundle_retain(b);
+
+    p = (char *)hdr + model_bundle_aligned((4 + g->n_feat) * sizeof(*hdr));
+    g->mean = gauden_param_index((mfcc_t *)p, g->n_mgau, g->n_feat,
+                                 g->n_density, g->featlen);
+    p += model_bundle_aligned(n_param * sizeof(mfcc_t));
+    g->var = gauden_param_index((mfcc_t *)p, g->n_mgau, g->n_feat,
+                                g->n_density, g->featlen);
+    p += model_bundle_aligned(n_param * sizeof(mfcc_t));
+    g->det = ckd_alloc_3d_ptr(g->n_mgau, g->n_feat, g->n_density,
+                              p, sizeof(mfcc_t));
+    p += model_bundle_aligned((size_t)g->n_mgau * g->n_feat * g->n_density
+                              * sizeof(mfcc_t));
+    g->block = (gmm_block_t ***)ckd_calloc_2d(g->n_mgau, g->n_feat,
+                                              sizeof(**g->block));
+    for (m = 0; m < g->n_mgau; m++) {
+        for (f = 0; f < g->n_feat; f++) {
+            g->block[m][f] = gmm_block_map((mfcc_t *)p, g->n_density,
+                                           g->featlen[f]);
+            p += model_bundle_aligned((2 * g->featlen[f] + 1)
+                                      * g->block[m][f]->n_alloc
+                                      * sizeof(mfcc_t));
+        }
+    }
+    g->dist = ckd_calloc(g->block[0][0]->n_alloc, sizeof(*g->dist));
+
+    E_INFO("Mapped %d codebook, %d feature, %d density Gaussians from %s\n",
+           g->n_mgau, g->n_feat, g->n_density, model_bundle_name(b));
+    for (i = 0; i < g->n_feat; i++)
+        E_INFO(" %dx%d\n", g->n_density, g->featlen[i]);
+    return g;
+
+invalid:
+    E_ERROR("Gaussian codebooks in %s are not valid\n", model_bundle_name(b));
+    return NULL;
+}
+
+int32
+gauden_write_bundle(gauden_t * g, model_bundle_writer_t *w)
+{
+    FILE *fh;
+    int32 hdr[4];
+    int32 m, f, blk;
+    size_t n_param;
+
+    if (g->mean == NULL) {
+        E_ERROR("Quantized Gaussians cannot be written to a model bundle\n");
+        return -1;
+    }
+    hdr[0] = g->n_mgau;
+    hdr[1] = g->n_feat;
+    hdr[2] = g->n_density;
+    hdr[3] = g->block[0][0]->n_alloc;
+    for (f = 0, blk = 0; f < g->n_feat; ++f)
+        blk += g->featlen[f];
+    n_param = (size_t)g->n_mgau * g->n_density * blk;
+
+    if ((fh = model_bundle_add(w, "gauden")) == NULL
+        || fwrite(hdr, sizeof(*hdr), 4, fh) != 4
+        || model_bundle_write_aligned(fh, g->featlen,
+                                      g->n_feat * sizeof(*g->featlen)) < 0
+        || model_bundle_write_aligned(fh, g->mean[0][0][0],
+                                      n_param * sizeof(mfcc_t)) < 0
+        || model_bundle_write_aligned(fh, g->var[0][0][0],
+                                      n_param * sizeof(mfcc_t)) < 0
+        || model_bundle_write_aligned(fh, g->det[0][0],
+                                      (size_t)g->n_mgau * g->n_feat
+                                      * g->n_density * sizeof(mfcc_t)) < 0)
+        return -1;
+    for (m = 0; m < g->n_mgau; m++) {
+        for (f = 0; f < g->n_feat; f++) {
+            gmm_block_t *block = g->block[m][f];
+
+            if (model_bundle_write_aligned(fh, block->mean,
+                                           (2 * block->featlen + 1)
+                                           * block->n_alloc
+                                           * sizeof(mfcc_t)) < 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
 void
 gauden_free(gauden_t * g)
 {
     if (g == NULL)
         return;
-    if (g->mean)
-        gauden_param_free(g->mean);
-    if (g->var)
-        gauden_param_free(g->var);
-    if (g->det)
-        ckd_free_3d(g->det);
+    gauden_param_release(g);
+    gauden_block_free(g);
+    model_bundle_free(g->bundle);
+    if (!g->mllr_copy)
+        kd_trees_free(g->kdtree, g->n_mgau * g->n_feat);
+    if (g->orig_mean)
+        gauden_param_free((mfcc_t ****)g->orig_mean);
+    if (g->orig_var)
+        gauden_param_free((mfcc_t ****)g->orig_var);
     if (g->featlen)
         ckd_free(g->featlen);
     ckd_free(g);
 }
 
+int32
+gauden_load_kdtrees(gauden_t * g, char const *file,
+                    int32 maxdepth, int32 maxbbi)
+{
+    kd_tree_t **trees;
+    int32 i, n_trees, n_leaf, n_bbi;
+
+    if ((trees = kd_trees_read(file, &n_trees, maxdepth, maxbbi)) == NULL)
+        return -1;
+    if (n_trees != g->n_mgau * g->n_feat) {
+        E_ERROR("%s has %d kd-trees, expected %d\n",
+                file, n_trees, g->n_mgau * g->n_feat);
+        kd_trees_free(trees, n_trees);
+        return -1;
+    }
+    n_leaf = n_bbi = 0;
+    for (i = 0; i < n_trees; ++i) {
+        int32 j;
+
+        if (trees[i]->n_density != g->n_density
+            || trees[i]->n_comp != g->featlen[i % g->n_feat]) {
+            E_ERROR("kd-tree %d in %s does not match the codebook\n",
+                    i, file);
+            kd_trees_free(trees, n_trees);
+            return -1;
+        }
+        for (j = 0; j < (1 << trees[i]->n_level) - 1; ++j) {
+            kd_tree_node_t *node = &trees[i]->nodes[j];
+
+            /* Count the boxes where the search can stop. */
+            if (node->split_comp >= 0)
+                continue;
+            if (j == 0 || trees[i]->nodes[(j - 1) / 2].split_comp >= 0) {
+                ++n_leaf;
+                n_bbi += node->n_bbi;
+            }
+        }
+    }
+    E_INFO("Gaussian selection with %d kd-trees, %.1f of %d densities per box\n",
+           n_trees, (double)n_bbi / n_leaf, g->n_density);
+
+    kd_trees_free(g->kdtree, g->n_mgau * g->n_feat);
+    g->kdtree = trees;
+    return 0;
+}
+
 /* See compute_dist below */
 static int32
-compute_dist_all(gauden_dist_t * out_dist, mfcc_t* obs, int32 featlen,
-                 mfcc_t ** mean, mfcc_t ** var, mfcc_t * det,
+compute_dist_all(gauden_dist_t * out_dist, mfcc_t const *dist,
                  int32 n_density)
 {
-    int32 i, d;
+    int32 d;
 
     for (d = 0; d < n_density; ++d) {
-        mfcc_t *m;
-        mfcc_t *v;
-        mfcc_t dval;
-
-        m = mean[d];
-        v = var[d];
-        dval = det[d];
-
-        for (i = 0; i < featlen; i++) {
-            mfcc_t diff;
 #ifdef FIXED_POINT
-            /* Have to check for underflows here. */
-            mfcc_t pdval = dval;
-            diff = obs[i] - m[i];
-            dval -= MFCCMUL(MFCCMUL(diff, diff), v[i]);
-            if (dval > pdval) {
-                dval = WORST_SCORE;
-                break;
-            }
+        /* Underflows are saturated by gmm_block_eval(). */
+        out_dist[d].dist = (dist[d] == INT_MIN) ? WORST_SCORE : dist[d];
 #else
-            diff = obs[i] - m[i];
-            /* The compiler really likes this to be a single
-             * expression, for whatever reason. */
-            dval -= diff * diff * v[i];
+        out_dist[d].dist = dist[d];
 #endif
-        }
-
-        out_dist[d].dist = dval;
         out_dist[d].id = d;
     }
 
@@ -461,51 +932,49 @@ compute_dist_all(gauden_dist_t * out_dist, mfcc_t* obs, int32 featlen,
  */
 static int32
 compute_dist(gauden_dist_t * out_dist, int32 n_top,
-             mfcc_t * obs, int32 featlen,
-             mfcc_t ** mean, mfcc_t ** var, mfcc_t * det,
-             int32 n_density)
+             mfcc_t * obs, gmm_block_t const *block,
+             kd_tree_t const *kdtree, mfcc_t * dist)
 {
-    int32 i, j, d;
+    int32 i, j, k, d, n_dist;
+    uint16 const *ids = NULL;
     gauden_dist_t *worst;
 
-    /* Special case optimization when n_density <= n_top */
-    if (n_top >= n_density)
-        return (compute_dist_all
-                (out_dist, obs, featlen, mean, var, det, n_density));
+    /* Compute only the densities in the box of the observation,
+     * unless there are too few of them to choose from. */
+    if (kdtree && n_top < block->n_density) {
+        kd_tree_node_t const *node = kd_tree_find(kdtree, obs);
+        if (node->n_bbi >= n_top) {
+            ids = node->bbi;
+            n_dist = node->n_bbi;
+            gmm_block_eval_list(block, obs, ids, n_dist, dist);
+        }
+    }
+
+    if (ids == NULL) {
+        /* Compute all densities at once, which is faster than trying
+         * to stop early for each of them. */
+        gmm_block_eval(block, obs, dist);
+        n_dist = block->n_density;
+
+        /* Special case optimization when n_density <= n_top */
+        if (n_top >= block->n_density)
+            return compute_dist_all(out_dist, dist, block->n_density);
+    }
 
     for (i = 0; i < n_top; i++)
         out_dist[i].dist = WORST_DIST;
     worst = &(out_dist[n_top - 1]);
 
-    for (d = 0; d < n_density; d++) {
-        mfcc_t *m;
-        mfcc_t *v;
-        mfcc_t dval;
+    for (k = 0; k < n_dist; k++) {
+        mfcc_t dval = dist[k];
 
-        m = mean[d];
-        v = var[d];
-        dval = det[d];
+        d = ids ? ids[k] : k;
 
-        for (i = 0; (i < featlen) && (dval >= worst->dist); i++) {
-            mfcc_t diff;
 #ifdef FIXED_POINT
-            /* Have to check for underflows here. */
-            mfcc_t pdval = dval;
-            diff = obs[i] - m[i];
-            dval -= MFCCMUL(MFCCMUL(diff, diff), v[i]);
-            if (dval > pdval) {
-                dval = WORST_SCORE;
-                break;
-            }
-#else
-            diff = obs[i] - m[i];
-            /* The compiler really likes this to be a single
-             * expression, for whatever reason. */
-            dval -= diff * diff * v[i];
+        if (dval == INT_MIN)    /* Underflow */
+            continue;
 #endif
-        }
-
-        if ((i < featlen) || (dval < worst->dist))     /* Codeword d worse than worst */
+        if (dval < worst->dist)     /* Codeword d worse than worst */
             continue;
 
         /* Codeword d at least as good as worst so far; insert in the ordered list */
@@ -529,16 +998,23 @@ compute_dist(gauden_dist_t * out_dist, int32 n_top,
 int32
 gauden_dist(gauden_t * g,
             int mgau, int32 n_top, mfcc_t** obs, gauden_dist_t ** out_dist)
+{
+    return gauden_dist_r(g, mgau, n_top, obs, out_dist, g->dist);
+}
+
+int32
+gauden_dist_r(gauden_t * g,
+              int mgau, int32 n_top, mfcc_t** obs, gauden_dist_t ** out_dist,
+              mfcc_t *dist)
 {
     int32 f;
 
     assert((n_top > 0) && (n_top <= g->n_density));
 
     for (f = 0; f < g->n_feat; f++) {
-        compute_dist(out_dist[f], n_top,
-                     obs[f], g->featlen[f],
-                     g->mean[mgau][f], g->var[mgau][f], g->det[mgau][f],
-                     g->n_density);
+        compute_dist(out_dist[f], n_top, obs[f], g->block[mgau][f],
+                     g->kdtree ? g->kdtree[mgau * g->n_feat + f] : NULL,
+                     dist);
         E_DEBUG(3, ("Top CW(%d,%d) = %d %d\n", mgau, f, out_dist[f][0].id,
                     (int)out_dist[f][0].dist >> SENSCR_SHIFT));
     }
@@ -546,72 +1022,296 @@ gauden_dist(gauden_t * g,
     return 0;
 }
 
-int32
-gauden_mllr_transform(gauden_t *g, ps_mllr_t *mllr, cmd_ln_t *config)
+
+/*
+ * Number of outputs of the MLLR rotation computed together by
+ * gauden_mllr_mean(), one per vector lane.  Needs GCC vector
+ * extensions with conversions.
+ */
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_convertvector)
+#define GAUDEN_MLLR_VEC 4
+typedef float32 gauden_mllr_vec_t
+    __attribute__((vector_size(GAUDEN_MLLR_VEC * sizeof(float32)),
+                   aligned(sizeof(float32))));
+typedef float64 gauden_mllr_acc_t
+    __attribute__((vector_size(GAUDEN_MLLR_VEC * sizeof(float64)),
+                   aligned(sizeof(float64))));
+#endif
+#endif
+#ifndef GAUDEN_MLLR_VEC
+#define GAUDEN_MLLR_VEC 1
+#endif
+
+/* MLLR transform of all Gaussians, split among threads by density. */
+typedef struct gauden_mllr_job_s {
+    gauden_t *g;
+    ps_mllr_t *mllr;
+    float32 **rot;      /**< Transposed rotation for each feature stream,
+                           rot[f][m * n_pad + l] = A[f][0][l][m] */
+    int32 max_pad;      /**< Longest feature stream, rounded up to vectors */
+    float32 varfloor;
+    int32 *floored;     /**< Number of variances floored by each part */
+} gauden_mllr_job_t;
+
+static int32
+gauden_mllr_pad(int32 flen)
 {
-    int32 i, m, f, d, *flen;
-    float32 ****fgau;
+    return (flen + GAUDEN_MLLR_VEC - 1) / GAUDEN_MLLR_VEC * GAUDEN_MLLR_VEC;
+}
 
-    /* Free data if already here */
-    if (g->mean)
-        gauden_param_free(g->mean);
-    if (g->var)
-        gauden_param_free(g->var);
-    if (g->det)
-        ckd_free_3d(g->det);
-    if (g->featlen)
-        ckd_free(g->featlen);
-    g->mean = NULL;
-    g->var = NULL;
-    g->det = NULL;
-    g->featlen = NULL;
+/*
+ * Transform one mean vector.  Float products are added in double
+ * precision in the same order as when it was done one output at a
+ * time, so the results are the same, several outputs at a time.
+ */
+static void
+gauden_mllr_mean(float32 const *rot, float32 const *bias, int32 flen,
+                 float32 const *in, float32 *out, float64 *temp)
+{
+    int32 l, m, n_pad;
+
+    n_pad = gauden_mllr_pad(flen);
+    for (l = 0; l < n_pad; l++)
+        temp[l] = 0.0;
+    for (m = 0; m < flen; m++) {
+        float32 const *r = rot + m * n_pad;
+#if GAUDEN_MLLR_VEC > 1
+        for (l = 0; l < n_pad; l += GAUDEN_MLLR_VEC)
+            *(gauden_mllr_acc_t *)(temp + l)
+                += __builtin_convertvector(*(gauden_mllr_vec_t const *)(r + l)
+                                           * in[m], gauden_mllr_acc_t);
+#else
+        for (l = 0; l < flen; l++)
+            temp[l] += r[l] * in[m];
+#endif
+    }
+    for (l = 0; l < flen; l++) {
+        temp[l] += bias[l];
+        out[l] = (float32) temp[l];
+    }
+}
 
-    /* Reload means and variances (un-precomputed). */
-    fgau = NULL;
-    gauden_param_read(&fgau, &g->n_mgau, &g->n_feat, &g->n_density,
-                      &g->featlen, cmd_ln_str_r(config, "-mean"));
-    g->mean = (mfcc_t ****)fgau;
-    fgau = NULL;
-    gauden_param_read(&fgau, &m, &f, &d, &flen, cmd_ln_str_r(config, "-var"));
-    g->var = (mfcc_t ****)fgau;
+/*
+ * Transform the Gaussians in one part of the codebooks and densities
+ * (or copy them if there is no transform), and precompute them while
+ * they are in cache.
+ */
+static void
+gauden_mllr_part(void *arg, int part, int n_part)
+{
+    gauden_mllr_job_t *job = arg;
+    gauden_t *g = job->g;
+    ps_mllr_t *mllr = job->mllr;
+    float64 *temp;
+    int32 n_item, item, end, i, f, d, l;
+
+    temp = ckd_calloc(job->max_pad, sizeof(*temp));
+    n_item = g->n_mgau * g->n_density;
+    end = n_item * (part + 1) / n_part;
+    for (item = n_item * part / n_part; item < end; item++) {
+        i = item / g->n_density;
+        d = item % g->n_density;
+        for (f = 0; f < g->n_feat; f++) {
+            float32 *mean = (float32 *)g->mean[i][f][d];
+            float32 *var = (float32 *)g->var[i][f][d];
+
+            if (mllr) {
+                /* FIXME: For now, only one class, hence the zeros below. */
+                gauden_mllr_mean(job->rot[f], mllr->b[f][0], g->featlen[f],
+                                 g->orig_mean[i][f][d], mean, temp);
+                for (l = 0; l < g->featlen[f]; l++)
+                    var[l] = g->orig_var[i][f][d][l] * mllr->h[f][0][l];
+            }
+            else {
+                memcpy(mean, g->orig_mean[i][f][d],
+                       g->featlen[f] * sizeof(*mean));
+                memcpy(var, g->orig_var[i][f][d],
+                       g->featlen[f] * sizeof(*var));
+            }
+            job->floored[part] +=
+                gauden_precompute_density(g->lmath, job->varfloor,
+                                          g->featlen[f], g->mean[i][f][d],
+                                          g->var[i][f][d], &g->det[i][f][d]);
+        }
+    }
+    ckd_free(temp);
+}
 
-    /* Verify mean and variance parameter dimensions */
-    if ((m != g->n_mgau) || (f != g->n_feat) || (d != g->n_density))
+/* Allocate parameters laid out like those read by gauden_param_read(). */
+static mfcc_t ****
+gauden_param_alloc(gauden_t * g)
+{
+    int32 f, blk;
+
+    for (f = 0, blk = 0; f < g->n_feat; f++)
+        blk += g->featlen[f];
+    return gauden_param_index(ckd_calloc((size_t)g->n_mgau * g->n_density
+                                         * blk, sizeof(mfcc_t)),
+                              g->n_mgau, g->n_feat, g->n_density, g->featlen);
+}
+
+/* Read the unadapted parameters, if not done already. */
+static int32
+gauden_mllr_read_orig(gauden_t * g, cmd_ln_t *config)
+{
+    float32 ****mean, ****var;
+    int32 m, f, d, i, *mlen, *vlen;
+
+    if (g->orig_mean)
+        return 0;
+    if (cmd_ln_str_r(config, "-mean") == NULL
+        || cmd_ln_str_r(config, "-var") == NULL) {
+        E_ERROR("MLLR transform needs -mean and -var\n");
+        return -1;
+    }
+    mean = var = NULL;
+    gauden_param_read(&mean, &m, &f, &d, &mlen, cmd_ln_str_r(config, "-mean"));
+    if (m != g->n_mgau || f != g->n_feat || d != g->n_density) {
+        E_ERROR("Means in %s do not match the acoustic model\n",
+                cmd_ln_str_r(config, "-mean"));
+        gauden_param_free((mfcc_t ****)mean);
+        ckd_free(mlen);
+        return -1;
+    }
+    gauden_param_read(&var, &m, &f, &d, &vlen, cmd_ln_str_r(config, "-var"));
+    if (m != g->n_mgau || f != g->n_feat || d != g->n_density)
         E_FATAL
             ("Mixture-gaussians dimensions for means and variances differ\n");
-    for (i = 0; i < g->n_feat; i++)
-        if (g->featlen[i] != flen[i])
+    for (i = 0; i < g->n_feat; i++) {
+        if (mlen[i] != vlen[i])
             E_FATAL("Feature lengths for means and variances differ\n");
-    ckd_free(flen);
-
-    /* Transform codebook for each stream s */
-    for (i = 0; i < g->n_mgau; ++i) {
-        for (f = 0; f < g->n_feat; ++f) {
-            float64 *temp;
-            temp = (float64 *) ckd_calloc(g->featlen[f], sizeof(float64));
-            /* Transform each density d in selected codebook */
-            for (d = 0; d < g->n_density; d++) {
-                int l;
-                for (l = 0; l < g->featlen[f]; l++) {
-                    temp[l] = 0.0;
-                    for (m = 0; m < g->featlen[f]; m++) {
-                        /* FIXME: For now, only one class, hence the zeros below. */
-                        temp[l] += mllr->A[f][0][l][m] * g->mean[i][f][d][m];
-                    }
-                    temp[l] += mllr->b[f][0][l];
-                }
+        if (mlen[i] != g->featlen[i]) {
+            E_ERROR("Means in %s do not match the acoustic model\n",
+                    cmd_ln_str_r(config, "-mean"));
+            gauden_param_free((mfcc_t ****)mean);
+            gauden_param_free((mfcc_t ****)var);
+            ckd_free(mlen);
+            ckd_free(vlen);
+            return -1;
+        }
+    }
+    ckd_free(mlen);
+    ckd_free(vlen);
+    g->orig_mean = mean;
+    g->orig_var = var;
+    return 0;
+}
 
-                for (l = 0; l < g->featlen[f]; l++) {
-                    g->mean[i][f][d][l] = (float32) temp[l];
-                    g->var[i][f][d][l] *= mllr->h[f][0][l];
-                }
+int32
+gauden_mllr_transform(gauden_t *g, ps_mllr_t *mllr, cmd_ln_t *config,
+                      thread_pool_t *pool)
+{
+    gauden_mllr_job_t job;
+    int32 f, l, m, n_part, floored;
+
+    if (mllr) {
+        if (mllr->n_feat != g->n_feat) {
+            E_ERROR("MLLR transform has %d feature streams, model has %d\n",
+                    mllr->n_feat, g->n_feat);
+            return -1;
+        }
+        for (f = 0; f < g->n_feat; f++) {
+            if (mllr->veclen[f] != g->featlen[f]) {
+                E_ERROR("MLLR transform stream %d has length %d, model has %d\n",
+                        f, mllr->veclen[f], g->featlen[f]);
+                return -1;
             }
-            ckd_free(temp);
         }
     }
+    if (gauden_mllr_read_orig(g, config) < 0)
+        return -1;
+
+    /* Parameters from a model bundle, quantized ones, or none at all
+     * (in a copy) are replaced with our own, otherwise they are
+     * overwritten. */
+    gauden_block_free(g);
+    if (g->bundle || g->mean == NULL || g->var == NULL) {
+        gauden_param_release(g);
+        model_bundle_free(g->bundle);
+        g->bundle = NULL;
+        g->mean = gauden_param_alloc(g);
+        g->var = gauden_param_alloc(g);
+    }
+    else if (g->det) {
+        ckd_free_3d(g->det);
+    }
+    g->det = ckd_calloc_3d(g->n_mgau, g->n_feat, g->n_density,
+                           sizeof(***g->det));
+
+    job.g = g;
+    job.mllr = mllr;
+    job.varfloor = cmd_ln_float32_r(config, "-varfloor");
+    job.max_pad = 0;
+    job.rot = ckd_calloc(g->n_feat, sizeof(*job.rot));
+    for (f = 0; f < g->n_feat; f++) {
+        int32 n_pad = gauden_mllr_pad(g->featlen[f]);
+
+        if (n_pad > job.max_pad)
+            job.max_pad = n_pad;
+        if (mllr == NULL)
+            continue;
+        job.rot[f] = ckd_calloc(g->featlen[f] * n_pad, sizeof(**job.rot));
+        for (m = 0; m < g->featlen[f]; m++)
+            for (l = 0; l < g->featlen[f]; l++)
+                job.rot[f][m * n_pad + l] = mllr->A[f][0][l][m];
+    }
+    n_part = pool ? thread_pool_size(pool) + 1 : 1;
+    job.floored = ckd_calloc(n_part, sizeof(*job.floored));
+    if (pool)
+        thread_pool_run(pool, gauden_mllr_part, &job);
+    else
+        gauden_mllr_part(&job, 0, 1);
+
+    for (f = 0, floored = 0; f < n_part; f++)
+        floored += job.floored[f];
+    E_INFO("%d variance values floored\n", floored);
+    for (f = 0; f < g->n_feat; f++)
+        ckd_free(job.rot[f]);
+    ckd_free(job.rot);
+    ckd_free(job.floored);
+
+    return gauden_block_init(g);
+}
+
+gauden_t *
+gauden_mllr_copy(gauden_t *g)
+{
+    gauden_t *copy;
+
+    copy = (gauden_t *) ckd_calloc(1, sizeof(gauden_t));
+    copy->lmath = g->lmath;
+    copy->n_mgau = g->n_mgau;
+    copy->n_feat = g->n_feat;
+    copy->n_density = g->n_density;
+    copy->featlen = ckd_calloc(g->n_feat, sizeof(*copy->featlen));
+    memcpy(copy->featlen, g->featlen, g->n_feat * sizeof(*copy->featlen));
+    copy->bits = g->bits;
+    copy->kdtree = g->kdtree;
+    copy->mllr_copy = TRUE;
+    return copy;
+}
+
+int32
+gauden_mllr_transform_shared(gauden_t **inout_g, gauden_t *base,
+                             ps_mllr_t *mllr, cmd_ln_t *config,
+                             thread_pool_t *pool)
+{
+    gauden_t *g = *inout_g;
 
-    /* Re-precompute (if we aren't adapting variances this isn't
-     * actually necessary...) */
-    gauden_dist_precompute(g, g->lmath, cmd_ln_float32_r(config, "-varfloor"));
+    if (mllr == NULL) {
+        if (g != base)
+            gauden_free(g);
+        *inout_g = base;
+        return 0;
+    }
+    if (g == base)
+        g = gauden_mllr_copy(base);
+    if (gauden_mllr_transform(g, mllr, config, pool) < 0) {
+        if (g != *inout_g)
+            gauden_free(g);
+        return -1;
+    }
+    *inout_g = g;
     return 0;
 }
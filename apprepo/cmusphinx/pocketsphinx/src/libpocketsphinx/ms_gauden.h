@@ -59,6 +59,10 @@
 #include "vector.h"
 #include "pocketsphinx_internal.h"
 #include "hmm.h"
+#include "gmm_kernel.h"
+#include "kdtree.h"
+#include "model_bundle.h"
+#include "thread_pool.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -83,7 +87,8 @@ typedef struct {
  * \brief Multivariate gaussian mixture density parameters
  */
 typedef struct {
-    mfcc_t ****mean;	/**< mean[codebook][feature][codeword] vector */
+    mfcc_t ****mean;	/**< mean[codebook][feature][codeword] vector,
+                           NULL if quantized */
     mfcc_t ****var;	/**< like mean; diagonal covariance vector only */
     mfcc_t ***det;	/**< log(determinant) for each variance vector;
 			   actually, log(sqrt(2*pi*det)) */
@@ -92,6 +97,19 @@ typedef struct {
     int32 n_feat;	/**< Number feature streams in each codebook */
     int32 n_density;	/**< Number gaussian densities in each codebook-feature stream */
     int32 *featlen;	/**< feature length for each feature */
+    gmm_block_t ***block; /**< block[codebook][feature], copy of the above
+                             laid out for gmm_block_eval() */
+    mfcc_t *dist;       /**< Scratch space for gmm_block_eval() */
+    int32 bits;         /**< Bits per parameter in block, 0 if not quantized */
+    kd_tree_t **kdtree; /**< kdtree[codebook * n_feat + feature] for
+                           Gaussian selection, or NULL */
+    model_bundle_t *bundle; /**< Model bundle holding the parameters
+                               and blocks (if any) */
+    float32 ****orig_mean; /**< Unadapted means, kept by
+                              gauden_mllr_transform() (or NULL) */
+    float32 ****orig_var; /**< Unadapted variances, likewise */
+    int32 mllr_copy;    /**< Created by gauden_mllr_copy(), sharing the
+                           kd-trees of the original */
 } gauden_t;
 
 
@@ -108,11 +126,95 @@ gauden_init (char const *meanfile,/**< Input: File containing means of mixture g
              logmath_t *lmath
     );
 
+/**
+ * Get precomputed codebooks from a model bundle.  Parameters and
+ * blocks are used in place.
+ * @return NULL if the bundle has none.
+ */
+gauden_t *gauden_init_bundle(model_bundle_t *b, logmath_t *lmath);
+
+/**
+ * Add precomputed codebooks to a model bundle.
+ * @return 0 if successful, -1 otherwise (including if quantized).
+ */
+int32 gauden_write_bundle(gauden_t *g, model_bundle_writer_t *w);
+
 /** Release memory allocated by gauden_init. */
 void gauden_free(gauden_t *g); /**< In: The gauden_t to free */
 
-/** Transform Gaussians according to an MLLR matrix (or, eventually, more). */
-int32 gauden_mllr_transform(gauden_t *s, ps_mllr_t *mllr, cmd_ln_t *config);
+/**
+ * Quantize means and precisions to 8 or 16 bits per value.  Only
+ * gauden_dist() and gauden_dist_r() can be used afterwards, as the
+ * floating point parameters in mean and var are released.
+ * @return 0 if successful, -1 otherwise (unsupported number of bits,
+ * precisions too large for a fixed-point build, or already quantized
+ * differently).
+ */
+int32 gauden_quantize(gauden_t *g, int bits);
+
+/**
+ * Write a quantized copy of a means or variances file, with 8 or 16
+ * bits per value and a scale and offset for each dimension of each
+ * codebook.  Such files can be read by gauden_init() like the
+ * original ones.
+ * @return 0 if successful, -1 otherwise.
+ */
+int32 gauden_param_quantize(char const *infile, /**< In: means or variances file */
+                            char const *outfile, /**< In: file to write */
+                            int bits,           /**< In: 8 or 16 */
+                            int logmap          /**< In: quantize the logarithm of
+                                                   the values (for variances) */
+    );
+
+/**
+ * Use kd-trees for Gaussian selection: only the densities listed in
+ * the box of the observation are computed, unless there are fewer of
+ * them than the number of top densities requested.
+ * @return 0 if successful, -1 otherwise (unreadable file, or trees
+ * not matching the codebooks).
+ */
+int32 gauden_load_kdtrees(gauden_t *g,
+                          char const *file, /**< In: file written by kd_trees_write() */
+                          int32 maxdepth, /**< In: depth at which to stop the search,
+                                             0 for the whole trees */
+                          int32 maxbbi    /**< In: maximum number of densities
+                                             computed, -1 for no limit */
+    );
+
+/**
+ * Transform Gaussians according to an MLLR matrix (or, eventually,
+ * more).  The unadapted parameters are read from the -mean and -var
+ * files the first time and kept, so that switching to another
+ * transform does not read them again, and no transform restores them.
+ * @return 0 if successful, -1 otherwise (in which case g is unchanged).
+ */
+int32 gauden_mllr_transform(gauden_t *g,
+                            ps_mllr_t *mllr, /**< In: transform, or NULL */
+                            cmd_ln_t *config,
+                            thread_pool_t *pool /**< In: threads to split the
+                                                   work with, or NULL */
+    );
+
+/**
+ * Create a copy of g with no parameters, to be adapted with
+ * gauden_mllr_transform() without modifying g, which other models may
+ * be using.  Only its kd-trees are shared.
+ */
+gauden_t *gauden_mllr_copy(gauden_t *g);
+
+/**
+ * Adapt the Gaussians of a model which shares those of another one.
+ * They are replaced with an adapted copy of base the first time, and
+ * with base again if there is no transform.
+ * @return 0 if successful, -1 otherwise (in which case *inout_g is
+ * unchanged).
+ */
+int32 gauden_mllr_transform_shared(gauden_t **inout_g, /**< In/Out: Gaussians in use */
+                                   gauden_t *base, /**< In: Gaussians of the
+                                                      original model */
+                                   ps_mllr_t *mllr,
+                                   cmd_ln_t *config,
+                                   thread_pool_t *pool);
 
 /**
  * Compute gaussian density values for the given input observation vector wrt the
@@ -133,6 +235,21 @@ gauden_dist (gauden_t *g,	/**< In: handle to entire ensemble of codebooks */
 		Caller must allocate memory for this output */
     );
 
+/**
+ * Same as gauden_dist(), but using the given scratch space instead of
+ * the one in g, so that different codebooks can be evaluated by
+ * different threads at the same time.
+ */
+int32
+gauden_dist_r (gauden_t *g,	/**< In: handle to entire ensemble of codebooks */
+	       int mgau,	/**< In: codebook for which density values to be evaluated */
+	       int n_top,	/**< In: Number top densities to be evaluated */
+	       mfcc_t **obs,	/**< In: Observation vector; obs[f] = for feature f */
+	       gauden_dist_t **out_dist, /**< Out: as for gauden_dist() */
+	       mfcc_t *dist	/**< Scratch space, with room for the densities of one codebook
+				   (gauden_t::block[mgau][f]->n_alloc values) */
+    );
+
 /**
    Dump the definitionn of Gaussian distribution. 
 */
@@ -74,10 +74,53 @@
 static ps_mgaufuncs_t ms_mgau_funcs = {
     "ms",
     ms_cont_mgau_frame_eval, /* frame_eval */
+    ms_cont_mgau_frame_eval_block, /* frame_eval_block */
     ms_mgau_mllr_transform,  /* transform */
+    ms_mgau_copy,            /* copy */
+    ms_mgau_write_bundle,    /* write_bundle */
     ms_mgau_free             /* free */
 };
 
+/*
+ * Allocate the scratch space used to evaluate the model, which is
+ * private to each copy.
+ */
+static void
+ms_mgau_alloc_state(ms_mgau_model_t *msg)
+{
+    gauden_t *g = msg->g;
+    cmd_ln_t *config = msg->config;
+    int i;
+
+    msg->n_blk_alloc = cmd_ln_int32_r(config, "-scoreblock");
+    if (msg->n_blk_alloc < 1)
+        msg->n_blk_alloc = 1;
+    msg->blk_dist = ckd_calloc(msg->n_blk_alloc, sizeof(*msg->blk_dist));
+    for (i = 0; i < msg->n_blk_alloc; ++i)
+        msg->blk_dist[i] = (gauden_dist_t ***)
+            ckd_calloc_3d(g->n_mgau, g->n_feat, msg->topn,
+                          sizeof(gauden_dist_t));
+    msg->dist = msg->blk_dist[0];
+    msg->mgau_active = ckd_calloc(g->n_mgau, sizeof(int8));
+
+    /* Split codebooks among threads if requested. */
+    msg->n_part = 1;
+    if (cmd_ln_int32_r(config, "-senthreads") > 1) {
+        /* Select the Gaussian kernel before the threads use it. */
+        E_INFO("Evaluating codebooks with %d threads and the %s kernel\n",
+               cmd_ln_int32_r(config, "-senthreads"), gmm_kernel_name());
+        msg->pool = thread_pool_init(config,
+                                     cmd_ln_int32_r(config, "-senthreads") - 1);
+        if (msg->pool)
+            msg->n_part = thread_pool_size(msg->pool) + 1;
+    }
+    msg->blk_best = (int32 **)ckd_calloc_2d(msg->n_part, msg->n_blk_alloc,
+                                            sizeof(**msg->blk_best));
+    msg->part_dist = (mfcc_t **)ckd_calloc_2d(msg->n_part,
+                                              g->block[0][0]->n_alloc,
+                                              sizeof(**msg->part_dist));
+}
+
 ps_mgau_t *
 ms_mgau_init(acmod_t *acmod, logmath_t *lmath, bin_mdef_t *mdef)
 {
@@ -96,10 +139,14 @@ ms_mgau_init(acmod_t *acmod, logmath_t *lmath, bin_mdef_t *mdef)
     msg->g = NULL;
     msg->s = NULL;
     
-    g = msg->g = gauden_init(cmd_ln_str_r(config, "-mean"),
+    if (acmod->bundle)
+        msg->g = gauden_init_bundle(acmod->bundle, lmath);
+    if (msg->g == NULL)
+        msg->g = gauden_init(cmd_ln_str_r(config, "-mean"),
                              cmd_ln_str_r(config, "-var"),
                              cmd_ln_float32_r(config, "-varfloor"),
                              lmath);
+    g = msg->g;
 
     /* Verify n_feat and veclen, against acmod. */
     if (g->n_feat != feat_dimension1(acmod->fcb)) {
@@ -115,7 +162,19 @@ ms_mgau_init(acmod_t *acmod, logmath_t *lmath, bin_mdef_t *mdef)
         }
     }
 
-    s = msg->s = senone_init(msg->g,
+    /* Keep only quantized means and precisions if requested. */
+    if (cmd_ln_int32_r(config, "-gquant")
+        && gauden_quantize(g, cmd_ln_int32_r(config, "-gquant")) < 0)
+        goto error_out;
+
+    /* Compute only some of the densities of each codebook. */
+    if (cmd_ln_str_r(config, "-kdtree")
+        && gauden_load_kdtrees(g, cmd_ln_str_r(config, "-kdtree"),
+                               cmd_ln_int32_r(config, "-kdmaxdepth"),
+                               cmd_ln_int32_r(config, "-kdmaxbbi")) < 0)
+        goto error_out;
+
+    s = msg->s = senone_init(msg->g, acmod->bundle,
                              cmd_ln_str_r(config, "-mixw"),
                              cmd_ln_str_r(config, "-senmgau"),
                              cmd_ln_float32_r(config, "-mixwfloor"),
@@ -146,19 +205,36 @@ ms_mgau_init(acmod_t *acmod, logmath_t *lmath, bin_mdef_t *mdef)
         msg->topn = msg->g->n_density;
     }
 
-    msg->dist = (gauden_dist_t ***)
-        ckd_calloc_3d(g->n_mgau, g->n_feat, msg->topn,
-                      sizeof(gauden_dist_t));
-    msg->mgau_active = ckd_calloc(g->n_mgau, sizeof(int8));
+    ms_mgau_alloc_state(msg);
 
     mg = (ps_mgau_t *)msg;
     mg->vt = &ms_mgau_funcs;
+    mg->refcount = 1;
     return mg;
 error_out:
     ms_mgau_free(ps_mgau_base(msg));
     return NULL;    
 }
 
+ps_mgau_t *
+ms_mgau_copy(ps_mgau_t *mg, acmod_t *acmod)
+{
+    ms_mgau_model_t *other = (ms_mgau_model_t *)mg;
+    ms_mgau_model_t *msg;
+
+    msg = (ms_mgau_model_t *) ckd_calloc(1, sizeof(ms_mgau_model_t));
+    msg->config = acmod->config;
+    msg->g = other->g;
+    msg->s = other->s;
+    msg->topn = other->topn;
+    ms_mgau_alloc_state(msg);
+
+    msg->base.vt = &ms_mgau_funcs;
+    msg->base.refcount = 1;
+    msg->base.shared = ps_mgau_retain(mg);
+    return ps_mgau_base(msg);
+}
+
 void
 ms_mgau_free(ps_mgau_t * mg)
 {
@@ -166,24 +242,54 @@ ms_mgau_free(ps_mgau_t * mg)
     if (msg == NULL)
         return;
 
-    if (msg->g)
-	gauden_free(msg->g);
-    if (msg->s)
-        senone_free(msg->s);
-    if (msg->dist)
-        ckd_free_3d((void *) msg->dist);
+    /* Parameters belong to the original model in copies. */
+    if (mg->shared == NULL) {
+        if (msg->g)
+            gauden_free(msg->g);
+        if (msg->s)
+            senone_free(msg->s);
+    }
+    else if (msg->g != ((ms_mgau_model_t *)mg->shared)->g) {
+        gauden_free(msg->g);
+    }
+    if (msg->blk_dist) {
+        int32 i;
+        for (i = 0; i < msg->n_blk_alloc; ++i)
+            ckd_free_3d((void *) msg->blk_dist[i]);
+        ckd_free(msg->blk_dist);
+    }
+    thread_pool_free(msg->pool);
+    ckd_free_2d(msg->blk_best);
+    ckd_free_2d(msg->part_dist);
     if (msg->mgau_active)
         ckd_free(msg->mgau_active);
+    ps_mgau_free(mg->shared);
     
     ckd_free(msg);
 }
 
+int
+ms_mgau_write_bundle(ps_mgau_t *mg, model_bundle_writer_t *w)
+{
+    ms_mgau_model_t *msg = (ms_mgau_model_t *)mg;
+
+    if (gauden_write_bundle(msg->g, w) < 0)
+        return -1;
+    return senone_write_bundle(msg->s, w);
+}
+
 int
 ms_mgau_mllr_transform(ps_mgau_t *s,
 		       ps_mllr_t *mllr)
 {
     ms_mgau_model_t *msg = (ms_mgau_model_t *)s;
-    return gauden_mllr_transform(msg->g, mllr, msg->config);
+
+    /* Copies adapt a copy of the original Gaussians. */
+    if (s->shared)
+        return gauden_mllr_transform_shared(&msg->g,
+                                            ((ms_mgau_model_t *)s->shared)->g,
+                                            mllr, msg->config, msg->pool);
+    return gauden_mllr_transform(msg->g, mllr, msg->config, msg->pool);
 }
 
 int32
@@ -194,86 +300,154 @@ ms_cont_mgau_frame_eval(ps_mgau_t * mg,
                         mfcc_t ** feat,
 			int32 frame,
 			int32 compallsen)
+{
+    if (ms_cont_mgau_frame_eval_block(mg, &senscr, senone_active,
+                                      n_senone_active, &feat,
+                                      frame, 1, compallsen) < 0)
+        return -1;
+    return 0;
+}
+
+/*
+ * Normalize senone scores for one frame.
+ */
+static void
+ms_cont_mgau_norm(int16 *senscr, int32 best, uint8 *senone_active,
+                  int32 n_senone_active, int32 n_sen, int32 compallsen)
+{
+    int32 i, n;
+
+    n = 0;
+    for (i = 0; i < (compallsen ? n_sen : n_senone_active); i++) {
+        int32 s = compallsen ? i : senone_active[i] + n;
+        int32 bs = senscr[s] - best;
+        if (bs > 32767)
+            bs = 32767;
+        if (bs < -32768)
+            bs = -32768;
+        senscr[s] = bs;
+        n = s;
+    }
+}
+
+/* Arguments of ms_cont_mgau_frame_eval_block() for each part. */
+typedef struct ms_mgau_job_s {
+    ms_mgau_model_t *msg;
+    int16 **senscr;
+    uint8 *senone_active;
+    int32 n_senone_active;
+    mfcc_t ***feat;
+    int32 n_frame;
+    int32 compallsen;
+} ms_mgau_job_t;
+
+/*
+ * Evaluate the active codebooks in a range, and the active senones
+ * that use them, for all frames of a block.  Frames are evaluated one
+ * codebook (or senone) at a time, so that its parameters are read
+ * from memory only once for all of them.
+ */
+static void
+ms_cont_mgau_eval_part(void *arg, int part, int n_part)
+{
+    ms_mgau_job_t *job = (ms_mgau_job_t *)arg;
+    ms_mgau_model_t *msg = job->msg;
+    gauden_t *g = ms_mgau_gauden(msg);
+    senone_t *sen = ms_mgau_senone(msg);
+    int32 topn = ms_mgau_topn(msg);
+    int32 *best = msg->blk_best[part];
+    int32 gid, gid_start, gid_end, i, n, k;
+
+    gid_start = part * g->n_mgau / n_part;
+    gid_end = (part + 1) * g->n_mgau / n_part;
+
+    /* Compute topn gaussian density values (for active codebooks) */
+    for (gid = gid_start; gid < gid_end; gid++) {
+        if (!msg->mgau_active[gid])
+            continue;
+        for (k = 0; k < job->n_frame; ++k)
+            gauden_dist_r(g, gid, topn, job->feat[k], msg->blk_dist[k][gid],
+                          msg->part_dist[part]);
+    }
+
+    for (k = 0; k < job->n_frame; ++k)
+        best[k] = (int32) 0x7fffffff;
+    n = 0;
+    for (i = 0; i < (job->compallsen ? sen->n_sen : job->n_senone_active); i++) {
+        int32 s = job->compallsen ? i : job->senone_active[i] + n;
+        n = s;
+        if (sen->mgau[s] < gid_start || sen->mgau[s] >= gid_end)
+            continue;
+        for (k = 0; k < job->n_frame; ++k) {
+            int32 scr = senone_eval(sen, s, msg->blk_dist[k][sen->mgau[s]], topn);
+            job->senscr[k][s] = scr;
+            if (best[k] > scr)
+                best[k] = scr;
+        }
+    }
+}
+
+/*
+ * With -senthreads, codebooks are split in contiguous ranges, each of
+ * which is evaluated by a different thread together with the senones
+ * that use it, so that no thread has to wait for the others until
+ * the scores are normalized.
+ */
+int32
+ms_cont_mgau_frame_eval_block(ps_mgau_t * mg,
+                              int16 **senscr,
+                              uint8 *senone_active,
+                              int32 n_senone_active,
+                              mfcc_t *** feat,
+                              int32 frame,
+                              int32 n_frame,
+                              int32 compallsen)
 {
     ms_mgau_model_t *msg = (ms_mgau_model_t *)mg;
-    int32 gid;
-    int32 topn;
-    int32 best;
+    ms_mgau_job_t job;
+    int32 gid, i, n, k, p;
     gauden_t *g;
     senone_t *sen;
 
-    topn = ms_mgau_topn(msg);
     g = ms_mgau_gauden(msg);
     sen = ms_mgau_senone(msg);
+    if (n_frame > msg->n_blk_alloc)
+        n_frame = msg->n_blk_alloc;
 
-    if (compallsen) {
-	int32 s;
-
-	for (gid = 0; gid < g->n_mgau; gid++)
-	    gauden_dist(g, gid, topn, feat, msg->dist[gid]);
-
-	best = (int32) 0x7fffffff;
-	for (s = 0; s < sen->n_sen; s++) {
-	    senscr[s] = senone_eval(sen, s, msg->dist[sen->mgau[s]], topn);
-	    if (best > senscr[s]) {
-		best = senscr[s];
-	    }
-	}
-
-	/* Normalize senone scores */
-	for (s = 0; s < sen->n_sen; s++) {
-	    int32 bs = senscr[s] - best;
-	    if (bs > 32767)
-		bs = 32767;
-	    if (bs < -32768)
-		bs = -32768;
-	    senscr[s] = bs;
-	}
+    /* Flag all active mixture-gaussian codebooks */
+    for (gid = 0; gid < g->n_mgau; gid++)
+        msg->mgau_active[gid] = compallsen;
+    if (!compallsen) {
+        n = 0;
+        for (i = 0; i < n_senone_active; i++) {
+            /* senone_active consists of deltas. */
+            int32 s = senone_active[i] + n;
+            msg->mgau_active[sen->mgau[s]] = 1;
+            n = s;
+        }
     }
-    else {
-	int32 i, n;
-	/* Flag all active mixture-gaussian codebooks */
-	for (gid = 0; gid < g->n_mgau; gid++)
-	    msg->mgau_active[gid] = 0;
-
-	n = 0;
-	for (i = 0; i < n_senone_active; i++) {
-	    /* senone_active consists of deltas. */
-	    int32 s = senone_active[i] + n;
-	    msg->mgau_active[sen->mgau[s]] = 1;
-	    n = s;
-	}
-
-	/* Compute topn gaussian density values (for active codebooks) */
-	for (gid = 0; gid < g->n_mgau; gid++) {
-	    if (msg->mgau_active[gid])
-		gauden_dist(g, gid, topn, feat, msg->dist[gid]);
-	}
-
-	best = (int32) 0x7fffffff;
-	n = 0;
-	for (i = 0; i < n_senone_active; i++) {
-	    int32 s = senone_active[i] + n;
-	    senscr[s] = senone_eval(sen, s, msg->dist[sen->mgau[s]], topn);
-	    if (best > senscr[s]) {
-		best = senscr[s];
-	    }
-	    n = s;
-	}
-
-	/* Normalize senone scores */
-	n = 0;
-	for (i = 0; i < n_senone_active; i++) {
-	    int32 s = senone_active[i] + n;
-	    int32 bs = senscr[s] - best;
-	    if (bs > 32767)
-		bs = 32767;
-	    if (bs < -32768)
-		bs = -32768;
-	    senscr[s] = bs;
-	    n = s;
-	}
+
+    job.msg = msg;
+    job.senscr = senscr;
+    job.senone_active = senone_active;
+    job.n_senone_active = n_senone_active;
+    job.feat = feat;
+    job.n_frame = n_frame;
+    job.compallsen = compallsen;
+    if (msg->pool)
+        thread_pool_run(msg->pool, ms_cont_mgau_eval_part, &job);
+    else
+        ms_cont_mgau_eval_part(&job, 0, 1);
+
+    /* Normalize senone scores */
+    for (k = 0; k < n_frame; ++k) {
+        int32 best = msg->blk_best[0][k];
+        for (p = 1; p < msg->n_part; ++p)
+            if (best > msg->blk_best[p][k])
+                best = msg->blk_best[p][k];
+        ms_cont_mgau_norm(senscr[k], best, senone_active,
+                          n_senone_active, sen->n_sen, compallsen);
     }
 
-    return 0;
+    return n_frame;
 }
@@ -106,6 +106,7 @@
 #include "bin_mdef.h"
 #include "ms_gauden.h"
 #include "ms_senone.h"
+#include "thread_pool.h"
 
 /** \struct ms_mgau_t
     \brief Multi-stream mixture gaussian. It is not necessary to be continr
@@ -119,8 +120,15 @@ typedef struct {
 
     /**< Intermediate used in computation */
     gauden_dist_t ***dist;  
+    gauden_dist_t ****blk_dist; /**< dist for each frame of a block (blk_dist[0] == dist) */
+    int32 **blk_best;           /**< Best senone score for each part and frame of a block */
+    int32 n_blk_alloc;          /**< Number of frames allocated in blk_dist */
     uint8 *mgau_active;
     cmd_ln_t *config;
+
+    thread_pool_t *pool;        /**< Threads evaluating codebooks (or NULL) */
+    int32 n_part;               /**< Number of parts codebooks are split in */
+    mfcc_t **part_dist;         /**< Density scratch space for each part */
 } ms_mgau_model_t;  
 
 #define ms_mgau_gauden(msg) (msg->g)
@@ -128,6 +136,7 @@ typedef struct {
 #define ms_mgau_topn(msg) (msg->topn)
 
 ps_mgau_t* ms_mgau_init(acmod_t *acmod, logmath_t *lmath, bin_mdef_t *mdef);
+ps_mgau_t *ms_mgau_copy(ps_mgau_t *g, acmod_t *acmod);
 void ms_mgau_free(ps_mgau_t *g);
 int32 ms_cont_mgau_frame_eval(ps_mgau_t * msg,
                               int16 *senscr,
@@ -136,6 +145,15 @@ int32 ms_cont_mgau_frame_eval(ps_mgau_t * msg,
                               mfcc_t ** feat,
                               int32 frame,
                               int32 compallsen);
+int32 ms_cont_mgau_frame_eval_block(ps_mgau_t * msg,
+                                    int16 **senscr,
+                                    uint8 *senone_active,
+                                    int32 n_senone_active,
+                                    mfcc_t *** feat,
+                                    int32 frame,
+                                    int32 n_frame,
+                                    int32 compallsen);
+int ms_mgau_write_bundle(ps_mgau_t *g, model_bundle_writer_t *w);
 int32 ms_mgau_mllr_transform(ps_mgau_t *s,
                              ps_mllr_t *mllr);
 
@@ -38,6 +38,8 @@
 /* System headers. */
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
 #include <assert.h>
 
 /* SphinxBase headers. */
@@ -50,6 +52,9 @@
 #define MIXW_PARAM_VERSION	"1.0"
 #define SPDEF_PARAM_VERSION	"1.2"
 
+/* Number of codeword scores given to logmath_add_n() at once. */
+#define SENONE_TOPN_CHUNK 64
+
 #if defined(__STDC_VERSION__) && (__STDC_VERSION__ == 199901L)
 #define LOGMATH_INLINE inline
 #elif defined(__GNUC__)
@@ -151,9 +156,11 @@ senone_mixw_read(senone_t * s, char const *file_name, logmath_t *lmath)
 {
     char eofchk;
     FILE *fp;
-    int32 byteswap, chksum_present;
+    int32 byteswap, chksum_present, quant;
     uint32 chksum;
     float32 *pdf;
+    senprob_t *qpdf;
+    float64 logbase;
     int32 i, f, c, p, n_err;
     char **argname, **argval;
 
@@ -168,6 +175,8 @@ senone_mixw_read(senone_t * s, char const *file_name, logmath_t *lmath)
 
     /* Parse argument-value list */
     chksum_present = 0;
+    quant = 0;
+    logbase = 0.0;
     for (i = 0; argname[i]; i++) {
         if (strcmp(argname[i], "version") == 0) {
             if (strcmp(argval[i], MIXW_PARAM_VERSION) != 0)
@@ -177,10 +186,29 @@ senone_mixw_read(senone_t * s, char const *file_name, logmath_t *lmath)
         else if (strcmp(argname[i], "chksum0") == 0) {
             chksum_present = 1; /* Ignore the associated value */
         }
+        else if (strcmp(argname[i], "quant") == 0) {
+            quant = atoi(argval[i]);
+        }
+        else if (strcmp(argname[i], "logbase") == 0) {
+            logbase = atof(argval[i]);
+        }
     }
     bio_hdrarg_free(argname, argval);
     argname = argval = NULL;
 
+    /* Quantized weights are stored as senprob_t, already floored
+     * and converted with the same log base and shift. */
+    if (quant) {
+        if (quant != 8 * sizeof(senprob_t))
+            E_FATAL("%s: unsupported quantization to %d bits\n",
+                    file_name, quant);
+        if (fabs(logbase - logmath_get_base(lmath)) > 1e-6)
+            E_FATAL("%s: quantized with log base %f, but decoding with %f\n",
+                    file_name, logbase, logmath_get_base(lmath));
+        E_INFO("Mixture weights are quantized to %d bits, "
+               "ignoring the floor\n", quant);
+    }
+
     chksum = 0;
 
     /* Read #senones, #features, #codewords, arraysize */
@@ -229,11 +257,24 @@ senone_mixw_read(senone_t * s, char const *file_name, logmath_t *lmath)
 
     /* Temporary structure to read in floats */
     pdf = (float32 *) ckd_calloc(s->n_cw, sizeof(float32));
+    qpdf = (senprob_t *) ckd_calloc(s->n_cw, sizeof(senprob_t));
 
     /* Read senone probs data, normalize, floor, convert to logs3, truncate to 8 bits */
     n_err = 0;
     for (i = 0; i < s->n_sen; i++) {
         for (f = 0; f < s->n_feat; f++) {
+            if (quant) {
+                if (bio_fread(qpdf, sizeof(senprob_t), s->n_cw,
+                              fp, byteswap, &chksum) != s->n_cw)
+                    E_FATAL("bio_fread(%s) (arraydata) failed\n", file_name);
+                for (c = 0; c < s->n_cw; c++) {
+                    if (s->n_gauden > 1)
+                        s->pdf[i][f][c] = qpdf[c];
+                    else
+                        s->pdf[f][c][i] = qpdf[c];
+                }
+                continue;
+            }
             if (bio_fread
                 ((void *) pdf, sizeof(float32), s->n_cw, fp, byteswap,
                  &chksum)
@@ -265,6 +306,7 @@ senone_mixw_read(senone_t * s, char const *file_name, logmath_t *lmath)
         E_WARN("Weight normalization failed for %d mixture weights components\n", n_err);
 
     ckd_free(pdf);
+    ckd_free(qpdf);
 
     if (chksum_present)
         bio_verify_chksum(fp, byteswap, chksum);
@@ -282,9 +324,117 @@ senone_mixw_read(senone_t * s, char const *file_name, logmath_t *lmath)
 }
 
 
+/*
+ * Layout of the "senone" section: n_sen, n_feat, n_cw and whether the
+ * weights are transposed, then pdf as in senone_t.
+ */
+static int32
+senone_mixw_map(senone_t * s, model_bundle_t *b)
+{
+    int32 const *hdr;
+    size_t size;
+    uint8 *pdf;
+
+    if ((hdr = model_bundle_get(b, "senone", &size)) == NULL)
+        return -1;
+    if (size < MODEL_BUNDLE_ALIGN
+        || hdr[0] <= 0 || hdr[1] <= 0 || hdr[2] <= 0
+        || hdr[3] != (s->n_gauden == 1)
+        || (size - MODEL_BUNDLE_ALIGN) / hdr[0] / hdr[1] < (size_t)hdr[2]) {
+        E_ERROR("Mixture weights in %s are not valid\n", model_bundle_name(b));
+        return -1;
+    }
+    s->n_sen = hdr[0];
+    s->n_feat = hdr[1];
+    s->n_cw = hdr[2];
+    pdf = (uint8 *)hdr + MODEL_BUNDLE_ALIGN;
+    if (s->n_gauden > 1)
+        s->pdf = ckd_alloc_3d_ptr(s->n_sen, s->n_feat, s->n_cw,
+                                  pdf, sizeof(senprob_t));
+    else
+        s->pdf = ckd_alloc_3d_ptr(s->n_feat, s->n_cw, s->n_sen,
+                                  pdf, sizeof(senprob_t));
+    s->bundle = model_bundle_retain(b);
+
+    E_INFO("Mapped mixture weights for %d senones from %s\n",
+           s->n_sen, model_bundle_name(b));
+    return 0;
+}
+
+int
+senone_write_bundle(senone_t * s, model_bundle_writer_t *w)
+{
+    int32 hdr[4];
+    FILE *fh;
+    size_t n;
+
+    hdr[0] = s->n_sen;
+    hdr[1] = s->n_feat;
+    hdr[2] = s->n_cw;
+    hdr[3] = (s->n_gauden == 1);
+    n = (size_t)s->n_sen * s->n_feat * s->n_cw;
+    if ((fh = model_bundle_add(w, "senone")) == NULL
+        || model_bundle_write_aligned(fh, hdr, sizeof(hdr)) < 0
+        || fwrite(s->pdf[0][0], sizeof(senprob_t), n, fh) != n)
+        return -1;
+    return 0;
+}
+
+int32
+senone_mixw_quantize(char const *infile, char const *outfile,
+                     float32 mixwfloor, logmath_t *lmath)
+{
+    senone_t *s;
+    FILE *fp;
+    uint32 chksum;
+    int32 n;
+    char basestr[32], bitstr[8];
+
+    /* Read (and convert) the weights without transposing them. */
+    s = (senone_t *) ckd_calloc(1, sizeof(senone_t));
+    s->mixwfloor = mixwfloor;
+    s->n_gauden = 2;
+    senone_mixw_read(s, infile, lmath);
+    n = s->n_sen * s->n_feat * s->n_cw;
+
+    if ((fp = fopen(outfile, "wb")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open %s for writing", outfile);
+        goto error_out;
+    }
+    sprintf(basestr, "%f", logmath_get_base(lmath));
+    sprintf(bitstr, "%d", (int)(8 * sizeof(senprob_t)));
+    chksum = 0;
+    if (bio_writehdr(fp, "version", MIXW_PARAM_VERSION,
+                     "quant", bitstr, "logbase", basestr,
+                     "chksum0", "yes", NULL) < 0
+        || bio_fwrite(&s->n_sen, sizeof(int32), 1, fp, 0, &chksum) != 1
+        || bio_fwrite(&s->n_feat, sizeof(int32), 1, fp, 0, &chksum) != 1
+        || bio_fwrite(&s->n_cw, sizeof(int32), 1, fp, 0, &chksum) != 1
+        || bio_fwrite(&n, sizeof(int32), 1, fp, 0, &chksum) != 1
+        || bio_fwrite(s->pdf[0][0], sizeof(senprob_t), n,
+                      fp, 0, &chksum) != n
+        || fwrite(&chksum, sizeof(chksum), 1, fp) != 1) {
+        E_ERROR_SYSTEM("Failed to write %s", outfile);
+        fclose(fp);
+        goto error_out;
+    }
+    fclose(fp);
+    E_INFO("Wrote mixture weights for %d senones quantized to %d bits to %s\n",
+           s->n_sen, (int)(8 * sizeof(senprob_t)), outfile);
+    ckd_free_3d((void *) s->pdf);
+    ckd_free(s);
+    return 0;
+
+error_out:
+    ckd_free_3d((void *) s->pdf);
+    ckd_free(s);
+    return -1;
+}
+
 senone_t *
-senone_init(gauden_t *g, char const *mixwfile, char const *sen2mgau_map_file,
-	    float32 mixwfloor, logmath_t *lmath, bin_mdef_t *mdef)
+senone_init(gauden_t *g, model_bundle_t *bundle, char const *mixwfile,
+            char const *sen2mgau_map_file, float32 mixwfloor,
+            logmath_t *lmath, bin_mdef_t *mdef)
 {
     senone_t *s;
     int32 n = 0, i;
@@ -311,7 +461,8 @@ senone_init(gauden_t *g, char const *mixwfile, char const *sen2mgau_map_file,
 	    sen2mgau_map_file = ".cont.";
     }
 
-    senone_mixw_read(s, mixwfile, lmath);
+    if (bundle == NULL || senone_mixw_map(s, bundle) < 0)
+        senone_mixw_read(s, mixwfile, lmath);
 
     if (strcmp(sen2mgau_map_file, ".semi.") == 0) {
         /* All-to-1 senones-codebook mapping */
@@ -353,7 +504,11 @@ senone_free(senone_t * s)
 {
     if (s == NULL)
         return;
-    if (s->pdf)
+    if (s->bundle) {
+        ckd_free_3d_ptr(s->pdf);
+        model_bundle_free(s->bundle);
+    }
+    else if (s->pdf)
         ckd_free_3d((void *) s->pdf);
     if (s->mgau)
         ckd_free(s->mgau);
@@ -375,8 +530,8 @@ senone_eval(senone_t * s, int id, gauden_dist_t ** dist, int32 n_top)
     int32 scr;                  /* total senone score */
     int32 fden;                 /* Gaussian density */
     int32 fscr;                 /* senone score for one feature */
-    int32 fwscr;                /* senone score for one feature, one codeword */
-    int32 f, t;
+    int32 fwscr[SENONE_TOPN_CHUNK]; /* senone scores for one feature, some codewords */
+    int32 f, t, i, n;
     gauden_dist_t *fdist;
 
     assert((id >= 0) && (id < s->n_sen));
@@ -385,25 +540,23 @@ senone_eval(senone_t * s, int id, gauden_dist_t ** dist, int32 n_top)
     scr = 0;
 
     for (f = 0; f < s->n_feat; f++) {
-        int top;
         fdist = dist[f];
 
-        /* Top codeword for feature f */
-	top = fden = ((int32)fdist[0].dist + ((1<<SENSCR_SHIFT) - 1)) >> SENSCR_SHIFT;
-        fscr = (s->n_gauden > 1)
-	    ? (fden + -s->pdf[id][f][fdist[0].id])  /* untransposed */
-	    : (fden + -s->pdf[f][fdist[0].id][id]); /* transposed */
-        E_DEBUG(1, ("fden[%d][%d] l+= %d + %d = %d\n",
-                    id, f, -(fscr - fden), -(fden-top), -(fscr-top)));
-        /* Remaining of n_top codewords for feature f */
-        for (t = 1; t < n_top; t++) {
-	    fden = ((int32)fdist[t].dist + ((1<<SENSCR_SHIFT) - 1)) >> SENSCR_SHIFT;
-            fwscr = (s->n_gauden > 1) ?
-                (fden + -s->pdf[id][f][fdist[t].id]) :
-                (fden + -s->pdf[f][fdist[t].id][id]);
-            fscr = logmath_add(s->lmath, fscr, fwscr);
-            E_DEBUG(1, ("fden[%d][%d] l+= %d + %d = %d\n",
-                        id, f, -(fwscr - fden), -(fden-top), -(fscr-top)));
+        /* Add up the n_top codewords for feature f, in chunks (on
+         * the stack, since senones may be evaluated in parallel). */
+        fscr = logmath_get_zero(s->lmath);
+        for (t = 0; t < n_top; t += n) {
+            n = (n_top - t < SENONE_TOPN_CHUNK) ? n_top - t : SENONE_TOPN_CHUNK;
+            for (i = 0; i < n; ++i) {
+                fden = ((int32)fdist[t + i].dist + ((1<<SENSCR_SHIFT) - 1)) >> SENSCR_SHIFT;
+                fwscr[i] = (s->n_gauden > 1)
+                    ? (fden + -s->pdf[id][f][fdist[t + i].id])  /* untransposed */
+                    : (fden + -s->pdf[f][fdist[t + i].id][id]); /* transposed */
+                E_DEBUG(1, ("fden[%d][%d] l+= %d + %d\n",
+                            id, f, -(fwscr[i] - fden), -fden));
+            }
+            fscr = logmath_add(s->lmath, fscr,
+                               logmath_add_n(s->lmath, fwscr, n));
         }
 	/* Senone scores are also scaled, negated logs3 values.  Hence
 	 * we have to negate the stuff we calculated above. */
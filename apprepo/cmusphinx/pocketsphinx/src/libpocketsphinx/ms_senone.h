@@ -161,6 +161,7 @@ typedef struct {
     uint32 *mgau;		/**< senone-id -> mgau-id mapping for senones in this set */
     int32 *featscr;              /**< The feature score for every senone, will be initialized inside senone_eval_all */
     int32 aw;			/**< Inverse acoustic weight */
+    model_bundle_t *bundle;     /**< Model bundle holding pdf (if any) */
 } senone_t;
 
 
@@ -171,6 +172,9 @@ typedef struct {
  * @return pointer to senone structure created.  Caller MUST NOT change its contents.
  */
 senone_t *senone_init (gauden_t *g,             /**< In: codebooks */
+                       model_bundle_t *bundle,  /**< In: model bundle with the
+                                                   weights, or NULL to read
+                                                   mixwfile */
                        char const *mixwfile,	/**< In: mixing weights file */
 		       char const *mgau_mapfile,/**< In: file specifying mapping from each
 						   senone to mixture gaussian codebook.
@@ -180,9 +184,27 @@ senone_t *senone_init (gauden_t *g,             /**< In: codebooks */
                        bin_mdef_t *mdef         /**< In: model definition */
     );
 
+/**
+ * Add the weights to a model bundle, in the same layout as in memory.
+ */
+int senone_write_bundle(senone_t *s, model_bundle_writer_t *w);
+
 /** Release memory allocated by senone_init. */
 void senone_free(senone_t *s); /**< In: The senone_t to free */
 
+/**
+ * Write a copy of a mixture weights file with the weights already
+ * floored and converted to 8 bits, as senone_init() stores them.
+ * Such files are a quarter of the size of the original ones and can
+ * be read by senone_init() as long as the log base is the same.
+ * @return 0 if successful, -1 otherwise.
+ */
+int32 senone_mixw_quantize(char const *infile,  /**< In: mixture weights file */
+                           char const *outfile, /**< In: file to write */
+                           float32 mixwfloor,   /**< In: Floor value for senone weights */
+                           logmath_t *lmath     /**< In: log math used for decoding */
+    );
+
 /**
  * Evaluate the score for the given senone wrt to the given top N gaussian codewords.
  * @return senone score (in logs3 domain).
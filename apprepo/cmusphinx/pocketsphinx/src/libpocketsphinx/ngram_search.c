@@ -90,6 +90,29 @@ ngram_search_update_widmap(ngram_search_t *ngs)
         words[i] = (const char *)dict_wordstr(ps_search_dict(ngs), i);
     ngram_model_set_map_words(ngs->lmset, words, n_words);
     ckd_free(words);
+    ngs->widmap_lmset = ngs->lmset;
+    ngs->widmap_n_models = ngram_model_set_count(ngs->lmset);
+    ngs->widmap_n_words = n_words;
+}
+
+/*
+ * Check whether the word mapping in the LM set still matches the
+ * dictionary, i.e. any words added to the dictionary since it was
+ * built have also been added to the LM set, in the same order.
+ */
+static int
+ngram_search_widmap_valid(ngram_search_t *ngs)
+{
+    dict_t *dict = ps_search_dict(ngs);
+    int32 w;
+
+    if (ngs->widmap_lmset != ngs->lmset
+        || ngs->widmap_n_models != ngram_model_set_count(ngs->lmset))
+        return FALSE;
+    for (w = ngs->widmap_n_words; w < ps_search_n_words(ngs); ++w)
+        if (ngram_wid(ngs->lmset, dict_wordstr(dict, w)) != w)
+            return FALSE;
+    return TRUE;
 }
 
 static void
@@ -141,10 +164,58 @@ ngram_search_init(cmd_ln_t *config,
 		  dict_t *dict,
                   dict2pid_t *d2p)
 {
-    ngram_search_t *ngs;
+    ngram_model_t *lmset = NULL;
     const char *path;
 
+    /* Load language model(s) */
+    if ((path = cmd_ln_str_r(config, "-lmctl"))) {
+        lmset = ngram_model_set_read(config, path, acmod->lmath);
+        if (lmset == NULL) {
+            E_ERROR("Failed to read language model control file: %s\n",
+                    path);
+            return NULL;
+        }
+        /* Set the default language model if needed. */
+        if ((path = cmd_ln_str_r(config, "-lmname"))) {
+            ngram_model_set_select(lmset, path);
+        }
+    }
+    else if ((path = cmd_ln_str_r(config, "-lm"))) {
+        static const char *name = "default";
+        ngram_model_t *lm;
+
+        lm = ngram_model_read(config, path, NGRAM_AUTO, acmod->lmath);
+        if (lm == NULL) {
+            E_ERROR("Failed to read language model file: %s\n", path);
+            return NULL;
+        }
+        lmset = ngram_model_set_init(config,
+                                     &lm, (char **)&name,
+                                     NULL, 1);
+        if (lmset == NULL) {
+            E_ERROR("Failed to initialize language model set\n");
+            ngram_model_free(lm);
+            return NULL;
+        }
+    }
+
+    return ngram_search_init_lmset(config, acmod, dict, d2p, lmset);
+}
+
+/*
+ * Allocate everything common to all passes.
+ */
+static ngram_search_t *
+ngram_search_alloc(cmd_ln_t *config,
+                   acmod_t *acmod,
+                   dict_t *dict,
+                   dict2pid_t *d2p,
+                   ngram_model_t *lmset)
+{
+    ngram_search_t *ngs;
+
     ngs = ckd_calloc(1, sizeof(*ngs));
+    ngs->lmset = lmset;
     ps_search_init(&ngs->base, &ngram_funcs, config, acmod, dict, d2p);
     ngs->hmmctx = hmm_context_init(bin_mdef_n_emit_state(acmod->mdef),
                                    acmod->tmat->tp, NULL, acmod->mdef->sseq);
@@ -167,6 +238,10 @@ ngram_search_init(cmd_ln_t *config,
     ngs->word_active = bitvec_alloc(dict_size(dict));
     ngs->last_ltrans = ckd_calloc(dict_size(dict),
                                   sizeof(*ngs->last_ltrans));
+    ngs->lm_batch_wid = ckd_calloc(dict_size(dict),
+                                   sizeof(*ngs->lm_batch_wid));
+    ngs->lm_batch_scr = ckd_calloc(dict_size(dict),
+                                   sizeof(*ngs->lm_batch_scr));
 
     /* FIXME: All these structures need to be made dynamic with
      * garbage collection. */
@@ -181,41 +256,12 @@ ngram_search_init(cmd_ln_t *config,
     ngs->bp_table_idx = ckd_calloc(ngs->n_frame_alloc + 1,
                                    sizeof(*ngs->bp_table_idx));
     ++ngs->bp_table_idx; /* Make bptableidx[-1] valid */
+    ngs->commitwin = cmd_ln_int32_r(config, "-commitwin");
 
     /* Allocate active word list array */
     ngs->active_word_list = ckd_calloc_2d(2, dict_size(dict),
                                           sizeof(**ngs->active_word_list));
 
-    /* Load language model(s) */
-    if ((path = cmd_ln_str_r(config, "-lmctl"))) {
-        ngs->lmset = ngram_model_set_read(config, path, acmod->lmath);
-        if (ngs->lmset == NULL) {
-            E_ERROR("Failed to read language model control file: %s\n",
-                    path);
-            goto error_out;
-        }
-        /* Set the default language model if needed. */
-        if ((path = cmd_ln_str_r(config, "-lmname"))) {
-            ngram_model_set_select(ngs->lmset, path);
-        }
-    }
-    else if ((path = cmd_ln_str_r(config, "-lm"))) {
-        static const char *name = "default";
-        ngram_model_t *lm;
-
-        lm = ngram_model_read(config, path, NGRAM_AUTO, acmod->lmath);
-        if (lm == NULL) {
-            E_ERROR("Failed to read language model file: %s\n", path);
-            goto error_out;
-        }
-        ngs->lmset = ngram_model_set_init(config,
-                                          &lm, (char **)&name,
-                                          NULL, 1);
-        if (ngs->lmset == NULL) {
-            E_ERROR("Failed to initialize language model set\n");
-            goto error_out;
-        }
-    }
     if (ngs->lmset != NULL
         && ngram_wid(ngs->lmset, S3_FINISH_WORD) == ngram_unknown_wid(ngs->lmset)) {
         E_ERROR("Language model/set does not contain </s>, recognition will fail\n");
@@ -224,6 +270,88 @@ ngram_search_init(cmd_ln_t *config,
 
     /* Create word mappings. */
     ngram_search_update_widmap(ngs);
+    return ngs;
+
+error_out:
+    ngram_search_free((ps_search_t *)ngs);
+    return NULL;
+}
+
+/*
+ * Create the flat lexicon search which runs beside fwdtree with
+ * -fwdflatlag.  It has its own acoustic model, language model set
+ * and search state (sharing the model parameters) so that it can run
+ * in another thread.
+ */
+int
+ngram_search_init_flat(ngram_search_t *ngs)
+{
+    acmod_t *acmod;
+    ngram_model_t *lmset;
+    ngram_search_t *flat;
+
+    if ((acmod = acmod_copy(ps_search_acmod(ngs))) == NULL)
+        return -1;
+    /* Keep every frame it is given until it gets to search it. */
+    acmod_set_grow(acmod, TRUE);
+    /* Its frames come from the main acoustic model, which has already
+     * applied any feature space transform to them. */
+    acmod_update_fmllr(acmod, NULL);
+    if ((lmset = ngram_model_set_dup(ngs->lmset)) == NULL) {
+        acmod_free(acmod);
+        return -1;
+    }
+    flat = ngram_search_alloc(ps_search_config(ngs), acmod,
+                              ps_search_dict(ngs), ps_search_dict2pid(ngs),
+                              lmset);
+    if (flat == NULL) {
+        acmod_free(acmod);
+        return -1;
+    }
+    flat->pipelined = TRUE;
+    ngram_fwdflat_init(flat);
+    flat->fwdflat = TRUE;
+    flat->fwdflat_perf.name = "fwdflat";
+    ptmr_init(&flat->fwdflat_perf);
+    ngs->flat = flat;
+
+    /* Without threads it still runs alongside fwdtree, just not at
+     * the same time. */
+    ngs->flat_thread = thread_pool_init(ps_search_config(ngs), 1);
+    E_INFO("fwdflat search follows fwdtree by %d frames%s\n",
+           ngs->fwdflat_lag, ngs->flat_thread ? " in another thread" : "");
+    return 0;
+}
+
+void
+ngram_search_free_flat(ngram_search_t *ngs)
+{
+    acmod_t *acmod;
+
+    if (ngs->flat == NULL)
+        return;
+    if (ngs->flat_thread) {
+        thread_pool_wait(ngs->flat_thread);
+        thread_pool_free(ngs->flat_thread);
+        ngs->flat_thread = NULL;
+    }
+    acmod = ps_search_acmod(ngs->flat);
+    ngram_search_free(ps_search_base(ngs->flat));
+    acmod_free(acmod);
+    ngs->flat = NULL;
+}
+
+ps_search_t *
+ngram_search_init_lmset(cmd_ln_t *config,
+                        acmod_t *acmod,
+                        dict_t *dict,
+                        dict2pid_t *d2p,
+                        ngram_model_t *lmset)
+{
+    ngram_search_t *ngs;
+
+    if ((ngs = ngram_search_alloc(config, acmod, dict, d2p, lmset)) == NULL)
+        return NULL;
 
     /* Initialize fwdtree, fwdflat, bestpath modules if necessary. */
     if (cmd_ln_boolean_r(config, "-fwdtree")) {
@@ -243,6 +371,19 @@ ngram_search_init(cmd_ln_t *config,
         ngs->bestpath_perf.name = "bestpath";
         ptmr_init(&ngs->bestpath_perf);
     }
+    /* Committing words only works in a single forward pass. */
+    if (ngs->commitwin > 0
+        && (!ngs->fwdtree || ngs->fwdflat || ngs->bestpath)) {
+        E_ERROR("-commitwin requires -fwdtree yes -fwdflat no -bestpath no\n");
+        goto error_out;
+    }
+    ngs->fwdflat_lag = cmd_ln_int32_r(config, "-fwdflatlag");
+    if (ngs->fwdflat_lag > 0) {
+        if (!ngs->fwdtree || !ngs->fwdflat)
+            E_WARN("-fwdflatlag only applies to -fwdtree yes -fwdflat yes, ignored\n");
+        else if (ngram_search_init_flat(ngs) < 0)
+            goto error_out;
+    }
 
     return (ps_search_t *)ngs;
 
@@ -255,9 +396,14 @@ static int
 ngram_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
 {
     ngram_search_t *ngs = (ngram_search_t *)search;
-    int old_n_words;
+    int old_n_words, rebuild;
     int rv = 0;
 
+    /* A new dictionary means starting over, otherwise only words
+     * may have been added, or the LM changed. */
+    rebuild = (dict != ps_search_dict(search)
+               || d2p != ps_search_dict2pid(search));
+
     /* Update the number of words. */
     old_n_words = search->n_words;
     if (old_n_words != dict_size(dict)) {
@@ -266,10 +412,14 @@ ngram_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
         ckd_free(ngs->word_lat_idx);
         ckd_free(ngs->word_active);
         ckd_free(ngs->last_ltrans);
+        ckd_free(ngs->lm_batch_wid);
+        ckd_free(ngs->lm_batch_scr);
         ckd_free_2d(ngs->active_word_list);
         ngs->word_lat_idx = ckd_calloc(search->n_words, sizeof(*ngs->word_lat_idx));
         ngs->word_active = bitvec_alloc(search->n_words);
         ngs->last_ltrans = ckd_calloc(search->n_words, sizeof(*ngs->last_ltrans));
+        ngs->lm_batch_wid = ckd_calloc(search->n_words, sizeof(*ngs->lm_batch_wid));
+        ngs->lm_batch_scr = ckd_calloc(search->n_words, sizeof(*ngs->lm_batch_scr));
         ngs->active_word_list
             = ckd_calloc_2d(2, search->n_words,
                             sizeof(**ngs->active_word_list));
@@ -284,18 +434,36 @@ ngram_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
     /* Update beam widths. */
     ngram_search_calc_beams(ngs);
 
-    /* Update word mappings. */
-    ngram_search_update_widmap(ngs);
+    /* Update word mappings, unless they already cover new words. */
+    if (rebuild || !ngram_search_widmap_valid(ngs)) {
+        ngram_search_update_widmap(ngs);
+        rebuild = TRUE;
+    }
+    else
+        ngs->widmap_n_words = search->n_words;
 
-    /* Now rebuild lextrees. */
+    /* Now rebuild lextrees, or switch to (and add words to) the
+     * one for the current LM. */
     if (ngs->fwdtree) {
-        if ((rv = ngram_fwdtree_reinit(ngs)) < 0)
+        if (rebuild)
+            rv = ngram_fwdtree_reinit(ngs);
+        else
+            rv = ngram_fwdtree_update(ngs, old_n_words);
+        if (rv < 0)
             return rv;
     }
     if (ngs->fwdflat) {
         if ((rv = ngram_fwdflat_reinit(ngs)) < 0)
             return rv;
     }
+    /* The flat lexicon search has its own copy of the language
+     * models, so it is simplest to start over if the words changed.
+     * It follows the selected LM by itself. */
+    if (ngs->flat && (rebuild || old_n_words != search->n_words)) {
+        ngram_search_free_flat(ngs);
+        if ((rv = ngram_search_init_flat(ngs)) < 0)
+            return rv;
+    }
 
     return rv;
 }
@@ -305,6 +473,7 @@ ngram_search_free(ps_search_t *search)
 {
     ngram_search_t *ngs = (ngram_search_t *)search;
 
+    ngram_search_free_flat(ngs);
     ps_search_deinit(search);
     if (ngs->fwdtree)
         ngram_fwdtree_deinit(ngs);
@@ -337,24 +506,41 @@ ngram_search_free(ps_search_t *search)
         ckd_free(ngs->bp_table_idx - 1);
     ckd_free_2d(ngs->active_word_list);
     ckd_free(ngs->last_ltrans);
+    ckd_free(ngs->lm_batch_wid);
+    ckd_free(ngs->lm_batch_scr);
+    ckd_free(ngs->commit_seg);
+    ckd_free(ngs->bp_map);
     ckd_free(ngs);
 }
 
-int
-ngram_search_mark_bptable(ngram_search_t *ngs, int frame_idx)
+void
+ngram_search_alloc_frames(ngram_search_t *ngs, int frame_idx)
 {
-    if (frame_idx >= ngs->n_frame_alloc) {
+    int32 n_frame_alloc;
+
+    if (frame_idx < ngs->n_frame_alloc)
+        return;
+    n_frame_alloc = ngs->n_frame_alloc;
+    while (frame_idx >= ngs->n_frame_alloc)
         ngs->n_frame_alloc *= 2;
-        ngs->bp_table_idx = ckd_realloc(ngs->bp_table_idx - 1,
-                                        (ngs->n_frame_alloc + 1)
-                                        * sizeof(*ngs->bp_table_idx));
-        if (ngs->frm_wordlist) {
-            ngs->frm_wordlist = ckd_realloc(ngs->frm_wordlist,
-                                            ngs->n_frame_alloc
-                                            * sizeof(*ngs->frm_wordlist));
-        }
-        ++ngs->bp_table_idx; /* Make bptableidx[-1] valid */
+    ngs->bp_table_idx = ckd_realloc(ngs->bp_table_idx - 1,
+                                    (ngs->n_frame_alloc + 1)
+                                    * sizeof(*ngs->bp_table_idx));
+    if (ngs->frm_wordlist) {
+        ngs->frm_wordlist = ckd_realloc(ngs->frm_wordlist,
+                                        ngs->n_frame_alloc
+                                        * sizeof(*ngs->frm_wordlist));
+        memset(ngs->frm_wordlist + n_frame_alloc, 0,
+               (ngs->n_frame_alloc - n_frame_alloc)
+               * sizeof(*ngs->frm_wordlist));
     }
+    ++ngs->bp_table_idx; /* Make bptableidx[-1] valid */
+}
+
+int
+ngram_search_mark_bptable(ngram_search_t *ngs, int frame_idx)
+{
+    ngram_search_alloc_frames(ngs, frame_idx);
     ngs->bp_table_idx[frame_idx] = ngs->bpidx;
     return ngs->bpidx;
 }
@@ -564,52 +750,28 @@ ngram_search_find_exit(ngram_search_t *ngs, int frame_idx, int32 *out_best_score
     return best_exit;
 }
 
-char const *
-ngram_search_bp_hyp(ngram_search_t *ngs, int bpidx)
+/* Predecessor function for the cached traceback. */
+static int32
+ngram_search_bp_pred(ps_search_t *base, int32 bp, char const **out_word)
 {
-    ps_search_t *base = ps_search_base(ngs);
-    char *c;
-    size_t len;
-    int bp;
-
-    if (bpidx == NO_BP)
-        return NULL;
+    ngram_search_t *ngs = (ngram_search_t *)base;
+    bptbl_t *be = &ngs->bp_table[bp];
 
-    bp = bpidx;
-    len = 0;
-    while (bp != NO_BP) {
-        bptbl_t *be = &ngs->bp_table[bp];
-        bp = be->bp;
-        if (dict_real_word(ps_search_dict(ngs), be->wid))
-            len += strlen(dict_basestr(ps_search_dict(ngs), be->wid)) + 1;
-    }
-
-    ckd_free(base->hyp_str);
-    if (len == 0) {
-	base->hyp_str = NULL;
-	return base->hyp_str;
-    }
-    base->hyp_str = ckd_calloc(1, len);
-
-    bp = bpidx;
-    c = base->hyp_str + len - 1;
-    while (bp != NO_BP) {
-        bptbl_t *be = &ngs->bp_table[bp];
-        size_t len;
-
-        bp = be->bp;
-        if (dict_real_word(ps_search_dict(ngs), be->wid)) {
-            len = strlen(dict_basestr(ps_search_dict(ngs), be->wid));
-            c -= len;
-            memcpy(c, dict_basestr(ps_search_dict(ngs), be->wid), len);
-            if (c > base->hyp_str) {
-                --c;
-                *c = ' ';
-            }
-        }
-    }
+    if (dict_real_word(ps_search_dict(ngs), be->wid))
+        *out_word = dict_basestr(ps_search_dict(ngs), be->wid);
+    else
+        *out_word = NULL;
+    return (be->bp >= ngs->bp_first) ? be->bp : -1;
+}
 
-    return base->hyp_str;
+char const *
+ngram_search_bp_hyp(ngram_search_t *ngs, int bpidx)
+{
+    /* Everything before bp_first has been committed. */
+    if (bpidx < ngs->bp_first)
+        bpidx = NO_BP;
+    return ps_search_trace(ps_search_base(ngs), bpidx,
+                           ngram_search_bp_pred);
 }
 
 void
@@ -747,7 +909,12 @@ ngram_search_start(ps_search_t *search)
     ngram_search_t *ngs = (ngram_search_t *)search;
 
     ngs->done = FALSE;
+    ngs->frame_offset = 0;
+    ngs->bp_first = 0;
+    ngs->n_commit_seg = 0;
     ngram_model_flush(ngs->lmset);
+    if (ngs->flat)
+        ngram_fwdflat_pipeline_start(ngs);
     if (ngs->fwdtree)
         ngram_fwdtree_start(ngs);
     else if (ngs->fwdflat)
@@ -762,8 +929,12 @@ ngram_search_step(ps_search_t *search, int frame_idx)
 {
     ngram_search_t *ngs = (ngram_search_t *)search;
 
-    if (ngs->fwdtree)
-        return ngram_fwdtree_search(ngs, frame_idx);
+    if (ngs->fwdtree) {
+        int nfr = ngram_fwdtree_search(ngs, frame_idx);
+        if (ngs->flat)
+            ngram_fwdflat_pipeline_step(ngs);
+        return nfr;
+    }
     else if (ngs->fwdflat)
         return ngram_fwdflat_search(ngs, frame_idx);
     else
@@ -806,13 +977,17 @@ ngram_search_finish(ps_search_t *search)
 {
     ngram_search_t *ngs = (ngram_search_t *)search;
 
-    ngs->n_tot_frame += ngs->n_frame;
+    ngs->n_tot_frame += ngs->n_frame + ngs->frame_offset;
     if (ngs->fwdtree) {
         ngram_fwdtree_finish(ngs);
         /* dump_bptable(ngs); */
 
+        /* Finish fwdflat search if it was running alongside. */
+        if (ngs->flat) {
+            ngram_fwdflat_pipeline_finish(ngs);
+        }
         /* Now do fwdflat search in its entirety, if requested. */
-        if (ngs->fwdflat) {
+        else if (ngs->fwdflat) {
             int i;
             /* Rewind the acoustic model. */
             if (acmod_rewind(ps_search_acmod(ngs)) < 0)
@@ -914,8 +1089,8 @@ ngram_search_bp2itor(ps_seg_t *seg, int bp)
     be = &ngs->bp_table[bp];
     pbe = be->bp == -1 ? NULL : &ngs->bp_table[be->bp];
     seg->word = dict_wordstr(ps_search_dict(ngs), be->wid);
-    seg->ef = be->frame;
-    seg->sf = pbe ? pbe->frame + 1 : 0;
+    seg->ef = be->frame + ngs->frame_offset;
+    seg->sf = pbe ? pbe->frame + 1 + ngs->frame_offset : 0;
     seg->prob = 0; /* Bogus value... */
     /* Compute acoustic and LM scores for this segment. */
     if (pbe == NULL) {
@@ -980,36 +1155,23 @@ static ps_seg_t *
 ngram_search_bp_iter(ngram_search_t *ngs, int bpidx, float32 lwf)
 {
     bptbl_seg_t *itor;
-    int bp, cur;
+    ps_trace_t *trace;
 
     /* Calling this an "iterator" is a bit of a misnomer since we have
      * to get the entire backtrace in order to produce it.  On the
-     * other hand, all we actually need is the bptbl IDs, and we can
-     * allocate a fixed-size array of them. */
+     * other hand, all we actually need is the bptbl IDs, which the
+     * cached traceback already has. */
+    ngram_search_bp_hyp(ngs, bpidx);
+    trace = &ps_search_base(ngs)->trace;
+    if (trace->n_id == 0)
+        return NULL;
     itor = ckd_calloc(1, sizeof(*itor));
     itor->base.vt = &ngram_bp_segfuncs;
     itor->base.search = ps_search_base(ngs);
     itor->base.lwf = lwf;
-    itor->n_bpidx = 0;
-    bp = bpidx;
-    while (bp != NO_BP) {
-        bptbl_t *be = &ngs->bp_table[bp];
-        bp = be->bp;
-        ++itor->n_bpidx;
-    }
-    if (itor->n_bpidx == 0) {
-        ckd_free(itor);
-        return NULL;
-    }
+    itor->n_bpidx = trace->n_id;
     itor->bpidx = ckd_calloc(itor->n_bpidx, sizeof(*itor->bpidx));
-    cur = itor->n_bpidx - 1;
-    bp = bpidx;
-    while (bp != NO_BP) {
-        bptbl_t *be = &ngs->bp_table[bp];
-        itor->bpidx[cur] = bp;
-        bp = be->bp;
-        --cur;
-    }
+    memcpy(itor->bpidx, trace->id, itor->n_bpidx * sizeof(*itor->bpidx));
 
     /* Fill in relevant fields for first element. */
     ngram_search_bp2itor((ps_seg_t *)itor, itor->bpidx[0]);
@@ -1017,6 +1179,229 @@ ngram_search_bp_iter(ngram_search_t *ngs, int bpidx, float32 lwf)
     return (ps_seg_t *)itor;
 }
 
+/**
+ * Segmentation "iterator" for committed words.
+ */
+typedef struct commit_seg_itor_s {
+    ps_seg_t base;        /**< Base structure. */
+    commit_seg_t *seg;    /**< Committed words. */
+    int32 n_seg;          /**< Number of committed words. */
+    int32 cur;            /**< Current position in seg. */
+} commit_seg_itor_t;
+
+static void
+commit_seg2itor(commit_seg_itor_t *itor)
+{
+    commit_seg_t *cs = itor->seg + itor->cur;
+
+    itor->base.word = cs->word;
+    itor->base.sf = cs->sf;
+    itor->base.ef = cs->ef;
+    itor->base.ascr = cs->ascr;
+    itor->base.lscr = cs->lscr;
+    itor->base.lback = cs->lback;
+    itor->base.prob = 0; /* Bogus value... */
+}
+
+static void
+ngram_commit_seg_free(ps_seg_t *seg)
+{
+    commit_seg_itor_t *itor = (commit_seg_itor_t *)seg;
+
+    ckd_free(itor->seg);
+    ckd_free(itor);
+}
+
+static ps_seg_t *
+ngram_commit_seg_next(ps_seg_t *seg)
+{
+    commit_seg_itor_t *itor = (commit_seg_itor_t *)seg;
+
+    if (++itor->cur == itor->n_seg) {
+        ngram_commit_seg_free(seg);
+        return NULL;
+    }
+    commit_seg2itor(itor);
+    return seg;
+}
+
+static ps_segfuncs_t ngram_commit_segfuncs = {
+    /* seg_next */ ngram_commit_seg_next,
+    /* seg_free */ ngram_commit_seg_free
+};
+
+ps_seg_t *
+ngram_search_commit_iter(ngram_search_t *ngs)
+{
+    commit_seg_itor_t *itor;
+
+    if (ngs->n_commit_seg == 0)
+        return NULL;
+
+    /* Hand over the committed words, so they don't pile up. */
+    itor = ckd_calloc(1, sizeof(*itor));
+    itor->base.vt = &ngram_commit_segfuncs;
+    itor->base.search = ps_search_base(ngs);
+    itor->base.lwf = 1.0;
+    itor->seg = ngs->commit_seg;
+    itor->n_seg = ngs->n_commit_seg;
+    ngs->commit_seg = NULL;
+    ngs->n_commit_seg = ngs->n_commit_seg_alloc = 0;
+    commit_seg2itor(itor);
+
+    return (ps_seg_t *)itor;
+}
+
+/*
+ * Append the words from the first uncommitted one up to bp to the
+ * committed words.
+ */
+static void
+commit_bp(ngram_search_t *ngs, int32 bp)
+{
+    ps_seg_t seg;
+    int32 b, n, i;
+
+    n = 0;
+    for (b = bp; b >= ngs->bp_first; b = ngs->bp_table[b].bp)
+        ++n;
+    if (ngs->n_commit_seg + n > ngs->n_commit_seg_alloc) {
+        ngs->n_commit_seg_alloc = ngs->n_commit_seg + n + 16;
+        ngs->commit_seg = ckd_realloc(ngs->commit_seg,
+                                      ngs->n_commit_seg_alloc
+                                      * sizeof(*ngs->commit_seg));
+    }
+
+    memset(&seg, 0, sizeof(seg));
+    seg.search = ps_search_base(ngs);
+    seg.lwf = 1.0;
+    i = ngs->n_commit_seg + n - 1;
+    for (b = bp; b >= ngs->bp_first; b = ngs->bp_table[b].bp) {
+        commit_seg_t *cs = ngs->commit_seg + i--;
+
+        ngram_search_bp2itor(&seg, b);
+        cs->word = seg.word;
+        cs->sf = seg.sf;
+        cs->ef = seg.ef;
+        cs->ascr = seg.ascr;
+        cs->lscr = seg.lscr;
+        cs->lback = seg.lback;
+    }
+    ngs->n_commit_seg += n;
+}
+
+int32 const *
+ngram_search_commit(ngram_search_t *ngs, bitvec_t *live, int *out_shift)
+{
+    int32 *nleaf, *bpmap;
+    int32 i, j, n_bp, n_leaf, root, start, shift, bss_head;
+
+    *out_shift = 0;
+    if (ngs->bpidx == 0)
+        return NULL;
+    if (ngs->bp_map_alloc < ngs->bpidx) {
+        ngs->bp_map_alloc = ngs->bp_table_size;
+        ngs->bp_map = ckd_realloc(ngs->bp_map,
+                                  ngs->bp_map_alloc * sizeof(*ngs->bp_map));
+    }
+
+    /* Count the live entries at or after each entry.  Predecessors
+     * always come before their successors in the table. */
+    nleaf = ngs->bp_map;
+    n_leaf = 0;
+    for (i = 0; i < ngs->bpidx; ++i) {
+        nleaf[i] = bitvec_is_set(live, ngs->bp_table[i].frame) ? 1 : 0;
+        n_leaf += nleaf[i];
+    }
+    if (n_leaf == 0)
+        return NULL;
+    for (i = ngs->bpidx - 1; i >= 0; --i) {
+        if (nleaf[i] && ngs->bp_table[i].bp != NO_BP)
+            nleaf[ngs->bp_table[i].bp] += nleaf[i];
+    }
+
+    /* The last entry which precedes all live ones (if there is one)
+     * will not change anymore, nor will anything before it. */
+    for (root = ngs->bpidx - 1; root >= 0; --root)
+        if (nleaf[root] == n_leaf)
+            break;
+    if (root >= ngs->bp_first) {
+        commit_bp(ngs, root);
+        /* Keep frame numbers even, since the active channel lists
+         * alternate between frames. */
+        shift = ngs->bp_table[root].frame & ~1;
+    }
+    else
+        shift = 0;
+    start = (root == NO_BP) ? 0 : root;
+
+    /* Compact the backpointer table and score stack to the live
+     * entries (and the root), reusing nleaf for the new indices. */
+    bpmap = nleaf;
+    bss_head = 0;
+    for (i = 0; i < start; ++i)
+        bpmap[i] = NO_BP;
+    for (i = start, j = 0; i < ngs->bpidx; ++i) {
+        bptbl_t *be = ngs->bp_table + i;
+
+        if (nleaf[i] == 0) {
+            bpmap[i] = NO_BP;
+            continue;
+        }
+        bpmap[i] = j;
+        if (be->s_idx != -1) {
+            int32 rcsize = dict2pid_rssid(ps_search_dict2pid(ngs),
+                                          be->last_phone,
+                                          be->last2_phone)->n_ssid;
+            memmove(ngs->bscore_stack + bss_head,
+                    ngs->bscore_stack + be->s_idx,
+                    rcsize * sizeof(*ngs->bscore_stack));
+            be->s_idx = bss_head;
+            bss_head += rcsize;
+        }
+        if (i == root)
+            be->bp = NO_BP;
+        else if (be->bp != NO_BP)
+            be->bp = bpmap[be->bp];
+        be->frame -= shift;
+        ngs->bp_table[j++] = *be;
+    }
+    E_DEBUG(1, ("Committed %d frames, kept %d of %d backpointers\n",
+                shift, j, ngs->bpidx));
+    n_bp = ngs->bpidx;
+    ngs->bpidx = j;
+    ngs->bss_head = bss_head;
+    if (root >= ngs->bp_first)
+        ngs->bp_first = 1;
+    /* The cached traceback refers to the old numbering. */
+    ps_search_trace_reset(ps_search_base(ngs));
+
+    /* Rebuild the frame index. */
+    ngs->n_frame -= shift;
+    ngs->frame_offset += shift;
+    for (i = -1, j = 0; i < ngs->n_frame; ++i) {
+        while (j < ngs->bpidx && ngs->bp_table[j].frame < i)
+            ++j;
+        ngs->bp_table_idx[i] = j;
+    }
+
+    /* Cached last phone transitions are only valid for live frames,
+     * where all word exits are kept. */
+    for (i = 0; i < ps_search_n_words(ngs); ++i) {
+        last_ltrans_t *lt = ngs->last_ltrans + i;
+
+        if (lt->sf > 0 && bitvec_is_set(live, lt->sf - 1)) {
+            lt->sf -= shift;
+            lt->bp = (lt->bp >= 0 && lt->bp < n_bp) ? bpmap[lt->bp] : NO_BP;
+        }
+        else
+            lt->sf = -1;
+    }
+
+    *out_shift = shift;
+    return bpmap;
+}
+
 static ps_seg_t *
 ngram_search_seg_iter(ps_search_t *search, int32 *out_score)
 {
@@ -1242,6 +1627,12 @@ ngram_search_lattice(ps_search_t *search)
     ngs = (ngram_search_t *)search;
     min_endfr = cmd_ln_int32_r(ps_search_config(search), "-min_endfr");
 
+    /* The backpointer table no longer covers the whole utterance. */
+    if (ngs->commitwin > 0) {
+        E_ERROR("Word lattice is not available when committing words (-commitwin)\n");
+        return NULL;
+    }
+
     /* If the best score is WORST_SCORE or worse, there is no way to
      * make a lattice. */
     if (ngs->best_score == WORST_SCORE || ngs->best_score WORSE_THAN WORST_SCORE)
@@ -47,11 +47,13 @@
 #include <sphinxbase/logmath.h>
 #include <sphinxbase/ngram_model.h>
 #include <sphinxbase/listelem_alloc.h>
+#include <sphinxbase/hash_table.h>
 #include <sphinxbase/err.h>
 
 /* Local headers. */
 #include "pocketsphinx_internal.h"
 #include "hmm.h"
+#include "thread_pool.h"
 
 /**
  * Lexical tree node data type.
@@ -120,6 +122,16 @@ typedef struct bptbl_s {
     int16    last2_phone;       /**< next-to-last phone of this word */
 } bptbl_t;
 
+/**
+ * Word committed by continuous decoding, with its start and end frame
+ * counted from the start of the utterance.
+ */
+typedef struct commit_seg_s {
+    char const *word;
+    int32 sf, ef;
+    int32 ascr, lscr, lback;
+} commit_seg_t;
+
 /**
  * Segmentation "iterator" for backpointer table results.
  */
@@ -231,10 +243,33 @@ struct ngram_search_s {
     root_chan_t *root_chan;  /**< Roots of search tree. */
     int32 n_root_chan_alloc; /**< Number of root_chan allocated */
     int32 n_root_chan;       /**< Number of valid root_chan */
+    /**
+     * Non-root channels of the search tree, in breadth-first order.
+     * The children of each channel are contiguous, so its next and
+     * alt pointers walk forward through this array.  Channels for
+     * words added to the tree after it was built follow at the end.
+     */
+    chan_t *nonroot_chan;
     int32 n_nonroot_chan;    /**< Number of valid non-root channels */
+    int32 n_nonroot_chan_alloc; /**< Number of non-root channels allocated */
     int32 max_nonroot_chan;  /**< Maximum possible number of non-root channels */
     root_chan_t *rhmm_1ph;   /**< Root HMMs for single-phone words */
 
+    /**
+     * Search trees built for other language models in lmset, keyed
+     * by name, so that switching back to one does not require
+     * rebuilding it.
+     */
+    hash_table_t *tree_cache;
+    ngram_model_t *tree_lm;  /**< Language model the search tree is for
+                                (NULL if interpolated), retained */
+    char *tree_lmname;       /**< Name of tree_lm in lmset */
+
+    /* What the word mapping in lmset was last built for. */
+    ngram_model_t *widmap_lmset;
+    int32 widmap_n_models;
+    int32 widmap_n_words;
+
     /**
      * Channels associated with a given word (only used for right
      * contexts, single-phone words in fwdtree search, and word HMMs
@@ -269,10 +304,10 @@ struct ngram_search_s {
      * Array of active channels for current and next frame.
      *
      * In any frame, only some HMM tree nodes are active.
-     * active_chan_list[f mod 2] = list of nonroot channels in the HMM
-     * tree active in frame f.
+     * active_chan_list[f mod 2] = list of indices in nonroot_chan of
+     * channels in the HMM tree active in frame f.
      */
-    chan_t ***active_chan_list;
+    int32 **active_chan_list;
     int32 n_active_chan[2];  /**< Number entries in active_chan_list */
     /**
      * Array of active multi-phone words for current and next frame.
@@ -293,6 +328,8 @@ struct ngram_search_s {
     lastphn_cand_t *lastphn_cand;
     int32 n_lastphn_cand;
     last_ltrans_t *last_ltrans;      /* one per word */
+    int32 *lm_batch_wid;   /**< LM word IDs for ngram_ng_score_batch() */
+    int32 *lm_batch_scr;   /**< LM scores from ngram_ng_score_batch() */
     int32 cand_sf_alloc;
     cand_sf_t *cand_sf;
     bestbp_rc_t *bestbp_rc;
@@ -310,6 +347,20 @@ struct ngram_search_s {
     int32 *word_lat_idx; /* BPTable index for any word in current frame;
                             cleared before each frame */
 
+    /*
+     * Continuous decoding: words on which all active paths agree are
+     * committed and the backpointer table is trimmed to the rest.
+     */
+    int32 commitwin;     /**< Frames between commits, or 0 for none. */
+    int32 frame_offset;  /**< Frames removed from the start of the
+                            backpointer table so far. */
+    int32 bp_first;      /**< First backpointer not yet committed. */
+    commit_seg_t *commit_seg; /**< Committed words not yet fetched. */
+    int32 n_commit_seg;
+    int32 n_commit_seg_alloc;
+    int32 *bp_map;       /**< Old to new backpointer indices in a commit. */
+    int32 bp_map_alloc;
+
     /*
      * Flat lexicon (2nd pass) search stuff.
      */
@@ -322,6 +373,22 @@ struct ngram_search_s {
     int32 max_sf_win;
     float32 fwdflat_fwdtree_lw_ratio;
 
+    /*
+     * Pipelined flat lexicon search (-fwdflatlag), which runs in
+     * another thread on the word lattice as fwdtree produces it.
+     */
+    int32 fwdflat_lag;     /**< Frames by which it follows fwdtree. */
+    struct ngram_search_s *flat; /**< The flat lexicon search, if any. */
+    thread_pool_t *flat_thread;  /**< Thread running it (or NULL). */
+    int32 flat_bpidx;      /**< First backpointer not yet passed to it. */
+    int32 flat_sync_frame; /**< Last frame at which it was passed data. */
+    /* In the flat lexicon search itself: */
+    uint8 pipelined;       /**< Word lattice is fed by another search. */
+    uint8 fed_final;       /**< All of the word lattice has been fed. */
+    int32 n_fed_frame;     /**< Frames of word lattice fed so far. */
+    int32 n_fwdflat_word;  /**< Number of words in fwdflat_wordlist. */
+    bitvec_t *fwdflat_word_flag; /**< Words in fwdflat_wordlist. */
+
     int32 best_score; /**< Best Viterbi path score. */
     int32 last_phone_best_score; /**< Best Viterbi path score for last phone. */
     int32 renormalized;
@@ -365,11 +432,38 @@ ps_search_t *ngram_search_init(cmd_ln_t *config,
                                dict_t *dict,
                                dict2pid_t *d2p);
 
+/**
+ * Initialize the N-Gram search module with a language model set.
+ *
+ * @param lmset Language model set, which is owned by the search from
+ * now on (whether or not this function succeeds).
+ */
+ps_search_t *ngram_search_init_lmset(cmd_ln_t *config,
+                                     acmod_t *acmod,
+                                     dict_t *dict,
+                                     dict2pid_t *d2p,
+                                     ngram_model_t *lmset);
+
 /**
  * Finalize the N-Gram search module.
  */
 void ngram_search_free(ps_search_t *ngs);
 
+/**
+ * Create the fwdflat search which follows fwdtree with -fwdflatlag.
+ *
+ * @return 0 for success, <0 on error.
+ */
+int ngram_search_init_flat(ngram_search_t *ngs);
+
+/**
+ * Free the fwdflat search which follows fwdtree, if there is one.
+ *
+ * It shares the acoustic model parameters, so it has to go before
+ * they can be adapted, and be created again afterwards.
+ */
+void ngram_search_free_flat(ngram_search_t *ngs);
+
 /**
  * Record the current frame's index in the backpointer table.
  *
@@ -377,12 +471,42 @@ void ngram_search_free(ps_search_t *ngs);
  */
 int ngram_search_mark_bptable(ngram_search_t *ngs, int frame_idx);
 
+/**
+ * Make room for frame_idx in the backpointer table index and the
+ * fwdflat word lattice.
+ */
+void ngram_search_alloc_frames(ngram_search_t *ngs, int frame_idx);
+
 /**
  * Enter a word in the backpointer table.
  */
 void ngram_search_save_bp(ngram_search_t *ngs, int frame_idx, int32 w,
                           int32 score, int32 path, int32 rc);
 
+/**
+ * Commit words and compact the backpointer table.
+ *
+ * All entries ending in a frame marked in <code>live</code> (and
+ * their predecessors) are kept, the rest are discarded.  If the kept
+ * entries share a common predecessor, it and the words before it are
+ * committed, and frames before it are removed from the table.
+ *
+ * @param live Frames whose word exits may still be used by the search.
+ * @param out_shift Output: number of frames removed.
+ * @return mapping of old to new backpointer indices, with NO_BP for
+ * discarded entries, or NULL if the table was not changed.  It stays
+ * valid until the next call.
+ */
+int32 const *ngram_search_commit(ngram_search_t *ngs, bitvec_t *live,
+                                 int *out_shift);
+
+/**
+ * Get an iterator over the words committed since the last call.
+ *
+ * @return iterator, or NULL if there are none.
+ */
+ps_seg_t *ngram_search_commit_iter(ngram_search_t *ngs);
+
 /**
  * Allocate last phone channels for all possible right contexts for word w.
  */
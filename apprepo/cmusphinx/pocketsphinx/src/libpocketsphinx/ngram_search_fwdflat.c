@@ -156,8 +156,14 @@ ngram_fwdflat_init(ngram_search_t *ngs)
     E_INFO("fwdflat: min_ef_width = %d, max_sf_win = %d\n",
            ngs->min_ef_width, ngs->max_sf_win);
 
+    /* Fed by a tree search in another thread; the word list is built
+     * up as the lattice arrives. */
+    if (ngs->pipelined) {
+        ngs->fwdflat_word_flag = bitvec_alloc(n_words);
+        ngram_fwdflat_allocate_1ph(ngs);
+    }
     /* No tree-search; pre-build the expansion list, including all LM words. */
-    if (!ngs->fwdtree) {
+    else if (!ngs->fwdtree) {
         /* Build full expansion list from LM words. */
         ngram_fwdflat_expand_all(ngs);
         /* Allocate single phone words. */
@@ -171,12 +177,15 @@ ngram_fwdflat_deinit(ngram_search_t *ngs)
     double n_speech = (double)ngs->n_tot_frame
             / cmd_ln_int32_r(ps_search_config(ngs), "-frate");
 
-    E_INFO("TOTAL fwdflat %.2f CPU %.3f xRT\n",
-           ngs->fwdflat_perf.t_tot_cpu,
-           ngs->fwdflat_perf.t_tot_cpu / n_speech);
-    E_INFO("TOTAL fwdflat %.2f wall %.3f xRT\n",
-           ngs->fwdflat_perf.t_tot_elapsed,
-           ngs->fwdflat_perf.t_tot_elapsed / n_speech);
+    /* A pipelined search's totals are reported by the one it follows. */
+    if (!ngs->pipelined) {
+        E_INFO("TOTAL fwdflat %.2f CPU %.3f xRT\n",
+               ngs->fwdflat_perf.t_tot_cpu,
+               ngs->fwdflat_perf.t_tot_cpu / n_speech);
+        E_INFO("TOTAL fwdflat %.2f wall %.3f xRT\n",
+               ngs->fwdflat_perf.t_tot_elapsed,
+               ngs->fwdflat_perf.t_tot_elapsed / n_speech);
+    }
 
     /* Free single-phone words if we allocated them. */
     if (!ngs->fwdtree) {
@@ -184,6 +193,7 @@ ngram_fwdflat_deinit(ngram_search_t *ngs)
     }
     ckd_free(ngs->fwdflat_wordlist);
     bitvec_free(ngs->expand_word_flag);
+    bitvec_free(ngs->fwdflat_word_flag);
     ckd_free(ngs->expand_word_list);
     ckd_free(ngs->frm_wordlist);
 }
@@ -231,6 +241,17 @@ build_fwdflat_wordlist(ngram_search_t *ngs)
     bptbl_t *bp;
     ps_latnode_t *node, *prevnode, *nextnode;
 
+    /* Pipelined search, start with an empty wordlist. */
+    if (ngs->pipelined) {
+        memset(ngs->frm_wordlist, 0,
+               ngs->n_frame_alloc * sizeof(*ngs->frm_wordlist));
+        bitvec_clear_all(ngs->fwdflat_word_flag, ps_search_n_words(ngs));
+        ngs->fwdflat_wordlist[0] = -1;
+        ngs->n_fwdflat_word = 0;
+        ngs->n_fed_frame = 0;
+        ngs->fed_final = FALSE;
+        return;
+    }
     /* No tree-search, use statically allocated wordlist. */
     if (!ngs->fwdtree)
         return;
@@ -306,12 +327,12 @@ build_fwdflat_wordlist(ngram_search_t *ngs)
 }
 
 /**
- * Build HMM network for one utterance of fwdflat search.
+ * Build HMMs for one word of the fwdflat search.
  */
 static void
-build_fwdflat_chan(ngram_search_t *ngs)
+build_fwdflat_word_chan(ngram_search_t *ngs, int32 wid)
 {
-    int32 i, wid, p;
+    int32 p;
     root_chan_t *rhmm;
     chan_t *hmm, *prevhmm;
     dict_t *dict;
@@ -320,57 +341,64 @@ build_fwdflat_chan(ngram_search_t *ngs)
     dict = ps_search_dict(ngs);
     d2p = ps_search_dict2pid(ngs);
 
-    /* Build word HMMs for each word in the lattice. */
-    for (i = 0; ngs->fwdflat_wordlist[i] >= 0; i++) {
-        wid = ngs->fwdflat_wordlist[i];
-
-        /* Single-phone words are permanently allocated */
-        if (dict_is_single_phone(dict, wid))
-            continue;
-
-        assert(ngs->word_chan[wid] == NULL);
-
-        /* Multiplex root HMM for first phone (one root per word, flat
-         * lexicon).  diphone is irrelevant here, for the time being,
-         * at least. */
-        rhmm = listelem_malloc(ngs->root_chan_alloc);
-        rhmm->ci2phone = dict_second_phone(dict, wid);
-        rhmm->ciphone = dict_first_phone(dict, wid);
-        rhmm->next = NULL;
-        hmm_init(ngs->hmmctx, &rhmm->hmm, TRUE,
-                 bin_mdef_pid2ssid(ps_search_acmod(ngs)->mdef, rhmm->ciphone),
-                 bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, rhmm->ciphone));
-
-        /* HMMs for word-internal phones */
-        prevhmm = NULL;
-        for (p = 1; p < dict_pronlen(dict, wid) - 1; p++) {
-            hmm = listelem_malloc(ngs->chan_alloc);
-            hmm->ciphone = dict_pron(dict, wid, p);
-            hmm->info.rc_id = (p == dict_pronlen(dict, wid) - 1) ? 0 : -1;
-            hmm->next = NULL;
-            hmm_init(ngs->hmmctx, &hmm->hmm, FALSE,
-                     dict2pid_internal(d2p,wid,p), 
-		     bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, hmm->ciphone));
-
-            if (prevhmm)
-                prevhmm->next = hmm;
-            else
-                rhmm->next = hmm;
-
-            prevhmm = hmm;
-        }
+    /* Single-phone words are permanently allocated */
+    if (dict_is_single_phone(dict, wid))
+        return;
 
-        /* Right-context phones */
-        ngram_search_alloc_all_rc(ngs, wid);
+    assert(ngs->word_chan[wid] == NULL);
+
+    /* Multiplex root HMM for first phone (one root per word, flat
+     * lexicon).  diphone is irrelevant here, for the time being,
+     * at least. */
+    rhmm = listelem_malloc(ngs->root_chan_alloc);
+    rhmm->ci2phone = dict_second_phone(dict, wid);
+    rhmm->ciphone = dict_first_phone(dict, wid);
+    rhmm->next = NULL;
+    hmm_init(ngs->hmmctx, &rhmm->hmm, TRUE,
+             bin_mdef_pid2ssid(ps_search_acmod(ngs)->mdef, rhmm->ciphone),
+             bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, rhmm->ciphone));
+
+    /* HMMs for word-internal phones */
+    prevhmm = NULL;
+    for (p = 1; p < dict_pronlen(dict, wid) - 1; p++) {
+        hmm = listelem_malloc(ngs->chan_alloc);
+        hmm->ciphone = dict_pron(dict, wid, p);
+        hmm->info.rc_id = (p == dict_pronlen(dict, wid) - 1) ? 0 : -1;
+        hmm->next = NULL;
+        hmm_init(ngs->hmmctx, &hmm->hmm, FALSE,
+                 dict2pid_internal(d2p,wid,p), 
+                 bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, hmm->ciphone));
 
-        /* Link in just allocated right-context phones */
         if (prevhmm)
-            prevhmm->next = ngs->word_chan[wid];
+            prevhmm->next = hmm;
         else
-            rhmm->next = ngs->word_chan[wid];
-        ngs->word_chan[wid] = (chan_t *) rhmm;
+            rhmm->next = hmm;
+
+        prevhmm = hmm;
     }
 
+    /* Right-context phones */
+    ngram_search_alloc_all_rc(ngs, wid);
+
+    /* Link in just allocated right-context phones */
+    if (prevhmm)
+        prevhmm->next = ngs->word_chan[wid];
+    else
+        rhmm->next = ngs->word_chan[wid];
+    ngs->word_chan[wid] = (chan_t *) rhmm;
+}
+
+/**
+ * Build HMM network for one utterance of fwdflat search.
+ */
+static void
+build_fwdflat_chan(ngram_search_t *ngs)
+{
+    int32 i;
+
+    /* Build word HMMs for each word in the lattice. */
+    for (i = 0; ngs->fwdflat_wordlist[i] >= 0; i++)
+        build_fwdflat_word_chan(ngs, ngs->fwdflat_wordlist[i]);
 }
 
 void
@@ -386,6 +414,8 @@ ngram_fwdflat_start(ngram_search_t *ngs)
 
     ngs->bpidx = 0;
     ngs->bss_head = 0;
+    /* Backpointer IDs from the first pass are about to be reused. */
+    ps_search_trace_reset(ps_search_base(ngs));
 
     for (i = 0; i < ps_search_n_words(ngs); i++)
         ngs->word_lat_idx[i] = NO_BP;
@@ -609,29 +639,47 @@ fwdflat_prune_chan(ngram_search_t *ngs, int frame_idx)
     }
 }
 
+/**
+ * Check if a word in a pipelined search's lattice would have passed
+ * the filtering in build_fwdflat_wordlist().
+ */
+static int
+fwdflat_node_ok(ngram_search_t *ngs, ps_latnode_t *node)
+{
+    if (node->lef - node->fef < ngs->min_ef_width)
+        return FALSE;
+    /* </s> has to end in the last frame, which is not known yet. */
+    if (node->wid == ps_search_finish_wid(ngs))
+        return ngs->fed_final && node->lef == ngs->n_fed_frame - 1;
+    return TRUE;
+}
+
 static void
 get_expand_wordlist(ngram_search_t *ngs, int32 frm, int32 win)
 {
-    int32 f, sf, ef;
+    int32 f, sf, ef, n_frame;
     ps_latnode_t *node;
 
-    if (!ngs->fwdtree) {
+    if (!ngs->fwdtree && !ngs->pipelined) {
         ngs->st.n_fwdflat_word_transition += ngs->n_expand_words;
         return;
     }
 
+    n_frame = ngs->pipelined ? ngs->n_fed_frame : ngs->n_frame;
     sf = frm - win;
     if (sf < 0)
         sf = 0;
     ef = frm + win;
-    if (ef > ngs->n_frame)
-        ef = ngs->n_frame;
+    if (ef > n_frame)
+        ef = n_frame;
 
     bitvec_clear_all(ngs->expand_word_flag, ps_search_n_words(ngs));
     ngs->n_expand_words = 0;
 
     for (f = sf; f < ef; f++) {
         for (node = ngs->frm_wordlist[f]; node; node = node->next) {
+            if (ngs->pipelined && !fwdflat_node_ok(ngs, node))
+                continue;
             if (!bitvec_is_set(ngs->expand_word_flag, node->wid)) {
                 ngs->expand_word_list[ngs->n_expand_words++] = node->wid;
                 bitvec_set(ngs->expand_word_flag, node->wid);
@@ -665,11 +713,13 @@ fwdflat_word_transition(ngram_search_t *ngs, int frame_idx)
     /* Search for all words starting within a window of this frame.
      * These are the successors for words exiting now. */
     get_expand_wordlist(ngs, cf, ngs->max_sf_win);
+    for (i = 0; i < ngs->n_expand_words; i++)
+        ngs->lm_batch_wid[i] = dict_basewid(dict, ngs->expand_word_list[i]);
 
     /* Scan words exited in current frame */
     for (b = ngs->bp_table_idx[cf]; b < ngs->bpidx; b++) {
         xwdssid_t *rssid;
-        int32 silscore;
+        int32 silscore, hist[2];
 
         bp = ngs->bp_table + b;
         ngs->word_lat_idx[bp->wid] = NO_BP;
@@ -686,10 +736,13 @@ fwdflat_word_transition(ngram_search_t *ngs, int frame_idx)
         else
             rssid = dict2pid_rssid(d2p, bp->last_phone, bp->last2_phone);
 
-        /* Transition to all successor words. */
+        /* Transition to all successor words, with their LM scores
+         * looked up at once. */
+        hist[0] = bp->real_wid;
+        hist[1] = bp->prev_real_wid;
+        ngram_ng_score_batch(ngs->lmset, ngs->lm_batch_wid, ngs->n_expand_words,
+                             hist, 2, ngs->lm_batch_scr);
         for (i = 0; ngs->expand_word_list[i] >= 0; i++) {
-            int32 n_used;
-
             w = ngs->expand_word_list[i];
 
             /* Get the exit score we recorded in save_bwd_ptr(), or
@@ -701,12 +754,7 @@ fwdflat_word_transition(ngram_search_t *ngs, int frame_idx)
             if (newscore == WORST_SCORE)
                 continue;
             /* FIXME: Floating point... */
-            newscore += lwf
-                * (ngram_tg_score(ngs->lmset,
-                                  dict_basewid(dict, w),
-                                  bp->real_wid,
-                                  bp->prev_real_wid,
-                                  &n_used) >> SENSCR_SHIFT);
+            newscore += lwf * (ngs->lm_batch_scr[i] >> SENSCR_SHIFT);
             newscore += pip;
 
             /* Enter the next word */
@@ -850,9 +898,13 @@ ngram_fwdflat_search(ngram_search_t *ngs, int frame_idx)
     nf = frame_idx + 1;
     nawl = ngs->active_word_list[nf & 0x1];
     for (i = 0, j = 0; ngs->fwdflat_wordlist[i] >= 0; i++) {
-        if (bitvec_is_set(ngs->word_active, ngs->fwdflat_wordlist[i])) {
-            *(nawl++) = ngs->fwdflat_wordlist[i];
+        int32 wid = ngs->fwdflat_wordlist[i];
+        if (bitvec_is_set(ngs->word_active, wid)) {
+            *(nawl++) = wid;
             j++;
+            /* The start word and fillers may be in the word list too,
+             * don't add (and evaluate) them twice. */
+            bitvec_clear(ngs->word_active, wid);
         }
     }
     for (i = ps_search_start_wid(ngs); i < ps_search_n_words(ngs); i++) {
@@ -876,12 +928,13 @@ static void
 destroy_fwdflat_wordlist(ngram_search_t *ngs)
 {
     ps_latnode_t *node, *tnode;
-    int32 f;
+    int32 f, n_frame;
 
-    if (!ngs->fwdtree)
+    if (!ngs->fwdtree && !ngs->pipelined)
         return;
 
-    for (f = 0; f < ngs->n_frame; f++) {
+    n_frame = ngs->pipelined ? ngs->n_fed_frame : ngs->n_frame;
+    for (f = 0; f < n_frame; f++) {
         for (node = ngs->frm_wordlist[f]; node; node = tnode) {
             tnode = node->next;
             listelem_free(ngs->latnode_alloc, node);
@@ -956,3 +1009,189 @@ ngram_fwdflat_finish(ngram_search_t *ngs)
                ngs->fwdflat_perf.t_elapsed / n_speech);
     }
 }
+
+/**
+ * How many frames of fwdtree search to let pass between handing
+ * things over to the pipelined fwdflat search.
+ */
+#define FWDFLAT_SYNC_FRAMES 10
+
+/**
+ * Add a word to the pipelined search's vocabulary.
+ */
+static void
+fwdflat_add_word(ngram_search_t *flat, int32 wid)
+{
+    bitvec_set(flat->fwdflat_word_flag, wid);
+    flat->fwdflat_wordlist[flat->n_fwdflat_word++] = wid;
+    flat->fwdflat_wordlist[flat->n_fwdflat_word] = -1;
+    build_fwdflat_word_chan(flat, wid);
+}
+
+/**
+ * Hand the fwdtree search's new backpointers and feature frames over
+ * to the pipelined fwdflat search, which must not be running.
+ */
+static void
+fwdflat_feed(ngram_search_t *ngs, int final)
+{
+    ngram_search_t *flat = ngs->flat;
+    acmod_t *acmod = ps_search_acmod(flat);
+    int32 i, f, sf, ef, wid, limit;
+    bptbl_t *bp;
+    ps_latnode_t *node;
+
+    /* Update the word lattice, as in build_fwdflat_wordlist(). */
+    for (i = ngs->flat_bpidx, bp = ngs->bp_table + i; i < ngs->bpidx; i++, bp++) {
+        sf = (bp->bp < 0) ? 0 : ngs->bp_table[bp->bp].frame + 1;
+        ef = bp->frame;
+        wid = bp->wid;
+
+        if (!ngram_model_set_known_wid(flat->lmset,
+                                       dict_basewid(ps_search_dict(flat), wid)))
+            continue;
+
+        ngram_search_alloc_frames(flat, sf);
+        for (node = flat->frm_wordlist[sf]; node && (node->wid != wid);
+             node = node->next);
+        if (node)
+            node->lef = ef;
+        else {
+            node = listelem_malloc(flat->latnode_alloc);
+            node->wid = wid;
+            node->fef = node->lef = ef;
+
+            node->next = flat->frm_wordlist[sf];
+            flat->frm_wordlist[sf] = node;
+        }
+        if (!bitvec_is_set(flat->fwdflat_word_flag, wid)
+            && fwdflat_node_ok(flat, node))
+            fwdflat_add_word(flat, wid);
+    }
+    ngs->flat_bpidx = ngs->bpidx;
+    flat->n_fed_frame = ngs->n_frame;
+    ngram_search_alloc_frames(flat, flat->n_fed_frame);
+
+    /* The final frame is known, so </s> can go in now. */
+    if (final) {
+        flat->fed_final = TRUE;
+        for (f = 0; f < flat->n_fed_frame; f++) {
+            for (node = flat->frm_wordlist[f]; node; node = node->next) {
+                if (!bitvec_is_set(flat->fwdflat_word_flag, node->wid)
+                    && fwdflat_node_ok(flat, node))
+                    fwdflat_add_word(flat, node->wid);
+            }
+        }
+    }
+
+    /* Stay far enough behind to see words starting near each frame. */
+    limit = final ? ngs->n_frame : ngs->n_frame - ngs->fwdflat_lag;
+    while (acmod->output_frame + acmod->n_feat_frame < limit) {
+        f = acmod->output_frame + acmod->n_feat_frame;
+        if (acmod_process_feat(acmod,
+                               acmod_get_frame(ps_search_acmod(ngs), &f)) == 0)
+            break;
+    }
+}
+
+/**
+ * Search all the frames fed to the pipelined fwdflat search.
+ */
+static void
+fwdflat_pipeline_job(void *arg, int part, int n_part)
+{
+    ngram_search_t *flat = arg;
+    acmod_t *acmod = ps_search_acmod(flat);
+
+    while (acmod->n_feat_frame > 0) {
+        if (ngram_fwdflat_search(flat, acmod->output_frame) < 0)
+            break;
+        acmod_advance(acmod);
+    }
+}
+
+void
+ngram_fwdflat_pipeline_start(ngram_search_t *ngs)
+{
+    ngram_search_t *flat = ngs->flat;
+    char const *lmname;
+
+    if (ngs->flat_thread)
+        thread_pool_wait(ngs->flat_thread);
+    /* Both searches score the same language models from now until
+     * the end of the utterance, so stop caching in them. */
+    ngram_model_set_share(flat->lmset, TRUE);
+    /* Follow any change of language model. */
+    if ((lmname = ngram_model_set_current(ngs->lmset)) != NULL)
+        ngram_model_set_select(flat->lmset, lmname);
+    else
+        ngram_model_set_interp(flat->lmset, NULL, NULL);
+    ngram_model_flush(flat->lmset);
+    flat->done = FALSE;
+    acmod_start_utt(ps_search_acmod(flat));
+    ngs->flat_bpidx = 0;
+    ngs->flat_sync_frame = 0;
+    ngram_fwdflat_start(flat);
+}
+
+void
+ngram_fwdflat_pipeline_step(ngram_search_t *ngs)
+{
+    if (ngs->n_frame - ngs->flat_sync_frame < FWDFLAT_SYNC_FRAMES)
+        return;
+    if (ngs->flat_thread)
+        thread_pool_wait(ngs->flat_thread);
+    fwdflat_feed(ngs, FALSE);
+    ngs->flat_sync_frame = ngs->n_frame;
+    if (ngs->flat_thread)
+        thread_pool_start(ngs->flat_thread, fwdflat_pipeline_job, ngs->flat);
+    else
+        fwdflat_pipeline_job(ngs->flat, 0, 1);
+}
+
+void
+ngram_fwdflat_pipeline_finish(ngram_search_t *ngs)
+{
+    ngram_search_t *flat = ngs->flat;
+    bptbl_t *bp_table;
+    int32 *bscore_stack;
+    int32 tmp;
+
+    if (ngs->flat_thread)
+        thread_pool_wait(ngs->flat_thread);
+    fwdflat_feed(ngs, TRUE);
+    fwdflat_pipeline_job(flat, 0, 1);
+    ngram_fwdflat_finish(flat);
+    flat->n_tot_frame += flat->n_frame;
+    ngram_model_set_share(flat->lmset, FALSE);
+
+    /* Take over the fwdflat backpointer table, as if fwdflat search
+     * had been run in this search after fwdtree. */
+    bp_table = ngs->bp_table;
+    ngs->bp_table = flat->bp_table;
+    flat->bp_table = bp_table;
+    tmp = ngs->bp_table_size;
+    ngs->bp_table_size = flat->bp_table_size;
+    flat->bp_table_size = tmp;
+    bscore_stack = ngs->bscore_stack;
+    ngs->bscore_stack = flat->bscore_stack;
+    flat->bscore_stack = bscore_stack;
+    tmp = ngs->bscore_stack_size;
+    ngs->bscore_stack_size = flat->bscore_stack_size;
+    flat->bscore_stack_size = tmp;
+    tmp = ngs->bpidx;
+    ngs->bpidx = flat->bpidx;
+    flat->bpidx = tmp;
+    tmp = ngs->bss_head;
+    ngs->bss_head = flat->bss_head;
+    flat->bss_head = tmp;
+
+    ngram_search_alloc_frames(ngs, flat->n_frame);
+    memcpy(ngs->bp_table_idx - 1, flat->bp_table_idx - 1,
+           (flat->n_frame + 2) * sizeof(*ngs->bp_table_idx));
+    ngs->n_frame = flat->n_frame;
+    ngs->renormalized = flat->renormalized;
+    ngs->best_score = flat->best_score;
+    ngs->fwdflat_perf = flat->fwdflat_perf;
+    ps_search_trace_reset(ps_search_base(ngs));
+}
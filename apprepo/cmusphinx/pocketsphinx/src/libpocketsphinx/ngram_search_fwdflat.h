@@ -77,5 +77,21 @@ int ngram_fwdflat_search(ngram_search_t *ngs, int frame_idx);
  */
 void ngram_fwdflat_finish(ngram_search_t *ngs);
 
+/**
+ * Start the pipelined fwdflat search for an utterance.
+ */
+void ngram_fwdflat_pipeline_start(ngram_search_t *ngs);
+
+/**
+ * Pass new frames and words from fwdtree to the pipelined fwdflat
+ * search (called after each frame of fwdtree search).
+ */
+void ngram_fwdflat_pipeline_step(ngram_search_t *ngs);
+
+/**
+ * Finish the pipelined fwdflat search and take over its result.
+ */
+void ngram_fwdflat_pipeline_finish(ngram_search_t *ngs);
+
 
 #endif /* __NGRAM_SEARCH_FWDFLAT_H__ */
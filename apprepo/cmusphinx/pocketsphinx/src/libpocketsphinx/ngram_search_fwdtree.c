@@ -123,29 +123,51 @@ init_search_tree(ngram_search_t *ngs)
         ngs->root_chan[i].next = NULL;
     }
 
-    /* Permanently allocate and initialize channels for single-phone
-     * words (1/word). */
-    ngs->rhmm_1ph = ckd_calloc(ngs->n_1ph_words, sizeof(*ngs->rhmm_1ph));
-    i = 0;
-    for (w = 0; w < n_words; w++) {
+    ngs->single_phone_wid = ckd_calloc(ngs->n_1ph_words,
+                                       sizeof(*ngs->single_phone_wid));
+    E_INFO("%d root, %d non-root channels, %d single-phone words\n",
+           ngs->n_root_chan, ngs->n_nonroot_chan, ngs->n_1ph_words);
+}
+
+/*
+ * Initialize the channel for a single-phone word.
+ */
+static void
+init_1ph_chan(ngram_search_t *ngs, root_chan_t *rhmm, int32 w)
+{
+    bin_mdef_t *mdef = ps_search_acmod(ngs)->mdef;
+
+    /* Use SIL as right context for these. */
+    rhmm->ci2phone = bin_mdef_silphone(mdef);
+    rhmm->ciphone = dict_first_phone(ps_search_dict(ngs), w);
+    hmm_init(ngs->hmmctx, &rhmm->hmm, TRUE,
+             bin_mdef_pid2ssid(mdef, rhmm->ciphone),
+             bin_mdef_pid2tmatid(mdef, rhmm->ciphone));
+    rhmm->next = NULL;
+}
+
+/*
+ * Permanently allocate and initialize channels for single-phone words
+ * (1/word), which are not part of the search tree.
+ */
+static void
+alloc_1ph_chan(ngram_search_t *ngs)
+{
+    int32 w, i, n_words;
+    dict_t *dict = ps_search_dict(ngs);
+
+    n_words = ps_search_n_words(ngs);
+    for (i = w = 0; w < n_words; w++)
+        if (dict_is_single_phone(dict, w))
+            ++i;
+    ngs->rhmm_1ph = ckd_calloc(i, sizeof(*ngs->rhmm_1ph));
+    for (i = w = 0; w < n_words; w++) {
         if (!dict_is_single_phone(dict, w))
             continue;
-        /* Use SIL as right context for these. */
-        ngs->rhmm_1ph[i].ci2phone = bin_mdef_silphone(ps_search_acmod(ngs)->mdef);
-        ngs->rhmm_1ph[i].ciphone = dict_first_phone(dict, w);
-        hmm_init(ngs->hmmctx, &ngs->rhmm_1ph[i].hmm, TRUE,
-                 bin_mdef_pid2ssid(ps_search_acmod(ngs)->mdef, ngs->rhmm_1ph[i].ciphone),
-                 bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, ngs->rhmm_1ph[i].ciphone));
-        ngs->rhmm_1ph[i].next = NULL;
-
+        init_1ph_chan(ngs, &ngs->rhmm_1ph[i], w);
         ngs->word_chan[w] = (chan_t *) &(ngs->rhmm_1ph[i]);
         i++;
     }
-
-    ngs->single_phone_wid = ckd_calloc(ngs->n_1ph_words,
-                                       sizeof(*ngs->single_phone_wid));
-    E_INFO("%d root, %d non-root channels, %d single-phone words\n",
-           ngs->n_root_chan, ngs->n_nonroot_chan, ngs->n_1ph_words);
 }
 
 /*
@@ -161,6 +183,267 @@ init_nonroot_chan(ngram_search_t *ngs, chan_t * hmm, int32 ph, int32 ci, int32 t
     hmm_init(ngs->hmmctx, &hmm->hmm, FALSE, ph, tmatid);
 }
 
+/*
+ * Get a new internal channel in the HMM tree.  While the tree is being
+ * built it comes from the list allocator, to be flattened later.
+ * When adding words to a flattened tree it comes from the end of
+ * nonroot_chan, which the caller has made room for with
+ * grow_nonroot_chan().
+ */
+static chan_t *
+new_nonroot_chan(ngram_search_t *ngs, int32 ph, int32 ci, int32 tmatid)
+{
+    chan_t *hmm;
+
+    if (ngs->nonroot_chan) {
+        assert(ngs->n_nonroot_chan < ngs->n_nonroot_chan_alloc);
+        hmm = ngs->nonroot_chan + ngs->n_nonroot_chan;
+    }
+    else
+        hmm = listelem_malloc(ngs->chan_alloc);
+    init_nonroot_chan(ngs, hmm, ph, ci, tmatid);
+    ngs->n_nonroot_chan++;
+    return hmm;
+}
+
+/*
+ * Make room for n more channels at the end of the flattened tree,
+ * moving it (and fixing up all pointers into it) if necessary.
+ */
+static void
+grow_nonroot_chan(ngram_search_t *ngs, int32 n)
+{
+    chan_t *old_chan, *new_chan;
+    int32 i;
+
+    if (ngs->n_nonroot_chan + n <= ngs->n_nonroot_chan_alloc)
+        return;
+    old_chan = ngs->nonroot_chan;
+    ngs->n_nonroot_chan_alloc = ngs->n_nonroot_chan + n + 128;
+    new_chan = ckd_calloc(ngs->n_nonroot_chan_alloc, sizeof(*new_chan));
+    if (ngs->n_nonroot_chan > 0)
+        memcpy(new_chan, old_chan, ngs->n_nonroot_chan * sizeof(*new_chan));
+#define MOVE_CHAN(c) ((c) ? new_chan + ((c) - old_chan) : NULL)
+    for (i = 0; i < ngs->n_nonroot_chan; ++i) {
+        new_chan[i].next = MOVE_CHAN(new_chan[i].next);
+        new_chan[i].alt = MOVE_CHAN(new_chan[i].alt);
+    }
+    for (i = 0; i < ngs->n_root_chan; ++i)
+        ngs->root_chan[i].next = MOVE_CHAN(ngs->root_chan[i].next);
+#undef MOVE_CHAN
+    ckd_free(old_chan);
+    ngs->nonroot_chan = new_chan;
+}
+
+/*
+ * Copy a channel and its siblings to the end of the flattened tree,
+ * freeing the originals.  Their children are fixed up when their turn
+ * comes in flatten_search_tree().
+ */
+static int32
+flatten_siblings(ngram_search_t *ngs, int32 tail, chan_t *hmm)
+{
+    chan_t *sibling;
+
+    for (; hmm; hmm = sibling) {
+        sibling = hmm->alt;
+        ngs->nonroot_chan[tail] = *hmm;
+        ngs->nonroot_chan[tail].alt
+            = sibling ? ngs->nonroot_chan + tail + 1 : NULL;
+        listelem_free(ngs->chan_alloc, hmm);
+        ++tail;
+    }
+    return tail;
+}
+
+/*
+ * Compile the non-root channels of the tree into a single array in
+ * breadth-first order, so that the search walks through contiguous
+ * memory rather than chasing pointers across the heap.
+ */
+static void
+flatten_search_tree(ngram_search_t *ngs)
+{
+    int32 i, head, tail;
+
+    ngs->n_nonroot_chan_alloc = ngs->n_nonroot_chan;
+    if (ngs->n_nonroot_chan == 0)
+        return;
+    ngs->nonroot_chan = ckd_calloc(ngs->n_nonroot_chan,
+                                   sizeof(*ngs->nonroot_chan));
+    tail = 0;
+    for (i = 0; i < ngs->n_root_chan; ++i) {
+        chan_t *child = ngs->root_chan[i].next;
+        if (child == NULL)
+            continue;
+        ngs->root_chan[i].next = ngs->nonroot_chan + tail;
+        tail = flatten_siblings(ngs, tail, child);
+    }
+    for (head = 0; head < tail; ++head) {
+        chan_t *child = ngs->nonroot_chan[head].next;
+        if (child == NULL)
+            continue;
+        ngs->nonroot_chan[head].next = ngs->nonroot_chan + tail;
+        tail = flatten_siblings(ngs, tail, child);
+    }
+    assert(tail == ngs->n_nonroot_chan);
+}
+
+/*
+ * Add w to the set of words whose last phone follows a channel.
+ */
+static void
+add_homophone(ngram_search_t *ngs, int32 *penult_phn_wid, int32 w)
+{
+    int32 j;
+
+    if ((j = *penult_phn_wid) < 0)
+        *penult_phn_wid = w;
+    else {
+        for (; ngs->homophone_set[j] >= 0; j = ngs->homophone_set[j]);
+        ngs->homophone_set[j] = w;
+    }
+}
+
+/*
+ * Add a multi-phone word to the search tree.
+ */
+static void
+add_tree_word(ngram_search_t *ngs, int32 w)
+{
+    chan_t *hmm;
+    root_chan_t *rhmm;
+    int32 i, p, ph, tmatid, ciphone, ci2phone;
+    dict_t *dict = ps_search_dict(ngs);
+    dict2pid_t *d2p = ps_search_dict2pid(ngs);
+
+    /* Find a root channel matching the initial diphone, or
+     * allocate one if not found. */
+    ciphone = dict_first_phone(dict, w);
+    ci2phone = dict_second_phone(dict, w);
+    for (i = 0; i < ngs->n_root_chan; ++i) {
+        if (ngs->root_chan[i].ciphone == ciphone
+            && ngs->root_chan[i].ci2phone == ci2phone)
+            break;
+    }
+    if (i == ngs->n_root_chan) {
+        /* Words added since init_search_tree() may need more. */
+        if (ngs->n_root_chan == ngs->n_root_chan_alloc) {
+            ngs->root_chan = ckd_realloc(ngs->root_chan,
+                                         ++ngs->n_root_chan_alloc
+                                         * sizeof(*ngs->root_chan));
+            hmm_init(ngs->hmmctx, &ngs->root_chan[i].hmm, TRUE, -1, -1);
+            ngs->root_chan[i].penult_phn_wid = -1;
+            ngs->root_chan[i].next = NULL;
+        }
+        rhmm = &(ngs->root_chan[ngs->n_root_chan]);
+        rhmm->hmm.tmatid = bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, ciphone);
+        /* Begin with CI phone?  Not sure this makes a difference... */
+        hmm_mpx_ssid(&rhmm->hmm, 0) =
+            bin_mdef_pid2ssid(ps_search_acmod(ngs)->mdef, ciphone);
+        rhmm->ciphone = ciphone;
+        rhmm->ci2phone = ci2phone;
+        ngs->n_root_chan++;
+    }
+    else
+        rhmm = &(ngs->root_chan[i]);
+
+    E_DEBUG(3,("word %s rhmm %d\n", dict_wordstr(dict, w), rhmm - ngs->root_chan));
+    /* Now, rhmm = root channel for w.  Go on to remaining phones */
+    if (dict_pronlen(dict, w) == 2) {
+        /* Next phone is the last; not kept in tree; add w to penult_phn_wid set */
+        add_homophone(ngs, &rhmm->penult_phn_wid, w);
+        return;
+    }
+
+    /* Add remaining phones, except the last, to tree */
+    ph = dict2pid_internal(d2p, w, 1);
+    tmatid = bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, dict_pron(dict, w, 1));
+    hmm = rhmm->next;
+    if (hmm == NULL) {
+        rhmm->next = hmm = new_nonroot_chan(ngs, ph, dict_pron(dict, w, 1), tmatid);
+    }
+    else {
+        chan_t *prev_hmm = NULL;
+
+        for (; hmm && (hmm_nonmpx_ssid(&hmm->hmm) != ph); hmm = hmm->alt)
+            prev_hmm = hmm;
+        if (!hmm) {     /* thanks, rkm! */
+            prev_hmm->alt = hmm = new_nonroot_chan(ngs, ph, dict_pron(dict, w, 1), tmatid);
+        }
+    }
+    E_DEBUG(3,("phone %s = %d\n",
+               bin_mdef_ciphone_str(ps_search_acmod(ngs)->mdef,
+                                    dict_second_phone(dict, w)), ph));
+    for (p = 2; p < dict_pronlen(dict, w) - 1; p++) {
+        ph = dict2pid_internal(d2p, w, p);
+        tmatid = bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, dict_pron(dict, w, p));
+        if (!hmm->next) {
+            hmm->next = new_nonroot_chan(ngs, ph, dict_pron(dict, w, p), tmatid);
+            hmm = hmm->next;
+        }
+        else {
+            chan_t *prev_hmm = NULL;
+
+            for (hmm = hmm->next; hmm && (hmm_nonmpx_ssid(&hmm->hmm) != ph);
+                 hmm = hmm->alt)
+                prev_hmm = hmm;
+            if (!hmm) { /* thanks, rkm! */
+                prev_hmm->alt = hmm = new_nonroot_chan(ngs, ph, dict_pron(dict, w, p), tmatid);
+            }
+        }
+        E_DEBUG(3,("phone %s = %d\n",
+                   bin_mdef_ciphone_str(ps_search_acmod(ngs)->mdef,
+                                        dict_pron(dict, w, p)), ph));
+    }
+
+    /* All but last phone of w in tree; add w to hmm->info.penult_phn_wid set */
+    add_homophone(ngs, &hmm->info.penult_phn_wid, w);
+}
+
+/*
+ * Make sure the active channel lists can hold the whole tree.
+ */
+static void
+alloc_active_chan_list(ngram_search_t *ngs)
+{
+    if (ngs->n_nonroot_chan >= ngs->max_nonroot_chan) {
+        /* Give some room for channels for new words added dynamically at run time */
+        ngs->max_nonroot_chan = ngs->n_nonroot_chan + 128;
+        E_INFO("after: max nonroot chan increased to %d\n", ngs->max_nonroot_chan);
+
+        /* Free old active channel list array if any and allocate new one */
+        if (ngs->active_chan_list)
+            ckd_free_2d(ngs->active_chan_list);
+        ngs->active_chan_list = ckd_calloc_2d(2, ngs->max_nonroot_chan,
+                                              sizeof(**ngs->active_chan_list));
+    }
+}
+
+/*
+ * Remember which language model the search tree is for.  It is
+ * retained, so that another one cannot take its address while the
+ * tree is kept.
+ */
+static void
+set_tree_lm(ngram_search_t *ngs)
+{
+    char const *name;
+
+    ckd_free(ngs->tree_lmname);
+    ngram_model_free(ngs->tree_lm);
+    if ((name = ngram_model_set_current(ngs->lmset)) != NULL) {
+        ngs->tree_lmname = ckd_salloc(name);
+        ngs->tree_lm = ngram_model_set_lookup(ngs->lmset, name);
+        if (ngs->tree_lm)
+            ngram_model_retain(ngs->tree_lm);
+    }
+    else {
+        ngs->tree_lmname = NULL;
+        ngs->tree_lm = NULL;
+    }
+}
+
 /*
  * Allocate and initialize search channel-tree structure.
  * At this point, all the root-channels have been allocated and partly initialized
@@ -174,12 +457,9 @@ init_nonroot_chan(ngram_search_t *ngs, chan_t * hmm, int32 ph, int32 ci, int32 t
 static void
 create_search_tree(ngram_search_t *ngs)
 {
-    chan_t *hmm;
-    root_chan_t *rhmm;
-    int32 w, i, j, p, ph, tmatid;
+    int32 w;
     int32 n_words;
     dict_t *dict = ps_search_dict(ngs);
-    dict2pid_t *d2p = ps_search_dict2pid(ngs);
 
     n_words = ps_search_n_words(ngs);
 
@@ -196,8 +476,6 @@ create_search_tree(ngram_search_t *ngs)
     ngs->n_nonroot_chan = 0;
 
     for (w = 0; w < n_words; w++) {
-        int ciphone, ci2phone;
-
         /* Ignore dictionary words not in LM */
         if (!ngram_model_set_known_wid(ngs->lmset, dict_basewid(dict, w)))
             continue;
@@ -210,97 +488,7 @@ create_search_tree(ngram_search_t *ngs)
             continue;
         }
 
-        /* Find a root channel matching the initial diphone, or
-         * allocate one if not found. */
-        ciphone = dict_first_phone(dict, w);
-        ci2phone = dict_second_phone(dict, w);
-        for (i = 0; i < ngs->n_root_chan; ++i) {
-            if (ngs->root_chan[i].ciphone == ciphone
-                && ngs->root_chan[i].ci2phone == ci2phone)
-                break;
-        }
-        if (i == ngs->n_root_chan) {
-            rhmm = &(ngs->root_chan[ngs->n_root_chan]);
-            rhmm->hmm.tmatid = bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, ciphone);
-            /* Begin with CI phone?  Not sure this makes a difference... */
-            hmm_mpx_ssid(&rhmm->hmm, 0) =
-                bin_mdef_pid2ssid(ps_search_acmod(ngs)->mdef, ciphone);
-            rhmm->ciphone = ciphone;
-            rhmm->ci2phone = ci2phone;
-            ngs->n_root_chan++;
-        }
-        else
-            rhmm = &(ngs->root_chan[i]);
-
-        E_DEBUG(3,("word %s rhmm %d\n", dict_wordstr(dict, w), rhmm - ngs->root_chan));
-        /* Now, rhmm = root channel for w.  Go on to remaining phones */
-        if (dict_pronlen(dict, w) == 2) {
-            /* Next phone is the last; not kept in tree; add w to penult_phn_wid set */
-            if ((j = rhmm->penult_phn_wid) < 0)
-                rhmm->penult_phn_wid = w;
-            else {
-                for (; ngs->homophone_set[j] >= 0; j = ngs->homophone_set[j]);
-                ngs->homophone_set[j] = w;
-            }
-        }
-        else {
-            /* Add remaining phones, except the last, to tree */
-            ph = dict2pid_internal(d2p, w, 1);
-            tmatid = bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, dict_pron(dict, w, 1));
-            hmm = rhmm->next;
-            if (hmm == NULL) {
-                rhmm->next = hmm = listelem_malloc(ngs->chan_alloc);
-                init_nonroot_chan(ngs, hmm, ph, dict_pron(dict, w, 1), tmatid);
-                ngs->n_nonroot_chan++;
-            }
-            else {
-                chan_t *prev_hmm = NULL;
-
-                for (; hmm && (hmm_nonmpx_ssid(&hmm->hmm) != ph); hmm = hmm->alt)
-                    prev_hmm = hmm;
-                if (!hmm) {     /* thanks, rkm! */
-                    prev_hmm->alt = hmm = listelem_malloc(ngs->chan_alloc);
-                    init_nonroot_chan(ngs, hmm, ph, dict_pron(dict, w, 1), tmatid);
-                    ngs->n_nonroot_chan++;
-                }
-            }
-            E_DEBUG(3,("phone %s = %d\n",
-                       bin_mdef_ciphone_str(ps_search_acmod(ngs)->mdef,
-                                            dict_second_phone(dict, w)), ph));
-            for (p = 2; p < dict_pronlen(dict, w) - 1; p++) {
-                ph = dict2pid_internal(d2p, w, p);
-                tmatid = bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, dict_pron(dict, w, p));
-                if (!hmm->next) {
-                    hmm->next = listelem_malloc(ngs->chan_alloc);
-                    hmm = hmm->next;
-                    init_nonroot_chan(ngs, hmm, ph, dict_pron(dict, w, p), tmatid);
-                    ngs->n_nonroot_chan++;
-                }
-                else {
-                    chan_t *prev_hmm = NULL;
-
-                    for (hmm = hmm->next; hmm && (hmm_nonmpx_ssid(&hmm->hmm) != ph);
-                         hmm = hmm->alt)
-                        prev_hmm = hmm;
-                    if (!hmm) { /* thanks, rkm! */
-                        prev_hmm->alt = hmm = listelem_malloc(ngs->chan_alloc);
-                        init_nonroot_chan(ngs, hmm, ph, dict_pron(dict, w, p), tmatid);
-                        ngs->n_nonroot_chan++;
-                    }
-                }
-                E_DEBUG(3,("phone %s = %d\n",
-                           bin_mdef_ciphone_str(ps_search_acmod(ngs)->mdef,
-                                                dict_pron(dict, w, p)), ph));
-            }
-
-            /* All but last phone of w in tree; add w to hmm->info.penult_phn_wid set */
-            if ((j = hmm->info.penult_phn_wid) < 0)
-                hmm->info.penult_phn_wid = w;
-            else {
-                for (; ngs->homophone_set[j] >= 0; j = ngs->homophone_set[j]);
-                ngs->homophone_set[j] = w;
-            }
-        }
+        add_tree_word(ngs, w);
     }
 
     ngs->n_1ph_words = ngs->n_1ph_LMwords;
@@ -320,17 +508,9 @@ create_search_tree(ngram_search_t *ngs)
         ngs->single_phone_wid[ngs->n_1ph_words++] = w;
     }
 
-    if (ngs->n_nonroot_chan >= ngs->max_nonroot_chan) {
-        /* Give some room for channels for new words added dynamically at run time */
-        ngs->max_nonroot_chan = ngs->n_nonroot_chan + 128;
-        E_INFO("after: max nonroot chan increased to %d\n", ngs->max_nonroot_chan);
-
-        /* Free old active channel list array if any and allocate new one */
-        if (ngs->active_chan_list)
-            ckd_free_2d(ngs->active_chan_list);
-        ngs->active_chan_list = ckd_calloc_2d(2, ngs->max_nonroot_chan,
-                                              sizeof(**ngs->active_chan_list));
-    }
+    flatten_search_tree(ngs);
+    alloc_active_chan_list(ngs);
+    set_tree_lm(ngs);
 
     if (!ngs->n_root_chan)
 	E_ERROR("No word from the language model has pronunciation in the dictionary\n");
@@ -339,22 +519,6 @@ create_search_tree(ngram_search_t *ngs)
            ngs->n_root_chan, ngs->n_nonroot_chan, ngs->n_1ph_words);
 }
 
-static void
-reinit_search_subtree(ngram_search_t *ngs, chan_t * hmm)
-{
-    chan_t *child, *sibling;
-
-    /* First free all children under hmm */
-    for (child = hmm->next; child; child = sibling) {
-        sibling = child->alt;
-        reinit_search_subtree(ngs, child);
-    }
-
-    /* Now free hmm */
-    hmm_deinit(&hmm->hmm);
-    listelem_free(ngs->chan_alloc, hmm);
-}
-
 /*
  * Delete search tree by freeing all interior channels within search tree and
  * restoring root channel state to the init state (i.e., just after init_search_tree()).
@@ -363,54 +527,27 @@ static void
 reinit_search_tree(ngram_search_t *ngs)
 {
     int32 i;
-    chan_t *hmm, *sibling;
 
+    for (i = 0; i < ngs->n_nonroot_chan; i++)
+        hmm_deinit(&ngs->nonroot_chan[i].hmm);
+    ckd_free(ngs->nonroot_chan);
+    ngs->nonroot_chan = NULL;
     for (i = 0; i < ngs->n_root_chan; i++) {
-        hmm = ngs->root_chan[i].next;
-
-        while (hmm) {
-            sibling = hmm->alt;
-            reinit_search_subtree(ngs, hmm);
-            hmm = sibling;
-        }
-
         ngs->root_chan[i].penult_phn_wid = -1;
         ngs->root_chan[i].next = NULL;
     }
     ngs->n_nonroot_chan = 0;
-}
-
-void
-ngram_fwdtree_init(ngram_search_t *ngs)
-{
-    /* Allocate bestbp_rc, lastphn_cand, last_ltrans */
-    ngs->bestbp_rc = ckd_calloc(bin_mdef_n_ciphone(ps_search_acmod(ngs)->mdef),
-                                sizeof(*ngs->bestbp_rc));
-    ngs->lastphn_cand = ckd_calloc(ps_search_n_words(ngs),
-                                   sizeof(*ngs->lastphn_cand));
-    init_search_tree(ngs);
-    create_search_tree(ngs);
+    ngs->n_nonroot_chan_alloc = 0;
 }
 
 static void
 deinit_search_tree(ngram_search_t *ngs)
 {
-    int i, w, n_words;
+    int i;
 
-    n_words = ps_search_n_words(ngs);
     for (i = 0; i < ngs->n_root_chan_alloc; i++) {
         hmm_deinit(&ngs->root_chan[i].hmm);
     }
-    if (ngs->rhmm_1ph) {
-        for (i = w = 0; w < n_words; ++w) {
-            if (!dict_is_single_phone(ps_search_dict(ngs), w))
-                continue;
-            hmm_deinit(&ngs->rhmm_1ph[i].hmm);
-            ++i;
-        }
-        ckd_free(ngs->rhmm_1ph);
-        ngs->rhmm_1ph = NULL;
-    }
     ngs->n_root_chan = 0;
     ngs->n_root_chan_alloc = 0;
     ckd_free(ngs->root_chan);
@@ -419,6 +556,150 @@ deinit_search_tree(ngram_search_t *ngs)
     ngs->single_phone_wid = NULL;
     ckd_free(ngs->homophone_set);
     ngs->homophone_set = NULL;
+    ckd_free(ngs->tree_lmname);
+    ngs->tree_lmname = NULL;
+    ngram_model_free(ngs->tree_lm);
+    ngs->tree_lm = NULL;
+}
+
+static void
+free_1ph_chan(ngram_search_t *ngs)
+{
+    int i, w, n_words;
+
+    if (ngs->rhmm_1ph == NULL)
+        return;
+    n_words = ps_search_n_words(ngs);
+    for (i = w = 0; w < n_words; ++w) {
+        if (!dict_is_single_phone(ps_search_dict(ngs), w))
+            continue;
+        hmm_deinit(&ngs->rhmm_1ph[i].hmm);
+        ++i;
+    }
+    ckd_free(ngs->rhmm_1ph);
+    ngs->rhmm_1ph = NULL;
+}
+
+/*
+ * Search tree put aside for a language model other than the current one.
+ */
+typedef struct saved_tree_s {
+    char *lmname;
+    ngram_model_t *lm;          /**< Retained, like ngs->tree_lm. */
+    root_chan_t *root_chan;
+    int32 n_root_chan_alloc;
+    int32 n_root_chan;
+    chan_t *nonroot_chan;
+    int32 n_nonroot_chan;
+    int32 n_nonroot_chan_alloc;
+    int32 *homophone_set;
+    int32 *single_phone_wid;
+    int32 n_1ph_words;
+    int32 n_1ph_LMwords;
+} saved_tree_t;
+
+/*
+ * Take the current search tree out of the search, leaving none.
+ */
+static saved_tree_t *
+save_search_tree(ngram_search_t *ngs)
+{
+    saved_tree_t *st = ckd_calloc(1, sizeof(*st));
+
+    st->lmname = ngs->tree_lmname;
+    st->lm = ngs->tree_lm;
+    st->root_chan = ngs->root_chan;
+    st->n_root_chan_alloc = ngs->n_root_chan_alloc;
+    st->n_root_chan = ngs->n_root_chan;
+    st->nonroot_chan = ngs->nonroot_chan;
+    st->n_nonroot_chan = ngs->n_nonroot_chan;
+    st->n_nonroot_chan_alloc = ngs->n_nonroot_chan_alloc;
+    st->homophone_set = ngs->homophone_set;
+    st->single_phone_wid = ngs->single_phone_wid;
+    st->n_1ph_words = ngs->n_1ph_words;
+    st->n_1ph_LMwords = ngs->n_1ph_LMwords;
+
+    ngs->tree_lmname = NULL;
+    ngs->tree_lm = NULL;
+    ngs->root_chan = NULL;
+    ngs->n_root_chan_alloc = ngs->n_root_chan = 0;
+    ngs->nonroot_chan = NULL;
+    ngs->n_nonroot_chan = ngs->n_nonroot_chan_alloc = 0;
+    ngs->homophone_set = NULL;
+    ngs->single_phone_wid = NULL;
+    ngs->n_1ph_words = ngs->n_1ph_LMwords = 0;
+    return st;
+}
+
+/*
+ * Make a saved search tree the current one (there must be none).
+ */
+static void
+restore_search_tree(ngram_search_t *ngs, saved_tree_t *st)
+{
+    ngs->tree_lmname = st->lmname;
+    ngs->tree_lm = st->lm;
+    ngs->root_chan = st->root_chan;
+    ngs->n_root_chan_alloc = st->n_root_chan_alloc;
+    ngs->n_root_chan = st->n_root_chan;
+    ngs->nonroot_chan = st->nonroot_chan;
+    ngs->n_nonroot_chan = st->n_nonroot_chan;
+    ngs->n_nonroot_chan_alloc = st->n_nonroot_chan_alloc;
+    ngs->homophone_set = st->homophone_set;
+    ngs->single_phone_wid = st->single_phone_wid;
+    ngs->n_1ph_words = st->n_1ph_words;
+    ngs->n_1ph_LMwords = st->n_1ph_LMwords;
+    ckd_free(st);
+}
+
+static void
+free_saved_tree(ngram_search_t *ngs, saved_tree_t *st)
+{
+    restore_search_tree(ngs, st);
+    reinit_search_tree(ngs);
+    deinit_search_tree(ngs);
+}
+
+/*
+ * Free all saved search trees.
+ */
+static void
+flush_tree_cache(ngram_search_t *ngs)
+{
+    hash_iter_t *itor;
+    glist_t trees = NULL;
+    gnode_t *gn;
+
+    if (ngs->tree_cache == NULL)
+        return;
+    for (itor = hash_table_iter(ngs->tree_cache); itor;
+         itor = hash_table_iter_next(itor))
+        trees = glist_add_ptr(trees, hash_entry_val(itor->ent));
+    hash_table_empty(ngs->tree_cache);
+    if (trees == NULL)
+        return;
+    /* Freeing them goes through the current tree. */
+    {
+        saved_tree_t *cur = save_search_tree(ngs);
+        for (gn = trees; gn; gn = gnode_next(gn))
+            free_saved_tree(ngs, gnode_ptr(gn));
+        restore_search_tree(ngs, cur);
+    }
+    glist_free(trees);
+}
+
+void
+ngram_fwdtree_init(ngram_search_t *ngs)
+{
+    /* Allocate bestbp_rc, lastphn_cand, last_ltrans */
+    ngs->bestbp_rc = ckd_calloc(bin_mdef_n_ciphone(ps_search_acmod(ngs)->mdef),
+                                sizeof(*ngs->bestbp_rc));
+    ngs->lastphn_cand = ckd_calloc(ps_search_n_words(ngs),
+                                   sizeof(*ngs->lastphn_cand));
+    ngs->tree_cache = hash_table_new(5, HASH_CASE_YES);
+    init_search_tree(ngs);
+    alloc_1ph_chan(ngs);
+    create_search_tree(ngs);
 }
 
 void
@@ -434,10 +715,15 @@ ngram_fwdtree_deinit(ngram_search_t *ngs)
            ngs->fwdtree_perf.t_tot_elapsed,
            ngs->fwdtree_perf.t_tot_elapsed / n_speech);
 
+    /* Free the search trees for other LMs. */
+    flush_tree_cache(ngs);
+    hash_table_free(ngs->tree_cache);
+    ngs->tree_cache = NULL;
     /* Reset non-root channels. */
     reinit_search_tree(ngs);
     /* Free the search tree. */
     deinit_search_tree(ngs);
+    free_1ph_chan(ngs);
     /* Free other stuff. */
     ngs->max_nonroot_chan = 0;
     ckd_free_2d(ngs->active_chan_list);
@@ -453,10 +739,13 @@ ngram_fwdtree_deinit(ngram_search_t *ngs)
 int
 ngram_fwdtree_reinit(ngram_search_t *ngs)
 {
+    /* Search trees for other LMs are out of date too. */
+    flush_tree_cache(ngs);
     /* Reset non-root channels. */
     reinit_search_tree(ngs);
     /* Free the search tree. */
     deinit_search_tree(ngs);
+    free_1ph_chan(ngs);
     /* Reallocate things that depend on the number of words. */
     ckd_free(ngs->lastphn_cand);
     ngs->lastphn_cand = ckd_calloc(ps_search_n_words(ngs),
@@ -466,10 +755,213 @@ ngram_fwdtree_reinit(ngram_search_t *ngs)
                                 sizeof(*ngs->word_chan));
     /* Rebuild the search tree. */
     init_search_tree(ngs);
+    alloc_1ph_chan(ngs);
     create_search_tree(ngs);
     return 0;
 }
 
+/*
+ * Grow the per-word arrays of the search and of all search trees for
+ * words added to the dictionary.
+ */
+static void
+add_dict_words(ngram_search_t *ngs, int32 old_n_words)
+{
+    dict_t *dict = ps_search_dict(ngs);
+    hash_iter_t *itor;
+    int32 w, n_words, new_1ph;
+
+    n_words = ps_search_n_words(ngs);
+    ckd_free(ngs->lastphn_cand);
+    ngs->lastphn_cand = ckd_calloc(n_words, sizeof(*ngs->lastphn_cand));
+    ngs->word_chan = ckd_realloc(ngs->word_chan,
+                                 n_words * sizeof(*ngs->word_chan));
+    memset(ngs->word_chan + old_n_words, 0,
+           (n_words - old_n_words) * sizeof(*ngs->word_chan));
+
+    ngs->homophone_set = ckd_realloc(ngs->homophone_set,
+                                     n_words * sizeof(*ngs->homophone_set));
+    for (w = old_n_words; w < n_words; ++w)
+        ngs->homophone_set[w] = -1;
+    for (itor = hash_table_iter(ngs->tree_cache); itor;
+         itor = hash_table_iter_next(itor)) {
+        saved_tree_t *st = hash_entry_val(itor->ent);
+        st->homophone_set = ckd_realloc(st->homophone_set,
+                                        n_words * sizeof(*st->homophone_set));
+        for (w = old_n_words; w < n_words; ++w)
+            st->homophone_set[w] = -1;
+    }
+
+    /* Single-phone words all have a channel, in or out of the LM. */
+    new_1ph = FALSE;
+    for (w = old_n_words; w < n_words; ++w)
+        if (dict_is_single_phone(dict, w))
+            new_1ph = TRUE;
+    if (new_1ph) {
+        root_chan_t *old_1ph = ngs->rhmm_1ph;
+        int32 i, n_1ph;
+
+        for (n_1ph = w = 0; w < n_words; w++)
+            if (dict_is_single_phone(dict, w))
+                ++n_1ph;
+        ngs->rhmm_1ph = ckd_calloc(n_1ph, sizeof(*ngs->rhmm_1ph));
+        for (i = w = 0; w < n_words; w++) {
+            if (!dict_is_single_phone(dict, w))
+                continue;
+            if (w < old_n_words)
+                ngs->rhmm_1ph[i] = old_1ph[i];
+            else
+                init_1ph_chan(ngs, &ngs->rhmm_1ph[i], w);
+            ngs->word_chan[w] = (chan_t *) &(ngs->rhmm_1ph[i]);
+            i++;
+        }
+        ckd_free(old_1ph);
+    }
+}
+
+/*
+ * Drop saved search trees for language models which know any of the
+ * words added to the dictionary.
+ */
+static void
+drop_stale_trees(ngram_search_t *ngs, int32 old_n_words)
+{
+    dict_t *dict = ps_search_dict(ngs);
+    hash_iter_t *itor;
+    glist_t stale = NULL;
+    gnode_t *gn;
+    char const *name;
+    int32 w;
+
+    name = ngram_model_set_current(ngs->lmset);
+    for (itor = hash_table_iter(ngs->tree_cache); itor;
+         itor = hash_table_iter_next(itor)) {
+        saved_tree_t *st = hash_entry_val(itor->ent);
+        ngram_model_set_select(ngs->lmset, st->lmname);
+        for (w = old_n_words; w < ps_search_n_words(ngs); ++w) {
+            if (ngram_model_set_known_wid(ngs->lmset, dict_basewid(dict, w))) {
+                stale = glist_add_ptr(stale, st);
+                break;
+            }
+        }
+    }
+    if (name)
+        ngram_model_set_select(ngs->lmset, name);
+    else
+        ngram_model_set_interp(ngs->lmset, NULL, NULL);
+
+    if (stale == NULL)
+        return;
+    {
+        saved_tree_t *cur = save_search_tree(ngs);
+        for (gn = stale; gn; gn = gnode_next(gn)) {
+            saved_tree_t *st = gnode_ptr(gn);
+            E_INFO("Dropping search tree for %s\n", st->lmname);
+            hash_table_delete(ngs->tree_cache, st->lmname);
+            free_saved_tree(ngs, st);
+        }
+        restore_search_tree(ngs, cur);
+    }
+    glist_free(stale);
+}
+
+/*
+ * Add words from the dictionary, which are in the current LM, to the
+ * current search tree.
+ */
+static void
+add_search_tree_words(ngram_search_t *ngs, int32 old_n_words)
+{
+    dict_t *dict = ps_search_dict(ngs);
+    int32 w, n_added;
+
+    n_added = 0;
+    for (w = old_n_words; w < ps_search_n_words(ngs); ++w) {
+        if (!ngram_model_set_known_wid(ngs->lmset, dict_basewid(dict, w)))
+            continue;
+        if (dict_is_single_phone(dict, w)) {
+            /* Goes after the other LM words, before the fillers. */
+            ngs->single_phone_wid = ckd_realloc(ngs->single_phone_wid,
+                                                (ngs->n_1ph_words + 1)
+                                                * sizeof(*ngs->single_phone_wid));
+            memmove(ngs->single_phone_wid + ngs->n_1ph_LMwords + 1,
+                    ngs->single_phone_wid + ngs->n_1ph_LMwords,
+                    (ngs->n_1ph_words - ngs->n_1ph_LMwords)
+                    * sizeof(*ngs->single_phone_wid));
+            ngs->single_phone_wid[ngs->n_1ph_LMwords++] = w;
+            ++ngs->n_1ph_words;
+        }
+        else {
+            grow_nonroot_chan(ngs, dict_pronlen(dict, w) - 2);
+            add_tree_word(ngs, w);
+        }
+        ++n_added;
+    }
+    alloc_active_chan_list(ngs);
+    E_INFO("Added %d words to search tree: %d root, %d non-root channels, %d single-phone words\n",
+           n_added, ngs->n_root_chan, ngs->n_nonroot_chan, ngs->n_1ph_words);
+}
+
+int
+ngram_fwdtree_update(ngram_search_t *ngs, int32 old_n_words)
+{
+    char const *name;
+    ngram_model_t *lm;
+    int built = FALSE;
+
+    if (ps_search_n_words(ngs) > old_n_words)
+        add_dict_words(ngs, old_n_words);
+
+    /* Switch to the search tree for the current LM. */
+    name = ngram_model_set_current(ngs->lmset);
+    lm = name ? ngram_model_set_lookup(ngs->lmset, name) : NULL;
+    if (lm != ngs->tree_lm) {
+        void *val;
+
+        /* Put away the old one, unless it was for interpolated LMs. */
+        if (ngs->tree_lm) {
+            saved_tree_t *st;
+
+            if (hash_table_lookup(ngs->tree_cache, ngs->tree_lmname, &val) == 0) {
+                hash_table_delete(ngs->tree_cache, ngs->tree_lmname);
+                st = save_search_tree(ngs);
+                free_saved_tree(ngs, val);
+            }
+            else
+                st = save_search_tree(ngs);
+            hash_table_enter(ngs->tree_cache, st->lmname, st);
+        }
+        else {
+            reinit_search_tree(ngs);
+            deinit_search_tree(ngs);
+        }
+
+        if (lm && hash_table_lookup(ngs->tree_cache, name, &val) == 0) {
+            saved_tree_t *st = val;
+            hash_table_delete(ngs->tree_cache, name);
+            if (st->lm == lm) {
+                E_INFO("Using saved search tree for %s\n", name);
+                restore_search_tree(ngs, st);
+            }
+            else
+                free_saved_tree(ngs, st);
+        }
+        if (ngs->root_chan == NULL) {
+            init_search_tree(ngs);
+            create_search_tree(ngs);
+            built = TRUE;
+        }
+        alloc_active_chan_list(ngs);
+    }
+
+    if (ps_search_n_words(ngs) > old_n_words) {
+        drop_stale_trees(ngs, old_n_words);
+        if (!built)
+            add_search_tree_words(ngs, old_n_words);
+    }
+    return 0;
+}
+
 void
 ngram_fwdtree_start(ngram_search_t *ngs)
 {
@@ -506,8 +998,7 @@ ngram_fwdtree_start(ngram_search_t *ngs)
     ngs->n_frame = 0;
 
     /* Clear the hypothesis string. */
-    ckd_free(base->hyp_str);
-    base->hyp_str = NULL;
+    ps_search_trace_reset(base);
 
     /* Reset the permanently allocated single-phone words, since they
      * may have junk left over in them from FWDFLAT. */
@@ -531,7 +1022,8 @@ static void
 compute_sen_active(ngram_search_t *ngs, int frame_idx)
 {
     root_chan_t *rhmm;
-    chan_t *hmm, **acl;
+    chan_t *hmm;
+    int32 c, *acl;
     int32 i, w, *awl;
 
     acmod_clear_active(ps_search_acmod(ngs));
@@ -545,7 +1037,8 @@ compute_sen_active(ngram_search_t *ngs, int frame_idx)
     /* Flag active senones for nonroot channels in HMM tree */
     i = ngs->n_active_chan[frame_idx & 0x1];
     acl = ngs->active_chan_list[frame_idx & 0x1];
-    for (hmm = *(acl++); i > 0; --i, hmm = *(acl++)) {
+    for (c = *(acl++); i > 0; --i, c = *(acl++)) {
+        hmm = ngs->nonroot_chan + c;
         acmod_activate_hmm(ps_search_acmod(ngs), &hmm->hmm);
     }
 
@@ -570,7 +1063,8 @@ static void
 renormalize_scores(ngram_search_t *ngs, int frame_idx, int32 norm)
 {
     root_chan_t *rhmm;
-    chan_t *hmm, **acl;
+    chan_t *hmm;
+    int32 c, *acl;
     int32 i, w, *awl;
 
     /* Renormalize root channels */
@@ -583,7 +1077,8 @@ renormalize_scores(ngram_search_t *ngs, int frame_idx, int32 norm)
     /* Renormalize nonroot channels in HMM tree */
     i = ngs->n_active_chan[frame_idx & 0x1];
     acl = ngs->active_chan_list[frame_idx & 0x1];
-    for (hmm = *(acl++); i > 0; --i, hmm = *(acl++)) {
+    for (c = *(acl++); i > 0; --i, c = *(acl++)) {
+        hmm = ngs->nonroot_chan + c;
         hmm_normalize(&hmm->hmm, norm);
     }
 
@@ -627,7 +1122,8 @@ eval_root_chan(ngram_search_t *ngs, int frame_idx)
 static int32
 eval_nonroot_chan(ngram_search_t *ngs, int frame_idx)
 {
-    chan_t *hmm, **acl;
+    chan_t *hmm;
+    int32 c, *acl;
     int32 i, bestscore;
 
     i = ngs->n_active_chan[frame_idx & 0x1];
@@ -635,7 +1131,8 @@ eval_nonroot_chan(ngram_search_t *ngs, int frame_idx)
     bestscore = WORST_SCORE;
     ngs->st.n_nonroot_chan_eval += i;
 
-    for (hmm = *(acl++); i > 0; --i, hmm = *(acl++)) {
+    for (c = *(acl++); i > 0; --i, c = *(acl++)) {
+        hmm = ngs->nonroot_chan + c;
         int32 score = chan_v_eval(hmm);
         assert(hmm_frame(&hmm->hmm) == frame_idx);
         if (score BETTER_THAN bestscore)
@@ -730,7 +1227,7 @@ prune_root_chan(ngram_search_t *ngs, int frame_idx)
     chan_t *hmm;
     int32 i, nf, w;
     int32 thresh, newphone_thresh, lastphn_thresh, newphone_score;
-    chan_t **nacl;              /* next active list */
+    int32 *nacl;                /* next active list */
     lastphn_cand_t *candp;
     phone_loop_search_t *pls;
 
@@ -763,7 +1260,7 @@ prune_root_chan(ngram_search_t *ngs, int frame_idx)
                             || (pl_newphone_score BETTER_THAN hmm_in_score(&hmm->hmm))) {
                             hmm_enter(&hmm->hmm, pl_newphone_score,
                                       hmm_out_history(&rhmm->hmm), nf);
-                            *(nacl++) = hmm;
+                            *(nacl++) = hmm - ngs->nonroot_chan;
                         }
                     }
                 }
@@ -806,7 +1303,7 @@ prune_nonroot_chan(ngram_search_t *ngs, int frame_idx)
     chan_t *hmm, *nexthmm;
     int32 nf, w, i;
     int32 thresh, newphone_thresh, lastphn_thresh, newphone_score;
-    chan_t **acl, **nacl;       /* active list, next active list */
+    int32 c, *acl, *nacl;       /* active list, next active list */
     lastphn_cand_t *candp;
     phone_loop_search_t *pls;
 
@@ -820,15 +1317,16 @@ prune_nonroot_chan(ngram_search_t *ngs, int frame_idx)
     acl = ngs->active_chan_list[frame_idx & 0x1];   /* currently active HMMs in tree */
     nacl = ngs->active_chan_list[nf & 0x1] + ngs->n_active_chan[nf & 0x1];
 
-    for (i = ngs->n_active_chan[frame_idx & 0x1], hmm = *(acl++); i > 0;
-         --i, hmm = *(acl++)) {
+    for (i = ngs->n_active_chan[frame_idx & 0x1], c = *(acl++); i > 0;
+         --i, c = *(acl++)) {
+        hmm = ngs->nonroot_chan + c;
         assert(hmm_frame(&hmm->hmm) >= frame_idx);
 
         if (hmm_bestscore(&hmm->hmm) BETTER_THAN thresh) {
             /* retain this channel in next frame */
             if (hmm_frame(&hmm->hmm) != nf) {
                 hmm_frame(&hmm->hmm) = nf;
-                *(nacl++) = hmm;
+                *(nacl++) = hmm - ngs->nonroot_chan;
             }
 
             /* transition to all next-level channel in the HMM tree */
@@ -843,7 +1341,7 @@ prune_nonroot_chan(ngram_search_t *ngs, int frame_idx)
                                 BETTER_THAN hmm_in_score(&nexthmm->hmm)))) {
                         if (hmm_frame(&nexthmm->hmm) != nf) {
                             /* Keep this HMM on the active list */
-                            *(nacl++) = nexthmm;
+                            *(nacl++) = nexthmm - ngs->nonroot_chan;
                         }
                         hmm_enter(&nexthmm->hmm, pl_newphone_score,
                                   hmm_out_history(&hmm->hmm), nf);
@@ -968,26 +1466,34 @@ last_phone_transition(ngram_search_t *ngs, int frame_idx)
 
     /* Compute best LM score and bp for new cands entered in the sorted lists above */
     for (i = 0; i < n_cand_sf; i++) {
+        int32 n_cand = 0;
+
+        /* LM scores for all candidates are looked up at once for each history. */
+        for (j = ngs->cand_sf[i].cand; j >= 0; j = candp->next) {
+            candp = &(ngs->lastphn_cand[j]);
+            ngs->lm_batch_wid[n_cand++] = dict_basewid(ps_search_dict(ngs), candp->wid);
+        }
         /* For the i-th unique end frame... */
         bp = ngs->bp_table_idx[ngs->cand_sf[i].bp_ef];
         bpend = ngs->bp_table_idx[ngs->cand_sf[i].bp_ef + 1];
         for (bpe = &(ngs->bp_table[bp]); bp < bpend; bp++, bpe++) {
+            int32 hist[2], c;
+
             if (!bpe->valid)
                 continue;
+            hist[0] = bpe->real_wid;
+            hist[1] = bpe->prev_real_wid;
+            ngram_ng_score_batch(ngs->lmset, ngs->lm_batch_wid, n_cand,
+                                 hist, 2, ngs->lm_batch_scr);
             /* For each candidate at the start frame find bp->cand transition-score */
-            for (j = ngs->cand_sf[i].cand; j >= 0; j = candp->next) {
-                int32 n_used;
+            for (c = 0, j = ngs->cand_sf[i].cand; j >= 0; ++c, j = candp->next) {
                 candp = &(ngs->lastphn_cand[j]);
                 dscr = 
                     ngram_search_exit_score
                     (ngs, bpe, dict_first_phone(ps_search_dict(ngs), candp->wid));
                 if (dscr BETTER_THAN WORST_SCORE) {
                     assert(!dict_filler_word(ps_search_dict(ngs), candp->wid));
-                    dscr += ngram_tg_score(ngs->lmset,
-                                           dict_basewid(ps_search_dict(ngs), candp->wid),
-                                           bpe->real_wid,
-                                           bpe->prev_real_wid,
-                                           &n_used)>>SENSCR_SHIFT;
+                    dscr += ngs->lm_batch_scr[c] >> SENSCR_SHIFT;
                 }
 
                 if (dscr BETTER_THAN ngs->last_ltrans[candp->wid].dscr) {
@@ -1142,7 +1648,8 @@ prune_channels(ngram_search_t *ngs, int frame_idx)
         /* Build a histogram to approximately prune them. */
         int32 bins[256], bw, nhmms, i;
         root_chan_t *rhmm;
-        chan_t **acl, *hmm;
+        chan_t *hmm;
+        int32 c, *acl;
 
         /* Bins go from zero (best score) to edge of beam. */
         bw = -ngs->beam / 256;
@@ -1159,10 +1666,12 @@ prune_channels(ngram_search_t *ngs, int frame_idx)
         }
         /* For each active non-root channel. */
         acl = ngs->active_chan_list[frame_idx & 0x1];       /* currently active HMMs in tree */
-        for (i = ngs->n_active_chan[frame_idx & 0x1], hmm = *(acl++);
-             i > 0; --i, hmm = *(acl++)) {
+        for (i = ngs->n_active_chan[frame_idx & 0x1], c = *(acl++);
+             i > 0; --i, c = *(acl++)) {
             int32 b;
 
+            hmm = ngs->nonroot_chan + c;
+
             /* Put it in a bin according to its bestscore. */
             b = (ngs->best_score - hmm_bestscore(&hmm->hmm)) / bw;
             if (b >= 256)
@@ -1338,25 +1847,27 @@ word_transition(ngram_search_t *ngs, int frame_idx)
     for (i = 0; i < ngs->n_1ph_LMwords; i++) {
         w = ngs->single_phone_wid[i];
         ngs->last_ltrans[w].dscr = (int32) 0x80000000;
+        ngs->lm_batch_wid[i] = dict_basewid(dict, w);
     }
     for (bp = ngs->bp_table_idx[frame_idx]; bp < ngs->bpidx; bp++) {
+        int32 hist[2];
+
         bpe = &(ngs->bp_table[bp]);
         if (!bpe->valid)
             continue;
 
+        hist[0] = bpe->real_wid;
+        hist[1] = bpe->prev_real_wid;
+        ngram_ng_score_batch(ngs->lmset, ngs->lm_batch_wid, ngs->n_1ph_LMwords,
+                             hist, 2, ngs->lm_batch_scr);
         for (i = 0; i < ngs->n_1ph_LMwords; i++) {
-            int32 n_used;
             w = ngs->single_phone_wid[i];
             newscore = ngram_search_exit_score
                 (ngs, bpe, dict_first_phone(dict, w));
             E_DEBUG(4, ("initial newscore for %s: %d\n",
                         dict_wordstr(dict, w), newscore));
             if (newscore != WORST_SCORE)
-                newscore += ngram_tg_score(ngs->lmset,
-                                           dict_basewid(dict, w),
-                                           bpe->real_wid,
-                                           bpe->prev_real_wid,
-                                           &n_used)>>SENSCR_SHIFT;
+                newscore += ngs->lm_batch_scr[i] >> SENSCR_SHIFT;
 
             /* FIXME: Not sure how WORST_SCORE could be better, but it
              * apparently happens. */
@@ -1451,17 +1962,132 @@ deactivate_channels(ngram_search_t *ngs, int frame_idx)
     }
 }
 
+/*
+ * Mark the frames of the word exits that the paths in an active
+ * channel come from.
+ */
+static void
+mark_live_frames(ngram_search_t *ngs, hmm_t *hmm, bitvec_t *live)
+{
+    int i;
+
+    for (i = 0; i < hmm_n_emit_state(hmm); ++i) {
+        if (hmm_score(hmm, i) BETTER_THAN WORST_SCORE
+            && hmm_history(hmm, i) != NO_BP)
+            bitvec_set(live, ngs->bp_table[hmm_history(hmm, i)].frame);
+    }
+    if (hmm_out_score(hmm) BETTER_THAN WORST_SCORE
+        && hmm_out_history(hmm) != NO_BP)
+        bitvec_set(live, ngs->bp_table[hmm_out_history(hmm)].frame);
+}
+
+/*
+ * Update a channel for backpointers and frames removed by
+ * ngram_search_commit().
+ */
+static void
+rebase_hmm(hmm_t *hmm, int32 const *bpmap, int shift)
+{
+    int i;
+
+    for (i = 0; i < hmm_n_emit_state(hmm); ++i) {
+        if (hmm_history(hmm, i) != NO_BP)
+            hmm_history(hmm, i) = bpmap[hmm_history(hmm, i)];
+    }
+    if (hmm_out_history(hmm) != NO_BP)
+        hmm_out_history(hmm) = bpmap[hmm_out_history(hmm)];
+    if (hmm_frame(hmm) - shift < -1)
+        hmm_frame(hmm) = -1;
+    else
+        hmm_frame(hmm) -= shift;
+}
+
+/*
+ * Commit the words that all active paths agree on, and remove what
+ * they no longer need from the backpointer table.
+ */
+static void
+commit_words(ngram_search_t *ngs, int frame_idx)
+{
+    root_chan_t *rhmm;
+    chan_t *hmm;
+    bitvec_t *live;
+    int32 const *bpmap;
+    int32 i, w, c, *acl, *awl;
+    int nf, shift;
+
+    nf = frame_idx + 1;
+    live = bitvec_alloc(ngs->n_frame);
+
+    /* The hypothesis comes from the last frames. */
+    bitvec_set(live, frame_idx);
+    if (frame_idx > 0)
+        bitvec_set(live, frame_idx - 1);
+    /* Active channels can also go back to any word exit in the frame
+     * their paths start from, in last_phone_transition(). */
+    for (i = ngs->n_root_chan, rhmm = ngs->root_chan; i > 0; --i, rhmm++) {
+        if (hmm_frame(&rhmm->hmm) == nf)
+            mark_live_frames(ngs, &rhmm->hmm, live);
+    }
+    i = ngs->n_active_chan[nf & 0x1];
+    acl = ngs->active_chan_list[nf & 0x1];
+    for (c = *(acl++); i > 0; --i, c = *(acl++)) {
+        hmm = ngs->nonroot_chan + c;
+        mark_live_frames(ngs, &hmm->hmm, live);
+    }
+    i = ngs->n_active_word[nf & 0x1];
+    awl = ngs->active_word_list[nf & 0x1];
+    for (w = *(awl++); i > 0; --i, w = *(awl++)) {
+        for (hmm = ngs->word_chan[w]; hmm; hmm = hmm->next)
+            mark_live_frames(ngs, &hmm->hmm, live);
+    }
+    for (i = 0; i < ngs->n_1ph_words; i++) {
+        w = ngs->single_phone_wid[i];
+        rhmm = (root_chan_t *) ngs->word_chan[w];
+        if (hmm_frame(&rhmm->hmm) == nf)
+            mark_live_frames(ngs, &rhmm->hmm, live);
+    }
+
+    bpmap = ngram_search_commit(ngs, live, &shift);
+    bitvec_free(live);
+    if (bpmap == NULL)
+        return;
+
+    /* Update all channels, since inactive ones keep their histories
+     * and frames too. */
+    for (i = ngs->n_root_chan, rhmm = ngs->root_chan; i > 0; --i, rhmm++)
+        rebase_hmm(&rhmm->hmm, bpmap, shift);
+    for (i = 0; i < ngs->n_nonroot_chan; ++i)
+        rebase_hmm(&ngs->nonroot_chan[i].hmm, bpmap, shift);
+    for (w = 0; w < ps_search_n_words(ngs); ++w) {
+        if (ngs->word_chan[w] == NULL)
+            continue;
+        if (dict_is_single_phone(ps_search_dict(ngs), w)) {
+            rhmm = (root_chan_t *) ngs->word_chan[w];
+            rebase_hmm(&rhmm->hmm, bpmap, shift);
+        }
+        else {
+            for (hmm = ngs->word_chan[w]; hmm; hmm = hmm->next)
+                rebase_hmm(&hmm->hmm, bpmap, shift);
+        }
+    }
+}
+
 int
 ngram_fwdtree_search(ngram_search_t *ngs, int frame_idx)
 {
     int16 const *senscr;
+    int acmod_frame = frame_idx;
+
+    /* Frames are counted from the last commit in the search. */
+    frame_idx -= ngs->frame_offset;
 
     /* Activate our HMMs for the current frame if need be. */
     if (!ps_search_acmod(ngs)->compallsen)
         compute_sen_active(ngs, frame_idx);
 
     /* Compute GMM scores for the current frame. */
-    if ((senscr = acmod_score(ps_search_acmod(ngs), &frame_idx)) == NULL)
+    if ((senscr = acmod_score(ps_search_acmod(ngs), &acmod_frame)) == NULL)
         return 0;
     ngs->st.n_senone_active_utt += ps_search_acmod(ngs)->n_senone_active;
 
@@ -1491,6 +2117,10 @@ ngram_fwdtree_search(ngram_search_t *ngs, int frame_idx)
     deactivate_channels(ngs, frame_idx);
 
     ++ngs->n_frame;
+    /* Commit stable words every so often in continuous mode. */
+    if (ngs->commitwin > 0
+        && (ngs->n_frame + ngs->frame_offset) % ngs->commitwin == 0)
+        commit_words(ngs, frame_idx);
     /* Return the number of frames processed. */
     return 1;
 }
@@ -1500,10 +2130,11 @@ ngram_fwdtree_finish(ngram_search_t *ngs)
 {
     int32 i, w, cf, *awl;
     root_chan_t *rhmm;
-    chan_t *hmm, **acl;
+    chan_t *hmm;
+    int32 c, *acl;
 
-    /* This is the number of frames processed. */
-    cf = ps_search_acmod(ngs)->output_frame;
+    /* This is the number of frames processed (since the last commit). */
+    cf = ps_search_acmod(ngs)->output_frame - ngs->frame_offset;
     /* Add a mark in the backpointer table for one past the final frame. */
     ngram_search_mark_bptable(ngs, cf);
 
@@ -1516,7 +2147,8 @@ ngram_fwdtree_finish(ngram_search_t *ngs)
     /* nonroot channels of HMM tree */
     i = ngs->n_active_chan[cf & 0x1];
     acl = ngs->active_chan_list[cf & 0x1];
-    for (hmm = *(acl++); i > 0; --i, hmm = *(acl++)) {
+    for (c = *(acl++); i > 0; --i, c = *(acl++)) {
+        hmm = ngs->nonroot_chan + c;
         hmm_clear(&hmm->hmm);
     }
 
@@ -1542,7 +2174,8 @@ ngram_fwdtree_finish(ngram_search_t *ngs)
      */
 
     ptmr_stop(&ngs->fwdtree_perf);
-    /* Print out some statistics. */
+    /* Print out some statistics (for the whole utterance). */
+    cf += ngs->frame_offset;
     if (cf > 0) {
         double n_speech = (double)(cf + 1)
             / cmd_ln_int32_r(ps_search_config(ngs), "-frate");
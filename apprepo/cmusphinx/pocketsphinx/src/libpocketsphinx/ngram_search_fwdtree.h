@@ -62,6 +62,16 @@ void ngram_fwdtree_deinit(ngram_search_t *ngs);
  */
 int ngram_fwdtree_reinit(ngram_search_t *ngs);
 
+/**
+ * Update search structures for a change of language model in the
+ * set, or for words added to the dictionary and language model,
+ * without rebuilding them all.
+ *
+ * @param old_n_words Number of words in the dictionary when the
+ *                    search tree was last updated.
+ */
+int ngram_fwdtree_update(ngram_search_t *ngs, int32 old_n_words);
+
 /**
  * Start fwdtree decoding for an utterance.
  */
@@ -37,6 +37,7 @@
 
 /* System headers. */
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 /* SphinxBase headers. */
@@ -105,6 +106,18 @@ ps_init_defaults(ps_decoder_t *ps)
     cmd_ln_set_boolean_r(ps->config, "-mmap", FALSE);
 #endif
 
+    /* Continuous decoding keeps nothing for the whole utterance, so
+     * only the first pass without lookahead is possible. */
+    if (cmd_ln_int32_r(ps->config, "-commitwin") > 0
+        && (cmd_ln_boolean_r(ps->config, "-fwdflat")
+            || cmd_ln_boolean_r(ps->config, "-bestpath")
+            || cmd_ln_int32_r(ps->config, "-pl_window") > 0)) {
+        E_INFO("Disabling -fwdflat, -bestpath and -pl_window for -commitwin\n");
+        cmd_ln_set_boolean_r(ps->config, "-fwdflat", FALSE);
+        cmd_ln_set_boolean_r(ps->config, "-bestpath", FALSE);
+        cmd_ln_set_int32_r(ps->config, "-pl_window", 0);
+    }
+
 #ifdef MODELDIR
     /* Set default acoustic and language models. */
     hmmdir = cmd_ln_str_r(ps->config, "-hmm");
@@ -149,6 +162,16 @@ ps_init_defaults(ps_decoder_t *ps)
 
     /* Get acoustic model filenames and add them to the command-line */
     if ((hmmdir = cmd_ln_str_r(ps->config, "-hmm")) != NULL) {
+        /* The bundle in the model directory must not take the place
+         * of parameter files given explicitly. */
+        int params_given = (cmd_ln_str_r(ps->config, "-mdef")
+                            || cmd_ln_str_r(ps->config, "-mean")
+                            || cmd_ln_str_r(ps->config, "-var")
+                            || cmd_ln_str_r(ps->config, "-tmat")
+                            || cmd_ln_str_r(ps->config, "-mixw")
+                            || cmd_ln_str_r(ps->config, "-sendump")
+                            || cmd_ln_str_r(ps->config, "-senmgau"));
+
         ps_add_file(ps, "-mdef", hmmdir, "mdef");
         ps_add_file(ps, "-mean", hmmdir, "means");
         ps_add_file(ps, "-var", hmmdir, "variances");
@@ -159,6 +182,9 @@ ps_init_defaults(ps_decoder_t *ps)
         ps_add_file(ps, "-lda", hmmdir, "feature_transform");
         ps_add_file(ps, "-featparams", hmmdir, "feat.params");
         ps_add_file(ps, "-senmgau", hmmdir, "senmgau");
+        ps_add_file(ps, "-kdtree", hmmdir, "kdtrees");
+        if (!params_given)
+            ps_add_file(ps, "-bundle", hmmdir, "bundle");
     }
 }
 
@@ -309,6 +335,81 @@ ps_init(cmd_ln_t *config)
     return ps;
 }
 
+ps_decoder_t *
+ps_init_shared(ps_decoder_t *other)
+{
+    ps_decoder_t *ps;
+    gnode_t *gn;
+
+    ps = ckd_calloc(1, sizeof(*ps));
+    ps->refcount = 1;
+    ps->config = cmd_ln_retain(other->config);
+    ps->mfclogdir = other->mfclogdir;
+    ps->rawlogdir = other->rawlogdir;
+    ps->senlogdir = other->senlogdir;
+    ps->lmath = logmath_retain(other->lmath);
+
+    /* Acoustic model parameters are shared, feature computation and
+     * scoring buffers are not. */
+    if ((ps->acmod = acmod_copy(other->acmod)) == NULL)
+        goto error_out;
+    acmod_set_grow(ps->acmod, other->acmod->grow_feat);
+
+    /* Dictionary and triphone mappings are only read while searching. */
+    ps->dict = dict_retain(other->dict);
+    if (other->d2p)
+        ps->d2p = dict2pid_retain(other->d2p);
+
+    if ((ps->pl_window = other->pl_window)) {
+        if ((ps->phone_loop = phone_loop_search_init(ps->config,
+                                                     ps->acmod, ps->dict)) == NULL)
+            goto error_out;
+        ps->searches = glist_add_ptr(ps->searches, ps->phone_loop);
+    }
+
+    /* Searches keep their own state, only language models are shared. */
+    for (gn = other->searches; gn; gn = gnode_next(gn)) {
+        ps_search_t *search = gnode_ptr(gn);
+        ps_search_t *copy;
+
+        if (search == other->phone_loop)
+            continue;
+        if (0 == strcmp(ps_search_name(search), "ngram")) {
+            ngram_model_t *lmset;
+
+            lmset = ngram_model_set_dup(((ngram_search_t *)search)->lmset);
+            if (lmset == NULL)
+                goto error_out;
+            /* Both decoders may be scoring the models at once. */
+            ngram_model_set_share(lmset, TRUE);
+            copy = ngram_search_init_lmset(ps->config, ps->acmod,
+                                           ps->dict, ps->d2p, lmset);
+        }
+        else if (0 == strcmp(ps_search_name(search), "fsg")) {
+            copy = fsg_search_init(ps->config, ps->acmod, ps->dict, ps->d2p);
+        }
+        else {
+            E_ERROR("Search module %s cannot be shared\n",
+                    ps_search_name(search));
+            goto error_out;
+        }
+        if (copy == NULL)
+            goto error_out;
+        copy->pls = ps->phone_loop;
+        ps->searches = glist_add_ptr(ps->searches, copy);
+        if (search == other->search)
+            ps->search = copy;
+    }
+
+    ps->perf.name = "decode";
+    ptmr_init(&ps->perf);
+    return ps;
+
+error_out:
+    ps_free(ps);
+    return NULL;
+}
+
 arg_t const *
 ps_args(void)
 {
@@ -373,7 +474,25 @@ ps_get_feat(ps_decoder_t *ps)
 ps_mllr_t *
 ps_update_mllr(ps_decoder_t *ps, ps_mllr_t *mllr)
 {
-    return acmod_update_mllr(ps->acmod, mllr);
+    ngram_search_t *ngs;
+    ps_mllr_t *rv;
+
+    /* The fwdflat search following fwdtree shares the acoustic model,
+     * so take it down while adapting it. */
+    ngs = (ngram_search_t *)ps_find_search(ps, "ngram");
+    if (ngs == NULL || ngs->flat == NULL)
+        return acmod_update_mllr(ps->acmod, mllr);
+    ngram_search_free_flat(ngs);
+    rv = acmod_update_mllr(ps->acmod, mllr);
+    if (ngram_search_init_flat(ngs) < 0)
+        E_ERROR("Failed to restart fwdflat search, it will not follow fwdtree\n");
+    return rv;
+}
+
+ps_mllr_t *
+ps_update_fmllr(ps_decoder_t *ps, ps_mllr_t *fmllr)
+{
+    return acmod_update_fmllr(ps->acmod, fmllr);
 }
 
 ngram_model_t *
@@ -643,8 +762,7 @@ ps_start_utt(ps_decoder_t *ps, char const *uttid)
     ps->search->dag = NULL;
     ps->search->last_link = NULL;
     ps->search->post = 0;
-    ckd_free(ps->search->hyp_str);
-    ps->search->hyp_str = NULL;
+    ps_search_trace_reset(ps->search);
 
     if ((rv = acmod_start_utt(ps->acmod)) < 0)
         return rv;
@@ -831,8 +949,23 @@ ps_end_utt(ps_decoder_t *ps)
         ptmr_stop(&ps->perf);
         return rv;
     }
+    /* The final hypothesis may come from a different pass. */
+    ++ps->search->trace.serial;
     ptmr_stop(&ps->perf);
 
+    /* Log time spent in acoustic scoring (searches log their own). */
+    if (ps->acmod->output_frame > 0) {
+        double n_speech = (double)ps->acmod->output_frame
+            / cmd_ln_int32_r(ps->config, "-frate");
+        E_INFO("score %.2f CPU %.3f xRT\n",
+               ps->acmod->perf.t_cpu, ps->acmod->perf.t_cpu / n_speech);
+        E_INFO("score %.2f wall %.3f xRT\n",
+               ps->acmod->perf.t_elapsed, ps->acmod->perf.t_elapsed / n_speech);
+        if (ps->acmod->n_blk_hit + ps->acmod->n_blk_miss > 0)
+            E_INFO("%d frames scored ahead, %d scored on demand\n",
+                   ps->acmod->n_blk_hit, ps->acmod->n_blk_miss);
+    }
+
     /* Log a backtrace if requested. */
     if (cmd_ln_boolean_r(ps->config, "-backtrace")) {
         char const *uttid, *hyp;
@@ -866,6 +999,7 @@ ps_get_hyp(ps_decoder_t *ps, int32 *out_best_score, char const **out_uttid)
 
     ptmr_start(&ps->perf);
     hyp = ps_search_hyp(ps->search, out_best_score, NULL);
+    ps->hyp_serial = ps->search->trace.serial;
     if (out_uttid)
         *out_uttid = ps->uttid;
     ptmr_stop(&ps->perf);
@@ -879,10 +1013,26 @@ ps_get_hyp_final(ps_decoder_t *ps, int32 *out_is_final)
 
     ptmr_start(&ps->perf);
     hyp = ps_search_hyp(ps->search, NULL, out_is_final);
+    ps->hyp_serial = ps->search->trace.serial;
     ptmr_stop(&ps->perf);
     return hyp;
 }
 
+int
+ps_hyp_changed(ps_decoder_t *ps)
+{
+    ps_search_t *search = ps->search;
+
+    if (search->trace.serial != ps->hyp_serial)
+        return TRUE;
+    /* Bring the cached traceback up to date (cheap unless the best
+     * path changed a long way back). */
+    ptmr_start(&ps->perf);
+    ps_search_hyp(search, NULL, NULL);
+    ptmr_stop(&ps->perf);
+    return search->trace.serial != ps->hyp_serial;
+}
+
 
 int32
 ps_get_prob(ps_decoder_t *ps, char const **out_uttid)
@@ -908,6 +1058,15 @@ ps_seg_iter(ps_decoder_t *ps, int32 *out_best_score)
     return itor;
 }
 
+ps_seg_t *
+ps_seg_committed(ps_decoder_t *ps)
+{
+    if (ps->search == NULL
+        || 0 != strcmp(ps_search_name(ps->search), "ngram"))
+        return NULL;
+    return ngram_search_commit_iter((ngram_search_t *)ps->search);
+}
+
 ps_seg_t *
 ps_seg_next(ps_seg_t *seg)
 {
@@ -1081,6 +1240,7 @@ void
 ps_search_base_reinit(ps_search_t *search, dict_t *dict,
                       dict2pid_t *d2p)
 {
+    ps_search_trace_reset(search);
     dict_free(search->dict);
     dict2pid_free(search->d2p);
     /* FIXME: _retain() should just return NULL if passed NULL. */
@@ -1111,5 +1271,117 @@ ps_search_deinit(ps_search_t *search)
     dict_free(search->dict);
     dict2pid_free(search->d2p);
     ckd_free(search->hyp_str);
+    ckd_free(search->trace.id);
+    ckd_free(search->trace.len);
+    ckd_free(search->trace.new_id);
+    ckd_free(search->trace.new_word);
     ps_lattice_free(search->dag);
 }
+
+void
+ps_search_trace_reset(ps_search_t *search)
+{
+    ps_trace_t *trace = &search->trace;
+
+    if (trace->n_id > 0)
+        ++trace->serial;
+    trace->n_id = 0;
+    if (search->hyp_str)
+        search->hyp_str[0] = '\0';
+}
+
+/* Binary search for an entry on the cached path. */
+static int
+trace_find(ps_trace_t *trace, int32 id)
+{
+    int lo, hi;
+
+    lo = 0;
+    hi = trace->n_id;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (trace->id[mid] < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < trace->n_id && trace->id[lo] == id)
+        return lo;
+    return -1;
+}
+
+static void
+trace_grow(ps_trace_t *trace, int32 n)
+{
+    if (n <= trace->n_alloc)
+        return;
+    trace->n_alloc = (n > trace->n_alloc * 2) ? n : trace->n_alloc * 2;
+    trace->id = ckd_realloc(trace->id, trace->n_alloc * sizeof(*trace->id));
+    trace->len = ckd_realloc(trace->len, trace->n_alloc * sizeof(*trace->len));
+    trace->new_id = ckd_realloc(trace->new_id,
+                                trace->n_alloc * sizeof(*trace->new_id));
+    trace->new_word = ckd_realloc(trace->new_word,
+                                  trace->n_alloc * sizeof(*trace->new_word));
+}
+
+char const *
+ps_search_trace(ps_search_t *search, int32 id, ps_search_pred_f pred)
+{
+    ps_trace_t *trace = &search->trace;
+    int32 old_len, len, n_new, keep, i;
+    int changed;
+
+    /* Follow the path back to the first entry already cached. */
+    n_new = 0;
+    keep = 0;
+    while (id >= 0) {
+        if ((keep = trace_find(trace, id)) >= 0) {
+            ++keep;
+            break;
+        }
+        trace_grow(trace, n_new + 1);
+        trace->new_id[n_new] = id;
+        id = (*pred)(search, id, &trace->new_word[n_new]);
+        ++n_new;
+        keep = 0;
+    }
+
+    /* Replace everything after it with the new part of the path,
+     * noting whether the text actually changes. */
+    old_len = (trace->n_id > 0) ? trace->len[trace->n_id - 1] : 0;
+    len = (keep > 0) ? trace->len[keep - 1] : 0;
+    changed = FALSE;
+    trace_grow(trace, keep + n_new);
+    for (i = n_new - 1; i >= 0; --i) {
+        char const *word = trace->new_word[i];
+        if (word) {
+            int32 wlen = strlen(word);
+            if (len + wlen + 2 > trace->hyp_alloc) {
+                trace->hyp_alloc = (len + wlen + 2) * 2;
+                search->hyp_str = ckd_realloc(search->hyp_str,
+                                              trace->hyp_alloc);
+            }
+            if (len > 0) {
+                if (len >= old_len || search->hyp_str[len] != ' ')
+                    changed = TRUE;
+                search->hyp_str[len++] = ' ';
+            }
+            if (!changed && (len + wlen > old_len
+                             || memcmp(search->hyp_str + len, word, wlen) != 0))
+                changed = TRUE;
+            memcpy(search->hyp_str + len, word, wlen);
+            len += wlen;
+        }
+        trace->id[keep] = trace->new_id[i];
+        trace->len[keep] = len;
+        ++keep;
+    }
+    trace->n_id = keep;
+    if (changed || len != old_len)
+        ++trace->serial;
+
+    if (len == 0)
+        return NULL;
+    search->hyp_str[len] = '\0';
+    return search->hyp_str;
+}
@@ -62,6 +62,36 @@
  */
 typedef struct ps_search_s ps_search_t;
 
+/**
+ * Cached traceback of the best path behind the current hypothesis.
+ *
+ * Partial hypotheses are requested many times per utterance, and the
+ * best path rarely changes except near its end.  Keeping the path
+ * lets each request follow predecessors back only as far as the first
+ * entry already on it.  Entries are backpointer or history IDs, which
+ * always increase along a path.
+ */
+typedef struct ps_trace_s {
+    int32 *id;         /**< Path entries, first to last. */
+    int32 *len;        /**< Hypothesis length up to and including each entry. */
+    int32 n_id;        /**< Number of entries on the path. */
+    int32 n_alloc;     /**< Number of entries allocated (also for scratch). */
+    int32 *new_id;     /**< Scratch: entries found by the current walk. */
+    char const **new_word; /**< Scratch: words for new_id (NULL if none). */
+    int32 hyp_alloc;   /**< Bytes allocated for the hypothesis string. */
+    int32 serial;      /**< Incremented whenever the hypothesis changes. */
+} ps_trace_t;
+
+/**
+ * Predecessor function for ps_search_trace().
+ *
+ * @param out_word Output: word string that entry id adds to the
+ *                 hypothesis, or NULL if it adds none (fillers, etc).
+ * @return Predecessor of entry id, or -1 if it starts the path.
+ */
+typedef int32 (*ps_search_pred_f)(ps_search_t *search, int32 id,
+                                  char const **out_word);
+
 /**
  * V-table for search algorithm.
  */
@@ -91,6 +121,7 @@ struct ps_search_s {
     dict_t *dict;        /**< Pronunciation dictionary. */
     dict2pid_t *d2p;       /**< Dictionary to senone mappings. */
     char *hyp_str;         /**< Current hypothesis string. */
+    ps_trace_t trace;      /**< Best path behind hyp_str. */
     ps_lattice_t *dag;	   /**< Current hypothesis word graph. */
     ps_latlink_t *last_link; /**< Final link in best path. */
     int32 post;            /**< Utterance posterior probability. */
@@ -148,6 +179,26 @@ void ps_search_base_reinit(ps_search_t *search, dict_t *dict,
  */
 void ps_search_deinit(ps_search_t *search);
 
+/**
+ * Update the hypothesis string for the path ending in a given entry.
+ *
+ * Only the part of the path not already in the cached traceback is
+ * followed, and only the corresponding tail of hyp_str is rewritten.
+ *
+ * @param id Last entry on the path, or -1 for an empty path.
+ * @return The hypothesis string, or NULL if it is empty.
+ */
+char const *ps_search_trace(ps_search_t *search, int32 id,
+                            ps_search_pred_f pred);
+
+/**
+ * Forget the cached traceback.
+ *
+ * Must be called whenever the entry IDs it refers to are reused or
+ * renumbered.
+ */
+void ps_search_trace_reset(ps_search_t *search);
+
 typedef struct ps_segfuncs_s {
     ps_seg_t *(*seg_next)(ps_seg_t *seg);
     void (*seg_free)(ps_seg_t *seg);
@@ -160,8 +211,8 @@ struct ps_seg_s {
     ps_segfuncs_t *vt;     /**< V-table of seg methods */
     ps_search_t *search;   /**< Search object from whence this came */
     char const *word;      /**< Word string (pointer into dictionary hash) */
-    frame_idx_t sf;        /**< Start frame. */
-    frame_idx_t ef;        /**< End frame. */
+    int sf;                /**< Start frame. */
+    int ef;                /**< End frame. */
     int32 ascr;            /**< Acoustic score. */
     int32 lscr;            /**< Language model score. */
     int32 prob;            /**< Log posterior probability. */
@@ -203,6 +254,7 @@ struct ps_decoder_s {
     char *uttid;        /**< Utterance ID for current utterance. */
     ptmr_t perf;        /**< Performance counter for all of decoding. */
     uint32 n_frame;     /**< Total number of frames processed. */
+    int32 hyp_serial;   /**< Hypothesis serial at the last ps_get_hyp(). */
     char const *mfclogdir; /**< Log directory for MFCC files. */
     char const *rawlogdir; /**< Log directory for audio files. */
     char const *senlogdir; /**< Log directory for senone score files. */
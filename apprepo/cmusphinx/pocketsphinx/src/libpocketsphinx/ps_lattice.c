@@ -697,6 +697,7 @@ ps_lattice_free(ps_lattice_t *dag)
     listelem_alloc_free(dag->latlink_alloc);
     listelem_alloc_free(dag->latlink_list_alloc);    
     ckd_free(dag->hyp_str);
+    ckd_free(dag->logsum);
     ckd_free(dag);
     return 0;
 }
@@ -1234,6 +1235,18 @@ ps_lattice_reverse_next(ps_lattice_t *dag, ps_latnode_t *start)
  * there a reliable Viterbi analogue to word-level Forward-Backward
  * like there is for state-level?  Or, is it just lattice density?)
  */
+/* Append a score to dag->logsum, to be added up with logmath_add_n(). */
+static void
+logsum_append(ps_lattice_t *dag, int32 *n, int32 score)
+{
+    if (*n >= dag->n_logsum_alloc) {
+        dag->n_logsum_alloc = dag->n_logsum_alloc ? dag->n_logsum_alloc * 2 : 16;
+        dag->logsum = ckd_realloc(dag->logsum,
+                                  dag->n_logsum_alloc * sizeof(*dag->logsum));
+    }
+    dag->logsum[(*n)++] = score;
+}
+
 ps_latlink_t *
 ps_lattice_bestpath(ps_lattice_t *dag, ngram_model_t *lmset,
                     float32 lwf, float32 ascale)
@@ -1244,7 +1257,7 @@ ps_lattice_bestpath(ps_lattice_t *dag, ngram_model_t *lmset,
     ps_latlink_t *bestend;
     latlink_list_t *x;
     logmath_t *lmath;
-    int32 bestescr;
+    int32 bestescr, n_logsum;
 
     search = dag->search;
     lmath = dag->lmath;
@@ -1341,7 +1354,7 @@ ps_lattice_bestpath(ps_lattice_t *dag, ngram_model_t *lmset,
 
     /* Normalizer is the alpha for the imaginary link exiting the
        final node. */
-    dag->norm = logmath_get_zero(lmath);
+    n_logsum = 0;
     for (x = dag->end->entries; x; x = x->next) {
         int32 bprob, n_used;
 
@@ -1353,12 +1366,13 @@ ps_lattice_bestpath(ps_lattice_t *dag, ngram_model_t *lmset,
                                   &x->link->from->basewid, 1, &n_used);
         else
             bprob = 0;
-        dag->norm = logmath_add(lmath, dag->norm, x->link->alpha + bprob);
+        logsum_append(dag, &n_logsum, x->link->alpha + bprob);
         if (x->link->path_scr BETTER_THAN bestescr) {
             bestescr = x->link->path_scr;
             bestend = x->link;
         }
     }
+    dag->norm = logmath_add_n(lmath, dag->logsum, n_logsum);
     /* FIXME: floating point... */
     dag->norm += (int32)(dag->final_node_ascr << SENSCR_SHIFT) * ascale;
 
@@ -1458,14 +1472,18 @@ ps_lattice_posterior(ps_lattice_t *dag, ngram_model_t *lmset,
             link->beta = bprob + (dag->final_node_ascr << SENSCR_SHIFT) * ascale;
         }
         else {
+            int32 n_logsum = 0;
+
             /* Update beta from all outgoing betas. */
             for (x = link->to->exits; x; x = x->next) {
                 if (dict_filler_word(ps_search_dict(search), x->link->to->basewid) && x->link->to != dag->end)
                     continue;
-                link->beta = logmath_add(lmath, link->beta,
-                                         x->link->beta + bprob
-                                         + (x->link->ascr << SENSCR_SHIFT) * ascale);
+                logsum_append(dag, &n_logsum,
+                              x->link->beta + bprob
+                              + (x->link->ascr << SENSCR_SHIFT) * ascale);
             }
+            link->beta = logmath_add(lmath, link->beta,
+                                     logmath_add_n(lmath, dag->logsum, n_logsum));
         }
     }
 
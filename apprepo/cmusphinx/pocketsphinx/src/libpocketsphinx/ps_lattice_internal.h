@@ -84,6 +84,9 @@ struct ps_lattice_s {
     /* This will probably be replaced with a heap. */
     latlink_list_t *q_head; /**< Queue of links for traversal. */
     latlink_list_t *q_tail; /**< Queue of links for traversal. */
+
+    int32 *logsum;          /**< Scores to add up with logmath_add_n(). */
+    int32 n_logsum_alloc;   /**< Number of entries allocated in logsum. */
 };
 
 /**
@@ -68,7 +68,10 @@
 static ps_mgaufuncs_t ptm_mgau_funcs = {
     "ptm",
     ptm_mgau_frame_eval,      /* frame_eval */
+    ptm_mgau_frame_eval_block, /* frame_eval_block */
     ptm_mgau_mllr_transform,  /* transform */
+    ptm_mgau_copy,            /* copy */
+    ptm_mgau_write_bundle,    /* write_bundle */
     ptm_mgau_free             /* free */
 };
 
@@ -95,13 +98,18 @@ insertion_sort_topn(ptm_topn_t *topn, int i, int32 d)
     topn[j + 1] = vtmp;
 }
 
+/*
+ * Re-evaluate the top-N densities from the previous frame.  If dist
+ * is not NULL, it holds the scores of all the densities.
+ */
 static int
-eval_topn(ptm_mgau_t *s, int cb, int feat, mfcc_t *z)
+eval_topn(ptm_mgau_t *s, ptm_fast_eval_t *f,
+          int cb, int feat, mfcc_t *z, mfcc_t const *dist)
 {
     ptm_topn_t *topn;
     int i, ceplen;
 
-    topn = s->f->topn[cb][feat];
+    topn = f->topn[cb][feat];
     ceplen = s->g->featlen[feat];
 
     for (i = 0; i < s->max_topn; i++) {
@@ -111,6 +119,10 @@ eval_topn(ptm_mgau_t *s, int cb, int feat, mfcc_t *z)
         int32 cw, j;
 
         cw = topn[i].cw;
+        if (dist) {
+            insertion_sort_topn(topn, i, (int32)dist[cw]);
+            continue;
+        }
         mean = s->g->mean[cb][feat][0] + cw * ceplen;
         var = s->g->var[cb][feat][0] + cw * ceplen;
         d = s->g->det[cb][feat][cw];
@@ -156,65 +168,26 @@ insertion_sort_cb(ptm_topn_t **cur, ptm_topn_t *worst, ptm_topn_t *best,
     (*cur)->score = intd;
 }
 
+/*
+ * Merge the scores of all the densities, as computed by
+ * gmm_block_eval(), into the top-N.
+ */
 static int
-eval_cb(ptm_mgau_t *s, int cb, int feat, mfcc_t *z)
+eval_cb(ptm_mgau_t *s, ptm_fast_eval_t *f,
+        int cb, int feat, mfcc_t const *dist)
 {
     ptm_topn_t *worst, *best, *topn;
-    mfcc_t *mean;
-    mfcc_t *var, *det, *detP, *detE;
-    int32 i, ceplen;
+    int32 i, cw;
 
-    best = topn = s->f->topn[cb][feat];
+    best = topn = f->topn[cb][feat];
     worst = topn + (s->max_topn - 1);
-    mean = s->g->mean[cb][feat][0];
-    var = s->g->var[cb][feat][0];
-    det = s->g->det[cb][feat];
-    detE = det + s->g->n_density;
-    ceplen = s->g->featlen[feat];
 
-    for (detP = det; detP < detE; ++detP) {
-        mfcc_t diff[4], sqdiff[4], compl[4]; /* diff, diff^2, component likelihood */
+    for (cw = 0; cw < s->g->n_density; ++cw) {
         mfcc_t d, thresh;
-        mfcc_t *obs;
         ptm_topn_t *cur;
-        int32 cw, j;
 
-        d = *detP;
+        d = dist[cw];
         thresh = (mfcc_t) worst->score; /* Avoid int-to-float conversions */
-        obs = z;
-        cw = detP - det;
-
-        /* Unroll the loop starting with the first dimension(s).  In
-         * theory this might be a bit faster if this Gaussian gets
-         * "knocked out" by C0. In practice not. */
-        for (j = 0; (j < ceplen % 4) && (d >= thresh); ++j) {
-            diff[0] = *obs++ - *mean++;
-            sqdiff[0] = MFCCMUL(diff[0], diff[0]);
-            compl[0] = MFCCMUL(sqdiff[0], *var++);
-            d = GMMSUB(d, compl[0]);
-        }
-        /* Now do 4 dimensions at a time.  You'd think that GCC would
-         * vectorize this?  Apparently not.  And it's right, because
-         * that won't make this any faster, at least on x86-64. */
-        for (; j < ceplen && d >= thresh; j += 4) {
-            COMPUTE_GMM_MAP(0);
-            COMPUTE_GMM_MAP(1);
-            COMPUTE_GMM_MAP(2);
-            COMPUTE_GMM_MAP(3);
-            COMPUTE_GMM_REDUCE(0);
-            COMPUTE_GMM_REDUCE(1);
-            COMPUTE_GMM_REDUCE(2);
-            COMPUTE_GMM_REDUCE(3);
-            var += 4;
-            obs += 4;
-            mean += 4;
-        }
-        if (j < ceplen) {
-            /* terminated early, so not in topn */
-            mean += (ceplen - j);
-            var += (ceplen - j);
-            continue;
-        }
         if (d < thresh)
             continue;
         for (i = 0; i < s->max_topn; i++) {
@@ -231,31 +204,54 @@ eval_cb(ptm_mgau_t *s, int cb, int feat, mfcc_t *z)
 }
 
 /**
- * Compute top-N densities for active codebooks (and prune)
+ * Compute top-N densities for one codebook in frame f, starting from
+ * those of the previous frame, using dist as scratch space.
  */
-static int
-ptm_mgau_codebook_eval(ptm_mgau_t *s, mfcc_t **z, int frame)
+static void
+ptm_mgau_codebook_eval(ptm_mgau_t *s, ptm_fast_eval_t *f, int i,
+                       mfcc_t **z, int frame, mfcc_t *dist)
 {
-    int i, j;
+    ptm_fast_eval_t *lastf;
+    int j;
 
-    /* First evaluate top-N from previous frame. */
-    for (i = 0; i < s->g->n_mgau; ++i)
+    /* Get the previous frame's top-N information (on the first frame
+     * of the input this is just all WORST_DIST, no harm in that) */
+    if (f == s->hist)
+        lastf = s->hist + s->n_fast_hist - 1;
+    else
+        lastf = f - 1;
+    memcpy(f->topn[i][0], lastf->topn[i][0],
+           s->g->n_feat * s->max_topn * sizeof(ptm_topn_t));
+
+    /* Evaluate top-N from previous frame, then, unless frame
+     * downsampling is in effect, the whole of the codebook if it is
+     * active.  The top-N scores are taken from the whole codebook
+     * when it is evaluated anyway. */
+    if ((frame % s->ds_ratio)
+        || bitvec_is_clear(f->mgau_active, i)) {
         for (j = 0; j < s->g->n_feat; ++j)
-            eval_topn(s, i, j, z[j]);
+            eval_topn(s, f, i, j, z[j], NULL);
+        return;
+    }
+    for (j = 0; j < s->g->n_feat; ++j) {
+        gmm_block_eval(s->g->block[i][j], z[j], dist);
+        eval_topn(s, f, i, j, z[j], dist);
+        eval_cb(s, f, i, j, dist);
+    }
+}
+
+/**
+ * Normalize top-N densities for active codebooks in the current frame.
+ */
+static int
+ptm_mgau_codebook_norm(ptm_mgau_t *s, int frame)
+{
+    int i, j;
 
-    /* If frame downsampling is in effect, possibly do nothing else. */
+    /* If frame downsampling is in effect, do nothing else. */
     if (frame % s->ds_ratio)
         return 0;
 
-    /* Evaluate remaining codebooks. */
-    for (i = 0; i < s->g->n_mgau; ++i) {
-        if (bitvec_is_clear(s->f->mgau_active, i))
-            continue;
-        for (j = 0; j < s->g->n_feat; ++j) {
-            eval_cb(s, i, j, z[j]);
-        }
-    }
-
     /* Normalize densities to produce "posterior probabilities",
      * i.e. things with a reasonable dynamic range, then scale and
      * clamp them to the acceptable range.  This is actually done
@@ -318,16 +314,19 @@ ptm_mgau_calc_cb_active(ptm_mgau_t *s, uint8 *senone_active,
 }
 
 /**
- * Compute senone scores from top-N densities for active codebooks.
+ * Compute senone scores from top-N densities for active codebooks in
+ * frame fe, for the senones using codebooks cb_start to cb_end - 1.
+ *
+ * @return the best score.
  */
 static int
-ptm_mgau_senone_eval(ptm_mgau_t *s, int16 *senone_scores,
+ptm_mgau_senone_eval(ptm_mgau_t *s, ptm_fast_eval_t *fe,
+                     int16 *senone_scores,
                      uint8 *senone_active, int32 n_senone_active,
-                     int compall)
+                     int compall, int cb_start, int cb_end)
 {
     int i, lastsen, bestscore;
 
-    memset(senone_scores, 0, s->n_sen * sizeof(*senone_scores));
     /* FIXME: This is the non-cache-efficient way to do this.  We want
      * to evaluate one codeword at a time but this requires us to have
      * a reverse codebook to senone mapping, which we don't have
@@ -346,8 +345,9 @@ ptm_mgau_senone_eval(ptm_mgau_t *s, int16 *senone_scores,
             sen = senone_active[i] + lastsen;
         lastsen = sen;
         cb = s->sen2cb[sen];
-
-        if (bitvec_is_clear(s->f->mgau_active, cb)) {
+        if (cb < cb_start || cb >= cb_end)
+            continue;
+        if (bitvec_is_clear(fe->mgau_active, cb)) {
             int j;
             /* Because senone_active is deltas we can't really "knock
              * out" senones from pruned codebooks, and in any case,
@@ -355,7 +355,7 @@ ptm_mgau_senone_eval(ptm_mgau_t *s, int16 *senone_scores,
              * which doesn't expect senone_active to change. */
             for (f = 0; f < s->g->n_feat; ++f) {
                 for (j = 0; j < s->max_topn; ++j) {
-                    s->f->topn[cb][f][j].score = MAX_NEG_ASCR;
+                    fe->topn[cb][f][j].score = MAX_NEG_ASCR;
                 }
             }
         }
@@ -365,7 +365,7 @@ ptm_mgau_senone_eval(ptm_mgau_t *s, int16 *senone_scores,
         for (f = 0; f < s->g->n_feat; ++f) {
             ptm_topn_t *topn;
             int j, fden = 0;
-            topn = s->f->topn[cb][f];
+            topn = fe->topn[cb][f];
             for (j = 0; j < s->max_topn; ++j) {
                 int mixw;
                 /* Find mixture weight for this codeword. */
@@ -390,13 +390,8 @@ ptm_mgau_senone_eval(ptm_mgau_t *s, int16 *senone_scores,
         if (ascore < bestscore) bestscore = ascore;
         senone_scores[sen] = ascore;
     }
-    /* Normalize the scores again (finishing the job we started above
-     * in ptm_mgau_codebook_eval...) */
-    for (i = 0; i < s->n_sen; ++i) {
-        senone_scores[i] -= bestscore;
-    }
 
-    return 0;
+    return bestscore;
 }
 
 /**
@@ -409,44 +404,152 @@ ptm_mgau_frame_eval(ps_mgau_t *ps,
                     int32 n_senone_active,
                     mfcc_t ** featbuf, int32 frame,
                     int32 compallsen)
+{
+    if (ptm_mgau_frame_eval_block(ps, &senone_scores, senone_active,
+                                  n_senone_active, &featbuf, frame, 1,
+                                  compallsen) < 0)
+        return -1;
+    return 0;
+}
+
+/* Arguments of ptm_mgau_frame_eval_block() for each part. */
+typedef struct ptm_mgau_job_s {
+    ptm_mgau_t *s;
+    int phase;             /**< 0 for codebooks, 1 for senones. */
+    int16 **senone_scores;
+    uint8 *senone_active;
+    int32 n_senone_active;
+    mfcc_t ***featbuf;
+    int32 frame;
+    int32 k0;              /**< First frame whose top-N is computed. */
+    int32 n_frame;
+    int32 compallsen;
+} ptm_mgau_job_t;
+
+/**
+ * Evaluate a range of codebooks, or the senones that use them, for
+ * all frames of a block.
+ */
+static void
+ptm_mgau_eval_part(void *arg, int part, int n_part)
+{
+    ptm_mgau_job_t *job = (ptm_mgau_job_t *)arg;
+    ptm_mgau_t *s = job->s;
+    int cb_start, cb_end, i, k;
+
+    cb_start = part * s->g->n_mgau / n_part;
+    cb_end = (part + 1) * s->g->n_mgau / n_part;
+
+    if (job->phase == 0) {
+        for (i = cb_start; i < cb_end; ++i) {
+            for (k = job->k0; k < job->n_frame; ++k) {
+                ptm_fast_eval_t *f = s->hist + (job->frame + k) % s->n_fast_hist;
+                ptm_mgau_codebook_eval(s, f, i, job->featbuf[k],
+                                       job->frame + k, s->part_dist[part]);
+            }
+        }
+    }
+    else {
+        for (k = 0; k < job->n_frame; ++k) {
+            ptm_fast_eval_t *f = s->hist + (job->frame + k) % s->n_fast_hist;
+            s->blk_best[part][k]
+                = ptm_mgau_senone_eval(s, f, job->senone_scores[k],
+                                       job->senone_active,
+                                       job->n_senone_active,
+                                       job->compallsen, cb_start, cb_end);
+        }
+    }
+}
+
+static void
+ptm_mgau_run(ptm_mgau_t *s, ptm_mgau_job_t *job)
+{
+    if (s->pool)
+        thread_pool_run(s->pool, ptm_mgau_eval_part, job);
+    else
+        ptm_mgau_eval_part(job, 0, 1);
+}
+
+/**
+ * Compute senone scores for the active senones in several frames.
+ * Each codebook is evaluated for all the frames before moving on to
+ * the next, which is what makes this faster than one frame at a time.
+ * With -senthreads, codebooks are split in contiguous ranges, each of
+ * which is evaluated by a different thread, and so are the senones
+ * using them.
+ */
+int32
+ptm_mgau_frame_eval_block(ps_mgau_t *ps,
+                          int16 **senone_scores,
+                          uint8 *senone_active,
+                          int32 n_senone_active,
+                          mfcc_t *** featbuf, int32 frame,
+                          int32 n_frame,
+                          int32 compallsen)
 {
     ptm_mgau_t *s = (ptm_mgau_t *)ps;
-    int fast_eval_idx;
-
-    /* Find the appropriate frame in the rotating history buffer
-     * corresponding to the requested input frame.  No bounds checking
-     * is done here, which just means you'll get semi-random crap if
-     * you request a frame in the future or one that's too far in the
-     * past.  Since the history buffer is just used for fast match
-     * that might not be fatal. */
-    fast_eval_idx = frame % s->n_fast_hist;
-    s->f = s->hist + fast_eval_idx;
-    /* Compute the top-N codewords for every codebook, unless this
-     * is a past frame, in which case we already have them (we
-     * hope!) */
-    if (frame >= ps_mgau_base(ps)->frame_idx) {
-        ptm_fast_eval_t *lastf;
-        /* Get the previous frame's top-N information (on the
-         * first frame of the input this is just all WORST_DIST,
-         * no harm in that) */
-        if (fast_eval_idx == 0)
-            lastf = s->hist + s->n_fast_hist - 1;
-        else
-            lastf = s->hist + fast_eval_idx - 1;
-        /* Copy in initial top-N info */
-        memcpy(s->f->topn[0][0], lastf->topn[0][0],
-               s->g->n_mgau * s->g->n_feat * s->max_topn * sizeof(ptm_topn_t));
-        /* Generate initial active codebook list (this might not be
-         * necessary) */
+    ptm_mgau_job_t job;
+    int i, k, p;
+
+    /* Don't overwrite the top-N of the first frame. */
+    if (n_frame > s->n_fast_hist - 1)
+        n_frame = s->n_fast_hist - 1;
+
+    job.s = s;
+    job.senone_scores = senone_scores;
+    job.senone_active = senone_active;
+    job.n_senone_active = n_senone_active;
+    job.featbuf = featbuf;
+    job.frame = frame;
+    job.n_frame = n_frame;
+    job.compallsen = compallsen;
+
+    /* Find the appropriate frames in the rotating history buffer
+     * corresponding to the requested input frames.  No bounds
+     * checking is done here, which just means you'll get semi-random
+     * crap if you request a frame in the future or one that's too
+     * far in the past.  Since the history buffer is just used for
+     * fast match that might not be fatal.
+     *
+     * Compute the top-N codewords for every codebook, except for past
+     * frames, for which we already have them (we hope!) */
+    job.k0 = ps_mgau_base(ps)->frame_idx - frame;
+    if (job.k0 < 0)
+        job.k0 = 0;
+    if (job.k0 > n_frame)
+        job.k0 = n_frame;
+    /* Generate initial active codebook list (this might not be
+     * necessary) */
+    for (k = job.k0; k < n_frame; ++k) {
+        s->f = s->hist + (frame + k) % s->n_fast_hist;
         ptm_mgau_calc_cb_active(s, senone_active, n_senone_active, compallsen);
-        /* Now evaluate top-N, prune, and evaluate remaining codebooks. */
-        ptm_mgau_codebook_eval(s, featbuf, frame);
     }
+    /* Now evaluate top-N, prune, and evaluate remaining codebooks. */
+    job.phase = 0;
+    ptm_mgau_run(s, &job);
+    for (k = job.k0; k < n_frame; ++k) {
+        s->f = s->hist + (frame + k) % s->n_fast_hist;
+        ptm_mgau_codebook_norm(s, frame + k);
+    }
+
     /* Evaluate intersection of active senones and active codebooks. */
-    ptm_mgau_senone_eval(s, senone_scores, senone_active,
-                         n_senone_active, compallsen);
+    for (k = 0; k < n_frame; ++k)
+        memset(senone_scores[k], 0, s->n_sen * sizeof(**senone_scores));
+    job.phase = 1;
+    ptm_mgau_run(s, &job);
+    /* Normalize the scores again (finishing the job we started above
+     * in ptm_mgau_codebook_norm...) */
+    for (k = 0; k < n_frame; ++k) {
+        int bestscore = s->blk_best[0][k];
+        for (p = 1; p < s->n_part; ++p)
+            if (bestscore > s->blk_best[p][k])
+                bestscore = s->blk_best[p][k];
+        for (i = 0; i < s->n_sen; ++i)
+            senone_scores[k][i] -= bestscore;
+    }
+    s->f = s->hist + (frame + n_frame - 1) % s->n_fast_hist;
 
-    return 0;
+    return n_frame;
 }
 
 static int32
@@ -765,6 +868,65 @@ read_mixw(ptm_mgau_t * s, char const *file_name, double SmoothMin)
     return n_sen;
 }
 
+/*
+ * Allocate the scratch space used to evaluate the model, which is
+ * private to each copy.
+ */
+static void
+ptm_mgau_alloc_state(ptm_mgau_t *s)
+{
+    cmd_ln_t *config = s->config;
+    int i;
+
+    /* Allocate fast-match history buffers.  We need enough for the
+     * phoneme lookahead window, plus the current frame, plus one for
+     * good measure? (FIXME: I don't remember why) */
+    s->n_fast_hist = cmd_ln_int32_r(config, "-pl_window") + 2;
+    /* Plus the frames scored ahead of time by -scoreblock. */
+    if (cmd_ln_int32_r(config, "-scoreblock") > 1)
+        s->n_fast_hist += cmd_ln_int32_r(config, "-scoreblock") - 1;
+    s->hist = ckd_calloc(s->n_fast_hist, sizeof(*s->hist));
+    /* s->f will be a rotating pointer into s->hist. */
+    s->f = s->hist;
+
+    /* Split codebooks among threads if requested. */
+    s->n_part = 1;
+    if (cmd_ln_int32_r(config, "-senthreads") > 1) {
+        /* Select the Gaussian kernel before the threads use it. */
+        E_INFO("Evaluating codebooks with %d threads and the %s kernel\n",
+               cmd_ln_int32_r(config, "-senthreads"), gmm_kernel_name());
+        s->pool = thread_pool_init(config,
+                                   cmd_ln_int32_r(config, "-senthreads") - 1);
+        if (s->pool)
+            s->n_part = thread_pool_size(s->pool) + 1;
+    }
+    s->blk_best = (int32 **)ckd_calloc_2d(s->n_part, s->n_fast_hist,
+                                          sizeof(**s->blk_best));
+    s->part_dist = (mfcc_t **)ckd_calloc_2d(s->n_part,
+                                            s->g->block[0][0]->n_alloc,
+                                            sizeof(**s->part_dist));
+    for (i = 0; i < s->n_fast_hist; ++i) {
+        int j, k, m;
+        /* Top-N codewords for every codebook and feature. */
+        s->hist[i].topn = ckd_calloc_3d(s->g->n_mgau, s->g->n_feat,
+                                        s->max_topn, sizeof(ptm_topn_t));
+        /* Initialize them to sane (yet arbitrary) defaults. */
+        for (j = 0; j < s->g->n_mgau; ++j) {
+            for (k = 0; k < s->g->n_feat; ++k) {
+                for (m = 0; m < s->max_topn; ++m) {
+                    s->hist[i].topn[j][k][m].cw = m;
+                    s->hist[i].topn[j][k][m].score = WORST_DIST;
+                }
+            }
+        }
+        /* Active codebook mapping (just codebook, not features,
+           at least not yet) */
+        s->hist[i].mgau_active = bitvec_alloc(s->g->n_mgau);
+        /* Start with them all on, prune them later. */
+        bitvec_set_all(s->hist[i].mgau_active, s->g->n_mgau);
+    }
+}
+
 ps_mgau_t *
 ptm_mgau_init(acmod_t *acmod, bin_mdef_t *mdef)
 {
@@ -789,10 +951,13 @@ ptm_mgau_init(acmod_t *acmod, bin_mdef_t *mdef)
     }
 
     /* Read means and variances. */
-    if ((s->g = gauden_init(cmd_ln_str_r(s->config, "-mean"),
-                            cmd_ln_str_r(s->config, "-var"),
-                            cmd_ln_float32_r(s->config, "-varfloor"),
-                            s->lmath)) == NULL)
+    if (acmod->bundle)
+        s->g = gauden_init_bundle(acmod->bundle, s->lmath);
+    if (s->g == NULL
+        && (s->g = gauden_init(cmd_ln_str_r(s->config, "-mean"),
+                               cmd_ln_str_r(s->config, "-var"),
+                               cmd_ln_float32_r(s->config, "-varfloor"),
+                               s->lmath)) == NULL)
         goto error_out;
     /* We only support 256 codebooks or less (like 640k or 2GB, this
      * should be enough for anyone) */
@@ -818,7 +983,15 @@ ptm_mgau_init(acmod_t *acmod, bin_mdef_t *mdef)
         }
     }
     /* Read mixture weights. */
-    if ((sendump_path = cmd_ln_str_r(s->config, "-sendump"))) {
+    if (acmod->bundle
+        && (s->mixw = model_bundle_get_sendump(acmod->bundle, s->g->n_feat,
+                                               s->g->n_density,
+                                               bin_mdef_n_sen(acmod->mdef),
+                                               &s->mixw_cb)) != NULL) {
+        s->n_sen = bin_mdef_n_sen(acmod->mdef);
+        s->bundle = model_bundle_retain(acmod->bundle);
+    }
+    else if ((sendump_path = cmd_ln_str_r(s->config, "-sendump"))) {
         if (read_sendump(s, acmod->mdef, sendump_path) < 0) {
             goto error_out;
         }
@@ -839,65 +1012,104 @@ ptm_mgau_init(acmod_t *acmod, bin_mdef_t *mdef)
     for (i = 0; i < s->n_sen; ++i)
         s->sen2cb[i] = bin_mdef_sen2cimap(acmod->mdef, i);
 
-    /* Allocate fast-match history buffers.  We need enough for the
-     * phoneme lookahead window, plus the current frame, plus one for
-     * good measure? (FIXME: I don't remember why) */
-    s->n_fast_hist = cmd_ln_int32_r(s->config, "-pl_window") + 2;
-    s->hist = ckd_calloc(s->n_fast_hist, sizeof(*s->hist));
-    /* s->f will be a rotating pointer into s->hist. */
-    s->f = s->hist;
-    for (i = 0; i < s->n_fast_hist; ++i) {
-        int j, k, m;
-        /* Top-N codewords for every codebook and feature. */
-        s->hist[i].topn = ckd_calloc_3d(s->g->n_mgau, s->g->n_feat,
-                                        s->max_topn, sizeof(ptm_topn_t));
-        /* Initialize them to sane (yet arbitrary) defaults. */
-        for (j = 0; j < s->g->n_mgau; ++j) {
-            for (k = 0; k < s->g->n_feat; ++k) {
-                for (m = 0; m < s->max_topn; ++m) {
-                    s->hist[i].topn[j][k][m].cw = m;
-                    s->hist[i].topn[j][k][m].score = WORST_DIST;
-                }
-            }
-        }
-        /* Active codebook mapping (just codebook, not features,
-           at least not yet) */
-        s->hist[i].mgau_active = bitvec_alloc(s->g->n_mgau);
-        /* Start with them all on, prune them later. */
-        bitvec_set_all(s->hist[i].mgau_active, s->g->n_mgau);
-    }
+    ptm_mgau_alloc_state(s);
 
     ps = (ps_mgau_t *)s;
     ps->vt = &ptm_mgau_funcs;
+    ps->refcount = 1;
     return ps;
 error_out:
     ptm_mgau_free(ps_mgau_base(s));
     return NULL;
 }
 
+int
+ptm_mgau_write_bundle(ps_mgau_t *ps, model_bundle_writer_t *w)
+{
+    ptm_mgau_t *s = (ptm_mgau_t *)ps;
+
+    if (gauden_write_bundle(s->g, w) < 0)
+        return -1;
+    return model_bundle_write_sendump(w, s->mixw, s->mixw_cb,
+                                      s->g->n_feat, s->g->n_density, s->n_sen);
+}
+
 int
 ptm_mgau_mllr_transform(ps_mgau_t *ps,
                             ps_mllr_t *mllr)
 {
     ptm_mgau_t *s = (ptm_mgau_t *)ps;
-    return gauden_mllr_transform(s->g, mllr, s->config);
+
+    /* Copies adapt a copy of the original Gaussians. */
+    if (ps->shared)
+        return gauden_mllr_transform_shared(&s->g,
+                                            ((ptm_mgau_t *)ps->shared)->g,
+                                            mllr, s->config, s->pool);
+    return gauden_mllr_transform(s->g, mllr, s->config, s->pool);
+}
+
+ps_mgau_t *
+ptm_mgau_copy(ps_mgau_t *ps, acmod_t *acmod)
+{
+    ptm_mgau_t *other = (ptm_mgau_t *)ps;
+    ptm_mgau_t *s;
+
+    s = ckd_calloc(1, sizeof(*s));
+    s->config = acmod->config;
+    s->lmath = logmath_retain(other->lmath);
+    s->lmath_8b = logmath_retain(other->lmath_8b);
+    s->g = other->g;
+    s->n_sen = other->n_sen;
+    s->sen2cb = other->sen2cb;
+    s->mixw = other->mixw;
+    s->sendump_mmap = other->sendump_mmap;
+    s->bundle = other->bundle;
+    s->mixw_cb = other->mixw_cb;
+    s->max_topn = other->max_topn;
+    s->ds_ratio = other->ds_ratio;
+    ptm_mgau_alloc_state(s);
+
+    s->base.vt = &ptm_mgau_funcs;
+    s->base.refcount = 1;
+    s->base.shared = ps_mgau_retain(ps);
+    return ps_mgau_base(s);
 }
 
 void
 ptm_mgau_free(ps_mgau_t *ps)
 {
     ptm_mgau_t *s = (ptm_mgau_t *)ps;
+    int i;
 
     logmath_free(s->lmath);
     logmath_free(s->lmath_8b);
-    if (s->sendump_mmap) {
-        ckd_free_2d(s->mixw); 
-        mmio_file_unmap(s->sendump_mmap);
+    /* Parameters belong to the original model in copies. */
+    if (ps->shared == NULL) {
+        if (s->bundle) {
+            ckd_free_2d(s->mixw);
+            model_bundle_free(s->bundle);
+        }
+        else if (s->sendump_mmap) {
+            ckd_free_2d(s->mixw); 
+            mmio_file_unmap(s->sendump_mmap);
+        }
+        else {
+            ckd_free_3d(s->mixw);
+        }
+        ckd_free(s->sen2cb);
+        gauden_free(s->g);
     }
-    else {
-        ckd_free_3d(s->mixw);
+    else if (s->g != ((ptm_mgau_t *)ps->shared)->g) {
+        gauden_free(s->g);
+    }
+    for (i = 0; s->hist && i < s->n_fast_hist; ++i) {
+        ckd_free_3d(s->hist[i].topn);
+        bitvec_free(s->hist[i].mgau_active);
     }
-    ckd_free(s->sen2cb);
-    gauden_free(s->g);
+    ckd_free(s->hist);
+    thread_pool_free(s->pool);
+    ckd_free_2d(s->blk_best);
+    ckd_free_2d(s->part_dist);
+    ps_mgau_free(ps->shared);
     ckd_free(s);
 }
@@ -52,6 +52,7 @@
 #include "hmm.h"
 #include "bin_mdef.h"
 #include "ms_gauden.h"
+#include "thread_pool.h"
 
 typedef struct ptm_mgau_s ptm_mgau_t;
 
@@ -73,6 +74,7 @@ struct ptm_mgau_s {
     uint8 *sen2cb;     /**< Senone to codebook mapping. */
     uint8 ***mixw;     /**< Mixture weight distributions by feature, codeword, senone */
     mmio_file_t *sendump_mmap;/* Memory map for mixw (or NULL if not mmap) */
+    model_bundle_t *bundle;   /* Model bundle holding mixw (or NULL) */
     uint8 *mixw_cb;    /* Mixture weight codebook, if any (assume it contains 16 values) */
     int16 max_topn;
     int16 ds_ratio;
@@ -81,6 +83,11 @@ struct ptm_mgau_s {
     ptm_fast_eval_t *f;      /**< Fast eval info for current frame. */
     int n_fast_hist;         /**< Number of past frames tracked. */
 
+    thread_pool_t *pool;     /**< Threads evaluating codebooks (or NULL). */
+    int n_part;              /**< Number of parts codebooks are split in. */
+    mfcc_t **part_dist;      /**< Density scratch space for each part. */
+    int32 **blk_best;        /**< Best senone score for each part and frame. */
+
     /* Log-add table for compressed values. */
     logmath_t *lmath_8b;
     /* Log-add object for reloading means/variances. */
@@ -88,6 +95,7 @@ struct ptm_mgau_s {
 };
 
 ps_mgau_t *ptm_mgau_init(acmod_t *acmod, bin_mdef_t *mdef);
+ps_mgau_t *ptm_mgau_copy(ps_mgau_t *s, acmod_t *acmod);
 void ptm_mgau_free(ps_mgau_t *s);
 int ptm_mgau_frame_eval(ps_mgau_t *s,
                         int16 *senone_scores,
@@ -96,6 +104,15 @@ int ptm_mgau_frame_eval(ps_mgau_t *s,
                         mfcc_t **featbuf,
                         int32 frame,
                         int32 compallsen);
+int ptm_mgau_frame_eval_block(ps_mgau_t *s,
+                              int16 **senone_scores,
+                              uint8 *senone_active,
+                              int32 n_senone_active,
+                              mfcc_t ***featbuf,
+                              int32 frame,
+                              int32 n_frame,
+                              int32 compallsen);
+int ptm_mgau_write_bundle(ps_mgau_t *s, model_bundle_writer_t *w);
 int ptm_mgau_mllr_transform(ps_mgau_t *s,
                             ps_mllr_t *mllr);
 
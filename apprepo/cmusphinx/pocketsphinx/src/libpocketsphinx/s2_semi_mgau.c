@@ -68,7 +68,10 @@
 static ps_mgaufuncs_t s2_semi_mgau_funcs = {
     "s2_semi",
     s2_semi_mgau_frame_eval,      /* frame_eval */
+    s2_semi_mgau_frame_eval_block, /* frame_eval_block */
     s2_semi_mgau_mllr_transform,  /* transform */
+    s2_semi_mgau_copy,            /* copy */
+    s2_semi_mgau_write_bundle,    /* write_bundle */
     s2_semi_mgau_free             /* free */
 };
 
@@ -77,8 +80,12 @@ struct vqFeature_s {
     int32 codeword; /* codeword (vector index) */
 };
 
+/*
+ * Re-evaluate the top-N densities from the previous frame.  If dist
+ * is not NULL, it holds the scores of all the densities.
+ */
 static void
-eval_topn(s2_semi_mgau_t *s, int32 feat, mfcc_t *z)
+eval_topn(s2_semi_mgau_t *s, int32 feat, mfcc_t *z, mfcc_t const *dist)
 {
     int i, ceplen;
     vqFeature_t *topn;
@@ -94,16 +101,21 @@ eval_topn(s2_semi_mgau_t *s, int32 feat, mfcc_t *z)
         int32 cw, j;
 
         cw = topn[i].codeword;
-        mean = s->means[feat][0] + cw * ceplen;
-        var = s->vars[feat][0] + cw * ceplen;
-        d = s->dets[feat][cw];
-        obs = z;
-        for (j = 0; j < ceplen; j++) {
-            diff = *obs++ - *mean++;
-            sqdiff = MFCCMUL(diff, diff);
-            compl = MFCCMUL(sqdiff, *var);
-            d = GMMSUB(d, compl);
-            ++var;
+        if (dist) {
+            d = dist[cw];
+        }
+        else {
+            mean = s->means[feat][0] + cw * ceplen;
+            var = s->vars[feat][0] + cw * ceplen;
+            d = s->dets[feat][cw];
+            obs = z;
+            for (j = 0; j < ceplen; j++) {
+                diff = *obs++ - *mean++;
+                sqdiff = MFCCMUL(diff, diff);
+                compl = MFCCMUL(sqdiff, *var);
+                d = GMMSUB(d, compl);
+                ++var;
+            }
         }
         topn[i].score = (int32)d;
         if (i == 0)
@@ -116,45 +128,24 @@ eval_topn(s2_semi_mgau_t *s, int32 feat, mfcc_t *z)
     }
 }
 
+/*
+ * Merge the scores of all the densities, as computed by
+ * gmm_block_eval(), into the top-N.
+ */
 static void
-eval_cb(s2_semi_mgau_t *s, int32 feat, mfcc_t *z)
+eval_cb(s2_semi_mgau_t *s, int32 feat, mfcc_t const *dist)
 {
     vqFeature_t *worst, *best, *topn;
-    mfcc_t *mean;
-    mfcc_t *var, *det, *detP, *detE;
-    int32 i, ceplen;
+    int32 i, cw;
 
     best = topn = s->f[feat];
     worst = topn + (s->max_topn - 1);
-    mean = s->means[feat][0];
-    var = s->vars[feat][0];
-    det = s->dets[feat];
-    detE = det + s->n_density;
-    ceplen = s->veclen[feat];
 
-    for (detP = det; detP < detE; ++detP) {
-        mfcc_t diff, sqdiff, compl; /* diff, diff^2, component likelihood */
-        mfcc_t d;
-        mfcc_t *obs;
+    for (cw = 0; cw < s->n_density; ++cw) {
         vqFeature_t *cur;
-        int32 cw, j;
+        mfcc_t d;
 
-        d = *detP;
-        obs = z;
-        cw = detP - det;
-        for (j = 0; (j < ceplen) && (d >= worst->score); ++j) {
-            diff = *obs++ - *mean++;
-            sqdiff = MFCCMUL(diff, diff);
-            compl = MFCCMUL(sqdiff, *var);
-            d = GMMSUB(d, compl);
-            ++var;
-        }
-        if (j < ceplen) {
-            /* terminated early, so not in topn */
-            mean += (ceplen - j);
-            var += (ceplen - j);
-            continue;
-        }
+        d = dist[cw];
         if ((int32)d < worst->score)
             continue;
         for (i = 0; i < s->max_topn; i++) {
@@ -176,14 +167,17 @@ eval_cb(s2_semi_mgau_t *s, int32 feat, mfcc_t *z)
 static void
 mgau_dist(s2_semi_mgau_t * s, int32 frame, int32 feat, mfcc_t * z)
 {
-    eval_topn(s, feat, z);
-
-    /* If this frame is skipped, do nothing else. */
-    if (frame % s->ds_ratio)
+    /* If this frame is skipped, only update the top-N. */
+    if (frame % s->ds_ratio) {
+        eval_topn(s, feat, z, NULL);
         return;
+    }
 
-    /* Evaluate the rest of the codebook (or subset thereof). */
-    eval_cb(s, feat, z);
+    /* Otherwise evaluate the whole codebook once and take the top-N
+     * from the previous frame from there. */
+    gmm_block_eval(s->g->block[0][feat], z, s->dist);
+    eval_topn(s, feat, z, s->dist);
+    eval_cb(s, feat, s->dist);
 }
 
 static int
@@ -834,6 +828,55 @@ get_scores_4b_feat_all(s2_semi_mgau_t * s, int i, int topn, int16 *senone_scores
     return 0;
 }
 
+static int32
+get_scores_feat(s2_semi_mgau_t *s, int i, int topn,
+                int16 *senone_scores, uint8 *senone_active,
+                int32 n_senone_active, int32 compallsen)
+{
+    if (s->mixw_cb) {
+        if (compallsen)
+            return get_scores_4b_feat_all(s, i, topn, senone_scores);
+        else
+            return get_scores_4b_feat(s, i, topn, senone_scores,
+                                      senone_active, n_senone_active);
+    }
+    else {
+        if (compallsen)
+            return get_scores_8b_feat_all(s, i, topn, senone_scores);
+        else
+            return get_scores_8b_feat(s, i, topn, senone_scores,
+                                      senone_active, n_senone_active);
+    }
+}
+
+/*
+ * Compute the top-N densities of all features for a frame.
+ */
+static void
+frame_topn(s2_semi_mgau_t *s, mfcc_t **featbuf, int32 frame)
+{
+    int i, topn_idx;
+
+    /* No bounds checking is done here, which just means you'll get
+     * semi-random crap if you request a frame in the future or one
+     * that's too far in the past. */
+    topn_idx = frame % s->n_topn_hist;
+    s->f = s->topn_hist[topn_idx];
+    /* For past frames this will already be computed. */
+    if (frame < ps_mgau_base(s)->frame_idx)
+        return;
+    for (i = 0; i < s->n_feat; ++i) {
+        vqFeature_t **lastf;
+        if (topn_idx == 0)
+            lastf = s->topn_hist[s->n_topn_hist-1];
+        else
+            lastf = s->topn_hist[topn_idx-1];
+        memcpy(s->f[i], lastf[i], sizeof(vqFeature_t) * s->max_topn);
+        mgau_dist(s, frame, i, featbuf[i]);
+        s->topn_hist_n[topn_idx][i] = mgau_norm(s, i);
+    }
+}
+
 /*
  * Compute senone scores for the active senones.
  */
@@ -849,40 +892,51 @@ s2_semi_mgau_frame_eval(ps_mgau_t *ps,
     int i, topn_idx;
 
     memset(senone_scores, 0, s->n_sen * sizeof(*senone_scores));
-    /* No bounds checking is done here, which just means you'll get
-     * semi-random crap if you request a frame in the future or one
-     * that's too far in the past. */
+    frame_topn(s, featbuf, frame);
     topn_idx = frame % s->n_topn_hist;
-    s->f = s->topn_hist[topn_idx];
+    for (i = 0; i < s->n_feat; ++i)
+        get_scores_feat(s, i, s->topn_hist_n[topn_idx][i], senone_scores,
+                        senone_active, n_senone_active, compallsen);
+
+    return 0;
+}
+
+/*
+ * Compute senone scores for the active senones in several frames.
+ * The top-N of each frame is seeded from the one before it, so these
+ * are found frame by frame, but the mixture weights of each feature
+ * are then read only once for all frames.
+ */
+int32
+s2_semi_mgau_frame_eval_block(ps_mgau_t *ps,
+                              int16 **senone_scores,
+                              uint8 *senone_active,
+                              int32 n_senone_active,
+                              mfcc_t *** featbuf, int32 frame,
+                              int32 n_frame,
+                              int32 compallsen)
+{
+    s2_semi_mgau_t *s = (s2_semi_mgau_t *)ps;
+    int i, k;
+
+    /* Don't overwrite the top-N of the first frame. */
+    if (n_frame > s->n_topn_hist - 1)
+        n_frame = s->n_topn_hist - 1;
+    for (k = 0; k < n_frame; ++k) {
+        memset(senone_scores[k], 0, s->n_sen * sizeof(**senone_scores));
+        frame_topn(s, featbuf[k], frame + k);
+    }
     for (i = 0; i < s->n_feat; ++i) {
-        /* For past frames this will already be computed. */
-        if (frame >= ps_mgau_base(ps)->frame_idx) {
-            vqFeature_t **lastf;
-            if (topn_idx == 0)
-                lastf = s->topn_hist[s->n_topn_hist-1];
-            else
-                lastf = s->topn_hist[topn_idx-1];
-            memcpy(s->f[i], lastf[i], sizeof(vqFeature_t) * s->max_topn);
-            mgau_dist(s, frame, i, featbuf[i]);
-            s->topn_hist_n[topn_idx][i] = mgau_norm(s, i);
-        }
-        if (s->mixw_cb) {
-            if (compallsen)
-                get_scores_4b_feat_all(s, i, s->topn_hist_n[topn_idx][i], senone_scores);
-            else
-                get_scores_4b_feat(s, i, s->topn_hist_n[topn_idx][i], senone_scores,
-                                   senone_active, n_senone_active);
-        }
-        else {
-            if (compallsen)
-                get_scores_8b_feat_all(s, i, s->topn_hist_n[topn_idx][i], senone_scores);
-            else
-                get_scores_8b_feat(s, i, s->topn_hist_n[topn_idx][i], senone_scores,
-                                   senone_active, n_senone_active);
+        for (k = 0; k < n_frame; ++k) {
+            int topn_idx = (frame + k) % s->n_topn_hist;
+            s->f = s->topn_hist[topn_idx];
+            get_scores_feat(s, i, s->topn_hist_n[topn_idx][i],
+                            senone_scores[k], senone_active,
+                            n_senone_active, compallsen);
         }
     }
 
-    return 0;
+    return n_frame;
 }
 
 static int32
@@ -1231,6 +1285,40 @@ split_topn(char const *str, uint8 *out, int nfeat)
 }
 
 
+/*
+ * Allocate the scratch space used to evaluate the model, which is
+ * private to each copy.
+ */
+static void
+s2_semi_mgau_alloc_state(s2_semi_mgau_t *s)
+{
+    cmd_ln_t *config = s->config;
+    int i;
+
+    /* Top-N scores from recent frames */
+    s->n_topn_hist = cmd_ln_int32_r(config, "-pl_window") + 2;
+    /* Frames scored ahead of time by -scoreblock must be kept too. */
+    if (cmd_ln_int32_r(config, "-scoreblock") > 1)
+        s->n_topn_hist += cmd_ln_int32_r(config, "-scoreblock") - 1;
+    s->topn_hist = (vqFeature_t ***)
+        ckd_calloc_3d(s->n_topn_hist, s->n_feat, s->max_topn,
+                      sizeof(***s->topn_hist));
+    s->topn_hist_n = ckd_calloc_2d(s->n_topn_hist, s->n_feat,
+                                   sizeof(**s->topn_hist_n));
+    for (i = 0; i < s->n_topn_hist; ++i) {
+        int j;
+        for (j = 0; j < s->n_feat; ++j) {
+            int k;
+            for (k = 0; k < s->max_topn; ++k) {
+                s->topn_hist[i][j][k].score = WORST_DIST;
+                s->topn_hist[i][j][k].codeword = k;
+            }
+        }
+    }
+
+    s->dist = ckd_calloc(s->g->block[0][0]->n_alloc, sizeof(*s->dist));
+}
+
 ps_mgau_t *
 s2_semi_mgau_init(acmod_t *acmod)
 {
@@ -1255,10 +1343,13 @@ s2_semi_mgau_init(acmod_t *acmod)
     }
 
     /* Read means and variances. */
-    if ((s->g = gauden_init(cmd_ln_str_r(s->config, "-mean"),
-                            cmd_ln_str_r(s->config, "-var"),
-                            cmd_ln_float32_r(s->config, "-varfloor"),
-                            s->lmath)) == NULL)
+    if (acmod->bundle)
+        s->g = gauden_init_bundle(acmod->bundle, s->lmath);
+    if (s->g == NULL
+        && (s->g = gauden_init(cmd_ln_str_r(s->config, "-mean"),
+                               cmd_ln_str_r(s->config, "-var"),
+                               cmd_ln_float32_r(s->config, "-varfloor"),
+                               s->lmath)) == NULL)
         goto error_out;
     /* Currently only a single codebook is supported. */
     if (s->g->n_mgau != 1)
@@ -1284,7 +1375,15 @@ s2_semi_mgau_init(acmod_t *acmod)
     }
     s->n_density = s->g->n_density;
     /* Read mixture weights */
-    if ((sendump_path = cmd_ln_str_r(s->config, "-sendump"))) {
+    if (acmod->bundle
+        && (s->mixw = model_bundle_get_sendump(acmod->bundle, s->n_feat,
+                                               s->n_density,
+                                               bin_mdef_n_sen(acmod->mdef),
+                                               &s->mixw_cb)) != NULL) {
+        s->n_sen = bin_mdef_n_sen(acmod->mdef);
+        s->bundle = model_bundle_retain(acmod->bundle);
+    }
+    else if ((sendump_path = cmd_ln_str_r(s->config, "-sendump"))) {
         if (read_sendump(s, acmod->mdef, sendump_path) < 0) {
             goto error_out;
         }
@@ -1308,38 +1407,82 @@ s2_semi_mgau_init(acmod_t *acmod)
     }
     E_INFOCONT("\n");
 
-    /* Top-N scores from recent frames */
-    s->n_topn_hist = cmd_ln_int32_r(s->config, "-pl_window") + 2;
-    s->topn_hist = (vqFeature_t ***)
-        ckd_calloc_3d(s->n_topn_hist, s->n_feat, s->max_topn,
-                      sizeof(***s->topn_hist));
-    s->topn_hist_n = ckd_calloc_2d(s->n_topn_hist, s->n_feat,
-                                   sizeof(**s->topn_hist_n));
-    for (i = 0; i < s->n_topn_hist; ++i) {
-        int j;
-        for (j = 0; j < s->n_feat; ++j) {
-            int k;
-            for (k = 0; k < s->max_topn; ++k) {
-                s->topn_hist[i][j][k].score = WORST_DIST;
-                s->topn_hist[i][j][k].codeword = k;
-            }
-        }
-    }
+    s2_semi_mgau_alloc_state(s);
 
     ps = (ps_mgau_t *)s;
     ps->vt = &s2_semi_mgau_funcs;
+    ps->refcount = 1;
     return ps;
 error_out:
     s2_semi_mgau_free(ps_mgau_base(s));
     return NULL;
 }
 
+int
+s2_semi_mgau_write_bundle(ps_mgau_t *ps, model_bundle_writer_t *w)
+{
+    s2_semi_mgau_t *s = (s2_semi_mgau_t *)ps;
+
+    if (gauden_write_bundle(s->g, w) < 0)
+        return -1;
+    return model_bundle_write_sendump(w, s->mixw, s->mixw_cb,
+                                      s->n_feat, s->n_density, s->n_sen);
+}
+
 int
 s2_semi_mgau_mllr_transform(ps_mgau_t *ps,
                             ps_mllr_t *mllr)
 {
     s2_semi_mgau_t *s = (s2_semi_mgau_t *)ps;
-    return gauden_mllr_transform(s->g, mllr, s->config);
+    int rv;
+
+    /* Copies adapt a copy of the original Gaussians.  There is only
+     * one codebook, so no point in splitting it among threads. */
+    if (ps->shared)
+        rv = gauden_mllr_transform_shared(&s->g,
+                                          ((s2_semi_mgau_t *)ps->shared)->g,
+                                          mllr, s->config, NULL);
+    else
+        rv = gauden_mllr_transform(s->g, mllr, s->config, NULL);
+    /* The parameters were reallocated. */
+    s->means = s->g->mean[0];
+    s->vars = s->g->var[0];
+    s->dets = s->g->det[0];
+    s->veclen = s->g->featlen;
+    return rv;
+}
+
+ps_mgau_t *
+s2_semi_mgau_copy(ps_mgau_t *ps, acmod_t *acmod)
+{
+    s2_semi_mgau_t *other = (s2_semi_mgau_t *)ps;
+    s2_semi_mgau_t *s;
+
+    s = ckd_calloc(1, sizeof(*s));
+    s->config = acmod->config;
+    s->lmath = logmath_retain(other->lmath);
+    s->lmath_8b = logmath_retain(other->lmath_8b);
+    s->g = other->g;
+    s->means = other->means;
+    s->vars = other->vars;
+    s->dets = other->dets;
+    s->mixw = other->mixw;
+    s->sendump_mmap = other->sendump_mmap;
+    s->bundle = other->bundle;
+    s->mixw_cb = other->mixw_cb;
+    s->veclen = other->veclen;
+    s->n_feat = other->n_feat;
+    s->n_density = other->n_density;
+    s->n_sen = other->n_sen;
+    s->topn_beam = other->topn_beam;
+    s->max_topn = other->max_topn;
+    s->ds_ratio = other->ds_ratio;
+    s2_semi_mgau_alloc_state(s);
+
+    s->base.vt = &s2_semi_mgau_funcs;
+    s->base.refcount = 1;
+    s->base.shared = ps_mgau_retain(ps);
+    return ps_mgau_base(s);
 }
 
 void
@@ -1349,18 +1492,30 @@ s2_semi_mgau_free(ps_mgau_t *ps)
 
     logmath_free(s->lmath);
     logmath_free(s->lmath_8b);
-    if (s->sendump_mmap) {
-        ckd_free_2d(s->mixw); 
-        mmio_file_unmap(s->sendump_mmap);
+    /* Parameters belong to the original model in copies. */
+    if (ps->shared == NULL) {
+        if (s->bundle) {
+            ckd_free_2d(s->mixw);
+            model_bundle_free(s->bundle);
+        }
+        else if (s->sendump_mmap) {
+            ckd_free_2d(s->mixw); 
+            mmio_file_unmap(s->sendump_mmap);
+        }
+        else {
+            ckd_free_3d(s->mixw);
+            if (s->mixw_cb)
+                ckd_free(s->mixw_cb);
+        }
+        gauden_free(s->g);
+        ckd_free(s->topn_beam);
     }
-    else {
-        ckd_free_3d(s->mixw);
-        if (s->mixw_cb)
-            ckd_free(s->mixw_cb);
+    else if (s->g != ((s2_semi_mgau_t *)ps->shared)->g) {
+        gauden_free(s->g);
     }
-    gauden_free(s->g);
-    ckd_free(s->topn_beam);
     ckd_free_2d(s->topn_hist_n);
     ckd_free_3d((void **)s->topn_hist);
+    ckd_free(s->dist);
+    ps_mgau_free(ps->shared);
     ckd_free(s);
 }
@@ -67,6 +67,7 @@ struct s2_semi_mgau_s {
 
     uint8 ***mixw;     /* mixture weight distributions */
     mmio_file_t *sendump_mmap;/* memory map for mixw (or NULL if not mmap) */
+    model_bundle_t *bundle;   /* Model bundle holding mixw (or NULL) */
 
     uint8 *mixw_cb;    /* mixture weight codebook, if any (assume it contains 16 values) */
     int32 *veclen;	/* Length of feature streams */
@@ -81,6 +82,7 @@ struct s2_semi_mgau_s {
     uint8 **topn_hist_n;      /**< Variable top-N for past frames. */
     vqFeature_t **f;          /**< Topn-N for currently scoring frame. */
     int n_topn_hist;          /**< Number of past frames tracked. */
+    mfcc_t *dist;             /**< Density scratch space. */
 
     /* Log-add table for compressed values. */
     logmath_t *lmath_8b;
@@ -89,6 +91,7 @@ struct s2_semi_mgau_s {
 };
 
 ps_mgau_t *s2_semi_mgau_init(acmod_t *acmod);
+ps_mgau_t *s2_semi_mgau_copy(ps_mgau_t *s, acmod_t *acmod);
 void s2_semi_mgau_free(ps_mgau_t *s);
 int s2_semi_mgau_frame_eval(ps_mgau_t *s,
                             int16 *senone_scores,
@@ -97,6 +100,15 @@ int s2_semi_mgau_frame_eval(ps_mgau_t *s,
                             mfcc_t **featbuf,
                             int32 frame,
                             int32 compallsen);
+int s2_semi_mgau_frame_eval_block(ps_mgau_t *s,
+                                  int16 **senone_scores,
+                                  uint8 *senone_active,
+                                  int32 n_senone_active,
+                                  mfcc_t ***featbuf,
+                                  int32 frame,
+                                  int32 n_frame,
+                                  int32 compallsen);
+int s2_semi_mgau_write_bundle(ps_mgau_t *s, model_bundle_writer_t *w);
 int s2_semi_mgau_mllr_transform(ps_mgau_t *s,
                                 ps_mllr_t *mllr);
 
@@ -0,0 +1,179 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2012 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * @file thread_pool.c Simple pool of worker threads.
+ */
+
+/* SphinxBase headers. */
+#include <sphinxbase/ckd_alloc.h>
+#include <sphinxbase/err.h>
+#include <sphinxbase/sbthread.h>
+
+/* Local headers. */
+#include "thread_pool.h"
+
+typedef struct thread_pool_worker_s {
+    thread_pool_t *pool;
+    int part;
+    sbthread_t *th;
+    sbevent_t *start;  /**< Signalled when there is a job to do. */
+    sbevent_t *done;   /**< Signalled when the job is done. */
+} thread_pool_worker_t;
+
+struct thread_pool_s {
+    thread_pool_worker_t *workers;
+    int n_thread;
+    int n_part;               /**< Number of parts of the current job. */
+    int running;              /**< Whether a job was started. */
+    int quit;                 /**< Set to make the threads exit. */
+    thread_pool_func_t func;  /**< Current job. */
+    void *arg;
+};
+
+static int
+thread_pool_main(sbthread_t *th)
+{
+    thread_pool_worker_t *w = sbthread_arg(th);
+    thread_pool_t *pool = w->pool;
+
+    while (sbevent_wait(w->start, -1, 0) == 0) {
+        if (pool->quit)
+            break;
+        (*pool->func)(pool->arg, w->part, pool->n_part);
+        sbevent_signal(w->done);
+    }
+    return 0;
+}
+
+thread_pool_t *
+thread_pool_init(cmd_ln_t *config, int n_thread)
+{
+    thread_pool_t *pool;
+    int i;
+
+    pool = ckd_calloc(1, sizeof(*pool));
+    pool->workers = ckd_calloc(n_thread, sizeof(*pool->workers));
+    for (i = 0; i < n_thread; ++i) {
+        thread_pool_worker_t *w = pool->workers + i;
+
+        w->pool = pool;
+        w->part = i;
+        if ((w->start = sbevent_init()) == NULL
+            || (w->done = sbevent_init()) == NULL
+            || (w->th = sbthread_start(config, thread_pool_main, w)) == NULL) {
+            E_ERROR("Failed to start worker thread %d\n", i);
+            pool->n_thread = i + 1;
+            thread_pool_free(pool);
+            return NULL;
+        }
+    }
+    pool->n_thread = n_thread;
+    return pool;
+}
+
+void
+thread_pool_free(thread_pool_t *pool)
+{
+    int i;
+
+    if (pool == NULL)
+        return;
+    thread_pool_wait(pool);
+    pool->quit = TRUE;
+    for (i = 0; i < pool->n_thread; ++i) {
+        thread_pool_worker_t *w = pool->workers + i;
+
+        if (w->th) {
+            sbevent_signal(w->start);
+            sbthread_free(w->th);
+        }
+        if (w->start)
+            sbevent_free(w->start);
+        if (w->done)
+            sbevent_free(w->done);
+    }
+    ckd_free(pool->workers);
+    ckd_free(pool);
+}
+
+int
+thread_pool_size(thread_pool_t *pool)
+{
+    return pool->n_thread;
+}
+
+static void
+thread_pool_signal(thread_pool_t *pool, thread_pool_func_t func,
+                   void *arg, int n_part)
+{
+    int i;
+
+    thread_pool_wait(pool);
+    pool->func = func;
+    pool->arg = arg;
+    pool->n_part = n_part;
+    pool->running = TRUE;
+    for (i = 0; i < pool->n_thread; ++i)
+        sbevent_signal(pool->workers[i].start);
+}
+
+void
+thread_pool_run(thread_pool_t *pool, thread_pool_func_t func, void *arg)
+{
+    thread_pool_signal(pool, func, arg, pool->n_thread + 1);
+    (*func)(arg, pool->n_thread, pool->n_thread + 1);
+    thread_pool_wait(pool);
+}
+
+void
+thread_pool_start(thread_pool_t *pool, thread_pool_func_t func, void *arg)
+{
+    thread_pool_signal(pool, func, arg, pool->n_thread);
+}
+
+int
+thread_pool_wait(thread_pool_t *pool)
+{
+    int i;
+
+    if (!pool->running)
+        return FALSE;
+    for (i = 0; i < pool->n_thread; ++i)
+        sbevent_wait(pool->workers[i].done, -1, 0);
+    pool->running = FALSE;
+    return TRUE;
+}
@@ -0,0 +1,119 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2012 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * @file thread_pool.h Simple pool of worker threads.
+ *
+ * Runs the same function on a fixed number of threads, each one
+ * working on a different part of the data, and waits for all of them
+ * to finish.  This is enough for splitting up acoustic scoring, where
+ * the parts are fixed and there is only ever one job in flight.
+ */
+
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+/* SphinxBase headers. */
+#include <sphinxbase/cmd_ln.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#if 0
+} /* Fool Emacs into not indenting things. */
+#endif
+
+/**
+ * Function run by each thread.
+ *
+ * @param arg Argument passed to thread_pool_run() or thread_pool_start().
+ * @param part Index of the part of the job to do, from 0 to n_part - 1.
+ * @param n_part Number of parts the job is split into.
+ */
+typedef void (*thread_pool_func_t)(void *arg, int part, int n_part);
+
+/**
+ * Thread pool object.
+ */
+typedef struct thread_pool_s thread_pool_t;
+
+/**
+ * Start a pool of worker threads.
+ *
+ * @param n_thread Number of worker threads.
+ * @return the new pool, or NULL if threads could not be started.
+ */
+thread_pool_t *thread_pool_init(cmd_ln_t *config, int n_thread);
+
+/**
+ * Stop all threads and release a pool.
+ */
+void thread_pool_free(thread_pool_t *pool);
+
+/**
+ * Number of worker threads in a pool.
+ */
+int thread_pool_size(thread_pool_t *pool);
+
+/**
+ * Run a job split in thread_pool_size() + 1 parts, the last of which
+ * is done by the calling thread, and wait for it to complete.
+ */
+void thread_pool_run(thread_pool_t *pool, thread_pool_func_t func, void *arg);
+
+/**
+ * Start a job split in thread_pool_size() parts and return
+ * immediately.  thread_pool_wait() must be called before the next
+ * one.
+ */
+void thread_pool_start(thread_pool_t *pool, thread_pool_func_t func, void *arg);
+
+/**
+ * Wait for the job started by thread_pool_start(), if any, to
+ * complete.
+ *
+ * @return TRUE if a job was running.
+ */
+int thread_pool_wait(thread_pool_t *pool);
+
+#if 0
+{ /* Stop indent from complaining */
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __THREAD_POOL_H__ */
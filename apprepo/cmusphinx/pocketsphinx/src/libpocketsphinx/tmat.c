@@ -207,6 +207,7 @@ tmat_init(char const *file_name, logmath_t *lmath, float64 tpfloor, int32 brepor
     }
 
     t = (tmat_t *) ckd_calloc(1, sizeof(tmat_t));
+    t->refcount = 1;
 
     if ((fp = fopen(file_name, "rb")) == NULL)
         E_FATAL_SYSTEM("Failed to open transition file '%s' for reading", file_name);
@@ -315,6 +316,62 @@ tmat_init(char const *file_name, logmath_t *lmath, float64 tpfloor, int32 brepor
     return t;
 }
 
+tmat_t *
+tmat_init_bundle(model_bundle_t *b, logmath_t *lmath)
+{
+    int32 const *hdr;
+    size_t size;
+    tmat_t *t;
+
+    if ((hdr = model_bundle_get(b, "tmat", &size)) == NULL)
+        return NULL;
+    if (size < MODEL_BUNDLE_ALIGN
+        || hdr[0] <= 0 || hdr[0] >= MAX_INT16
+        || hdr[1] <= 0 || hdr[1] >= MAX_INT16
+        || (size - MODEL_BUNDLE_ALIGN) / hdr[0] / hdr[1] < (size_t)hdr[1] + 1) {
+        E_ERROR("Transition matrices in %s are not valid\n",
+                model_bundle_name(b));
+        return NULL;
+    }
+    E_INFO("Reading HMM transition probability matrices from %s\n",
+           model_bundle_name(b));
+
+    t = (tmat_t *) ckd_calloc(1, sizeof(tmat_t));
+    t->refcount = 1;
+    t->n_tmat = hdr[0];
+    t->n_state = hdr[1];
+    t->tp = ckd_alloc_3d_ptr(t->n_tmat, t->n_state, t->n_state + 1,
+                             (uint8 *)hdr + MODEL_BUNDLE_ALIGN,
+                             sizeof(***t->tp));
+    t->bundle = model_bundle_retain(b);
+
+    if (tmat_chk_uppertri(t, lmath) < 0
+        || tmat_chk_1skip(t, lmath) < 0) {
+        E_ERROR("Transition matrices in %s have an unsupported topology\n",
+                model_bundle_name(b));
+        tmat_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+int
+tmat_write_bundle(tmat_t *t, model_bundle_writer_t *w)
+{
+    int32 hdr[2];
+    FILE *fh;
+
+    hdr[0] = t->n_tmat;
+    hdr[1] = t->n_state;
+    if ((fh = model_bundle_add(w, "tmat")) == NULL
+        || model_bundle_write_aligned(fh, hdr, sizeof(hdr)) < 0
+        || fwrite(t->tp[0][0], sizeof(***t->tp),
+                  t->n_tmat * t->n_state * (t->n_state + 1), fh)
+        != (size_t)t->n_tmat * t->n_state * (t->n_state + 1))
+        return -1;
+    return 0;
+}
+
 void
 tmat_report(tmat_t * t)
 {
@@ -325,6 +382,13 @@ tmat_report(tmat_t * t)
 
 }
 
+tmat_t *
+tmat_retain(tmat_t * t)
+{
+    ++t->refcount;
+    return t;
+}
+
 /* 
  *  RAH, Free memory allocated in tmat_init ()
  */
@@ -332,7 +396,13 @@ void
 tmat_free(tmat_t * t)
 {
     if (t) {
-        if (t->tp)
+        if (--t->refcount > 0)
+            return;
+        if (t->bundle) {
+            ckd_free_3d_ptr(t->tp);
+            model_bundle_free(t->bundle);
+        }
+        else if (t->tp)
             ckd_free_3d(t->tp);
         ckd_free(t);
     }
@@ -91,6 +91,9 @@
 /* SphinxBase headers. */
 #include <sphinxbase/logmath.h>
 
+/* Local headers. */
+#include "model_bundle.h"
+
 /** \file tmat.h
  *  \brief Transition matrix data structure.
  */
@@ -112,6 +115,8 @@ typedef struct {
     int16 n_tmat;	/**< Number matrices */
     int16 n_state;	/**< Number source states in matrix (only the emitting states);
 			   Number destination states = n_state+1, it includes the exit state */
+    int refcount;       /**< Reference count. */
+    model_bundle_t *bundle; /**< Model bundle holding tp (if any) */
 } tmat_t;
 
 
@@ -125,6 +130,17 @@ tmat_t *tmat_init (char const *tmatfile,/**< In: input file */
 					    
 
 
+/**
+ * Get transition matrices from a model bundle.
+ * @return NULL if the bundle has none.
+ */
+tmat_t *tmat_init_bundle(model_bundle_t *b, logmath_t *lmath);
+
+/**
+ * Add transition matrices to a model bundle.
+ */
+int tmat_write_bundle(tmat_t *t, model_bundle_writer_t *w);
+
 /** Dumping the transition matrix for debugging */
 
 void tmat_dump (tmat_t *tmat,  /**< In: transition matrix */
@@ -132,6 +148,12 @@ void tmat_dump (tmat_t *tmat,  /**< In: transition matrix */
     );	
 
 
+/**
+ * Retain a transition matrix, for instance to share it between
+ * several acoustic models.
+ */
+tmat_t *tmat_retain(tmat_t *t);
+
 /**
  * RAH, add code to remove memory allocated by tmat_init
  */
@@ -37,6 +37,10 @@
 
 /* System headers. */
 #include <stdio.h>
+#include <stdarg.h>
+#if defined(__linux__)
+#include <unistd.h>
+#endif
 
 /* SphinxBase headers. */
 #include <sphinxbase/pio.h>
@@ -44,6 +48,8 @@
 #include <sphinxbase/strfuncs.h>
 #include <sphinxbase/filename.h>
 #include <sphinxbase/byteorder.h>
+#include <sphinxbase/sbthread.h>
+#include <sphinxbase/profile.h>
 
 /* PocketSphinx headers. */
 #include <pocketsphinx.h>
@@ -82,6 +88,10 @@ static const arg_t ps_args_def[] = {
       ARG_INT32,
       "1",
       "Do every Nth line in the control file" },
+    { "-nthreads",
+      ARG_INT32,
+      "1",
+      "Number of utterances decoded in parallel, sharing the same models" },
     { "-mllrctl",
       ARG_STRING,
       NULL,
@@ -182,6 +192,50 @@ static const arg_t ps_args_def[] = {
     CMDLN_EMPTY_OPTION
 };
 
+/* Output stream, either a file or a memory buffer holding results
+ * until they can be written in order. */
+typedef struct batch_out_s {
+    FILE *fh;
+    char *buf;
+    size_t len, alloc;
+} batch_out_t;
+
+static void
+batch_printf(batch_out_t *out, char const *fmt, ...)
+{
+    va_list args;
+    int n;
+
+    if (out->fh) {
+        va_start(args, fmt);
+        vfprintf(out->fh, fmt, args);
+        va_end(args);
+        return;
+    }
+    for (;;) {
+        va_start(args, fmt);
+        n = vsnprintf(out->buf + out->len, out->alloc - out->len, fmt, args);
+        va_end(args);
+        if (n >= 0 && out->len + n < out->alloc) {
+            out->len += n;
+            return;
+        }
+        /* Some C libraries return -1 rather than the length needed. */
+        out->alloc = out->alloc * 2 + (n > 0 ? n : 0) + 256;
+        out->buf = ckd_realloc(out->buf, out->alloc);
+    }
+}
+
+static void
+batch_out_flush(batch_out_t *out, FILE *fh)
+{
+    if (fh && out->len)
+        fwrite(out->buf, 1, out->len, fh);
+    ckd_free(out->buf);
+    out->buf = NULL;
+    out->len = out->alloc = 0;
+}
+
 static mfcc_t **
 read_mfc_file(FILE *infh, int sf, int ef, int *out_nfr, int ceplen)
 {
@@ -502,7 +556,7 @@ write_nbest(ps_decoder_t *ps, char const *nbestdir, char const *uttid)
 }
 
 static int
-write_hypseg(FILE *fh, ps_decoder_t *ps, char const *uttid)
+write_hypseg(batch_out_t *out, ps_decoder_t *ps, char const *uttid)
 {
     int32 score, lscr, sf, ef;
     ps_seg_t *itor = ps_seg_iter(ps, &score);
@@ -516,7 +570,7 @@ write_hypseg(FILE *fh, ps_decoder_t *ps, char const *uttid)
         lscr += wlscr;
         itor = ps_seg_next(itor);
     }
-    fprintf(fh, "%s S %d T %d A %d L %d", uttid,
+    batch_printf(out, "%s S %d T %d A %d L %d", uttid,
             0, /* "scaling factor" which is mostly useless anyway */
             score, score - lscr, lscr);
     /* Now print out words. */
@@ -527,20 +581,20 @@ write_hypseg(FILE *fh, ps_decoder_t *ps, char const *uttid)
 
         ps_seg_prob(itor, &ascr, &wlscr, NULL);
         ps_seg_frames(itor, &sf, &ef);
-        fprintf(fh, " %d %d %d %s",
+        batch_printf(out, " %d %d %d %s",
                 sf, ascr,
                 /* FIXME: This is inconsistent with the total lm
                    score, but that's the way it's done in S3... */
                 lm ? ngram_score_to_prob(lm, wlscr) : wlscr, w);
         itor = ps_seg_next(itor);
     }
-    fprintf(fh, " %d\n", ef);
+    batch_printf(out, " %d\n", ef);
 
     return 0;
 }
 
 static int
-write_ctm(FILE *fh, ps_decoder_t *ps, ps_seg_t *itor, char const *uttid, int32 frate)
+write_ctm(batch_out_t *out, ps_decoder_t *ps, ps_seg_t *itor, char const *uttid, int32 frate)
 {
     logmath_t *lmath = ps_get_logmath(ps);
     char *dupid, *show, *channel, *c;
@@ -577,7 +631,7 @@ write_ctm(FILE *fh, ps_decoder_t *ps, ps_seg_t *itor, char const *uttid, int32 f
             prob = ps_seg_prob(itor, NULL, NULL, NULL);
             ps_seg_frames(itor, &sf, &ef);
         
-            fprintf(fh, "%s %s %.2f %.2f %s %.3f\n",
+            batch_printf(out, "%s %s %.2f %.2f %s %.3f\n",
                     show,
                     channel ? channel : "1",
                     ustart + (double)sf / frate,
@@ -593,6 +647,39 @@ write_ctm(FILE *fh, ps_decoder_t *ps, ps_seg_t *itor, char const *uttid, int32 f
     return 0;
 }
 
+/*
+ * Write out results for the utterance just decoded, to the outputs
+ * which are not NULL.
+ */
+static void
+write_results(ps_decoder_t *ps, cmd_ln_t *config, batch_out_t *hypout,
+              batch_out_t *hypsegout, batch_out_t *ctmout)
+{
+    char const *hyp, *uttid, *outlatdir, *nbestdir;
+    int32 score;
+
+    outlatdir = cmd_ln_str_r(config, "-outlatdir");
+    nbestdir = cmd_ln_str_r(config, "-nbestdir");
+    hyp = ps_get_hyp(ps, &score, &uttid);
+
+    if (hypout) {
+        batch_printf(hypout, "%s (%s %d)\n", hyp ? hyp : "", uttid, score);
+    }
+    if (hypsegout) {
+        write_hypseg(hypsegout, ps, uttid);
+    }
+    if (ctmout) {
+        ps_seg_t *itor = ps_seg_iter(ps, &score);
+        write_ctm(ctmout, ps, itor, uttid, cmd_ln_int32_r(config, "-frate"));
+    }
+    if (outlatdir) {
+        write_lattice(ps, outlatdir, uttid);
+    }
+    if (nbestdir) {
+        write_nbest(ps, nbestdir, uttid);
+    }
+}
+
 static void
 process_ctl(ps_decoder_t *ps, cmd_ln_t *config, FILE *ctlfh)
 {
@@ -602,18 +689,13 @@ process_ctl(ps_decoder_t *ps, cmd_ln_t *config, FILE *ctlfh)
     size_t len;
     FILE *hypfh = NULL, *hypsegfh = NULL, *ctmfh = NULL;
     FILE *mllrfh = NULL, *lmfh = NULL, *fsgfh = NULL;
+    batch_out_t hypout, hypsegout, ctmout;
     double n_speech, n_cpu, n_wall;
-    char const *outlatdir;
-    char const *nbestdir;
     char const *str;
-    int frate;
 
     ctloffset = cmd_ln_int32_r(config, "-ctloffset");
     ctlcount = cmd_ln_int32_r(config, "-ctlcount");
     ctlincr = cmd_ln_int32_r(config, "-ctlincr");
-    outlatdir = cmd_ln_str_r(config, "-outlatdir");
-    nbestdir = cmd_ln_str_r(config, "-nbestdir");
-    frate = cmd_ln_int32_r(config, "-frate");
 
     if ((str = cmd_ln_str_r(config, "-mllrctl"))) {
         mllrfh = fopen(str, "r");
@@ -661,6 +743,13 @@ process_ctl(ps_decoder_t *ps, cmd_ln_t *config, FILE *ctlfh)
         setbuf(ctmfh, NULL);
     }
 
+    memset(&hypout, 0, sizeof(hypout));
+    memset(&hypsegout, 0, sizeof(hypsegout));
+    memset(&ctmout, 0, sizeof(ctmout));
+    hypout.fh = hypfh;
+    hypsegout.fh = hypsegfh;
+    ctmout.fh = ctmfh;
+
     i = 0;
     while ((line = fread_line(ctlfh, &len))) {
         char *wptr[4];
@@ -717,8 +806,7 @@ process_ctl(ps_decoder_t *ps, cmd_ln_t *config, FILE *ctlfh)
             E_ERROR("Unexpected extra data in control file at line %d\n", i);
         }
         else {
-            char const *hyp, *file, *uttid;
-            int32 score;
+            char const *file, *uttid;
 
             file = wptr[0];
             uttid = NULL;
@@ -737,25 +825,12 @@ process_ctl(ps_decoder_t *ps, cmd_ln_t *config, FILE *ctlfh)
                 continue;
             if(process_ctl_line(ps, config, file, uttid, sf, ef) < 0)
                 continue;
-            hyp = ps_get_hyp(ps, &score, &uttid);
-            
+
             /* Write out results and such. */
-            if (hypfh) {
-                fprintf(hypfh, "%s (%s %d)\n", hyp ? hyp : "", uttid, score);
-            }
-            if (hypsegfh) {
-                write_hypseg(hypsegfh, ps, uttid);
-            }
-            if (ctmfh) {
-                ps_seg_t *itor = ps_seg_iter(ps, &score);
-                write_ctm(ctmfh, ps, itor, uttid, frate);
-            }
-            if (outlatdir) {
-                write_lattice(ps, outlatdir, uttid);
-            }
-            if (nbestdir) {
-                write_nbest(ps, nbestdir, uttid);
-            }
+            write_results(ps, config, hypfh ? &hypout : NULL,
+                          hypsegfh ? &hypsegout : NULL,
+                          ctmfh ? &ctmout : NULL);
+            uttid = ps_get_uttid(ps);
             ps_get_utt_time(ps, &n_speech, &n_cpu, &n_wall);
             E_INFO("%s: %.2f seconds speech, %.2f seconds CPU, %.2f seconds wall\n",
                    uttid, n_speech, n_cpu, n_wall);
@@ -785,6 +860,330 @@ done:
         fclose(ctmfh);
 }
 
+/* One utterance of the control file, decoded by one of several threads. */
+typedef struct batch_job_s {
+    char *line;     /**< Control file line, fields below point into it. */
+    char *lmline;   /**< LM name control file line, or NULL. */
+    char *file;
+    char *uttid;
+    char *lmname;
+    int32 sf, ef;
+    int done;       /**< Decoding finished (protected by batch_pool_t::mtx). */
+    int failed;
+    batch_out_t hyp, hypseg, ctm;
+    double n_speech, n_cpu, n_wall;
+} batch_job_t;
+
+/* Control file shared by the decoding threads. */
+typedef struct batch_pool_s {
+    cmd_ln_t *config;
+    batch_job_t *jobs;
+    int n_jobs;
+    int next_job;   /**< Next job to decode (protected by mtx). */
+    int hyp, hypseg, ctm; /**< Which outputs are buffered. */
+    sbmtx_t *mtx;
+    sbevent_t *evt; /**< Signalled whenever a job is done. */
+} batch_pool_t;
+
+/* A decoding thread, with its own decoder sharing the models. */
+typedef struct batch_worker_s {
+    batch_pool_t *pool;
+    ps_decoder_t *ps;
+    sbthread_t *th;
+    int n_utt;
+} batch_worker_t;
+
+/*
+ * Resident size of the process in bytes, or -1 if not known.
+ */
+static double
+process_memory(void)
+{
+#if defined(__linux__)
+    FILE *fh;
+    long size, resident;
+
+    if ((fh = fopen("/proc/self/statm", "r")) == NULL)
+        return -1;
+    if (fscanf(fh, "%ld %ld", &size, &resident) != 2)
+        resident = -1;
+    fclose(fh);
+    if (resident < 0)
+        return -1;
+    return (double)resident * sysconf(_SC_PAGESIZE);
+#else
+    return -1;
+#endif
+}
+
+static int
+batch_worker_main(sbthread_t *th)
+{
+    batch_worker_t *w = sbthread_arg(th);
+    batch_pool_t *pool = w->pool;
+
+    for (;;) {
+        batch_job_t *job = NULL;
+
+        sbmtx_lock(pool->mtx);
+        if (pool->next_job < pool->n_jobs)
+            job = pool->jobs + pool->next_job++;
+        sbmtx_unlock(pool->mtx);
+        if (job == NULL)
+            break;
+
+        if (process_lmnamectl_line(w->ps, pool->config, job->lmname) < 0
+            || process_ctl_line(w->ps, pool->config, job->file,
+                                job->uttid, job->sf, job->ef) < 0) {
+            job->failed = TRUE;
+        }
+        else {
+            /* Lattices and N-best lists go to separate files and
+             * can be written right away. */
+            write_results(w->ps, pool->config,
+                          pool->hyp ? &job->hyp : NULL,
+                          pool->hypseg ? &job->hypseg : NULL,
+                          pool->ctm ? &job->ctm : NULL);
+            ps_get_utt_time(w->ps, &job->n_speech, &job->n_cpu, &job->n_wall);
+            ++w->n_utt;
+        }
+
+        sbmtx_lock(pool->mtx);
+        job->done = TRUE;
+        sbmtx_unlock(pool->mtx);
+        sbevent_signal(pool->evt);
+    }
+    return 0;
+}
+
+/*
+ * Decode the control file with nthreads decoders sharing the models
+ * of ps.  Utterances are handed out in order and results are written
+ * in the order of the control file.  MLLR and FSG control files are
+ * not supported, since they change the shared models.
+ */
+static void
+process_ctl_threaded(ps_decoder_t *ps, cmd_ln_t *config, FILE *ctlfh,
+                     int nthreads, double mem_base)
+{
+    int32 ctloffset, ctlcount, ctlincr;
+    int32 i;
+    char *line;
+    size_t len;
+    FILE *hypfh = NULL, *hypsegfh = NULL, *ctmfh = NULL, *lmfh = NULL;
+    batch_pool_t pool;
+    batch_worker_t *workers;
+    int n_alloc, n_workers;
+    double mem_models, mem_decoders, mem_end;
+    double n_speech, n_cpu, n_wall, per_decoder;
+    ptmr_t tm;
+    char const *str;
+
+    ctloffset = cmd_ln_int32_r(config, "-ctloffset");
+    ctlcount = cmd_ln_int32_r(config, "-ctlcount");
+    ctlincr = cmd_ln_int32_r(config, "-ctlincr");
+
+    memset(&pool, 0, sizeof(pool));
+    pool.config = config;
+    workers = NULL;
+    n_workers = 0;
+
+    if ((str = cmd_ln_str_r(config, "-lmnamectl"))) {
+        lmfh = fopen(str, "r");
+        if (lmfh == NULL) {
+            E_ERROR_SYSTEM("Failed to open LM name control file file %s", str);
+            goto done;
+        }
+    }
+    if ((str = cmd_ln_str_r(config, "-hyp"))) {
+        hypfh = fopen(str, "w");
+        if (hypfh == NULL) {
+            E_ERROR_SYSTEM("Failed to open hypothesis file %s for writing", str);
+            goto done;
+        }
+        setbuf(hypfh, NULL);
+    }
+    if ((str = cmd_ln_str_r(config, "-hypseg"))) {
+        hypsegfh = fopen(str, "w");
+        if (hypsegfh == NULL) {
+            E_ERROR_SYSTEM("Failed to open hypothesis file %s for writing", str);
+            goto done;
+        }
+        setbuf(hypsegfh, NULL);
+    }
+    if ((str = cmd_ln_str_r(config, "-ctm"))) {
+        ctmfh = fopen(str, "w");
+        if (ctmfh == NULL) {
+            E_ERROR_SYSTEM("Failed to open hypothesis file %s for writing", str);
+            goto done;
+        }
+        setbuf(ctmfh, NULL);
+    }
+    pool.hyp = (hypfh != NULL);
+    pool.hypseg = (hypsegfh != NULL);
+    pool.ctm = (ctmfh != NULL);
+
+    /* Read the utterances to decode. */
+    n_alloc = 0;
+    i = 0;
+    while ((line = fread_line(ctlfh, &len))) {
+        char *wptr[4];
+        int32 nf;
+        char *lmline = NULL;
+        batch_job_t *job;
+
+        if (lmfh) {
+            lmline = fread_line(lmfh, &len);
+            if (lmline == NULL) {
+                E_ERROR("File size mismatch between control and LM control\n");
+                ckd_free(line);
+                goto done;
+            }
+        }
+        if (i < ctloffset) {
+            i += ctlincr;
+            goto nextline;
+        }
+        if (ctlcount != -1 && i >= ctloffset + ctlcount) {
+            goto nextline;
+        }
+
+        nf = str2words(line, wptr, 4);
+        if (nf == 0) {
+            i += ctlincr;
+            goto nextline;
+        }
+        else if (nf < 0) {
+            E_ERROR("Unexpected extra data in control file at line %d\n", i);
+            i += ctlincr;
+            goto nextline;
+        }
+        if (pool.n_jobs == n_alloc) {
+            n_alloc = n_alloc * 2 + 64;
+            pool.jobs = ckd_realloc(pool.jobs, n_alloc * sizeof(*pool.jobs));
+        }
+        job = pool.jobs + pool.n_jobs++;
+        memset(job, 0, sizeof(*job));
+        job->line = line;
+        job->lmline = lmline;
+        job->file = wptr[0];
+        job->sf = (nf > 1) ? atoi(wptr[1]) : 0;
+        job->ef = (nf > 2) ? atoi(wptr[2]) : -1;
+        job->uttid = (nf > 3) ? wptr[3] : NULL;
+        job->lmname = lmline ? string_trim(lmline, STRING_BOTH) : NULL;
+        i += ctlincr;
+        continue;
+    nextline:
+        ckd_free(lmline);
+        ckd_free(line);
+    }
+
+    /* Create the decoders, all but the first one sharing its models. */
+    mem_models = process_memory();
+    if (nthreads > pool.n_jobs)
+        nthreads = pool.n_jobs > 0 ? pool.n_jobs : 1;
+    workers = ckd_calloc(nthreads, sizeof(*workers));
+    workers[n_workers++].ps = ps_retain(ps);
+    while (n_workers < nthreads) {
+        if ((workers[n_workers].ps = ps_init_shared(ps)) == NULL) {
+            E_ERROR("Failed to create decoder %d, using %d threads\n",
+                    n_workers, n_workers);
+            break;
+        }
+        ++n_workers;
+    }
+    mem_decoders = process_memory();
+
+    pool.mtx = sbmtx_init();
+    pool.evt = sbevent_init();
+    ptmr_init(&tm);
+    ptmr_start(&tm);
+    for (i = 0; i < n_workers; ++i) {
+        workers[i].pool = &pool;
+        workers[i].th = sbthread_start(config, batch_worker_main, workers + i);
+    }
+
+    /* Write out results in the order of the control file. */
+    for (i = 0; i < pool.n_jobs; ++i) {
+        batch_job_t *job = pool.jobs + i;
+        char const *uttid;
+
+        for (;;) {
+            int done;
+
+            sbmtx_lock(pool.mtx);
+            done = job->done;
+            sbmtx_unlock(pool.mtx);
+            if (done)
+                break;
+            sbevent_wait(pool.evt, -1, -1);
+        }
+        batch_out_flush(&job->hyp, hypfh);
+        batch_out_flush(&job->hypseg, hypsegfh);
+        batch_out_flush(&job->ctm, ctmfh);
+        if (job->failed)
+            continue;
+        uttid = job->uttid ? job->uttid : job->file;
+        E_INFO("%s: %.2f seconds speech, %.2f seconds CPU, %.2f seconds wall\n",
+               uttid, job->n_speech, job->n_cpu, job->n_wall);
+        E_INFO("%s: %.2f xRT (CPU), %.2f xRT (elapsed)\n",
+               uttid, job->n_cpu / job->n_speech,
+               job->n_wall / job->n_speech);
+    }
+
+    for (i = 0; i < n_workers; ++i) {
+        sbthread_wait(workers[i].th);
+        sbthread_free(workers[i].th);
+    }
+    ptmr_stop(&tm);
+    mem_end = process_memory();
+
+    for (i = 0; i < n_workers; ++i) {
+        ps_get_all_time(workers[i].ps, &n_speech, &n_cpu, &n_wall);
+        E_INFO("THREAD %d: %d utterances, %.2f seconds speech, %.2f seconds wall\n",
+               i, workers[i].n_utt, n_speech, n_wall);
+    }
+    n_speech = 0;
+    for (i = 0; i < pool.n_jobs; ++i)
+        if (!pool.jobs[i].failed)
+            n_speech += pool.jobs[i].n_speech;
+    E_INFO("TOTAL %.2f seconds speech, %.2f seconds wall with %d threads\n",
+           n_speech, tm.t_elapsed, n_workers);
+    E_INFO("AVERAGE %.2f xRT (elapsed), %.2f xRT (elapsed) per thread\n",
+           tm.t_elapsed / n_speech, tm.t_elapsed * n_workers / n_speech);
+    if (mem_base >= 0 && mem_models >= 0 && mem_decoders >= 0 && mem_end >= 0) {
+        /* The first decoder's own memory is included in mem_models. */
+        per_decoder = (n_workers > 1)
+            ? (mem_decoders - mem_models) / (n_workers - 1) : 0;
+        E_INFO("MEMORY %.1f MB shared models, %.1f MB per thread at startup, "
+               "%.1f MB in total\n",
+               (mem_models - mem_base - per_decoder) / 1048576,
+               per_decoder / 1048576, (mem_end - mem_base) / 1048576);
+    }
+
+done:
+    for (i = 0; i < n_workers; ++i)
+        ps_free(workers[i].ps);
+    ckd_free(workers);
+    for (i = 0; i < pool.n_jobs; ++i) {
+        ckd_free(pool.jobs[i].line);
+        ckd_free(pool.jobs[i].lmline);
+    }
+    ckd_free(pool.jobs);
+    if (pool.evt)
+        sbevent_free(pool.evt);
+    if (pool.mtx)
+        sbmtx_free(pool.mtx);
+    if (lmfh)
+        fclose(lmfh);
+    if (hypfh)
+        fclose(hypfh);
+    if (hypsegfh)
+        fclose(hypsegfh);
+    if (ctmfh)
+        fclose(ctmfh);
+}
+
 int
 main(int32 argc, char *argv[])
 {
@@ -792,6 +1191,8 @@ main(int32 argc, char *argv[])
     cmd_ln_t *config;
     char const *ctl;
     FILE *ctlfh;
+    int nthreads;
+    double mem_base;
 
     /* Handle argument file as only argument. */
     if (argc == 2) {
@@ -814,12 +1215,22 @@ main(int32 argc, char *argv[])
     if ((ctlfh = fopen(ctl, "r")) == NULL) {
         E_FATAL_SYSTEM("Failed to open control file '%s'", ctl);
     }
+    nthreads = cmd_ln_int32_r(config, "-nthreads");
+    if (nthreads > 1 && (cmd_ln_str_r(config, "-mllrctl")
+                         || cmd_ln_str_r(config, "-fsgctl"))) {
+        E_WARN("-mllrctl and -fsgctl change the models, decoding with one thread\n");
+        nthreads = 1;
+    }
+    mem_base = process_memory();
     ps = ps_init(config);
     if (ps == NULL) {
         E_FATAL("PocketSphinx decoder init failed\n");
     }
 
-    process_ctl(ps, config, ctlfh);
+    if (nthreads > 1)
+        process_ctl_threaded(ps, config, ctlfh, nthreads, mem_base);
+    else
+        process_ctl(ps, config, ctlfh);
 
     fclose(ctlfh);
     ps_free(ps);
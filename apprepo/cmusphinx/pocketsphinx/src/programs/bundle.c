@@ -0,0 +1,94 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2013 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * bundle.c - write acoustic model parameters to a model bundle
+ **/
+
+#include <stdio.h>
+
+#include <sphinxbase/err.h>
+#include <sphinxbase/strfuncs.h>
+
+#include <pocketsphinx.h>
+
+#include "pocketsphinx_internal.h"
+#include "acmod.h"
+
+static const arg_t bundle_args_def[] = {
+    POCKETSPHINX_OPTIONS,
+    { "-out",
+      ARG_STRING,
+      NULL,
+      "Model bundle to write (default: bundle in the -hmm directory)" },
+    CMDLN_EMPTY_OPTION
+};
+
+int
+main(int argc, char *argv[])
+{
+    cmd_ln_t *config;
+    ps_decoder_t *ps;
+    char *outfile;
+    int rv;
+
+    if ((config = cmd_ln_parse_r(NULL, bundle_args_def,
+                                 argc, argv, TRUE)) == NULL)
+        return 1;
+    if (cmd_ln_str_r(config, "-out"))
+        outfile = ckd_salloc(cmd_ln_str_r(config, "-out"));
+    else if (cmd_ln_str_r(config, "-hmm"))
+        outfile = string_join(cmd_ln_str_r(config, "-hmm"), "/bundle", NULL);
+    else {
+        E_ERROR("Give an acoustic model with -hmm, or -out\n");
+        cmd_ln_free_r(config);
+        return 1;
+    }
+    /* Always read the model files, not an existing bundle. */
+    cmd_ln_set_boolean_r(config, "-mmap", FALSE);
+
+    if ((ps = ps_init(config)) == NULL) {
+        ckd_free(outfile);
+        cmd_ln_free_r(config);
+        return 1;
+    }
+    rv = acmod_write_bundle(ps->acmod, outfile) < 0;
+
+    ckd_free(outfile);
+    ps_free(ps);
+    cmd_ln_free_r(config);
+    return rv;
+}
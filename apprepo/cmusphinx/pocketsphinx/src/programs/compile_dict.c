@@ -0,0 +1,143 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2013 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * compile_dict.c - write a compiled dictionary
+ **/
+
+#include <stdio.h>
+
+#include <sphinxbase/err.h>
+#include <sphinxbase/strfuncs.h>
+
+#include <pocketsphinx.h>
+
+#include "bin_mdef.h"
+#include "dict.h"
+
+static const arg_t compile_dict_args_def[] = {
+    { "-hmm",
+      ARG_STRING,
+      NULL,
+      "Directory containing acoustic model files." },
+    { "-mdef",
+      ARG_STRING,
+      NULL,
+      "Model definition input file (default: mdef in the -hmm directory)" },
+    { "-dict",
+      REQARG_STRING,
+      NULL,
+      "Main pronunciation dictionary (lexicon) input file" },
+    { "-fdict",
+      ARG_STRING,
+      NULL,
+      "Noise word pronunciation dictionary input file "
+      "(default: noisedict in the -hmm directory)" },
+    { "-dictcase",
+      ARG_BOOLEAN,
+      "no",
+      "Dictionary is case sensitive (NOTE: case insensitivity applies to ASCII characters only)" },
+    { "-out",
+      REQARG_STRING,
+      NULL,
+      "Compiled dictionary to write" },
+    CMDLN_EMPTY_OPTION
+};
+
+static int
+file_exists(const char *path)
+{
+    FILE *tmp;
+
+    tmp = fopen(path, "rb");
+    if (tmp) fclose(tmp);
+    return (tmp != NULL);
+}
+
+int
+main(int argc, char *argv[])
+{
+    cmd_ln_t *config;
+    bin_mdef_t *mdef;
+    dict_t *dict;
+    char const *hmmdir;
+    char *file;
+    int rv;
+
+    if ((config = cmd_ln_parse_r(NULL, compile_dict_args_def,
+                                 argc, argv, TRUE)) == NULL)
+        return 1;
+    hmmdir = cmd_ln_str_r(config, "-hmm");
+    if (cmd_ln_str_r(config, "-mdef") == NULL) {
+        if (hmmdir == NULL) {
+            E_ERROR("Give an acoustic model with -hmm, or -mdef\n");
+            cmd_ln_free_r(config);
+            return 1;
+        }
+        file = string_join(hmmdir, "/mdef", NULL);
+        cmd_ln_set_str_r(config, "-mdef", file);
+        ckd_free(file);
+    }
+    if (cmd_ln_str_r(config, "-fdict") == NULL && hmmdir) {
+        file = string_join(hmmdir, "/noisedict", NULL);
+        if (file_exists(file))
+            cmd_ln_set_str_r(config, "-fdict", file);
+        ckd_free(file);
+    }
+
+    if ((mdef = bin_mdef_read(NULL, cmd_ln_str_r(config, "-mdef"))) == NULL) {
+        cmd_ln_free_r(config);
+        return 1;
+    }
+    if ((dict = dict_init(config, mdef)) == NULL) {
+        bin_mdef_free(mdef);
+        cmd_ln_free_r(config);
+        return 1;
+    }
+    if (dict->bundle) {
+        E_ERROR("%s is already compiled\n", cmd_ln_str_r(config, "-dict"));
+        dict_free(dict);
+        bin_mdef_free(mdef);
+        cmd_ln_free_r(config);
+        return 1;
+    }
+    rv = dict_write_bundle(dict, cmd_ln_str_r(config, "-out")) < 0;
+
+    dict_free(dict);
+    bin_mdef_free(mdef);
+    cmd_ln_free_r(config);
+    return rv;
+}
@@ -0,0 +1,124 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2013 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * kdtree.c - build kd-trees for Gaussian selection in continuous models
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <pocketsphinx.h>
+
+#include "ms_gauden.h"
+#include "kdtree.h"
+
+static void
+usage(char const *prog)
+{
+    fprintf(stderr, "Usage: %s [-depth DEPTH] [-threshold NATS] "
+            "[-logbase BASE] [-varfloor FLOOR] MEANS VARIANCES OUTFILE\n", prog);
+}
+
+int
+main(int argc, char *argv[])
+{
+    char const *prog = argv[0];
+    logmath_t *lmath;
+    gauden_t *g;
+    kd_tree_t **trees;
+    float64 logbase = 1.0001;
+    float64 threshold = 3.0;
+    float32 varfloor = 0.0001;
+    int32 depth = 8;
+    int32 m, f, i, n_trees;
+    int rv = 0;
+
+    while (argc > 4 && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-depth") == 0)
+            depth = atoi(argv[2]);
+        else if (strcmp(argv[1], "-threshold") == 0)
+            threshold = atof(argv[2]);
+        else if (strcmp(argv[1], "-logbase") == 0)
+            logbase = atof(argv[2]);
+        else if (strcmp(argv[1], "-varfloor") == 0)
+            varfloor = atof(argv[2]);
+        else {
+            fprintf(stderr, "Unknown argument %s\n", argv[1]);
+            usage(prog);
+            return 1;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc != 4) {
+        usage(prog);
+        return 1;
+    }
+
+    lmath = logmath_init(logbase, 0, TRUE);
+    g = gauden_init(argv[1], argv[2], varfloor, lmath);
+    n_trees = g->n_mgau * g->n_feat;
+    trees = ckd_calloc(n_trees, sizeof(*trees));
+    for (m = 0, i = 0; m < g->n_mgau; ++m) {
+        for (f = 0; f < g->n_feat; ++f, ++i) {
+            /* Precisions are in the log base of the decoder. */
+            trees[i] = kd_tree_build(g->mean[m][f], g->var[m][f],
+                                     g->n_density, g->featlen[f], depth,
+                                     threshold / log(logbase));
+            if (trees[i] == NULL) {
+                rv = 1;
+                goto done;
+            }
+        }
+    }
+    if (kd_trees_write(argv[3], trees, n_trees) < 0) {
+        rv = 1;
+        goto done;
+    }
+
+    /* Read them back, which reports the average size of the boxes. */
+    if (gauden_load_kdtrees(g, argv[3], 0, -1) < 0)
+        rv = 1;
+
+done:
+    kd_trees_free(trees, n_trees);
+    gauden_free(g);
+    logmath_free(lmath);
+    return rv;
+}
@@ -0,0 +1,129 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2006 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * quantize.c - write quantized copies of continuous acoustic model parameters
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pocketsphinx.h>
+#include <sphinxbase/strfuncs.h>
+
+#include "ms_gauden.h"
+#include "ms_senone.h"
+
+static int
+file_exists(const char *path)
+{
+    FILE *tmp;
+
+    tmp = fopen(path, "rb");
+    if (tmp) fclose(tmp);
+    return (tmp != NULL);
+}
+
+static void
+usage(char const *prog)
+{
+    fprintf(stderr, "Usage: %s [-bits 8|16] [-logbase BASE] [-mixwfloor FLOOR] "
+            "INDIR OUTDIR\n", prog);
+}
+
+int
+main(int argc, char *argv[])
+{
+    char const *prog = argv[0];
+    char *infile, *outfile;
+    logmath_t *lmath;
+    float64 logbase = 1.0001;
+    float32 mixwfloor = 0.0000001;
+    int bits = 8;
+    int rv = 0;
+
+    while (argc > 3 && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-bits") == 0)
+            bits = atoi(argv[2]);
+        else if (strcmp(argv[1], "-logbase") == 0)
+            logbase = atof(argv[2]);
+        else if (strcmp(argv[1], "-mixwfloor") == 0)
+            mixwfloor = atof(argv[2]);
+        else {
+            fprintf(stderr, "Unknown argument %s\n", argv[1]);
+            usage(prog);
+            return 1;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc != 3) {
+        usage(prog);
+        return 1;
+    }
+
+    /* Means are quantized linearly, variances in the log domain. */
+    infile = string_join(argv[1], "/means", NULL);
+    outfile = string_join(argv[2], "/means", NULL);
+    if (gauden_param_quantize(infile, outfile, bits, FALSE) < 0)
+        rv = 1;
+    ckd_free(infile);
+    ckd_free(outfile);
+
+    infile = string_join(argv[1], "/variances", NULL);
+    outfile = string_join(argv[2], "/variances", NULL);
+    if (gauden_param_quantize(infile, outfile, bits, TRUE) < 0)
+        rv = 1;
+    ckd_free(infile);
+    ckd_free(outfile);
+
+    /* Semi-continuous models have a sendump instead. */
+    infile = string_join(argv[1], "/mixture_weights", NULL);
+    outfile = string_join(argv[2], "/mixture_weights", NULL);
+    lmath = logmath_init(logbase, 0, TRUE);
+    if (file_exists(infile)
+        && senone_mixw_quantize(infile, outfile, mixwfloor, lmath) < 0)
+        rv = 1;
+    logmath_free(lmath);
+    ckd_free(infile);
+    ckd_free(outfile);
+
+    if (rv == 0)
+        printf("Copy the other files of %s to %s to use the model\n",
+               argv[1], argv[2]);
+    return rv;
+}
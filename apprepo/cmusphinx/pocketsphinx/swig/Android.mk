@@ -121,8 +121,11 @@ LOCAL_SRC_FILES := \
 	fsg_history.c   \
 	fsg_lextree.c   \
 	fsg_search.c   \
+	gmm_kernel.c.arm   \
 	hmm.c.arm     \
+	kdtree.c   \
 	mdef.c     \
+	model_bundle.c   \
 	ms_gauden.c.arm    \
 	ms_mgau.c.arm    \
 	ms_senone.c.arm    \
@@ -135,6 +138,7 @@ LOCAL_SRC_FILES := \
 	ps_mllr.c    \
 	ptm_mgau.c.arm    \
 	s2_semi_mgau.c.arm   \
+	thread_pool.c   \
 	tmat.c     \
 	vector.c
 
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <pocketsphinx.h>
+#include <sphinxbase/strfuncs.h>
+#include <bin_mdef.h>
+
+#include "pocketsphinx_internal.h"
+#include "dict.h"
+#include "test_macros.h"
+
+#define N_LOOKUP 10
+
+static dict_t *
+read_dict(cmd_ln_t *config, bin_mdef_t *mdef, double *out_time)
+{
+	dict_t *dict;
+	ptmr_t t;
+
+	ptmr_init(&t);
+	ptmr_start(&t);
+	TEST_ASSERT(dict = dict_init(config, mdef));
+	ptmr_stop(&t);
+	*out_time = t.t_elapsed;
+	return dict;
+}
+
+/*
+ * Time looking up all words (and as many missing ones) N_LOOKUP
+ * times, in random order.
+ */
+static double
+lookup_time(dict_t *dict, dict_t *words)
+{
+	ptmr_t t;
+	char **missing;
+	uint32 r;
+	int i, j, n;
+
+	n = dict_size(words);
+	missing = ckd_calloc(n, sizeof(*missing));
+	for (j = 0; j < n; ++j)
+		missing[j] = string_join(words->word[j].word, "-", NULL);
+
+	r = 1;
+	ptmr_init(&t);
+	ptmr_start(&t);
+	for (i = 0; i < N_LOOKUP * n; ++i) {
+		r = r * 1103515245 + 12345;
+		j = (r >> 8) % n;
+		TEST_EQUAL(j, dict_wordid(dict, words->word[j].word));
+		TEST_EQUAL(BAD_S3WID, dict_wordid(dict, missing[j]));
+	}
+	ptmr_stop(&t);
+
+	for (j = 0; j < n; ++j)
+		ckd_free(missing[j]);
+	ckd_free(missing);
+	return t.t_elapsed;
+}
+
+static void
+compare_dict(dict_t *ref, dict_t *dict)
+{
+	int i, j;
+
+	TEST_EQUAL(dict_size(ref), dict_size(dict));
+	TEST_EQUAL(dict_filler_start(ref), dict_filler_start(dict));
+	TEST_EQUAL(dict_filler_end(ref), dict_filler_end(dict));
+	TEST_EQUAL(dict_startwid(ref), dict_startwid(dict));
+	TEST_EQUAL(dict_finishwid(ref), dict_finishwid(dict));
+	TEST_EQUAL(dict_silwid(ref), dict_silwid(dict));
+	for (i = 0; i < dict_size(ref); ++i) {
+		TEST_EQUAL(0, strcmp(ref->word[i].word, dict->word[i].word));
+		TEST_EQUAL(dict_basewid(ref, i), dict_basewid(dict, i));
+		TEST_EQUAL(dict_nextalt(ref, i), dict_nextalt(dict, i));
+		TEST_EQUAL(dict_pronlen(ref, i), dict_pronlen(dict, i));
+		for (j = 0; j < dict_pronlen(ref, i); ++j)
+			TEST_EQUAL(dict_pron(ref, i, j), dict_pron(dict, i, j));
+		TEST_EQUAL(dict_real_word(ref, i), dict_real_word(dict, i));
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	bin_mdef_t *mdef, *tidigits_mdef;
+	dict_t *ref, *dict;
+	cmd_ln_t *config;
+	s3cipid_t pron[2];
+	s3wid_t w;
+	double t_text, t_compiled;
+
+	TEST_ASSERT(config = cmd_ln_init(NULL, ps_args(), FALSE,
+					 "-dict", MODELDIR "/lm/en_US/cmu07a.dic",
+					 "-fdict", MODELDIR "/hmm/en_US/hub4wsj_sc_8k/noisedict",
+					 NULL));
+	TEST_ASSERT(mdef = bin_mdef_read(NULL, MODELDIR "/hmm/en_US/hub4wsj_sc_8k/mdef"));
+
+	/* Compile the dictionary, and read it back. */
+	ref = read_dict(config, mdef, &t_text);
+	TEST_EQUAL(0, dict_write_bundle(ref, "_cmu07a.dictc"));
+	cmd_ln_set_str_r(config, "-dict", "_cmu07a.dictc");
+	dict = read_dict(config, mdef, &t_compiled);
+	TEST_ASSERT(dict->bundle);
+	printf("dictionary load: %.2f msec text, %.2f msec compiled\n",
+	       t_text * 1000, t_compiled * 1000);
+	compare_dict(ref, dict);
+
+	printf("lookup %d words: %.2f msec text, %.2f msec compiled\n",
+	       dict_size(ref) * 2 * N_LOOKUP,
+	       lookup_time(ref, ref) * 1000, lookup_time(dict, ref) * 1000);
+
+	/* Words can be added to it, but not words it already has. */
+	pron[0] = bin_mdef_ciphone_id(mdef, "AH");
+	pron[1] = bin_mdef_ciphone_id(mdef, "B");
+	TEST_EQUAL(BAD_S3WID, dict_add_word(dict, "carnegie", pron, 2));
+	TEST_EQUAL(BAD_S3WID, dict_add_word(dict, "foobie(2)", pron, 2));
+	TEST_ASSERT(BAD_S3WID != (w = dict_add_word(dict, "foobie", pron, 2)));
+	TEST_EQUAL(w, dict_wordid(dict, "foobie"));
+	TEST_ASSERT(dict_real_word(dict, w));
+	TEST_ASSERT(BAD_S3WID != (w = dict_add_word(dict, "carnegie(9)", pron, 1)));
+	TEST_EQUAL(dict_wordid(dict, "carnegie"), dict_basewid(dict, w));
+	TEST_EQUAL(w, dict_nextalt(dict, dict_wordid(dict, "carnegie")));
+	TEST_EQUAL(BAD_S3WID, dict_wordid(dict, "CARNEGIE"));
+	dict_free(dict);
+	dict_free(ref);
+
+	/* Case-insensitive lookups work too. */
+	cmd_ln_set_str_r(config, "-dict", MODELDIR "/lm/en/turtle.dic");
+	cmd_ln_set_boolean_r(config, "-dictcase", TRUE);
+	TEST_ASSERT(ref = dict_init(config, mdef));
+	TEST_EQUAL(0, dict_write_bundle(ref, "_turtle.dictc"));
+	cmd_ln_set_str_r(config, "-dict", "_turtle.dictc");
+	TEST_ASSERT(dict = dict_init(config, mdef));
+	compare_dict(ref, dict);
+	TEST_ASSERT(BAD_S3WID != dict_wordid(dict, "FORWARD"));
+	TEST_EQUAL(dict_wordid(ref, "Forward"), dict_wordid(dict, "Forward"));
+	dict_free(dict);
+
+	/* But only with the same -dictcase, */
+	cmd_ln_set_boolean_r(config, "-dictcase", FALSE);
+	TEST_EQUAL(NULL, dict_init(config, mdef));
+	/* and the same phone set. */
+	cmd_ln_set_boolean_r(config, "-dictcase", TRUE);
+	TEST_ASSERT(tidigits_mdef = bin_mdef_read(NULL, MODELDIR "/hmm/en/tidigits/mdef"));
+	TEST_EQUAL(NULL, dict_init(config, tidigits_mdef));
+	bin_mdef_free(tidigits_mdef);
+
+	dict_free(ref);
+	bin_mdef_free(mdef);
+	cmd_ln_free_r(config);
+
+	return 0;
+}
@@ -0,0 +1,249 @@
+#include <pocketsphinx.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "pocketsphinx_internal.h"
+#include "fsg_search_internal.h"
+#include "test_macros.h"
+
+#define GRAMMAR "goforward_large.gram"
+#define IMPORT_GRAMMAR "goimport.gram"
+#define N_COMMAND 100
+#define N_COMMAND_WORD 20
+
+/*
+ * Write a larger version of goforward.gram, with commands made of
+ * words taken from the dictionary.
+ */
+static void
+write_grammar(void)
+{
+	FILE *dictfh, *fh;
+	char line[1024];
+	int i, n;
+
+	TEST_ASSERT(dictfh = fopen(MODELDIR "/lm/en_US/cmu07a.dic", "r"));
+	TEST_ASSERT(fh = fopen(GRAMMAR, "w"));
+	fprintf(fh, "#JSGF V1.0;\n\ngrammar goforward;\n\n"
+		"public <move> = go <direction> <distance> [meter | meters]"
+		" | <command>;\n"
+		"<direction> = forward | backward;\n"
+		"<distance> = one | two | three | four | five | six | seven"
+		" | eight | nine | ten;\n"
+		"<command> = <command0>");
+	for (i = 1; i < N_COMMAND; ++i)
+		fprintf(fh, " | <command%d>", i);
+	fprintf(fh, ";\n");
+
+	/* Every 50th plain word in the dictionary. */
+	i = n = 0;
+	while (i < N_COMMAND * N_COMMAND_WORD
+	       && fgets(line, sizeof(line), dictfh)) {
+		char *c;
+
+		for (c = line; islower((unsigned char)*c); ++c)
+			;
+		if (!isspace((unsigned char)*c) || c - line < 3)
+			continue;
+		if (n++ % 50 != 0)
+			continue;
+		*c = '\0';
+		if (i % N_COMMAND_WORD == 0)
+			fprintf(fh, "<command%d> = (%s", i / N_COMMAND_WORD, line);
+		else
+			fprintf(fh, " | %s", line);
+		if (++i % N_COMMAND_WORD == 0)
+			fprintf(fh, ") [<direction>] <distance>;\n");
+	}
+	TEST_EQUAL(N_COMMAND * N_COMMAND_WORD, i);
+	fclose(fh);
+	fclose(dictfh);
+}
+
+static cmd_ln_t *
+grammar_config(char const *grammar, char const *cache)
+{
+	cmd_ln_t *config;
+
+	TEST_ASSERT(config =
+		    cmd_ln_init(NULL, ps_args(), TRUE,
+				"-hmm", MODELDIR "/hmm/en_US/hub4wsj_sc_8k",
+				"-dict", MODELDIR "/lm/en_US/cmu07a.dic",
+				"-jsgf", grammar,
+				"-input_endian", "little",
+				"-samprate", "16000", NULL));
+	if (cache)
+		cmd_ln_set_str_r(config, "-fsgcache", cache);
+	return config;
+}
+
+static char *
+decode(ps_decoder_t *ps, int32 *out_score)
+{
+	FILE *rawfh;
+	char const *hyp;
+
+	TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+	TEST_ASSERT(ps_decode_raw(ps, rawfh, "goforward", -1) > 0);
+	fclose(rawfh);
+	hyp = ps_get_hyp(ps, out_score, NULL);
+	return ckd_salloc(hyp ? hyp : "");
+}
+
+/*
+ * Time loading the grammar into a new FSG search, and check whether
+ * it was compiled (unless compiled is -1).
+ */
+static double
+load_time(ps_decoder_t *ps, cmd_ln_t *config, int compiled)
+{
+	ps_search_t *search;
+	ptmr_t t;
+
+	ptmr_init(&t);
+	ptmr_start(&t);
+	TEST_ASSERT(search = fsg_search_init(config, ps->acmod,
+					     ps->dict, ps->d2p));
+	ptmr_stop(&t);
+	if (compiled != -1)
+		TEST_EQUAL(compiled,
+			   ((fsg_search_t *)search)->lextree->pnode_block != NULL);
+	fsg_search_free(search);
+	return t.t_elapsed;
+}
+
+/* Add goforward.gram as an FSG built by the application, and use it. */
+static void
+add_small_fsg(ps_decoder_t *ps, cmd_ln_t *config)
+{
+	fsg_set_t *fsgs;
+	fsg_model_t *fsg;
+
+	fsgs = ps_get_fsgset(ps);
+	TEST_ASSERT(fsg = jsgf_read_file(DATADIR "/goforward.gram",
+					 ps_get_logmath(ps),
+					 cmd_ln_float32_r(config, "-lw")));
+	TEST_EQUAL(fsg, fsg_set_add(fsgs, "small", fsg));
+	TEST_ASSERT(fsg_set_select(fsgs, "small"));
+	TEST_ASSERT(ps_update_fsgset(ps));
+}
+
+/* Write the grammar imported by IMPORT_GRAMMAR. */
+static void
+write_imported(char const *numbers)
+{
+	FILE *fh;
+
+	TEST_ASSERT(fh = fopen("gonumber.gram", "w"));
+	fprintf(fh, "#JSGF V1.0;\n\ngrammar gonumber;\n\n"
+		"public <number> = %s;\n", numbers);
+	fclose(fh);
+}
+
+/* Check whether the grammar loaded into a new FSG search has a word. */
+static int
+has_word(ps_decoder_t *ps, cmd_ln_t *config, char const *word)
+{
+	ps_search_t *search;
+	int found;
+
+	TEST_ASSERT(search = fsg_search_init(config, ps->acmod,
+					     ps->dict, ps->d2p));
+	found = fsg_model_word_id(((fsg_search_t *)search)->fsg, word) >= 0;
+	fsg_search_free(search);
+	return found;
+}
+
+/*
+ * A compiled grammar is not used when a file imported by the grammar
+ * changes, even if the grammar itself does not.
+ */
+static void
+test_import(ps_decoder_t *ps)
+{
+	cmd_ln_t *config;
+	FILE *fh;
+
+	TEST_ASSERT(fh = fopen(IMPORT_GRAMMAR, "w"));
+	fprintf(fh, "#JSGF V1.0;\n\ngrammar goimport;\n\n"
+		"import <gonumber.number>;\n\n"
+		"public <move> = go <direction> <number> [meter | meters];\n"
+		"<direction> = forward | backward;\n");
+	fclose(fh);
+	config = grammar_config(IMPORT_GRAMMAR, ".");
+
+	write_imported("one | two | three");
+	load_time(ps, config, -1);
+	load_time(ps, config, TRUE);
+	TEST_ASSERT(!has_word(ps, config, "ten"));
+	write_imported("one | two | three | ten");
+	TEST_ASSERT(has_word(ps, config, "ten"));
+	write_imported("one | two | three");
+	load_time(ps, config, TRUE);
+	TEST_ASSERT(!has_word(ps, config, "ten"));
+
+	cmd_ln_free_r(config);
+}
+
+int
+main(int argc, char *argv[])
+{
+	cmd_ln_t *config, *cache_config;
+	ps_decoder_t *ps;
+	fsg_set_t *fsgs;
+	char *ref, *small_ref, *hyp;
+	int32 ref_score, small_score, score;
+	double t_build, t_compiled;
+
+	write_grammar();
+
+	/* Reference results, building the grammars. */
+	config = grammar_config(GRAMMAR, NULL);
+	TEST_ASSERT(ps = ps_init(config));
+	ref = decode(ps, &ref_score);
+	printf("%s (%d)\n", ref, ref_score);
+	t_build = load_time(ps, config, FALSE);
+
+	/* Compile the grammar (unless a previous run did), then load it. */
+	cache_config = grammar_config(GRAMMAR, ".");
+	load_time(ps, cache_config, -1);
+	t_compiled = load_time(ps, cache_config, TRUE);
+	printf("grammar load: %.2f msec building, %.2f msec compiled\n",
+	       t_build * 1000, t_compiled * 1000);
+	test_import(ps);
+
+	add_small_fsg(ps, config);
+	small_ref = decode(ps, &small_score);
+	printf("%s (%d)\n", small_ref, small_score);
+	ps_free(ps);
+	cmd_ln_free_r(config);
+
+	/* Decoding with the compiled grammar gives the same result. */
+	TEST_ASSERT(ps = ps_init(cache_config));
+	TEST_ASSERT(((fsg_search_t *)ps->search)->lextree->pnode_block);
+	hyp = decode(ps, &score);
+	TEST_EQUAL(0, strcmp(ref, hyp));
+	TEST_EQUAL(ref_score, score);
+	ckd_free(hyp);
+
+	/* So does an FSG added by the application, which is compiled
+	 * the first time it is used. */
+	add_small_fsg(ps, cache_config);
+	fsgs = ps_get_fsgset(ps);
+	TEST_ASSERT(fsg_set_select(fsgs, "<goforward.move>"));
+	TEST_ASSERT(ps_update_fsgset(ps));
+	TEST_ASSERT(fsg_set_select(fsgs, "small"));
+	TEST_ASSERT(ps_update_fsgset(ps));
+	TEST_ASSERT(((fsg_search_t *)ps->search)->lextree->pnode_block);
+	hyp = decode(ps, &score);
+	TEST_EQUAL(0, strcmp(small_ref, hyp));
+	TEST_EQUAL(small_score, score);
+	ckd_free(hyp);
+	ps_free(ps);
+	cmd_ln_free_r(cache_config);
+
+	ckd_free(ref);
+	ckd_free(small_ref);
+	return 0;
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <pocketsphinx.h>
+
+#include "ms_gauden.h"
+#include "gmm_kernel.h"
+#include "test_macros.h"
+
+#define N_OBS 64
+#define N_TOP 4
+
+/* Fraction of the float top-N densities found in the quantized top-N. */
+static double
+topn_overlap(gauden_dist_t **ref, gauden_dist_t **out, int n_feat)
+{
+	int f, i, j, n = 0;
+
+	for (f = 0; f < n_feat; ++f)
+		for (i = 0; i < N_TOP; ++i)
+			for (j = 0; j < N_TOP; ++j)
+				if (ref[f][i].id == out[f][j].id)
+					++n;
+	return (double)n / (n_feat * N_TOP);
+}
+
+/* Largest difference of the best density score, in log units. */
+static double
+top_error(gauden_dist_t **ref, gauden_dist_t **out, int n_feat)
+{
+	double err = 0;
+	int f;
+
+	for (f = 0; f < n_feat; ++f)
+		if (fabs(ref[f][0].dist - out[f][0].dist) > err)
+			err = fabs(ref[f][0].dist - out[f][0].dist);
+	return err;
+}
+
+int
+main(int argc, char *argv[])
+{
+	logmath_t *lmath;
+	gauden_t *g, *q;
+	mfcc_t ***obs;
+	gauden_dist_t **ref, **out;
+	mfcc_t *dist, *sdist;
+	unsigned int seed = 42;
+	int bits, i, j, f, d, n;
+
+	TEST_ASSERT(lmath = logmath_init(1.0001, 0, 0));
+	TEST_ASSERT(g = gauden_init(MODELDIR "/hmm/en_US/hub4wsj_sc_8k/means",
+				    MODELDIR "/hmm/en_US/hub4wsj_sc_8k/variances",
+				    0.0001, lmath));
+
+	/* Observations near random codewords. */
+	obs = (mfcc_t ***)ckd_calloc_3d(N_OBS, g->n_feat, g->featlen[0], sizeof(mfcc_t));
+	for (i = 0; i < N_OBS; ++i) {
+		for (f = 0; f < g->n_feat; ++f) {
+			seed = seed * 1103515245 + 12345;
+			d = (seed >> 16) % g->n_density;
+			for (j = 0; j < g->featlen[f]; ++j) {
+				seed = seed * 1103515245 + 12345;
+				obs[i][f][j] = g->mean[0][f][d][j]
+					+ FLOAT2MFCC(((int)((seed >> 16) & 0xff) - 128) / 256.0);
+			}
+		}
+	}
+	ref = (gauden_dist_t **)ckd_calloc_2d(g->n_feat, N_TOP, sizeof(**ref));
+	out = (gauden_dist_t **)ckd_calloc_2d(g->n_feat, N_TOP, sizeof(**out));
+	dist = ckd_calloc(g->block[0][0]->n_alloc, sizeof(*dist));
+	sdist = ckd_calloc(g->block[0][0]->n_alloc, sizeof(*sdist));
+
+	TEST_ASSERT(gauden_quantize(g, 12) < 0);
+	for (bits = 16; bits >= 8; bits -= 8) {
+		double overlap = 0, err = 0;
+		char const *name;
+
+		TEST_ASSERT(q = gauden_init(MODELDIR "/hmm/en_US/hub4wsj_sc_8k/means",
+					    MODELDIR "/hmm/en_US/hub4wsj_sc_8k/variances",
+					    0.0001, lmath));
+		TEST_EQUAL(0, gauden_quantize(q, bits));
+		TEST_EQUAL(bits, q->block[0][0]->bits);
+		TEST_ASSERT(q->mean == NULL);
+
+		for (i = 0; i < N_OBS; ++i) {
+			double e;
+
+			gauden_dist(g, 0, N_TOP, obs[i], ref);
+			gauden_dist(q, 0, N_TOP, obs[i], out);
+			overlap += topn_overlap(ref, out, g->n_feat);
+			e = top_error(ref, out, g->n_feat);
+			if (e > err)
+				err = e;
+		}
+		overlap /= N_OBS;
+		printf("%d bits: top-%d overlap %.3f, max error %.0f\n",
+		       bits, N_TOP, overlap, err);
+		TEST_ASSERT(overlap > (bits == 16 ? 0.99 : 0.95));
+
+		/* All kernels agree with the scalar code. */
+		TEST_EQUAL(0, gmm_kernel_select("scalar"));
+		for (n = 0; (name = gmm_kernel_supported(n)) != NULL; ++n) {
+			TEST_EQUAL(0, gmm_kernel_select(name));
+			for (i = 0; i < N_OBS; ++i) {
+				for (f = 0; f < g->n_feat; ++f) {
+					gmm_kernel_select("scalar");
+					gmm_block_eval(q->block[0][f], obs[i][f], sdist);
+					gmm_kernel_select(name);
+					gmm_block_eval(q->block[0][f], obs[i][f], dist);
+					for (d = 0; d < q->n_density; ++d)
+						TEST_ASSERT(fabs(sdist[d] - dist[d])
+							    <= 1e-5 * fabs(sdist[d]));
+				}
+			}
+		}
+		TEST_EQUAL(0, gmm_kernel_select(NULL));
+		gauden_free(q);
+	}
+
+	/* Quantized files are read like the original ones. */
+	TEST_EQUAL(0, gauden_param_quantize(MODELDIR "/hmm/en_US/hub4wsj_sc_8k/means",
+					    "means.q", 16, FALSE));
+	TEST_EQUAL(0, gauden_param_quantize(MODELDIR "/hmm/en_US/hub4wsj_sc_8k/variances",
+					    "variances.q", 16, TRUE));
+	TEST_ASSERT(q = gauden_init("means.q", "variances.q", 0.0001, lmath));
+	TEST_EQUAL(g->n_mgau, q->n_mgau);
+	TEST_EQUAL(g->n_density, q->n_density);
+	for (i = 0; i < N_OBS; ++i) {
+		gauden_dist(g, 0, N_TOP, obs[i], ref);
+		gauden_dist(q, 0, N_TOP, obs[i], out);
+		for (f = 0; f < g->n_feat; ++f)
+			TEST_EQUAL(ref[f][0].id, out[f][0].id);
+	}
+	gauden_free(q);
+
+	ckd_free(dist);
+	ckd_free(sdist);
+	ckd_free_2d((void **)ref);
+	ckd_free_2d((void **)out);
+	ckd_free_3d((void ***)obs);
+	gauden_free(g);
+	logmath_free(lmath);
+	return 0;
+}
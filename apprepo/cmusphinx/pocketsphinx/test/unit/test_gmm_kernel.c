@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#include <pocketsphinx.h>
+
+#include "ms_gauden.h"
+#include "gmm_kernel.h"
+#include "test_macros.h"
+
+#define N_OBS 64
+#define N_BENCH 2000
+
+/* Same computation as the original scalar loops in ms_gauden.c. */
+static mfcc_t
+ref_density(gauden_t *g, int f, int d, mfcc_t *obs)
+{
+	mfcc_t dval = g->det[0][f][d];
+	int i;
+
+	for (i = 0; i < g->featlen[f]; ++i) {
+		mfcc_t diff = obs[i] - g->mean[0][f][d][i];
+#ifdef FIXED_POINT
+		mfcc_t pdval = dval;
+		dval -= MFCCMUL(MFCCMUL(diff, diff), g->var[0][f][d][i]);
+		if (dval > pdval)
+			return INT_MIN;
+#else
+		dval -= diff * diff * g->var[0][f][d][i];
+#endif
+	}
+	return dval;
+}
+
+int
+main(int argc, char *argv[])
+{
+	logmath_t *lmath;
+	gauden_t *g;
+	mfcc_t ***obs;
+	mfcc_t *ref, *out;
+	gauden_dist_t **dist;
+	char const *name;
+	unsigned int seed = 42;
+	int i, j, k, n, f, d;
+
+	TEST_ASSERT(lmath = logmath_init(1.0001, 0, 0));
+	TEST_ASSERT(g = gauden_init(MODELDIR "/hmm/en_US/hub4wsj_sc_8k/means",
+				    MODELDIR "/hmm/en_US/hub4wsj_sc_8k/variances",
+				    0.0001, lmath));
+	TEST_EQUAL(1, g->n_mgau);
+
+	/* Observations near random codewords (and in fixed point a few far
+	 * from all of them, whose scores underflow). */
+	obs = (mfcc_t ***)ckd_calloc_3d(N_OBS, g->n_feat, g->featlen[0], sizeof(mfcc_t));
+	for (i = 0; i < N_OBS; ++i) {
+#ifdef FIXED_POINT
+		double scale = (i % 8 == 7) ? 16.0 : 1 / 256.0;
+#else
+		double scale = 1 / 256.0;
+#endif
+
+		for (f = 0; f < g->n_feat; ++f) {
+			seed = seed * 1103515245 + 12345;
+			d = (seed >> 16) % g->n_density;
+			for (j = 0; j < g->featlen[f]; ++j) {
+				seed = seed * 1103515245 + 12345;
+				obs[i][f][j] = g->mean[0][f][d][j]
+					+ FLOAT2MFCC(((int)((seed >> 16) & 0xff) - 128) * scale);
+			}
+		}
+	}
+
+	ref = ckd_calloc(g->block[0][0]->n_alloc, sizeof(*ref));
+	out = ckd_calloc(g->block[0][0]->n_alloc, sizeof(*out));
+	dist = (gauden_dist_t **)ckd_calloc_2d(g->n_feat, g->n_density, sizeof(**dist));
+
+	for (n = 0; (name = gmm_kernel_supported(n)) != NULL; ++n) {
+		clock_t c;
+		double secs;
+
+		TEST_EQUAL(0, gmm_kernel_select(name));
+		TEST_EQUAL(0, strcmp(name, gmm_kernel_name()));
+
+		for (i = 0; i < N_OBS; ++i) {
+			for (f = 0; f < g->n_feat; ++f) {
+				int best = 0;
+
+				gmm_block_eval(g->block[0][f], obs[i][f], out);
+				for (d = 0; d < g->n_density; ++d) {
+					ref[d] = ref_density(g, f, d, obs[i][f]);
+#ifdef FIXED_POINT
+					TEST_EQUAL(ref[d], out[d]);
+#else
+					/* Exact unless the compiler fuses multiply-subtract. */
+					TEST_ASSERT(fabs(ref[d] - out[d]) <= 1e-5 * fabs(ref[d]));
+#endif
+					if (ref[d] > ref[best])
+						best = d;
+				}
+				/* Top-N has the best density first. */
+				gauden_dist(g, 0, 4, obs[i], dist);
+				TEST_ASSERT(ref[dist[f][0].id] >= ref[best]);
+				for (k = 1; k < 4; ++k)
+					TEST_ASSERT(dist[f][k - 1].dist >= dist[f][k].dist);
+			}
+		}
+
+		c = clock();
+		for (i = 0; i < N_BENCH; ++i)
+			for (f = 0; f < g->n_feat; ++f)
+				gmm_block_eval(g->block[0][f], obs[i % N_OBS][f], out);
+		secs = (double)(clock() - c) / CLOCKS_PER_SEC;
+		printf("%s: %.0f densities/sec\n", name,
+		       secs > 0 ? (double)N_BENCH * g->n_feat * g->n_density / secs : 0.0);
+	}
+	TEST_ASSERT(n > 0);
+	TEST_ASSERT(gmm_kernel_select("no_such_kernel") < 0);
+	TEST_EQUAL(0, gmm_kernel_select(NULL));
+
+	ckd_free(ref);
+	ckd_free(out);
+	ckd_free_2d((void **)dist);
+	ckd_free_3d((void ***)obs);
+	gauden_free(g);
+	logmath_free(lmath);
+	return 0;
+}
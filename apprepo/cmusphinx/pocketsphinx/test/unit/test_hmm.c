@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <pocketsphinx.h>
+
+#include "hmm.h"
+#include "test_macros.h"
+
+#define N_SEN 256
+#define N_SSEQ 64
+#define N_TMAT 8
+#define N_HMM 1000
+#define N_FRAME 10
+
+static unsigned int seed = 42;
+
+static int
+rand_int(int n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % n;
+}
+
+static void
+rand_hmm(hmm_context_t *ctx, hmm_t *hmm, int mpx)
+{
+	int i;
+
+	hmm_init(ctx, hmm, mpx, rand_int(N_SSEQ), rand_int(N_TMAT));
+	for (i = 0; i < hmm_n_emit_state(hmm); ++i) {
+		hmm_score(hmm, i) = -rand_int(100000);
+		hmm_history(hmm, i) = rand_int(1000);
+		if (mpx)
+			hmm->senid[i] = rand_int(N_SSEQ);
+	}
+	hmm_out_score(hmm) = -rand_int(100000);
+	hmm_out_history(hmm) = rand_int(1000);
+	hmm_frame(hmm) = 0;
+}
+
+/*
+ * Plain Viterbi recurrence over the allowed transitions, from the
+ * scores of an HMM before it is evaluated.  Only valid when scores
+ * stay far from WORST_SCORE.  Fills score[0..n_emit_state], the last
+ * one being the exit state, and returns the best of them.
+ */
+static int32
+ref_eval(hmm_t *hmm, int32 *score)
+{
+	int32 prev[HMM_MAX_NSTATE];
+	int32 best = WORST_SCORE;
+	int n = hmm_n_emit_state(hmm);
+	int from, to;
+
+	for (from = 0; from < n; ++from)
+		prev[from] = hmm_score(hmm, from) + hmm_senscr(hmm, from);
+	for (to = 0; to <= n; ++to) {
+		score[to] = WORST_SCORE;
+		for (from = (to > 2) ? to - 2 : 0; from <= to && from < n; ++from) {
+			int32 tprob = hmm_tprob(hmm, from, to);
+
+			if (tprob BETTER_THAN TMAT_WORST_SCORE
+			    && prev[from] + tprob BETTER_THAN score[to])
+				score[to] = prev[from] + tprob;
+		}
+		if (score[to] BETTER_THAN best)
+			best = score[to];
+	}
+	return best;
+}
+
+/* Evaluate HMMs with hmm_vit_eval() for a few frames. */
+static void
+test_eval(int n_emit_state)
+{
+	uint8 ***tp;
+	int16 *senscore;
+	uint16 **sseq;
+	hmm_context_t *ctx;
+	hmm_t *hmms;
+	int32 (*ref)[HMM_MAX_NSTATE + 1];
+	int32 *refbest;
+	int i, j, k, n;
+
+	tp = (uint8 ***)ckd_calloc_3d(N_TMAT, n_emit_state, n_emit_state + 1,
+				      sizeof(***tp));
+	/* Some 3-state matrices without skip transitions, the 5-state
+	 * evaluators always use them.  The 3-state ones assume that a
+	 * matrix has either all of them or none. */
+	for (i = 0; i < N_TMAT; ++i) {
+		int skip = (n_emit_state != 3) || i % 2;
+
+		for (j = 0; j < n_emit_state; ++j) {
+			for (k = j; k <= n_emit_state && k <= j + 2; ++k) {
+				tp[i][j][k] = (k == j + 2 && !skip)
+					? 255 : rand_int(200);
+			}
+		}
+	}
+	senscore = ckd_calloc(N_SEN, sizeof(*senscore));
+	for (i = 0; i < N_SEN; ++i)
+		senscore[i] = rand_int(20000);
+	sseq = (uint16 **)ckd_calloc_2d(N_SSEQ, n_emit_state, sizeof(**sseq));
+	for (i = 0; i < N_SSEQ; ++i)
+		for (j = 0; j < n_emit_state; ++j)
+			sseq[i][j] = rand_int(N_SEN);
+	TEST_ASSERT(ctx = hmm_context_init(n_emit_state, tp, senscore, sseq));
+
+	hmms = ckd_calloc(N_HMM, sizeof(*hmms));
+	ref = ckd_calloc(N_HMM, sizeof(*ref));
+	refbest = ckd_calloc(N_HMM, sizeof(*refbest));
+	for (i = 0; i < N_HMM; ++i)
+		rand_hmm(ctx, hmms + i, i % 3 == 0);
+
+	for (n = 0; n < N_FRAME; ++n) {
+		for (i = 0; i < N_HMM - n; ++i) {
+			refbest[i] = ref_eval(hmms + i, ref[i]);
+			TEST_EQUAL(refbest[i], hmm_vit_eval(hmms + i));
+		}
+		for (i = 0; i < N_HMM - n; ++i) {
+			for (j = 0; j < n_emit_state; ++j)
+				TEST_EQUAL(ref[i][j], hmm_score(hmms + i, j));
+			TEST_EQUAL(ref[i][n_emit_state], hmm_out_score(hmms + i));
+			TEST_EQUAL(refbest[i], hmm_bestscore(hmms + i));
+		}
+	}
+	printf("%d states: %d HMMs evaluated for %d frames\n",
+	       n_emit_state, N_HMM, N_FRAME);
+
+	ckd_free(hmms);
+	ckd_free(ref);
+	ckd_free(refbest);
+	hmm_context_free(ctx);
+	ckd_free_3d(tp);
+	ckd_free(senscore);
+	ckd_free_2d(sseq);
+}
+
+int
+main(int argc, char *argv[])
+{
+	test_eval(3);
+	test_eval(5);
+	return 0;
+}
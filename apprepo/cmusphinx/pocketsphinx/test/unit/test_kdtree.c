@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <pocketsphinx.h>
+
+#include "ms_gauden.h"
+#include "kdtree.h"
+#include "test_macros.h"
+
+#define N_OBS 256
+#define N_TOP 4
+
+/* Densities computed one by one or in a block may differ in the last
+ * bit if the compiler fuses multiply-subtract. */
+static int
+same_score(mfcc_t a, mfcc_t b)
+{
+#ifdef FIXED_POINT
+	return a == b;
+#else
+	return fabs(a - b) <= 1e-5 * fabs(a);
+#endif
+}
+
+int
+main(int argc, char *argv[])
+{
+	logmath_t *lmath;
+	gauden_t *g;
+	kd_tree_t **trees;
+	mfcc_t ***obs;
+	gauden_dist_t ***ref, **out;
+	unsigned int seed = 42;
+	int i, j, f, d, n_trees, n_same, n_box;
+
+	TEST_ASSERT(lmath = logmath_init(1.0001, 0, 0));
+	TEST_ASSERT(g = gauden_init(MODELDIR "/hmm/en_US/hub4wsj_sc_8k/means",
+				    MODELDIR "/hmm/en_US/hub4wsj_sc_8k/variances",
+				    0.0001, lmath));
+
+	/* Observations near random codewords. */
+	obs = (mfcc_t ***)ckd_calloc_3d(N_OBS, g->n_feat, g->featlen[0], sizeof(mfcc_t));
+	for (i = 0; i < N_OBS; ++i) {
+		for (f = 0; f < g->n_feat; ++f) {
+			seed = seed * 1103515245 + 12345;
+			d = (seed >> 16) % g->n_density;
+			for (j = 0; j < g->featlen[f]; ++j) {
+				seed = seed * 1103515245 + 12345;
+				obs[i][f][j] = g->mean[0][f][d][j]
+					+ FLOAT2MFCC(((int)((seed >> 16) & 0xff) - 128) / 128.0);
+			}
+		}
+	}
+	ref = (gauden_dist_t ***)ckd_calloc_3d(N_OBS, g->n_feat, N_TOP, sizeof(***ref));
+	out = (gauden_dist_t **)ckd_calloc_2d(g->n_feat, N_TOP, sizeof(**out));
+	for (i = 0; i < N_OBS; ++i)
+		gauden_dist(g, 0, N_TOP, obs[i], ref[i]);
+
+	/* Build, write and read back the trees. */
+	n_trees = g->n_mgau * g->n_feat;
+	trees = ckd_calloc(n_trees, sizeof(*trees));
+	for (f = 0; f < g->n_feat; ++f) {
+		TEST_ASSERT(trees[f] = kd_tree_build(g->mean[0][f], g->var[0][f],
+						     g->n_density, g->featlen[f],
+						     8, 3.0 / log(1.0001)));
+		/* Everything is listed at the root. */
+		TEST_EQUAL(g->n_density, trees[f]->nodes[0].n_bbi);
+	}
+	TEST_EQUAL(0, kd_trees_write("hub4.kdtree", trees, n_trees));
+	TEST_ASSERT(gauden_load_kdtrees(g, "no_such_file", 0, -1) < 0);
+
+	/* Same boxes after reading. */
+	TEST_EQUAL(0, gauden_load_kdtrees(g, "hub4.kdtree", 0, -1));
+	for (i = 0; i < N_OBS; ++i) {
+		for (f = 0; f < g->n_feat; ++f) {
+			kd_tree_node_t const *a = kd_tree_find(trees[f], obs[i][f]);
+			kd_tree_node_t const *b = kd_tree_find(g->kdtree[f], obs[i][f]);
+			TEST_EQUAL(a->n_bbi, b->n_bbi);
+			TEST_EQUAL(0, memcmp(a->bbi, b->bbi, a->n_bbi * sizeof(*a->bbi)));
+		}
+	}
+
+	/* The best density is almost always found in the box. */
+	n_same = n_box = 0;
+	for (i = 0; i < N_OBS; ++i) {
+		gauden_dist(g, 0, N_TOP, obs[i], out);
+		for (f = 0; f < g->n_feat; ++f) {
+			n_box += kd_tree_find(g->kdtree[f], obs[i][f])->n_bbi;
+			if (out[f][0].id == ref[i][f][0].id) {
+				TEST_ASSERT(same_score(ref[i][f][0].dist, out[f][0].dist));
+				++n_same;
+			}
+			for (j = 1; j < N_TOP; ++j)
+				TEST_ASSERT(out[f][j - 1].dist >= out[f][j].dist);
+		}
+	}
+	printf("Best density found for %.1f%% of observations, "
+	       "%.1f of %d densities computed\n",
+	       100.0 * n_same / (N_OBS * g->n_feat),
+	       (double)n_box / (N_OBS * g->n_feat), g->n_density);
+	TEST_ASSERT(n_same >= 0.95 * N_OBS * g->n_feat);
+	TEST_ASSERT(n_box < g->n_density * N_OBS * g->n_feat / 2);
+
+	/* Searching only the root, or with lists too short to be
+	 * used, gives the same results as without the trees. */
+	TEST_EQUAL(0, gauden_load_kdtrees(g, "hub4.kdtree", 1, -1));
+	for (i = 0; i < N_OBS; ++i) {
+		gauden_dist(g, 0, N_TOP, obs[i], out);
+		for (f = 0; f < g->n_feat; ++f)
+			for (j = 0; j < N_TOP; ++j)
+				TEST_ASSERT(same_score(ref[i][f][j].dist, out[f][j].dist));
+	}
+	TEST_EQUAL(0, gauden_load_kdtrees(g, "hub4.kdtree", 0, N_TOP - 1));
+	for (i = 0; i < N_OBS; ++i) {
+		gauden_dist(g, 0, N_TOP, obs[i], out);
+		for (f = 0; f < g->n_feat; ++f)
+			for (j = 0; j < N_TOP; ++j)
+				TEST_ASSERT(same_score(ref[i][f][j].dist, out[f][j].dist));
+	}
+
+	kd_trees_free(trees, n_trees);
+	ckd_free_3d((void ***)ref);
+	ckd_free_2d((void **)out);
+	ckd_free_3d((void ***)obs);
+	gauden_free(g);
+	logmath_free(lmath);
+	return 0;
+}
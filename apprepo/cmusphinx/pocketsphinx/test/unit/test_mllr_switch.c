@@ -0,0 +1,287 @@
+/**
+ * @file test_mllr_switch.c Check and time switching between speaker
+ * transforms, in feature space and in model space.
+ */
+
+#include <pocketsphinx.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pocketsphinx_internal.h"
+#include "ms_gauden.h"
+#include "thread_pool.h"
+
+#include "test_macros.h"
+
+#define N_SPEAKER 4
+#define N_SWITCH 20
+
+static uint32 rand_state = 1;
+
+static float32
+next_rand(void)
+{
+	rand_state = rand_state * 1103515245 + 12345;
+	return (rand_state >> 8) / (float32)(1 << 24) - 0.5f;
+}
+
+/*
+ * Write a transform for the streams of fcb, which is the identity if
+ * scale is zero and otherwise a random one near it.
+ */
+static void
+write_mllr(char const *file, feat_t *fcb, float32 scale)
+{
+	FILE *fh;
+	int i, j, k;
+
+	TEST_ASSERT(fh = fopen(file, "w"));
+	fprintf(fh, "1\n%d\n", feat_dimension1(fcb));
+	for (i = 0; i < feat_dimension1(fcb); ++i) {
+		int veclen = feat_dimension2(fcb, i);
+
+		fprintf(fh, "%d\n", veclen);
+		for (j = 0; j < veclen; ++j) {
+			for (k = 0; k < veclen; ++k)
+				fprintf(fh, "%f ", (j == k) + scale * next_rand());
+			fprintf(fh, "\n");
+		}
+		for (j = 0; j < veclen; ++j)
+			fprintf(fh, "%f ", scale * next_rand());
+		fprintf(fh, "\n");
+		for (j = 0; j < veclen; ++j)
+			fprintf(fh, "%f ", 1.0 + scale * next_rand());
+		fprintf(fh, "\n");
+	}
+	fclose(fh);
+}
+
+/* Cepstra for the test utterance, computed once, since the model
+ * asks for dither, which would make each decoding a bit different. */
+static mfcc_t **cep;
+static int32 n_cep;
+
+static void
+read_cep(ps_decoder_t *ps)
+{
+	FILE *rawfh;
+	int16 *buf;
+	int16 const *bptr;
+	size_t nsamps;
+	int32 nfr;
+
+	TEST_ASSERT(rawfh = fopen(DATADIR "/numbers.raw", "rb"));
+	fseek(rawfh, 0, SEEK_END);
+	nsamps = ftell(rawfh) / sizeof(*buf);
+	fseek(rawfh, 0, SEEK_SET);
+	bptr = buf = ckd_calloc(nsamps, sizeof(*buf));
+	TEST_EQUAL(nsamps, fread(buf, sizeof(*buf), nsamps, rawfh));
+	fclose(rawfh);
+	fe_process_frames(ps->acmod->fe, &bptr, &nsamps, NULL, &n_cep);
+	cep = ckd_calloc_2d(n_cep + 1, fe_get_output_size(ps->acmod->fe),
+			    sizeof(**cep));
+	fe_start_utt(ps->acmod->fe);
+	fe_process_frames(ps->acmod->fe, &bptr, &nsamps, cep, &n_cep);
+	fe_end_utt(ps->acmod->fe, cep[n_cep], &nfr);
+	n_cep += nfr;
+	ckd_free(buf);
+}
+
+static int32
+decode(ps_decoder_t *ps, char *hyp, double *xrt)
+{
+	char const *h;
+	double n_speech, n_cpu, n_wall;
+	int32 score;
+
+	TEST_EQUAL(0, ps_start_utt(ps, "numbers"));
+	TEST_EQUAL(n_cep, ps_process_cep(ps, cep, n_cep, FALSE, TRUE));
+	TEST_EQUAL(0, ps_end_utt(ps));
+	TEST_ASSERT(h = ps_get_hyp(ps, &score, NULL));
+	strcpy(hyp, h);
+	ps_get_utt_time(ps, &n_speech, &n_cpu, &n_wall);
+	if (xrt)
+		*xrt = n_cpu / n_speech;
+	printf("%s (%d)\n", hyp, score);
+	return score;
+}
+
+/*
+ * Transform the Gaussians directly, with and without threads, and
+ * compare the means with the way it was done one value at a time.
+ */
+static void
+test_gauden(ps_decoder_t *ps, ps_mllr_t *mllr)
+{
+	cmd_ln_t *config = ps_get_config(ps);
+	logmath_t *lmath = ps_get_logmath(ps);
+	thread_pool_t *pool;
+	gauden_t *g, *g2;
+	ptmr_t t1, t2;
+	int32 i, f, d, l, m;
+
+	TEST_ASSERT(g = gauden_init(cmd_ln_str_r(config, "-mean"),
+				    cmd_ln_str_r(config, "-var"),
+				    cmd_ln_float32_r(config, "-varfloor"),
+				    lmath));
+	TEST_ASSERT(g2 = gauden_init(cmd_ln_str_r(config, "-mean"),
+				     cmd_ln_str_r(config, "-var"),
+				     cmd_ln_float32_r(config, "-varfloor"),
+				     lmath));
+	TEST_ASSERT(pool = thread_pool_init(config, 2));
+	/* The first time reads the unadapted parameters. */
+	TEST_EQUAL(0, gauden_mllr_transform(g, mllr, config, NULL));
+	TEST_EQUAL(0, gauden_mllr_transform(g2, mllr, config, pool));
+	ptmr_init(&t1);
+	ptmr_init(&t2);
+	for (i = 0; i < N_SWITCH; ++i) {
+		ptmr_start(&t1);
+		TEST_EQUAL(0, gauden_mllr_transform(g, mllr, config, NULL));
+		ptmr_stop(&t1);
+		ptmr_start(&t2);
+		TEST_EQUAL(0, gauden_mllr_transform(g2, mllr, config, pool));
+		ptmr_stop(&t2);
+	}
+	printf("transform %d x %d x %d Gaussians: %.3f ms"
+	       " (%d threads: %.3f ms)\n",
+	       g->n_mgau, g->n_feat, g->n_density,
+	       t1.t_elapsed / N_SWITCH * 1000,
+	       thread_pool_size(pool) + 1, t2.t_elapsed / N_SWITCH * 1000);
+
+	for (i = 0; i < g->n_mgau; ++i) {
+		for (f = 0; f < g->n_feat; ++f) {
+			TEST_EQUAL(0, memcmp(g->det[i][f], g2->det[i][f],
+					     g->n_density * sizeof(mfcc_t)));
+			for (d = 0; d < g->n_density; ++d) {
+				float32 const *in = g->orig_mean[i][f][d];
+
+				TEST_EQUAL(0, memcmp(g->var[i][f][d], g2->var[i][f][d],
+						     g->featlen[f] * sizeof(mfcc_t)));
+				for (l = 0; l < g->featlen[f]; ++l) {
+					float64 temp = 0.0;
+
+					for (m = 0; m < g->featlen[f]; ++m)
+						temp += mllr->A[f][0][l][m] * in[m];
+					temp += mllr->b[f][0][l];
+					TEST_EQUAL(FLOAT2MFCC((float32)temp),
+						   g->mean[i][f][d][l]);
+					TEST_EQUAL(g->mean[i][f][d][l],
+						   g2->mean[i][f][d][l]);
+				}
+			}
+		}
+	}
+
+	/* Without a transform, they go back to the way they were. */
+	TEST_EQUAL(0, gauden_mllr_transform(g, NULL, config, pool));
+	for (i = 0; i < g->n_mgau; ++i)
+		for (f = 0; f < g->n_feat; ++f)
+			for (d = 0; d < g->n_density; ++d)
+				for (l = 0; l < g->featlen[f]; ++l)
+					TEST_EQUAL(FLOAT2MFCC(g->orig_mean[i][f][d][l]),
+						   g->mean[i][f][d][l]);
+
+	thread_pool_free(pool);
+	gauden_free(g);
+	gauden_free(g2);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char hyp[256], hyp2[256], file[16];
+	cmd_ln_t *config;
+	ps_decoder_t *ps, *ps2;
+	ps_mllr_t *ident, *spk[N_SPEAKER];
+	ptmr_t t_first, t_model, t_feat;
+	double xrt, xrt_model, xrt_feat;
+	int32 score, score2, i;
+
+	TEST_ASSERT(config =
+		    cmd_ln_init(NULL, ps_args(), TRUE,
+				"-hmm", MODELDIR "/hmm/en/tidigits",
+				"-fsg", MODELDIR "/lm/en/tidigits.fsg",
+				"-dict", MODELDIR "/lm/en/tidigits.dic",
+				"-input_endian", "little",
+				"-samprate", "16000", NULL));
+	TEST_ASSERT(ps = ps_init(config));
+	read_cep(ps);
+	score = decode(ps, hyp, &xrt);
+
+	write_mllr("ident.mllr", ps->acmod->fcb, 0);
+	TEST_ASSERT(ident = ps_mllr_read("ident.mllr"));
+	for (i = 0; i < N_SPEAKER; ++i) {
+		sprintf(file, "spk%d.mllr", i);
+		write_mllr(file, ps->acmod->fcb, 0.02f);
+		TEST_ASSERT(spk[i] = ps_mllr_read(file));
+	}
+
+	/* The identity transform changes nothing, either way. */
+	TEST_ASSERT(ps_update_fmllr(ps, ps_mllr_retain(ident)));
+	TEST_EQUAL(score, decode(ps, hyp2, NULL));
+	TEST_EQUAL(0, strcmp(hyp, hyp2));
+	TEST_ASSERT(ps_update_fmllr(ps, NULL) == NULL);
+	TEST_ASSERT(ps_update_mllr(ps, ps_mllr_retain(ident)));
+	TEST_EQUAL(score, decode(ps, hyp2, NULL));
+	TEST_EQUAL(0, strcmp(hyp, hyp2));
+
+	/* And a real one can be undone. */
+	TEST_ASSERT(ps_update_mllr(ps, ps_mllr_retain(spk[0])));
+	score2 = decode(ps, hyp2, NULL);
+	TEST_ASSERT(score2 != score);
+	TEST_ASSERT(ps_update_mllr(ps, NULL) == NULL);
+	TEST_EQUAL(score, decode(ps, hyp2, NULL));
+
+	/* A decoder sharing the model adapts its own copy of it. */
+	TEST_ASSERT(ps2 = ps_init_shared(ps));
+	TEST_ASSERT(ps_update_mllr(ps2, ps_mllr_retain(spk[0])));
+	TEST_EQUAL(score2, decode(ps2, hyp2, NULL));
+	TEST_EQUAL(score, decode(ps, hyp2, NULL));
+	TEST_ASSERT(ps_update_mllr(ps, ps_mllr_retain(spk[1])) == NULL);
+	ps_mllr_free(spk[1]);
+	TEST_ASSERT(ps_update_mllr(ps2, NULL) == NULL);
+	TEST_EQUAL(score, decode(ps2, hyp2, NULL));
+	/* Feature space transforms need no copy at all. */
+	TEST_ASSERT(ps_update_fmllr(ps2, ps_mllr_retain(spk[2])));
+	TEST_ASSERT(score != decode(ps2, hyp2, NULL));
+	TEST_EQUAL(score, decode(ps, hyp2, NULL));
+
+	/* Time switching between speakers. */
+	ptmr_init(&t_first);
+	ptmr_init(&t_model);
+	ptmr_init(&t_feat);
+	ptmr_start(&t_first);
+	TEST_ASSERT(ps_update_mllr(ps2, ps_mllr_retain(spk[0])));
+	ptmr_stop(&t_first);
+	for (i = 0; i < N_SWITCH; ++i) {
+		ptmr_start(&t_model);
+		TEST_ASSERT(ps_update_mllr(ps2, ps_mllr_retain(spk[i % N_SPEAKER])));
+		ptmr_stop(&t_model);
+		ptmr_start(&t_feat);
+		TEST_ASSERT(ps_update_fmllr(ps2, ps_mllr_retain(spk[i % N_SPEAKER])));
+		ptmr_stop(&t_feat);
+	}
+	TEST_ASSERT(ps_update_fmllr(ps2, NULL) == NULL);
+	decode(ps2, hyp2, &xrt_model);
+	TEST_ASSERT(ps_update_mllr(ps2, NULL) == NULL);
+	TEST_ASSERT(ps_update_fmllr(ps2, ps_mllr_retain(spk[0])));
+	decode(ps2, hyp2, &xrt_feat);
+	printf("switch: model space %.3f ms (first %.3f ms),"
+	       " feature space %.3f ms\n",
+	       t_model.t_elapsed / N_SWITCH * 1000,
+	       t_first.t_elapsed * 1000,
+	       t_feat.t_elapsed / N_SWITCH * 1000);
+	printf("decode: %.3f xRT (model space %.3f xRT,"
+	       " feature space %.3f xRT)\n", xrt, xrt_model, xrt_feat);
+
+	test_gauden(ps, spk[3]);
+
+	ps_free(ps2);
+	ps_free(ps);
+	ps_mllr_free(ident);
+	for (i = 0; i < N_SPEAKER; ++i)
+		ps_mllr_free(spk[i]);
+	ckd_free_2d(cep);
+	cmd_ln_free_r(config);
+	return 0;
+}
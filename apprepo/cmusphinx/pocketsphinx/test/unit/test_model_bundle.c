@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <pocketsphinx.h>
+
+#include "pocketsphinx_internal.h"
+#include "acmod.h"
+#include "model_bundle.h"
+#include "test_macros.h"
+
+#define HMMDIR MODELDIR "/hmm/en_US/hub4wsj_sc_8k"
+#define MAX_FRAMES 512
+#define N_BENCH 10
+
+static cmd_ln_t *
+model_config(char const *mmap, char const *bundle, char const *varfloor)
+{
+	return cmd_ln_init(NULL, ps_args(), TRUE,
+			   "-featparams", HMMDIR "/feat.params",
+			   "-mdef", HMMDIR "/mdef",
+			   "-mean", HMMDIR "/means",
+			   "-var", HMMDIR "/variances",
+			   "-tmat", HMMDIR "/transition_matrices",
+			   "-sendump", HMMDIR "/sendump",
+			   "-compallsen", "yes",
+			   "-varfloor", varfloor,
+			   "-mmap", mmap,
+			   "-bundle", bundle,
+			   "-input_endian", "little",
+			   "-samprate", "16000", NULL);
+}
+
+static void
+score_frames(acmod_t *acmod, int16 *scores, int *n_frame)
+{
+	int n_sen = bin_mdef_n_sen(acmod->mdef);
+
+	while (acmod->n_feat_frame > 0) {
+		int16 const *senscr;
+		int frame_idx = -1;
+
+		TEST_ASSERT(senscr = acmod_score(acmod, &frame_idx));
+		TEST_ASSERT(*n_frame < MAX_FRAMES);
+		memcpy(scores + *n_frame * n_sen, senscr, n_sen * sizeof(*senscr));
+		++*n_frame;
+		acmod_advance(acmod);
+	}
+}
+
+/* Senone scores for all frames of goforward.raw. */
+static int
+score_file(acmod_t *acmod, int16 *scores)
+{
+	FILE *rawfh;
+	int16 buf[2048];
+	int16 const *bptr;
+	size_t nread;
+	int n_frame = 0;
+
+	TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+	TEST_EQUAL(0, acmod_start_utt(acmod));
+	while (!feof(rawfh)) {
+		nread = fread(buf, sizeof(*buf), 2048, rawfh);
+		bptr = buf;
+		while (acmod_process_raw(acmod, &bptr, &nread, FALSE) > 0)
+			score_frames(acmod, scores, &n_frame);
+	}
+	TEST_ASSERT(acmod_end_utt(acmod) >= 0);
+	score_frames(acmod, scores, &n_frame);
+	fclose(rawfh);
+	return n_frame;
+}
+
+static double
+init_time(cmd_ln_t *config, logmath_t *lmath)
+{
+	clock_t c = clock();
+	int i;
+
+	for (i = 0; i < N_BENCH; ++i) {
+		acmod_t *acmod;
+		TEST_ASSERT(acmod = acmod_init(config, lmath, NULL, NULL));
+		acmod_free(acmod);
+	}
+	return (double)(clock() - c) / CLOCKS_PER_SEC / N_BENCH;
+}
+
+static char const *
+decode_numbers(char const *mmap, char const *bundle)
+{
+	static char hyp[256];
+	cmd_ln_t *config;
+	ps_decoder_t *ps;
+	FILE *rawfh;
+	char const *h;
+	int32 score;
+
+	TEST_ASSERT(config =
+		    cmd_ln_init(NULL, ps_args(), TRUE,
+				"-hmm", MODELDIR "/hmm/en/tidigits",
+				"-fsg", MODELDIR "/lm/en/tidigits.fsg",
+				"-dict", MODELDIR "/lm/en/tidigits.dic",
+				"-mmap", mmap,
+				"-bundle", bundle,
+				"-seed", "1",
+				"-input_endian", "little",
+				"-samprate", "16000", NULL));
+	TEST_ASSERT(ps = ps_init(config));
+	if (strcmp(mmap, "yes") == 0) {
+		TEST_ASSERT(ps->acmod->bundle);
+	}
+	else {
+		TEST_ASSERT(ps->acmod->bundle == NULL);
+		TEST_EQUAL(0, acmod_write_bundle(ps->acmod, bundle));
+	}
+	TEST_ASSERT(rawfh = fopen(DATADIR "/numbers.raw", "rb"));
+	TEST_ASSERT(ps_decode_raw(ps, rawfh, "numbers", -1) > 0);
+	fclose(rawfh);
+	TEST_ASSERT(h = ps_get_hyp(ps, &score, NULL));
+	printf("%s: %s (%d)\n", mmap, h, score);
+	strncpy(hyp, h, sizeof(hyp) - 1);
+	ps_free(ps);
+	cmd_ln_free_r(config);
+	return hyp;
+}
+
+int
+main(int argc, char *argv[])
+{
+	logmath_t *lmath;
+	cmd_ln_t *config;
+	acmod_t *acmod;
+	int16 *ref, *scores;
+	int n_sen, n_ref, n;
+	double t_files, t_bundle;
+	char hyp[256];
+
+	lmath = logmath_init(1.0001, 0, 0);
+
+	/* Write a bundle from the files. */
+	TEST_ASSERT(config = model_config("no", "hub4wsj_sc_8k.bundle", "0.0001"));
+	TEST_ASSERT(acmod = acmod_init(config, lmath, NULL, NULL));
+	TEST_ASSERT(acmod->bundle == NULL);
+	TEST_EQUAL(0, acmod_write_bundle(acmod, "hub4wsj_sc_8k.bundle"));
+	n_sen = bin_mdef_n_sen(acmod->mdef);
+	ref = ckd_calloc(MAX_FRAMES * n_sen, sizeof(*ref));
+	scores = ckd_calloc(MAX_FRAMES * n_sen, sizeof(*scores));
+	n_ref = score_file(acmod, ref);
+	TEST_ASSERT(n_ref > 0);
+	acmod_free(acmod);
+	t_files = init_time(config, lmath);
+	cmd_ln_free_r(config);
+
+	/* Scores are the same with the bundle. */
+	TEST_ASSERT(config = model_config("yes", "hub4wsj_sc_8k.bundle", "0.0001"));
+	TEST_ASSERT(acmod = acmod_init(config, lmath, NULL, NULL));
+	TEST_ASSERT(acmod->bundle);
+	TEST_EQUAL(0, strcmp(acmod->mgau->vt->name, "s2_semi"));
+	TEST_EQUAL(n_sen, bin_mdef_n_sen(acmod->mdef));
+	n = score_file(acmod, scores);
+	TEST_EQUAL(n_ref, n);
+	TEST_EQUAL(0, memcmp(ref, scores, n * n_sen * sizeof(*scores)));
+
+	/* Copies share it. */
+	{
+		acmod_t *copy;
+		TEST_ASSERT(copy = acmod_copy(acmod));
+		memset(scores, 0, MAX_FRAMES * n_sen * sizeof(*scores));
+		n = score_file(copy, scores);
+		TEST_EQUAL(n_ref, n);
+		TEST_EQUAL(0, memcmp(ref, scores, n * n_sen * sizeof(*scores)));
+		acmod_free(copy);
+	}
+	acmod_free(acmod);
+	t_bundle = init_time(config, lmath);
+	cmd_ln_free_r(config);
+	printf("acmod_init: %.2f ms from files, %.2f ms from bundle\n",
+	       t_files * 1000, t_bundle * 1000);
+
+	/* It is ignored with other floors. */
+	TEST_ASSERT(config = model_config("yes", "hub4wsj_sc_8k.bundle", "0.001"));
+	TEST_ASSERT(acmod = acmod_init(config, lmath, NULL, NULL));
+	TEST_ASSERT(acmod->bundle == NULL);
+	acmod_free(acmod);
+	cmd_ln_free_r(config);
+
+	/* Or if the parameter files are not the ones it was written
+	 * from, even with the same contents. */
+	{
+		model_bundle_t *b;
+		FILE *in, *out;
+		int c;
+
+		TEST_ASSERT(config = model_config("yes", "hub4wsj_sc_8k.bundle", "0.0001"));
+		TEST_ASSERT(b = model_bundle_read("hub4wsj_sc_8k.bundle", config, lmath));
+		model_bundle_free(b);
+		cmd_ln_set_str_r(config, "-mixw", HMMDIR "/means");
+		TEST_ASSERT(model_bundle_read("hub4wsj_sc_8k.bundle", config, lmath) == NULL);
+		cmd_ln_set_str_r(config, "-mixw", NULL);
+
+		TEST_ASSERT(in = fopen(HMMDIR "/transition_matrices", "rb"));
+		TEST_ASSERT(out = fopen("transition_matrices.copy", "wb"));
+		while ((c = fgetc(in)) != EOF)
+			fputc(c, out);
+		fclose(in);
+		fclose(out);
+		cmd_ln_set_str_r(config, "-tmat", "transition_matrices.copy");
+		TEST_ASSERT(model_bundle_read("hub4wsj_sc_8k.bundle", config, lmath) == NULL);
+		cmd_ln_free_r(config);
+	}
+
+	/* Or if it is not a bundle. */
+	TEST_ASSERT(config = model_config("yes", HMMDIR "/means", "0.0001"));
+	TEST_ASSERT(acmod = acmod_init(config, lmath, NULL, NULL));
+	TEST_ASSERT(acmod->bundle == NULL);
+	acmod_free(acmod);
+	cmd_ln_free_r(config);
+
+	/* Decoding gives the same result. */
+	strcpy(hyp, decode_numbers("no", "tidigits.bundle"));
+	TEST_EQUAL(0, strcmp(hyp, decode_numbers("yes", "tidigits.bundle")));
+
+	ckd_free(ref);
+	ckd_free(scores);
+	logmath_free(lmath);
+	return 0;
+}
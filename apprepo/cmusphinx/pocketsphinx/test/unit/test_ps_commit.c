@@ -0,0 +1,174 @@
+#include <pocketsphinx.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "pocketsphinx_internal.h"
+#include "ngram_search.h"
+#include "test_macros.h"
+
+#define MAX_SEG 4096
+
+typedef struct seg_s {
+	char *word;
+	int sf, ef;
+	int32 ascr, lscr;
+} seg_t;
+
+static int16 *audio;
+static size_t n_audio;
+
+static ps_decoder_t *
+init_decoder(char const *commitwin)
+{
+	cmd_ln_t *config;
+	ps_decoder_t *ps;
+
+	TEST_ASSERT(config =
+		    cmd_ln_init(NULL, ps_args(), TRUE,
+				"-hmm", MODELDIR "/hmm/en/tidigits",
+				"-lm", MODELDIR "/lm/en/tidigits.DMP",
+				"-dict", MODELDIR "/lm/en/tidigits.dic",
+				"-fwdflat", "no",
+				"-bestpath", "no",
+				"-seed", "1",
+				"-commitwin", commitwin,
+				"-input_endian", "little",
+				"-samprate", "8000", NULL));
+	TEST_ASSERT(ps = ps_init(config));
+	cmd_ln_free_r(config);
+	return ps;
+}
+
+static int
+add_segs(seg_t *segs, int n_seg, ps_seg_t *itor)
+{
+	for (; itor; itor = ps_seg_next(itor)) {
+		TEST_ASSERT(n_seg < MAX_SEG);
+		segs[n_seg].word = ckd_salloc(ps_seg_word(itor));
+		ps_seg_frames(itor, &segs[n_seg].sf, &segs[n_seg].ef);
+		ps_seg_prob(itor, &segs[n_seg].ascr, &segs[n_seg].lscr, NULL);
+		++n_seg;
+	}
+	return n_seg;
+}
+
+/* Decode the audio n_rep times over as one utterance. */
+static int
+decode(ps_decoder_t *ps, int n_rep, seg_t *segs)
+{
+	int i, n_seg;
+
+	n_seg = 0;
+	TEST_EQUAL(0, ps_start_utt(ps, NULL));
+	for (i = 0; i < n_rep; ++i) {
+		TEST_ASSERT(ps_process_raw(ps, audio, n_audio, FALSE, FALSE) >= 0);
+		n_seg = add_segs(segs, n_seg, ps_seg_committed(ps));
+	}
+	TEST_EQUAL(0, ps_end_utt(ps));
+	n_seg = add_segs(segs, n_seg, ps_seg_committed(ps));
+	return add_segs(segs, n_seg, ps_seg_iter(ps, NULL));
+}
+
+/* Committing words does not change the result. */
+static void
+test_commit(void)
+{
+	static seg_t ref[MAX_SEG], segs[MAX_SEG];
+	ps_decoder_t *ps;
+	int i, n_ref, n_seg;
+
+	ps = init_decoder("0");
+	n_ref = decode(ps, 20, ref);
+	ps_free(ps);
+
+	ps = init_decoder("100");
+	n_seg = decode(ps, 20, segs);
+	TEST_ASSERT(((ngram_search_t *)ps->search)->frame_offset > 0);
+	printf("%d words, %d committed frames\n", n_seg,
+	       ((ngram_search_t *)ps->search)->frame_offset);
+	TEST_EQUAL(n_ref, n_seg);
+	for (i = 0; i < n_seg; ++i) {
+		TEST_EQUAL(0, strcmp(ref[i].word, segs[i].word));
+		TEST_EQUAL(ref[i].sf, segs[i].sf);
+		TEST_EQUAL(ref[i].ef, segs[i].ef);
+		TEST_EQUAL(ref[i].ascr, segs[i].ascr);
+		TEST_EQUAL(ref[i].lscr, segs[i].lscr);
+		ckd_free(ref[i].word);
+		ckd_free(segs[i].word);
+	}
+	ps_free(ps);
+}
+
+/* An hour of audio is decoded in bounded memory. */
+static void
+test_hour(void)
+{
+	ps_decoder_t *ps;
+	ngram_search_t *ngs;
+	ps_seg_t *itor;
+	int32 bp_table_size, bscore_stack_size, n_frame_alloc, n_feat_alloc;
+	int i, n_rep, n_word, ef;
+	clock_t c;
+
+	ps = init_decoder("100");
+	ngs = (ngram_search_t *)ps->search;
+	n_rep = 3600 * 8000 / n_audio;
+	n_word = 0;
+	ef = -1;
+	bp_table_size = bscore_stack_size = n_frame_alloc = n_feat_alloc = 0;
+	c = clock();
+	TEST_EQUAL(0, ps_start_utt(ps, NULL));
+	for (i = 0; i < n_rep; ++i) {
+		TEST_ASSERT(ps_process_raw(ps, audio, n_audio, FALSE, FALSE) >= 0);
+		for (itor = ps_seg_committed(ps); itor; itor = ps_seg_next(itor)) {
+			int sf;
+			ps_seg_frames(itor, &sf, NULL);
+			TEST_ASSERT(sf > ef);
+			ps_seg_frames(itor, NULL, &ef);
+			++n_word;
+		}
+		/* Everything has grown to size after the first minute. */
+		if (i == n_rep / 60) {
+			bp_table_size = ngs->bp_table_size;
+			bscore_stack_size = ngs->bscore_stack_size;
+			n_frame_alloc = ngs->n_frame_alloc;
+			n_feat_alloc = ps->acmod->n_feat_alloc;
+		}
+	}
+	TEST_EQUAL(0, ps_end_utt(ps));
+	c = clock() - c;
+	printf("%d frames, %d committed words in %.2f sec\n",
+	       ps_get_n_frames(ps), n_word, (double)c / CLOCKS_PER_SEC);
+	printf("%d backpointers, %d frames allocated\n",
+	       ngs->bp_table_size, ngs->n_frame_alloc);
+	TEST_ASSERT(ps_get_n_frames(ps) > 3600 * 100 - 100);
+	TEST_ASSERT(ef > 3600 * 100 - 1000);
+	TEST_EQUAL(bp_table_size, ngs->bp_table_size);
+	TEST_EQUAL(bscore_stack_size, ngs->bscore_stack_size);
+	TEST_EQUAL(n_frame_alloc, ngs->n_frame_alloc);
+	TEST_EQUAL(n_feat_alloc, ps->acmod->n_feat_alloc);
+	TEST_ASSERT(ngs->n_frame < 1000);
+	ps_free(ps);
+}
+
+int
+main(int argc, char *argv[])
+{
+	FILE *rawfh;
+	long len;
+
+	TEST_ASSERT(rawfh = fopen(DATADIR "/tidigits/dhd.2934z.raw", "rb"));
+	fseek(rawfh, 0, SEEK_END);
+	len = ftell(rawfh);
+	fseek(rawfh, 0, SEEK_SET);
+	n_audio = len / sizeof(*audio);
+	audio = ckd_calloc(n_audio, sizeof(*audio));
+	TEST_EQUAL(n_audio, fread(audio, sizeof(*audio), n_audio, rawfh));
+	fclose(rawfh);
+
+	test_commit();
+	test_hour();
+	ckd_free(audio);
+	return 0;
+}
@@ -0,0 +1,175 @@
+#include <pocketsphinx.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pocketsphinx_internal.h"
+#include "test_macros.h"
+
+/* Feed audio in blocks of 100ms, as a live application would. */
+#define BLOCK_SAMPLES 800
+
+static int16 *audio;
+static size_t n_audio;
+
+static uint32 rand_state = 1;
+
+static float32
+next_rand(void)
+{
+	rand_state = rand_state * 1103515245 + 12345;
+	return (rand_state >> 8) / (float32)(1 << 24) - 0.5f;
+}
+
+/* Write a random transform near the identity for the streams of fcb. */
+static void
+write_mllr(char const *file, feat_t *fcb, float32 scale)
+{
+	FILE *fh;
+	int i, j, k;
+
+	TEST_ASSERT(fh = fopen(file, "w"));
+	fprintf(fh, "1\n%d\n", feat_dimension1(fcb));
+	for (i = 0; i < feat_dimension1(fcb); ++i) {
+		int veclen = feat_dimension2(fcb, i);
+
+		fprintf(fh, "%d\n", veclen);
+		for (j = 0; j < veclen; ++j) {
+			for (k = 0; k < veclen; ++k)
+				fprintf(fh, "%f ", (j == k) + scale * next_rand());
+			fprintf(fh, "\n");
+		}
+		for (j = 0; j < veclen; ++j)
+			fprintf(fh, "%f ", scale * next_rand());
+		fprintf(fh, "\n");
+		for (j = 0; j < veclen; ++j)
+			fprintf(fh, "%f ", 1.0 + scale * next_rand());
+		fprintf(fh, "\n");
+	}
+	fclose(fh);
+}
+
+static ps_decoder_t *
+init_decoder(char const *lag, char const *fmllr)
+{
+	cmd_ln_t *config;
+	ps_decoder_t *ps;
+
+	TEST_ASSERT(config =
+		    cmd_ln_init(NULL, ps_args(), TRUE,
+				"-hmm", MODELDIR "/hmm/en/tidigits",
+				"-lm", MODELDIR "/lm/en/tidigits.DMP",
+				"-dict", MODELDIR "/lm/en/tidigits.dic",
+				"-fwdflatlag", lag,
+				"-seed", "1",
+				"-input_endian", "little",
+				"-samprate", "8000", NULL));
+	if (fmllr)
+		cmd_ln_set_str_r(config, "-fmllr", fmllr);
+	TEST_ASSERT(ps = ps_init(config));
+	cmd_ln_free_r(config);
+	return ps;
+}
+
+/*
+ * Decode the audio n_rep times over as one utterance, and return the
+ * hypothesis and the time taken to finish the utterance.
+ */
+static char *
+decode(ps_decoder_t *ps, int n_rep, int32 *out_score, double *out_latency)
+{
+	char const *hyp;
+	ptmr_t t_end;
+	int i;
+	size_t pos;
+
+	ptmr_init(&t_end);
+	TEST_EQUAL(0, ps_start_utt(ps, NULL));
+	for (i = 0; i < n_rep; ++i) {
+		for (pos = 0; pos < n_audio; pos += BLOCK_SAMPLES) {
+			size_t n = n_audio - pos;
+			if (n > BLOCK_SAMPLES)
+				n = BLOCK_SAMPLES;
+			TEST_ASSERT(ps_process_raw(ps, audio + pos, n,
+						   FALSE, FALSE) >= 0);
+		}
+	}
+	ptmr_start(&t_end);
+	TEST_EQUAL(0, ps_end_utt(ps));
+	ptmr_stop(&t_end);
+	*out_latency = t_end.t_elapsed;
+	TEST_ASSERT(hyp = ps_get_hyp(ps, out_score, NULL));
+	return ckd_salloc(hyp);
+}
+
+int
+main(int argc, char *argv[])
+{
+	ps_decoder_t *ps;
+	FILE *rawfh;
+	long len;
+	char *ref[3], *hyp;
+	int32 ref_score[3], score;
+	double ref_latency, latency;
+	int i, n_rep;
+
+	TEST_ASSERT(rawfh = fopen(DATADIR "/tidigits/dhd.2934z.raw", "rb"));
+	fseek(rawfh, 0, SEEK_END);
+	len = ftell(rawfh);
+	fseek(rawfh, 0, SEEK_SET);
+	n_audio = len / sizeof(*audio);
+	audio = ckd_calloc(n_audio, sizeof(*audio));
+	TEST_EQUAL(n_audio, fread(audio, sizeof(*audio), n_audio, rawfh));
+	fclose(rawfh);
+
+	/* About 20 seconds of audio, decoded twice to check that
+	 * everything is reset between utterances (CMN is not, so the
+	 * second result is different), then once more after adapting
+	 * the acoustic model, which is shared with the lagging search. */
+	n_rep = 20 * 8000 / n_audio;
+	ps = init_decoder("0", NULL);
+	write_mllr("fwdflat_lag.mllr", ps_get_feat(ps), 0.02f);
+	write_mllr("fwdflat_lag.fmllr", ps_get_feat(ps), 0.05f);
+	for (i = 0; i < 3; ++i) {
+		if (i == 2)
+			TEST_ASSERT(ps_update_mllr(ps, ps_mllr_read("fwdflat_lag.mllr")));
+		ref[i] = decode(ps, n_rep, &ref_score[i], &ref_latency);
+		printf("%s (%d)\n", ref[i], ref_score[i]);
+	}
+	ps_free(ps);
+
+	/* Far enough behind, the result is the same as running it after. */
+	ps = init_decoder("100", NULL);
+	for (i = 0; i < 3; ++i) {
+		if (i == 2)
+			TEST_ASSERT(ps_update_mllr(ps, ps_mllr_read("fwdflat_lag.mllr")));
+		hyp = decode(ps, n_rep, &score, &latency);
+		TEST_EQUAL(0, strcmp(ref[i], hyp));
+		/* Adapting restarts the lagging search, which loses the
+		 * acoustic scoring state kept from the previous utterance,
+		 * so only the hypothesis is the same. */
+		if (i < 2)
+			TEST_EQUAL(ref_score[i], score);
+		ckd_free(hyp);
+		ckd_free(ref[i]);
+	}
+	printf("end of utterance: after %.1f msec, lagging %.1f msec\n",
+	       ref_latency * 1000, latency * 1000);
+	ps_free(ps);
+
+	/* The lagging search gets frames that have already been through
+	 * the feature space transform. */
+	ps = init_decoder("0", "fwdflat_lag.fmllr");
+	ref[0] = decode(ps, n_rep, &ref_score[0], &ref_latency);
+	printf("%s (%d)\n", ref[0], ref_score[0]);
+	ps_free(ps);
+	ps = init_decoder("100", "fwdflat_lag.fmllr");
+	hyp = decode(ps, n_rep, &score, &latency);
+	TEST_EQUAL(0, strcmp(ref[0], hyp));
+	TEST_EQUAL(ref_score[0], score);
+	ckd_free(hyp);
+	ckd_free(ref[0]);
+	ps_free(ps);
+
+	ckd_free(audio);
+	return 0;
+}
@@ -0,0 +1,129 @@
+#include <pocketsphinx.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pocketsphinx_internal.h"
+#include "test_macros.h"
+
+/* Poll for partial results every 100ms of audio. */
+#define POLL_SAMPLES 800
+
+static int16 *audio;
+static size_t n_audio;
+
+static ps_decoder_t *
+init_decoder(char const *lmarg, char const *lm)
+{
+	cmd_ln_t *config;
+	ps_decoder_t *ps;
+
+	TEST_ASSERT(config =
+		    cmd_ln_init(NULL, ps_args(), TRUE,
+				"-hmm", MODELDIR "/hmm/en/tidigits",
+				lmarg, lm,
+				"-dict", MODELDIR "/lm/en/tidigits.dic",
+				"-seed", "1",
+				"-input_endian", "little",
+				"-samprate", "8000", NULL));
+	TEST_ASSERT(ps = ps_init(config));
+	cmd_ln_free_r(config);
+	return ps;
+}
+
+static int
+same_hyp(char const *a, char const *b)
+{
+	if (a == NULL || b == NULL)
+		return a == b;
+	return 0 == strcmp(a, b);
+}
+
+/*
+ * Decode the audio n_rep times over as one utterance, polling for the
+ * hypothesis as a live application would, and check each partial
+ * result against a full backtrace.
+ */
+static void
+poll_decode(ps_decoder_t *ps, int n_rep)
+{
+	char *prev, *full;
+	char const *hyp;
+	ptmr_t t_cached, t_full;
+	int i, n_poll, n_changed;
+	size_t pos;
+
+	prev = NULL;
+	n_poll = n_changed = 0;
+	ptmr_init(&t_cached);
+	ptmr_init(&t_full);
+	TEST_EQUAL(0, ps_start_utt(ps, NULL));
+	for (i = 0; i < n_rep; ++i) {
+		for (pos = 0; pos < n_audio; pos += POLL_SAMPLES) {
+			size_t n = n_audio - pos;
+			int changed;
+
+			if (n > POLL_SAMPLES)
+				n = POLL_SAMPLES;
+			TEST_ASSERT(ps_process_raw(ps, audio + pos, n,
+						   FALSE, FALSE) >= 0);
+			changed = ps_hyp_changed(ps);
+			ptmr_start(&t_cached);
+			hyp = ps_get_hyp(ps, NULL, NULL);
+			ptmr_stop(&t_cached);
+			TEST_EQUAL(changed, !same_hyp(prev, hyp));
+			n_changed += changed;
+			ckd_free(prev);
+			prev = hyp ? ckd_salloc(hyp) : NULL;
+
+			/* Start over from scratch and compare. */
+			ps_search_trace_reset(ps->search);
+			ptmr_start(&t_full);
+			hyp = ps_get_hyp(ps, NULL, NULL);
+			ptmr_stop(&t_full);
+			TEST_ASSERT(same_hyp(prev, hyp));
+			TEST_EQUAL(FALSE, ps_hyp_changed(ps));
+			++n_poll;
+		}
+	}
+	TEST_EQUAL(0, ps_end_utt(ps));
+	TEST_EQUAL(TRUE, ps_hyp_changed(ps));
+	hyp = ps_get_hyp(ps, NULL, NULL);
+	full = hyp ? ckd_salloc(hyp) : NULL;
+	TEST_EQUAL(FALSE, ps_hyp_changed(ps));
+	printf("%d frames, %d polls, %d changes: %s\n",
+	       ps_get_n_frames(ps), n_poll, n_changed, full);
+	printf("per poll: cached %.1f usec, full backtrace %.1f usec\n",
+	       t_cached.t_elapsed * 1e6 / n_poll,
+	       t_full.t_elapsed * 1e6 / n_poll);
+	ckd_free(prev);
+	ckd_free(full);
+}
+
+int
+main(int argc, char *argv[])
+{
+	ps_decoder_t *ps;
+	FILE *rawfh;
+	long len;
+
+	TEST_ASSERT(rawfh = fopen(DATADIR "/tidigits/dhd.2934z.raw", "rb"));
+	fseek(rawfh, 0, SEEK_END);
+	len = ftell(rawfh);
+	fseek(rawfh, 0, SEEK_SET);
+	n_audio = len / sizeof(*audio);
+	audio = ckd_calloc(n_audio, sizeof(*audio));
+	TEST_EQUAL(n_audio, fread(audio, sizeof(*audio), n_audio, rawfh));
+	fclose(rawfh);
+
+	/* About a minute of audio. */
+	ps = init_decoder("-lm", MODELDIR "/lm/en/tidigits.DMP");
+	poll_decode(ps, 60 * 8000 / n_audio);
+	ps_free(ps);
+
+	ps = init_decoder("-fsg", MODELDIR "/lm/en/tidigits.fsg");
+	poll_decode(ps, 1);
+	ps_free(ps);
+
+	ckd_free(audio);
+	return 0;
+}
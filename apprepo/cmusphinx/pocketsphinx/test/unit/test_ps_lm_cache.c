@@ -0,0 +1,154 @@
+#include <pocketsphinx.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pocketsphinx_internal.h"
+#include "ngram_search.h"
+#include "ngram_search_fwdtree.h"
+#include "test_macros.h"
+
+static int16 *audio;
+static size_t n_audio;
+
+static char *
+decode(ps_decoder_t *ps, int32 *out_score)
+{
+	char const *hyp;
+
+	TEST_EQUAL(0, ps_start_utt(ps, NULL));
+	TEST_ASSERT(ps_process_raw(ps, audio, n_audio, FALSE, TRUE) >= 0);
+	TEST_EQUAL(0, ps_end_utt(ps));
+	hyp = ps_get_hyp(ps, out_score, NULL);
+	return ckd_salloc(hyp ? hyp : "");
+}
+
+/*
+ * Switch back and forth between two language models, checking that
+ * the saved search trees give the same results as new ones.
+ */
+static void
+test_switch_lm(ps_decoder_t *ps, cmd_ln_t *config)
+{
+	ngram_model_t *lmset, *lm;
+	char const *names[2] = { "default", "tw" };
+	char *ref[2], *hyp;
+	int32 ref_score[2], score;
+	ptmr_t t_new, t_saved;
+	int i;
+
+	lmset = ps_get_lmset(ps);
+	TEST_ASSERT(lm = ngram_model_read(config,
+					  MODELDIR "/lm/zh_TW/gigatdt.5000.DMP",
+					  NGRAM_AUTO, ps_get_logmath(ps)));
+	TEST_ASSERT(ngram_model_set_add(lmset, lm, "tw", 1.0, TRUE));
+	TEST_ASSERT(ps_update_lmset(ps, lmset));
+
+	ptmr_init(&t_new);
+	ptmr_init(&t_saved);
+	ref[0] = decode(ps, &ref_score[0]);
+	TEST_ASSERT(ngram_model_set_select(lmset, "tw"));
+	ptmr_start(&t_new);
+	TEST_ASSERT(ps_update_lmset(ps, lmset));
+	ptmr_stop(&t_new);
+	ref[1] = decode(ps, &ref_score[1]);
+	for (i = 0; i < 2; ++i)
+		printf("%s: %s (%d)\n", names[i], ref[i], ref_score[i]);
+	TEST_ASSERT(0 != strcmp(ref[0], ref[1]));
+
+	for (i = 0; i < 4; ++i) {
+		TEST_ASSERT(ngram_model_set_select(lmset, names[i % 2]));
+		ptmr_start(&t_saved);
+		TEST_ASSERT(ps_update_lmset(ps, lmset));
+		ptmr_stop(&t_saved);
+		hyp = decode(ps, &score);
+		TEST_EQUAL(0, strcmp(ref[i % 2], hyp));
+		TEST_EQUAL(ref_score[i % 2], score);
+		ckd_free(hyp);
+	}
+	printf("switch LM: new tree %.2f msec, saved tree %.2f msec\n",
+	       t_new.t_elapsed * 1000, t_saved.t_elapsed * 1000 / 4);
+
+	ckd_free(ref[0]);
+	ckd_free(ref[1]);
+}
+
+/*
+ * Add words to the search tree, and check that the result is the
+ * same as building it from scratch.
+ */
+static void
+test_add_word(ps_decoder_t *ps)
+{
+	ngram_model_t *lmset;
+	ngram_search_t *ngs;
+	char *ref, *hyp;
+	int32 ref_score, score;
+	int32 n_root_chan, n_nonroot_chan, n_1ph_words;
+	ptmr_t t_add;
+
+	lmset = ps_get_lmset(ps);
+	TEST_ASSERT(ngram_model_set_select(lmset, "default"));
+	TEST_ASSERT(ps_update_lmset(ps, lmset));
+	ngs = (ngram_search_t *)ps->search;
+	ptmr_init(&t_add);
+	ptmr_start(&t_add);
+	TEST_ASSERT(ps_add_word(ps, "contacta", "b i x i es ei", TRUE) > 0);
+	TEST_ASSERT(ps_add_word(ps, "contactb", "ao x i", TRUE) > 0);
+	TEST_ASSERT(ps_add_word(ps, "contactc", "x i", TRUE) > 0);
+	TEST_ASSERT(ps_add_word(ps, "contactd", "ao", TRUE) > 0);
+	ptmr_stop(&t_add);
+	printf("add word: %.2f msec\n", t_add.t_elapsed * 1000 / 4);
+	n_root_chan = ngs->n_root_chan;
+	n_nonroot_chan = ngs->n_nonroot_chan;
+	n_1ph_words = ngs->n_1ph_words;
+	ref = decode(ps, &ref_score);
+	printf("%s (%d)\n", ref, ref_score);
+
+	TEST_EQUAL(0, ngram_fwdtree_reinit(ngs));
+	TEST_EQUAL(n_root_chan, ngs->n_root_chan);
+	TEST_EQUAL(n_nonroot_chan, ngs->n_nonroot_chan);
+	TEST_EQUAL(n_1ph_words, ngs->n_1ph_words);
+	hyp = decode(ps, &score);
+	TEST_EQUAL(0, strcmp(ref, hyp));
+	TEST_EQUAL(ref_score, score);
+
+	ckd_free(ref);
+	ckd_free(hyp);
+}
+
+int
+main(int argc, char *argv[])
+{
+	cmd_ln_t *config;
+	ps_decoder_t *ps;
+	FILE *rawfh;
+	long len;
+
+	TEST_ASSERT(rawfh = fopen(DATADIR "/tidigits/dhd.2934z.raw", "rb"));
+	fseek(rawfh, 0, SEEK_END);
+	len = ftell(rawfh);
+	fseek(rawfh, 0, SEEK_SET);
+	n_audio = len / sizeof(*audio);
+	audio = ckd_calloc(n_audio, sizeof(*audio));
+	TEST_EQUAL(n_audio, fread(audio, sizeof(*audio), n_audio, rawfh));
+	fclose(rawfh);
+
+	/* Adding words needs writable language models. */
+	TEST_ASSERT(config =
+		    cmd_ln_init(NULL, ps_args(), TRUE,
+				"-hmm", MODELDIR "/hmm/zh/tdt_sc_8k",
+				"-lm", MODELDIR "/lm/zh_CN/gigatdt.5000.DMP",
+				"-dict", MODELDIR "/lm/zh_CN/mandarin_notone.dic",
+				"-mmap", "no",
+				"-seed", "1",
+				"-input_endian", "little",
+				"-samprate", "8000", NULL));
+	TEST_ASSERT(ps = ps_init(config));
+	test_switch_lm(ps, config);
+	test_add_word(ps);
+	ps_free(ps);
+	cmd_ln_free_r(config);
+
+	ckd_free(audio);
+	return 0;
+}
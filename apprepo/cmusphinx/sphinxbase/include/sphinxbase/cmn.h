@@ -162,6 +162,21 @@ void cmn_prior(cmn_t *cmn,        /**< In/Out: cmn normalization, which contains
 	       int32 nfr         /**< Number of incoming frames */
     );
 
+/**
+ * CMN for one block of data, using prior mean, copying the normalized
+ * frames to a circular buffer rather than modifying them in place.
+ * This lets a caller which has to buffer the frames anyway do it in
+ * the same pass over them.
+ */
+SPHINXBASE_EXPORT
+void cmn_prior_copy(cmn_t *cmn,        /**< In/Out: cmn normalization */
+                    mfcc_t **incep,    /**< In: mfc[f] = mfc vector in frame f */
+                    mfcc_t **outbuf,   /**< Out: circular buffer of n_buf frames */
+                    int32 pos,         /**< Index in outbuf of the first output frame */
+                    int32 n_buf,       /**< Number of frames in outbuf */
+                    int32 nfr          /**< Number of incoming frames */
+    );
+
 /**
  * Update prior mean based on observed data
  */
@@ -197,6 +197,8 @@ typedef struct feat_s {
     mfcc_t ***lda; /**< Array of linear transformations (for LDA, MLLT, or whatever) */
     uint32 n_lda;   /**< Number of linear transformations in lda. */
     uint32 out_dim; /**< Output dimensionality */
+    mfcc_t *lda_buf; /**< LDA matrix laid out for vector code, and feature
+                        vectors after and before LDA (allocated when first used) */
 } feat_t;
 
 /**
@@ -98,6 +98,15 @@
  * speed.
  */
 
+/**
+ * Since then, the hash table is no longer only used in initialization,
+ * so it is now open-addressed, with Robin Hood probing over a
+ * power-of-two array of entries which also hold the full hash of each
+ * key.  Lookups touch one or two cache lines instead of following a
+ * chain of separately allocated entries, and the table grows by
+ * doubling, so that the expected size is only a hint.
+ */
+
 /**
  * Another note by ARCHAN at 20050703: To use this data structure
  * properly, it is very important to realize that the users are
@@ -140,26 +149,30 @@ extern "C" {
 /**
  * The hash table structures.
  * Each hash table is identified by a hash_table_t structure.  hash_table_t.table is
- * pre-allocated for a user-controlled max size, and is initially empty.  As new
+ * an array of entries whose size is a power of two, and is initially empty.  As new
  * entries are created (using hash_enter()), the empty entries get filled.  If multiple
- * keys hash to the same entry, new entries are allocated and linked together in a
- * linear list.
+ * keys hash to the same entry, the later ones go in the following entries, and the
+ * table is doubled in size before it is 3/4 full.
+ *
+ * Entries move when others are entered or deleted, so pointers to
+ * them (from iterators or hash_table_tolist()) are only valid until
+ * the table is next modified.
  */
 
 typedef struct hash_entry_s {
 	const char *key;		/** Key string, NULL if this is an empty slot.
 					    NOTE that the key must not be changed once the entry
 					    has been made. */
-	size_t len;			/** Key-length; the key string does not have to be a C-style NULL
-					    terminated string; it can have arbitrary binary bytes */
 	void *val;			/** Value associated with above key */
-	struct hash_entry_s *next;	/** For collision resolution */
+	uint32 len;			/** Key-length; the key string does not have to be a C-style NULL
+					    terminated string; it can have arbitrary binary bytes */
+	uint32 hash;			/** Full hash value of the key */
 } hash_entry_t;
 
 typedef struct {
-	hash_entry_t *table;	/**Primary hash table, excluding entries that collide */
-	int32 size;		/** Primary hash table size, (is a prime#); NOTE: This is the
-				    number of primary entries ALLOCATED, NOT the number of valid
+	hash_entry_t *table;	/** Hash table entries */
+	int32 size;		/** Hash table size, (is a power of 2); NOTE: This is the
+				    number of entries ALLOCATED, NOT the number of valid
 				    entries in the table */
 	int32 inuse;		/** Number of valid entries in the table. */
 	int32 nocase;		/** Whether case insensitive for key comparisons */
@@ -168,7 +181,7 @@ typedef struct {
 typedef struct hash_iter_s {
 	hash_table_t *ht;  /**< Hash table we are iterating over. */
 	hash_entry_t *ent; /**< Current entry in that table. */
-	size_t idx;        /**< Index of next bucket to search. */
+	size_t idx;        /**< Index of next entry to search. */
 } hash_iter_t;
 
 /** Access macros */
@@ -425,9 +438,9 @@ glist_t hash_table_tolist(hash_table_t *h,	/**< In: Hash table from which list i
 	);
 
 /**
- * Display a hash-with-chaining representation on the screen.
- * Currently, it will only works for situation where hash_enter was
- * used to enter the keys. 
+ * Display the non-empty entries of the table on the screen, in the
+ * order they are stored.  Currently, it will only works for situation
+ * where hash_enter was used to enter the keys.
  */
 SPHINXBASE_EXPORT
 void  hash_table_display(hash_table_t *h, /**< In: Hash table to display */
@@ -121,6 +121,33 @@ jsgf_rule_iter_t *jsgf_rule_iter(jsgf_t *grammar);
  */
 #define jsgf_rule_iter_free(itor) hash_table_iter_free(itor)
 
+/**
+ * Iterator over the files imported by a grammar.
+ */
+typedef hash_iter_t jsgf_import_iter_t;
+
+/**
+ * Get an iterator over the files imported by a grammar, and by the
+ * grammars it imports, in no particular order.
+ */
+SPHINXBASE_EXPORT
+jsgf_import_iter_t *jsgf_import_iter(jsgf_t *grammar);
+
+/**
+ * Advance an iterator to the next imported file.
+ */
+#define jsgf_import_iter_next(itor) hash_table_iter_next(itor)
+
+/**
+ * Get the path of the current file in an import iterator.
+ */
+#define jsgf_import_iter_path(itor) ((char const *)(itor)->ent->key)
+
+/**
+ * Free an import iterator (if the end hasn't been reached).
+ */
+#define jsgf_import_iter_free(itor) hash_table_iter_free(itor)
+
 /**
  * Get a rule by name from a grammar.
  */
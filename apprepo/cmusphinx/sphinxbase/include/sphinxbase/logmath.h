@@ -193,6 +193,30 @@ int logmath_add_exact(logmath_t *lmath, int logb_p, int logb_q);
 SPHINXBASE_EXPORT
 int logmath_add(logmath_t *lmath, int logb_p, int logb_q);
 
+/**
+ * Add an array of values in log space (i.e. return log(sum(exp(x_i)))).
+ *
+ * For more than a few dozen values, rather than adding them one at a
+ * time with the add table, this takes the maximum, then sums
+ * exp(x_i - max) in linear space with a polynomial approximation,
+ * several values at a time where SIMD instructions are available.
+ * This is faster, and also more accurate, since the result is rounded
+ * only once.  Shorter arrays are simply added with the table.
+ *
+ * @return the sum, or the smallest possible value if n is 0.
+ */
+SPHINXBASE_EXPORT
+int logmath_add_n(logmath_t *lmath, const int *logb_x, int n);
+
+/**
+ * Add an array of natural logs (i.e. return log(sum(exp(x_i)))),
+ * in the same way as logmath_add_n().
+ *
+ * @return the sum, or -FLT_MAX if n is 0.
+ */
+SPHINXBASE_EXPORT
+float32 logmath_ln_add_n(const float32 *ln_x, int n);
+
 /**
  * Convert linear floating point number to integer log in base B.
  */
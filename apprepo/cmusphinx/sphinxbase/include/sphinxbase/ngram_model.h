@@ -79,6 +79,7 @@ typedef enum ngram_file_type_e {
     NGRAM_ARPA,  /**< ARPABO text format (the standard). */
     NGRAM_DMP,   /**< Sphinx .DMP format. */
     NGRAM_DMP32, /**< Sphinx .DMP32 format (NOT SUPPORTED) */
+    NGRAM_BIN,   /**< Sorted array trie, any order. */
 } ngram_file_type_t;
 
 #define NGRAM_INVALID_WID -1 /**< Impossible word ID */
@@ -280,6 +281,26 @@ SPHINXBASE_EXPORT
 int32 ngram_ng_score(ngram_model_t *model, int32 wid, int32 *history,
                      int32 n_hist, int32 *n_used);
 
+/**
+ * Quick general N-Gram score lookup for several words with the same
+ * history.
+ *
+ * This gives the same scores as ngram_ng_score() for each word in
+ * <code>wids</code>, but the history is only looked up once.  Lookups
+ * are fastest if <code>wids</code> is sorted.
+ *
+ * @param wids Words to score.
+ * @param n_wids Number of words in <code>wids</code>.
+ * @param history History words, most recent first.
+ * @param n_hist Number of words in <code>history</code>.
+ * @param out_scores Output: score of each word in <code>wids</code>.
+ */
+SPHINXBASE_EXPORT
+void ngram_ng_score_batch(ngram_model_t *model,
+                          int32 const *wids, int32 n_wids,
+                          int32 *history, int32 n_hist,
+                          int32 *out_scores);
+
 /**
  * Get the "raw" log-probability for a general N-Gram.
  *
@@ -554,6 +575,33 @@ ngram_model_t *ngram_model_set_read(cmd_ln_t *config,
                                     const char *lmctlfile,
                                     logmath_t *lmath);
 
+/**
+ * Create a copy of a language model set sharing its language models.
+ *
+ * The copy has its own word mapping, selected model and weights.  The
+ * language models themselves are retained rather than copied, so
+ * before using the copy and the original set at the same time from
+ * different threads, call ngram_model_set_share() on the copy.  Words
+ * must not be added to either set afterwards.
+ *
+ * @return newly created language model set, or NULL on failure.
+ */
+SPHINXBASE_EXPORT
+ngram_model_t *ngram_model_set_dup(ngram_model_t *set);
+
+/**
+ * Mark the language models in a set as shared between threads, or not.
+ *
+ * Shared language models do not cache N-Gram information, which makes
+ * scoring them from several threads safe but slower, for every set
+ * that contains them.  They stop being shared once no set sharing
+ * them is left.  Freeing a set ends its share.
+ *
+ * @param share TRUE to start sharing the models, FALSE to stop.
+ */
+SPHINXBASE_EXPORT
+void ngram_model_set_share(ngram_model_t *set, int share);
+
 /**
  * Returns the number of language models in a set.
  */
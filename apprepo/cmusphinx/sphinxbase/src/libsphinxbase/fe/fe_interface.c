@@ -269,6 +269,7 @@ fe_init_auto_r(cmd_ln_t *config)
     fe->ccc = ckd_calloc(fe->fft_size / 4, sizeof(*fe->ccc));
     fe->sss = ckd_calloc(fe->fft_size / 4, sizeof(*fe->sss));
     fe_create_twiddle(fe);
+    fe_create_batch(fe);
 
     if (cmd_ln_boolean_r(config, "-verbose")) {
         fe_print_current(fe);
@@ -409,7 +410,7 @@ fe_process_frames(fe_t *fe,
                *inout_spch, offset * sizeof(**inout_spch));
         fe_read_frame(fe, fe->overflow_samps, fe->frame_size);
         assert(outidx < frame_count);
-        if ((n = fe_write_frame(fe, buf_cep[outidx])) < 0)
+        if ((n = fe_write_frames(fe, buf_cep + outidx, frame_count == 1)) < 0)
             return -1;
         outidx += n;
         /* Update input-output pointers and counters. */
@@ -420,7 +421,7 @@ fe_process_frames(fe_t *fe,
     else {
         fe_read_frame(fe, *inout_spch, fe->frame_size);
         assert(outidx < frame_count);
-        if ((n = fe_write_frame(fe, buf_cep[outidx])) < 0)
+        if ((n = fe_write_frames(fe, buf_cep + outidx, frame_count == 1)) < 0)
             return -1;
         outidx += n;
         /* Update input-output pointers and counters. */
@@ -428,13 +429,15 @@ fe_process_frames(fe_t *fe,
         *inout_nsamps -= fe->frame_size;
     }
 
-    /* Process all remaining frames. */
+    /* Process all remaining frames, several at a time where possible
+     * (outidx stays at the first frame queued by fe_write_frames()). */
     for (i = 1; i < frame_count; ++i) {
         assert(*inout_nsamps >= (size_t)fe->frame_shift);
 
         fe_shift_frame(fe, *inout_spch, fe->frame_shift);
         assert(outidx < frame_count);
-        if ((n = fe_write_frame(fe, buf_cep[outidx])) < 0)
+        if ((n = fe_write_frames(fe, buf_cep + outidx,
+                                 i == frame_count - 1)) < 0)
             return -1;
         outidx += n;
         /* Update input-output pointers and counters. */
@@ -566,6 +569,7 @@ fe_free(fe_t * fe)
     ckd_free(fe->mfspec);
     ckd_free(fe->overflow_samps);
     ckd_free(fe->hamming_window);
+    fe_free_batch(fe);
     cmd_ln_free_r(fe->config);
     ckd_free(fe);
 
@@ -71,6 +71,13 @@ typedef float64 window_t;
 typedef struct { float64 r, i; } complex;
 #endif /* FIXED_POINT */
 
+/* Number of frames transformed together by fe_write_frames(), one
+ * per vector lane.  Needs GCC vector extensions. */
+#if !defined(FIXED_POINT) && (defined(__clang__) || __GNUC__ > 4 \
+                              || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define FE_BATCH 4
+#endif
+
 /* Values for the 'logspec' field. */
 enum {
 	RAW_LOG_SPEC = 1,
@@ -164,6 +171,18 @@ struct fe_s {
     int16 *overflow_samps;
     int16 num_overflow_samps;    
     int16 prior;
+
+#ifdef FE_BATCH
+    /* Batched transform: bit-reversal permutation, window in
+     * bit-reversed order, interleaved buffers for FE_BATCH frames and
+     * number of frames queued in them. */
+    int16 *bitrev;
+    window_t *batch_window;
+    frame_t *batch_frame;
+    powspec_t *batch_spec, *batch_mfspec;
+    int n_batch;
+    void (*batch_transform)(struct fe_s *fe);
+#endif
 };
 
 #define BB_SAMPLING_RATE 16000
@@ -194,11 +213,18 @@ int fe_shift_frame(fe_t *fe, int16 const *in, int32 len);
 /* Process a frame of data into features. */
 int32 fe_write_frame(fe_t *fe, mfcc_t *fea);
 
+/* Queue a frame of data and process the queue into features if it
+ * is full or flush is TRUE.  fea points to the output for the first
+ * queued frame.  Returns the number of frames written. */
+int32 fe_write_frames(fe_t *fe, mfcc_t **fea, int flush);
+
 /* Initialization functions. */
 int32 fe_build_melfilters(melfb_t *MEL_FB);
 int32 fe_compute_melcosine(melfb_t *MEL_FB);
 void fe_create_hamming(window_t *in, int32 in_len);
 void fe_create_twiddle(fe_t *fe);
+void fe_create_batch(fe_t *fe);
+void fe_free_batch(fe_t *fe);
 
 /* Miscellaneous processing functions. */
 void fe_spec2cep(fe_t * fe, const powspec_t * mflogspec, mfcc_t * mfcep);
@@ -539,23 +539,26 @@ fe_create_hamming(window_t * in, int32 in_len)
 }
 
 static void
-fe_hamming_window(frame_t * in, window_t * window, int32 in_len, int32 remove_dc)
+fe_remove_dc(frame_t * in, int32 in_len)
 {
-    int i;
-
-    if (remove_dc) {
 #ifdef FIXED16
-        int32 mean = 0; /* Use int32 to avoid possibility of overflow */
+    int32 mean = 0; /* Use int32 to avoid possibility of overflow */
 #else
-        frame_t mean = 0;
+    frame_t mean = 0;
 #endif
+    int i;
 
-        for (i = 0; i < in_len; i++)
-            mean += in[i];
-        mean /= in_len;
-        for (i = 0; i < in_len; i++)
-            in[i] -= (frame_t)mean;
-    }
+    for (i = 0; i < in_len; i++)
+        mean += in[i];
+    mean /= in_len;
+    for (i = 0; i < in_len; i++)
+        in[i] -= (frame_t)mean;
+}
+
+static void
+fe_hamming_window(frame_t * in, window_t * window, int32 in_len)
+{
+    int i;
 
 #ifdef FIXED16
     for (i = 0; i < in_len/2; i++) {
@@ -593,9 +596,10 @@ fe_spch_to_frame(fe_t *fe, int len)
     memset(fe->frame + len, 0,
            (fe->fft_size - len) * sizeof(*fe->frame));
 
-    /* Window. */
-    fe_hamming_window(fe->frame, fe->hamming_window, fe->frame_size,
-                      fe->remove_dc);
+    /* Remove DC offset.  The window is applied by fe_write_frame()
+     * or fused with the batched FFT input. */
+    if (fe->remove_dc)
+        fe_remove_dc(fe->frame, fe->frame_size);
 
     return len;
 }
@@ -1104,6 +1108,7 @@ fe_dct3(fe_t * fe, const mfcc_t * mfcep, powspec_t * mflogspec)
 int32
 fe_write_frame(fe_t * fe, mfcc_t * fea)
 {
+    fe_hamming_window(fe->frame, fe->hamming_window, fe->frame_size);
     fe_spec_magnitude(fe);
     fe_mel_spec(fe);
     fe_mel_cep(fe, fea);
@@ -1112,6 +1117,215 @@ fe_write_frame(fe_t * fe, mfcc_t * fea)
     return 1;
 }
 
+#ifdef FE_BATCH
+/*
+ * The batched transform runs FE_BATCH frames together, one per vector
+ * lane.  Each lane does exactly the arithmetic of fe_fft_real(),
+ * fe_spec_magnitude() and fe_mel_spec(), so the output is the same as
+ * that of fe_write_frame().  Frames are stored bit-reversed and
+ * interleaved, with the window applied on the way in.
+ */
+typedef frame_t fe_vec_t
+    __attribute__((vector_size(FE_BATCH * sizeof(frame_t)),
+                   aligned(sizeof(frame_t))));
+
+static void
+fe_batch_frame(fe_t *fe, int k)
+{
+    frame_t *x = fe->batch_frame + k;
+    int i;
+
+    for (i = 0; i < fe->fft_size; ++i)
+        x[i * FE_BATCH] = COSMUL(fe->frame[fe->bitrev[i]],
+                                 fe->batch_window[i]);
+}
+
+static inline __attribute__((always_inline)) void
+fe_batch_transform_vec(fe_t *fe)
+{
+    fe_vec_t *x, *spec, *mfspec, xt;
+    int i, j, k, m, n;
+
+    x = (fe_vec_t *)fe->batch_frame;
+    m = fe->fft_order;
+    n = fe->fft_size;
+
+    /* Basic butterflies (the input is already bit-reversed). */
+    for (i = 0; i < n; i += 2) {
+        xt = x[i];
+        x[i]     = (xt + x[i + 1]);
+        x[i + 1] = (xt - x[i + 1]);
+    }
+
+    /* The rest of the butterflies, in stages from 1..m */
+    for (k = 1; k < m; ++k) {
+        int n1, n2, n4;
+
+        n4 = k - 1;
+        n2 = k;
+        n1 = k + 1;
+        for (i = 0; i < n; i += (1 << n1)) {
+            xt = x[i];
+            x[i]             = (xt + x[i + (1 << n2)]);
+            x[i + (1 << n2)] = (xt - x[i + (1 << n2)]);
+            x[i + (1 << n2) + (1 << n4)] = -x[i + (1 << n2) + (1 << n4)];
+
+            for (j = 1; j < (1 << n4); ++j) {
+                frame_t cc, ss;
+                fe_vec_t t1, t2;
+                int i1, i2, i3, i4;
+
+                i1 = i + j;
+                i2 = i + (1 << n2) - j;
+                i3 = i + (1 << n2) + j;
+                i4 = i + (1 << n2) + (1 << n2) - j;
+
+                cc = fe->ccc[j << (m - n1)];
+                ss = fe->sss[j << (m - n1)];
+
+                t1 = x[i3] * cc + x[i4] * ss;
+                t2 = x[i3] * ss - x[i4] * cc;
+
+                x[i4] = (x[i2] - t2);
+                x[i3] = (-x[i2] - t2);
+                x[i2] = (x[i1] - t1);
+                x[i1] = (x[i1] + t1);
+            }
+        }
+    }
+
+    /* Power spectrum. */
+    spec = (fe_vec_t *)fe->batch_spec;
+    spec[0] = x[0] * x[0];
+    for (j = 1; j <= n / 2; j++)
+        spec[j] = x[j] * x[j] + x[n - j] * x[n - j];
+
+    /* Mel filterbank, only over the non-zero filter coefficients. */
+    mfspec = (fe_vec_t *)fe->batch_mfspec;
+    for (k = 0; k < fe->mel_fb->num_filters; k++) {
+        fe_vec_t *s = spec + fe->mel_fb->spec_start[k];
+        mfcc_t const *c = fe->mel_fb->filt_coeffs + fe->mel_fb->filt_start[k];
+        fe_vec_t acc = { 0 };
+
+        for (i = 0; i < fe->mel_fb->filt_width[k]; i++)
+            acc += s[i] * (powspec_t)c[i];
+        mfspec[k] = acc;
+    }
+}
+
+static void
+fe_batch_transform(fe_t *fe)
+{
+    fe_batch_transform_vec(fe);
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+/* Same code, in 256-bit registers.  No FMA, which would round
+ * differently from fe_write_frame(). */
+__attribute__((target("avx")))
+static void
+fe_batch_transform_avx(fe_t *fe)
+{
+    fe_batch_transform_vec(fe);
+}
+#endif
+#endif /* FE_BATCH */
+
+void
+fe_create_batch(fe_t *fe)
+{
+#ifdef FE_BATCH
+    int i, j, k, n, half;
+
+    n = fe->fft_size;
+    half = fe->frame_size / 2;
+    fe->bitrev = ckd_calloc(n, sizeof(*fe->bitrev));
+    fe->batch_window = ckd_calloc(n, sizeof(*fe->batch_window));
+    fe->batch_frame = ckd_calloc(n * FE_BATCH, sizeof(*fe->batch_frame));
+    fe->batch_spec = ckd_calloc((n / 2 + 1) * FE_BATCH,
+                                sizeof(*fe->batch_spec));
+    fe->batch_mfspec = ckd_calloc(fe->mel_fb->num_filters * FE_BATCH,
+                                  sizeof(*fe->batch_mfspec));
+    fe->n_batch = 0;
+
+    /* Same permutation as the swaps in fe_fft_real(). */
+    j = 0;
+    for (i = 0; i < n - 1; ++i) {
+        fe->bitrev[i] = j;
+        k = n / 2;
+        while (k <= j) {
+            j -= k;
+            k /= 2;
+        }
+        j += k;
+    }
+    fe->bitrev[n - 1] = n - 1;
+
+    /* Same weights as fe_hamming_window(), which leaves the middle
+     * sample of an odd-length frame alone. */
+    for (i = 0; i < n; ++i) {
+        int s = fe->bitrev[i];
+
+        if (s < half)
+            fe->batch_window[i] = fe->hamming_window[s];
+        else if (s >= fe->frame_size)
+            fe->batch_window[i] = 0;
+        else if (s >= fe->frame_size - half)
+            fe->batch_window[i] = fe->hamming_window[fe->frame_size - 1 - s];
+        else
+            fe->batch_window[i] = 1;
+    }
+
+    fe->batch_transform = fe_batch_transform;
+#if defined(__i386__) || defined(__x86_64__)
+    if (__builtin_cpu_supports("avx"))
+        fe->batch_transform = fe_batch_transform_avx;
+#endif
+#endif /* FE_BATCH */
+}
+
+void
+fe_free_batch(fe_t *fe)
+{
+#ifdef FE_BATCH
+    ckd_free(fe->bitrev);
+    ckd_free(fe->batch_window);
+    ckd_free(fe->batch_frame);
+    ckd_free(fe->batch_spec);
+    ckd_free(fe->batch_mfspec);
+#endif
+}
+
+int32
+fe_write_frames(fe_t *fe, mfcc_t **fea, int flush)
+{
+#ifdef FE_BATCH
+    int32 i, k, n;
+
+    /* Nothing to batch a single frame with. */
+    if (flush && fe->n_batch == 0)
+        return fe_write_frame(fe, fea[0]);
+
+    fe_batch_frame(fe, fe->n_batch++);
+    if (!flush && fe->n_batch < FE_BATCH)
+        return 0;
+    n = fe->n_batch;
+    fe->n_batch = 0;
+
+    (*fe->batch_transform)(fe);
+    for (k = 0; k < n; ++k) {
+        for (i = 0; i < fe->mel_fb->num_filters; ++i)
+            fe->mfspec[i] = fe->batch_mfspec[i * FE_BATCH + k];
+        fe_mel_cep(fe, fea[k]);
+        fe_lifter(fe, fea[k]);
+    }
+    return n;
+#else
+    (void)flush;
+    return fe_write_frame(fe, fea[0]);
+#endif
+}
+
 void *
 fe_create_2d(int32 d1, int32 d2, int32 elem_size)
 {
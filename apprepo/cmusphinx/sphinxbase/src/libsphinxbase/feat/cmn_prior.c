@@ -143,26 +143,37 @@ cmn_prior_update(cmn_t *cmn)
 }
 
 void
-cmn_prior(cmn_t *cmn, mfcc_t **incep, int32 varnorm, int32 nfr)
+cmn_prior_copy(cmn_t *cmn, mfcc_t **incep, mfcc_t **outbuf,
+               int32 pos, int32 n_buf, int32 nfr)
 {
     int32 i, j;
 
-    if (varnorm)
-        E_FATAL
-            ("Variance normalization not implemented in live mode decode\n");
-
     if (nfr <= 0)
         return;
 
     for (i = 0; i < nfr; i++) {
+        mfcc_t *in = incep[i], *out = outbuf[pos];
+
         for (j = 0; j < cmn->veclen; j++) {
-            cmn->sum[j] += incep[i][j];
-            incep[i][j] -= cmn->cmn_mean[j];
+            cmn->sum[j] += in[j];
+            out[j] = in[j] - cmn->cmn_mean[j];
         }
         ++cmn->nframe;
+        if (++pos == n_buf)
+            pos = 0;
     }
 
     /* Shift buffer down if we have more than CMN_WIN_HWM frames */
     if (cmn->nframe > CMN_WIN_HWM)
         cmn_prior_shiftwin(cmn);
 }
+
+void
+cmn_prior(cmn_t *cmn, mfcc_t **incep, int32 varnorm, int32 nfr)
+{
+    if (varnorm)
+        E_FATAL
+            ("Variance normalization not implemented in live mode decode\n");
+
+    cmn_prior_copy(cmn, incep, incep, 0, nfr, nfr);
+}
@@ -140,6 +140,16 @@
 #define FEAT_VERSION	"1.0"
 #define FEAT_DCEP_WIN		2
 
+/* Number of LDA outputs computed together by feat_lda_frame(), one per
+ * vector lane.  Needs GCC vector extensions. */
+#if !defined(FIXED_POINT) && (defined(__clang__) || __GNUC__ > 4 \
+                              || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define FEAT_VEC 4
+typedef mfcc_t feat_vec_t
+    __attribute__((vector_size(FEAT_VEC * sizeof(mfcc_t)),
+                   aligned(sizeof(mfcc_t))));
+#endif
+
 #ifdef DUMP_FEATURES
 static void
 cep_dump_dbg(feat_t *fcb, mfcc_t **mfc, int32 nfr, const char *text)
@@ -421,6 +431,117 @@ feat_array_free(mfcc_t ***feat)
     ckd_free_2d((void **)feat);
 }
 
+/* Number of LDA outputs, rounded up to whole vectors. */
+static uint32
+feat_lda_padded_dim(feat_t *fcb)
+{
+#ifdef FEAT_VEC
+    return (feat_dimension(fcb) + FEAT_VEC - 1) / FEAT_VEC * FEAT_VEC;
+#else
+    return feat_dimension(fcb);
+#endif
+}
+
+/*
+ * Allocate fcb->lda_buf.  For vector code, it starts with the LDA
+ * matrix transposed, so that a vector of consecutive outputs can be
+ * updated with each input coefficient.  Then there is room for one
+ * feature vector after LDA, and one before.
+ */
+static void
+feat_lda_setup(feat_t *fcb)
+{
+    uint32 n_in, n_pad;
+
+    n_in = fcb->stream_len[0];
+    n_pad = feat_lda_padded_dim(fcb);
+#ifdef FEAT_VEC
+    {
+        uint32 j, k;
+
+        fcb->lda_buf = ckd_calloc(n_in * n_pad + n_pad + n_in,
+                                  sizeof(mfcc_t));
+        for (k = 0; k < n_in; ++k)
+            for (j = 0; j < feat_dimension(fcb); ++j)
+                fcb->lda_buf[k * n_pad + j] = fcb->lda[0][j][k];
+    }
+#else
+    fcb->lda_buf = ckd_calloc(n_pad + n_in, sizeof(mfcc_t));
+#endif
+}
+
+/* Feature vector after LDA, in fcb->lda_buf. */
+static mfcc_t *
+feat_lda_out(feat_t *fcb)
+{
+#ifdef FEAT_VEC
+    return fcb->lda_buf + fcb->stream_len[0] * feat_lda_padded_dim(fcb);
+#else
+    return fcb->lda_buf;
+#endif
+}
+
+/*
+ * Apply LDA to one feature vector.  This is feat_lda_transform(), with
+ * the same arithmetic in the same order for each output, so the
+ * results are identical.
+ */
+static void
+feat_lda_frame(feat_t *fcb, mfcc_t const *in, mfcc_t *out)
+{
+    mfcc_t *tmp;
+    uint32 n_in, n_pad, j, k;
+
+    n_in = fcb->stream_len[0];
+    n_pad = feat_lda_padded_dim(fcb);
+    tmp = feat_lda_out(fcb);
+#ifdef FEAT_VEC
+    for (j = 0; j < n_pad; j += FEAT_VEC) {
+        mfcc_t const *lda_t = fcb->lda_buf + j;
+        feat_vec_t acc = { 0 };
+
+        for (k = 0; k < n_in; ++k)
+            acc += in[k] * *(feat_vec_t const *)(lda_t + k * n_pad);
+        *(feat_vec_t *)(tmp + j) = acc;
+    }
+#else
+    for (j = 0; j < n_pad; ++j) {
+        tmp[j] = 0;
+        for (k = 0; k < n_in; ++k)
+            tmp[j] += MFCCMUL(in[k], fcb->lda[0][j][k]);
+    }
+#endif
+    /* As in feat_lda_transform(), anything past the output dimension
+     * is zero. */
+    memcpy(out, tmp, feat_dimension(fcb) * sizeof(mfcc_t));
+    memset(out + feat_dimension(fcb), 0,
+           (n_in - feat_dimension(fcb)) * sizeof(mfcc_t));
+}
+
+/*
+ * Compute the feature vector for the window of cepstra around mfc[0],
+ * then apply LDA and subvector projection to it while it is still in
+ * cache, rather than in separate passes over all the frames.
+ */
+static void
+feat_compute_frame(feat_t *fcb, mfcc_t **mfc, mfcc_t **feat)
+{
+    if (fcb->lda) {
+        mfcc_t *in;
+
+        if (fcb->lda_buf == NULL)
+            feat_lda_setup(fcb);
+        in = feat_lda_out(fcb) + feat_lda_padded_dim(fcb);
+        fcb->compute_feat(fcb, mfc, &in);
+        feat_lda_frame(fcb, in, feat[0]);
+    }
+    else
+        fcb->compute_feat(fcb, mfc, feat);
+
+    if (fcb->subvecs)
+        feat_subvec_project(fcb, &feat, 1);
+}
+
 static void
 feat_s2_4x_cep2feat(feat_t * fcb, mfcc_t ** mfc, mfcc_t ** feat)
 {
@@ -971,20 +1092,10 @@ feat_compute_utt(feat_t *fcb, mfcc_t **mfc, int32 nfr, int32 win, mfcc_t ***feat
 
     /* Create feature vectors */
     for (i = win; i < nfr - win; i++) {
-        fcb->compute_feat(fcb, mfc + i, feat[i - win]);
-    }
-
-    feat_print_dbg(fcb, feat, nfr - win * 2, "After dynamic feature computation");
-
-    if (fcb->lda) {
-        feat_lda_transform(fcb, feat, nfr - win * 2);
-        feat_print_dbg(fcb, feat, nfr - win * 2, "After LDA");
+        feat_compute_frame(fcb, mfc + i, feat[i - win]);
     }
 
-    if (fcb->subvecs) {
-        feat_subvec_project(fcb, feat, nfr - win * 2);
-        feat_print_dbg(fcb, feat, nfr - win * 2, "After subvector projection");
-    }
+    feat_print_dbg(fcb, feat, nfr - win * 2, "After feature computation");
 }
 
 
@@ -1307,7 +1418,7 @@ int32
 feat_s2mfc2feat_live(feat_t * fcb, mfcc_t ** uttcep, int32 *inout_ncep,
 		     int32 beginutt, int32 endutt, mfcc_t *** ofeat)
 {
-    int32 win, cepsize, nbufcep;
+    int32 win, cepsize, nbufcep, startpos;
     int32 i, j, nfeatvec;
     int32 zero = 0;
 
@@ -1344,30 +1455,45 @@ feat_s2mfc2feat_live(feat_t * fcb, mfcc_t ** uttcep, int32 *inout_ncep,
         endutt = FALSE;
     }
 
-    /* FIXME: Don't modify the input! */
-    feat_cmn(fcb, uttcep, *inout_ncep, beginutt, endutt);
-    feat_agc(fcb, uttcep, *inout_ncep, beginutt, endutt);
-
     /* Replicate first frame into the first win frames if we're at the
      * beginning of the utterance and there was some actual input to
-     * deal with.  (FIXME: Not entirely sure why that condition) */
+     * deal with.  (FIXME: Not entirely sure why that condition)  It
+     * is copied there once it has been normalized below. */
+    startpos = fcb->bufpos;
     if (beginutt && *inout_ncep > 0) {
-        for (i = 0; i < win; i++) {
-            memcpy(fcb->cepbuf[fcb->bufpos++], uttcep[0],
-                   cepsize * sizeof(mfcc_t));
-            fcb->bufpos %= LIVEBUFBLOCKSIZE;
-        }
+        fcb->bufpos = (fcb->bufpos + win) % LIVEBUFBLOCKSIZE;
         /* Move the current pointer past this data. */
         fcb->curpos = fcb->bufpos;
         nbufcep -= win;
     }
 
-    /* Copy in frame data to the circular buffer. */
-    for (i = 0; i < *inout_ncep; ++i) {
-        memcpy(fcb->cepbuf[fcb->bufpos++], uttcep[i],
-               cepsize * sizeof(mfcc_t));
-        fcb->bufpos %= LIVEBUFBLOCKSIZE;
-	++nbufcep;
+    /* Copy in frame data to the circular buffer.  Prior CMN (which is
+     * what feat_cmn() does unless given the whole utterance at once)
+     * is done on the way in, unless there is AGC to do as well. */
+    if (fcb->agc == AGC_NONE && fcb->cmn != CMN_NONE
+        && !(fcb->cmn == CMN_CURRENT && beginutt && endutt)) {
+        if (fcb->varnorm)
+            E_FATAL("Variance normalization not implemented in live mode decode\n");
+        cmn_prior_copy(fcb->cmn_struct, uttcep, fcb->cepbuf,
+                       fcb->bufpos, LIVEBUFBLOCKSIZE, *inout_ncep);
+        if (endutt)
+            cmn_prior_update(fcb->cmn_struct);
+    }
+    else {
+        /* FIXME: Don't modify the input! */
+        feat_cmn(fcb, uttcep, *inout_ncep, beginutt, endutt);
+        feat_agc(fcb, uttcep, *inout_ncep, beginutt, endutt);
+        for (i = 0; i < *inout_ncep; ++i)
+            memcpy(fcb->cepbuf[(fcb->bufpos + i) % LIVEBUFBLOCKSIZE],
+                   uttcep[i], cepsize * sizeof(mfcc_t));
+    }
+    fcb->bufpos = (fcb->bufpos + *inout_ncep) % LIVEBUFBLOCKSIZE;
+    nbufcep += *inout_ncep;
+
+    if (beginutt && *inout_ncep > 0) {
+        for (i = 0; i < win; i++)
+            memcpy(fcb->cepbuf[(startpos + i) % LIVEBUFBLOCKSIZE],
+                   fcb->cepbuf[fcb->curpos], cepsize * sizeof(mfcc_t));
     }
 
     /* Replicate last frame into the last win frames if we're at the
@@ -1400,22 +1526,16 @@ feat_s2mfc2feat_live(feat_t * fcb, mfcc_t ** uttcep, int32 *inout_ncep,
                     (fcb->curpos + j + LIVEBUFBLOCKSIZE) % LIVEBUFBLOCKSIZE;
 		fcb->tmpcepbuf[win + j] = fcb->cepbuf[tmppos];
             }
-            fcb->compute_feat(fcb, fcb->tmpcepbuf + win, ofeat[i]);
+            feat_compute_frame(fcb, fcb->tmpcepbuf + win, ofeat[i]);
         }
         else {
-            fcb->compute_feat(fcb, fcb->cepbuf + fcb->curpos, ofeat[i]);
+            feat_compute_frame(fcb, fcb->cepbuf + fcb->curpos, ofeat[i]);
         }
 	/* Move the read pointer forward. */
         ++fcb->curpos;
         fcb->curpos %= LIVEBUFBLOCKSIZE;
     }
 
-    if (fcb->lda)
-        feat_lda_transform(fcb, ofeat, nfeatvec);
-
-    if (fcb->subvecs)
-        feat_subvec_project(fcb, ofeat, nfeatvec);
-
     return nfeatvec;
 }
 
@@ -1443,6 +1563,7 @@ feat_free(feat_t * f)
     }
     if (f->lda)
         ckd_free_3d((void ***) f->lda);
+    ckd_free(f->lda_buf);
 
     ckd_free(f->stream_len);
     ckd_free(f->sv_len);
@@ -102,6 +102,9 @@ feat_read_lda(feat_t *feat, const char *ldafile, int32 dim)
 
     if (feat->lda)
         ckd_free_3d((void ***)feat->lda);
+    /* It will be set up again for the new matrix. */
+    ckd_free(feat->lda_buf);
+    feat->lda_buf = NULL;
 
     {
         /* Use a temporary variable to avoid strict-aliasing problems. */
@@ -41,6 +41,7 @@
 #include <time.h>
 #endif                          /* _WIN32_WCE */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
@@ -794,6 +795,45 @@ fsg_model_free(fsg_model_t * fsg)
     return 0;
 }
 
+static int
+link_cmp(const void *a, const void *b)
+{
+    fsg_link_t const *la = *(fsg_link_t const **) a;
+    fsg_link_t const *lb = *(fsg_link_t const **) b;
+
+    if ((la->wid < 0) != (lb->wid < 0))
+        return (la->wid < 0) ? 1 : -1;
+    if (la->to_state != lb->to_state)
+        return (la->to_state < lb->to_state) ? -1 : 1;
+    return (la->wid < lb->wid) ? -1 : (la->wid > lb->wid);
+}
+
+/*
+ * Get the transitions out of state i in a fixed order, non-null ones
+ * first, then by destination state and word, as the hash tables
+ * holding them are in no particular order.  The array must be freed
+ * with ckd_free().
+ */
+static fsg_link_t **
+fsg_model_sorted_arcs(fsg_model_t * fsg, int32 i, int32 * out_n_arc)
+{
+    fsg_arciter_t *itor;
+    fsg_link_t **arcs;
+    int32 n;
+
+    n = 0;
+    for (itor = fsg_model_arcs(fsg, i); itor;
+         itor = fsg_arciter_next(itor))
+        ++n;
+    arcs = ckd_calloc(n + 1, sizeof(*arcs));
+    n = 0;
+    for (itor = fsg_model_arcs(fsg, i); itor;
+         itor = fsg_arciter_next(itor))
+        arcs[n++] = fsg_arciter_get(itor);
+    qsort(arcs, n, sizeof(*arcs), link_cmp);
+    *out_n_arc = n;
+    return arcs;
+}
 
 void
 fsg_model_write(fsg_model_t * fsg, FILE * fp)
@@ -807,11 +847,12 @@ fsg_model_write(fsg_model_t * fsg, FILE * fp)
     fprintf(fp, "%s %d\n", FSG_MODEL_FINAL_STATE_DECL, fsg->final_state);
 
     for (i = 0; i < fsg->n_state; i++) {
-        fsg_arciter_t *itor;
+        fsg_link_t **arcs;
+        int32 j, n_arc;
 
-        for (itor = fsg_model_arcs(fsg, i); itor;
-             itor = fsg_arciter_next(itor)) {
-            fsg_link_t *tl = fsg_arciter_get(itor);
+        arcs = fsg_model_sorted_arcs(fsg, i, &n_arc);
+        for (j = 0; j < n_arc; j++) {
+            fsg_link_t *tl = arcs[j];
 
             fprintf(fp, "%s %d %d %f %s\n", FSG_MODEL_TRANSITION_DECL,
                     tl->from_state, tl->to_state,
@@ -819,6 +860,7 @@ fsg_model_write(fsg_model_t * fsg, FILE * fp)
                                 (int32) (tl->logs2prob / fsg->lw)),
                     (tl->wid < 0) ? "" : fsg_model_word_str(fsg, tl->wid));
         }
+        ckd_free(arcs);
     }
 
     fprintf(fp, "%s\n", FSG_MODEL_END_DECL);
@@ -848,16 +890,18 @@ fsg_model_writefile(fsg_model_t * fsg, char const *file)
 static void
 fsg_model_write_fsm_trans(fsg_model_t * fsg, int i, FILE * fp)
 {
-    fsg_arciter_t *itor;
+    fsg_link_t **arcs;
+    int32 j, n_arc;
 
-    for (itor = fsg_model_arcs(fsg, i); itor;
-         itor = fsg_arciter_next(itor)) {
-        fsg_link_t *tl = fsg_arciter_get(itor);
+    arcs = fsg_model_sorted_arcs(fsg, i, &n_arc);
+    for (j = 0; j < n_arc; j++) {
+        fsg_link_t *tl = arcs[j];
         fprintf(fp, "%d %d %s %f\n",
                 tl->from_state, tl->to_state,
                 (tl->wid < 0) ? "<eps>" : fsg_model_word_str(fsg, tl->wid),
                 -logmath_log_to_ln(fsg->lmath, tl->logs2prob / fsg->lw));
     }
+    ckd_free(arcs);
 }
 
 void
@@ -423,6 +423,12 @@ jsgf_rule_iter(jsgf_t *grammar)
     return hash_table_iter(grammar->rules);
 }
 
+jsgf_import_iter_t *
+jsgf_import_iter(jsgf_t *grammar)
+{
+    return hash_table_iter(grammar->imports);
+}
+
 jsgf_rule_t *
 jsgf_get_rule(jsgf_t *grammar, char const *name)
 {
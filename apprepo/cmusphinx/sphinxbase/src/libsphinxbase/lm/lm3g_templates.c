@@ -97,18 +97,13 @@ lm3g_bg_score(NGRAM_MODEL_TYPE *model,
 }
 
 static void
-load_tginfo(NGRAM_MODEL_TYPE *model, int32 lw1, int32 lw2)
+fill_tginfo(NGRAM_MODEL_TYPE *model, tginfo_t *tginfo, int32 lw1, int32 lw2)
 {
     int32 i, n, b, t;
     bigram_t *bg;
-    tginfo_t *tginfo;
 
-    /* First allocate space for tg information for bg lw1,lw2 */
-    tginfo = (tginfo_t *) listelem_malloc(model->lm3g.le);
     tginfo->w1 = lw1;
     tginfo->tg = NULL;
-    tginfo->next = model->lm3g.tginfo[lw2];
-    model->lm3g.tginfo[lw2] = tginfo;
 
     /* Locate bigram lw1,lw2 */
     b = model->lm3g.unigrams[lw1].bigrams;
@@ -133,6 +128,54 @@ load_tginfo(NGRAM_MODEL_TYPE *model, int32 lw1, int32 lw2)
     }
 }
 
+static void
+load_tginfo(NGRAM_MODEL_TYPE *model, int32 lw1, int32 lw2)
+{
+    tginfo_t *tginfo;
+
+    /* First allocate space for tg information for bg lw1,lw2 */
+    tginfo = (tginfo_t *) listelem_malloc(model->lm3g.le);
+    fill_tginfo(model, tginfo, lw1, lw2);
+    tginfo->next = model->lm3g.tginfo[lw2];
+    model->lm3g.tginfo[lw2] = tginfo;
+}
+
+/*
+ * Find trigram information for bigram lw1,lw2, loading it in the
+ * cache if needed.  Models shared between threads are not cached,
+ * the information is computed again in tmp instead.
+ */
+static tginfo_t *
+find_tginfo(NGRAM_MODEL_TYPE *model, int32 lw1, int32 lw2, tginfo_t *tmp)
+{
+    tginfo_t *tginfo, *prev_tginfo;
+
+    if (model->base.flags & NGRAM_MODEL_SHARED) {
+        fill_tginfo(model, tmp, lw1, lw2);
+        return tmp;
+    }
+
+    prev_tginfo = NULL;
+    for (tginfo = model->lm3g.tginfo[lw2]; tginfo; tginfo = tginfo->next) {
+        if (tginfo->w1 == lw1)
+            break;
+        prev_tginfo = tginfo;
+    }
+
+    if (!tginfo) {
+        load_tginfo(model, lw1, lw2);
+        tginfo = model->lm3g.tginfo[lw2];
+    }
+    else if (prev_tginfo) {
+        prev_tginfo->next = tginfo->next;
+        tginfo->next = model->lm3g.tginfo[lw2];
+        model->lm3g.tginfo[lw2] = tginfo;
+    }
+
+    tginfo->used = 1;
+    return tginfo;
+}
+
 /* Similar to find_bg */
 static int32
 find_tg(trigram_t * tg, int32 n, int32 w)
@@ -162,29 +205,12 @@ lm3g_tg_score(NGRAM_MODEL_TYPE *model, int32 lw1,
     ngram_model_t *base = &model->base;
     int32 i, n, score;
     trigram_t *tg;
-    tginfo_t *tginfo, *prev_tginfo;
+    tginfo_t *tginfo, tmp;
 
     if ((base->n < 3) || (lw1 < 0) || (lw2 < 0))
         return (lm3g_bg_score(model, lw2, lw3, n_used));
 
-    prev_tginfo = NULL;
-    for (tginfo = model->lm3g.tginfo[lw2]; tginfo; tginfo = tginfo->next) {
-        if (tginfo->w1 == lw1)
-            break;
-        prev_tginfo = tginfo;
-    }
-
-    if (!tginfo) {
-        load_tginfo(model, lw1, lw2);
-        tginfo = model->lm3g.tginfo[lw2];
-    }
-    else if (prev_tginfo) {
-        prev_tginfo->next = tginfo->next;
-        tginfo->next = model->lm3g.tginfo[lw2];
-        model->lm3g.tginfo[lw2] = tginfo;
-    }
-
-    tginfo->used = 1;
+    tginfo = find_tginfo(model, lw1, lw2, &tmp);
 
     /* Trigrams for w1,w2 now pointed to by tginfo */
     n = tginfo->n_tg;
@@ -221,6 +247,65 @@ lm3g_template_score(ngram_model_t *base, int32 wid,
     }
 }
 
+/*
+ * Score several words after the same history.  The bigram and trigram
+ * lists of the history are found once, and if the words come in order
+ * each search starts where the last one ended.
+ */
+static void
+lm3g_template_score_batch(ngram_model_t *base,
+                          int32 const *wids, int32 n_wids,
+                          int32 *history, int32 n_hist,
+                          int32 *out_scores)
+{
+    NGRAM_MODEL_TYPE *model = (NGRAM_MODEL_TYPE *)base;
+    bigram_t *bg = NULL;
+    trigram_t *tg = NULL;
+    tginfo_t *tginfo, tmp;
+    int32 lw1, lw2, n_bg = 0, n_tg = 0, bowt1 = 0, bowt2 = 0;
+    int32 bg_start = 0, tg_start = 0, prev = -1;
+    int32 i, j;
+
+    lw2 = (n_hist > 0 && base->n > 1) ? history[0] : -1;
+    lw1 = (n_hist > 1 && base->n > 2 && lw2 >= 0) ? history[1] : -1;
+    if (lw2 >= 0) {
+        int32 b = FIRST_BG(model, lw2);
+        n_bg = FIRST_BG(model, lw2 + 1) - b;
+        bg = model->lm3g.bigrams + b;
+        bowt1 = model->lm3g.unigrams[lw2].bo_wt1.l;
+    }
+    if (lw1 >= 0) {
+        tginfo = find_tginfo(model, lw1, lw2, &tmp);
+        tg = tginfo->tg;
+        n_tg = tginfo->n_tg;
+        bowt2 = tginfo->bowt;
+    }
+
+    for (i = 0; i < n_wids; ++i) {
+        int32 wid = wids[i];
+
+        if (wid < 0) {
+            out_scores[i] = base->log_zero;
+            continue;
+        }
+        if (wid <= prev)
+            bg_start = tg_start = 0;
+        prev = wid;
+        if (tg && (j = find_tg(tg + tg_start, n_tg - tg_start, wid)) >= 0) {
+            tg_start += j + 1;
+            out_scores[i] = model->lm3g.prob3[tg[tg_start - 1].prob3].l;
+        }
+        else if (bg && (j = find_bg(bg + bg_start, n_bg - bg_start, wid)) >= 0) {
+            bg_start += j + 1;
+            out_scores[i] = bowt2
+                + model->lm3g.prob2[bg[bg_start - 1].prob2].l;
+        }
+        else
+            out_scores[i] = bowt2 + bowt1
+                + model->lm3g.unigrams[wid].prob1.l;
+    }
+}
+
 static int32
 lm3g_template_raw_score(ngram_model_t *base, int32 wid,
                         int32 *history, int32 n_hist,
@@ -311,28 +396,10 @@ lm3g_template_iter(ngram_model_t *base, int32 wid,
     }
     else if (n_hist == 2) {
         int32 i, n;
-        tginfo_t *tginfo, *prev_tginfo;
-        /* Find the trigram, as in tg_score above (duplicate code...) */
+        tginfo_t *tginfo, tmp;
+        /* Find the trigram, as in tg_score above */
         itor->ug = model->lm3g.unigrams + history[1];
-        prev_tginfo = NULL;
-        for (tginfo = model->lm3g.tginfo[history[0]];
-             tginfo; tginfo = tginfo->next) {
-            if (tginfo->w1 == history[1])
-                break;
-            prev_tginfo = tginfo;
-        }
-
-        if (!tginfo) {
-            load_tginfo(model, history[1], history[0]);
-            tginfo = model->lm3g.tginfo[history[0]];
-        }
-        else if (prev_tginfo) {
-            prev_tginfo->next = tginfo->next;
-            tginfo->next = model->lm3g.tginfo[history[0]];
-            model->lm3g.tginfo[history[0]] = tginfo;
-        }
-
-        tginfo->used = 1;
+        tginfo = find_tginfo(model, history[1], history[0], &tmp);
 
         /* Trigrams for w1,w2 now pointed to by tginfo */
         n = tginfo->n_tg;
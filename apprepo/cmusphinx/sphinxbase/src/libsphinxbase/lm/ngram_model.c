@@ -90,6 +90,8 @@ ngram_file_name_to_type(const char *file_name)
          return NGRAM_ARPA;
      if (0 == strncmp_nocase(ext, ".DMP", 4))
          return NGRAM_DMP;
+     if (0 == strncmp_nocase(ext, ".BIN", 4))
+         return NGRAM_BIN;
      return NGRAM_INVALID;
  }
 
@@ -100,6 +102,8 @@ ngram_str_to_type(const char *str_name)
         return NGRAM_ARPA;
     if (0 == strcmp_nocase(str_name, "dmp"))
         return NGRAM_DMP;
+    if (0 == strcmp_nocase(str_name, "bin"))
+        return NGRAM_BIN;
     return NGRAM_INVALID;
 }
 
@@ -111,6 +115,8 @@ ngram_type_to_str(int type)
         return "arpa";
     case NGRAM_DMP:
         return "dmp";
+    case NGRAM_BIN:
+        return "bin";
     default:
         return NULL;
     }
@@ -127,6 +133,13 @@ ngram_type_to_str(int type)
 
      switch (file_type) {
      case NGRAM_AUTO: {
+         /* Only try the trie reader on trie files, so that text and
+          * DMP files are read without errors. */
+         if (ngram_model_trie_probe(file_name)) {
+             if ((model = ngram_model_trie_read(config, file_name, lmath)) != NULL)
+                 break;
+             return NULL;
+         }
          if ((model = ngram_model_arpa_read(config, file_name, lmath)) != NULL)
              break;
          if ((model = ngram_model_dmp_read(config, file_name, lmath)) != NULL)
@@ -139,6 +152,9 @@ ngram_type_to_str(int type)
      case NGRAM_DMP:
          model = ngram_model_dmp_read(config, file_name, lmath);
          break;
+     case NGRAM_BIN:
+         model = ngram_model_trie_read(config, file_name, lmath);
+         break;
      default:
          E_ERROR("language model file type not supported\n");
          return NULL;
@@ -179,6 +195,8 @@ ngram_type_to_str(int type)
          return ngram_model_arpa_write(model, file_name);
      case NGRAM_DMP:
          return ngram_model_dmp_write(model, file_name);
+     case NGRAM_BIN:
+         return ngram_model_trie_write(model, file_name);
      default:
          E_ERROR("language model file type not supported\n");
          return -1;
@@ -198,7 +216,7 @@ ngram_type_to_str(int type)
      base->n = n;
      /* If this was previously initialized... */
     if (base->n_counts == NULL)
-        base->n_counts = ckd_calloc(3, sizeof(*base->n_counts));
+        base->n_counts = ckd_calloc(n > 3 ? n : 3, sizeof(*base->n_counts));
     /* Don't reset weights if logmath object hasn't changed. */
     if (base->lmath != lmath) {
         /* Set default values for weights. */
@@ -246,6 +264,9 @@ ngram_model_retain(ngram_model_t *model)
 void
 ngram_model_flush(ngram_model_t *model)
 {
+    /* Nothing is cached in shared models. */
+    if (model->flags & NGRAM_MODEL_SHARED)
+        return;
     if (model->funcs && model->funcs->flush)
         (*model->funcs->flush)(model);
 }
@@ -520,6 +541,25 @@ ngram_ng_score(ngram_model_t *model, int32 wid, int32 *history,
     return score + class_weight;
 }
 
+void
+ngram_ng_score_batch(ngram_model_t *model,
+                     int32 const *wids, int32 n_wids,
+                     int32 *history, int32 n_hist,
+                     int32 *out_scores)
+{
+    int32 i, n_used;
+
+    /* Class words have their own weights, score them one at a time. */
+    if (model->n_classes > 0 || model->funcs->score_batch == NULL) {
+        for (i = 0; i < n_wids; ++i)
+            out_scores[i] = ngram_ng_score(model, wids[i],
+                                           history, n_hist, &n_used);
+        return;
+    }
+    (*model->funcs->score_batch)(model, wids, n_wids,
+                                 history, n_hist, out_scores);
+}
+
 int32
 ngram_score(ngram_model_t *model, const char *word, ...)
 {
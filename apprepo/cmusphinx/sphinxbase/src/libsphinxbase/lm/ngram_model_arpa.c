@@ -93,6 +93,11 @@ ReadNgramCounts(lineiter_t **li, int32 * n_ug, int32 * n_bg, int32 * n_tg)
             *n_tg = ngram_cnt;
             break;
         default:
+            if (ngram > 3) {
+                /* Orders above trigrams go in a trie. */
+                E_INFO("Found %d-grams, reading as a trie\n", ngram);
+                return -2;
+            }
             E_ERROR("Unknown ngram (%d)\n", ngram);
             return -1;
         }
@@ -469,9 +474,11 @@ ngram_model_arpa_read(cmd_ln_t *config,
     li = lineiter_start(fp);
  
     /* Read #unigrams, #bigrams, #trigrams from file */
-    if (ReadNgramCounts(&li, &n_unigram, &n_bigram, &n_trigram) == -1) {
+    if ((n = ReadNgramCounts(&li, &n_unigram, &n_bigram, &n_trigram)) < 0) {
         lineiter_free(li);
         fclose_comp(fp, is_pipe);
+        if (n == -2)
+            return ngram_model_trie_read_arpa(config, file_name, lmath);
         return NULL;
     }
     E_INFO("ngrams 1=%d, 2=%d, 3=%d\n", n_unigram, n_bigram, n_trigram);
@@ -655,5 +662,6 @@ static ngram_funcs_t ngram_model_arpa_funcs = {
     lm3g_template_successors,       /* successors */
     lm3g_template_iter_get,         /* iter_get */
     lm3g_template_iter_next,        /* iter_next */
-    lm3g_template_iter_free         /* iter_free */
+    lm3g_template_iter_free,        /* iter_free */
+    lm3g_template_score_batch       /* score_batch */
 };
@@ -882,6 +882,11 @@ ngram_model_dmp_write(ngram_model_t *base,
     ngram_model_t *newbase;
     FILE *fh;
 
+    if (base->n > 3) {
+        E_ERROR("DMP files hold at most trigrams, not %d-grams\n", base->n);
+        return -1;
+    }
+
     /* First, construct a DMP model from the base model. */
     model = ngram_model_dmp_build(base);
     newbase = &model->base;
@@ -968,5 +973,6 @@ static ngram_funcs_t ngram_model_dmp_funcs = {
     lm3g_template_successors,      /* successors */
     lm3g_template_iter_get,        /* iter_get */
     lm3g_template_iter_next,       /* iter_next */
-    lm3g_template_iter_free        /* iter_free */
+    lm3g_template_iter_free,       /* iter_free */
+    lm3g_template_score_batch      /* score_batch */
 };
@@ -63,6 +63,8 @@ struct ngram_model_s {
     uint8 writable;     /**< Are word strings writable? */
     uint8 flags;        /**< Any other flags we might care about
                              (FIXME: Merge this and writable) */
+    uint8 n_share;      /**< Number of model sets sharing this model
+                             between threads (see NGRAM_MODEL_SHARED) */
     logmath_t *lmath;   /**< Log-math object */
     float32 lw;         /**< Language model scaling factor */
     int32 log_wip;      /**< Log of word insertion penalty */
@@ -106,6 +108,14 @@ struct ngram_class_s {
 
 #define UG_ALLOC_STEP 10
 
+/**
+ * Value of ngram_model_t::flags for a model scored by several threads
+ * at once.  Nothing is cached in it while scoring, and
+ * ngram_model_flush() does nothing.  It is set for as long as
+ * ngram_model_t::n_share is non-zero, see ngram_model_set_share().
+ */
+#define NGRAM_MODEL_SHARED 0x01
+
 /** Implementation-specific functions for operating on ngram_model_t objects */
 typedef struct ngram_funcs_s {
     /**
@@ -185,6 +195,15 @@ typedef struct ngram_funcs_s {
      * Implementation-specific function for iterating.
      */
     void (*iter_free)(ngram_iter_t *itor);
+
+    /**
+     * Implementation-specific function for scoring several words with
+     * the same history (optional).  Class words have been removed.
+     */
+    void (*score_batch)(ngram_model_t *model,
+                        int32 const *wids, int32 n_wids,
+                        int32 *history, int32 n_hist,
+                        int32 *out_scores);
 } ngram_funcs_t;
 
 /**
@@ -233,6 +252,23 @@ ngram_model_t *ngram_model_dmp_read(cmd_ln_t *config,
 ngram_model_t *ngram_model_dmp32_read(cmd_ln_t *config,
 				     const char *file_name,
 				     logmath_t *lmath);
+/**
+ * Check whether a file is a binary trie file, without reporting
+ * errors if it is not.
+ */
+int ngram_model_trie_probe(const char *file_name);
+/**
+ * Read an N-Gram model from a binary trie file.
+ */
+ngram_model_t *ngram_model_trie_read(cmd_ln_t *config,
+				     const char *file_name,
+				     logmath_t *lmath);
+/**
+ * Read an ARPABO text file of any order into a trie model.
+ */
+ngram_model_t *ngram_model_trie_read_arpa(cmd_ln_t *config,
+					  const char *file_name,
+					  logmath_t *lmath);
 
 /**
  * Write an N-Gram model to an ARPABO text file.
@@ -244,6 +280,11 @@ int ngram_model_arpa_write(ngram_model_t *model,
  */
 int ngram_model_dmp_write(ngram_model_t *model,
 			  const char *file_name);
+/**
+ * Write an N-Gram model to a binary trie file.
+ */
+int ngram_model_trie_write(ngram_model_t *model,
+			   const char *file_name);
 
 /**
  * Read a probdef file.
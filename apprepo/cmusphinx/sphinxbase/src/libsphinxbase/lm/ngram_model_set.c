@@ -357,6 +357,66 @@ error_out:
     return set;
 }
 
+ngram_model_t *
+ngram_model_set_dup(ngram_model_t *base)
+{
+    ngram_model_set_t *set = (ngram_model_set_t *)base;
+    ngram_model_set_t *dup;
+    ngram_model_t **lms;
+    int32 i;
+
+    lms = ckd_calloc(set->n_models, sizeof(*lms));
+    for (i = 0; i < set->n_models; ++i)
+        lms[i] = ngram_model_retain(set->lms[i]);
+    dup = (ngram_model_set_t *)
+        ngram_model_set_init(NULL, lms, set->names, NULL, set->n_models);
+    if (dup == NULL) {
+        for (i = 0; i < set->n_models; ++i)
+            ngram_model_free(lms[i]);
+        ckd_free(lms);
+        return NULL;
+    }
+    ckd_free(lms);
+
+    dup->cur = set->cur;
+    memcpy(dup->lweights, set->lweights,
+           set->n_models * sizeof(*set->lweights));
+    ngram_model_set_map_words(&dup->base, (const char **)base->word_str,
+                              base->n_words);
+    return &dup->base;
+}
+
+/*
+ * Several sets may share the same models, so they only cache again
+ * once none of them is shared any more.
+ */
+static void
+share_model(ngram_model_t *lm, int share)
+{
+    if (share)
+        ++lm->n_share;
+    else
+        --lm->n_share;
+    if (lm->n_share)
+        lm->flags |= NGRAM_MODEL_SHARED;
+    else
+        lm->flags &= ~NGRAM_MODEL_SHARED;
+}
+
+void
+ngram_model_set_share(ngram_model_t *base, int share)
+{
+    ngram_model_set_t *set = (ngram_model_set_t *)base;
+    int32 i;
+
+    share = (share != 0);
+    if (set->shared == share)
+        return;
+    set->shared = share;
+    for (i = 0; i < set->n_models; ++i)
+        share_model(set->lms[i], share);
+}
+
 int32
 ngram_model_set_count(ngram_model_t *base)
 {
@@ -532,6 +592,8 @@ ngram_model_set_add(ngram_model_t *base,
     ++set->n_models;
     set->lms = ckd_realloc(set->lms, set->n_models * sizeof(*set->lms));
     set->lms[set->n_models - 1] = model;
+    if (set->shared)
+        share_model(model, TRUE);
     set->names = ckd_realloc(set->names, set->n_models * sizeof(*set->names));
     set->names[set->n_models - 1] = ckd_salloc(name);
     /* Expand the history mapping table if necessary. */
@@ -592,6 +654,8 @@ ngram_model_set_remove(ngram_model_t *base,
     if (lmidx == set->n_models)
         return NULL;
     submodel = set->lms[lmidx];
+    if (set->shared)
+        share_model(submodel, FALSE);
 
     /* Renormalize the interpolation weights by scaling them by
      * 1/(1-fprob) */
@@ -727,6 +791,48 @@ ngram_model_set_score(ngram_model_t *base, int32 wid,
     return score;
 }
 
+static void
+ngram_model_set_score_batch(ngram_model_t *base,
+                            int32 const *wids, int32 n_wids,
+                            int32 *history, int32 n_hist,
+                            int32 *out_scores)
+{
+    ngram_model_set_t *set = (ngram_model_set_t *)base;
+    int32 mapwids[256];
+    int32 i, j, n;
+
+    /* Truncate the history. */
+    if (n_hist > base->n - 1)
+        n_hist = base->n - 1;
+
+    /* Interpolated scores are done one word at a time. */
+    if (set->cur == -1) {
+        for (i = 0; i < n_wids; ++i) {
+            int32 n_used;
+            out_scores[i] = ngram_model_set_score(base, wids[i],
+                                                  history, n_hist, &n_used);
+        }
+        return;
+    }
+
+    for (j = 0; j < n_hist; ++j) {
+        if (history[j] == NGRAM_INVALID_WID)
+            set->maphist[j] = NGRAM_INVALID_WID;
+        else
+            set->maphist[j] = set->widmap[history[j]][set->cur];
+    }
+    for (i = 0; i < n_wids; i += n) {
+        n = n_wids - i;
+        if (n > (int32)(sizeof(mapwids) / sizeof(mapwids[0])))
+            n = sizeof(mapwids) / sizeof(mapwids[0]);
+        for (j = 0; j < n; ++j)
+            mapwids[j] = (wids[i + j] == NGRAM_INVALID_WID)
+                ? NGRAM_INVALID_WID : set->widmap[wids[i + j]][set->cur];
+        ngram_ng_score_batch(set->lms[set->cur], mapwids, n,
+                             set->maphist, n_hist, out_scores + i);
+    }
+}
+
 static int32
 ngram_model_set_raw_score(ngram_model_t *base, int32 wid,
                           int32 *history, int32 n_hist,
@@ -839,6 +945,7 @@ ngram_model_set_free(ngram_model_t *base)
     ngram_model_set_t *set = (ngram_model_set_t *)base;
     int32 i;
 
+    ngram_model_set_share(base, FALSE);
     for (i = 0; i < set->n_models; ++i)
         ngram_model_free(set->lms[i]);
     ckd_free(set->lms);
@@ -866,5 +973,12 @@ static ngram_funcs_t ngram_model_set_funcs = {
     ngram_model_set_score,         /* score */
     ngram_model_set_raw_score,     /* raw_score */
     ngram_model_set_add_ug,        /* add_ug */
-    ngram_model_set_flush          /* flush */
+    ngram_model_set_flush,         /* flush */
+    NULL,                          /* iter */
+    NULL,                          /* mgrams */
+    NULL,                          /* successors */
+    NULL,                          /* iter_get */
+    NULL,                          /* iter_next */
+    NULL,                          /* iter_free */
+    ngram_model_set_score_batch    /* score_batch */
 };
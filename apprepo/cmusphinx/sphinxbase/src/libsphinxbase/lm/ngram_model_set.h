@@ -58,6 +58,7 @@ typedef struct ngram_model_set_s {
     int32 *lweights;     /**< Log interpolation weights. */
     int32 **widmap;      /**< Word ID mapping for submodels. */
     int32 *maphist;      /**< Word ID mapping for N-Gram history. */
+    uint8 shared;        /**< Are the models marked as shared by this set? */
 } ngram_model_set_t;
 
 /**
@@ -0,0 +1,1435 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 1999-2007 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/*
+ * \file ngram_model_trie.c Sorted array trie language models
+ *
+ * N-Grams of any order are kept in one sorted array per order, with
+ * bit-packed word IDs and quantized probabilities and backoff weights.
+ * The successors of an N-Gram are a contiguous range of the next
+ * order, found by binary search.  The binary file holds the arrays as
+ * they are used, so that they can be memory-mapped.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
+
+#include "sphinxbase/ckd_alloc.h"
+#include "sphinxbase/err.h"
+#include "sphinxbase/pio.h"
+#include "sphinxbase/strfuncs.h"
+
+#include "ngram_model_trie.h"
+
+static ngram_funcs_t ngram_model_trie_funcs;
+
+static const char trie_hdr[8] = { 'S', 'B', 'L', 'M', 'T', 'R', 'I', 'E' };
+#define TRIE_VERSION 1
+#define TRIE_BYTEORDER 0x11223344
+
+/** Largest width of a quantized probability or backoff weight. */
+#define TRIE_MAX_QUANT_BITS 16
+
+/** Fields are read 64 bits at a time, so this is added to packed arrays. */
+#define TRIE_PADDING 8
+
+#ifdef WORDS_BIGENDIAN
+static uint64
+bits_swap(uint64 v)
+{
+    uint64 out = 0;
+    int i;
+
+    for (i = 0; i < 8; ++i) {
+        out = (out << 8) | (v & 0xff);
+        v >>= 8;
+    }
+    return out;
+}
+#endif
+
+static uint32
+bits_read(uint8 const *bits, uint64 pos, int32 width)
+{
+    uint64 v;
+
+    memcpy(&v, bits + (pos >> 3), sizeof(v));
+#ifdef WORDS_BIGENDIAN
+    v = bits_swap(v);
+#endif
+    return (uint32)((v >> (pos & 7)) & ((((uint64)1) << width) - 1));
+}
+
+static void
+bits_write(uint8 *bits, uint64 pos, int32 width, uint32 val)
+{
+    uint64 v, mask;
+
+    mask = ((((uint64)1) << width) - 1) << (pos & 7);
+    memcpy(&v, bits + (pos >> 3), sizeof(v));
+#ifdef WORDS_BIGENDIAN
+    v = bits_swap(v);
+#endif
+    v = (v & ~mask) | (((uint64)val << (pos & 7)) & mask);
+#ifdef WORDS_BIGENDIAN
+    v = bits_swap(v);
+#endif
+    memcpy(bits + (pos >> 3), &v, sizeof(v));
+}
+
+/* Number of bits needed for values up to max_val. */
+static int32
+bits_needed(int32 max_val)
+{
+    int32 bits = 0;
+
+    while (bits < 31 && (max_val >> bits) != 0)
+        ++bits;
+    return bits;
+}
+
+static int32
+trie_wid(ngram_model_trie_t *model, int32 m, int32 i)
+{
+    trie_level_t *lev = &model->levels[m];
+
+    return bits_read(lev->bits, (uint64)i * lev->entry_bits,
+                     model->wid_bits);
+}
+
+static int32
+trie_prob(ngram_model_trie_t *model, int32 m, int32 i)
+{
+    trie_level_t *lev = &model->levels[m];
+
+    return lev->prob.vals[bits_read(lev->bits,
+                                    (uint64)i * lev->entry_bits
+                                    + model->wid_bits, lev->prob.bits)];
+}
+
+static int32
+trie_bowt(ngram_model_trie_t *model, int32 m, int32 i)
+{
+    trie_level_t *lev;
+
+    if (m == 0)
+        return model->unigrams[i].bo_wt1;
+    lev = &model->levels[m];
+    return lev->bowt.vals[bits_read(lev->bits,
+                                    (uint64)i * lev->entry_bits
+                                    + model->wid_bits + lev->prob.bits,
+                                    lev->bowt.bits)];
+}
+
+/* Index of the first successor of entry i of order m. */
+static int32
+trie_first(ngram_model_trie_t *model, int32 m, int32 i)
+{
+    trie_level_t *lev;
+
+    if (m == 0)
+        return model->unigrams[i].next;
+    lev = &model->levels[m];
+    return bits_read(lev->bits, (uint64)i * lev->entry_bits
+                     + model->wid_bits + lev->prob.bits + lev->bowt.bits,
+                     lev->next_bits);
+}
+
+/* Find word wid among entries b to e of order m. */
+static int32
+trie_find(ngram_model_trie_t *model, int32 m, int32 b, int32 e, int32 wid)
+{
+    while (b < e) {
+        int32 i = b + ((e - b) >> 1);
+        int32 w = trie_wid(model, m, i);
+
+        if (w < wid)
+            b = i + 1;
+        else if (w > wid)
+            e = i;
+        else
+            return i;
+    }
+    return -1;
+}
+
+/* Find the successor wid of entry i of order m. */
+static int32
+trie_find_successor(ngram_model_trie_t *model, int32 m, int32 i, int32 wid)
+{
+    return trie_find(model, m + 1, trie_first(model, m, i),
+                     trie_first(model, m, i + 1), wid);
+}
+
+/*
+ * Find the entry for the k most recent words of a history (most
+ * recent first) in order k - 1.
+ */
+static int32
+trie_context(ngram_model_trie_t *model, int32 *history, int32 k)
+{
+    int32 m, i;
+
+    i = history[k - 1];
+    for (m = 1; m < k && i >= 0; ++m)
+        i = trie_find_successor(model, m - 1, i, history[k - 1 - m]);
+    return i;
+}
+
+/* Find the entry of order m whose successors include entry i. */
+static int32
+trie_parent(ngram_model_trie_t *model, int32 m, int32 i)
+{
+    int32 b = 0, e = model->base.n_counts[m];
+
+    while (e - b > 1) {
+        int32 mid = b + ((e - b) >> 1);
+
+        if (trie_first(model, m, mid) <= i)
+            b = mid;
+        else
+            e = mid;
+    }
+    return b;
+}
+
+static int32
+ngram_model_trie_score(ngram_model_t *base, int32 wid,
+                       int32 *history, int32 n_hist,
+                       int32 *n_used)
+{
+    ngram_model_trie_t *model = (ngram_model_trie_t *)base;
+    int32 backoff = 0;
+    int32 i, j, k;
+
+    if (n_hist > base->n - 1)
+        n_hist = base->n - 1;
+    for (k = 0; k < n_hist; ++k)
+        if (history[k] < 0)
+            break;
+
+    /* Back off from the longest history. */
+    for (; k > 0; --k) {
+        if ((j = trie_context(model, history, k)) < 0)
+            continue;
+        if ((i = trie_find_successor(model, k - 1, j, wid)) >= 0) {
+            *n_used = k + 1;
+            return backoff + trie_prob(model, k, i);
+        }
+        backoff += trie_bowt(model, k - 1, j);
+    }
+    *n_used = 1;
+    return backoff + model->unigrams[wid].prob1;
+}
+
+static void
+ngram_model_trie_score_batch(ngram_model_t *base,
+                             int32 const *wids, int32 n_wids,
+                             int32 *history, int32 n_hist,
+                             int32 *out_scores)
+{
+    ngram_model_trie_t *model = (ngram_model_trie_t *)base;
+    int32 *ctx, *backoff;
+    int32 i, k, n_ctx;
+
+    if (n_hist > base->n - 1)
+        n_hist = base->n - 1;
+    for (n_ctx = 0; n_ctx < n_hist; ++n_ctx)
+        if (history[n_ctx] < 0)
+            break;
+
+    /* Find the contexts and their backoff weights once. */
+    ctx = ckd_calloc(n_ctx + 1, sizeof(*ctx));
+    backoff = ckd_calloc(n_ctx + 1, sizeof(*backoff));
+    for (k = n_ctx; k > 0; --k) {
+        ctx[k] = trie_context(model, history, k);
+        backoff[k - 1] = backoff[k];
+        if (ctx[k] >= 0)
+            backoff[k - 1] += trie_bowt(model, k - 1, ctx[k]);
+    }
+
+    for (i = 0; i < n_wids; ++i) {
+        int32 wid = wids[i], j = -1;
+
+        if (wid < 0) {
+            out_scores[i] = base->log_zero;
+            continue;
+        }
+        for (k = n_ctx; k > 0; --k) {
+            if (ctx[k] >= 0
+                && (j = trie_find_successor(model, k - 1, ctx[k], wid)) >= 0)
+                break;
+        }
+        if (k > 0)
+            out_scores[i] = backoff[k] + trie_prob(model, k, j);
+        else
+            out_scores[i] = backoff[0] + model->unigrams[wid].prob1;
+    }
+    ckd_free(ctx);
+    ckd_free(backoff);
+}
+
+static int32
+ngram_model_trie_raw_score(ngram_model_t *base, int32 wid,
+                           int32 *history, int32 n_hist,
+                           int32 *n_used)
+{
+    ngram_model_trie_t *model = (ngram_model_trie_t *)base;
+    int32 score;
+
+    if (n_hist == 0) {
+        /* Access mode: unigram */
+        *n_used = 1;
+        /* Undo insertion penalty. */
+        score = model->unigrams[wid].prob1 - base->log_wip;
+        /* Undo language weight. */
+        score = (int32)(score / base->lw);
+        /* Undo unigram interpolation */
+        if (strcmp(base->word_str[wid], "<s>") != 0) { /* FIXME: configurable start_sym */
+            score = logmath_log(base->lmath,
+                                logmath_exp(base->lmath, score)
+                                - logmath_exp(base->lmath,
+                                              base->log_uniform + base->log_uniform_weight));
+        }
+        return score;
+    }
+    score = ngram_model_trie_score(base, wid, history, n_hist, n_used);
+    /* FIXME (maybe): This doesn't undo unigram weighting in backoff cases. */
+    return (int32)((score - base->log_wip) / base->lw);
+}
+
+static int
+ngram_model_trie_apply_weights(ngram_model_t *base, float32 lw,
+                               float32 wip, float32 uw)
+{
+    ngram_model_trie_t *model = (ngram_model_trie_t *)base;
+    int32 log_wip, log_uw, log_uniform_weight;
+    int32 i, m;
+
+    /* Same as lm3g_apply_weights(), on the quantization tables. */
+    log_wip = logmath_log(base->lmath, wip);
+    log_uw = logmath_log(base->lmath, uw);
+    log_uniform_weight = logmath_log(base->lmath, 1.0 - uw);
+
+    for (i = 0; i < base->n_counts[0]; ++i) {
+        int32 prob1, bo_wt, n_used;
+
+        bo_wt = (int32)(model->unigrams[i].bo_wt1 / base->lw);
+        prob1 = ngram_ng_prob(base, i, NULL, 0, &n_used);
+        model->unigrams[i].bo_wt1 = (int32)(bo_wt * lw);
+        if (strcmp(base->word_str[i], "<s>") != 0) { /* FIXME: configurable start_sym */
+            prob1 += log_uw;
+            prob1 = logmath_add(base->lmath, prob1,
+                                base->log_uniform + log_uniform_weight);
+        }
+        model->unigrams[i].prob1 = (int32)(prob1 * lw) + log_wip;
+    }
+
+    for (m = 1; m < base->n; ++m) {
+        trie_level_t *lev = &model->levels[m];
+
+        for (i = 0; i < lev->prob.n_vals; ++i) {
+            int32 prob = (int32)((lev->prob.vals[i] - base->log_wip) / base->lw);
+            lev->prob.vals[i] = (int32)(prob * lw) + log_wip;
+        }
+        for (i = 0; i < lev->bowt.n_vals; ++i)
+            lev->bowt.vals[i] = (int32)(lev->bowt.vals[i] / base->lw * lw);
+    }
+
+    base->log_wip = log_wip;
+    base->log_uw = log_uw;
+    base->log_uniform_weight = log_uniform_weight;
+    base->lw = lw;
+    return 0;
+}
+
+static int32
+ngram_model_trie_add_ug(ngram_model_t *base, int32 wid, int32 lweight)
+{
+    ngram_model_trie_t *model = (ngram_model_trie_t *)base;
+    int32 score, next, i;
+
+    /* New words have no successors. */
+    next = model->unigrams[base->n_counts[0]].next;
+    model->unigrams = ckd_realloc(model->unigrams,
+                                  (base->n_1g_alloc + 1)
+                                  * sizeof(*model->unigrams));
+    for (i = base->n_counts[0]; i <= base->n_1g_alloc; ++i) {
+        model->unigrams[i].prob1 = base->log_zero;
+        model->unigrams[i].bo_wt1 = 0;
+        model->unigrams[i].next = next;
+    }
+    /* Same as lm3g_add_ug(). */
+    score = lweight + base->log_uniform + base->log_uw;
+    score = logmath_add(base->lmath, score,
+                        base->log_uniform + base->log_uniform_weight);
+    model->unigrams[wid].prob1 = score;
+    ++base->n_counts[0];
+    if (wid >= base->n_counts[0])
+        base->n_counts[0] = wid + 1;
+
+    return score;
+}
+
+typedef struct trie_iter_s {
+    ngram_iter_t base;
+    int32 *idx;         /**< Entry for each word, by order. */
+} trie_iter_t;
+
+static trie_iter_t *
+trie_iter_new(ngram_model_trie_t *model, int m, int successor)
+{
+    trie_iter_t *itor = ckd_calloc(1, sizeof(*itor));
+
+    ngram_iter_init((ngram_iter_t *)itor, &model->base, m, successor);
+    itor->idx = ckd_calloc(model->base.n, sizeof(*itor->idx));
+    return itor;
+}
+
+static ngram_iter_t *
+ngram_model_trie_iter(ngram_model_t *base, int32 wid,
+                      int32 *history, int32 n_hist)
+{
+    ngram_model_trie_t *model = (ngram_model_trie_t *)base;
+    trie_iter_t *itor;
+    int32 m;
+
+    if (wid < 0 || wid >= base->n_counts[0])
+        return NULL;
+    itor = trie_iter_new(model, n_hist, FALSE);
+    for (m = 0; m <= n_hist; ++m) {
+        int32 w = (m == n_hist) ? wid : history[n_hist - 1 - m];
+
+        if (m == 0)
+            itor->idx[0] = (w >= 0 && w < base->n_counts[0]) ? w : -1;
+        else
+            itor->idx[m] = trie_find_successor(model, m - 1,
+                                               itor->idx[m - 1], w);
+        if (itor->idx[m] < 0) {
+            ngram_iter_free((ngram_iter_t *)itor);
+            return NULL;
+        }
+    }
+    return (ngram_iter_t *)itor;
+}
+
+static ngram_iter_t *
+ngram_model_trie_mgrams(ngram_model_t *base, int m)
+{
+    ngram_model_trie_t *model = (ngram_model_trie_t *)base;
+    trie_iter_t *itor;
+    int32 j;
+
+    if (base->n_counts[m] == 0)
+        return NULL;
+    itor = trie_iter_new(model, m, FALSE);
+    for (j = m; j > 0; --j)
+        itor->idx[j - 1] = trie_parent(model, j - 1, itor->idx[j]);
+    return (ngram_iter_t *)itor;
+}
+
+static ngram_iter_t *
+ngram_model_trie_successors(ngram_iter_t *bitor)
+{
+    ngram_model_trie_t *model = (ngram_model_trie_t *)bitor->model;
+    trie_iter_t *from = (trie_iter_t *)bitor;
+    trie_iter_t *itor;
+    int32 m = bitor->m, b;
+
+    b = trie_first(model, m, from->idx[m]);
+    if (b == trie_first(model, m, from->idx[m] + 1))
+        return NULL;
+    itor = trie_iter_new(model, m + 1, TRUE);
+    memcpy(itor->idx, from->idx, (m + 1) * sizeof(*itor->idx));
+    itor->idx[m + 1] = b;
+    return (ngram_iter_t *)itor;
+}
+
+static int32 const *
+ngram_model_trie_iter_get(ngram_iter_t *base,
+                          int32 *out_score, int32 *out_bowt)
+{
+    ngram_model_trie_t *model = (ngram_model_trie_t *)base->model;
+    trie_iter_t *itor = (trie_iter_t *)base;
+    int32 j, m = base->m;
+
+    base->wids[0] = itor->idx[0];
+    for (j = 1; j <= m; ++j)
+        base->wids[j] = trie_wid(model, j, itor->idx[j]);
+    if (m == 0) {
+        *out_score = model->unigrams[itor->idx[0]].prob1;
+        *out_bowt = model->unigrams[itor->idx[0]].bo_wt1;
+    }
+    else {
+        *out_score = trie_prob(model, m, itor->idx[m]);
+        *out_bowt = (m < model->base.n - 1) ? trie_bowt(model, m, itor->idx[m]) : 0;
+    }
+    return base->wids;
+}
+
+static ngram_iter_t *
+ngram_model_trie_iter_next(ngram_iter_t *base)
+{
+    ngram_model_trie_t *model = (ngram_model_trie_t *)base->model;
+    trie_iter_t *itor = (trie_iter_t *)base;
+    int32 j, m = base->m;
+
+    if (++itor->idx[m] >= model->base.n_counts[m])
+        goto done;
+    /* Move the parents along if needed. */
+    for (j = m; j > 0; --j) {
+        if (itor->idx[j] < trie_first(model, j - 1, itor->idx[j - 1] + 1))
+            break;
+        /* Successor iterators stop at the end of their parent. */
+        if (base->successor)
+            goto done;
+        itor->idx[j - 1] = trie_parent(model, j - 1, itor->idx[j]);
+    }
+    return base;
+done:
+    ngram_iter_free(base);
+    return NULL;
+}
+
+static void
+ngram_model_trie_iter_free(ngram_iter_t *base)
+{
+    trie_iter_t *itor = (trie_iter_t *)base;
+
+    ckd_free(itor->idx);
+    ckd_free(itor);
+}
+
+static void
+ngram_model_trie_free(ngram_model_t *base)
+{
+    ngram_model_trie_t *model = (ngram_model_trie_t *)base;
+    int32 m;
+
+    if (model->levels) {
+        for (m = 1; m < base->n; ++m) {
+            ckd_free(model->levels[m].prob.vals);
+            ckd_free(model->levels[m].bowt.vals);
+            if (model->trie_mmap == NULL)
+                ckd_free(model->levels[m].bits);
+        }
+    }
+    ckd_free(model->levels);
+    ckd_free(model->unigrams);
+    if (model->trie_mmap)
+        mmio_file_unmap(model->trie_mmap);
+}
+
+static int
+int32_cmp(const void *a, const void *b)
+{
+    int32 x = *(const int32 *)a, y = *(const int32 *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Build the table for n values taken every stride ints.  Distinct
+ * values are kept exactly if there are not too many of them,
+ * otherwise each level is the mean of an equal share of the values.
+ */
+static void
+trie_quant_init(trie_quant_t *q, int32 const *vals, int32 n, int32 stride)
+{
+    int32 *sorted;
+    int32 i, n_uniq;
+
+    sorted = ckd_calloc(n > 0 ? n : 1, sizeof(*sorted));
+    for (i = 0; i < n; ++i)
+        sorted[i] = vals[(size_t)i * stride];
+    qsort(sorted, n, sizeof(*sorted), int32_cmp);
+    for (n_uniq = 0, i = 0; i < n; ++i)
+        if (i == 0 || sorted[i] != sorted[i - 1])
+            ++n_uniq;
+
+    if (n_uniq <= (1 << TRIE_MAX_QUANT_BITS)) {
+        for (n_uniq = 0, i = 0; i < n; ++i)
+            if (i == 0 || sorted[i] != sorted[n_uniq - 1])
+                sorted[n_uniq++] = sorted[i];
+        q->vals = sorted;
+        q->n_vals = n_uniq;
+    }
+    else {
+        q->n_vals = 1 << TRIE_MAX_QUANT_BITS;
+        q->vals = ckd_calloc(q->n_vals, sizeof(*q->vals));
+        for (i = 0; i < q->n_vals; ++i) {
+            int32 b = (int32)((int64)n * i / q->n_vals);
+            int32 e = (int32)((int64)n * (i + 1) / q->n_vals);
+            int64 sum = 0;
+            int32 j;
+
+            for (j = b; j < e; ++j)
+                sum += sorted[j];
+            q->vals[i] = (int32)(sum / (e - b));
+        }
+        ckd_free(sorted);
+    }
+    q->bits = q->n_vals ? bits_needed(q->n_vals - 1) : 0;
+}
+
+/* Index of the closest value to val. */
+static int32
+trie_quant_index(trie_quant_t *q, int32 val)
+{
+    int32 b = 0, e = q->n_vals;
+
+    while (b < e) {
+        int32 i = b + ((e - b) >> 1);
+
+        if (q->vals[i] < val)
+            b = i + 1;
+        else
+            e = i;
+    }
+    if (b == q->n_vals)
+        return b - 1;
+    if (b > 0 && (int64)val - q->vals[b - 1] < (int64)q->vals[b] - val)
+        return b - 1;
+    return b;
+}
+
+/* Compare the first n words of two N-Grams. */
+static int
+gram_cmp(int32 const *a, int32 const *b, int32 n)
+{
+    int32 i;
+
+    for (i = 0; i < n; ++i)
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    return 0;
+}
+
+/*
+ * Sort n (m+1)-Grams by their words.  Each one is stored as m + 1
+ * word IDs, its probability and its backoff weight.
+ */
+static void
+grams_sort(int32 *grams, int32 n, int32 m)
+{
+    int32 width = m + 3;
+    int32 *src, *dst, *tmp;
+    int32 run, i;
+
+    for (i = 1; i < n; ++i)
+        if (gram_cmp(grams + (size_t)(i - 1) * width,
+                     grams + (size_t)i * width, m + 1) > 0)
+            break;
+    if (i >= n)
+        return;
+
+    /* Bottom-up merge sort. */
+    src = grams;
+    dst = tmp = ckd_calloc((size_t)n * width, sizeof(*tmp));
+    for (run = 1; run < n; run *= 2) {
+        int32 lo;
+
+        for (lo = 0; lo < n; lo += 2 * run) {
+            int32 a = lo, mid = lo + run < n ? lo + run : n;
+            int32 b = mid, hi = lo + 2 * run < n ? lo + 2 * run : n;
+            int32 *out = dst + (size_t)lo * width;
+
+            while (a < mid || b < hi) {
+                int32 *g;
+
+                if (b == hi || (a < mid
+                                && gram_cmp(src + (size_t)a * width,
+                                            src + (size_t)b * width,
+                                            m + 1) <= 0))
+                    g = src + (size_t)a++ * width;
+                else
+                    g = src + (size_t)b++ * width;
+                memcpy(out, g, width * sizeof(*g));
+                out += width;
+            }
+        }
+        tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    if (src != grams) {
+        memcpy(grams, src, (size_t)n * width * sizeof(*grams));
+        ckd_free(src);
+    }
+    else
+        ckd_free(dst);
+}
+
+/*
+ * Build the packed arrays from the unigrams already in the model and
+ * the N-Grams in grams[m] for order m + 1 (which get sorted).
+ */
+static int
+trie_build_levels(ngram_model_trie_t *model, int32 **grams)
+{
+    ngram_model_t *base = &model->base;
+    int32 **nexts;
+    int32 m, i, p, q;
+    int rv = -1;
+
+    model->levels = ckd_calloc(base->n, sizeof(*model->levels));
+    model->wid_bits = bits_needed(base->n_counts[0] - 1);
+    nexts = ckd_calloc(base->n, sizeof(*nexts));
+
+    /* Find the first successor of each N-Gram. */
+    for (m = 1; m < base->n; ++m) {
+        int32 width = m + 3;
+
+        grams_sort(grams[m], base->n_counts[m], m);
+        if (m > 1)
+            nexts[m - 1] = ckd_calloc(base->n_counts[m - 1] + 1,
+                                      sizeof(**nexts));
+        for (p = q = i = 0; i < base->n_counts[m]; ++i) {
+            int32 *g = grams[m] + (size_t)i * width;
+
+            if (m == 1) {
+                q = g[0];
+            }
+            else {
+                int32 pwidth = m + 2;
+
+                while (q < base->n_counts[m - 1]
+                       && gram_cmp(grams[m - 1] + (size_t)q * pwidth, g, m) < 0)
+                    ++q;
+                if (q == base->n_counts[m - 1]
+                    || gram_cmp(grams[m - 1] + (size_t)q * pwidth, g, m) != 0) {
+                    E_ERROR("Missing %d-gram for %d-gram %d of %d\n",
+                            m, m + 1, i, base->n_counts[m]);
+                    goto error_out;
+                }
+            }
+            while (p <= q) {
+                if (m == 1)
+                    model->unigrams[p++].next = i;
+                else
+                    nexts[m - 1][p++] = i;
+            }
+        }
+        while (p <= base->n_counts[m - 1]) {
+            if (m == 1)
+                model->unigrams[p++].next = base->n_counts[m];
+            else
+                nexts[m - 1][p++] = base->n_counts[m];
+        }
+    }
+
+    /* Now pack them. */
+    for (m = 1; m < base->n; ++m) {
+        trie_level_t *lev = &model->levels[m];
+        int32 width = m + 3;
+        int32 n_entries = base->n_counts[m];
+        uint64 n_bits;
+
+        trie_quant_init(&lev->prob, grams[m] + m + 1, base->n_counts[m], width);
+        if (m < base->n - 1) {
+            trie_quant_init(&lev->bowt, grams[m] + m + 2,
+                            base->n_counts[m], width);
+            lev->next_bits = bits_needed(base->n_counts[m + 1]);
+            ++n_entries;
+        }
+        lev->entry_bits = model->wid_bits + lev->prob.bits
+            + lev->bowt.bits + lev->next_bits;
+        n_bits = (uint64)n_entries * lev->entry_bits;
+        if (n_bits / 8 + TRIE_PADDING > INT_MAX) {
+            E_ERROR("Too many %d-grams\n", m + 1);
+            goto error_out;
+        }
+        lev->n_bytes = (int32)((n_bits + 7) / 8) + TRIE_PADDING;
+        lev->bits = ckd_calloc(lev->n_bytes, 1);
+
+        for (i = 0; i < n_entries; ++i) {
+            int32 *g = grams[m] + (size_t)i * width;
+            uint64 pos = (uint64)i * lev->entry_bits;
+
+            if (i < base->n_counts[m]) {
+                bits_write(lev->bits, pos, model->wid_bits, g[m]);
+                bits_write(lev->bits, pos + model->wid_bits, lev->prob.bits,
+                           trie_quant_index(&lev->prob, g[m + 1]));
+                if (lev->bowt.n_vals)
+                    bits_write(lev->bits,
+                               pos + model->wid_bits + lev->prob.bits,
+                               lev->bowt.bits,
+                               trie_quant_index(&lev->bowt, g[m + 2]));
+            }
+            if (m < base->n - 1)
+                bits_write(lev->bits, pos + model->wid_bits
+                           + lev->prob.bits + lev->bowt.bits,
+                           lev->next_bits, nexts[m][i]);
+        }
+        E_INFO("%8d = #%d-grams, %d bits each (%d bytes)\n",
+               base->n_counts[m], m + 1, lev->entry_bits, lev->n_bytes);
+    }
+    rv = 0;
+
+error_out:
+    for (m = 0; m < base->n; ++m)
+        ckd_free(nexts[m]);
+    ckd_free(nexts);
+    return rv;
+}
+
+static trie_unigram_t *
+new_unigram_table(int32 n_ug, int32 log_zero)
+{
+    trie_unigram_t *table;
+    int32 i;
+
+    table = ckd_calloc(n_ug, sizeof(*table));
+    for (i = 0; i < n_ug; ++i)
+        table[i].prob1 = log_zero;
+    return table;
+}
+
+ngram_model_trie_t *
+ngram_model_trie_build(ngram_model_t *base)
+{
+    ngram_model_trie_t *model;
+    ngram_model_t *newbase;
+    ngram_iter_t *itor;
+    int32 **grams;
+    int32 m, i;
+
+    if (base->funcs == &ngram_model_trie_funcs) {
+        E_INFO("Using existing trie model.\n");
+        return (ngram_model_trie_t *)ngram_model_retain(base);
+    }
+
+    E_INFO("Building trie model...\n");
+    model = ckd_calloc(1, sizeof(*model));
+    newbase = &model->base;
+    ngram_model_init(newbase, &ngram_model_trie_funcs, base->lmath,
+                     base->n, base->n_counts[0]);
+    memcpy(newbase->n_counts, base->n_counts,
+           base->n * sizeof(*base->n_counts));
+    newbase->writable = TRUE;
+
+    model->unigrams = new_unigram_table(newbase->n_counts[0] + 1,
+                                        newbase->log_zero);
+    for (itor = ngram_model_mgrams(base, 0); itor;
+         itor = ngram_iter_next(itor)) {
+        int32 const *wids;
+        int32 prob1, bo_wt1;
+
+        wids = ngram_iter_get(itor, &prob1, &bo_wt1);
+        model->unigrams[wids[0]].prob1 = prob1;
+        model->unigrams[wids[0]].bo_wt1 = bo_wt1;
+        newbase->word_str[wids[0]] = ckd_salloc(ngram_word(base, wids[0]));
+        if ((hash_table_enter_int32(newbase->wid,
+                                    newbase->word_str[wids[0]], wids[0]))
+            != wids[0]) {
+            E_WARN("Duplicate word in dictionary: %s\n",
+                   newbase->word_str[wids[0]]);
+        }
+    }
+
+    grams = ckd_calloc(base->n, sizeof(*grams));
+    for (m = 1; m < base->n; ++m) {
+        grams[m] = ckd_calloc((size_t)base->n_counts[m] * (m + 3),
+                              sizeof(**grams));
+        i = 0;
+        for (itor = ngram_model_mgrams(base, m); itor;
+             itor = ngram_iter_next(itor)) {
+            int32 const *wids;
+            int32 *g;
+
+            if (i == base->n_counts[m]) {
+                ngram_iter_free(itor);
+                break;
+            }
+            g = grams[m] + (size_t)i * (m + 3);
+            wids = ngram_iter_get(itor, &g[m + 1], &g[m + 2]);
+            memcpy(g, wids, (m + 1) * sizeof(*wids));
+            ++i;
+        }
+        newbase->n_counts[m] = i;
+    }
+    i = trie_build_levels(model, grams);
+    for (m = 0; m < base->n; ++m)
+        ckd_free(grams[m]);
+    ckd_free(grams);
+    if (i < 0) {
+        ngram_model_free(newbase);
+        return NULL;
+    }
+
+    /* Values are already weighted. */
+    newbase->lw = base->lw;
+    newbase->log_wip = base->log_wip;
+    newbase->log_uw = base->log_uw;
+    newbase->log_uniform = base->log_uniform;
+    newbase->log_uniform_weight = base->log_uniform_weight;
+    return model;
+}
+
+/*
+ * Read the N-Grams of order m + 1 from an ARPA file, following the
+ * header line, into grams.
+ */
+static int
+trie_read_arpa_grams(lineiter_t **li, ngram_model_trie_t *model,
+                     int32 m, int32 *grams)
+{
+    ngram_model_t *base = &model->base;
+    char **wptr;
+    int32 count = 0;
+    int rv = -1;
+
+    E_INFO("Reading %d-grams\n", m + 1);
+    wptr = ckd_calloc(m + 3, sizeof(*wptr));
+    while ((*li = lineiter_next(*li))) {
+        int32 *g = grams + (size_t)count * (m + 3);
+        float32 p, bo_wt = 0.0f;
+        int32 j, n;
+
+        string_trim((*li)->buf, STRING_BOTH);
+        if ((*li)->buf[0] == '\\')
+            break;
+        if ((n = str2words((*li)->buf, wptr, m + 3)) < m + 2) {
+            if ((*li)->buf[0] != '\0')
+                E_WARN("Format error; %d-gram ignored: %s\n", m + 1, (*li)->buf);
+            continue;
+        }
+        if (count >= base->n_counts[m]) {
+            E_ERROR("Too many %d-grams\n", m + 1);
+            goto error_out;
+        }
+        p = (float32)atof_c(wptr[0]);
+        if (n == m + 3)
+            bo_wt = (float32)atof_c(wptr[m + 2]);
+        for (j = 0; j <= m; ++j) {
+            if ((g[j] = ngram_wid(base, wptr[j + 1])) == NGRAM_INVALID_WID)
+                break;
+        }
+        if (j <= m) {
+            E_ERROR("Unknown word: %s, skipping %d-gram\n", wptr[j + 1], m + 1);
+            continue;
+        }
+        /* Quantize to 4 decimal digits, as ngram_model_arpa.c does. */
+        p = (float32)((int32)(p * 10000)) / 10000;
+        bo_wt = (float32)((int32)(bo_wt * 10000)) / 10000;
+        g[m + 1] = logmath_log10_to_log(base->lmath, p);
+        g[m + 2] = logmath_log10_to_log(base->lmath, bo_wt);
+        ++count;
+    }
+    if (*li == NULL) {
+        E_ERROR("Unexpected end of file while reading %d-grams\n", m + 1);
+        goto error_out;
+    }
+    if (count != base->n_counts[m]) {
+        E_WARN("%d %d-grams expected, %d read\n",
+               base->n_counts[m], m + 1, count);
+        base->n_counts[m] = count;
+    }
+    rv = 0;
+
+error_out:
+    ckd_free(wptr);
+    return rv;
+}
+
+ngram_model_t *
+ngram_model_trie_read_arpa(cmd_ln_t *config,
+                           const char *file_name,
+                           logmath_t *lmath)
+{
+    ngram_model_trie_t *model = NULL;
+    ngram_model_t *base;
+    lineiter_t *li;
+    FILE *fp;
+    int32 is_pipe;
+    int32 *counts = NULL;
+    int32 **grams = NULL;
+    int32 n, m, ngram, ngram_cnt, wcnt;
+
+    if ((fp = fopen_comp(file_name, "r", &is_pipe)) == NULL) {
+        E_ERROR("File %s not found\n", file_name);
+        return NULL;
+    }
+    li = lineiter_start(fp);
+
+    /* Find the \data\ mark and read the counts. */
+    for (; li; li = lineiter_next(li)) {
+        string_trim(li->buf, STRING_BOTH);
+        if (strcmp(li->buf, "\\data\\") == 0)
+            break;
+    }
+    if (li == NULL) {
+        E_ERROR("No \\data\\ mark in LM file\n");
+        goto error_out;
+    }
+    n = 0;
+    while ((li = lineiter_next(li))) {
+        if (sscanf(li->buf, "ngram %d=%d", &ngram, &ngram_cnt) != 2)
+            break;
+        if (ngram != n + 1 || ngram_cnt < 0 || (ngram == 1 && ngram_cnt == 0)) {
+            E_ERROR("Bad ngram count: %s\n", li->buf);
+            goto error_out;
+        }
+        counts = ckd_realloc(counts, ++n * sizeof(*counts));
+        counts[n - 1] = ngram_cnt;
+    }
+    if (li == NULL || n == 0) {
+        E_ERROR("Bad or missing ngram counts\n");
+        goto error_out;
+    }
+    while (li && strcmp(li->buf, "\\1-grams:") != 0) {
+        li = lineiter_next(li);
+        if (li)
+            string_trim(li->buf, STRING_BOTH);
+    }
+    if (li == NULL) {
+        E_ERROR("Failed to read \\1-grams: mark\n");
+        goto error_out;
+    }
+
+    model = ckd_calloc(1, sizeof(*model));
+    base = &model->base;
+    ngram_model_init(base, &ngram_model_trie_funcs, lmath, n, counts[0]);
+    memcpy(base->n_counts, counts, n * sizeof(*counts));
+    base->writable = TRUE;
+    model->unigrams = new_unigram_table(counts[0] + 1, base->log_zero);
+
+    E_INFO("Reading unigrams\n");
+    wcnt = 0;
+    while ((li = lineiter_next(li))) {
+        char *wptr[3];
+        float32 p1, bo_wt = 0.0f;
+        int nw;
+
+        string_trim(li->buf, STRING_BOTH);
+        if (li->buf[0] == '\\')
+            break;
+        if ((nw = str2words(li->buf, wptr, 3)) < 2) {
+            if (li->buf[0] != '\0')
+                E_WARN("Format error; unigram ignored: %s\n", li->buf);
+            continue;
+        }
+        if (wcnt >= base->n_counts[0]) {
+            E_ERROR("Too many unigrams\n");
+            goto error_out;
+        }
+        p1 = (float32)atof_c(wptr[0]);
+        if (nw == 3)
+            bo_wt = (float32)atof_c(wptr[2]);
+        base->word_str[wcnt] = ckd_salloc(wptr[1]);
+        if ((hash_table_enter_int32(base->wid, base->word_str[wcnt], wcnt))
+            != wcnt) {
+            E_WARN("Duplicate word in dictionary: %s\n", base->word_str[wcnt]);
+        }
+        model->unigrams[wcnt].prob1 = logmath_log10_to_log(lmath, p1);
+        model->unigrams[wcnt].bo_wt1 = logmath_log10_to_log(lmath, bo_wt);
+        ++wcnt;
+    }
+    if (li == NULL) {
+        E_ERROR("Unexpected end of file while reading unigrams\n");
+        goto error_out;
+    }
+    if (base->n_counts[0] != wcnt) {
+        E_WARN("%d unigrams expected, %d read\n", base->n_counts[0], wcnt);
+        base->n_counts[0] = base->n_words = wcnt;
+    }
+
+    grams = ckd_calloc(n, sizeof(*grams));
+    for (m = 1; m < n; ++m) {
+        char hdr[32];
+
+        sprintf(hdr, "\\%d-grams:", m + 1);
+        if (strcmp(li->buf, hdr) != 0) {
+            E_ERROR("Expected %s, got %s\n", hdr, li->buf);
+            goto error_out;
+        }
+        grams[m] = ckd_calloc((size_t)base->n_counts[m] * (m + 3),
+                              sizeof(**grams));
+        if (trie_read_arpa_grams(&li, model, m, grams[m]) < 0)
+            goto error_out;
+    }
+    if (strcmp(li->buf, "\\end\\") != 0) {
+        E_ERROR("Expected \\end\\, got %s\n", li->buf);
+        goto error_out;
+    }
+    lineiter_free(li);
+    li = NULL;
+    fclose_comp(fp, is_pipe);
+    fp = NULL;
+
+    if (trie_build_levels(model, grams) < 0)
+        goto error_out;
+    for (m = 0; m < n; ++m)
+        ckd_free(grams[m]);
+    ckd_free(grams);
+    ckd_free(counts);
+    return base;
+
+error_out:
+    if (grams) {
+        for (m = 0; m < n; ++m)
+            ckd_free(grams[m]);
+        ckd_free(grams);
+    }
+    ckd_free(counts);
+    lineiter_free(li);
+    if (fp)
+        fclose_comp(fp, is_pipe);
+    if (model)
+        ngram_model_free(&model->base);
+    return NULL;
+}
+
+/* Convert a log value written with another base or shift. */
+static int32
+trie_convert(logmath_t *lmath, float64 log10_of_base, int32 shift, int32 val)
+{
+    float64 log10_val = (float64)val * (1 << shift) * log10_of_base;
+
+    if (log10_val <= logmath_log_to_log10(lmath, logmath_get_zero(lmath)))
+        return logmath_get_zero(lmath);
+    return logmath_log10_to_log(lmath, log10_val);
+}
+
+static int
+fread_int32s(int32 *out, size_t n, FILE *fp)
+{
+    return fread(out, sizeof(*out), n, fp) == n ? 0 : -1;
+}
+
+static int
+trie_read_quant(trie_quant_t *q, FILE *fp)
+{
+    if (fread_int32s(&q->n_vals, 1, fp) < 0
+        || fread_int32s(&q->bits, 1, fp) < 0
+        || q->n_vals < 0 || q->bits > TRIE_MAX_QUANT_BITS)
+        return -1;
+    q->vals = ckd_calloc(q->n_vals + 1, sizeof(*q->vals));
+    return fread_int32s(q->vals, q->n_vals, fp);
+}
+
+int
+ngram_model_trie_probe(const char *file_name)
+{
+    FILE *fp;
+    int32 is_pipe;
+    char hdr[sizeof(trie_hdr)];
+    int rv;
+
+    if ((fp = fopen_comp(file_name, "rb", &is_pipe)) == NULL)
+        return FALSE;
+    rv = (fread(hdr, 1, sizeof(hdr), fp) == sizeof(hdr)
+          && memcmp(hdr, trie_hdr, sizeof(hdr)) == 0);
+    fclose_comp(fp, is_pipe);
+    return rv;
+}
+
+ngram_model_t *
+ngram_model_trie_read(cmd_ln_t *config,
+                      const char *file_name,
+                      logmath_t *lmath)
+{
+    ngram_model_trie_t *model = NULL;
+    ngram_model_t *base = NULL;
+    FILE *fp;
+    int32 is_pipe, do_mmap;
+    char hdr[sizeof(trie_hdr)];
+    int32 byteorder, version, n, shift, words_size, m, i;
+    int32 *counts = NULL;
+    long words_offset = 0, *bits_offset = NULL;
+    float64 logbase;
+    char *words = NULL;
+
+    do_mmap = FALSE;
+    if (config)
+        do_mmap = cmd_ln_boolean_r(config, "-mmap");
+
+    if ((fp = fopen_comp(file_name, "rb", &is_pipe)) == NULL) {
+        E_ERROR("File %s not found\n", file_name);
+        return NULL;
+    }
+    if (fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr)
+        || memcmp(hdr, trie_hdr, sizeof(hdr)) != 0) {
+        E_ERROR("%s is not a trie language model file\n", file_name);
+        fclose_comp(fp, is_pipe);
+        return NULL;
+    }
+    if (is_pipe && do_mmap) {
+        E_WARN("LM file is compressed, will not use memory-mapped I/O\n");
+        do_mmap = FALSE;
+    }
+    if (fread_int32s(&byteorder, 1, fp) < 0
+        || fread_int32s(&version, 1, fp) < 0)
+        goto error_out;
+    if (byteorder != TRIE_BYTEORDER) {
+        E_ERROR("%s was written with another byte order, convert it again\n",
+                file_name);
+        goto error_out;
+    }
+    if (version != TRIE_VERSION) {
+        E_ERROR("%s has version %d, expected %d\n",
+                file_name, version, TRIE_VERSION);
+        goto error_out;
+    }
+    if (fread_int32s(&n, 1, fp) < 0 || fread_int32s(&shift, 1, fp) < 0
+        || fread(&logbase, sizeof(logbase), 1, fp) != 1
+        || n < 1 || n > 255 || shift < 0 || shift > 30)
+        goto error_out;
+    counts = ckd_calloc(n, sizeof(*counts));
+    if (fread_int32s(counts, n, fp) < 0 || counts[0] < 1)
+        goto error_out;
+    E_INFO("%d-gram trie language model\n", n);
+
+    model = ckd_calloc(1, sizeof(*model));
+    base = &model->base;
+    ngram_model_init(base, &ngram_model_trie_funcs, lmath, n, counts[0]);
+    memcpy(base->n_counts, counts, n * sizeof(*counts));
+    if (fread_int32s(&model->wid_bits, 1, fp) < 0)
+        goto error_out;
+
+    /* Word strings, used in place if memory-mapped. */
+    if (fread_int32s(&words_size, 1, fp) < 0 || words_size < counts[0])
+        goto error_out;
+    if (do_mmap) {
+        words_offset = ftell(fp);
+        if (fseek(fp, words_size, SEEK_CUR) < 0)
+            goto error_out;
+    }
+    else {
+        words = ckd_malloc(words_size + 1);
+        if (fread(words, 1, words_size, fp) != (size_t)words_size)
+            goto error_out;
+        words[words_size] = '\0';
+    }
+
+    model->unigrams = ckd_calloc(counts[0] + 1, sizeof(*model->unigrams));
+    if (fread_int32s((int32 *)model->unigrams,
+                     (counts[0] + 1) * 3, fp) < 0)
+        goto error_out;
+
+    model->levels = ckd_calloc(n, sizeof(*model->levels));
+    bits_offset = ckd_calloc(n, sizeof(*bits_offset));
+    for (m = 1; m < n; ++m) {
+        trie_level_t *lev = &model->levels[m];
+
+        if (trie_read_quant(&lev->prob, fp) < 0)
+            goto error_out;
+        if (m < n - 1 && trie_read_quant(&lev->bowt, fp) < 0)
+            goto error_out;
+        if (fread_int32s(&lev->next_bits, 1, fp) < 0
+            || fread_int32s(&lev->n_bytes, 1, fp) < 0)
+            goto error_out;
+        lev->entry_bits = model->wid_bits + lev->prob.bits
+            + lev->bowt.bits + lev->next_bits;
+        if (lev->n_bytes < TRIE_PADDING
+            || (uint64)(lev->n_bytes - TRIE_PADDING) * 8
+            < (uint64)(counts[m] + (m < n - 1)) * lev->entry_bits) {
+            E_ERROR("%d-grams in %s are truncated\n", m + 1, file_name);
+            goto error_out;
+        }
+        if (do_mmap) {
+            bits_offset[m] = ftell(fp);
+            if (fseek(fp, lev->n_bytes, SEEK_CUR) < 0)
+                goto error_out;
+        }
+        else {
+            lev->bits = ckd_malloc(lev->n_bytes);
+            if (fread(lev->bits, 1, lev->n_bytes, fp) != (size_t)lev->n_bytes)
+                goto error_out;
+        }
+    }
+
+    if (do_mmap) {
+        char *map_base;
+
+        E_INFO("Will use memory-mapped I/O for LM file\n");
+        if ((model->trie_mmap = mmio_file_read(file_name)) == NULL)
+            goto error_out;
+        map_base = mmio_file_ptr(model->trie_mmap);
+        words = map_base + words_offset;
+        for (m = 1; m < n; ++m)
+            model->levels[m].bits = (uint8 *)map_base + bits_offset[m];
+    }
+
+    /* Convert log values if written with another base. */
+    if (logbase != logmath_get_base(lmath)
+        || shift != logmath_get_shift(lmath)) {
+        float64 log10_of_base = log10(logbase);
+
+        for (i = 0; i < counts[0]; ++i) {
+            model->unigrams[i].prob1 =
+                trie_convert(lmath, log10_of_base, shift, model->unigrams[i].prob1);
+            model->unigrams[i].bo_wt1 =
+                trie_convert(lmath, log10_of_base, shift, model->unigrams[i].bo_wt1);
+        }
+        for (m = 1; m < n; ++m) {
+            trie_level_t *lev = &model->levels[m];
+
+            for (i = 0; i < lev->prob.n_vals; ++i)
+                lev->prob.vals[i] = trie_convert(lmath, log10_of_base,
+                                                 shift, lev->prob.vals[i]);
+            for (i = 0; i < lev->bowt.n_vals; ++i)
+                lev->bowt.vals[i] = trie_convert(lmath, log10_of_base,
+                                                 shift, lev->bowt.vals[i]);
+        }
+    }
+
+    /* Word strings are NUL-separated. */
+    {
+        char *w = words;
+
+        base->writable = !do_mmap;
+        for (i = 0; i < counts[0]; ++i) {
+            if (w >= words + words_size) {
+                E_ERROR("Word strings in %s are truncated\n", file_name);
+                goto error_out;
+            }
+            base->word_str[i] = do_mmap ? w : ckd_salloc(w);
+            if ((hash_table_enter_int32(base->wid, base->word_str[i], i))
+                != i) {
+                E_WARN("Duplicate word in dictionary: %s\n", base->word_str[i]);
+            }
+            w += strlen(w) + 1;
+        }
+    }
+    if (!do_mmap)
+        ckd_free(words);
+    ckd_free(bits_offset);
+    ckd_free(counts);
+    fclose_comp(fp, is_pipe);
+    return base;
+
+error_out:
+    E_ERROR("Failed to read trie language model %s\n", file_name);
+    if (!do_mmap)
+        ckd_free(words);
+    ckd_free(bits_offset);
+    ckd_free(counts);
+    fclose_comp(fp, is_pipe);
+    if (base)
+        ngram_model_free(base);
+    return NULL;
+}
+
+static void
+trie_write_quant(trie_quant_t *q, FILE *fh)
+{
+    fwrite(&q->n_vals, sizeof(q->n_vals), 1, fh);
+    fwrite(&q->bits, sizeof(q->bits), 1, fh);
+    fwrite(q->vals, sizeof(*q->vals), q->n_vals, fh);
+}
+
+int
+ngram_model_trie_write(ngram_model_t *base,
+                       const char *file_name)
+{
+    ngram_model_trie_t *model;
+    ngram_model_t *newbase;
+    FILE *fh;
+    int32 val, words_size, m, i;
+    float64 logbase;
+    int rv;
+
+    if ((model = ngram_model_trie_build(base)) == NULL)
+        return -1;
+    newbase = &model->base;
+    if ((fh = fopen(file_name, "wb")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open %s for writing", file_name);
+        ngram_model_free(newbase);
+        return -1;
+    }
+
+    fwrite(trie_hdr, 1, sizeof(trie_hdr), fh);
+    val = TRIE_BYTEORDER;
+    fwrite(&val, sizeof(val), 1, fh);
+    val = TRIE_VERSION;
+    fwrite(&val, sizeof(val), 1, fh);
+    val = newbase->n;
+    fwrite(&val, sizeof(val), 1, fh);
+    val = logmath_get_shift(newbase->lmath);
+    fwrite(&val, sizeof(val), 1, fh);
+    logbase = logmath_get_base(newbase->lmath);
+    fwrite(&logbase, sizeof(logbase), 1, fh);
+    fwrite(newbase->n_counts, sizeof(*newbase->n_counts), newbase->n, fh);
+    fwrite(&model->wid_bits, sizeof(model->wid_bits), 1, fh);
+
+    for (words_size = i = 0; i < newbase->n_counts[0]; ++i)
+        words_size += strlen(newbase->word_str[i]) + 1;
+    fwrite(&words_size, sizeof(words_size), 1, fh);
+    for (i = 0; i < newbase->n_counts[0]; ++i)
+        fwrite(newbase->word_str[i], 1, strlen(newbase->word_str[i]) + 1, fh);
+
+    fwrite(model->unigrams, sizeof(*model->unigrams),
+           newbase->n_counts[0] + 1, fh);
+    for (m = 1; m < newbase->n; ++m) {
+        trie_level_t *lev = &model->levels[m];
+
+        trie_write_quant(&lev->prob, fh);
+        if (m < newbase->n - 1)
+            trie_write_quant(&lev->bowt, fh);
+        fwrite(&lev->next_bits, sizeof(lev->next_bits), 1, fh);
+        fwrite(&lev->n_bytes, sizeof(lev->n_bytes), 1, fh);
+        fwrite(lev->bits, 1, lev->n_bytes, fh);
+    }
+
+    rv = ferror(fh) ? -1 : 0;
+    if (fclose(fh) != 0)
+        rv = -1;
+    if (rv < 0)
+        E_ERROR_SYSTEM("Failed to write %s", file_name);
+    ngram_model_free(newbase);
+    return rv;
+}
+
+static ngram_funcs_t ngram_model_trie_funcs = {
+    ngram_model_trie_free,          /* free */
+    ngram_model_trie_apply_weights, /* apply_weights */
+    ngram_model_trie_score,         /* score */
+    ngram_model_trie_raw_score,     /* raw_score */
+    ngram_model_trie_add_ug,        /* add_ug */
+    NULL,                           /* flush */
+    ngram_model_trie_iter,          /* iter */
+    ngram_model_trie_mgrams,        /* mgrams */
+    ngram_model_trie_successors,    /* successors */
+    ngram_model_trie_iter_get,      /* iter_get */
+    ngram_model_trie_iter_next,     /* iter_next */
+    ngram_model_trie_iter_free,     /* iter_free */
+    ngram_model_trie_score_batch    /* score_batch */
+};
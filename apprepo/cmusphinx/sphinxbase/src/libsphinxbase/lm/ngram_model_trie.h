@@ -0,0 +1,105 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 1999-2007 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/*
+ * \file ngram_model_trie.h Sorted array trie for N-Gram models
+ */
+
+#ifndef __NGRAM_MODEL_TRIE_H__
+#define __NGRAM_MODEL_TRIE_H__
+
+#include "sphinxbase/mmio.h"
+
+#include "ngram_model_internal.h"
+
+/**
+ * Unigram in a trie.
+ */
+typedef struct trie_unigram_s {
+    int32 prob1;        /**< Unigram probability. */
+    int32 bo_wt1;       /**< Unigram backoff weight. */
+    int32 next;         /**< Index of the first bigram for this word. */
+} trie_unigram_t;
+
+/**
+ * Table of the distinct values (or, if there are too many of them,
+ * quantization levels) of probabilities or backoff weights for one
+ * order.  Entries store an index into it.
+ */
+typedef struct trie_quant_s {
+    int32 *vals;        /**< Values, in increasing order. */
+    int32 n_vals;       /**< Number of values. */
+    int32 bits;         /**< Width of an index into vals. */
+} trie_quant_t;
+
+/**
+ * The M-Grams (M > 1) of one order, sorted by their words.
+ *
+ * Entries are bit-packed, each one holds the last word ID, the index
+ * of its probability and, except for the highest order, the index of
+ * its backoff weight and of its first successor.  The successors of
+ * an entry are the entries from there up to the first successor of
+ * the next one, so there is an extra entry at the end of these
+ * orders.
+ */
+typedef struct trie_level_s {
+    uint8 *bits;        /**< Packed entries (memory-mapped or allocated). */
+    int32 n_bytes;      /**< Size of bits, including padding. */
+    int32 entry_bits;   /**< Width of one entry. */
+    int32 next_bits;    /**< Width of the successor index. */
+    trie_quant_t prob;  /**< Probabilities. */
+    trie_quant_t bowt;  /**< Backoff weights. */
+} trie_level_t;
+
+/**
+ * Subclass of ngram_model for sorted array tries.
+ */
+typedef struct ngram_model_trie_s {
+    ngram_model_t base;         /**< Base ngram_model_t structure */
+    trie_unigram_t *unigrams;   /**< Unigrams, plus an extra one at the end. */
+    trie_level_t *levels;       /**< levels[m] has the (M+1)-Grams. */
+    int32 wid_bits;             /**< Width of a word ID. */
+    mmio_file_t *trie_mmap;     /**< mmap() of the file (or NULL if none) */
+} ngram_model_trie_t;
+
+/**
+ * Construct a trie model from a generic base model.
+ *
+ * If base is already a trie model, this just calls ngram_model_retain().
+ */
+ngram_model_trie_t *ngram_model_trie_build(ngram_model_t *base);
+
+#endif /*  __NGRAM_MODEL_TRIE_H__ */
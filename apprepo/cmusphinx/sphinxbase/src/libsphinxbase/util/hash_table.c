@@ -84,6 +84,8 @@
  */
 
 
+
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -98,59 +100,25 @@
 #include "sphinxbase/ckd_alloc.h"
 #include "sphinxbase/case.h"
 
+/* Smallest table allocated, which must be a power of 2. */
+#define HASH_MIN_SIZE 8
 
-#if 0
-static void
-prime_sieve(int32 max)
-{
-    char *notprime;
-    int32 p, pp;
-
-    notprime = (char *) ckd_calloc(max + 1, 1);
-    p = 2;
-    for (;;) {
-        printf("%d\n", p);
-        for (pp = p + p; pp <= max; pp += p)
-            notprime[pp] = 1;
-        for (++p; (p <= max) && notprime[p]; p++);
-        if (p > max)
-            break;
-    }
-}
-#endif
+/* Probe distance of the entry in slot i from its home slot. */
+#define PROBE_DIST(h,i,hash) (((i) - (hash)) & ((h)->size - 1))
 
 
 /*
- * HACK!!  Initial hash table size is restricted by this set of primes.  (Of course,
- * collision resolution by chaining will accommodate more entries indefinitely, but
- * efficiency will drop.)
- */
-const int32 prime[] = {
-    101, 211, 307, 401, 503, 601, 701, 809, 907,
-    1009, 1201, 1601, 2003, 2411, 3001, 4001, 5003, 6007, 7001, 8009,
-    9001,
-    10007, 12007, 16001, 20011, 24001, 30011, 40009, 50021, 60013,
-    70001, 80021, 90001,
-    100003, 120011, 160001, 200003, 240007, 300007, 400009, 500009,
-    600011, 700001, 800011, 900001,
-    -1
-};
-
-
-/**
- * This function returns a very large prime. 
+ * Number of entries to allocate for an expected size, leaving at
+ * least 1/3 of them empty, as there are then few collisions.
  */
 static int32
-prime_size(int32 size)
+table_size(int32 size)
 {
-    int32 i;
+    int32 n;
 
-    for (i = 0; (prime[i] > 0) && (prime[i] < size); i++);
-    if (prime[i] <= 0) {
-        E_WARN("Very large hash table requested (%d entries)\n", size);
-        --i;
-    }
-    return (prime[i]);
+    for (n = HASH_MIN_SIZE; n < size + (size >> 1); n <<= 1)
+        ;
+    return n;
 }
 
 
@@ -160,80 +128,111 @@ hash_table_new(int32 size, int32 casearg)
     hash_table_t *h;
 
     h = (hash_table_t *) ckd_calloc(1, sizeof(hash_table_t));
-    h->size = prime_size(size + (size >> 1));
+    h->size = table_size(size);
     h->nocase = (casearg == HASH_CASE_NO);
     h->table = (hash_entry_t *) ckd_calloc(h->size, sizeof(hash_entry_t));
-    /* The above calloc clears h->table[*].key and .next to NULL, i.e. an empty table */
+    /* The above calloc clears h->table[*].key to NULL, i.e. an empty table */
 
     return h;
 }
 
 
 /*
- * Compute hash value for given key string.
- * Somewhat tuned for English text word strings.
+ * Mix the bits of a hash value, so that its low bits (which choose
+ * the slot) depend on all of the key.
  */
 static uint32
-key2hash(hash_table_t * h, const char *key)
+mix(uint32 a, uint32 b)
 {
+    uint32 hash;
 
-    register const char *cp;
-
-    /** ARCHAN 20050712: 
-	[1236322] libutil\str2words special character bgu
-	HACK Apply suggested hack of fixing the hash table such that
-	it can work with extended ascii code . This is a hack because
-	the best way to solve it is to make sure all character
-	representation is unsigned character in the first place. (or
-	better unicode.)
-    **/
+    hash = a ^ ((b << 16) | (b >> 16));
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
 
-    /*register char c; */
-    register unsigned char c;
-    register int32 s;
-    register uint32 hash;
+/*
+ * Compute hash value for given key string, and its length.  This is
+ * FNV-1a, over the odd and even characters separately, so that the
+ * two multiplications can go on at the same time.
+ *
+ * Characters are treated as unsigned, so that this works with
+ * extended ASCII (see SourceForge bug 1236322).
+ */
+#define FNV_STEP(hash, c) (((hash) ^ (c)) * 16777619)
+#define FNV_BASIS 2166136261u
+#define FNV_BASIS2 0x9e3779b9
 
-    hash = 0;
-    s = 0;
+static uint32
+key2hash(hash_table_t * h, const char *key, size_t *out_len)
+{
+    const unsigned char *cp;
+    uint32 a, b;
 
+    a = FNV_BASIS;
+    b = FNV_BASIS2;
+    cp = (const unsigned char *) key;
     if (h->nocase) {
-        for (cp = key; *cp; cp++) {
-            c = *cp;
-            c = UPPER_CASE(c);
-            hash += c << s;
-            s += 5;
-            if (s >= 25)
-                s -= 24;
+        for (; cp[0] && cp[1]; cp += 2) {
+            a = FNV_STEP(a, UPPER_CASE(cp[0]));
+            b = FNV_STEP(b, UPPER_CASE(cp[1]));
+        }
+        if (cp[0]) {
+            a = FNV_STEP(a, UPPER_CASE(cp[0]));
+            ++cp;
         }
     }
     else {
-        for (cp = key; *cp; cp++) {
-            hash += (*cp) << s;
-            s += 5;
-            if (s >= 25)
-                s -= 24;
+        for (; cp[0] && cp[1]; cp += 2) {
+            a = FNV_STEP(a, cp[0]);
+            b = FNV_STEP(b, cp[1]);
+        }
+        if (cp[0]) {
+            a = FNV_STEP(a, cp[0]);
+            ++cp;
         }
     }
+    *out_len = (const char *) cp - key;
 
-    return (hash % h->size);
+    return mix(a, b);
 }
 
-
-static char *
-makekey(uint8 * data, int32 len, char *key)
+/*
+ * Like key2hash(), for a binary key of known length (which hashes
+ * the same as a C string of the same characters).
+ */
+static uint32
+bkey2hash(hash_table_t * h, const char *key, size_t len)
 {
-    int32 i, j;
-
-    if (!key)
-        key = (char *) ckd_calloc(len * 2 + 1, sizeof(char));
+    const unsigned char *cp;
+    uint32 a, b;
+    size_t i;
 
-    for (i = 0, j = 0; i < len; i++, j += 2) {
-        key[j] = 'A' + (data[i] & 0x000f);
-        key[j + 1] = 'J' + ((data[i] >> 4) & 0x000f);
+    a = FNV_BASIS;
+    b = FNV_BASIS2;
+    cp = (const unsigned char *) key;
+    if (h->nocase) {
+        for (i = 0; i + 1 < len; i += 2) {
+            a = FNV_STEP(a, UPPER_CASE(cp[i]));
+            b = FNV_STEP(b, UPPER_CASE(cp[i + 1]));
+        }
+        if (i < len)
+            a = FNV_STEP(a, UPPER_CASE(cp[i]));
+    }
+    else {
+        for (i = 0; i + 1 < len; i += 2) {
+            a = FNV_STEP(a, cp[i]);
+            b = FNV_STEP(b, cp[i + 1]);
+        }
+        if (i < len)
+            a = FNV_STEP(a, cp[i]);
     }
-    key[j] = '\0';
 
-    return key;
+    return mix(a, b);
 }
 
 
@@ -258,67 +257,44 @@ keycmp_nocase(hash_entry_t * entry, const char *key)
 }
 
 
-static int32
-keycmp_case(hash_entry_t * entry, const char *key)
-{
-    char c1, c2;
-    int32 i;
-    const char *str;
-
-    str = entry->key;
-    for (i = 0; i < entry->len; i++) {
-        c1 = *(str++);
-        c2 = *(key++);
-        if (c1 != c2)
-            return (c1 - c2);
-    }
-
-    return 0;
-}
-
-
 /*
- * Lookup entry with hash-value hash in table h for given key
- * Return value: hash_entry_t for key
+ * Lookup entry with hash value hash in table h for given key
+ * Return value: index of the entry for key, or -1 if not found
  */
-static hash_entry_t *
+static int32
 lookup(hash_table_t * h, uint32 hash, const char *key, size_t len)
 {
     hash_entry_t *entry;
-
-    entry = &(h->table[hash]);
-    if (entry->key == NULL)
-        return NULL;
-
-    if (h->nocase) {
-        while (entry && ((entry->len != len)
-                         || (keycmp_nocase(entry, key) != 0)))
-            entry = entry->next;
+    uint32 i, dist;
+
+    for (i = hash & (h->size - 1), dist = 0;;
+         i = (i + 1) & (h->size - 1), ++dist) {
+        entry = &(h->table[i]);
+        /* An empty slot, or an entry closer to its home slot than
+         * this key would be, means that the key is not here (this
+         * is what Robin Hood insertion buys us). */
+        if (entry->key == NULL || PROBE_DIST(h, i, entry->hash) < dist)
+            return -1;
+        if (entry->hash == hash && entry->len == len
+            && (h->nocase ? keycmp_nocase(entry, key) == 0
+                : memcmp(entry->key, key, len) == 0))
+            return i;
     }
-    else {
-        while (entry && ((entry->len != len)
-                         || (keycmp_case(entry, key) != 0)))
-            entry = entry->next;
-    }
-
-    return entry;
 }
 
 
 int32
 hash_table_lookup(hash_table_t * h, const char *key, void ** val)
 {
-    hash_entry_t *entry;
     uint32 hash;
-    int32 len;
+    size_t len;
+    int32 i;
 
-    hash = key2hash(h, key);
-    len = strlen(key);
+    hash = key2hash(h, key, &len);
 
-    entry = lookup(h, hash, key, len);
-    if (entry) {
+    if ((i = lookup(h, hash, key, len)) >= 0) {
         if (val)
-            *val = entry->val;
+            *val = h->table[i].val;
         return 0;
     }
     else
@@ -343,18 +319,14 @@ hash_table_lookup_int32(hash_table_t * h, const char *key, int32 *val)
 int32
 hash_table_lookup_bkey(hash_table_t * h, const char *key, size_t len, void ** val)
 {
-    hash_entry_t *entry;
     uint32 hash;
-    char *str;
+    int32 i;
 
-    str = makekey((uint8 *) key, len, NULL);
-    hash = key2hash(h, str);
-    ckd_free(str);
+    hash = bkey2hash(h, key, len);
 
-    entry = lookup(h, hash, key, len);
-    if (entry) {
+    if ((i = lookup(h, hash, key, len)) >= 0) {
         if (val)
-            *val = entry->val;
+            *val = h->table[i].val;
         return 0;
     }
     else
@@ -376,12 +348,60 @@ hash_table_lookup_bkey_int32(hash_table_t * h, const char *key, size_t len, int3
 }
 
 
+/*
+ * Put an entry (which is not in the table) in its place, displacing
+ * entries that are closer to their home slots than it is.
+ */
+static void
+insert(hash_table_t * h, hash_entry_t *new)
+{
+    hash_entry_t ent, tmp, *cur;
+    uint32 i, dist, curdist;
+
+    ent = *new;
+    for (i = ent.hash & (h->size - 1), dist = 0;;
+         i = (i + 1) & (h->size - 1), ++dist) {
+        cur = &(h->table[i]);
+        if (cur->key == NULL) {
+            *cur = ent;
+            return;
+        }
+        curdist = PROBE_DIST(h, i, cur->hash);
+        if (curdist < dist) {
+            tmp = *cur;
+            *cur = ent;
+            ent = tmp;
+            dist = curdist;
+        }
+    }
+}
+
+/* Double the size of the table, and re-insert all entries. */
+static void
+grow(hash_table_t * h)
+{
+    hash_entry_t *old;
+    int32 i, oldsize;
+
+    old = h->table;
+    oldsize = h->size;
+    h->size = oldsize * 2;
+    h->table = (hash_entry_t *) ckd_calloc(h->size, sizeof(hash_entry_t));
+    for (i = 0; i < oldsize; i++) {
+        if (old[i].key != NULL)
+            insert(h, &old[i]);
+    }
+    ckd_free(old);
+}
+
 static void *
 enter(hash_table_t * h, uint32 hash, const char *key, size_t len, void *val, int32 replace)
 {
-    hash_entry_t *cur, *new;
+    hash_entry_t new;
+    int32 i;
 
-    if ((cur = lookup(h, hash, key, len)) != NULL) {
+    if ((i = lookup(h, hash, key, len)) >= 0) {
+        hash_entry_t *cur = &(h->table[i]);
         void *oldval;
         /* Key already exists. */
         oldval = cur->val;
@@ -395,92 +415,43 @@ enter(hash_table_t * h, uint32 hash, const char *key, size_t len, void *val, int
         return oldval;
     }
 
-    cur = &(h->table[hash]);
-    if (cur->key == NULL) {
-        /* Empty slot at hashed location; add this entry */
-        cur->key = key;
-        cur->len = len;
-        cur->val = val;
-
-        /* Added by ARCHAN at 20050515. This allows deletion could work. */
-        cur->next = NULL;
-
-    }
-    else {
-        /* Key collision; create new entry and link to hashed location */
-        new = (hash_entry_t *) ckd_calloc(1, sizeof(hash_entry_t));
-        new->key = key;
-        new->len = len;
-        new->val = val;
-        new->next = cur->next;
-        cur->next = new;
-    }
+    /* Keep the table at most 3/4 full. */
+    if ((h->inuse + 1) * 4 > h->size * 3)
+        grow(h);
+    new.key = key;
+    new.len = (uint32) len;
+    new.val = val;
+    new.hash = hash;
+    insert(h, &new);
     ++h->inuse;
 
     return val;
 }
 
-/* 20050523 Added by ARCHAN  to delete a key from a hash table */
+/*
+ * Delete an entry, and shift back the entries after it until one
+ * which is in its home slot, so that there is no need for tombstones.
+ */
 static void *
 delete(hash_table_t * h, uint32 hash, const char *key, size_t len)
 {
-    hash_entry_t *entry, *prev;
+    hash_entry_t *entry;
     void *val;
+    int32 i, j;
 
-    prev = NULL;
-    entry = &(h->table[hash]);
-    if (entry->key == NULL)
-        return NULL;
-
-    if (h->nocase) {
-        while (entry && ((entry->len != len)
-                         || (keycmp_nocase(entry, key) != 0))) {
-            prev = entry;
-            entry = entry->next;
-        }
-    }
-    else {
-        while (entry && ((entry->len != len)
-                         || (keycmp_case(entry, key) != 0))) {
-            prev = entry;
-            entry = entry->next;
-        }
-    }
-
-    if (entry == NULL)
+    if ((i = lookup(h, hash, key, len)) < 0)
         return NULL;
+    val = h->table[i].val;
 
-    /* At this point, entry will be the one required to be deleted, prev
-       will contain the previous entry
-     */
-    val = entry->val;
-
-    if (prev == NULL) {
-        /* That is to say the entry in the hash table (not the chain) matched the key. */
-        /* We will then copy the things from the next entry to the hash table */
-        prev = entry;
-        if (entry->next) {      /* There is a next entry, great, copy it. */
-            entry = entry->next;
-            prev->key = entry->key;
-            prev->len = entry->len;
-            prev->val = entry->val;
-            prev->next = entry->next;
-            ckd_free(entry);
-        }
-        else {                  /* There is not a next entry, just set the key to null */
-            prev->key = NULL;
-            prev->len = 0;
-            prev->next = NULL;
-        }
-
-    }
-    else {                      /* This case is simple */
-        prev->next = entry->next;
-        ckd_free(entry);
+    for (;;) {
+        j = (i + 1) & (h->size - 1);
+        entry = &(h->table[j]);
+        if (entry->key == NULL || PROBE_DIST(h, j, entry->hash) == 0)
+            break;
+        h->table[i] = *entry;
+        i = j;
     }
-
-    /* Do wiring and free the entry */
-
+    memset(&h->table[i], 0, sizeof(h->table[i]));
     --h->inuse;
 
     return val;
@@ -489,17 +460,7 @@ delete(hash_table_t * h, uint32 hash, const char *key, size_t len)
 void
 hash_table_empty(hash_table_t *h)
 {
-    hash_entry_t *e, *e2;
-    int32 i;
-
-    for (i = 0; i < h->size; i++) {
-        /* Free collision lists. */
-        for (e = h->table[i].next; e; e = e2) {
-            e2 = e->next;
-            ckd_free((void *) e);
-        }
-        memset(&h->table[i], 0, sizeof(h->table[i]));
-    }
+    memset(h->table, 0, h->size * sizeof(*h->table));
     h->inuse = 0;
 }
 
@@ -510,8 +471,7 @@ hash_table_enter(hash_table_t * h, const char *key, void *val)
     uint32 hash;
     size_t len;
 
-    hash = key2hash(h, key);
-    len = strlen(key);
+    hash = key2hash(h, key, &len);
     return (enter(h, hash, key, len, val, 0));
 }
 
@@ -521,8 +481,7 @@ hash_table_replace(hash_table_t * h, const char *key, void *val)
     uint32 hash;
     size_t len;
 
-    hash = key2hash(h, key);
-    len = strlen(key);
+    hash = key2hash(h, key, &len);
     return (enter(h, hash, key, len, val, 1));
 }
 
@@ -532,9 +491,7 @@ hash_table_delete(hash_table_t * h, const char *key)
     uint32 hash;
     size_t len;
 
-    hash = key2hash(h, key);
-    len = strlen(key);
-
+    hash = key2hash(h, key, &len);
     return (delete(h, hash, key, len));
 }
 
@@ -542,12 +499,8 @@ void *
 hash_table_enter_bkey(hash_table_t * h, const char *key, size_t len, void *val)
 {
     uint32 hash;
-    char *str;
-
-    str = makekey((uint8 *) key, len, NULL);
-    hash = key2hash(h, str);
-    ckd_free(str);
 
+    hash = bkey2hash(h, key, len);
     return (enter(h, hash, key, len, val, 0));
 }
 
@@ -555,12 +508,8 @@ void *
 hash_table_replace_bkey(hash_table_t * h, const char *key, size_t len, void *val)
 {
     uint32 hash;
-    char *str;
-
-    str = makekey((uint8 *) key, len, NULL);
-    hash = key2hash(h, str);
-    ckd_free(str);
 
+    hash = bkey2hash(h, key, len);
     return (enter(h, hash, key, len, val, 1));
 }
 
@@ -568,12 +517,8 @@ void *
 hash_table_delete_bkey(hash_table_t * h, const char *key, size_t len)
 {
     uint32 hash;
-    char *str;
-
-    str = makekey((uint8 *) key, len, NULL);
-    hash = key2hash(h, str);
-    ckd_free(str);
 
+    hash = bkey2hash(h, key, len);
     return (delete(h, hash, key, len));
 }
 
@@ -584,7 +529,7 @@ hash_table_display(hash_table_t * h, int32 showdisplay)
     int i, j;
     j = 0;
 
-    E_INFOCONT("Hash with chaining representation of the hash table\n");
+    E_INFOCONT("Open addressing representation of the hash table\n");
 
     for (i = 0; i < h->size; i++) {
         e = &(h->table[i]);
@@ -595,23 +540,9 @@ hash_table_display(hash_table_t * h, int32 showdisplay)
             else
                 E_INFOCONT("%p", e->key);
 
-            E_INFOCONT("|len:%d|val=%ld|->", e->len, (long)e->val);
-            if (e->next == NULL) {
-                E_INFOCONT("NULL\n");
-            }
+            E_INFOCONT("|len:%d|val=%ld|dist:%d|\n", e->len, (long)e->val,
+                       PROBE_DIST(h, i, e->hash));
             j++;
-
-            for (e = e->next; e; e = e->next) {
-                E_INFOCONT("|key:");
-                if (showdisplay)
-                    E_INFOCONT("%s", e->key);
-
-                E_INFOCONT("|len:%d|val=%ld|->", e->len, (long)e->val);
-                if (e->next == NULL) {
-                    E_INFOCONT("NULL\n");
-                }
-                j++;
-            }
         }
     }
 
@@ -623,23 +554,15 @@ glist_t
 hash_table_tolist(hash_table_t * h, int32 * count)
 {
     glist_t g;
-    hash_entry_t *e;
     int32 i, j;
 
     g = NULL;
 
     j = 0;
     for (i = 0; i < h->size; i++) {
-        e = &(h->table[i]);
-
-        if (e->key != NULL) {
-            g = glist_add_ptr(g, (void *) e);
+        if (h->table[i].key != NULL) {
+            g = glist_add_ptr(g, (void *) &(h->table[i]));
             j++;
-
-            for (e = e->next; e; e = e->next) {
-                g = glist_add_ptr(g, (void *) e);
-                j++;
-            }
         }
     }
 
@@ -662,26 +585,20 @@ hash_table_iter(hash_table_t *h)
 hash_iter_t *
 hash_table_iter_next(hash_iter_t *itor)
 {
-	/* If there is an entry, walk down its list. */
-	if (itor->ent)
-		itor->ent = itor->ent->next;
-	/* If we got to the end of the chain, or we had no entry, scan
-	 * forward in the table to find the next non-empty bucket. */
-	if (itor->ent == NULL) {
-		while (itor->idx < itor->ht->size
-		       && itor->ht->table[itor->idx].key == NULL) 
-			++itor->idx;
-		/* If we did not find one then delete the iterator and
-		 * return NULL. */
-		if (itor->idx == itor->ht->size) {
-			hash_table_iter_free(itor);
-			return NULL;
-		}
-		/* Otherwise use this next entry. */
-		itor->ent = itor->ht->table + itor->idx;
-		/* Increase idx for the next time around. */
+	/* Scan forward in the table to find the next non-empty entry. */
+	while (itor->idx < itor->ht->size
+	       && itor->ht->table[itor->idx].key == NULL)
 		++itor->idx;
+	/* If we did not find one then delete the iterator and
+	 * return NULL. */
+	if (itor->idx == itor->ht->size) {
+		hash_table_iter_free(itor);
+		return NULL;
 	}
+	/* Otherwise use this next entry. */
+	itor->ent = itor->ht->table + itor->idx;
+	/* Increase idx for the next time around. */
+	++itor->idx;
 	return itor;
 }
 
@@ -694,20 +611,9 @@ hash_table_iter_free(hash_iter_t *itor)
 void
 hash_table_free(hash_table_t * h)
 {
-    hash_entry_t *e, *e2;
-    int32 i;
-
     if (h == NULL)
         return;
 
-    /* Free additional entries created for key collision cases */
-    for (i = 0; i < h->size; i++) {
-        for (e = h->table[i].next; e; e = e2) {
-            e2 = e->next;
-            ckd_free((void *) e);
-        }
-    }
-
     ckd_free((void *) h->table);
     ckd_free((void *) h);
 }
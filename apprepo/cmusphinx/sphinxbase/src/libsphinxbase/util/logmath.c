@@ -36,6 +36,7 @@
  */
 
 #include <math.h>
+#include <float.h>
 #include <string.h>
 #include <assert.h>
 
@@ -46,6 +47,14 @@
 #include "sphinxbase/bio.h"
 #include "sphinxbase/strfuncs.h"
 
+/* SSE2 is always there on x86-64, and lets logmath_add_n() work on
+ * four values at a time. */
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LOGMATH_SSE2 1
+#include <emmintrin.h>
+#endif
+
 struct logmath_s {
     logadd_t t;
     int refcount;
@@ -443,6 +452,230 @@ logmath_add_exact(logmath_t *lmath, int logb_p, int logb_q)
                        + logmath_exp(lmath, logb_q));
 }
 
+#define LN_2 0.69314718055994530942
+/*
+ * Below this many values, logmath_add_n() just uses the add table:
+ * a table lookup is only a few cycles, and the exp and log below have
+ * a fixed cost which only pays off for longer arrays.
+ */
+#define ADD_N_MIN 32
+
+/* The helpers for logmath_add_n() are small, and have to be inlined
+ * into its loops to be of any use. */
+#if defined(__GNUC__)
+#define ADD_N_INLINE static inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define ADD_N_INLINE static __forceinline
+#else
+#define ADD_N_INLINE static
+#endif
+
+/*
+ * Approximate 2^x for x <= 0, as 2^round(x), made directly from the
+ * bits of a float, times 2^(x - round(x)), from its Taylor series.
+ * There are no branches or table lookups, so the same thing can be
+ * done four values at a time below.
+ */
+#define EXP2_C1 0.6931472f
+#define EXP2_C2 0.2402265f
+#define EXP2_C3 0.05550411f
+#define EXP2_C4 0.009618129f
+#define EXP2_C5 0.001333356f
+#define EXP2_C6 0.0001540353f
+
+ADD_N_INLINE float32
+fast_exp2(float32 x)
+{
+    union {
+        float32 f;
+        int32 i;
+    } e;
+    float32 f;
+    int32 k;
+
+    /* Below this, 2^x is not a normal float (and too small to
+     * matter anyway). */
+    if (x < -126.0f)
+        x = -126.0f;
+    /* x + 126.5 is positive, so truncation rounds it down. */
+    k = (int32)(x + 126.5f);
+    f = x - (float32)(k - 126);
+    e.i = (k + 1) << 23;
+    return e.f * (1.0f + f * (EXP2_C1 + f * (EXP2_C2 + f * (EXP2_C3
+                 + f * (EXP2_C4 + f * (EXP2_C5 + f * EXP2_C6))))));
+}
+
+#ifdef LOGMATH_SSE2
+ADD_N_INLINE __m128
+fast_exp2_sse2(__m128 x)
+{
+    __m128i k;
+    __m128 f, p;
+
+    x = _mm_max_ps(x, _mm_set1_ps(-126.0f));
+    k = _mm_cvttps_epi32(_mm_add_ps(x, _mm_set1_ps(126.5f)));
+    f = _mm_sub_ps(x, _mm_cvtepi32_ps(_mm_sub_epi32(k, _mm_set1_epi32(126))));
+    p = _mm_add_ps(_mm_mul_ps(f, _mm_set1_ps(EXP2_C6)), _mm_set1_ps(EXP2_C5));
+    p = _mm_add_ps(_mm_mul_ps(f, p), _mm_set1_ps(EXP2_C4));
+    p = _mm_add_ps(_mm_mul_ps(f, p), _mm_set1_ps(EXP2_C3));
+    p = _mm_add_ps(_mm_mul_ps(f, p), _mm_set1_ps(EXP2_C2));
+    p = _mm_add_ps(_mm_mul_ps(f, p), _mm_set1_ps(EXP2_C1));
+    p = _mm_add_ps(_mm_mul_ps(f, p), _mm_set1_ps(1.0f));
+    return _mm_mul_ps(p, _mm_castsi128_ps(
+                          _mm_slli_epi32(_mm_add_epi32(k, _mm_set1_epi32(1)), 23)));
+}
+
+ADD_N_INLINE float64
+hsum_sse2(__m128 v)
+{
+    float32 s[4];
+
+    _mm_storeu_ps(s, v);
+    return (float64)s[0] + s[1] + s[2] + s[3];
+}
+
+/* SSE2 has no pmaxsd, so select with a comparison. */
+ADD_N_INLINE __m128i
+max_epi32_sse2(__m128i a, __m128i b)
+{
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+#endif /* LOGMATH_SSE2 */
+
+/*
+ * Approximate log2(x) for x >= 1, from its exponent and mantissa.  The
+ * sum only has float precision anyway, so take them from a float.
+ */
+ADD_N_INLINE float64
+fast_log2(float64 x)
+{
+    union {
+        float32 f;
+        int32 i;
+    } m;
+    float64 s, s2;
+    int e;
+
+    /* Take the mantissa m in [sqrt(1/2), sqrt(2)), and x = m 2^e. */
+    m.f = (float32)x;
+    e = ((m.i >> 23) & 0xff) - 127;
+    m.i = (m.i & 0x007fffff) | (127 << 23);
+    if (m.f > 1.41421356f) {
+        m.f *= 0.5f;
+        ++e;
+    }
+    /* ln(m) = 2 atanh((m - 1) / (m + 1)), and |s| < 0.172 */
+    s = (m.f - 1.0) / (m.f + 1.0);
+    s2 = s * s;
+    return e + s * (2 / LN_2) * (1 + s2 * (1.0 / 3 + s2 * (1.0 / 5
+                                 + s2 * (1.0 / 7 + s2 * (1.0 / 9)))));
+}
+
+int
+logmath_add_n(logmath_t *lmath, const int *logb_x, int n)
+{
+    float32 scale;
+    float64 sum;
+    int i, r, zero;
+
+    if (n == 0)
+        return lmath->zero;
+    if (n < ADD_N_MIN && lmath->t.table != NULL) {
+        r = logb_x[0];
+        for (i = 1; i < n; ++i)
+            r = logmath_add(lmath, r, logb_x[i]);
+        return r;
+    }
+    zero = lmath->zero;
+    r = logb_x[0];
+    i = 1;
+#ifdef LOGMATH_SSE2
+    if (n >= 8) {
+        __m128i vr = _mm_loadu_si128((const __m128i *)logb_x);
+        int32 m[4];
+
+        for (i = 4; i + 4 <= n; i += 4)
+            vr = max_epi32_sse2(vr, _mm_loadu_si128((const __m128i *)(logb_x + i)));
+        _mm_storeu_si128((__m128i *)m, vr);
+        r = m[0];
+        if (m[1] > r) r = m[1];
+        if (m[2] > r) r = m[2];
+        if (m[3] > r) r = m[3];
+    }
+#endif
+    for (; i < n; ++i)
+        if (logb_x[i] > r)
+            r = logb_x[i];
+    /* handle 0 + 0 = 0 case. */
+    if (r <= zero)
+        return r;
+
+    /* Add 2^((x_i - r) log2(B)) to get log_B(sum_i B^(x_i - r)).
+     * The zeros are clamped so that x_i - r cannot overflow. */
+    scale = (float32)(lmath->log_of_base * (1 << lmath->t.shift)
+                      * (1.0 / LN_2));
+    sum = 0;
+    i = 0;
+#ifdef LOGMATH_SSE2
+    {
+        __m128i vr = _mm_set1_epi32(r), vz = _mm_set1_epi32(zero);
+        __m128 vscale = _mm_set1_ps(scale), vsum = _mm_setzero_ps();
+
+        for (; i + 4 <= n; i += 4) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(logb_x + i));
+            x = _mm_sub_epi32(max_epi32_sse2(x, vz), vr);
+            vsum = _mm_add_ps(vsum, fast_exp2_sse2(
+                                  _mm_mul_ps(_mm_cvtepi32_ps(x), vscale)));
+        }
+        sum = hsum_sse2(vsum);
+    }
+#endif
+    for (; i < n; ++i) {
+        int x = (logb_x[i] < zero) ? zero : logb_x[i];
+        sum += fast_exp2((float32)(x - r) * scale);
+    }
+    /* sum >= 1, so this is positive and truncation rounds it. */
+    return r + (int)(fast_log2(sum) * lmath->inv_log_of_base * LN_2
+                     / (1 << lmath->t.shift) + 0.5);
+}
+
+float32
+logmath_ln_add_n(const float32 *ln_x, int n)
+{
+    const float32 inv_ln_2 = (float32)(1.0 / LN_2);
+    float32 r;
+    float64 sum;
+    int i;
+
+    if (n == 0)
+        return -FLT_MAX;
+    r = ln_x[0];
+    for (i = 1; i < n; ++i)
+        if (ln_x[i] > r)
+            r = ln_x[i];
+    if (r <= -FLT_MAX)
+        return r;
+
+    sum = 0;
+    i = 0;
+#ifdef LOGMATH_SSE2
+    {
+        __m128 vr = _mm_set1_ps(r), vscale = _mm_set1_ps(inv_ln_2);
+        __m128 vsum = _mm_setzero_ps();
+
+        for (; i + 4 <= n; i += 4) {
+            __m128 x = _mm_sub_ps(_mm_loadu_ps(ln_x + i), vr);
+            vsum = _mm_add_ps(vsum, fast_exp2_sse2(_mm_mul_ps(x, vscale)));
+        }
+        sum = hsum_sse2(vsum);
+    }
+#endif
+    for (; i < n; ++i)
+        sum += fast_exp2((ln_x[i] - r) * inv_ln_2);
+    return r + (float32)(fast_log2(sum) * LN_2);
+}
+
 int
 logmath_log(logmath_t *lmath, float64 p)
 {
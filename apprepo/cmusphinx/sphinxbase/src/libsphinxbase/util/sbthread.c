@@ -528,6 +528,21 @@ sbmsgq_send(sbmsgq_t *q, size_t len, void const *data)
     return 0;
 }
 
+/* Absolute time sec seconds and nsec nanoseconds from now. */
+static void
+cond_deadline(struct timespec *end, int sec, int nsec)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    end->tv_sec = now.tv_sec + sec;
+    end->tv_nsec = now.tv_usec * 1000 + nsec;
+    if (end->tv_nsec >= (1000*1000*1000)) {
+        end->tv_sec += end->tv_nsec / (1000*1000*1000);
+        end->tv_nsec = end->tv_nsec % (1000*1000*1000);
+    }
+}
+
 static int
 cond_timed_wait(pthread_cond_t *cond, pthread_mutex_t *mtx, int sec, int nsec)
 {
@@ -536,16 +551,9 @@ cond_timed_wait(pthread_cond_t *cond, pthread_mutex_t *mtx, int sec, int nsec)
         rv = pthread_cond_wait(cond, mtx);
     }
     else {
-        struct timeval now;
         struct timespec end;
 
-        gettimeofday(&now, NULL);
-        end.tv_sec = now.tv_sec + sec;
-        end.tv_nsec = now.tv_usec * 1000 + nsec;
-        if (end.tv_nsec > (1000*1000*1000)) {
-            sec += end.tv_nsec / (1000*1000*1000);
-            end.tv_nsec = end.tv_nsec % (1000*1000*1000);
-        }
+        cond_deadline(&end, sec, nsec);
         rv = pthread_cond_timedwait(cond, mtx, &end);
     }
     return rv;
@@ -651,13 +659,22 @@ sbevent_signal(sbevent_t *evt)
 int
 sbevent_wait(sbevent_t *evt, int sec, int nsec)
 {
+    struct timespec end;
     int rv = 0;
 
+    /* The timeout is from now, not from each wakeup. */
+    if (sec != -1)
+        cond_deadline(&end, sec, nsec);
     /* Lock the mutex before we check its signalled state. */
     pthread_mutex_lock(&evt->mtx);
-    /* If it's not signalled, then wait until it is. */
-    if (!evt->signalled)
-        rv = cond_timed_wait(&evt->cond, &evt->mtx, sec, nsec);
+    /* If it's not signalled, then wait until it is (condition
+     * variables can wake up spuriously). */
+    while (!evt->signalled && rv == 0) {
+        if (sec == -1)
+            rv = pthread_cond_wait(&evt->cond, &evt->mtx);
+        else
+            rv = pthread_cond_timedwait(&evt->cond, &evt->mtx, &end);
+    }
     /* Set its state to unsignalled if we were successful. */
     if (rv == 0)
         evt->signalled = FALSE;
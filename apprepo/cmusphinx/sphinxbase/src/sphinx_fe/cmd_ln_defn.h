@@ -221,6 +221,11 @@ static arg_t defn[] = {
     "no",
     "Input is cepstral files, output is log spectral files" },
 
+  { "-benchmark",
+    ARG_INT32,
+    "0",
+    "Instead of writing features, time this many passes of the front-end over each input, one frame at a time and all frames at once" },
+
   { NULL, 0, NULL, NULL }
 };
 
@@ -56,6 +56,7 @@
 #include <sphinxbase/err.h>
 #include <sphinxbase/ckd_alloc.h>
 #include <sphinxbase/byteorder.h>
+#include <sphinxbase/profile.h>
 #include <sphinxbase/hash_table.h>
 
 #include "sphinx_wave2feat.h"
@@ -490,6 +491,95 @@ decode_pcm(sphinx_wave2feat_t *wtf)
     return nfloat;
 }
 
+/**
+ * Time the front-end on PCM audio from a filehandle, one frame at a
+ * time and then all frames at once, and check that both give the
+ * same features.  Assume that wtf->infh is positioned just after the
+ * file header.
+ */
+static int
+benchmark_pcm(sphinx_wave2feat_t *wtf)
+{
+    static char const *const modes[2] = {
+        "one frame at a time", "all frames at once"
+    };
+    int16 *data;
+    mfcc_t **feat[2];
+    size_t ndata, nalloc, nsamp;
+    int32 nfr, total, nchans, whichchan;
+    int npass, pass, mode, rv;
+
+    nchans = cmd_ln_int32_r(wtf->config, "-nchans");
+    whichchan = cmd_ln_int32_r(wtf->config, "-whichchan");
+    npass = cmd_ln_int32_r(wtf->config, "-benchmark");
+
+    /* Read all of the audio first. */
+    data = NULL;
+    ndata = nalloc = 0;
+    while ((nsamp = fread(wtf->audio, 2, wtf->blocksize, wtf->infh)) != 0) {
+        size_t n;
+
+        if (wtf->byteswap) {
+            for (n = 0; n < nsamp; ++n)
+                SWAP_INT16(wtf->audio + n);
+        }
+        if (nchans > 1)
+            nsamp = mixnpick_channels(wtf->audio, nsamp, nchans, whichchan);
+        if (ndata + nsamp > nalloc) {
+            nalloc = (ndata + nsamp) * 2;
+            data = ckd_realloc(data, nalloc * sizeof(*data));
+        }
+        memcpy(data + ndata, wtf->audio, nsamp * sizeof(*data));
+        ndata += nsamp;
+    }
+    if (fclose(wtf->infh) == EOF)
+        E_ERROR_SYSTEM("Failed to close input file");
+    wtf->infh = NULL;
+
+    nsamp = ndata;
+    fe_process_frames(wtf->fe, NULL, &nsamp, NULL, &total);
+    for (mode = 0; mode < 2; ++mode)
+        feat[mode] = (mfcc_t **)ckd_calloc_2d(total + 1, wtf->veclen,
+                                              sizeof(mfcc_t));
+
+    for (mode = 0; mode < 2; ++mode) {
+        ptmr_t tm;
+
+        ptmr_init(&tm);
+        ptmr_start(&tm);
+        for (pass = 0; pass < npass; ++pass) {
+            int16 const *inspeech = data;
+            int32 outidx = 0;
+
+            nsamp = ndata;
+            fe_start_utt(wtf->fe);
+            while (outidx < total) {
+                nfr = mode ? total - outidx : 1;
+                fe_process_frames(wtf->fe, &inspeech, &nsamp,
+                                  feat[mode] + outidx, &nfr);
+                outidx += nfr;
+            }
+            fe_end_utt(wtf->fe, feat[mode][total], &nfr);
+        }
+        ptmr_stop(&tm);
+        E_INFO("%s: %d frames, %.3f sec CPU, %.0f frames/sec\n",
+               modes[mode], total, tm.t_cpu,
+               tm.t_cpu > 0 ? (double)total * npass / tm.t_cpu : 0.0);
+    }
+
+    rv = total;
+    if (memcmp(feat[0][0], feat[1][0],
+               (total + 1) * wtf->veclen * sizeof(mfcc_t)) != 0) {
+        E_ERROR("Features differ between %s and %s\n", modes[0], modes[1]);
+        rv = -1;
+    }
+
+    ckd_free_2d(feat[0]);
+    ckd_free_2d(feat[1]);
+    ckd_free(data);
+    return rv;
+}
+
 /**
  * Process Sphinx MFCCs/logspectra from a filehandle.  Assume that
  * wtf->infh is positioned just after the file header.
@@ -898,6 +988,16 @@ sphinx_wave2feat_convert_file(sphinx_wave2feat_t *wtf,
     
     wtf->feat = ckd_calloc_2d(wtf->featsize, veclen, sizeof(**wtf->feat));
 
+    if (cmd_ln_int32_r(wtf->config, "-benchmark") > 0) {
+        if (atype->decode != &decode_pcm) {
+            E_ERROR("-benchmark only supports PCM input files\n");
+            goto error_out;
+        }
+        if (benchmark_pcm(wtf) < 0)
+            goto error_out;
+        goto done;
+    }
+
     /* Let's go! */
     if ((wtf->outfh = fopen(outfile, "wb")) == NULL) {
         E_ERROR_SYSTEM("Failed to open %s for writing", outfile);
@@ -927,7 +1027,7 @@ sphinx_wave2feat_convert_file(sphinx_wave2feat_t *wtf,
         }
     }
     
-
+done:
     if (wtf->audio)
 	ckd_free(wtf->audio);
     if (wtf->feat)
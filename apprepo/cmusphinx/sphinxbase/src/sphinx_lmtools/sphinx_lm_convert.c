@@ -114,8 +114,8 @@ static void
 usagemsg(char *pgm)
 {
     E_INFO("Usage: %s -i <input.lm> \\\n", pgm);
-    E_INFOCONT("\t[-ifmt txt] [-ofmt dmp]\n");
-    E_INFOCONT("\t-o <output.lm.DMP>\n");
+    E_INFOCONT("\t[-ifmt txt] [-ofmt dmp|bin]\n");
+    E_INFOCONT("\t-o <output.lm.DMP|output.lm.bin>\n");
 
     exit(0);
 }
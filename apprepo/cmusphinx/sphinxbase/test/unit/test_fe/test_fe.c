@@ -7,13 +7,75 @@
 
 #include "test_macros.h"
 
+static const arg_t fe_args[] = {
+	waveform_to_cepstral_command_line_macro(),
+	{ NULL, 0, NULL, NULL }
+};
+
+/* Processing a whole file one frame at a time and all at once (which
+ * transforms several frames together where supported) must give
+ * exactly the same features. */
+static void
+test_whole_file(cmd_ln_t *config)
+{
+	FILE *raw;
+	fe_t *fe;
+	int16 *data;
+	int16 const *inptr;
+	mfcc_t **cepbuf1, **cepbuf2;
+	int32 nfr, total, i, frame_shift, frame_size;
+	size_t ndata, nsamp;
+
+	TEST_ASSERT(fe = fe_init_auto_r(config));
+	TEST_ASSERT(raw = fopen(TESTDATADIR "/chan3.raw", "rb"));
+	fseek(raw, 0, SEEK_END);
+	ndata = ftell(raw) / sizeof(int16);
+	fseek(raw, 0, SEEK_SET);
+	data = ckd_calloc(ndata, sizeof(*data));
+	TEST_EQUAL(ndata, fread(data, sizeof(int16), ndata, raw));
+	fclose(raw);
+
+	nsamp = ndata;
+	fe_process_frames(fe, NULL, &nsamp, NULL, &total);
+	cepbuf1 = ckd_calloc_2d(total + 1, fe_get_output_size(fe),
+				sizeof(**cepbuf1));
+	cepbuf2 = ckd_calloc_2d(total + 1, fe_get_output_size(fe),
+				sizeof(**cepbuf2));
+
+	TEST_EQUAL(0, fe_start_utt(fe));
+	inptr = data;
+	nsamp = ndata;
+	for (i = 0; i < total; ++i) {
+		nfr = 1;
+		TEST_ASSERT(fe_process_frames(fe, &inptr, &nsamp,
+					      &cepbuf1[i], &nfr) >= 0);
+		TEST_EQUAL(1, nfr);
+	}
+	TEST_ASSERT(fe_end_utt(fe, cepbuf1[total], &nfr) >= 0);
+
+	TEST_EQUAL(0, fe_start_utt(fe));
+	inptr = data;
+	nsamp = ndata;
+	nfr = total;
+	TEST_ASSERT(fe_process_frames(fe, &inptr, &nsamp, cepbuf2, &nfr) >= 0);
+	TEST_EQUAL(total, nfr);
+	TEST_ASSERT(fe_end_utt(fe, cepbuf2[total], &nfr) >= 0);
+
+	fe_get_input_size(fe, &frame_shift, &frame_size);
+	printf("%d frames of %d samples\n", total, frame_size);
+	TEST_EQUAL(0, memcmp(cepbuf1[0], cepbuf2[0],
+			     (total + 1) * fe_get_output_size(fe)
+			     * sizeof(**cepbuf1)));
+
+	ckd_free_2d(cepbuf1);
+	ckd_free_2d(cepbuf2);
+	ckd_free(data);
+	fe_free(fe);
+}
+
 int
 main(int argc, char *argv[])
 {
-	static const arg_t fe_args[] = {
-		waveform_to_cepstral_command_line_macro(),
-		{ NULL, 0, NULL, NULL }
-	};
 	FILE *raw;
 	cmd_ln_t *config;
 	fe_t *fe;
@@ -200,6 +262,20 @@ main(int argc, char *argv[])
 	ckd_free_2d(cepbuf2);
 	fclose(raw);
 	fe_free(fe);
+
+	test_whole_file(config);
+	cmd_ln_free_r(config);
+
+	/* Odd frame size (205 samples), with DC removal. */
+	TEST_ASSERT(config = cmd_ln_init(NULL, fe_args, FALSE,
+					 "-samprate", "8000",
+					 "-nfft", "256",
+					 "-nfilt", "31",
+					 "-lowerf", "200",
+					 "-upperf", "3500",
+					 "-remove_dc", "yes",
+					 NULL));
+	test_whole_file(config);
 	cmd_ln_free_r(config);
 
 	return 0;
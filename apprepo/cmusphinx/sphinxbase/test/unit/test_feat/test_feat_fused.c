@@ -0,0 +1,169 @@
+/**
+ * @file test_feat_fused.c Check and time live feature computation
+ * with prior CMN and LDA against separate passes over the frames.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "feat.h"
+#include "cmn.h"
+#include "ckd_alloc.h"
+#include "profile.h"
+#include "test_macros.h"
+
+#define CEPLEN 13
+#define LDA_DIM 32
+/* Enough for the CMN window to be shifted a few times. */
+#define N_FRAME 3000
+#define N_TIME 20
+
+static uint32 rand_state = 1;
+
+static float32
+next_rand(void)
+{
+	rand_state = rand_state * 1103515245 + 12345;
+	return (rand_state >> 8) / (float32)(1 << 24) - 0.5f;
+}
+
+/* Block sizes to feed the live feature computation, which vary so
+ * that the circular buffer wraps at different places. */
+static int32
+block_size(int32 i)
+{
+	return 1 + (i * 37) % 97;
+}
+
+/*
+ * Run the live feature computation over all of cep, recording the
+ * number of frames consumed by each call in blocks.
+ */
+static int32
+run_live(feat_t *fcb, mfcc_t **cep, mfcc_t ***feat, int32 *blocks)
+{
+	int32 nfr, nin, nblock;
+
+	nfr = nin = nblock = 0;
+	while (nin < N_FRAME) {
+		int32 ncep = block_size(nblock);
+
+		if (ncep > N_FRAME - nin)
+			ncep = N_FRAME - nin;
+		nfr += feat_s2mfc2feat_live(fcb, cep + nin, &ncep,
+					    nin == 0, nin + ncep == N_FRAME,
+					    feat + nfr);
+		/* If not all of it fit, end of utterance processing was
+		 * cancelled, and will be done with the rest. */
+		blocks[nblock++] = ncep;
+		nin += ncep;
+	}
+	blocks[nblock] = 0;
+	return nfr;
+}
+
+/*
+ * The same thing with a pass over all the frames for each of CMN,
+ * dynamic features and LDA.  This modifies cep.
+ */
+static int32
+run_passes(feat_t *fcb, cmn_t *cmn, mfcc_t **cep, mfcc_t ***feat,
+	   int32 const *blocks)
+{
+	mfcc_t **padded;
+	int32 i, nin, win;
+
+	for (i = nin = 0; blocks[i]; nin += blocks[i++])
+		cmn_prior(cmn, cep + nin, FALSE, blocks[i]);
+
+	win = feat_window_size(fcb);
+	padded = ckd_calloc(N_FRAME + 2 * win, sizeof(*padded));
+	for (i = 0; i < win; ++i) {
+		padded[i] = cep[0];
+		padded[N_FRAME + win + i] = cep[N_FRAME - 1];
+	}
+	memcpy(padded + win, cep, N_FRAME * sizeof(*padded));
+	for (i = 0; i < N_FRAME; ++i)
+		fcb->compute_feat(fcb, padded + win + i, feat[i]);
+	ckd_free(padded);
+
+	feat_lda_transform(fcb, feat, N_FRAME);
+	return N_FRAME;
+}
+
+int
+main(int argc, char *argv[])
+{
+	feat_t *fcb;
+	cmn_t *cmn;
+	mfcc_t **cep, **cep2;
+	mfcc_t ***feat, ***feat2;
+	int32 *blocks;
+	ptmr_t t_live, t_passes;
+	int32 i, j, nfr, nfr2;
+
+	cep = (mfcc_t **)ckd_calloc_2d(N_FRAME, CEPLEN, sizeof(mfcc_t));
+	cep2 = (mfcc_t **)ckd_calloc_2d(N_FRAME, CEPLEN, sizeof(mfcc_t));
+	for (i = 0; i < N_FRAME; ++i) {
+		cep[i][0] = FLOAT2MFCC(12.0 + 4 * next_rand());
+		for (j = 1; j < CEPLEN; ++j)
+			cep[i][j] = FLOAT2MFCC(2 * next_rand());
+	}
+	blocks = ckd_calloc(N_FRAME + 1, sizeof(*blocks));
+
+	TEST_ASSERT(fcb = feat_init("1s_c_d_dd", CMN_PRIOR, FALSE,
+				    AGC_NONE, TRUE, CEPLEN));
+	fcb->lda = (mfcc_t ***)ckd_calloc_3d(1, LDA_DIM, CEPLEN * 3,
+					     sizeof(mfcc_t));
+	fcb->n_lda = 1;
+	for (i = 0; i < LDA_DIM; ++i)
+		for (j = 0; j < CEPLEN * 3; ++j)
+			fcb->lda[0][i][j] = FLOAT2MFCC(next_rand());
+	fcb->out_dim = LDA_DIM;
+	TEST_EQUAL(LDA_DIM, feat_dimension(fcb));
+	cmn = cmn_init(CEPLEN);
+
+	feat = feat_array_alloc(fcb, N_FRAME + feat_window_size(fcb));
+	feat2 = feat_array_alloc(fcb, N_FRAME + feat_window_size(fcb));
+
+	/* The input is not modified, and the output is the same as
+	 * with separate passes. */
+	memcpy(cep2[0], cep[0], N_FRAME * CEPLEN * sizeof(mfcc_t));
+	nfr = run_live(fcb, cep, feat, blocks);
+	TEST_EQUAL(0, memcmp(cep2[0], cep[0], N_FRAME * CEPLEN * sizeof(mfcc_t)));
+	nfr2 = run_passes(fcb, cmn, cep2, feat2, blocks);
+	TEST_EQUAL(nfr2, nfr);
+	for (i = 0; i < nfr; ++i)
+		for (j = 0; j < CEPLEN * 3; ++j)
+			TEST_EQUAL(feat2[i][0][j], feat[i][0][j]);
+
+	/* Time them. */
+	ptmr_init(&t_live);
+	ptmr_init(&t_passes);
+	for (i = 0; i < N_TIME; ++i) {
+		ptmr_start(&t_live);
+		run_live(fcb, cep, feat, blocks);
+		ptmr_stop(&t_live);
+		memcpy(cep2[0], cep[0], N_FRAME * CEPLEN * sizeof(mfcc_t));
+		ptmr_start(&t_passes);
+		run_passes(fcb, cmn, cep2, feat2, blocks);
+		ptmr_stop(&t_passes);
+	}
+	printf("live: %.0f frames/sec, separate passes: %.0f frames/sec\n",
+	       N_FRAME * N_TIME / t_live.t_elapsed,
+	       N_FRAME * N_TIME / t_passes.t_elapsed);
+
+	feat_array_free(feat);
+	feat_array_free(feat2);
+	feat_free(fcb);
+	cmn_free(cmn);
+	ckd_free(blocks);
+	ckd_free_2d(cep);
+	ckd_free_2d(cep2);
+
+	return 0;
+}
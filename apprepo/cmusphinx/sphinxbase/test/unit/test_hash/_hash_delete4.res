@@ -1,7 +1,9 @@
-Hash with chaining representation of the hash table
-|key:-bla|len:4|val=8|->NULL
-|key:-subvq|len:6|val=7|->|key:-outlatdir|len:10|val=3|->NULL
-|key:-svq4svq|len:8|val=2|->|key:-lminmemory|len:11|val=6|->NULL
-|key:-lm|len:3|val=4|->NULL
-|key:-beam|len:5|val=5|->NULL
+Open addressing representation of the hash table
+|key:-subvq|len:6|val=7|dist:0|
+|key:-lm|len:3|val=4|dist:0|
+|key:-svq4svq|len:8|val=2|dist:0|
+|key:-bla|len:4|val=8|dist:0|
+|key:-beam|len:5|val=5|dist:0|
+|key:-outlatdir|len:10|val=3|dist:0|
+|key:-lminmemory|len:11|val=6|dist:0|
 The total number of keys =7
@@ -0,0 +1,186 @@
+/**
+ * @file test_hash_bench.c Check and time hash tables with many keys
+ */
+
+#include "hash_table.h"
+#include "ckd_alloc.h"
+#include "profile.h"
+#include "case.h"
+#include "test_macros.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N_KEY 200000
+#define N_LOOKUP 2000000
+
+static uint32 rand_state = 1;
+
+static uint32
+next_rand(void)
+{
+	rand_state = rand_state * 1103515245 + 12345;
+	return rand_state >> 8;
+}
+
+/* A random word, of the length of most dictionary words. */
+static char *
+random_word(char const *suffix)
+{
+	char buf[32];
+	int i, len;
+
+	len = 2 + next_rand() % 11;
+	for (i = 0; i < len; ++i)
+		buf[i] = 'a' + next_rand() % 26;
+	strcpy(buf + len, suffix);
+	return ckd_salloc(buf);
+}
+
+/* Bytes used by the table (not the keys). */
+static size_t
+table_bytes(hash_table_t *h)
+{
+	return sizeof(*h) + hash_table_size(h) * sizeof(hash_entry_t);
+}
+
+static double
+mrate(int n, ptmr_t *t)
+{
+	return n / t->t_elapsed / 1e6;
+}
+
+static void
+bench(int n_key, int nocase)
+{
+	hash_table_t *h;
+	hash_iter_t *itor;
+	char **keys, **lookup_keys, **missing;
+	ptmr_t t_enter, t_hit, t_miss;
+	int32 val;
+	int i, j, n;
+
+	keys = ckd_calloc(n_key, sizeof(*keys));
+	lookup_keys = ckd_calloc(n_key, sizeof(*lookup_keys));
+	missing = ckd_calloc(n_key, sizeof(*missing));
+	ptmr_init(&t_enter);
+	ptmr_init(&t_hit);
+	ptmr_init(&t_miss);
+
+	TEST_ASSERT(h = hash_table_new(n_key, nocase ? HASH_CASE_NO : HASH_CASE_YES));
+	for (i = 0; i < n_key; ++i)
+		keys[i] = random_word("");
+	ptmr_start(&t_enter);
+	for (i = n = 0; i < n_key; ++i) {
+		if (hash_table_enter_int32(h, keys[i], n) == n)
+			keys[n++] = keys[i];
+		else
+			ckd_free(keys[i]);
+	}
+	ptmr_stop(&t_enter);
+	TEST_EQUAL(n, hash_table_inuse(h));
+
+	/* Look keys up in another case (if allowed), and missing keys
+	 * (which are never made of letters only). */
+	for (i = 0; i < n; ++i) {
+		lookup_keys[i] = ckd_salloc(keys[i]);
+		if (nocase)
+			ucase(lookup_keys[i]);
+		missing[i] = random_word("1");
+	}
+	ptmr_start(&t_hit);
+	for (i = 0; i < N_LOOKUP; ++i) {
+		j = next_rand() % n;
+		TEST_EQUAL(0, hash_table_lookup_int32(h, lookup_keys[j], &val));
+		TEST_EQUAL(j, val);
+	}
+	ptmr_stop(&t_hit);
+	ptmr_start(&t_miss);
+	for (i = 0; i < N_LOOKUP; ++i) {
+		j = next_rand() % n;
+		TEST_EQUAL(-1, hash_table_lookup_int32(h, missing[j], NULL));
+	}
+	ptmr_stop(&t_miss);
+
+	printf("%s: %d keys, %.1f bytes/entry, "
+	       "enter %.2f M/s, lookup %.2f M/s, missing %.2f M/s\n",
+	       nocase ? "nocase" : "case", n,
+	       (double)table_bytes(h) / n, mrate(n, &t_enter),
+	       mrate(N_LOOKUP, &t_hit), mrate(N_LOOKUP, &t_miss));
+
+	/* Iterate over all keys. */
+	for (i = 0, itor = hash_table_iter(h); itor;
+	     itor = hash_table_iter_next(itor), ++i) {
+		j = (long)hash_entry_val(itor->ent);
+		TEST_ASSERT(j >= 0 && j < n);
+		TEST_EQUAL(keys[j], hash_entry_key(itor->ent));
+	}
+	TEST_EQUAL(n, i);
+
+	/* Delete every other key, and check that the others are still
+	 * there. */
+	for (i = 0; i < n; i += 2)
+		TEST_EQUAL(i, (long)hash_table_delete(h, keys[i]));
+	TEST_EQUAL(n / 2, hash_table_inuse(h));
+	for (i = 0; i < n; ++i) {
+		if (i % 2) {
+			TEST_EQUAL(0, hash_table_lookup_int32(h, lookup_keys[i], &val));
+			TEST_EQUAL(i, val);
+		}
+		else {
+			TEST_EQUAL(-1, hash_table_lookup_int32(h, lookup_keys[i], &val));
+		}
+	}
+	hash_table_free(h);
+
+	for (i = 0; i < n; ++i) {
+		ckd_free(keys[i]);
+		ckd_free(lookup_keys[i]);
+		ckd_free(missing[i]);
+	}
+	ckd_free(keys);
+	ckd_free(lookup_keys);
+	ckd_free(missing);
+}
+
+/* Start with an empty table, so that it has to grow. */
+static void
+grow(void)
+{
+	hash_table_t *h;
+	char **keys;
+	int32 val;
+	int i, n;
+
+	keys = ckd_calloc(N_KEY / 10, sizeof(*keys));
+	TEST_ASSERT(h = hash_table_new(0, HASH_CASE_YES));
+	for (i = n = 0; i < N_KEY / 10; ++i) {
+		keys[n] = random_word("");
+		if (hash_table_enter_int32(h, keys[n], n) == n)
+			++n;
+		else
+			ckd_free(keys[n]);
+	}
+	TEST_EQUAL(n, hash_table_inuse(h));
+	for (i = 0; i < n; ++i) {
+		TEST_EQUAL(0, hash_table_lookup_int32(h, keys[i], &val));
+		TEST_EQUAL(i, val);
+	}
+	hash_table_free(h);
+	for (i = 0; i < n; ++i)
+		ckd_free(keys[i]);
+	ckd_free(keys);
+}
+
+int
+main(int argc, char *argv[])
+{
+	/* Small enough to stay in cache, then large enough not to. */
+	bench(N_KEY / 40, FALSE);
+	bench(N_KEY / 40, TRUE);
+	bench(N_KEY, FALSE);
+	bench(N_KEY, TRUE);
+	grow();
+	return 0;
+}
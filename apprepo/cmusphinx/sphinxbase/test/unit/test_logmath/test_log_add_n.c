@@ -0,0 +1,186 @@
+#include <logmath.h>
+#include <profile.h>
+#include <ckd_alloc.h>
+
+#include <stdlib.h>
+#include <float.h>
+
+#include "test_macros.h"
+
+#define N_SUM 2000
+#define N_TIME 200000
+
+static uint32 rand_state = 1;
+
+static float64
+next_rand(void)
+{
+	rand_state = rand_state * 1103515245 + 12345;
+	return (rand_state >> 8) / (float64)(1 << 24);
+}
+
+/* Exact log-add of an array, rounded to the nearest integer. */
+static int
+add_n_exact(logmath_t *lmath, const int *x, int n)
+{
+	float64 scale, sum;
+	int i, r;
+
+	scale = log(logmath_get_base(lmath)) * (1 << logmath_get_shift(lmath));
+	r = x[0];
+	for (i = 1; i < n; ++i)
+		if (x[i] > r)
+			r = x[i];
+	sum = 0;
+	for (i = 0; i < n; ++i)
+		sum += exp((x[i] - r) * scale);
+	return r + (int)floor(log(sum) / scale + 0.5);
+}
+
+/* Values spread over a range of probabilities, like mixture
+ * components or lattice links. */
+static void
+random_logs(logmath_t *lmath, int *x, float32 *lnx, int n, float64 range)
+{
+	int i;
+
+	for (i = 0; i < n; ++i) {
+		lnx[i] = (float32)(-range * next_rand());
+		x[i] = logmath_ln_to_log(lmath, lnx[i]);
+	}
+}
+
+/*
+ * Check that logmath_add_n() is within 1 of the exact sum (and say
+ * how far adding one at a time with the table is from it).
+ */
+static void
+test_accuracy(logmath_t *lmath, int n, float64 range)
+{
+	int *x;
+	float32 *lnx;
+	int i, j, err, seq_err;
+
+	x = ckd_calloc(n, sizeof(*x));
+	lnx = ckd_calloc(n, sizeof(*lnx));
+	err = seq_err = 0;
+	for (i = 0; i < N_SUM; ++i) {
+		int ref, seq;
+		float64 lnref;
+
+		random_logs(lmath, x, lnx, n, range);
+		ref = add_n_exact(lmath, x, n);
+		if (abs(logmath_add_n(lmath, x, n) - ref) > err)
+			err = abs(logmath_add_n(lmath, x, n) - ref);
+		seq = logmath_get_zero(lmath);
+		for (j = 0; j < n; ++j)
+			seq = logmath_add(lmath, seq, x[j]);
+		if (abs(seq - ref) > seq_err)
+			seq_err = abs(seq - ref);
+
+		lnref = 0;
+		for (j = 0; j < n; ++j)
+			lnref += exp(lnx[j]);
+		lnref = log(lnref);
+		TEST_ASSERT(fabs(logmath_ln_add_n(lnx, n) - lnref)
+			    < 1e-5 * (1 + fabs(lnref)));
+	}
+	printf("base %g shift %d, %d values: "
+	       "max error %d (one at a time: %d)\n",
+	       logmath_get_base(lmath), logmath_get_shift(lmath),
+	       n, err, seq_err);
+	TEST_ASSERT(err <= 1);
+	ckd_free(x);
+	ckd_free(lnx);
+}
+
+/* Time adding n values, with logmath_add_n() and one at a time. */
+static void
+test_speed(logmath_t *lmath, int n)
+{
+	ptmr_t t_n, t_seq;
+	int *x;
+	float32 *lnx;
+	int i, j, acc;
+
+	x = ckd_calloc(n, sizeof(*x));
+	lnx = ckd_calloc(n, sizeof(*lnx));
+	random_logs(lmath, x, lnx, n, 20);
+	ptmr_init(&t_n);
+	ptmr_init(&t_seq);
+
+	acc = 0;
+	ptmr_start(&t_n);
+	for (i = 0; i < N_TIME; ++i) {
+		x[i % n] ^= 1;
+		acc += logmath_add_n(lmath, x, n);
+	}
+	ptmr_stop(&t_n);
+	ptmr_start(&t_seq);
+	for (i = 0; i < N_TIME; ++i) {
+		int seq = logmath_get_zero(lmath);
+		x[i % n] ^= 1;
+		for (j = 0; j < n; ++j)
+			seq = logmath_add(lmath, seq, x[j]);
+		acc -= seq;
+	}
+	ptmr_stop(&t_seq);
+	printf("add %d values: %.1f ns (one at a time: %.1f ns) %d\n",
+	       n, t_n.t_elapsed / N_TIME * 1e9,
+	       t_seq.t_elapsed / N_TIME * 1e9, acc != 0);
+	ckd_free(x);
+	ckd_free(lnx);
+}
+
+int
+main(int argc, char *argv[])
+{
+	logmath_t *lmath;
+	int x[3];
+	float32 lnx[2];
+
+	/* The usual acoustic and language model bases. */
+	TEST_ASSERT(lmath = logmath_init(1.0001, 0, TRUE));
+	test_accuracy(lmath, 2, 10);
+	test_accuracy(lmath, 4, 10);
+	test_accuracy(lmath, 32, 30);
+	test_accuracy(lmath, 64, 30);
+	test_accuracy(lmath, 300, 100);
+	test_speed(lmath, 4);
+	test_speed(lmath, 64);
+	test_speed(lmath, 256);
+
+	/* Zero plus anything is itself, and the sum of nothing is zero. */
+	x[0] = logmath_get_zero(lmath);
+	x[1] = logmath_log(lmath, 0.25);
+	x[2] = MAX_NEG_INT32;
+	TEST_EQUAL(x[1], logmath_add_n(lmath, x, 3));
+	TEST_EQUAL(x[0], logmath_add_n(lmath, x, 1));
+	TEST_EQUAL(logmath_get_zero(lmath), logmath_add_n(lmath, x, 0));
+	lnx[0] = -FLT_MAX;
+	lnx[1] = -3.0f;
+	TEST_EQUAL(-3.0f, logmath_ln_add_n(lnx, 2));
+	TEST_EQUAL(-FLT_MAX, logmath_ln_add_n(lnx, 1));
+	TEST_EQUAL(-FLT_MAX, logmath_ln_add_n(lnx, 0));
+	logmath_free(lmath);
+
+	/* Senone scores are shifted. */
+	TEST_ASSERT(lmath = logmath_init(1.0001, 10, TRUE));
+	test_accuracy(lmath, 4, 20);
+	test_accuracy(lmath, 64, 50);
+	logmath_free(lmath);
+
+	/* And 8-bit tables have a much bigger base. */
+	TEST_ASSERT(lmath = logmath_init(1.003, 0, TRUE));
+	test_accuracy(lmath, 4, 10);
+	test_accuracy(lmath, 64, 30);
+	logmath_free(lmath);
+
+	/* Without a table, short arrays are not added one at a time. */
+	TEST_ASSERT(lmath = logmath_init(1.0001, 0, FALSE));
+	test_accuracy(lmath, 2, 10);
+	test_accuracy(lmath, 5, 10);
+	logmath_free(lmath);
+
+	return 0;
+}
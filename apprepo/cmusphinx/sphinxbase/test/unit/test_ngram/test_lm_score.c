@@ -1,6 +1,7 @@
 #include <ngram_model.h>
 #include <logmath.h>
 #include <strfuncs.h>
+#include <ckd_alloc.h>
 
 #include "test_macros.h"
 
@@ -8,6 +9,49 @@
 #include <string.h>
 #include <math.h>
 
+/* Batch scores must be the same as one word at a time. */
+static void
+test_batch(ngram_model_t *model)
+{
+	ngram_iter_t *itor;
+	int32 *wids, *scores;
+	int32 n_words, i, n_used;
+
+	n_words = ngram_model_get_counts(model)[0];
+	wids = ckd_calloc(n_words + 3, sizeof(*wids));
+	scores = ckd_calloc(n_words + 3, sizeof(*scores));
+	for (i = 0; i < n_words; ++i)
+		wids[i] = i;
+	/* Out of order, repeated and invalid words. */
+	wids[n_words] = 0;
+	wids[n_words + 1] = n_words - 1;
+	wids[n_words + 2] = NGRAM_INVALID_WID;
+
+	for (itor = ngram_model_mgrams(model, 1); itor;
+	     itor = ngram_iter_next(itor)) {
+		int32 score, bowt, hist[2];
+		int32 const *bg = ngram_iter_get(itor, &score, &bowt);
+
+		hist[0] = bg[1];
+		hist[1] = bg[0];
+		ngram_ng_score_batch(model, wids, n_words + 3, hist, 2, scores);
+		for (i = 0; i < n_words + 2; ++i)
+			TEST_EQUAL(scores[i],
+				   ngram_ng_score(model, wids[i], hist, 2, &n_used));
+		TEST_EQUAL(scores[n_words + 2], ngram_zero(model));
+		ngram_ng_score_batch(model, wids, n_words, hist, 1, scores);
+		for (i = 0; i < n_words; ++i)
+			TEST_EQUAL(scores[i],
+				   ngram_ng_score(model, wids[i], hist, 1, &n_used));
+	}
+	ngram_ng_score_batch(model, wids, n_words, NULL, 0, scores);
+	for (i = 0; i < n_words; ++i)
+		TEST_EQUAL(scores[i],
+			   ngram_ng_score(model, wids[i], NULL, 0, &n_used));
+	ckd_free(wids);
+	ckd_free(scores);
+}
+
 void
 run_tests(ngram_model_t *model)
 {
@@ -23,9 +67,11 @@ run_tests(ngram_model_t *model)
 		       ngram_wid(model, "david"),
 		       ngram_wid(model, "david"), &n_used);
 	TEST_EQUAL(n_used, 1);
+	test_batch(model);
 
 	/* Apply weights. */
 	ngram_model_apply_weights(model, 7.5, 0.5, 1.0);
+	test_batch(model);
 	/* -9452 * 7.5 + log(0.5) = -77821 */
 	TEST_EQUAL_LOG(ngram_score(model, "daines", "huggins", "david", NULL),
 		   -77821);
@@ -167,6 +167,51 @@ main(int argc, char *argv[])
 	TEST_EQUAL_LOG(ngram_score(lmset, "daines", "huggins", "david", NULL),
 		       logmath_log10_to_log(lmath, -0.4105));
 
+	/* Batch scores go through the word ID mapping. */
+	{
+		int32 wids[3], hist[2], scores[3], n_used;
+
+		wids[0] = ngram_wid(lmset, "daines");
+		wids[1] = ngram_wid(lmset, "sphinxtrain");
+		wids[2] = ngram_wid(lmset, "bigbird");
+		hist[0] = ngram_wid(lmset, "huggins");
+		hist[1] = ngram_wid(lmset, "david");
+		ngram_ng_score_batch(lmset, wids, 3, hist, 2, scores);
+		TEST_EQUAL_LOG(scores[0], logmath_log10_to_log(lmath, -0.4105));
+		TEST_EQUAL(scores[1], ngram_ng_score(lmset, wids[1], hist, 2, &n_used));
+		TEST_EQUAL(scores[2], ngram_ng_score(lmset, wids[2], hist, 2, &n_used));
+	}
+
+	/* Test copies sharing the same language models. */
+	{
+		ngram_model_t *dup;
+
+		TEST_ASSERT(dup = ngram_model_set_dup(lmset));
+		TEST_EQUAL(0, strcmp(ngram_model_set_current(dup), "100"));
+		TEST_EQUAL(ngram_wid(dup, "sphinxtrain"), ngram_wid(lmset, "sphinxtrain"));
+		TEST_EQUAL_LOG(ngram_score(dup, "daines", "huggins", "david", NULL),
+			       logmath_log10_to_log(lmath, -0.4105));
+		/* Selecting a model in the copy leaves the original alone. */
+		ngram_model_set_select(dup, "100_2");
+		TEST_EQUAL_LOG(ngram_score(dup, "daines", "huggins", "david", NULL),
+			       logmath_log10_to_log(lmath, -0.0512));
+		TEST_EQUAL_LOG(ngram_score(lmset, "daines", "huggins", "david", NULL),
+			       logmath_log10_to_log(lmath, -0.4105));
+		/* Sharing the models does not change their scores. */
+		ngram_model_set_share(dup, TRUE);
+		ngram_model_set_share(dup, TRUE);
+		TEST_EQUAL_LOG(ngram_score(dup, "daines", "huggins", "david", NULL),
+			       logmath_log10_to_log(lmath, -0.0512));
+		TEST_EQUAL_LOG(ngram_score(lmset, "daines", "huggins", "david", NULL),
+			       logmath_log10_to_log(lmath, -0.4105));
+		ngram_model_set_share(dup, FALSE);
+		ngram_model_flush(lmset);
+		ngram_model_set_share(dup, TRUE);
+		ngram_model_free(dup);
+		TEST_EQUAL_LOG(ngram_score(lmset, "daines", "huggins", "david", NULL),
+			       logmath_log10_to_log(lmath, -0.4105));
+	}
+
 	/* Test class probabilities. */
 	ngram_model_set_select(lmset, "100");
 	TEST_EQUAL_LOG(ngram_score(lmset, "scylla:scylla", NULL),
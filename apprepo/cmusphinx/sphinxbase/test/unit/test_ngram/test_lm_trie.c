@@ -0,0 +1,245 @@
+#include <ngram_model.h>
+#include <logmath.h>
+#include <strfuncs.h>
+#include <err.h>
+#include <ckd_alloc.h>
+
+#include "test_macros.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define N_BENCH 20
+
+static const arg_t defn[] = {
+	{ "-mmap", ARG_BOOLEAN, "no", "use mmap" },
+	{ "-lw", ARG_FLOAT32, "1.0", "language weight" },
+	{ "-wip", ARG_FLOAT32, "1.0", "word insertion penalty" },
+	{ "-uw", ARG_FLOAT32, "1.0", "unigram weight" },
+	{ NULL, 0, NULL, NULL }
+};
+
+static void
+test_four_vals(ngram_model_t *model, logmath_t *lmath)
+{
+	int32 hist[3], n_used;
+
+	TEST_ASSERT(model);
+	TEST_EQUAL(ngram_model_get_size(model), 4);
+	TEST_EQUAL(ngram_model_get_counts(model)[3], 2);
+	TEST_EQUAL_LOG(ngram_score(model, "three", "two", "one", "<s>", NULL),
+		       logmath_log10_to_log(lmath, -0.1));
+	hist[0] = ngram_wid(model, "three");
+	hist[1] = ngram_wid(model, "two");
+	hist[2] = ngram_wid(model, "one");
+	TEST_EQUAL_LOG(ngram_ng_score(model, ngram_wid(model, "four"),
+				      hist, 3, &n_used),
+		       logmath_log10_to_log(lmath, -0.15));
+	TEST_EQUAL(n_used, 4);
+	/* Back off to the bigram. */
+	hist[2] = ngram_wid(model, "two");
+	TEST_EQUAL_LOG(ngram_ng_score(model, ngram_wid(model, "four"),
+				      hist, 3, &n_used),
+		       logmath_log10_to_log(lmath, -0.25 - 0.15 - 0.6));
+	TEST_EQUAL(n_used, 2);
+	/* And all the way to the unigram. */
+	hist[2] = ngram_wid(model, "one");
+	TEST_EQUAL_LOG(ngram_ng_score(model, ngram_wid(model, "</s>"),
+				      hist, 3, &n_used),
+		       logmath_log10_to_log(lmath, -0.15 - 0.15 - 0.15 - 1.0));
+	TEST_EQUAL(n_used, 1);
+	/* Shorter histories. */
+	TEST_EQUAL_LOG(ngram_tg_score(model, ngram_wid(model, "two"),
+				      ngram_wid(model, "one"),
+				      ngram_wid(model, "<s>"), &n_used),
+		       logmath_log10_to_log(lmath, -0.1));
+	TEST_EQUAL(n_used, 3);
+	TEST_EQUAL_LOG(ngram_score(model, "two", NULL),
+		       logmath_log10_to_log(lmath, -0.7));
+}
+
+/* Compare all scores and N-Grams of two trigram models. */
+static void
+test_same_scores(ngram_model_t *ref, ngram_model_t *model)
+{
+	int32 n_words, *all, *rscores, *scores;
+	int m;
+
+	TEST_EQUAL(ngram_model_get_size(ref), ngram_model_get_size(model));
+	n_words = ngram_model_get_counts(ref)[0];
+	all = ckd_calloc(n_words, sizeof(*all));
+	rscores = ckd_calloc(n_words, sizeof(*rscores));
+	scores = ckd_calloc(n_words, sizeof(*scores));
+	for (m = 0; m < n_words; ++m)
+		all[m] = m;
+	for (m = 0; m < ngram_model_get_size(ref); ++m) {
+		ngram_iter_t *ritor, *itor;
+		int32 count = 0;
+
+		TEST_EQUAL(ngram_model_get_counts(ref)[m],
+			   ngram_model_get_counts(model)[m]);
+		for (ritor = ngram_model_mgrams(ref, m),
+			     itor = ngram_model_mgrams(model, m);
+		     ritor && itor;
+		     ritor = ngram_iter_next(ritor),
+			     itor = ngram_iter_next(itor)) {
+			int32 const *rwids, *wids;
+			int32 rscore, rbowt, score, bowt;
+			int32 hist[2], rn_used, n_used;
+			int j;
+
+			rwids = ngram_iter_get(ritor, &rscore, &rbowt);
+			wids = ngram_iter_get(itor, &score, &bowt);
+			TEST_EQUAL(0, memcmp(rwids, wids, (m + 1) * sizeof(*wids)));
+			TEST_EQUAL(rscore, score);
+			TEST_EQUAL(rbowt, bowt);
+
+			for (j = 0; j < m; ++j)
+				hist[j] = wids[m - 1 - j];
+			TEST_EQUAL(ngram_ng_score(ref, wids[m], hist, m, &rn_used),
+				   ngram_ng_score(model, wids[m], hist, m, &n_used));
+			TEST_EQUAL(rn_used, n_used);
+			/* Unseen N-Grams back off the same way. */
+			TEST_EQUAL(ngram_ng_score(ref, 0, hist, m, &rn_used),
+				   ngram_ng_score(model, 0, hist, m, &n_used));
+			TEST_EQUAL(rn_used, n_used);
+			/* And so do all successors of this N-Gram. */
+			if (m + 1 < ngram_model_get_size(ref)) {
+				int32 bhist[2];
+				for (j = 0; j <= m; ++j)
+					bhist[j] = wids[m - j];
+				ngram_ng_score_batch(ref, all, n_words,
+						     bhist, m + 1, rscores);
+				ngram_ng_score_batch(model, all, n_words,
+						     bhist, m + 1, scores);
+				TEST_EQUAL(0, memcmp(rscores, scores,
+						     n_words * sizeof(*scores)));
+			}
+			++count;
+		}
+		TEST_ASSERT(ritor == NULL && itor == NULL);
+		TEST_EQUAL(count, ngram_model_get_counts(ref)[m]);
+	}
+	ckd_free(all);
+	ckd_free(rscores);
+	ckd_free(scores);
+}
+
+static double
+lookup_rate(ngram_model_t *model, int32 *tg, int32 n_tg)
+{
+	clock_t c = clock();
+	int32 n_used;
+	int i, j;
+
+	for (i = 0; i < N_BENCH; ++i)
+		for (j = 0; j < n_tg; ++j)
+			ngram_tg_score(model, tg[j * 3 + 2], tg[j * 3 + 1],
+				       tg[j * 3], &n_used);
+	return (double)N_BENCH * n_tg * CLOCKS_PER_SEC
+		/ (clock() - c + 1);
+}
+
+static long
+file_size(char const *file)
+{
+	FILE *fh;
+	long size;
+
+	TEST_ASSERT(fh = fopen(file, "rb"));
+	fseek(fh, 0, SEEK_END);
+	size = ftell(fh);
+	fclose(fh);
+	return size;
+}
+
+int
+main(int argc, char *argv[])
+{
+	logmath_t *lmath;
+	ngram_model_t *ref, *model;
+	ngram_iter_t *itor;
+	cmd_ln_t *config;
+	int32 *tg, n_tg, n_used;
+
+	lmath = logmath_init(1.0001, 0, 0);
+	config = cmd_ln_parse_r(NULL, defn, 0, NULL, FALSE);
+
+	/* Trigrams convert exactly. */
+	E_INFO("Converting DMP to trie\n");
+	ref = ngram_model_read(NULL, LMDIR "/100.arpa.DMP", NGRAM_DMP, lmath);
+	TEST_ASSERT(ref);
+	TEST_EQUAL(0, ngram_model_write(ref, "100.tmp.lm.bin", NGRAM_AUTO));
+	model = ngram_model_read(NULL, "100.tmp.lm.bin", NGRAM_AUTO, lmath);
+	TEST_ASSERT(model);
+	test_same_scores(ref, model);
+	TEST_EQUAL_LOG(ngram_score(model, "daines", "huggins", "david", NULL), -9452);
+	TEST_EQUAL_LOG(ngram_score(model, "<UNK>", NULL), -75346);
+
+	/* Lookup speed and size compared to DMP. */
+	n_tg = ngram_model_get_counts(ref)[2];
+	tg = ckd_calloc(n_tg * 3, sizeof(*tg));
+	n_tg = 0;
+	for (itor = ngram_model_mgrams(ref, 2); itor; itor = ngram_iter_next(itor)) {
+		int32 score, bowt;
+		memcpy(tg + n_tg++ * 3, ngram_iter_get(itor, &score, &bowt),
+		       3 * sizeof(*tg));
+	}
+	printf("DMP: %.0f lookups/sec, %ld bytes\n",
+	       lookup_rate(ref, tg, n_tg), file_size(LMDIR "/100.arpa.DMP"));
+	printf("trie: %.0f lookups/sec, %ld bytes\n",
+	       lookup_rate(model, tg, n_tg), file_size("100.tmp.lm.bin"));
+	ckd_free(tg);
+	ngram_model_free(model);
+
+	/* Same thing memory-mapped, with weights applied. */
+	cmd_ln_set_boolean_r(config, "-mmap", TRUE);
+	cmd_ln_set_float32_r(config, "-lw", 6.5);
+	cmd_ln_set_float32_r(config, "-wip", 0.2);
+	cmd_ln_set_float32_r(config, "-uw", 0.7);
+	ngram_model_free(ref);
+	ref = ngram_model_read(config, LMDIR "/100.arpa.DMP", NGRAM_DMP, lmath);
+	model = ngram_model_read(config, "100.tmp.lm.bin", NGRAM_BIN, lmath);
+	TEST_ASSERT(model);
+	test_same_scores(ref, model);
+	/* Read-only, so no new words. */
+	TEST_ASSERT(ngram_model_add_word(model, "foobie", 1.0) < 0);
+	ngram_model_free(model);
+	cmd_ln_set_boolean_r(config, "-mmap", FALSE);
+	cmd_ln_set_float32_r(config, "-lw", 1.0);
+	cmd_ln_set_float32_r(config, "-wip", 1.0);
+	cmd_ln_set_float32_r(config, "-uw", 1.0);
+
+	/* Words can be added otherwise. */
+	model = ngram_model_read(config, "100.tmp.lm.bin", NGRAM_BIN, lmath);
+	TEST_ASSERT(ngram_model_add_word(model, "foobie", 1.0) >= 0);
+	TEST_ASSERT(ngram_score(model, "foobie", NULL) > -100000);
+	ngram_bg_score(model, ngram_wid(model, "foobie"),
+		       ngram_wid(model, "david"), &n_used);
+	TEST_EQUAL(n_used, 1);
+	TEST_EQUAL_LOG(ngram_score(model, "daines", "huggins", "david", NULL), -9452);
+	ngram_model_free(model);
+	ngram_model_free(ref);
+
+	/* 4-grams are read from ARPA files into a trie. */
+	E_INFO("Reading 4-gram ARPA file\n");
+	model = ngram_model_read(config, LMDIR "/four.lm", NGRAM_ARPA, lmath);
+	test_four_vals(model, lmath);
+	TEST_ASSERT(ngram_model_write(model, "four.tmp.DMP", NGRAM_DMP) < 0);
+	TEST_EQUAL(0, ngram_model_write(model, "four.tmp.lm.bin", NGRAM_BIN));
+	TEST_EQUAL(0, ngram_model_write(model, "four.tmp.arpa", NGRAM_ARPA));
+	ngram_model_free(model);
+
+	model = ngram_model_read(config, "four.tmp.lm.bin", NGRAM_AUTO, lmath);
+	test_four_vals(model, lmath);
+	ngram_model_free(model);
+	model = ngram_model_read(config, "four.tmp.arpa", NGRAM_AUTO, lmath);
+	test_four_vals(model, lmath);
+	ngram_model_free(model);
+
+	cmd_ln_free_r(config);
+	logmath_free(lmath);
+	return 0;
+}